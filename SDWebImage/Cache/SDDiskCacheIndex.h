@@ -0,0 +1,178 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+/*
+ 磁盘缓存索引
+
+ 记录磁盘缓存目录中每个文件的大小、写入时间、访问时间和过期时间，
+ 并以追加写入的日志文件（journal）持久化在缓存目录中。
+ 这样计算缓存大小、数量以及清理过期文件时都不需要再遍历整个缓存目录。
+
+ 只有在日志文件不存在或者损坏时，才会分批扫描缓存目录重建索引。
+ */
+
+#import <Foundation/Foundation.h>
+#import "SDWebImageCompat.h"
+
+/**
+ * An immutable snapshot of one file tracked by `SDDiskCacheIndex`.
+ * All times are seconds since 1970.
+ */
+@interface SDDiskCacheIndexEntry : NSObject
+
+/**
+ * The file name, relative to the indexed directory
+ */
+@property (nonatomic, copy, readonly, nonnull) NSString *fileName;
+
+/**
+ * The file size in bytes
+ */
+@property (nonatomic, assign, readonly) NSUInteger size;
+
+/**
+ * When the file was written (写入时间)
+ */
+@property (nonatomic, assign, readonly) NSTimeInterval modificationTime;
+
+/**
+ * When the file was last read (最近访问时间)
+ */
+@property (nonatomic, assign, readonly) NSTimeInterval accessTime;
+
+/**
+ * How many times the file has been read since it was written (命中次数)
+ */
+@property (nonatomic, assign, readonly) NSUInteger accessCount;
+
+/**
+ * An explicit expiration time, or 0 if the file expires according to `SDImageCacheConfig.maxCacheAge`
+ */
+@property (nonatomic, assign, readonly) NSTimeInterval expirationTime;
+
+/**
+ * The `ETag` of the HTTP response the file was downloaded with, if any
+ */
+@property (nonatomic, copy, readonly, nullable) NSString *ETag;
+
+/**
+ * The `Last-Modified` date of the HTTP response the file was downloaded with, as sent by the server
+ */
+@property (nonatomic, copy, readonly, nullable) NSString *lastModified;
+
+/**
+ * Until when the file can be used without revalidating it with the server, or 0 if it must always be revalidated.
+ * This is HTTP freshness, unrelated to `expirationTime` (HTTP 新鲜度，不影响文件的清理)
+ */
+@property (nonatomic, assign, readonly) NSTimeInterval freshnessTime;
+
+@end
+
+/**
+ * A persistent, append-only index of the files stored in a disk cache directory.
+ *
+ * The index is thread safe. Methods taking a file manager touch the file system and should be
+ * called from the queue owning that file manager.
+ */
+@interface SDDiskCacheIndex : NSObject
+
+/**
+ * The indexed directory. The journal is stored in it as a hidden file.
+ */
+@property (nonatomic, copy, readonly, nonnull) NSString *directory;
+
+/**
+ * YES once the journal has been read or the directory has been fully scanned.
+ * Until then `totalSize` and `count` only reflect what is known so far.
+ */
+@property (nonatomic, assign, readonly, getter=isLoaded) BOOL loaded;
+
+/**
+ * The sum of all entry sizes, in bytes
+ */
+@property (nonatomic, assign, readonly) NSUInteger totalSize;
+
+/**
+ * The number of entries
+ */
+@property (nonatomic, assign, readonly) NSUInteger count;
+
+- (nonnull instancetype)initWithDirectory:(nonnull NSString *)directory NS_DESIGNATED_INITIALIZER;
+- (nonnull instancetype)init NS_UNAVAILABLE;
+
+/**
+ * Load the index from the journal.
+ *
+ * @return NO if the journal is missing or corrupt, in which case the index must be rebuilt with
+ *         `rebuildWithFileManager:batchSize:`
+ */
+- (BOOL)loadJournal;
+
+/**
+ * Scan the next batch of files of the directory to rebuild the index.
+ * The first call discards the journal, the last one writes a fresh journal.
+ *
+ * @param fileManager the file manager used to enumerate the directory
+ * @param batchSize   the maximum number of files to scan in this call
+ *
+ * @return YES once the index is loaded
+ */
+- (BOOL)rebuildWithFileManager:(nonnull NSFileManager *)fileManager batchSize:(NSUInteger)batchSize;
+
+/**
+ * Return the entry for a file name, if any
+ */
+- (nullable SDDiskCacheIndexEntry *)entryForFileName:(nonnull NSString *)fileName;
+
+/**
+ * Return a snapshot of all entries
+ */
+- (nonnull NSArray<SDDiskCacheIndexEntry *> *)allEntries;
+
+/**
+ * Record that a file has just been written
+ *
+ * @param fileName       the file name, relative to `directory`
+ * @param size           the file size in bytes
+ * @param expirationTime an explicit expiration time, or 0 to use the cache max age
+ */
+- (void)setEntryForFileName:(nonnull NSString *)fileName size:(NSUInteger)size expirationTime:(NSTimeInterval)expirationTime;
+
+/**
+ * Record the HTTP validators and freshness of a file, replacing the previous ones.
+ * Writing the file again with `setEntryForFileName:size:expirationTime:` clears them.
+ *
+ * @return NO if there is no entry for the file
+ */
+- (BOOL)setHTTPValidatorsForFileName:(nonnull NSString *)fileName
+                                ETag:(nullable NSString *)ETag
+                        lastModified:(nullable NSString *)lastModified
+                       freshnessTime:(NSTimeInterval)freshnessTime;
+
+/**
+ * Record that a file has just been read. This only updates the in-memory entry, access records are
+ * appended to the journal in batches and flushed by `synchronize`.
+ */
+- (void)recordAccessForFileName:(nonnull NSString *)fileName;
+
+/**
+ * Record that a file has been removed
+ */
+- (void)removeEntryForFileName:(nonnull NSString *)fileName;
+
+/**
+ * Forget all entries and reset the journal. Call this after the directory has been cleared.
+ */
+- (void)removeAllEntries;
+
+/**
+ * Flush the pending access records and compact the journal if it holds too many superseded records
+ */
+- (void)synchronize;
+
+@end
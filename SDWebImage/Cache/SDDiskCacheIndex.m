@@ -0,0 +1,620 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDDiskCacheIndex.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+/*
+ 日志文件格式（每行一条记录，字段以 \t 分隔）：
+
+     SDDiskCacheIndex   2                                                      文件头和版本号
+     +   fileName   size   modificationTime   accessTime   accessCount   expirationTime   写入文件
+     -   fileName                                                              删除文件
+     @   fileName   accessTime                                                 读取文件（批量写入）
+     =   fileName   ETag   lastModified   freshnessTime                        HTTP 校验信息，空字段表示没有
+
+ 读取日志时按顺序回放所有记录即可得到当前的索引。
+ 最后一行如果不完整（例如写入时进程被杀），直接丢弃；其它任何格式错误（包括版本号不同）都视为日志损坏，需要重建索引。
+ */
+static NSString * const kSDDiskCacheIndexFileName = @".sdindex";
+static const char kSDDiskCacheIndexHeader[] = "SDDiskCacheIndex\t2\n";
+// Superseded records tolerated before the journal is rewritten
+static const NSUInteger kSDDiskCacheIndexCompactThreshold = 4096;
+// Pending access records buffered before they are appended to the journal
+static const NSUInteger kSDDiskCacheIndexAccessBufferSize = 16 * 1024;
+static const NSUInteger kSDDiskCacheIndexMaxFields = 7;
+
+@interface SDDiskCacheIndexEntry ()
+
+- (nonnull instancetype)initWithFileName:(nonnull NSString *)fileName
+                                    size:(NSUInteger)size
+                        modificationTime:(NSTimeInterval)modificationTime
+                              accessTime:(NSTimeInterval)accessTime
+                             accessCount:(NSUInteger)accessCount
+                          expirationTime:(NSTimeInterval)expirationTime;
+
+- (nonnull instancetype)entryByRecordingAccessAtTime:(NSTimeInterval)accessTime;
+
+- (nonnull instancetype)entryBySettingETag:(nullable NSString *)ETag lastModified:(nullable NSString *)lastModified freshnessTime:(NSTimeInterval)freshnessTime;
+
+- (BOOL)hasHTTPValidators;
+
+@end
+
+@implementation SDDiskCacheIndexEntry
+
+- (nonnull instancetype)initWithFileName:(nonnull NSString *)fileName
+                                    size:(NSUInteger)size
+                        modificationTime:(NSTimeInterval)modificationTime
+                              accessTime:(NSTimeInterval)accessTime
+                             accessCount:(NSUInteger)accessCount
+                          expirationTime:(NSTimeInterval)expirationTime {
+    if ((self = [super init])) {
+        _fileName = [fileName copy];
+        _size = size;
+        _modificationTime = modificationTime;
+        _accessTime = accessTime;
+        _accessCount = accessCount;
+        _expirationTime = expirationTime;
+    }
+    return self;
+}
+
+- (nonnull instancetype)entryByRecordingAccessAtTime:(NSTimeInterval)accessTime {
+    SDDiskCacheIndexEntry *entry = [[SDDiskCacheIndexEntry alloc] initWithFileName:self.fileName
+                                                                              size:self.size
+                                                                  modificationTime:self.modificationTime
+                                                                        accessTime:MAX(accessTime, self.accessTime)
+                                                                       accessCount:self.accessCount + 1
+                                                                    expirationTime:self.expirationTime];
+    return [entry entryBySettingETag:self.ETag lastModified:self.lastModified freshnessTime:self.freshnessTime];
+}
+
+- (nonnull instancetype)entryBySettingETag:(nullable NSString *)ETag lastModified:(nullable NSString *)lastModified freshnessTime:(NSTimeInterval)freshnessTime {
+    SDDiskCacheIndexEntry *entry = [[SDDiskCacheIndexEntry alloc] initWithFileName:self.fileName
+                                                                              size:self.size
+                                                                  modificationTime:self.modificationTime
+                                                                        accessTime:self.accessTime
+                                                                       accessCount:self.accessCount
+                                                                    expirationTime:self.expirationTime];
+    entry->_ETag = [ETag copy];
+    entry->_lastModified = [lastModified copy];
+    entry->_freshnessTime = freshnessTime;
+    return entry;
+}
+
+- (BOOL)hasHTTPValidators {
+    return self.ETag || self.lastModified || self.freshnessTime > 0;
+}
+
+@end
+
+#pragma mark - Journal encoding
+
+// File names may contain the journal separators in their extension, escape them. HTTP validators are escaped the same way
+static NSString *SDDiskCacheIndexEscapedFileName(NSString *fileName) {
+    static NSCharacterSet *reservedCharacters;
+    static NSCharacterSet *allowedCharacters;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        reservedCharacters = [NSCharacterSet characterSetWithCharactersInString:@"%\t\r\n"];
+        allowedCharacters = reservedCharacters.invertedSet;
+    });
+    if ([fileName rangeOfCharacterFromSet:reservedCharacters].location == NSNotFound) {
+        return fileName;
+    }
+    return [fileName stringByAddingPercentEncodingWithAllowedCharacters:allowedCharacters];
+}
+
+static NSString *SDDiskCacheIndexFileNameFromField(const char *field, size_t length) {
+    if (length == 0) {
+        return nil;
+    }
+    NSString *fileName = [[NSString alloc] initWithBytes:field length:length encoding:NSUTF8StringEncoding];
+    if (fileName && memchr(field, '%', length)) {
+        fileName = [fileName stringByRemovingPercentEncoding];
+    }
+    return fileName;
+}
+
+static BOOL SDDiskCacheIndexNumberFromField(const char *field, size_t length, long long *value) {
+    char buffer[32];
+    if (length == 0 || length >= sizeof(buffer)) {
+        return NO;
+    }
+    memcpy(buffer, field, length);
+    buffer[length] = '\0';
+    char *end = NULL;
+    long long number = strtoll(buffer, &end, 10);
+    if (end != buffer + length || number < 0) {
+        return NO;
+    }
+    *value = number;
+    return YES;
+}
+
+// Split a line into at most `maxFields` tab separated fields, return the number of fields
+static NSUInteger SDDiskCacheIndexSplitLine(const char *line, size_t length, const char **fields, size_t *lengths, NSUInteger maxFields) {
+    NSUInteger count = 0;
+    const char *cursor = line;
+    const char *end = line + length;
+    while (count < maxFields) {
+        const char *tab = memchr(cursor, '\t', end - cursor);
+        const char *fieldEnd = tab ?: end;
+        fields[count] = cursor;
+        lengths[count] = fieldEnd - cursor;
+        count++;
+        if (!tab) {
+            return count;
+        }
+        cursor = tab + 1;
+    }
+    // Too many fields
+    return maxFields + 1;
+}
+
+@interface SDDiskCacheIndex ()
+
+@property (nonatomic, copy, readwrite, nonnull) NSString *directory;
+@property (nonatomic, copy, nonnull) NSString *journalPath;
+@property (nonatomic, strong, nonnull) NSMutableDictionary<NSString *, SDDiskCacheIndexEntry *> *entries;
+@property (nonatomic, strong, nonnull) dispatch_semaphore_t lock;
+// 重建索引时使用的目录枚举器，不为空表示正在重建
+@property (nonatomic, strong, nullable) NSDirectoryEnumerator<NSURL *> *rebuildEnumerator;
+// 索引加载完成之前删除的文件，日志和目录枚举器中可能还有它们
+@property (nonatomic, strong, nullable) NSMutableSet<NSString *> *removedBeforeLoading;
+// 还没有写入日志的读取记录，攒够一批再写，避免每次读取都写文件
+@property (nonatomic, strong, nonnull) NSMutableData *pendingAccessRecords;
+
+@end
+
+@implementation SDDiskCacheIndex {
+    int _journalFD;
+    BOOL _loaded;
+    NSUInteger _totalSize;
+    NSUInteger _journalRecordCount;
+    NSUInteger _pendingAccessRecordCount;
+}
+
+- (nonnull instancetype)initWithDirectory:(nonnull NSString *)directory {
+    if ((self = [super init])) {
+        _directory = [directory copy];
+        _journalPath = [directory stringByAppendingPathComponent:kSDDiskCacheIndexFileName];
+        _entries = [NSMutableDictionary dictionary];
+        _lock = dispatch_semaphore_create(1);
+        _journalFD = -1;
+        _removedBeforeLoading = [NSMutableSet set];
+        _pendingAccessRecords = [NSMutableData data];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (_journalFD >= 0) {
+        close(_journalFD);
+    }
+}
+
+#pragma mark - State
+
+- (BOOL)isLoaded {
+    SD_LOCK(self.lock);
+    BOOL loaded = _loaded;
+    SD_UNLOCK(self.lock);
+    return loaded;
+}
+
+- (NSUInteger)totalSize {
+    SD_LOCK(self.lock);
+    NSUInteger totalSize = _totalSize;
+    SD_UNLOCK(self.lock);
+    return totalSize;
+}
+
+- (NSUInteger)count {
+    SD_LOCK(self.lock);
+    NSUInteger count = self.entries.count;
+    SD_UNLOCK(self.lock);
+    return count;
+}
+
+#pragma mark - Loading
+
+- (BOOL)loadJournal {
+    NSData *data = [NSData dataWithContentsOfFile:self.journalPath options:NSDataReadingMappedIfSafe error:nil];
+    const size_t headerLength = sizeof(kSDDiskCacheIndexHeader) - 1;
+    if (data.length < headerLength || memcmp(data.bytes, kSDDiskCacheIndexHeader, headerLength) != 0) {
+        return NO;
+    }
+
+    NSMutableDictionary<NSString *, SDDiskCacheIndexEntry *> *entries = [NSMutableDictionary dictionary];
+    NSUInteger totalSize = 0;
+    NSUInteger recordCount = 0;
+    BOOL truncated = NO;
+
+    const char *cursor = (const char *)data.bytes + headerLength;
+    const char *end = (const char *)data.bytes + data.length;
+    const char *fields[kSDDiskCacheIndexMaxFields];
+    size_t lengths[kSDDiskCacheIndexMaxFields];
+    while (cursor < end) {
+        const char *newline = memchr(cursor, '\n', end - cursor);
+        if (!newline) {
+            // The last record was not completely written
+            truncated = YES;
+            break;
+        }
+        NSUInteger fieldCount = SDDiskCacheIndexSplitLine(cursor, newline - cursor, fields, lengths, kSDDiskCacheIndexMaxFields);
+        NSString *fileName = fieldCount >= 2 ? SDDiskCacheIndexFileNameFromField(fields[1], lengths[1]) : nil;
+        if (!fileName || lengths[0] != 1) {
+            return NO;
+        }
+        switch (fields[0][0]) {
+            case '+': {
+                long long size, modificationTime, accessTime, accessCount, expirationTime;
+                if (fieldCount != 7
+                    || !SDDiskCacheIndexNumberFromField(fields[2], lengths[2], &size)
+                    || !SDDiskCacheIndexNumberFromField(fields[3], lengths[3], &modificationTime)
+                    || !SDDiskCacheIndexNumberFromField(fields[4], lengths[4], &accessTime)
+                    || !SDDiskCacheIndexNumberFromField(fields[5], lengths[5], &accessCount)
+                    || !SDDiskCacheIndexNumberFromField(fields[6], lengths[6], &expirationTime)) {
+                    return NO;
+                }
+                SDDiskCacheIndexEntry *oldEntry = entries[fileName];
+                if (oldEntry) {
+                    totalSize -= oldEntry.size;
+                }
+                entries[fileName] = [[SDDiskCacheIndexEntry alloc] initWithFileName:fileName
+                                                                               size:(NSUInteger)size
+                                                                   modificationTime:modificationTime
+                                                                         accessTime:accessTime
+                                                                        accessCount:(NSUInteger)accessCount
+                                                                     expirationTime:expirationTime];
+                totalSize += (NSUInteger)size;
+                break;
+            }
+            case '@': {
+                long long accessTime;
+                if (fieldCount != 3 || !SDDiskCacheIndexNumberFromField(fields[2], lengths[2], &accessTime)) {
+                    return NO;
+                }
+                SDDiskCacheIndexEntry *oldEntry = entries[fileName];
+                if (oldEntry) {
+                    entries[fileName] = [oldEntry entryByRecordingAccessAtTime:accessTime];
+                }
+                break;
+            }
+            case '=': {
+                long long freshnessTime;
+                if (fieldCount != 5 || !SDDiskCacheIndexNumberFromField(fields[4], lengths[4], &freshnessTime)) {
+                    return NO;
+                }
+                SDDiskCacheIndexEntry *oldEntry = entries[fileName];
+                if (oldEntry) {
+                    // Empty fields are decoded as nil
+                    entries[fileName] = [oldEntry entryBySettingETag:SDDiskCacheIndexFileNameFromField(fields[2], lengths[2])
+                                                        lastModified:SDDiskCacheIndexFileNameFromField(fields[3], lengths[3])
+                                                       freshnessTime:freshnessTime];
+                }
+                break;
+            }
+            case '-': {
+                if (fieldCount != 2) {
+                    return NO;
+                }
+                SDDiskCacheIndexEntry *oldEntry = entries[fileName];
+                if (oldEntry) {
+                    totalSize -= oldEntry.size;
+                    [entries removeObjectForKey:fileName];
+                }
+                break;
+            }
+            default:
+                return NO;
+        }
+        recordCount++;
+        cursor = newline + 1;
+    }
+
+    SD_LOCK(self.lock);
+    // Merge what was recorded before the journal was read, it is more recent.
+    // appendRecord: does not write while loading, so it is only in memory and the journal must be rewritten
+    BOOL changedBeforeLoading = self.removedBeforeLoading.count > 0 || self.entries.count > 0;
+    for (NSString *fileName in self.removedBeforeLoading) {
+        totalSize -= entries[fileName].size;
+        [entries removeObjectForKey:fileName];
+    }
+    [self.entries enumerateKeysAndObjectsUsingBlock:^(NSString * _Nonnull key, SDDiskCacheIndexEntry * _Nonnull entry, BOOL * _Nonnull stop) {
+        totalSize -= entries[key].size;
+        entries[key] = entry;
+        totalSize += entry.size;
+    }];
+    self.entries = entries;
+    self.removedBeforeLoading = nil;
+    _totalSize = totalSize;
+    _journalRecordCount = recordCount;
+    _loaded = YES;
+    if (truncated || changedBeforeLoading) {
+        [self compactJournal];
+    }
+    SD_UNLOCK(self.lock);
+    return YES;
+}
+
+- (BOOL)rebuildWithFileManager:(nonnull NSFileManager *)fileManager batchSize:(NSUInteger)batchSize {
+    NSArray<NSString *> *resourceKeys = @[NSURLIsDirectoryKey, NSURLFileSizeKey, NSURLContentModificationDateKey, NSURLContentAccessDateKey];
+    SD_LOCK(self.lock);
+    if (_loaded) {
+        SD_UNLOCK(self.lock);
+        return YES;
+    }
+    if (!self.rebuildEnumerator) {
+        // 开始重建，丢弃损坏的日志
+        [self closeJournal];
+        unlink(self.journalPath.fileSystemRepresentation);
+        _journalRecordCount = 0;
+        NSURL *directoryURL = [NSURL fileURLWithPath:self.directory isDirectory:YES];
+        self.rebuildEnumerator = [fileManager enumeratorAtURL:directoryURL
+                                   includingPropertiesForKeys:resourceKeys
+                                                      options:NSDirectoryEnumerationSkipsHiddenFiles
+                                                 errorHandler:NULL];
+    }
+    NSDirectoryEnumerator<NSURL *> *enumerator = self.rebuildEnumerator;
+    SD_UNLOCK(self.lock);
+
+    NSUInteger scanned = 0;
+    NSURL *fileURL = nil;
+    while (scanned < batchSize && (fileURL = [enumerator nextObject])) {
+        @autoreleasepool {
+            scanned++;
+            NSError *error;
+            NSDictionary<NSString *, id> *resourceValues = [fileURL resourceValuesForKeys:resourceKeys error:&error];
+            if (error || !resourceValues) {
+                continue;
+            }
+            if ([resourceValues[NSURLIsDirectoryKey] boolValue]) {
+                [enumerator skipDescendants];
+                continue;
+            }
+            NSString *fileName = fileURL.lastPathComponent;
+            NSUInteger size = [resourceValues[NSURLFileSizeKey] unsignedIntegerValue];
+            NSTimeInterval modificationTime = [resourceValues[NSURLContentModificationDateKey] timeIntervalSince1970];
+            NSTimeInterval accessTime = [resourceValues[NSURLContentAccessDateKey] timeIntervalSince1970];
+            SDDiskCacheIndexEntry *entry = [[SDDiskCacheIndexEntry alloc] initWithFileName:fileName
+                                                                                      size:size
+                                                                          modificationTime:modificationTime
+                                                                                accessTime:MAX(accessTime, modificationTime)
+                                                                               accessCount:0
+                                                                            expirationTime:0];
+            SD_LOCK(self.lock);
+            // Entries recorded while rebuilding are more recent than the scan
+            if (!self.entries[fileName] && ![self.removedBeforeLoading containsObject:fileName]) {
+                self.entries[fileName] = entry;
+                _totalSize += size;
+            }
+            SD_UNLOCK(self.lock);
+        }
+    }
+    if (fileURL) {
+        return NO;
+    }
+
+    SD_LOCK(self.lock);
+    self.rebuildEnumerator = nil;
+    self.removedBeforeLoading = nil;
+    _loaded = YES;
+    [self compactJournal];
+    SD_UNLOCK(self.lock);
+    return YES;
+}
+
+#pragma mark - Entries
+
+- (nullable SDDiskCacheIndexEntry *)entryForFileName:(nonnull NSString *)fileName {
+    SD_LOCK(self.lock);
+    SDDiskCacheIndexEntry *entry = self.entries[fileName];
+    SD_UNLOCK(self.lock);
+    return entry;
+}
+
+- (nonnull NSArray<SDDiskCacheIndexEntry *> *)allEntries {
+    SD_LOCK(self.lock);
+    NSArray<SDDiskCacheIndexEntry *> *entries = self.entries.allValues;
+    SD_UNLOCK(self.lock);
+    return entries;
+}
+
+- (void)setEntryForFileName:(nonnull NSString *)fileName size:(NSUInteger)size expirationTime:(NSTimeInterval)expirationTime {
+    if (!fileName) {
+        return;
+    }
+    NSTimeInterval now = [[NSDate date] timeIntervalSince1970];
+    SDDiskCacheIndexEntry *entry = [[SDDiskCacheIndexEntry alloc] initWithFileName:fileName
+                                                                              size:size
+                                                                  modificationTime:now
+                                                                        accessTime:now
+                                                                       accessCount:0
+                                                                    expirationTime:expirationTime];
+    SD_LOCK(self.lock);
+    SDDiskCacheIndexEntry *oldEntry = self.entries[fileName];
+    if (oldEntry) {
+        _totalSize -= oldEntry.size;
+    }
+    self.entries[fileName] = entry;
+    _totalSize += size;
+    [self.removedBeforeLoading removeObject:fileName];
+    [self appendRecord:[NSString stringWithFormat:@"+\t%@\t%lu\t%lld\t%lld\t0\t%lld\n",
+                        SDDiskCacheIndexEscapedFileName(fileName), (unsigned long)size,
+                        (long long)now, (long long)now, (long long)expirationTime]];
+    SD_UNLOCK(self.lock);
+}
+
+- (BOOL)setHTTPValidatorsForFileName:(nonnull NSString *)fileName
+                                ETag:(nullable NSString *)ETag
+                        lastModified:(nullable NSString *)lastModified
+                       freshnessTime:(NSTimeInterval)freshnessTime {
+    if (!fileName) {
+        return NO;
+    }
+    SD_LOCK(self.lock);
+    SDDiskCacheIndexEntry *oldEntry = self.entries[fileName];
+    if (oldEntry) {
+        SDDiskCacheIndexEntry *entry = [oldEntry entryBySettingETag:ETag lastModified:lastModified freshnessTime:freshnessTime];
+        self.entries[fileName] = entry;
+        [self appendRecord:[self validatorsRecordForEntry:entry]];
+    }
+    SD_UNLOCK(self.lock);
+    return oldEntry != nil;
+}
+
+- (nonnull NSString *)validatorsRecordForEntry:(nonnull SDDiskCacheIndexEntry *)entry {
+    return [NSString stringWithFormat:@"=\t%@\t%@\t%@\t%lld\n",
+            SDDiskCacheIndexEscapedFileName(entry.fileName),
+            entry.ETag ? SDDiskCacheIndexEscapedFileName(entry.ETag) : @"",
+            entry.lastModified ? SDDiskCacheIndexEscapedFileName(entry.lastModified) : @"",
+            (long long)entry.freshnessTime];
+}
+
+- (void)recordAccessForFileName:(nonnull NSString *)fileName {
+    if (!fileName) {
+        return;
+    }
+    NSTimeInterval now = [[NSDate date] timeIntervalSince1970];
+    SD_LOCK(self.lock);
+    SDDiskCacheIndexEntry *oldEntry = self.entries[fileName];
+    if (oldEntry) {
+        self.entries[fileName] = [oldEntry entryByRecordingAccessAtTime:now];
+        if (_loaded) {
+            NSString *record = [NSString stringWithFormat:@"@\t%@\t%lld\n", SDDiskCacheIndexEscapedFileName(fileName), (long long)now];
+            [self.pendingAccessRecords appendData:[record dataUsingEncoding:NSUTF8StringEncoding]];
+            _pendingAccessRecordCount++;
+            if (self.pendingAccessRecords.length >= kSDDiskCacheIndexAccessBufferSize) {
+                [self flushPendingAccessRecords];
+            }
+        }
+    }
+    SD_UNLOCK(self.lock);
+}
+
+- (void)removeEntryForFileName:(nonnull NSString *)fileName {
+    if (!fileName) {
+        return;
+    }
+    SD_LOCK(self.lock);
+    [self.removedBeforeLoading addObject:fileName];
+    SDDiskCacheIndexEntry *oldEntry = self.entries[fileName];
+    if (oldEntry) {
+        _totalSize -= oldEntry.size;
+        [self.entries removeObjectForKey:fileName];
+        [self appendRecord:[NSString stringWithFormat:@"-\t%@\n", SDDiskCacheIndexEscapedFileName(fileName)]];
+    }
+    SD_UNLOCK(self.lock);
+}
+
+- (void)removeAllEntries {
+    SD_LOCK(self.lock);
+    [self.entries removeAllObjects];
+    // The directory is empty now, nothing is left to load or scan
+    self.rebuildEnumerator = nil;
+    self.removedBeforeLoading = nil;
+    _loaded = YES;
+    _totalSize = 0;
+    [self compactJournal];
+    SD_UNLOCK(self.lock);
+}
+
+- (void)synchronize {
+    SD_LOCK(self.lock);
+    [self flushPendingAccessRecords];
+    if (_loaded && _journalRecordCount > kSDDiskCacheIndexCompactThreshold && _journalRecordCount > self.entries.count * 2) {
+        [self compactJournal];
+    }
+    SD_UNLOCK(self.lock);
+}
+
+#pragma mark - Journal
+
+// All the journal methods below must be called with the lock held
+
+- (BOOL)openJournal {
+    if (_journalFD >= 0) {
+        return YES;
+    }
+    const char *path = self.journalPath.fileSystemRepresentation;
+    int fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0 && errno == ENOENT) {
+        [[NSFileManager defaultManager] createDirectoryAtPath:self.directory withIntermediateDirectories:YES attributes:nil error:NULL];
+        fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    }
+    if (fd < 0) {
+        return NO;
+    }
+    if (lseek(fd, 0, SEEK_END) == 0) {
+        write(fd, kSDDiskCacheIndexHeader, sizeof(kSDDiskCacheIndexHeader) - 1);
+    }
+    _journalFD = fd;
+    return YES;
+}
+
+- (void)closeJournal {
+    if (_journalFD >= 0) {
+        close(_journalFD);
+        _journalFD = -1;
+    }
+}
+
+- (void)appendRecord:(nonnull NSString *)record {
+    // Records made before loading or while rebuilding are written by the next compaction
+    if (!_loaded || ![self openJournal]) {
+        return;
+    }
+    const char *bytes = record.UTF8String;
+    // One write per record, a crash can only lose the record being written
+    if (write(_journalFD, bytes, strlen(bytes)) > 0) {
+        _journalRecordCount++;
+    }
+}
+
+- (void)flushPendingAccessRecords {
+    if (self.pendingAccessRecords.length == 0) {
+        return;
+    }
+    if (_loaded && [self openJournal]) {
+        // The access records of a batch are appended with a single write
+        if (write(_journalFD, self.pendingAccessRecords.bytes, self.pendingAccessRecords.length) > 0) {
+            _journalRecordCount += _pendingAccessRecordCount;
+        }
+    }
+    self.pendingAccessRecords.length = 0;
+    _pendingAccessRecordCount = 0;
+}
+
+- (void)compactJournal {
+    [self closeJournal];
+    // The compacted journal already contains the latest access times
+    self.pendingAccessRecords.length = 0;
+    _pendingAccessRecordCount = 0;
+    NSMutableData *data = [NSMutableData dataWithBytes:kSDDiskCacheIndexHeader length:sizeof(kSDDiskCacheIndexHeader) - 1];
+    for (SDDiskCacheIndexEntry *entry in self.entries.objectEnumerator) {
+        NSString *record = [NSString stringWithFormat:@"+\t%@\t%lu\t%lld\t%lld\t%lu\t%lld\n",
+                            SDDiskCacheIndexEscapedFileName(entry.fileName), (unsigned long)entry.size,
+                            (long long)entry.modificationTime, (long long)entry.accessTime,
+                            (unsigned long)entry.accessCount, (long long)entry.expirationTime];
+        [data appendData:[record dataUsingEncoding:NSUTF8StringEncoding]];
+        if ([entry hasHTTPValidators]) {
+            [data appendData:[[self validatorsRecordForEntry:entry] dataUsingEncoding:NSUTF8StringEncoding]];
+        }
+    }
+    [[NSFileManager defaultManager] createDirectoryAtPath:self.directory withIntermediateDirectories:YES attributes:nil error:NULL];
+    // Written to a temporary file then renamed, a crash never leaves a half written journal
+    if ([data writeToFile:self.journalPath atomically:YES]) {
+        _journalRecordCount = self.entries.count;
+    }
+}
+
+@end
@@ -0,0 +1,109 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+/*
+ 小文件打包存储
+
+ 大量几十 KB 的缩略图如果每张一个文件，会浪费 inode 和磁盘块，遍历目录也很慢。
+ 打包存储把小文件依次追加写入几个较大的段文件（segment），内存中保存文件名到段内偏移的映射。
+ 删除只追加一条删除记录（tombstone），段文件中失效的数据超过一半时再在后台压缩（compact）。
+
+ 段文件是自描述的，启动时顺序扫描所有段文件即可恢复映射，不需要额外的索引文件。
+ */
+
+#import <Foundation/Foundation.h>
+#import "SDWebImageCompat.h"
+
+/**
+ * An append-only store packing many small files into a few large segment files.
+ *
+ * The store is thread safe. All methods touch the file system and should be called from the
+ * disk cache IO queues.
+ */
+@interface SDDiskCachePackStore : NSObject
+
+/**
+ * The directory holding the segment files
+ */
+@property (nonatomic, copy, readonly, nonnull) NSString *directory;
+
+/**
+ * A new segment is started once the current one reaches this size, in bytes. Defaults to 32 MB.
+ * 单个段文件的最大体积
+ */
+@property (nonatomic, assign) NSUInteger maxSegmentSize;
+
+/**
+ * Whether the segment files created from now on are excluded from the iCloud backup. Defaults to NO.
+ * 之后创建的段文件是否不上传 iCloud
+ */
+@property (atomic, assign, getter=isExcludedFromBackup) BOOL excludedFromBackup;
+
+/**
+ * The number of stored files
+ */
+@property (nonatomic, assign, readonly) NSUInteger count;
+
+/**
+ * The size of all segment files, including superseded records, in bytes
+ */
+@property (nonatomic, assign, readonly) NSUInteger segmentsSize;
+
+- (nonnull instancetype)initWithDirectory:(nonnull NSString *)directory NS_DESIGNATED_INITIALIZER;
+- (nonnull instancetype)init NS_UNAVAILABLE;
+
+/**
+ * Scan the segment files to rebuild the offsets of the stored files. A truncated last record is discarded.
+ * The other methods load the store first if needed.
+ */
+- (void)load;
+
+- (BOOL)containsFileName:(nonnull NSString *)fileName;
+
+/**
+ * Return the size of a stored file, or NSNotFound if it is not stored
+ */
+- (NSUInteger)sizeForFileName:(nonnull NSString *)fileName;
+
+/**
+ * Return the content of a stored file, or nil if it is not stored
+ */
+- (nullable NSData *)dataForFileName:(nonnull NSString *)fileName;
+
+/**
+ * Append a file to the current segment, replacing any previous content for the same name
+ *
+ * @return NO if the data could not be written
+ */
+- (BOOL)setData:(nonnull NSData *)data forFileName:(nonnull NSString *)fileName;
+
+/**
+ * Append a tombstone for a file
+ *
+ * @return NO if the file is not stored
+ */
+- (BOOL)removeDataForFileName:(nonnull NSString *)fileName;
+
+/**
+ * Remove all segment files
+ */
+- (void)removeAllData;
+
+/**
+ * Return the names of all stored files
+ */
+- (nonnull NSArray<NSString *> *)allFileNames;
+
+/**
+ * Rewrite the live records of one segment which is mostly superseded into the current segment, then delete it.
+ *
+ * @return YES if a segment has been compacted and there may be more to compact
+ */
+- (BOOL)compactNextSegment;
+
+@end
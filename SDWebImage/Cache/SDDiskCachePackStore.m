@@ -0,0 +1,466 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDDiskCachePackStore.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/*
+ 段文件格式：记录依次追加，每条记录由记录头、文件名和数据组成
+
+     magic   flags   keyLength   dataLength   fileName   data
+
+ 删除记录（tombstone）的 flags 为 kSDDiskCachePackRecordFlagTombstone，没有数据。
+ 扫描时按段文件编号和偏移的顺序回放所有记录，后面的记录覆盖前面的记录。
+ 记录头不合法或者记录不完整（例如写入时进程被杀）时，段文件在这条记录处截断。
+ */
+static NSString * const kSDDiskCachePackSegmentExtension = @"segment";
+static const uint32_t kSDDiskCachePackRecordMagic = 0x4B504453; // "SDPK"
+static const uint32_t kSDDiskCachePackRecordFlagTombstone = 1 << 0;
+static const NSUInteger kSDDiskCachePackDefaultMaxSegmentSize = 32 * 1024 * 1024;
+// Keys are cache file names, anything longer is a corrupt record
+static const uint32_t kSDDiskCachePackMaxKeyLength = 1024;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t flags;
+    uint32_t keyLength;
+    uint32_t dataLength;
+} SDDiskCachePackRecordHeader;
+
+static inline unsigned long long SDDiskCachePackRecordSize(uint32_t keyLength, uint32_t dataLength) {
+    return sizeof(SDDiskCachePackRecordHeader) + (unsigned long long)keyLength + dataLength;
+}
+
+// Write the whole buffer, pwrite may write less than asked
+static BOOL SDDiskCachePackWriteAll(int fd, const void *bytes, size_t length, off_t offset) {
+    const char *cursor = bytes;
+    while (length > 0) {
+        ssize_t written = pwrite(fd, cursor, length, offset);
+        if (written <= 0) {
+            return NO;
+        }
+        cursor += written;
+        length -= written;
+        offset += written;
+    }
+    return YES;
+}
+
+static BOOL SDDiskCachePackReadAll(int fd, void *bytes, size_t length, off_t offset) {
+    char *cursor = bytes;
+    while (length > 0) {
+        ssize_t count = pread(fd, cursor, length, offset);
+        if (count <= 0) {
+            return NO;
+        }
+        cursor += count;
+        length -= count;
+        offset += count;
+    }
+    return YES;
+}
+
+// 一个段文件，_liveSize 是其中仍然有效的记录的大小
+@interface SDDiskCachePackSegment : NSObject {
+    @package
+    NSUInteger _identifier;
+    int _fd;
+    unsigned long long _size;
+    unsigned long long _liveSize;
+}
+@end
+
+@implementation SDDiskCachePackSegment
+
+- (void)dealloc {
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+@end
+
+// 一个文件在段文件中的位置，_offset 是记录头的偏移
+@interface SDDiskCachePackLocation : NSObject {
+    @package
+    SDDiskCachePackSegment *_segment;
+    unsigned long long _offset;
+    uint32_t _keyLength;
+    uint32_t _dataLength;
+}
+@end
+
+@implementation SDDiskCachePackLocation
+@end
+
+typedef void(^SDDiskCachePackRecordBlock)(const SDDiskCachePackRecordHeader *header, NSString *fileName, unsigned long long offset);
+
+@interface SDDiskCachePackStore ()
+
+@property (nonatomic, copy, readwrite, nonnull) NSString *directory;
+@property (nonatomic, strong, nonnull) NSMutableDictionary<NSString *, SDDiskCachePackLocation *> *locations;
+// 按编号排序，最后一个是当前写入的段文件
+@property (nonatomic, strong, nonnull) NSMutableArray<SDDiskCachePackSegment *> *segments;
+@property (nonatomic, strong, nonnull) dispatch_semaphore_t lock;
+
+@end
+
+@implementation SDDiskCachePackStore {
+    BOOL _loaded;
+}
+
+- (nonnull instancetype)initWithDirectory:(nonnull NSString *)directory {
+    if ((self = [super init])) {
+        _directory = [directory copy];
+        _maxSegmentSize = kSDDiskCachePackDefaultMaxSegmentSize;
+        _locations = [NSMutableDictionary dictionary];
+        _segments = [NSMutableArray array];
+        _lock = dispatch_semaphore_create(1);
+    }
+    return self;
+}
+
+#pragma mark - State
+
+- (NSUInteger)count {
+    SD_LOCK(self.lock);
+    [self loadIfNeeded];
+    NSUInteger count = self.locations.count;
+    SD_UNLOCK(self.lock);
+    return count;
+}
+
+- (NSUInteger)segmentsSize {
+    SD_LOCK(self.lock);
+    [self loadIfNeeded];
+    unsigned long long size = 0;
+    for (SDDiskCachePackSegment *segment in self.segments) {
+        size += segment->_size;
+    }
+    SD_UNLOCK(self.lock);
+    return (NSUInteger)size;
+}
+
+#pragma mark - Segments
+
+// All the methods below must be called with the lock held
+
+- (nonnull NSString *)pathForSegmentIdentifier:(NSUInteger)identifier {
+    NSString *name = [NSString stringWithFormat:@"%08lu.%@", (unsigned long)identifier, kSDDiskCachePackSegmentExtension];
+    return [self.directory stringByAppendingPathComponent:name];
+}
+
+- (void)loadIfNeeded {
+    if (_loaded) {
+        return;
+    }
+    _loaded = YES;
+    NSMutableArray<NSNumber *> *identifiers = [NSMutableArray array];
+    for (NSString *name in [[NSFileManager defaultManager] contentsOfDirectoryAtPath:self.directory error:nil]) {
+        if ([name.pathExtension isEqualToString:kSDDiskCachePackSegmentExtension]) {
+            [identifiers addObject:@(name.stringByDeletingPathExtension.integerValue)];
+        }
+    }
+    [identifiers sortUsingSelector:@selector(compare:)];
+    for (NSNumber *identifier in identifiers) {
+        int fd = open([self pathForSegmentIdentifier:identifier.unsignedIntegerValue].fileSystemRepresentation, O_RDWR);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            continue;
+        }
+        SDDiskCachePackSegment *segment = [SDDiskCachePackSegment new];
+        segment->_identifier = identifier.unsignedIntegerValue;
+        segment->_fd = fd;
+        segment->_size = (unsigned long long)st.st_size;
+        [self.segments addObject:segment];
+        unsigned long long end = [self enumerateRecordsInSegment:segment usingBlock:^(const SDDiskCachePackRecordHeader *header, NSString *fileName, unsigned long long offset) {
+            [self applyRecord:header fileName:fileName segment:segment offset:offset];
+        }];
+        if (end < segment->_size) {
+            // Drop the truncated or corrupt tail
+            ftruncate(fd, (off_t)end);
+            segment->_size = end;
+        }
+    }
+}
+
+// Return the offset following the last valid record
+- (unsigned long long)enumerateRecordsInSegment:(nonnull SDDiskCachePackSegment *)segment usingBlock:(nonnull SDDiskCachePackRecordBlock)block {
+    unsigned long long offset = 0;
+    char key[kSDDiskCachePackMaxKeyLength];
+    while (offset + sizeof(SDDiskCachePackRecordHeader) <= segment->_size) {
+        SDDiskCachePackRecordHeader header;
+        if (!SDDiskCachePackReadAll(segment->_fd, &header, sizeof(header), (off_t)offset)) {
+            break;
+        }
+        if (header.magic != kSDDiskCachePackRecordMagic || header.keyLength == 0 || header.keyLength > kSDDiskCachePackMaxKeyLength) {
+            break;
+        }
+        BOOL tombstone = (header.flags & kSDDiskCachePackRecordFlagTombstone) != 0;
+        if (tombstone && header.dataLength != 0) {
+            break;
+        }
+        unsigned long long recordSize = SDDiskCachePackRecordSize(header.keyLength, header.dataLength);
+        if (offset + recordSize > segment->_size) {
+            break;
+        }
+        if (!SDDiskCachePackReadAll(segment->_fd, key, header.keyLength, (off_t)(offset + sizeof(header)))) {
+            break;
+        }
+        NSString *fileName = [[NSString alloc] initWithBytes:key length:header.keyLength encoding:NSUTF8StringEncoding];
+        if (!fileName) {
+            break;
+        }
+        @autoreleasepool {
+            block(&header, fileName, offset);
+        }
+        offset += recordSize;
+    }
+    return offset;
+}
+
+- (void)applyRecord:(nonnull const SDDiskCachePackRecordHeader *)header fileName:(nonnull NSString *)fileName segment:(nonnull SDDiskCachePackSegment *)segment offset:(unsigned long long)offset {
+    [self forgetLocationForFileName:fileName];
+    if (header->flags & kSDDiskCachePackRecordFlagTombstone) {
+        return;
+    }
+    SDDiskCachePackLocation *location = [SDDiskCachePackLocation new];
+    location->_segment = segment;
+    location->_offset = offset;
+    location->_keyLength = header->keyLength;
+    location->_dataLength = header->dataLength;
+    segment->_liveSize += SDDiskCachePackRecordSize(header->keyLength, header->dataLength);
+    self.locations[fileName] = location;
+}
+
+- (void)forgetLocationForFileName:(nonnull NSString *)fileName {
+    SDDiskCachePackLocation *location = self.locations[fileName];
+    if (!location) {
+        return;
+    }
+    location->_segment->_liveSize -= SDDiskCachePackRecordSize(location->_keyLength, location->_dataLength);
+    [self.locations removeObjectForKey:fileName];
+}
+
+// The segment new records are appended to, a new one is started when the last one is full
+- (nullable SDDiskCachePackSegment *)currentSegment {
+    SDDiskCachePackSegment *segment = self.segments.lastObject;
+    if (segment && segment->_size < self.maxSegmentSize) {
+        return segment;
+    }
+    NSUInteger identifier = segment ? segment->_identifier + 1 : 0;
+    [[NSFileManager defaultManager] createDirectoryAtPath:self.directory withIntermediateDirectories:YES attributes:nil error:NULL];
+    NSString *path = [self pathForSegmentIdentifier:identifier];
+    int fd = open(path.fileSystemRepresentation, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return nil;
+    }
+    if (self.isExcludedFromBackup) {
+        [[NSURL fileURLWithPath:path] setResourceValue:@YES forKey:NSURLIsExcludedFromBackupKey error:nil];
+    }
+    segment = [SDDiskCachePackSegment new];
+    segment->_identifier = identifier;
+    segment->_fd = fd;
+    [self.segments addObject:segment];
+    return segment;
+}
+
+// Append one record with a single write, return its location or nil if it could not be written
+- (nullable SDDiskCachePackLocation *)appendRecordForFileName:(nonnull NSString *)fileName flags:(uint32_t)flags bytes:(nullable const void *)bytes length:(NSUInteger)length {
+    const char *key = fileName.UTF8String;
+    size_t keyLength = key ? strlen(key) : 0;
+    if (keyLength == 0 || keyLength > kSDDiskCachePackMaxKeyLength || length > UINT32_MAX) {
+        return nil;
+    }
+    SDDiskCachePackSegment *segment = [self currentSegment];
+    if (!segment) {
+        return nil;
+    }
+    SDDiskCachePackRecordHeader header = {kSDDiskCachePackRecordMagic, flags, (uint32_t)keyLength, (uint32_t)length};
+    unsigned long long recordSize = SDDiskCachePackRecordSize(header.keyLength, header.dataLength);
+    char *record = malloc((size_t)recordSize);
+    if (!record) {
+        return nil;
+    }
+    memcpy(record, &header, sizeof(header));
+    memcpy(record + sizeof(header), key, keyLength);
+    if (length > 0) {
+        memcpy(record + sizeof(header) + keyLength, bytes, length);
+    }
+    BOOL success = SDDiskCachePackWriteAll(segment->_fd, record, (size_t)recordSize, (off_t)segment->_size);
+    free(record);
+    if (!success) {
+        // Do not leave a partial record in the middle of the segment
+        ftruncate(segment->_fd, (off_t)segment->_size);
+        return nil;
+    }
+    SDDiskCachePackLocation *location = [SDDiskCachePackLocation new];
+    location->_segment = segment;
+    location->_offset = segment->_size;
+    location->_keyLength = header.keyLength;
+    location->_dataLength = header.dataLength;
+    segment->_size += recordSize;
+    return location;
+}
+
+- (nullable NSData *)dataAtLocation:(nonnull SDDiskCachePackLocation *)location {
+    NSUInteger length = location->_dataLength;
+    void *bytes = malloc(MAX(length, 1));
+    if (!bytes) {
+        return nil;
+    }
+    off_t offset = (off_t)(location->_offset + sizeof(SDDiskCachePackRecordHeader) + location->_keyLength);
+    if (!SDDiskCachePackReadAll(location->_segment->_fd, bytes, length, offset)) {
+        free(bytes);
+        return nil;
+    }
+    return [NSData dataWithBytesNoCopy:bytes length:length freeWhenDone:YES];
+}
+
+#pragma mark - Access
+
+- (void)load {
+    SD_LOCK(self.lock);
+    [self loadIfNeeded];
+    SD_UNLOCK(self.lock);
+}
+
+- (BOOL)containsFileName:(nonnull NSString *)fileName {
+    SD_LOCK(self.lock);
+    [self loadIfNeeded];
+    BOOL contains = self.locations[fileName] != nil;
+    SD_UNLOCK(self.lock);
+    return contains;
+}
+
+- (NSUInteger)sizeForFileName:(nonnull NSString *)fileName {
+    SD_LOCK(self.lock);
+    [self loadIfNeeded];
+    SDDiskCachePackLocation *location = self.locations[fileName];
+    NSUInteger size = location ? location->_dataLength : NSNotFound;
+    SD_UNLOCK(self.lock);
+    return size;
+}
+
+- (nullable NSData *)dataForFileName:(nonnull NSString *)fileName {
+    SD_LOCK(self.lock);
+    [self loadIfNeeded];
+    SDDiskCachePackLocation *location = self.locations[fileName];
+    NSData *data = location ? [self dataAtLocation:location] : nil;
+    SD_UNLOCK(self.lock);
+    return data;
+}
+
+- (BOOL)setData:(nonnull NSData *)data forFileName:(nonnull NSString *)fileName {
+    SD_LOCK(self.lock);
+    [self loadIfNeeded];
+    SDDiskCachePackLocation *location = [self appendRecordForFileName:fileName flags:0 bytes:data.bytes length:data.length];
+    if (location) {
+        [self forgetLocationForFileName:fileName];
+        location->_segment->_liveSize += SDDiskCachePackRecordSize(location->_keyLength, location->_dataLength);
+        self.locations[fileName] = location;
+    }
+    SD_UNLOCK(self.lock);
+    return location != nil;
+}
+
+- (BOOL)removeDataForFileName:(nonnull NSString *)fileName {
+    SD_LOCK(self.lock);
+    [self loadIfNeeded];
+    BOOL removed = NO;
+    // Without the tombstone the file would come back on the next load, keep it if the tombstone could not be written
+    if (self.locations[fileName] && [self appendRecordForFileName:fileName flags:kSDDiskCachePackRecordFlagTombstone bytes:NULL length:0]) {
+        [self forgetLocationForFileName:fileName];
+        removed = YES;
+    }
+    SD_UNLOCK(self.lock);
+    return removed;
+}
+
+- (void)removeAllData {
+    SD_LOCK(self.lock);
+    [self.locations removeAllObjects];
+    [self.segments removeAllObjects];
+    [[NSFileManager defaultManager] removeItemAtPath:self.directory error:nil];
+    _loaded = YES;
+    SD_UNLOCK(self.lock);
+}
+
+- (nonnull NSArray<NSString *> *)allFileNames {
+    SD_LOCK(self.lock);
+    [self loadIfNeeded];
+    NSArray<NSString *> *fileNames = self.locations.allKeys;
+    SD_UNLOCK(self.lock);
+    return fileNames;
+}
+
+#pragma mark - Compaction
+
+- (BOOL)compactNextSegment {
+    SD_LOCK(self.lock);
+    [self loadIfNeeded];
+    // The current segment is never compacted, pick the oldest segment which is more than half superseded
+    SDDiskCachePackSegment *segment = nil;
+    NSUInteger segmentIndex = 0;
+    for (NSUInteger i = 0; i + 1 < self.segments.count; i++) {
+        SDDiskCachePackSegment *candidate = self.segments[i];
+        if (candidate->_liveSize * 2 < candidate->_size) {
+            segment = candidate;
+            segmentIndex = i;
+            break;
+        }
+    }
+    if (!segment) {
+        SD_UNLOCK(self.lock);
+        return NO;
+    }
+    // Tombstones hide records of older segments, they can only be dropped from the oldest segment
+    BOOL keepTombstones = segmentIndex > 0;
+    __block BOOL failed = NO;
+    [self enumerateRecordsInSegment:segment usingBlock:^(const SDDiskCachePackRecordHeader *header, NSString *fileName, unsigned long long offset) {
+        if (failed) {
+            return;
+        }
+        SDDiskCachePackLocation *location = self.locations[fileName];
+        if (header->flags & kSDDiskCachePackRecordFlagTombstone) {
+            if (keepTombstones && !location) {
+                failed = ![self appendRecordForFileName:fileName flags:kSDDiskCachePackRecordFlagTombstone bytes:NULL length:0];
+            }
+            return;
+        }
+        if (!location || location->_segment != segment || location->_offset != offset) {
+            // Superseded
+            return;
+        }
+        NSData *data = [self dataAtLocation:location];
+        SDDiskCachePackLocation *newLocation = data ? [self appendRecordForFileName:fileName flags:0 bytes:data.bytes length:data.length] : nil;
+        if (!newLocation) {
+            failed = YES;
+            return;
+        }
+        [self forgetLocationForFileName:fileName];
+        newLocation->_segment->_liveSize += SDDiskCachePackRecordSize(newLocation->_keyLength, newLocation->_dataLength);
+        self.locations[fileName] = newLocation;
+    }];
+    if (!failed) {
+        // The live records have been copied, a crash before this point only leaves duplicates which the copies supersede
+        [self.segments removeObject:segment];
+        close(segment->_fd);
+        segment->_fd = -1;
+        unlink([self pathForSegmentIdentifier:segment->_identifier].fileSystemRepresentation);
+    }
+    SD_UNLOCK(self.lock);
+    return !failed;
+}
+
+@end
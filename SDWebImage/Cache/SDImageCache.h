@@ -3,7 +3,7 @@
  
  SDImageCache和SDWebImageDownloader是SDWebImage库的最重要的两个部件，它们一起为SDWebImageManager提供服务，来完成图片的加载。
  SDImageCache提供了对图片的内存缓存、异步磁盘缓存、图片缓存查询等功能，下载过的图片会被缓存到内存，也可选择保存到本地磁盘，当再次请求相同图片时直接从缓存中读取图片，从而大大提高了加载速度。
- 在SDImageCache中，内存缓存是通过 NSCache的子类AutoPurgeCache来实现的；
+ 在SDImageCache中，内存缓存是通过 LRU 缓存 SDMemoryCache 来实现的；
  磁盘缓存是通过 NSFileManager 来实现文件的存储(默认路径为/Library/Caches/default/com.hackemist.SDWebImageCache.default)，是异步实现的。
  
  
@@ -71,17 +71,31 @@ typedef void(^SDWebImageCalculateSizeBlock)(NSUInteger fileCount, NSUInteger tot
 @property (nonatomic, nonnull, readonly) SDImageCacheConfig *config;
 
 /**
- * The maximum "total cost" of the in-memory image cache. The cost function is the number of pixels held in memory.
- * 其实就是 NSCache 的 totalCostLimit，内存缓存总消耗的最大限制，cost 是根据内存中的图片的像素大小来计算的
+ * The maximum "total cost" of the in-memory image cache. The cost function is the number of bytes of the decoded images
+ * held in memory. Least recently used images are evicted first once it is exceeded. 0 means no limit.
+ * Defaults to 1/8 of the physical memory. The cache is also trimmed when the system reports memory pressure.
+ * 其实就是 SDMemoryCache 的 totalCostLimit，内存缓存总消耗的最大限制，cost 是内存中的图片解码后占用的字节数
  */
 @property (assign, nonatomic) NSUInteger maxMemoryCost;
 
 /**
- * The maximum number of objects the cache should hold.
- * 其实就是 NSCache 的 countLimit，内存缓存的最大数目
+ * The maximum number of objects the cache should hold. 0 means no limit.
+ * 其实就是 SDMemoryCache 的 countLimit，内存缓存的最大数目
  */
 @property (assign, nonatomic) NSUInteger maxMemoryCountLimit;
 
+/**
+ * The maximum time an image stays in the memory cache without being accessed, in seconds. 0 means no limit.
+ * 其实就是 SDMemoryCache 的 ageLimit，内存缓存中的图片多久没有被访问就会过期
+ */
+@property (assign, nonatomic) NSTimeInterval maxMemoryAge;
+
+/**
+ * The number of serial disk IO queues the keys are spread over
+ * 磁盘IO分片队列的数量
+ */
+@property (assign, nonatomic, readonly) NSUInteger ioShardCount;
+
 #pragma mark - Singleton and initialization
 //--------------  初始化 ----------------//
 
@@ -109,7 +123,21 @@ typedef void(^SDWebImageCalculateSizeBlock)(NSUInteger fileCount, NSUInteger tot
  * @param directory Directory to cache disk images in
  */
 - (nonnull instancetype)initWithNamespace:(nonnull NSString *)ns
-                       diskCacheDirectory:(nonnull NSString *)directory NS_DESIGNATED_INITIALIZER;
+                       diskCacheDirectory:(nonnull NSString *)directory;
+
+/**
+ * 通过文件夹名、文件目录名和IO分片数创建缓存
+ * Init a new cache store with a specific namespace, directory and number of disk IO shards.
+ * Disk operations on different keys run in parallel on different shards, operations on the same key stay ordered.
+ * The other initializers use one shard per active processor, between 2 and 8.
+ *
+ * @param ns           The namespace to use for this cache store
+ * @param directory    Directory to cache disk images in
+ * @param shardCount   The number of serial IO queues the keys are spread over
+ */
+- (nonnull instancetype)initWithNamespace:(nonnull NSString *)ns
+                       diskCacheDirectory:(nonnull NSString *)directory
+                             ioShardCount:(NSUInteger)shardCount NS_DESIGNATED_INITIALIZER;
 
 #pragma mark - Cache paths
 
@@ -158,7 +186,8 @@ typedef void(^SDWebImageCalculateSizeBlock)(NSUInteger fileCount, NSUInteger tot
  *                        instead of converting the given image object into a storable/compressed image format in order
  *                        to save quality and CPU
  * @param key             The unique image cache key, usually it's image absolute URL
- * @param toDisk          Store the image to disk cache if YES
+ * @param toDisk          Store the image to disk cache if YES. The disk write is buffered briefly and batched with other
+ *                        writes, the image can be read from the disk cache before it is written
  * @param completionBlock A block executed after the operation is finished
  */
 - (void)storeImage:(nullable UIImage *)image
@@ -168,16 +197,71 @@ typedef void(^SDWebImageCalculateSizeBlock)(NSUInteger fileCount, NSUInteger tot
         completion:(nullable SDWebImageNoParamsBlock)completionBlock;
 
 /**
- * 同步存储图像的 NSData 数据到磁盘缓存中，并以 key 作为图像数据的唯一标识。注意这个方法是同步的，要注意在 ioQueue 中回调它。
+ * 同步存储图像的 NSData 数据到磁盘缓存中，并以 key 作为图像数据的唯一标识。这个方法会等待写入完成，不要在主线程调用。
  * Synchronously store image NSData into disk cache at the given key.
  *
- * @warning This method is synchronous, make sure to call it from the ioQueue
+ * @warning This method is synchronous, it waits for the IO queue of the key and for any exclusive disk operation
+ *          (clearing or trimming the cache) to finish. Avoid calling it from the main queue.
+ *          When called from one of the cache's own IO queues (for example by a subclass), it writes on the calling
+ *          queue instead of waiting, as it did before the IO queue was sharded. The write is then only ordered with
+ *          the operations of that queue.
  *
  * @param imageData  The image data to store
  * @param key        The unique image cache key, usually it's image absolute URL
  */
 - (void)storeImageDataToDisk:(nullable NSData *)imageData forKey:(nullable NSString *)key;
 
+/**
+ * 立即写入所有等待写入磁盘的图片，并等待写入完成
+ * Synchronously write the images buffered by the store methods to disk.
+ *
+ * @warning This method blocks until the images are written, do not call it from the ioQueue
+ */
+- (void)flushDiskWrites;
+
+/**
+ * Asynchronously write the images buffered by the store methods to disk.
+ *
+ * @param completion A block executed on the main queue once the images are written
+ */
+- (void)flushDiskWritesWithCompletion:(nullable SDWebImageNoParamsBlock)completion;
+
+#pragma mark - HTTP revalidation
+//--------------  HTTP 校验信息 ----------------//
+// 磁盘缓存同时保存下载时响应的 ETag、Last-Modified 和新鲜度（Cache-Control max-age / Expires），
+// 刷新缓存时不需要借助 NSURLCache 再保存一份，服务器返回 304 时直接使用磁盘缓存的数据。
+
+/**
+ * Asynchronously store an image with the HTTP validators and freshness of the response it was downloaded with.
+ * They are used by `conditionalRequestHeadersForKey:` and `isDiskImageFreshForKey:` once the image is on disk.
+ *
+ * @param response The response the image data was downloaded with. If nil, this is the same as
+ *                 `storeImage:imageData:forKey:toDisk:completion:`
+ */
+- (void)storeImage:(nullable UIImage *)image
+         imageData:(nullable NSData *)imageData
+            forKey:(nullable NSString *)key
+          response:(nullable NSURLResponse *)response
+            toDisk:(BOOL)toDisk
+        completion:(nullable SDWebImageNoParamsBlock)completionBlock;
+
+/**
+ * Record that the server answered `304 Not Modified` for the image on disk, updating its freshness and validators.
+ */
+- (void)refreshDiskImageForKey:(nullable NSString *)key withNotModifiedResponse:(nullable NSURLResponse *)response;
+
+/**
+ * Return the `If-None-Match` and `If-Modified-Since` headers to revalidate the image on disk,
+ * or nil if it was stored without validators.
+ */
+- (nullable NSDictionary<NSString *, NSString *> *)conditionalRequestHeadersForKey:(nullable NSString *)key;
+
+/**
+ * Return YES if the image on disk is still fresh according to the response it was downloaded with,
+ * so it can be used without revalidating it.
+ */
+- (BOOL)isDiskImageFreshForKey:(nullable NSString *)key;
+
 
 
 #pragma mark - Query and Retrieve Ops
@@ -291,8 +375,9 @@ typedef void(^SDWebImageCalculateSizeBlock)(NSUInteger fileCount, NSUInteger tot
  *  @param key  the key (can be obtained from url using cacheKeyForURL)
  *  @param path the cache path root folder
  *
- *  @return the cache path
- *  获取某个键的缓存路径（需要缓存路径根文件夹）。
+ *  @return the cache path. No file exists at this path if the image is not cached, or if it is not larger than
+ *  `diskCachePackThreshold` and is then stored in a pack segment file: use `queryCacheOperationForKey:done:` to read it.
+ *  获取某个键的缓存路径（需要缓存路径根文件夹）。打包存储的小图片在这个路径上没有文件
  */
 - (nullable NSString *)cachePathForKey:(nullable NSString *)key inPath:(nonnull NSString *)path;
 
@@ -301,7 +386,8 @@ typedef void(^SDWebImageCalculateSizeBlock)(NSUInteger fileCount, NSUInteger tot
  *  获取磁盘缓存的位置
  *  @param key the key (can be obtained from url using cacheKeyForURL)
  *
- *  @return the default cache path
+ *  @return the default cache path. As for `cachePathForKey:inPath:`, no file exists at this path for images stored
+ *  in a pack segment file.
  */
 - (nullable NSString *)defaultCachePathForKey:(nullable NSString *)key;
 
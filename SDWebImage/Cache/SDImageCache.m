@@ -10,68 +10,419 @@
 #import <CommonCrypto/CommonDigest.h>
 #import "NSImage+WebCache.h"
 #import "SDWebImageCodersManager.h"
+#import "SDDiskCacheIndex.h"
+#import "SDMemoryCache.h"
+#import "SDDiskCachePackStore.h"
+#import "SDWebImageAnimatedImage.h"
+#import <pthread.h>
+#import <sys/stat.h>
+
+// 缓存最近使用的 key 对应的文件名数量
+static const NSUInteger kFileNameCacheCountLimit = 1024;
+// 重建磁盘缓存索引时每批扫描的文件数，批与批之间会让出磁盘给其它读写操作
+static const NSUInteger kDiskIndexRebuildBatchSize = 1000;
+// 打包存储段文件所在的目录，隐藏目录不会被索引重建扫描
+static NSString * const kDiskPackStoreDirectoryName = @".sdpack";
+// 等待写入磁盘的图片攒一小段时间再批量写入
+static const NSTimeInterval kDiskWriteBehindDelay = 0.1;
+// 已经派发、还没有写完的数据最多是几个 diskCacheWriteBufferSize
+static const NSUInteger kDiskWriteInFlightBufferCount = 2;
+// _ioQueue 和分片队列的 specific 的 key，值是缓存实例
+static void *kSDImageCacheIOQueueKey = &kSDImageCacheIOQueueKey;
 
 // See https://github.com/rs/SDWebImage/pull/1141 for discussion
 
 /*
  
- SDImageCache 的内存缓存是通过一个继承 NSCache 的 AutoPurgeCache 类来实现的，NSCache 是一个类似于 NSMutableDictionary 存储 key-value 的容器，主要有以下几个特点：
+ SDImageCache 的内存缓存是通过 SDMemoryCache 来实现的，它是一个哈希表 + 双向链表实现的 LRU 缓存，主要有以下几个特点：
  
- 1.自动删除机制：当系统内存紧张时，NSCache会自动删除一些缓存对象
- 2.线程安全：从不同线程中对同一个 NSCache 对象进行增删改查时，不需要加锁
- 3.不同于 NSMutableDictionary，NSCache存储对象时不会对 key 进行 copy 操作
+ 1.按字节限制：cost 是图片解码后占用的字节数，totalCostLimit 是内存缓存的字节预算
+ 2.淘汰顺序确定：超出限制时总是先淘汰最久没有使用的图片，也支持数量限制和按时间过期
+ 3.线程安全：从不同线程中对同一个 SDMemoryCache 对象进行增删改查时，不需要加锁
  4.SDImageCache 的磁盘缓存是通过异步操作 NSFileManager 存储缓存文件到沙盒来实现的。
  
  */
-@interface AutoPurgeCache : NSCache
+//　图片在缓存中的大小是通过解码后占用的字节数来衡量的。
+// 内联函数（类似宏定义）--图片消耗的内存空间
+FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
+    CGImageRef imageRef = image.CGImage;
+    if (!imageRef) {
+        return 0;
+    }
+    NSUInteger bytesPerFrame = CGImageGetBytesPerRow(imageRef) * CGImageGetHeight(imageRef);
+    if ([image isKindOfClass:[SDWebImageAnimatedImage class]]) {
+        // 按需解码的动图最多占用第一帧和缓冲区的内存
+        return bytesPerFrame * (1 + ((SDWebImageAnimatedImage *)image).maxBufferedFrameCount);
+    }
+    // 动图的每一帧都会解码并占用同样的内存
+    NSUInteger frameCount = image.images.count > 0 ? image.images.count : 1;
+    return bytesPerFrame * frameCount;
+}
+
+#pragma mark - Key hashing
+
+static inline uint64_t SDRotateLeft64(uint64_t x, int8_t r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t SDMurmurFinalMix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+// MurmurHash3_x64_128, see https://github.com/aappleby/smhasher
+static void SDMurmurHash3_x64_128(const void *key, size_t length, uint32_t seed, unsigned char out[16]) {
+    const unsigned char *data = (const unsigned char *)key;
+    const size_t blockCount = length / 16;
+    const uint64_t c1 = 0x87c37b91114253d5ULL;
+    const uint64_t c2 = 0x4cf5ad432745937fULL;
+    uint64_t h1 = seed;
+    uint64_t h2 = seed;
+
+    for (size_t i = 0; i < blockCount; i++) {
+        uint64_t k1, k2;
+        memcpy(&k1, data + i * 16, 8);
+        memcpy(&k2, data + i * 16 + 8, 8);
+
+        k1 *= c1; k1 = SDRotateLeft64(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = SDRotateLeft64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+        k2 *= c2; k2 = SDRotateLeft64(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = SDRotateLeft64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    const unsigned char *tail = data + blockCount * 16;
+    uint64_t k1 = 0;
+    uint64_t k2 = 0;
+    switch (length & 15) {
+        case 15: k2 ^= ((uint64_t)tail[14]) << 48; // fallthrough
+        case 14: k2 ^= ((uint64_t)tail[13]) << 40; // fallthrough
+        case 13: k2 ^= ((uint64_t)tail[12]) << 32; // fallthrough
+        case 12: k2 ^= ((uint64_t)tail[11]) << 24; // fallthrough
+        case 11: k2 ^= ((uint64_t)tail[10]) << 16; // fallthrough
+        case 10: k2 ^= ((uint64_t)tail[9]) << 8;   // fallthrough
+        case 9:  k2 ^= ((uint64_t)tail[8]);
+                 k2 *= c2; k2 = SDRotateLeft64(k2, 33); k2 *= c1; h2 ^= k2; // fallthrough
+        case 8:  k1 ^= ((uint64_t)tail[7]) << 56;  // fallthrough
+        case 7:  k1 ^= ((uint64_t)tail[6]) << 48;  // fallthrough
+        case 6:  k1 ^= ((uint64_t)tail[5]) << 40;  // fallthrough
+        case 5:  k1 ^= ((uint64_t)tail[4]) << 32;  // fallthrough
+        case 4:  k1 ^= ((uint64_t)tail[3]) << 24;  // fallthrough
+        case 3:  k1 ^= ((uint64_t)tail[2]) << 16;  // fallthrough
+        case 2:  k1 ^= ((uint64_t)tail[1]) << 8;   // fallthrough
+        case 1:  k1 ^= ((uint64_t)tail[0]);
+                 k1 *= c1; k1 = SDRotateLeft64(k1, 31); k1 *= c2; h1 ^= k1;
+        default:
+            break;
+    }
+
+    h1 ^= length;
+    h2 ^= length;
+    h1 += h2;
+    h2 += h1;
+    h1 = SDMurmurFinalMix64(h1);
+    h2 = SDMurmurFinalMix64(h2);
+    h1 += h2;
+    h2 += h1;
+    for (int i = 0; i < 8; i++) {
+        out[i] = (unsigned char)(h1 >> (i * 8));
+        out[i + 8] = (unsigned char)(h2 >> (i * 8));
+    }
+}
+
+// 哈希值转成小写十六进制文件名，URL 有后缀时加上后缀。查表转换，不使用 stringWithFormat:
+static NSString *SDCacheFileNameFromDigest(const unsigned char *digest, size_t digestLength, NSString *key) {
+    static const char kHexDigits[] = "0123456789abcdef";
+    char hex[32];
+    for (size_t i = 0; i < digestLength && i < 16; i++) {
+        hex[i * 2] = kHexDigits[digest[i] >> 4];
+        hex[i * 2 + 1] = kHexDigits[digest[i] & 0x0F];
+    }
+    NSString *fileName = [[NSString alloc] initWithBytes:hex length:MIN(digestLength, 16) * 2 encoding:NSASCIIStringEncoding];
+    NSURL *keyURL = [NSURL URLWithString:key];
+    NSString *ext = keyURL ? keyURL.pathExtension : key.pathExtension;
+    if (ext.length > 0) {
+        fileName = [[fileName stringByAppendingString:@"."] stringByAppendingString:ext];
+    }
+    return fileName;
+}
+
+// 旧版本使用的 MD5 文件名，用于迁移已有的缓存
+static NSString *SDLegacyCacheFileNameForKey(NSString *key) {
+    const char *str = key.UTF8String;
+    if (str == NULL) {
+        str = "";
+    }
+    unsigned char r[CC_MD5_DIGEST_LENGTH];
+    CC_MD5(str, (CC_LONG)strlen(str), r);
+    return SDCacheFileNameFromDigest(r, CC_MD5_DIGEST_LENGTH, key);
+}
+
+static NSString *SDMurmur3CacheFileNameForKey(NSString *key) {
+    const char *str = key.UTF8String;
+    if (str == NULL) {
+        str = "";
+    }
+    unsigned char r[16];
+    SDMurmurHash3_x64_128(str, strlen(str), 0, r);
+    return SDCacheFileNameFromDigest(r, sizeof(r), key);
+}
+
+// 分片用的哈希值。默认的文件名以 MurmurHash3（或 MD5）摘要的十六进制开头，直接取前 16 位，不重新计算；
+// diskCacheFileNameBlock 返回的文件名不一定均匀，再计算一次 MurmurHash3
+static uint64_t SDShardHashForFileName(NSString *fileName) {
+    const char *str = fileName.UTF8String ?: "";
+    size_t length = strlen(str);
+    BOOL isHex = length >= 16;
+    for (size_t i = 0; isHex && i < 16; i++) {
+        char c = str[i];
+        isHex = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+    }
+    if (isHex) {
+        char hex[17];
+        memcpy(hex, str, 16);
+        hex[16] = '\0';
+        return strtoull(hex, NULL, 16);
+    }
+    unsigned char r[16];
+    SDMurmurHash3_x64_128(str, length, 0, r);
+    uint64_t hash;
+    memcpy(&hash, r, sizeof(hash));
+    return hash;
+}
+
+#pragma mark - Lookup filter
+
+/*
+ 布隆过滤器，记录只读缓存目录中的文件名。
+ 查询结果为 NO 时文件一定不存在，可以直接跳过，不用访问文件系统；为 YES 时文件可能存在（约 1% 的误判）。
+ */
+@interface SDDiskCacheBloomFilter : NSObject
+
+- (nonnull instancetype)initWithCapacity:(NSUInteger)capacity;
+- (void)addString:(nonnull NSString *)string;
+- (BOOL)mayContainString:(nonnull NSString *)string;
+
 @end
 
-@implementation AutoPurgeCache
+// 10 bits and 7 hashes per element give a false positive rate below 1%
+static const NSUInteger kBloomFilterBitsPerElement = 10;
+static const NSUInteger kBloomFilterHashCount = 7;
 
-- (nonnull instancetype)init {
-    self = [super init];
-    if (self) {
-#if SD_UIKIT//内存警告
-        [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(removeAllObjects) name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
-#endif
+@implementation SDDiskCacheBloomFilter {
+    NSMutableData *_bits;
+    uint64_t _bitCount;
+}
+
+- (nonnull instancetype)initWithCapacity:(NSUInteger)capacity {
+    if ((self = [super init])) {
+        _bitCount = MAX(capacity, 64) * kBloomFilterBitsPerElement;
+        _bits = [NSMutableData dataWithLength:(NSUInteger)((_bitCount + 7) / 8)];
     }
     return self;
 }
 
-- (void)dealloc {
-#if SD_UIKIT
-    [[NSNotificationCenter defaultCenter] removeObserver:self name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
-#endif
+// Double hashing: the k bit positions are h1 + i * h2, both halves of the 128-bit hash of the string
+static void SDBloomFilterHashes(NSString *string, uint64_t *h1, uint64_t *h2) {
+    const char *str = string.UTF8String ?: "";
+    unsigned char r[16];
+    SDMurmurHash3_x64_128(str, strlen(str), 0, r);
+    memcpy(h1, r, 8);
+    memcpy(h2, r + 8, 8);
+}
+
+- (void)addString:(nonnull NSString *)string {
+    uint64_t h1, h2;
+    SDBloomFilterHashes(string, &h1, &h2);
+    uint8_t *bits = _bits.mutableBytes;
+    for (NSUInteger i = 0; i < kBloomFilterHashCount; i++) {
+        uint64_t bit = (h1 + i * h2) % _bitCount;
+        bits[bit / 8] |= (uint8_t)(1 << (bit % 8));
+    }
+}
+
+- (BOOL)mayContainString:(nonnull NSString *)string {
+    uint64_t h1, h2;
+    SDBloomFilterHashes(string, &h1, &h2);
+    const uint8_t *bits = _bits.bytes;
+    for (NSUInteger i = 0; i < kBloomFilterHashCount; i++) {
+        uint64_t bit = (h1 + i * h2) % _bitCount;
+        if (!(bits[bit / 8] & (1 << (bit % 8)))) {
+            return NO;
+        }
+    }
+    return YES;
 }
 
 @end
-//　图片在缓存中的大小是通过像素来衡量的。
-// 内联函数（类似宏定义）--图片消耗的内存空间
-FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
-#if SD_MAC
-    return image.size.height * image.size.width;
-#elif SD_UIKIT || SD_WATCH
-    return image.size.height * image.size.width * image.scale * image.scale;
-#endif
+
+// 磁盘缓存文件的保留价值，清理超出容量的缓存时从价值最低的文件开始删除
+static double SDDiskCacheRetentionValue(SDDiskCacheIndexEntry *entry, SDImageCacheConfigExpireType expireType, NSTimeInterval now) {
+    switch (expireType) {
+        case SDImageCacheConfigExpireTypeModificationDate:
+            return entry.modificationTime;
+        case SDImageCacheConfigExpireTypeAccessDateAndSize: {
+            // Hits per KB, decayed by the time since the last read: large, cold files go first
+            double idleTime = MAX(now - entry.accessTime, 0) + 60;
+            double kilobytes = MAX(entry.size, 1) / 1024.0 + 1;
+            return (entry.accessCount + 1) / (kilobytes * idleTime);
+        }
+        case SDImageCacheConfigExpireTypeAccessDate:
+        default:
+            return entry.accessTime;
+    }
+}
+
+#pragma mark - Write behind
+
+// 一次等待写入磁盘的图片，同一个 key 后面的写入会替换前面的写入
+@interface SDImageCachePendingWrite : NSObject
+
+@property (copy, nonatomic, nonnull) NSString *key;
+@property (strong, nonatomic, nullable) UIImage *image;
+// 没有 data 时在写入前把 image 编码成 PNG
+@property (strong, nonatomic, nullable) NSData *data;
+@property (assign, nonatomic) NSUInteger cost;
+// 下载图片时响应的 HTTP 校验信息，写入后记录到磁盘缓存索引
+@property (copy, nonatomic, nullable) NSString *ETag;
+@property (copy, nonatomic, nullable) NSString *lastModified;
+@property (assign, nonatomic) NSTimeInterval freshnessTime;
+@property (assign, nonatomic) BOOL hasHTTPValidators;
+// 已经派发到分片队列
+@property (assign, nonatomic, getter=isDispatched) BOOL dispatched;
+@property (strong, nonatomic, nonnull) NSMutableArray<SDWebImageNoParamsBlock> *completionBlocks;
+
+@end
+
+@implementation SDImageCachePendingWrite
+
+- (instancetype)init {
+    if ((self = [super init])) {
+        _completionBlocks = [NSMutableArray array];
+    }
+    return self;
+}
+
+@end
+
+#pragma mark - HTTP validators
+
+static NSDate *SDDateFromHTTPDateString(NSString *string) {
+    static NSDateFormatter *formatter;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        formatter = [NSDateFormatter new];
+        formatter.locale = [NSLocale localeWithLocaleIdentifier:@"en_US_POSIX"];
+        formatter.timeZone = [NSTimeZone timeZoneWithAbbreviation:@"GMT"];
+        formatter.dateFormat = @"EEE, dd MMM yyyy HH:mm:ss zzz";
+    });
+    return string ? [formatter dateFromString:string] : nil;
+}
+
+// Read the validators of a response, and until when it is fresh: `Cache-Control: max-age` minus `Age`, or `Expires`.
+// `no-cache` and `no-store` responses must always be revalidated.
+static BOOL SDHTTPValidatorsFromResponse(NSURLResponse *response, NSString **ETag, NSString **lastModified, NSTimeInterval *freshnessTime) {
+    if (![response isKindOfClass:[NSHTTPURLResponse class]]) {
+        return NO;
+    }
+    NSDictionary *headers = ((NSHTTPURLResponse *)response).allHeaderFields;
+    NSString *ETagValue = headers[@"ETag"];
+    NSString *lastModifiedValue = headers[@"Last-Modified"];
+    *ETag = ETagValue.length > 0 ? ETagValue : nil;
+    *lastModified = lastModifiedValue.length > 0 ? lastModifiedValue : nil;
+
+    NSTimeInterval now = [[NSDate date] timeIntervalSince1970];
+    NSTimeInterval freshness = 0;
+    BOOL hasMaxAge = NO;
+    BOOL mustRevalidate = NO;
+    for (NSString *directive in [[headers[@"Cache-Control"] lowercaseString] componentsSeparatedByString:@","]) {
+        NSString *trimmedDirective = [directive stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+        if ([trimmedDirective isEqualToString:@"no-cache"] || [trimmedDirective isEqualToString:@"no-store"]) {
+            mustRevalidate = YES;
+        } else if ([trimmedDirective hasPrefix:@"max-age="]) {
+            NSTimeInterval maxAge = [[trimmedDirective substringFromIndex:8] doubleValue];
+            NSTimeInterval age = [headers[@"Age"] doubleValue];
+            freshness = now + MAX(maxAge - age, 0);
+            hasMaxAge = YES;
+        }
+    }
+    if (mustRevalidate) {
+        freshness = 0;
+    } else if (!hasMaxAge) {
+        NSDate *expires = SDDateFromHTTPDateString(headers[@"Expires"]);
+        if (expires && expires.timeIntervalSince1970 > now) {
+            freshness = expires.timeIntervalSince1970;
+        }
+    }
+    *freshnessTime = freshness > now ? freshness : 0;
+    return *ETag || *lastModified || *freshnessTime > 0;
+}
+
+// 默认的内存缓存大小：物理内存的 1/8，和 NSCache 一样不会无限增长
+static NSUInteger SDImageCacheDefaultMaxMemoryCost(void) {
+    unsigned long long physicalMemory = [NSProcessInfo processInfo].physicalMemory;
+    return (NSUInteger)MIN(physicalMemory / 8, (unsigned long long)NSUIntegerMax);
+}
+
+static void SDCallCompletionBlocksOnMainQueue(NSArray<SDWebImageNoParamsBlock> *completionBlocks) {
+    if (completionBlocks.count == 0) {
+        return;
+    }
+    dispatch_async(dispatch_get_main_queue(), ^{
+        for (SDWebImageNoParamsBlock completionBlock in completionBlocks) {
+            completionBlock();
+        }
+    });
 }
 
 @interface SDImageCache ()
 
 #pragma mark - Properties
 //内存缓存
-@property (strong, nonatomic, nonnull) NSCache *memCache;
+@property (strong, nonatomic, nonnull) SDMemoryCache<NSString *, UIImage *> *memCache;
 //磁盘缓存路径
 @property (strong, nonatomic, nonnull) NSString *diskCachePath;
 //自定义的缓存路径
 @property (strong, nonatomic, nullable) NSMutableArray<NSString *> *customPaths;
+//只读缓存目录中文件名的布隆过滤器，还没有建好的目录没有过滤器
+@property (strong, nonatomic, nonnull) NSMutableDictionary<NSString *, SDDiskCacheBloomFilter *> *customPathFilters;
 //磁盘缓存操作的串行队列
 @property (strong, nonatomic, nullable) dispatch_queue_t ioQueue;
+//按 key 分片的串行队列，不同 key 的磁盘读写可以并行，同一个 key 的操作仍然按顺序执行
+@property (strong, nonatomic, nonnull) NSArray<dispatch_queue_t> *ioShardQueues;
+//磁盘缓存索引，记录每个文件的大小和时间，避免遍历缓存目录
+@property (strong, nonatomic, nonnull) SDDiskCacheIndex *diskIndex;
+//小图片的打包存储，打包存储的文件同样记录在磁盘缓存索引中
+@property (strong, nonatomic, nonnull) SDDiskCachePackStore *packStore;
+//等待写入磁盘的图片，写入完成之前读取这个 key 直接返回等待写入的数据
+@property (strong, nonatomic, nonnull) NSMutableDictionary<NSString *, SDImageCachePendingWrite *> *pendingWrites;
+@property (strong, nonatomic, nonnull) dispatch_semaphore_t pendingWritesLock;
+//最近使用的 key 对应的文件名
+@property (strong, nonatomic, nonnull) SDMemoryCache<NSString *, NSString *> *fileNameCache;
+@property (strong, nonatomic, nonnull) dispatch_semaphore_t fileNameCacheLock;
 //　ioQueue 这是用于输入和输出的队列，队列其实往往可以当做一种"锁"来使用，把某些任务放在串行队列里面按照顺序一步一步的执行，必须考虑线程是否安全。
 @end
 
 
 @implementation SDImageCache {
     NSFileManager *_fileManager;
+    // 分片队列上的操作持有读锁，需要独占整个磁盘缓存的操作（清理、统计）持有写锁
+    pthread_rwlock_t _ioLock;
+    // 以下变量由 pendingWritesLock 保护
+    // 还没有派发的写入的字节数，超过 diskCacheWriteBufferSize 时立即派发
+    NSUInteger _undispatchedWriteBytes;
+    // 已经派发、还没有执行完的写入的字节数，超过上限时后台线程的写入同步执行
+    NSUInteger _inFlightWriteBytes;
+    BOOL _pendingWritesFlushScheduled;
+    // 以下变量由 fileNameCacheLock 保护
+    // fileNameCache 中的文件名是用这个哈希算法和 diskCacheFileNameBlock 计算的
+    SDImageCacheConfigKeyHashType _fileNameCacheHashType;
+    SDImageCacheFileNameBlock _fileNameCacheBlock;
+    // 系统内存紧张时缩小内存缓存
+    dispatch_source_t _memoryPressureSource;
 }
 
 #pragma mark - Singleton, init, dealloc
@@ -117,20 +468,46 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
  */
 - (nonnull instancetype)initWithNamespace:(nonnull NSString *)ns
                        diskCacheDirectory:(nonnull NSString *)directory {
+    NSUInteger shardCount = MIN(MAX([NSProcessInfo processInfo].activeProcessorCount, 2), 8);
+    return [self initWithNamespace:ns diskCacheDirectory:directory ioShardCount:shardCount];
+}
+
+- (nonnull instancetype)initWithNamespace:(nonnull NSString *)ns
+                       diskCacheDirectory:(nonnull NSString *)directory
+                             ioShardCount:(NSUInteger)shardCount {
     if ((self = [super init])) {
          //最内层文件夹名（com.hackemist.SDWebImageCache.default）
         NSString *fullNamespace = [@"com.hackemist.SDWebImageCache." stringByAppendingString:ns];
         
         // Create IO serial queue
-        // 创建有一个IO操作的串行队列
+        // 创建有一个IO操作的串行队列，用于需要独占整个磁盘缓存的操作
         _ioQueue = dispatch_queue_create("com.hackemist.SDWebImageCache", DISPATCH_QUEUE_SERIAL);
+        dispatch_queue_set_specific(_ioQueue, kSDImageCacheIOQueueKey, (__bridge void *)self, NULL);
+        // 创建按 key 分片的IO队列
+        _ioShardCount = MAX(shardCount, 1);
+        NSMutableArray<dispatch_queue_t> *shardQueues = [NSMutableArray arrayWithCapacity:_ioShardCount];
+        for (NSUInteger i = 0; i < _ioShardCount; i++) {
+            dispatch_queue_t shardQueue = dispatch_queue_create("com.hackemist.SDWebImageCache.shard", DISPATCH_QUEUE_SERIAL);
+            dispatch_queue_set_specific(shardQueue, kSDImageCacheIOQueueKey, (__bridge void *)self, NULL);
+            [shardQueues addObject:shardQueue];
+        }
+        _ioShardQueues = [shardQueues copy];
+        pthread_rwlock_init(&_ioLock, NULL);
         
         _config = [[SDImageCacheConfig alloc] init];
         
          // 创建缓存对象
         // Init the memory cache
-        _memCache = [[AutoPurgeCache alloc] init];
+        _memCache = [[SDMemoryCache alloc] init];
         _memCache.name = fullNamespace;
+        _memCache.totalCostLimit = SDImageCacheDefaultMaxMemoryCost();
+        _fileNameCache = [[SDMemoryCache alloc] init];
+        _fileNameCache.countLimit = kFileNameCacheCountLimit;
+        _fileNameCacheLock = dispatch_semaphore_create(1);
+        _fileNameCacheHashType = _config.diskCacheKeyHashType;
+        _customPathFilters = [NSMutableDictionary dictionary];
+        _pendingWrites = [NSMutableDictionary dictionary];
+        _pendingWritesLock = dispatch_semaphore_create(1);
 
         // Init the disk cache
            // 初始化磁盘缓存地址
@@ -146,6 +523,18 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
             _fileManager = [NSFileManager new];
         });
 
+        // 在IO线程加载磁盘缓存索引，日志不存在或损坏时分批重建
+        _diskIndex = [[SDDiskCacheIndex alloc] initWithDirectory:_diskCachePath];
+        _packStore = [[SDDiskCachePackStore alloc] initWithDirectory:[_diskCachePath stringByAppendingPathComponent:kDiskPackStoreDirectoryName]];
+        [self dispatchExclusiveIO:^{
+            [self.packStore load];
+            if (![self.diskIndex loadJournal]) {
+                [self rebuildDiskIndexIncrementally];
+            }
+        }];
+
+        [self startObservingMemoryPressure];
+
 #if SD_UIKIT
         // Subscribe to app events
         //内存警告时会清除内存缓存
@@ -153,7 +542,11 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
                                                  selector:@selector(clearMemory)
                                                      name:UIApplicationDidReceiveMemoryWarningNotification
                                                    object:nil];
-        //app终止时，会整理沙盒缓存
+        //app终止时，先把等待写入的图片写入磁盘，再整理沙盒缓存
+        [[NSNotificationCenter defaultCenter] addObserver:self
+                                                 selector:@selector(flushDiskWrites)
+                                                     name:UIApplicationWillTerminateNotification
+                                                   object:nil];
         [[NSNotificationCenter defaultCenter] addObserver:self
                                                  selector:@selector(deleteOldFiles)
                                                      name:UIApplicationWillTerminateNotification
@@ -171,6 +564,10 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
 
 - (void)dealloc {
     [[NSNotificationCenter defaultCenter] removeObserver:self];
+    if (_memoryPressureSource) {
+        dispatch_source_cancel(_memoryPressureSource);
+    }
+    pthread_rwlock_destroy(&_ioLock);
 }
 
 
@@ -179,18 +576,111 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
      主队列返回的是: "com.apple.main-thread"。
      _ioQueue 返回的是 "com.hackemist.SDWebImageCache"，
      使用 DISPATCH_CURRENT_QUEUE_LABEL 做参数可返回当前队列的标识。
-     由此检查当前队列是不是 _ioQueue。
+     所有缓存实例的队列标识都相同，所以用 dispatch_queue_set_specific 在 _ioQueue 和分片队列上设置当前实例，
+     由此检查当前队列是不是这个实例的 _ioQueue 或者某个分片队列。
  */
 
 - (void)checkIfQueueIsIOQueue {
     
-    const char *currentQueueLabel = dispatch_queue_get_label(DISPATCH_CURRENT_QUEUE_LABEL);
-    const char *ioQueueLabel = dispatch_queue_get_label(self.ioQueue);
-    if (strcmp(currentQueueLabel, ioQueueLabel) != 0) {
+    if (![self isCurrentQueueIOQueue]) {
         NSLog(@"This method should be called from the ioQueue");
     }
 }
 
+- (BOOL)isCurrentQueueIOQueue {
+    // 队列的标识在所有缓存实例中都相同，用 dispatch_queue_set_specific 设置的值区分是不是这个实例的队列
+    return dispatch_get_specific(kSDImageCacheIOQueueKey) == (__bridge void *)self;
+}
+
+#pragma mark - IO queues
+
+/**
+ key 对应的分片。不使用 key.hash：NSString 的 hash 只取字符串开头和结尾的一部分字符，
+ 前缀和后缀相同的 CDN URL 会集中在少数几个分片上。这里用文件名中已经计算好的哈希值
+ */
+- (NSUInteger)ioShardIndexForKey:(nullable NSString *)key {
+    return (NSUInteger)(SDShardHashForFileName([self cachedFileNameForKey:key]) % self.ioShardCount);
+}
+
+- (nonnull dispatch_queue_t)ioQueueForKey:(nullable NSString *)key {
+    return self.ioShardQueues[[self ioShardIndexForKey:key]];
+}
+
+// 在 key 对应的分片队列中执行，不同分片之间的读写互不阻塞
+- (void)dispatchIOForKey:(nullable NSString *)key block:(nonnull dispatch_block_t)block {
+    dispatch_async([self ioQueueForKey:key], ^{
+        pthread_rwlock_rdlock(&self->_ioLock);
+        block();
+        pthread_rwlock_unlock(&self->_ioLock);
+    });
+}
+
+// 同步在 key 对应的分片队列中执行，不能在分片队列和 ioQueue 上调用
+- (void)dispatchIOForKeyAndWait:(nullable NSString *)key block:(nonnull dispatch_block_t)block {
+    dispatch_sync([self ioQueueForKey:key], ^{
+        pthread_rwlock_rdlock(&self->_ioLock);
+        block();
+        pthread_rwlock_unlock(&self->_ioLock);
+    });
+}
+
+// 独占整个磁盘缓存执行，会等待所有分片上正在执行的操作结束
+- (void)dispatchExclusiveIO:(nonnull dispatch_block_t)block {
+    dispatch_async(self.ioQueue, ^{
+        pthread_rwlock_wrlock(&self->_ioLock);
+        block();
+        pthread_rwlock_unlock(&self->_ioLock);
+    });
+}
+
+- (void)dispatchExclusiveIOAndWait:(nonnull dispatch_block_t)block {
+    dispatch_sync(self.ioQueue, ^{
+        pthread_rwlock_wrlock(&self->_ioLock);
+        block();
+        pthread_rwlock_unlock(&self->_ioLock);
+    });
+}
+
+
+#pragma mark - Disk index
+
+// 每次只扫描一批文件，然后重新排队，不会长时间阻塞其它磁盘读写
+- (void)rebuildDiskIndexIncrementally {
+    if ([self.diskIndex rebuildWithFileManager:_fileManager batchSize:kDiskIndexRebuildBatchSize]) {
+        [self restorePackedEntriesInDiskIndex];
+        return;
+    }
+    [self dispatchExclusiveIO:^{
+        [self rebuildDiskIndexIncrementally];
+    }];
+}
+
+// Needs a complete index, finish the rebuild synchronously if it is still running. Must be called with exclusive IO
+- (void)finishLoadingDiskIndex {
+    if (self.diskIndex.isLoaded) {
+        return;
+    }
+    [self.diskIndex rebuildWithFileManager:_fileManager batchSize:NSUIntegerMax];
+    [self restorePackedEntriesInDiskIndex];
+}
+
+// 重建索引只扫描缓存目录中的文件，打包存储的文件要再加回索引（写入时间记为现在）
+- (void)restorePackedEntriesInDiskIndex {
+    for (NSString *fileName in [self.packStore allFileNames]) {
+        if (![self.diskIndex entryForFileName:fileName]) {
+            [self.diskIndex setEntryForFileName:fileName size:[self.packStore sizeForFileName:fileName] expirationTime:0];
+        }
+    }
+}
+
+// 每次只压缩一个段文件，然后重新排队，不会长时间阻塞其它磁盘读写
+- (void)compactPackStoreIncrementally {
+    [self dispatchExclusiveIO:^{
+        if ([self.packStore compactNextSegment]) {
+            [self compactPackStoreIncrementally];
+        }
+    }];
+}
 
 #pragma mark - Cache paths
 
@@ -201,9 +691,66 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
 
     if (![self.customPaths containsObject:path]) {
         [self.customPaths addObject:path];
+        [self buildFilterForReadOnlyCachePath:path];
     }
 }
 
+// 只读目录的内容不会变化，在后台扫描一次建立过滤器，之后查找不存在的文件不再访问文件系统
+- (void)buildFilterForReadOnlyCachePath:(nonnull NSString *)path {
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+        NSFileManager *fileManager = [NSFileManager new];
+        NSArray<NSString *> *filenames = [fileManager contentsOfDirectoryAtPath:path error:nil];
+        if (!filenames) {
+            BOOL isDirectory = NO;
+            if ([fileManager fileExistsAtPath:path isDirectory:&isDirectory]) {
+                // Unreadable, keep searching the file system
+                return;
+            }
+            filenames = @[];
+        }
+        SDDiskCacheBloomFilter *filter = [[SDDiskCacheBloomFilter alloc] initWithCapacity:filenames.count];
+        for (NSString *filename in filenames) {
+            [filter addString:filename];
+        }
+        @synchronized (self.customPathFilters) {
+            self.customPathFilters[path] = filter;
+        }
+    });
+}
+
+/**
+ 查找某个目录中可能存在的文件名，明确不存在的文件名会被过滤掉：
+ 默认缓存目录使用磁盘缓存索引（精确），只读目录使用布隆过滤器，都还没有准备好时不过滤
+ */
+- (nonnull NSArray<NSString *> *)possibleFilenames:(nonnull NSArray<NSString *> *)filenames inPath:(nonnull NSString *)path {
+    if ([path isEqualToString:self.diskCachePath]) {
+        if (!self.diskIndex.isLoaded) {
+            return filenames;
+        }
+        NSMutableArray<NSString *> *possibleFilenames = [NSMutableArray arrayWithCapacity:filenames.count];
+        for (NSString *filename in filenames) {
+            if ([self.diskIndex entryForFileName:filename]) {
+                [possibleFilenames addObject:filename];
+            }
+        }
+        return possibleFilenames;
+    }
+    SDDiskCacheBloomFilter *filter;
+    @synchronized (self.customPathFilters) {
+        filter = self.customPathFilters[path];
+    }
+    if (!filter) {
+        return filenames;
+    }
+    NSMutableArray<NSString *> *possibleFilenames = [NSMutableArray arrayWithCapacity:filenames.count];
+    for (NSString *filename in filenames) {
+        if ([filter mayContainString:filename]) {
+            [possibleFilenames addObject:filename];
+        }
+    }
+    return possibleFilenames;
+}
+
 - (nullable NSString *)cachePathForKey:(nullable NSString *)key inPath:(nonnull NSString *)path {
     NSString *filename = [self cachedFileNameForKey:key];
     return [path stringByAppendingPathComponent:filename];
@@ -215,29 +762,79 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
 
 
 
-<<<<<<< HEAD
-//主要先看一下这个方法的实现，这个方法的主要功能是根据图片的 URL 返回一个 MD5 处理的文件名。
-//这里的参数 key 多为图片的 URL，把图片的 URL 使用 MD5 方式转化，同时当 URL 有后缀的时候，做加点处理。
-=======
 /**
- 这里的参数 key 多为图片的 URL，把图片的 URL 使用 MD5 方式转化，同时当 URL 有后缀的时候，做加点处理。
+ 这里的参数 key 多为图片的 URL，把图片的 URL 使用 config.diskCacheKeyHashType 指定的哈希算法（默认 MurmurHash3）转化，同时当 URL 有后缀的时候，做加点处理。
+ 最近使用的 key 对应的文件名会被缓存，不用每次都重新计算，修改哈希算法或者 diskCacheFileNameBlock 时清空。
  */
->>>>>>> c3185d69dd8b20c9c451522d995d31bf8cbe0688
 - (nullable NSString *)cachedFileNameForKey:(nullable NSString *)key {
-    const char *str = key.UTF8String;
-    if (str == NULL) {
-        str = "";
+    if (!key) {
+        key = @"";
     }
-    unsigned char r[CC_MD5_DIGEST_LENGTH];
-    CC_MD5(str, (CC_LONG)strlen(str), r);
-    NSURL *keyURL = [NSURL URLWithString:key];
-    NSString *ext = keyURL ? keyURL.pathExtension : key.pathExtension;
-    NSString *filename = [NSString stringWithFormat:@"%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%@",
-                          r[0], r[1], r[2], r[3], r[4], r[5], r[6], r[7], r[8], r[9], r[10],
-                          r[11], r[12], r[13], r[14], r[15], ext.length == 0 ? @"" : [NSString stringWithFormat:@".%@", ext]];
+    SDImageCacheConfigKeyHashType hashType = self.config.diskCacheKeyHashType;
+    SDImageCacheFileNameBlock fileNameBlock = self.config.diskCacheFileNameBlock;
+    // 修改 config 的哈希算法或者 diskCacheFileNameBlock 之后，缓存的文件名全部失效
+    SD_LOCK(self.fileNameCacheLock);
+    if (hashType != _fileNameCacheHashType || fileNameBlock != _fileNameCacheBlock) {
+        [self.fileNameCache removeAllObjects];
+        _fileNameCacheHashType = hashType;
+        _fileNameCacheBlock = fileNameBlock;
+    }
+    NSString *filename = [self.fileNameCache objectForKey:key];
+    SD_UNLOCK(self.fileNameCacheLock);
+    if (filename) {
+        return filename;
+    }
+    if (fileNameBlock) {
+        filename = fileNameBlock(key);
+    }
+    if (!filename) {
+        if (hashType == SDImageCacheConfigKeyHashTypeMD5) {
+            filename = SDLegacyCacheFileNameForKey(key);
+        } else {
+            filename = SDMurmur3CacheFileNameForKey(key);
+        }
+    }
+    // 计算期间 config 又被修改时不缓存
+    SD_LOCK(self.fileNameCacheLock);
+    if (hashType == _fileNameCacheHashType && fileNameBlock == _fileNameCacheBlock) {
+        [self.fileNameCache setObject:filename forKey:key];
+    }
+    SD_UNLOCK(self.fileNameCacheLock);
     return filename;
 }
 
+/**
+ 旧版本可能使用的文件名，按顺序查找：
+ 1.MD5 文件名（从 MD5 切换到其它哈希算法之前缓存的文件）
+ 2.没有后缀的 MD5 文件名
+   fallback because of https://github.com/rs/SDWebImage/pull/976 that added the extension to the disk file name
+ */
+- (nonnull NSArray<NSString *> *)legacyCachedFileNamesForKey:(nullable NSString *)key {
+    if (self.config.diskCacheFileNameBlock) {
+        NSString *filename = [self cachedFileNameForKey:key];
+        return filename.pathExtension.length > 0 ? @[filename.stringByDeletingPathExtension] : @[];
+    }
+    NSString *legacyFilename = SDLegacyCacheFileNameForKey(key ?: @"");
+    NSMutableArray<NSString *> *filenames = [NSMutableArray arrayWithCapacity:2];
+    if (self.config.diskCacheKeyHashType != SDImageCacheConfigKeyHashTypeMD5) {
+        [filenames addObject:legacyFilename];
+    }
+    if (legacyFilename.pathExtension.length > 0) {
+        [filenames addObject:legacyFilename.stringByDeletingPathExtension];
+    }
+    return filenames;
+}
+
+// 把默认缓存目录中旧文件名的缓存文件改成当前的文件名，必须在 key 对应的IO队列中调用
+- (void)migrateLegacyCacheFile:(nonnull NSString *)legacyFilename toFilename:(nonnull NSString *)filename size:(NSUInteger)size {
+    NSString *legacyPath = [self.diskCachePath stringByAppendingPathComponent:legacyFilename];
+    NSString *path = [self.diskCachePath stringByAppendingPathComponent:filename];
+    if ([_fileManager moveItemAtPath:legacyPath toPath:path error:nil]) {
+        [self.diskIndex removeEntryForFileName:legacyFilename];
+        [self.diskIndex setEntryForFileName:filename size:size expirationTime:0];
+    }
+}
+
 - (nullable NSString *)makeDiskCachePath:(nonnull NSString*)fullNamespace {
     NSArray<NSString *> *paths = NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES);
     return [paths[0] stringByAppendingPathComponent:fullNamespace];
@@ -265,6 +862,15 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
             forKey:(nullable NSString *)key
             toDisk:(BOOL)toDisk
         completion:(nullable SDWebImageNoParamsBlock)completionBlock {
+    [self storeImage:image imageData:imageData forKey:key response:nil toDisk:toDisk completion:completionBlock];
+}
+
+- (void)storeImage:(nullable UIImage *)image
+         imageData:(nullable NSData *)imageData
+            forKey:(nullable NSString *)key
+          response:(nullable NSURLResponse *)response
+            toDisk:(BOOL)toDisk
+        completion:(nullable SDWebImageNoParamsBlock)completionBlock {
     
     
     if (!image || !key) {
@@ -285,31 +891,12 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
     }
     
 //先计算出图像的占用内存，使用 _memCache 缓存图像到内存中。这个过程是非常快的，因此不用考虑线程。
-//如果 toDisk 为真，在串行队列 _ioQueue 中异步执行：
+//如果 toDisk 为真，在 key 对应的分片串行队列中异步执行：
     
       //要缓存在沙盒中
     if (toDisk) {
-        //在一个串行队列中做磁盘缓存操作
-        //如果 toDisk 为真，在串行队列 _ioQueue 中异步执行：
-        dispatch_async(self.ioQueue, ^{
-            @autoreleasepool {
-                NSData *data = imageData;
-                if (!data && image) {
-                    //获取图片的类型GIF/PNG等
-                    //根据指定的SDImageFormat，把图片转换为对应的data数据
-                    // If we do not have any data to detect image format, use PNG format
-                    data = [[SDWebImageCodersManager sharedInstance] encodedDataWithImage:image format:SDImageFormatPNG];
-                }
-                //把处理好了的数据存入磁盘
-                [self storeImageDataToDisk:data forKey:key];
-            }
-            
-            if (completionBlock) {
-                dispatch_async(dispatch_get_main_queue(), ^{
-                    completionBlock();
-                });
-            }
-        });
+        //不立即写入，先加入等待写入的队列，一小段时间内的写入会合并成一批，同一个 key 只写入最后一次
+        [self enqueueDiskWriteForKey:key image:image imageData:imageData response:response completion:completionBlock];
     } else {
         if (completionBlock) {
             completionBlock();
@@ -324,7 +911,21 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
     if (!imageData || !key) {
         return;
     }
-    
+    //之前等待写入的数据已经过时了
+    [self cancelPendingWriteForKey:key];
+    //已经在IO队列上（分片队列持有读锁，独占操作持有写锁）时和以前一样在当前线程写入，
+    //同步派发到分片队列会死锁
+    if ([self isCurrentQueueIOQueue]) {
+        [self writeImageDataToDisk:imageData forKey:key];
+        return;
+    }
+    //在 key 的分片队列上持有读锁写入，不会和清理缓存同时执行
+    [self dispatchIOForKeyAndWait:key block:^{
+        [self writeImageDataToDisk:imageData forKey:key];
+    }];
+}
+
+- (void)writeImageDataToDisk:(nonnull NSData *)imageData forKey:(nonnull NSString *)key {
     [self checkIfQueueIsIOQueue];
     //判断_diskCachePath的路径是否存在，没有就创建路径（创建对应的文件夹）
     //.../Library/Caches/default/com.hackemist.SDWebImageCache.default
@@ -336,11 +937,31 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
     // 获取image key 的缓存路径
     //.../Library/Caches/default/com.hackemist.SDWebImageCache.default/24dd60428e4a8af2a2da3d87a226ab9b.png
     NSString *cachePathForKey = [self defaultCachePathForKey:key];
+    NSString *filename = cachePathForKey.lastPathComponent;
+    // 小图片追加到打包存储中，并删除之前单独存储的文件
+    NSUInteger packThreshold = self.config.diskCachePackThreshold;
+    if (packThreshold > 0 && imageData.length <= packThreshold) {
+        // 段文件创建时设置是否上传 iCloud
+        self.packStore.excludedFromBackup = self.config.shouldDisableiCloud;
+        if (![self.packStore setData:imageData forFileName:filename]) {
+            return;
+        }
+        if ([self.diskIndex entryForFileName:filename]) {
+            [_fileManager removeItemAtPath:cachePathForKey error:nil];
+        }
+        [self.diskIndex setEntryForFileName:filename size:imageData.length expirationTime:0];
+        return;
+    }
     // transform to NSUrl
     // 转换成 NSUrl
     NSURL *fileURL = [NSURL fileURLWithPath:cachePathForKey];
-     //将data储存起来
-    [_fileManager createFileAtPath:cachePathForKey contents:imageData attributes:nil];
+     //将data储存起来，先写入临时文件再重命名，读取时不会读到写了一半的文件
+    if (![imageData writeToFile:cachePathForKey options:NSDataWritingAtomic error:nil]) {
+        return;
+    }
+    [self.packStore removeDataForFileName:filename];
+    //记录到磁盘缓存索引
+    [self.diskIndex setEntryForFileName:filename size:imageData.length expirationTime:0];
     
     // disable iCloud backup
     // 是否上传iCould
@@ -349,18 +970,289 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
     }
 }
 
+#pragma mark - Write behind
+
+- (void)enqueueDiskWriteForKey:(nonnull NSString *)key image:(nullable UIImage *)image imageData:(nullable NSData *)imageData response:(nullable NSURLResponse *)response completion:(nullable SDWebImageNoParamsBlock)completionBlock {
+    SDImageCachePendingWrite *write = [SDImageCachePendingWrite new];
+    write.key = key;
+    write.image = image;
+    write.data = imageData;
+    NSString *ETag = nil;
+    NSString *lastModified = nil;
+    NSTimeInterval freshnessTime = 0;
+    if (response && SDHTTPValidatorsFromResponse(response, &ETag, &lastModified, &freshnessTime)) {
+        write.ETag = ETag;
+        write.lastModified = lastModified;
+        write.freshnessTime = freshnessTime;
+        write.hasHTTPValidators = YES;
+    }
+    // 没有 data 时用解码后的大小估算
+    write.cost = imageData ? imageData.length : SDCacheCostForImage(image);
+    if (completionBlock) {
+        [write.completionBlocks addObject:completionBlock];
+    }
+    BOOL flushNow = NO;
+    BOOL scheduleFlush = NO;
+    BOOL writeNow = NO;
+    NSUInteger bufferSize = self.config.diskCacheWriteBufferSize;
+    SD_LOCK(self.pendingWritesLock);
+    SDImageCachePendingWrite *supersededWrite = self.pendingWrites[key];
+    if (supersededWrite) {
+        // 被替换的写入不再执行，它的回调在新的写入完成后执行
+        [write.completionBlocks insertObjects:supersededWrite.completionBlocks atIndexes:[NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, supersededWrite.completionBlocks.count)]];
+        [supersededWrite.completionBlocks removeAllObjects];
+        // 已经派发的写入执行时才从 _inFlightWriteBytes 中减去
+        if (!supersededWrite.isDispatched) {
+            _undispatchedWriteBytes -= supersededWrite.cost;
+        }
+    }
+    self.pendingWrites[key] = write;
+    if (_inFlightWriteBytes >= bufferSize * kDiskWriteInFlightBufferCount && ![NSThread isMainThread] && ![self isCurrentQueueIOQueue]) {
+        // 磁盘跟不上时后台线程同步写入，限制等待写入的数据占用的内存。主线程和 IO 队列不等待
+        write.dispatched = YES;
+        _inFlightWriteBytes += write.cost;
+        writeNow = YES;
+    } else {
+        _undispatchedWriteBytes += write.cost;
+        if (_undispatchedWriteBytes >= bufferSize) {
+            flushNow = YES;
+        } else if (!_pendingWritesFlushScheduled) {
+            _pendingWritesFlushScheduled = YES;
+            scheduleFlush = YES;
+        }
+    }
+    SD_UNLOCK(self.pendingWritesLock);
+
+    if (writeNow) {
+        [self dispatchIOForKeyAndWait:key block:^{
+            [self performPendingWrite:write];
+        }];
+    } else if (flushNow) {
+        [self dispatchPendingWrites];
+    } else if (scheduleFlush) {
+        __weak typeof(self) weakSelf = self;
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kDiskWriteBehindDelay * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            [weakSelf dispatchPendingWrites];
+        });
+    }
+}
+
+// 把还没有派发的写入按分片分组，每个分片只派发一个 block 依次写入
+- (void)dispatchPendingWrites {
+    NSMutableDictionary<NSNumber *, NSMutableArray<SDImageCachePendingWrite *> *> *writesByShard = [NSMutableDictionary dictionary];
+    SD_LOCK(self.pendingWritesLock);
+    _pendingWritesFlushScheduled = NO;
+    for (SDImageCachePendingWrite *write in self.pendingWrites.allValues) {
+        if (write.isDispatched) {
+            continue;
+        }
+        write.dispatched = YES;
+        _undispatchedWriteBytes -= write.cost;
+        _inFlightWriteBytes += write.cost;
+        NSNumber *shard = @([self ioShardIndexForKey:write.key]);
+        NSMutableArray<SDImageCachePendingWrite *> *writes = writesByShard[shard];
+        if (!writes) {
+            writes = [NSMutableArray array];
+            writesByShard[shard] = writes;
+        }
+        [writes addObject:write];
+    }
+    SD_UNLOCK(self.pendingWritesLock);
+
+    [writesByShard enumerateKeysAndObjectsUsingBlock:^(NSNumber *shard, NSMutableArray<SDImageCachePendingWrite *> *writes, BOOL *stop) {
+        [self dispatchIOForKey:writes.firstObject.key block:^{
+            for (SDImageCachePendingWrite *write in writes) {
+                [self performPendingWrite:write];
+            }
+        }];
+    }];
+}
+
+- (void)performPendingWrite:(nonnull SDImageCachePendingWrite *)write {
+    SD_LOCK(self.pendingWritesLock);
+    BOOL current = self.pendingWrites[write.key] == write;
+    SD_UNLOCK(self.pendingWritesLock);
+    // 已经被替换或者取消的写入直接丢弃
+    if (current) {
+        @autoreleasepool {
+            NSData *data = [self dataForPendingWrite:write];
+            if (data) {
+                //把处理好了的数据存入磁盘
+                [self writeImageDataToDisk:data forKey:write.key];
+                if (write.hasHTTPValidators) {
+                    [self.diskIndex setHTTPValidatorsForFileName:[self cachedFileNameForKey:write.key]
+                                                            ETag:write.ETag
+                                                    lastModified:write.lastModified
+                                                   freshnessTime:write.freshnessTime];
+                }
+            }
+        }
+    }
+    NSArray<SDWebImageNoParamsBlock> *completionBlocks;
+    SD_LOCK(self.pendingWritesLock);
+    if (self.pendingWrites[write.key] == write) {
+        [self.pendingWrites removeObjectForKey:write.key];
+    }
+    _inFlightWriteBytes -= write.cost;
+    completionBlocks = [write.completionBlocks copy];
+    [write.completionBlocks removeAllObjects];
+    SD_UNLOCK(self.pendingWritesLock);
+    SDCallCompletionBlocksOnMainQueue(completionBlocks);
+}
+
+- (nullable NSData *)dataForPendingWrite:(nonnull SDImageCachePendingWrite *)write {
+    SD_LOCK(self.pendingWritesLock);
+    NSData *data = write.data;
+    UIImage *image = write.image;
+    SD_UNLOCK(self.pendingWritesLock);
+    if (data || !image) {
+        return data;
+    }
+    //获取图片的类型GIF/PNG等
+    //根据指定的SDImageFormat，把图片转换为对应的data数据
+    // If we do not have any data to detect image format, use PNG format
+    data = [[SDWebImageCodersManager sharedInstance] encodedDataWithImage:image format:SDImageFormatPNG];
+    SD_LOCK(self.pendingWritesLock);
+    // 编码结果留给之后的读取和写入使用
+    if (!write.data) {
+        write.data = data;
+    }
+    SD_UNLOCK(self.pendingWritesLock);
+    return data;
+}
+
+// 还没有写入磁盘的数据
+- (nullable NSData *)pendingDiskDataForKey:(nonnull NSString *)key {
+    SD_LOCK(self.pendingWritesLock);
+    SDImageCachePendingWrite *write = self.pendingWrites[key];
+    SD_UNLOCK(self.pendingWritesLock);
+    return write ? [self dataForPendingWrite:write] : nil;
+}
+
+- (void)cancelPendingWriteForKey:(nonnull NSString *)key {
+    NSArray<SDWebImageNoParamsBlock> *completionBlocks;
+    SD_LOCK(self.pendingWritesLock);
+    SDImageCachePendingWrite *write = self.pendingWrites[key];
+    if (write) {
+        [self.pendingWrites removeObjectForKey:key];
+        if (!write.isDispatched) {
+            _undispatchedWriteBytes -= write.cost;
+        }
+    }
+    completionBlocks = [write.completionBlocks copy];
+    [write.completionBlocks removeAllObjects];
+    SD_UNLOCK(self.pendingWritesLock);
+    SDCallCompletionBlocksOnMainQueue(completionBlocks);
+}
+
+- (void)cancelAllPendingWrites {
+    NSMutableArray<SDWebImageNoParamsBlock> *completionBlocks = [NSMutableArray array];
+    SD_LOCK(self.pendingWritesLock);
+    for (SDImageCachePendingWrite *write in self.pendingWrites.allValues) {
+        [completionBlocks addObjectsFromArray:write.completionBlocks];
+        [write.completionBlocks removeAllObjects];
+    }
+    [self.pendingWrites removeAllObjects];
+    // 已经派发的写入仍然会执行，执行时从 _inFlightWriteBytes 中减去
+    _undispatchedWriteBytes = 0;
+    SD_UNLOCK(self.pendingWritesLock);
+    SDCallCompletionBlocksOnMainQueue(completionBlocks);
+}
+
+- (void)flushDiskWrites {
+    [self dispatchPendingWrites];
+    // 分片队列是串行的，空的 block 执行时之前派发的写入都已经完成
+    for (dispatch_queue_t queue in self.ioShardQueues) {
+        dispatch_sync(queue, ^{});
+    }
+}
+
+- (void)flushDiskWritesWithCompletion:(nullable SDWebImageNoParamsBlock)completion {
+    [self dispatchPendingWrites];
+    dispatch_group_t group = dispatch_group_create();
+    for (dispatch_queue_t queue in self.ioShardQueues) {
+        dispatch_group_async(group, queue, ^{});
+    }
+    dispatch_group_notify(group, dispatch_get_main_queue(), ^{
+        if (completion) {
+            completion();
+        }
+    });
+}
+
+#pragma mark - HTTP revalidation
+
+- (void)refreshDiskImageForKey:(nullable NSString *)key withNotModifiedResponse:(nullable NSURLResponse *)response {
+    if (!key || !response) {
+        return;
+    }
+    NSString *ETag = nil;
+    NSString *lastModified = nil;
+    NSTimeInterval freshnessTime = 0;
+    SDHTTPValidatorsFromResponse(response, &ETag, &lastModified, &freshnessTime);
+    [self dispatchIOForKey:key block:^{
+        NSString *filename = [self cachedFileNameForKey:key];
+        SDDiskCacheIndexEntry *entry = [self.diskIndex entryForFileName:filename];
+        if (!entry) {
+            return;
+        }
+        // 304 可能不带校验信息，这时沿用之前的
+        [self.diskIndex setHTTPValidatorsForFileName:filename
+                                                ETag:ETag ?: entry.ETag
+                                        lastModified:lastModified ?: entry.lastModified
+                                       freshnessTime:freshnessTime];
+    }];
+}
+
+- (nullable NSDictionary<NSString *, NSString *> *)conditionalRequestHeadersForKey:(nullable NSString *)key {
+    if (!key) {
+        return nil;
+    }
+    // 只读取内存中的索引，不访问磁盘
+    SDDiskCacheIndexEntry *entry = [self.diskIndex entryForFileName:[self cachedFileNameForKey:key]];
+    if (!entry.ETag && !entry.lastModified) {
+        return nil;
+    }
+    NSMutableDictionary<NSString *, NSString *> *headers = [NSMutableDictionary dictionaryWithCapacity:2];
+    if (entry.ETag) {
+        headers[@"If-None-Match"] = entry.ETag;
+    }
+    if (entry.lastModified) {
+        headers[@"If-Modified-Since"] = entry.lastModified;
+    }
+    return [headers copy];
+}
+
+- (BOOL)isDiskImageFreshForKey:(nullable NSString *)key {
+    if (!key) {
+        return NO;
+    }
+    SDDiskCacheIndexEntry *entry = [self.diskIndex entryForFileName:[self cachedFileNameForKey:key]];
+    return entry.freshnessTime > [[NSDate date] timeIntervalSince1970];
+}
+
 #pragma mark - Query and Retrieve Ops
 // 根据key判断磁盘缓存中是否存在图片
 - (void)diskImageExistsWithKey:(nullable NSString *)key completion:(nullable SDWebImageCheckCacheCompletionBlock)completionBlock {
     
-    dispatch_async(_ioQueue, ^{
-        BOOL exists = [_fileManager fileExistsAtPath:[self defaultCachePathForKey:key]];
-
+    [self dispatchIOForKey:key block:^{
         // fallback because of https://github.com/rs/SDWebImage/pull/976 that added the extension to the disk file name
         // checking the key with and without the extension
-         // 要确认有带拓展名的和没带拓展名的
-        if (!exists) {
-            exists = [_fileManager fileExistsAtPath:[self defaultCachePathForKey:key].stringByDeletingPathExtension];
+         // 要确认旧版本的文件名（MD5、没有拓展名的），索引中明确不存在的文件不访问文件系统
+        NSArray<NSString *> *filenames = [@[[self cachedFileNameForKey:key]] arrayByAddingObjectsFromArray:[self legacyCachedFileNamesForKey:key]];
+        BOOL exists = NO;
+        //还在等待写入的图片同样算作存在
+        SD_LOCK(self.pendingWritesLock);
+        if (key && self.pendingWrites[key]) {
+            exists = YES;
+            filenames = @[];
+        }
+        SD_UNLOCK(self.pendingWritesLock);
+        for (NSString *filename in [self possibleFilenames:filenames inPath:self.diskCachePath]) {
+            if ([self.packStore containsFileName:filename] || [_fileManager fileExistsAtPath:[self.diskCachePath stringByAppendingPathComponent:filename]]) {
+                exists = YES;
+                break;
+            }
         }
        //在主线程回调completionBlock
         if (completionBlock) {
@@ -368,7 +1260,7 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
                 completionBlock(exists);
             });
         }
-    });
+    }];
 }
 //根据key获取缓存在内存中的图片
 - (nullable UIImage *)imageFromMemoryCacheForKey:(nullable NSString *)key {
@@ -404,44 +1296,99 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
 
 // 根据指定的key，获取存储在磁盘上的数据
 - (nullable NSData *)diskImageDataBySearchingAllPathsForKey:(nullable NSString *)key {
-    //获取key对应的path
-    NSString *defaultPath = [self defaultCachePathForKey:key];
-    NSData *data = [NSData dataWithContentsOfFile:defaultPath options:self.config.diskCacheReadingOptions error:nil];
+    if (!key) {
+        return nil;
+    }
+    //刚存储还没有写入磁盘的图片直接返回等待写入的数据
+    NSData *data = [self pendingDiskDataForKey:key];
+    if (data) {
+        return data;
+    }
+    //获取key对应的文件名
+    NSString *filename = [self cachedFileNameForKey:key];
+    data = [self defaultPathDataForFilenames:@[filename] currentFilename:filename];
     if (data) {
         return data;
     }
-    // 注意要使用有带拓展名的和没带拓展名的地址来获取一遍
+    // 注意要使用旧版本的文件名（MD5、没有拓展名的）再获取一遍
     // fallback because of https://github.com/rs/SDWebImage/pull/976 that added the extension to the disk file name
     // checking the key with and without the extension
-    //如果key没有后缀名，则会走到这里通过这里读取
-    data = [NSData dataWithContentsOfFile:defaultPath.stringByDeletingPathExtension options:self.config.diskCacheReadingOptions error:nil];
+    NSArray<NSString *> *legacyFilenames = [self legacyCachedFileNamesForKey:key];
+    data = [self defaultPathDataForFilenames:legacyFilenames currentFilename:filename];
     if (data) {
         return data;
     }
     //如果在默认路径没有找到图片，则在自定义路径迭代查找
+    // 只读目录中的文件通常是旧版本生成的，同样要用旧的文件名获取一遍
+    NSArray<NSString *> *filenames = [@[filename] arrayByAddingObjectsFromArray:legacyFilenames];
     NSArray<NSString *> *customPaths = [self.customPaths copy];
     for (NSString *path in customPaths) {
-        NSString *filePath = [self cachePathForKey:key inPath:path];
-        NSData *imageData = [NSData dataWithContentsOfFile:filePath options:self.config.diskCacheReadingOptions error:nil];
-        if (imageData) {
-            return imageData;
-        }
-        // 注意要使用有带拓展名的和没带拓展名的地址来获取一遍
-        // fallback because of https://github.com/rs/SDWebImage/pull/976 that added the extension to the disk file name
-        // checking the key with and without the extension
-        imageData = [NSData dataWithContentsOfFile:filePath.stringByDeletingPathExtension options:self.config.diskCacheReadingOptions error:nil];
-        if (imageData) {
-            return imageData;
+        for (NSString *possibleFilename in [self possibleFilenames:filenames inPath:path]) {
+            NSData *imageData = [self dataWithContentsOfCacheFile:[path stringByAppendingPathComponent:possibleFilename] indexEntry:nil];
+            if (imageData) {
+                return imageData;
+            }
         }
     }
 
     return nil;
 }
 
+// 在默认缓存目录中读取，只读取可能存在的文件，确定不存在的文件不访问文件系统
+- (nullable NSData *)defaultPathDataForFilenames:(nonnull NSArray<NSString *> *)filenames currentFilename:(nonnull NSString *)filename {
+    for (NSString *possibleFilename in [self possibleFilenames:filenames inPath:self.diskCachePath]) {
+        // 只有当前的文件名会打包存储
+        NSData *data = [possibleFilename isEqualToString:filename] ? [self.packStore dataForFileName:filename] : nil;
+        if (!data) {
+            NSString *path = [self.diskCachePath stringByAppendingPathComponent:possibleFilename];
+            data = [self dataWithContentsOfCacheFile:path indexEntry:[self.diskIndex entryForFileName:possibleFilename]];
+        }
+        if (!data) {
+            continue;
+        }
+        if ([possibleFilename isEqualToString:filename]) {
+            //记录命中，只更新索引，不修改文件属性
+            [self.diskIndex recordAccessForFileName:filename];
+        } else {
+            //旧文件名的缓存，改成当前的文件名
+            [self migrateLegacyCacheFile:possibleFilename toFilename:filename size:data.length];
+        }
+        return data;
+    }
+    return nil;
+}
+
+// 读取缓存文件，大文件使用内存映射，文件大小优先从索引中获取
+- (nullable NSData *)dataWithContentsOfCacheFile:(nonnull NSString *)path indexEntry:(nullable SDDiskCacheIndexEntry *)entry {
+    NSDataReadingOptions options = self.config.diskCacheReadingOptions;
+    NSUInteger threshold = self.config.diskCacheMappedReadingThreshold;
+    if (threshold > 0 && !(options & NSDataReadingMappedAlways)) {
+        unsigned long long size = 0;
+        if (entry) {
+            size = entry.size;
+        } else {
+            struct stat st;
+            if (stat(path.fileSystemRepresentation, &st) != 0) {
+                return nil;
+            }
+            size = (unsigned long long)st.st_size;
+        }
+        if (size >= threshold) {
+            options |= NSDataReadingMappedAlways;
+        }
+    }
+    return [NSData dataWithContentsOfFile:path options:options error:nil];
+}
+
 //根据指定的key获取image对象
 - (nullable UIImage *)diskImageForKey:(nullable NSString *)key {
     //通过key从磁盘中获取图片data
     NSData *data = [self diskImageDataBySearchingAllPathsForKey:key];
+    return [self diskImageForKey:key data:data];
+}
+
+// 将磁盘中读取的data解码成image，data可能是内存映射的，解码时直接读取映射的内存
+- (nullable UIImage *)diskImageForKey:(nullable NSString *)key data:(nullable NSData *)data {
     if (data) {
         //将data转成image（其中有包括调整方向）
         UIImage *image = [[SDWebImageCodersManager sharedInstance] decodedImageWithData:data];
@@ -489,10 +1436,10 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
     
     //内存缓存没有
     //新建一个NSOperation来获取磁盘图片 ？？？？？？？？
-    //在 _ioQueue 中异步执行，创建一个 NSOperation 类型的 operation，如果 operation 取消了则直接 return。
+    //在 key 对应的分片队列中异步执行，创建一个 NSOperation 类型的 operation，如果 operation 取消了则直接 return。
     NSOperation *operation = [NSOperation new];
      //在IO队列中去查找沙盒中的图片
-    dispatch_async(self.ioQueue, ^{
+    [self dispatchIOForKey:key block:^{
         if (operation.isCancelled) {
             // do not call the completion if cancelled
             return;
@@ -503,8 +1450,8 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
         @autoreleasepool {
          
             NSData *diskData = [self diskImageDataBySearchingAllPathsForKey:key];
-                //通过key去沙盒获取image
-            UIImage *diskImage = [self diskImageForKey:key];
+                //用读取到的data解码image，不再重复读取磁盘
+            UIImage *diskImage = [self diskImageForKey:key data:diskData];
               //如果沙盒有，并且需要缓存图片则缓存起来
             if (diskImage && self.config.shouldCacheImagesInMemory) {
                 //获得图片消耗的内存大小
@@ -520,7 +1467,7 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
                 });
             }
         }
-    });
+    }];
 
     return operation;
 }
@@ -544,15 +1491,26 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
     
     //是否也要删除沙盒中的缓存
     if (fromDisk) {
-        dispatch_async(self.ioQueue, ^{
-            [_fileManager removeItemAtPath:[self defaultCachePathForKey:key] error:nil];
+        //还没有写入的数据不再写入
+        [self cancelPendingWriteForKey:key];
+        [self dispatchIOForKey:key block:^{
+            NSArray<NSString *> *filenames = [@[[self cachedFileNameForKey:key]] arrayByAddingObjectsFromArray:[self legacyCachedFileNamesForKey:key]];
+            for (NSString *filename in filenames) {
+                BOOL removed = [self.packStore removeDataForFileName:filename];
+                if ([_fileManager removeItemAtPath:[self.diskCachePath stringByAppendingPathComponent:filename] error:nil]) {
+                    removed = YES;
+                }
+                if (removed) {
+                    [self.diskIndex removeEntryForFileName:filename];
+                }
+            }
             
             if (completion) {
                 dispatch_async(dispatch_get_main_queue(), ^{
                     completion();
                 });
             }
-        });
+        }];
     } else if (completion){
         completion();
     }
@@ -577,6 +1535,43 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
     self.memCache.countLimit = maxCountLimit;
 }
 
+- (NSTimeInterval)maxMemoryAge {
+    return self.memCache.ageLimit;
+}
+
+- (void)setMaxMemoryAge:(NSTimeInterval)maxMemoryAge {
+    self.memCache.ageLimit = maxMemoryAge;
+}
+
+// 系统内存紧张时先淘汰一半，严重时清空内存缓存，macOS 上没有内存警告通知也会生效
+- (void)startObservingMemoryPressure {
+    dispatch_source_t source = dispatch_source_create(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE, 0,
+                                                      DISPATCH_MEMORYPRESSURE_WARN | DISPATCH_MEMORYPRESSURE_CRITICAL,
+                                                      dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0));
+    if (!source) {
+        return;
+    }
+    __weak typeof(self) wself = self;
+    dispatch_source_set_event_handler(source, ^{
+        __strong typeof(wself) sself = wself;
+        if (!sself) {
+            return;
+        }
+        unsigned long pressure = dispatch_source_get_data(source);
+        [sself trimMemoryForPressure:pressure];
+    });
+    _memoryPressureSource = source;
+    dispatch_resume(source);
+}
+
+- (void)trimMemoryForPressure:(unsigned long)pressure {
+    if (pressure & DISPATCH_MEMORYPRESSURE_CRITICAL) {
+        [self clearMemory];
+    } else if (pressure & DISPATCH_MEMORYPRESSURE_WARN) {
+        [self.memCache trimToCost:self.memCache.totalCost / 2];
+    }
+}
+
 #pragma mark - Cache clean Ops
 //清除内存缓存
 - (void)clearMemory {
@@ -584,8 +1579,9 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
 }
 //清除沙盒的缓存，完成后执行传入的block
 - (void)clearDiskOnCompletion:(nullable SDWebImageNoParamsBlock)completion {
-    //在io队列中异步执行清除操作
-    dispatch_async(self.ioQueue, ^{
+    [self cancelAllPendingWrites];
+    //独占整个磁盘缓存，异步执行清除操作
+    [self dispatchExclusiveIO:^{
         //清除文件夹
         [_fileManager removeItemAtPath:self.diskCachePath error:nil];
         //再创建个空的文件夹
@@ -593,13 +1589,16 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
                 withIntermediateDirectories:YES
                                  attributes:nil
                                       error:NULL];
+        //清空索引和打包存储
+        [self.diskIndex removeAllEntries];
+        [self.packStore removeAllData];
          //主线程回调传入的block（completion）
         if (completion) {
             dispatch_async(dispatch_get_main_queue(), ^{
                 completion();
             });
         }
-    });
+    }];
 }
 
 - (void)deleteOldFiles {
@@ -607,120 +1606,83 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
 }
 /**
  当应用终止或者进入后台都会调用这个方法来清除缓存图片
- 这里会根据图片存储时间来清理图片，默认是一周，从最老的图片开始清理。如果图片缓存空间小于一个规定值，则不考虑
+ 这里会根据 config.diskCacheExpireType 指定的时间（默认是最近访问时间）来清理图片，默认是一周，从最久未使用的图片开始清理。如果图片缓存空间小于一个规定值，则不考虑
  
  @param completionBlock 清除完成以后的回调
  */
 - (void)deleteOldFilesWithCompletionBlock:(nullable SDWebImageNoParamsBlock)completionBlock {
-    //获取磁盘缓存的默认根目录
-
-    dispatch_async(self.ioQueue, ^{
-        NSURL *diskCacheURL = [NSURL fileURLWithPath:self.diskCachePath isDirectory:YES];
-        NSArray<NSString *> *resourceKeys = @[NSURLIsDirectoryKey, NSURLContentModificationDateKey, NSURLTotalFileAllocatedSizeKey];
-// 这个枚举器为我们的缓存文件预取有用的属性.
-        // This enumerator prefetches useful properties for our cache files.
-        NSDirectoryEnumerator *fileEnumerator = [_fileManager enumeratorAtURL:diskCacheURL
-                                                   includingPropertiesForKeys:resourceKeys
-                                                                      options:NSDirectoryEnumerationSkipsHiddenFiles
-                                                                 errorHandler:NULL];
-  //求出过期的时间点
-        NSDate *expirationDate = [NSDate dateWithTimeIntervalSinceNow:-self.config.maxCacheAge];
-        NSMutableDictionary<NSURL *, NSDictionary<NSString *, id> *> *cacheFiles = [NSMutableDictionary dictionary];
-        NSUInteger currentCacheSize = 0;
-
-        // Enumerate all of the files in the cache directory.  This loop has two purposes:
+    [self dispatchExclusiveIO:^{
+        // 清理完全基于磁盘缓存索引，不再遍历缓存目录
+        [self finishLoadingDiskIndex];
+        //求出过期的时间点
+        SDImageCacheConfigExpireType expireType = self.config.diskCacheExpireType;
+        NSTimeInterval now = [[NSDate date] timeIntervalSince1970];
+        NSTimeInterval expirationTime = now - self.config.maxCacheAge;
+        NSMutableArray<SDDiskCacheIndexEntry *> *cacheEntries = [NSMutableArray array];
+
+        // Walk all of the indexed files. This loop has two purposes:
         //
         //  1. Removing files that are older than the expiration date.
-        //  2. Storing file attributes for the size-based cleanup pass.
-        
-        //迭代缓存目录。有两个目的：
-        //1 删除比指定日期更老的图片
-        //2 记录文件的大小，以提供给后面删除使用
-        NSMutableArray<NSURL *> *urlsToDelete = [[NSMutableArray alloc] init];
-        
-        //枚举器获取所有文件的url
-        for (NSURL *fileURL in fileEnumerator) {
-            NSError *error;
-            //获取文件的相关属性字典
-            //获取指定url对应文件的指定三种属性的key和value
-            NSDictionary<NSString *, id> *resourceValues = [fileURL resourceValuesForKeys:resourceKeys error:&error];
-             // 跳过文件夹
-            // Skip directories and errors.
-            //如果是文件夹则返回
-
-            if (error || !resourceValues || [resourceValues[NSURLIsDirectoryKey] boolValue]) {
-                continue;
-            }
-            // 移除比过期时间点更早的文件;
-            //获取指定url文件对应的修改日期
-
-            // Remove files that are older than the expiration date;
-            NSDate *modificationDate = resourceValues[NSURLContentModificationDateKey];
-            //通过文件创建日期和过期时间点的比较来判断是否过期
-            //如果修改日期大于指定日期，则加入要移除的数组里
-            if ([[modificationDate laterDate:expirationDate] isEqualToDate:expirationDate]) {
-                [urlsToDelete addObject:fileURL];
-                continue;
+        //  2. Collecting the remaining files for the size-based cleanup pass.
+        for (SDDiskCacheIndexEntry *entry in [self.diskIndex allEntries]) {
+            NSTimeInterval entryTime = expireType == SDImageCacheConfigExpireTypeModificationDate ? entry.modificationTime : entry.accessTime;
+            BOOL expired = entry.expirationTime > 0 ? entry.expirationTime <= now : entryTime <= expirationTime;
+            if (expired) {
+                [self removeIndexedFile:entry];
+            } else {
+                [cacheEntries addObject:entry];
             }
-             //获取指定的url对应的文件的大小，并且把url与对应大小存入一个字典中
-
-            // Store a reference to this file and account for its total size.
-            NSNumber *totalAllocatedSize = resourceValues[NSURLTotalFileAllocatedSizeKey];
-            //当前缓存总大小
-            currentCacheSize += totalAllocatedSize.unsignedIntegerValue;
-            //将该文件的属性字典保存在cacheFiles中，以fileURL为key
-            cacheFiles[fileURL] = resourceValues;
         }
-         //删除所有最后修改日期大于指定日期的所有文件
 
-        for (NSURL *fileURL in urlsToDelete) {
-            [_fileManager removeItemAtURL:fileURL error:nil];
-        }
-        
-        
         // 如果我们剩下的磁盘缓存大小还是超过配置的容量，就再次进行清理
-        // 当前容量大于设置的maxCacheSize
         // If our remaining disk cache exceeds a configured maximum size, perform a second
         // size-based cleanup pass.  We delete the oldest files first.
-        
-        //如果当前缓存的大小超过了默认大小，则按照日期删除，直到缓存大小<默认大小的一半
-
+        NSUInteger currentCacheSize = self.diskIndex.totalSize;
         if (self.config.maxCacheSize > 0 && currentCacheSize > self.config.maxCacheSize) {
             // Target half of our maximum cache size for this cleanup pass.
             // 一个期望的内存大小是配置容量的一半
             const NSUInteger desiredCacheSize = self.config.maxCacheSize / 2;
-            //通过日期来排序，最旧的放在数组前面
-            //根据文件创建的时间排序
 
-            // Sort the remaining cache files by their last modification time (oldest first).
-            NSArray<NSURL *> *sortedFiles = [cacheFiles keysSortedByValueWithOptions:NSSortConcurrent
-                                                                     usingComparator:^NSComparisonResult(id obj1, id obj2) {
-                                                                         return [obj1[NSURLContentModificationDateKey] compare:obj2[NSURLContentModificationDateKey]];
-                                                                     }];
-            // 删除文件直到达到我们的目标容量.
-            //迭代删除缓存，直到缓存大小是默认缓存大小的一半
+            // Sort the remaining cache files by eviction order (first to delete first).
+            [cacheEntries sortWithOptions:NSSortConcurrent usingComparator:^NSComparisonResult(SDDiskCacheIndexEntry *entry1, SDDiskCacheIndexEntry *entry2) {
+                double value1 = SDDiskCacheRetentionValue(entry1, expireType, now);
+                double value2 = SDDiskCacheRetentionValue(entry2, expireType, now);
+                if (value1 < value2) {
+                    return NSOrderedAscending;
+                }
+                return value1 > value2 ? NSOrderedDescending : NSOrderedSame;
+            }];
 
             // Delete files until we fall below our desired cache size.
-            for (NSURL *fileURL in sortedFiles) {
-                if ([_fileManager removeItemAtURL:fileURL error:nil]) {
-                    NSDictionary<NSString *, id> *resourceValues = cacheFiles[fileURL];
-                    NSNumber *totalAllocatedSize = resourceValues[NSURLTotalFileAllocatedSizeKey];
-                    //计算当前缓存总大小
-                    currentCacheSize -= totalAllocatedSize.unsignedIntegerValue;
-                    //如果当前缓存总大小小于目标容量，就不用删除了
-                    if (currentCacheSize < desiredCacheSize) {
-                        break;
-                    }
+            for (SDDiskCacheIndexEntry *entry in cacheEntries) {
+                [self removeIndexedFile:entry];
+                if (self.diskIndex.totalSize < desiredCacheSize) {
+                    break;
                 }
             }
         }
+        [self.diskIndex synchronize];
+        // 删除的打包文件只是追加了删除记录，在后台压缩段文件回收空间
+        [self compactPackStoreIncrementally];
         //执行完毕，主线程回调
         if (completionBlock) {
             dispatch_async(dispatch_get_main_queue(), ^{
                 completionBlock();
             });
         }
-    });
+    }];
+}
+
+// 删除索引中的一个文件。文件已经不存在时同样从索引中移除
+- (void)removeIndexedFile:(nonnull SDDiskCacheIndexEntry *)entry {
+    if ([self.packStore removeDataForFileName:entry.fileName]) {
+        [self.diskIndex removeEntryForFileName:entry.fileName];
+        return;
+    }
+    NSString *filePath = [self.diskCachePath stringByAppendingPathComponent:entry.fileName];
+    if ([_fileManager removeItemAtPath:filePath error:nil] || ![_fileManager fileExistsAtPath:filePath]) {
+        [self.diskIndex removeEntryForFileName:entry.fileName];
+    }
 }
 
 #if SD_UIKIT
@@ -743,66 +1705,58 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
     //图片清理结束以后，处理完成
 
     // Start the long-running task and return immediately.
-    [self deleteOldFilesWithCompletionBlock:^{
-        //清理完成以后，终止任务
-
-        [application endBackgroundTask:bgTask];
-        bgTask = UIBackgroundTaskInvalid;
+    // 先把等待写入的图片写入磁盘，再清理
+    [self flushDiskWritesWithCompletion:^{
+        [self deleteOldFilesWithCompletionBlock:^{
+            //清理完成以后，终止任务
+
+            [application endBackgroundTask:bgTask];
+            bgTask = UIBackgroundTaskInvalid;
+        }];
     }];
 }
 #endif
 
 #pragma mark - Cache Info
-//获取磁盘缓存文件总大小（在ioQueue中） 通过_fileManager在iO队列中去异步获取的。
+//获取磁盘缓存文件总大小，直接读取磁盘缓存索引
 - (NSUInteger)getSize {
+    if (self.diskIndex.isLoaded) {
+        return self.diskIndex.totalSize;
+    }
     __block NSUInteger size = 0;
-    dispatch_sync(self.ioQueue, ^{
-        NSDirectoryEnumerator *fileEnumerator = [_fileManager enumeratorAtPath:self.diskCachePath];
-        for (NSString *fileName in fileEnumerator) {
-            NSString *filePath = [self.diskCachePath stringByAppendingPathComponent:fileName];
-            NSDictionary<NSString *, id> *attrs = [[NSFileManager defaultManager] attributesOfItemAtPath:filePath error:nil];
-            size += [attrs fileSize];
-        }
-    });
+    [self dispatchExclusiveIOAndWait:^{
+        [self finishLoadingDiskIndex];
+        size = self.diskIndex.totalSize;
+    }];
     return size;
 }
-//获取磁盘缓存文件数量（在ioQueue中）
+//获取磁盘缓存文件数量，直接读取磁盘缓存索引
 - (NSUInteger)getDiskCount {
+    if (self.diskIndex.isLoaded) {
+        return self.diskIndex.count;
+    }
     __block NSUInteger count = 0;
-    dispatch_sync(self.ioQueue, ^{
-        NSDirectoryEnumerator *fileEnumerator = [_fileManager enumeratorAtPath:self.diskCachePath];
-        count = fileEnumerator.allObjects.count;
-    });
+    [self dispatchExclusiveIOAndWait:^{
+        [self finishLoadingDiskIndex];
+        count = self.diskIndex.count;
+    }];
     return count;
 }
 
-//计算磁盘缓存文件总大小和数量（在ioQueue中），并通过block传出
+//计算磁盘缓存文件总大小和数量（独占磁盘缓存），并通过block传出
 
 - (void)calculateSizeWithCompletionBlock:(nullable SDWebImageCalculateSizeBlock)completionBlock {
-    NSURL *diskCacheURL = [NSURL fileURLWithPath:self.diskCachePath isDirectory:YES];
-
-    dispatch_async(self.ioQueue, ^{
-        NSUInteger fileCount = 0;
-        NSUInteger totalSize = 0;
-
-        NSDirectoryEnumerator *fileEnumerator = [_fileManager enumeratorAtURL:diskCacheURL
-                                                   includingPropertiesForKeys:@[NSFileSize]
-                                                                      options:NSDirectoryEnumerationSkipsHiddenFiles
-                                                                 errorHandler:NULL];
-
-        for (NSURL *fileURL in fileEnumerator) {
-            NSNumber *fileSize;
-            [fileURL getResourceValue:&fileSize forKey:NSURLFileSizeKey error:NULL];
-            totalSize += fileSize.unsignedIntegerValue;
-            fileCount += 1;
-        }
+    [self dispatchExclusiveIO:^{
+        [self finishLoadingDiskIndex];
+        NSUInteger fileCount = self.diskIndex.count;
+        NSUInteger totalSize = self.diskIndex.totalSize;
 
         if (completionBlock) {
             dispatch_async(dispatch_get_main_queue(), ^{
                 completionBlock(fileCount, totalSize);
             });
         }
-    });
+    }];
 }
 
 @end
@@ -9,6 +9,49 @@
 #import <Foundation/Foundation.h>
 #import "SDWebImageCompat.h"
 
+/**
+ 磁盘缓存的淘汰策略，决定过期和超出容量时先删除哪些文件
+ */
+typedef NS_ENUM(NSUInteger, SDImageCacheConfigExpireType) {
+    /**
+     * When the image is accessed it will update this value. Least recently used files are removed first (LRU)
+     * 按最近访问时间淘汰
+     */
+    SDImageCacheConfigExpireTypeAccessDate,
+    /**
+     * When the image is written to the disk cache it will update this value. Oldest written files are removed first (legacy behavior)
+     * 按写入时间淘汰（旧的行为）
+     */
+    SDImageCacheConfigExpireTypeModificationDate,
+    /**
+     * Same expiration as `SDImageCacheConfigExpireTypeAccessDate`, but the size-based cleanup pass removes
+     * large, rarely and not recently read files first, keeping more small hot images in the same budget
+     * 过期按访问时间，超出容量时综合访问时间、命中次数和文件大小淘汰
+     */
+    SDImageCacheConfigExpireTypeAccessDateAndSize
+};
+
+/**
+ 磁盘缓存文件名使用的哈希算法
+ */
+typedef NS_ENUM(NSUInteger, SDImageCacheConfigKeyHashType) {
+    /**
+     * 128-bit MurmurHash3 of the key, much faster than MD5 for long URLs. Files cached with MD5 names are migrated on first read.
+     * 非加密的快速哈希（默认）
+     */
+    SDImageCacheConfigKeyHashTypeMurmur3,
+    /**
+     * MD5 of the key (legacy behavior)
+     * MD5（旧的文件名）
+     */
+    SDImageCacheConfigKeyHashTypeMD5
+};
+
+/**
+ * Return the disk cache file name for a key, return nil to use the default name
+ */
+typedef NSString * _Nullable (^SDImageCacheFileNameBlock)(NSString * _Nonnull key);
+
 @interface SDImageCacheConfig : NSObject
 
 /**
@@ -34,12 +77,59 @@
  */
 @property (assign, nonatomic) NSDataReadingOptions diskCacheReadingOptions;
 
+/**
+ * Files at least this large, in bytes, are read with `NSDataReadingMappedAlways` in addition to `diskCacheReadingOptions`.
+ * The decoders read the mapped pages directly instead of a heap copy of the file, and the mapping is released with the data once decoded.
+ * Defaults to 0, which disables mapping by size.
+ * 超过这个大小的缓存文件使用内存映射读取，避免解码时文件数据和解码后的图片同时占用内存，默认是0（不启用）
+ */
+@property (assign, nonatomic) NSUInteger diskCacheMappedReadingThreshold;
+
+/**
+ * Images whose data is at most this large, in bytes, are appended to shared segment files instead of one file per key.
+ * This saves inodes and disk blocks for large numbers of small thumbnails, larger images are still stored as plain files.
+ * Superseded records are compacted in the background when old files are deleted.
+ * Defaults to 0, which stores every image as a plain file.
+ * 小于这个大小的图片打包存储在段文件中，而不是每张图片一个文件，默认是0（不启用）
+ */
+@property (assign, nonatomic) NSUInteger diskCachePackThreshold;
+
+/**
+ * Images stored to disk are buffered briefly and written in batches, a newer image for the same key replaces the pending one.
+ * Once the pending images reach this size, in bytes, they are written at once. Defaults to 16 MB.
+ * When the images already handed to the IO queues but not yet written reach twice this size, further stores from
+ * a background thread write synchronously until the disk catches up. Stores from the main queue never wait.
+ * 等待写入磁盘的图片超过这个大小时立即写入，默认是16MB。正在写入的数据超过两倍时，后台线程的存储同步写入
+ */
+@property (assign, nonatomic) NSUInteger diskCacheWriteBufferSize;
+
+/**
+ * The hash used to build the disk cache file name of a key. Defaults to MurmurHash3.
+ * Set this before the cache is used, file names of recently used keys are cached.
+ * 磁盘缓存文件名使用的哈希算法，默认是 MurmurHash3，需要在使用缓存之前设置
+ */
+@property (assign, nonatomic) SDImageCacheConfigKeyHashType diskCacheKeyHashType;
+
+/**
+ * A block building the disk cache file name of a key, takes precedence over `diskCacheKeyHashType`. Defaults to nil.
+ * Files cached with other names are not migrated.
+ * 自定义磁盘缓存文件名
+ */
+@property (copy, nonatomic, nullable) SDImageCacheFileNameBlock diskCacheFileNameBlock;
+
 /**
  * The maximum length of time to keep an image in the cache, in seconds.
  * 磁盘缓存的最大时长，也就是说缓存存多久后需要删掉
  */
 @property (assign, nonatomic) NSInteger maxCacheAge;
 
+/**
+ * The attribute which the clear cache will be checked against when clearing the disk cache
+ * Default is Access Date
+ * 磁盘缓存的淘汰策略，默认按最近访问时间（LRU）
+ */
+@property (assign, nonatomic) SDImageCacheConfigExpireType diskCacheExpireType;
+
 /**
  * The maximum size of the cache, in bytes.
  * 磁盘缓存文件总体积最大限制，以 bytes 来计算
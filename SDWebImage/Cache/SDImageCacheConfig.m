@@ -21,9 +21,14 @@ static const NSInteger kDefaultCacheMaxCacheAge = 60 * 60 * 24 * 7; // 1 week
         // 缓存图片YES
         _shouldCacheImagesInMemory = YES;
         _diskCacheReadingOptions = 0;
+        _diskCacheMappedReadingThreshold = 0;
+        _diskCachePackThreshold = 0;
+        _diskCacheWriteBufferSize = 16 * 1024 * 1024;
+        _diskCacheKeyHashType = SDImageCacheConfigKeyHashTypeMurmur3;
         // 初始化缓存时间
         _maxCacheAge = kDefaultCacheMaxCacheAge;
         _maxCacheSize = 0;
+        _diskCacheExpireType = SDImageCacheConfigExpireTypeAccessDate;
     }
     return self;
 }
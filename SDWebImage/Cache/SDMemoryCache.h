@@ -0,0 +1,103 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+/*
+ 内存缓存
+
+ 用哈希表 + 双向链表实现的 LRU 缓存，读写和淘汰都是 O(1)：
+ 每次读写都把对象移到链表头部，超出限制时从链表尾部（最久没有使用的对象）开始淘汰。
+
+ 和 NSCache 不同，淘汰的顺序是确定的：
+ 1.总消耗（cost）超过 totalCostLimit 时淘汰
+ 2.数量超过 countLimit 时淘汰
+ 3.超过 ageLimit 没有被访问的对象会过期
+ */
+
+#import <Foundation/Foundation.h>
+#import "SDWebImageCompat.h"
+
+/**
+ * A thread safe key-value memory cache with least recently used eviction.
+ * Objects are evicted as soon as one of the limits is exceeded, the least recently used first.
+ */
+@interface SDMemoryCache<KeyType, ObjectType> : NSObject
+
+/**
+ * The name of the cache
+ */
+@property (copy, nullable) NSString *name;
+
+/**
+ * The maximum total cost the cache can hold. 0 means no limit. Defaults to 0.
+ * 总消耗的最大限制
+ */
+@property (assign) NSUInteger totalCostLimit;
+
+/**
+ * The maximum number of objects the cache can hold. 0 means no limit. Defaults to 0.
+ * 对象数量的最大限制
+ */
+@property (assign) NSUInteger countLimit;
+
+/**
+ * The maximum time an object can stay in the cache without being accessed, in seconds. 0 means no limit. Defaults to 0.
+ * 对象多久没有被访问就会过期
+ */
+@property (assign) NSTimeInterval ageLimit;
+
+/**
+ * The total cost of the objects in the cache
+ */
+@property (readonly) NSUInteger totalCost;
+
+/**
+ * The number of objects in the cache
+ */
+@property (readonly) NSUInteger totalCount;
+
+/**
+ * Return the object for the key and mark it as the most recently used, or nil if there is none or it has expired
+ */
+- (nullable ObjectType)objectForKey:(nonnull KeyType)key;
+
+/**
+ * Check whether an unexpired object is cached for the key, without changing the eviction order
+ */
+- (BOOL)containsObjectForKey:(nonnull KeyType)key;
+
+/**
+ * Set the object for the key with a cost of 0. Setting nil removes the object.
+ */
+- (void)setObject:(nullable ObjectType)obj forKey:(nonnull KeyType)key;
+
+/**
+ * Set the object for the key with the given cost, then evict objects until the limits are met.
+ * Setting nil removes the object.
+ */
+- (void)setObject:(nullable ObjectType)obj forKey:(nonnull KeyType)key cost:(NSUInteger)cost;
+
+- (void)removeObjectForKey:(nonnull KeyType)key;
+
+- (void)removeAllObjects;
+
+/**
+ * Evict the least recently used objects until the total cost is not greater than `cost`
+ */
+- (void)trimToCost:(NSUInteger)cost;
+
+/**
+ * Evict the least recently used objects until there are at most `count` objects
+ */
+- (void)trimToCount:(NSUInteger)count;
+
+/**
+ * Evict the objects which have not been accessed for more than `age` seconds
+ */
+- (void)trimToAge:(NSTimeInterval)age;
+
+@end
@@ -0,0 +1,282 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDMemoryCache.h"
+
+// 链表节点，由哈希表持有，prev/next 不持有节点
+@interface SDMemoryCacheNode : NSObject {
+    @package
+    __unsafe_unretained SDMemoryCacheNode *_prev;
+    __unsafe_unretained SDMemoryCacheNode *_next;
+    id _key;
+    id _value;
+    NSUInteger _cost;
+    CFAbsoluteTime _time;
+}
+@end
+
+@implementation SDMemoryCacheNode
+@end
+
+// 被淘汰的图片可能很大，放到后台队列释放，不阻塞调用者
+static void SDMemoryCacheReleaseInBackground(id object) {
+    if (!object) {
+        return;
+    }
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+        [object class];
+    });
+}
+
+@interface SDMemoryCache ()
+
+@property (strong, nonatomic, nonnull) NSMutableDictionary *nodes;
+@property (strong, nonatomic, nonnull) dispatch_semaphore_t lock;
+
+@end
+
+@implementation SDMemoryCache {
+    // 链表头部是最近使用的对象，尾部是最久没有使用的对象
+    __unsafe_unretained SDMemoryCacheNode *_head;
+    __unsafe_unretained SDMemoryCacheNode *_tail;
+    NSUInteger _totalCost;
+}
+
+- (instancetype)init {
+    if ((self = [super init])) {
+        _nodes = [NSMutableDictionary dictionary];
+        _lock = dispatch_semaphore_create(1);
+    }
+    return self;
+}
+
+#pragma mark - Linked list
+
+// All the linked list methods must be called with the lock held
+
+- (void)insertNodeAtHead:(SDMemoryCacheNode *)node {
+    node->_prev = nil;
+    node->_next = _head;
+    if (_head) {
+        _head->_prev = node;
+    }
+    _head = node;
+    if (!_tail) {
+        _tail = node;
+    }
+}
+
+- (void)unlinkNode:(SDMemoryCacheNode *)node {
+    if (node->_prev) {
+        node->_prev->_next = node->_next;
+    } else {
+        _head = node->_next;
+    }
+    if (node->_next) {
+        node->_next->_prev = node->_prev;
+    } else {
+        _tail = node->_prev;
+    }
+    node->_prev = nil;
+    node->_next = nil;
+}
+
+- (void)bringNodeToHead:(SDMemoryCacheNode *)node {
+    if (_head == node) {
+        return;
+    }
+    [self unlinkNode:node];
+    [self insertNodeAtHead:node];
+}
+
+// Return the removed node so that the caller releases it outside of the lock
+- (SDMemoryCacheNode *)removeNode:(SDMemoryCacheNode *)node {
+    SDMemoryCacheNode *removedNode = node;
+    [self unlinkNode:node];
+    _totalCost -= node->_cost;
+    [self.nodes removeObjectForKey:node->_key];
+    return removedNode;
+}
+
+- (BOOL)isNodeExpired:(SDMemoryCacheNode *)node now:(CFAbsoluteTime)now {
+    NSTimeInterval ageLimit = self.ageLimit;
+    return ageLimit > 0 && now - node->_time > ageLimit;
+}
+
+#pragma mark - Cache info
+
+- (NSUInteger)totalCost {
+    SD_LOCK(self.lock);
+    NSUInteger totalCost = _totalCost;
+    SD_UNLOCK(self.lock);
+    return totalCost;
+}
+
+- (NSUInteger)totalCount {
+    SD_LOCK(self.lock);
+    NSUInteger totalCount = self.nodes.count;
+    SD_UNLOCK(self.lock);
+    return totalCount;
+}
+
+#pragma mark - Access
+
+- (id)objectForKey:(id)key {
+    if (!key) {
+        return nil;
+    }
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    SDMemoryCacheNode *expiredNode = nil;
+    id value = nil;
+    SD_LOCK(self.lock);
+    SDMemoryCacheNode *node = self.nodes[key];
+    if (node) {
+        if ([self isNodeExpired:node now:now]) {
+            expiredNode = [self removeNode:node];
+        } else {
+            node->_time = now;
+            [self bringNodeToHead:node];
+            value = node->_value;
+        }
+    }
+    SD_UNLOCK(self.lock);
+    SDMemoryCacheReleaseInBackground(expiredNode);
+    return value;
+}
+
+- (BOOL)containsObjectForKey:(id)key {
+    if (!key) {
+        return NO;
+    }
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    SD_LOCK(self.lock);
+    SDMemoryCacheNode *node = self.nodes[key];
+    BOOL contains = node && ![self isNodeExpired:node now:now];
+    SD_UNLOCK(self.lock);
+    return contains;
+}
+
+- (void)setObject:(id)obj forKey:(id)key {
+    [self setObject:obj forKey:key cost:0];
+}
+
+- (void)setObject:(id)obj forKey:(id)key cost:(NSUInteger)cost {
+    if (!key) {
+        return;
+    }
+    if (!obj) {
+        [self removeObjectForKey:key];
+        return;
+    }
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    id oldValue = nil;
+    NSMutableArray<SDMemoryCacheNode *> *evictedNodes = nil;
+    SD_LOCK(self.lock);
+    SDMemoryCacheNode *node = self.nodes[key];
+    if (node) {
+        oldValue = node->_value;
+        _totalCost -= node->_cost;
+        [self bringNodeToHead:node];
+    } else {
+        node = [SDMemoryCacheNode new];
+        node->_key = [key conformsToProtocol:@protocol(NSCopying)] ? [key copy] : key;
+        self.nodes[node->_key] = node;
+        [self insertNodeAtHead:node];
+    }
+    node->_value = obj;
+    node->_cost = cost;
+    node->_time = now;
+    _totalCost += cost;
+    evictedNodes = [self evictNodesToCost:self.totalCostLimit count:self.countLimit now:now];
+    SD_UNLOCK(self.lock);
+    SDMemoryCacheReleaseInBackground(oldValue);
+    SDMemoryCacheReleaseInBackground(evictedNodes);
+}
+
+- (void)removeObjectForKey:(id)key {
+    if (!key) {
+        return;
+    }
+    SDMemoryCacheNode *removedNode = nil;
+    SD_LOCK(self.lock);
+    SDMemoryCacheNode *node = self.nodes[key];
+    if (node) {
+        removedNode = [self removeNode:node];
+    }
+    SD_UNLOCK(self.lock);
+    SDMemoryCacheReleaseInBackground(removedNode);
+}
+
+- (void)removeAllObjects {
+    NSMutableDictionary *nodes = nil;
+    SD_LOCK(self.lock);
+    nodes = self.nodes;
+    self.nodes = [NSMutableDictionary dictionary];
+    _head = nil;
+    _tail = nil;
+    _totalCost = 0;
+    SD_UNLOCK(self.lock);
+    SDMemoryCacheReleaseInBackground(nodes);
+}
+
+#pragma mark - Trim
+
+// Evict from the tail until the limits are met, expired objects are evicted too. 0 means no limit.
+- (NSMutableArray<SDMemoryCacheNode *> *)evictNodesToCost:(NSUInteger)costLimit count:(NSUInteger)countLimit now:(CFAbsoluteTime)now {
+    NSMutableArray<SDMemoryCacheNode *> *evictedNodes = nil;
+    while (_tail) {
+        BOOL overCost = costLimit > 0 && _totalCost > costLimit;
+        BOOL overCount = countLimit > 0 && self.nodes.count > countLimit;
+        if (!overCost && !overCount && ![self isNodeExpired:_tail now:now]) {
+            break;
+        }
+        if (!evictedNodes) {
+            evictedNodes = [NSMutableArray array];
+        }
+        [evictedNodes addObject:[self removeNode:_tail]];
+    }
+    return evictedNodes;
+}
+
+- (void)trimToCost:(NSUInteger)cost {
+    if (cost == 0) {
+        [self removeAllObjects];
+        return;
+    }
+    NSMutableArray<SDMemoryCacheNode *> *evictedNodes = nil;
+    SD_LOCK(self.lock);
+    evictedNodes = [self evictNodesToCost:cost count:0 now:CFAbsoluteTimeGetCurrent()];
+    SD_UNLOCK(self.lock);
+    SDMemoryCacheReleaseInBackground(evictedNodes);
+}
+
+- (void)trimToCount:(NSUInteger)count {
+    if (count == 0) {
+        [self removeAllObjects];
+        return;
+    }
+    NSMutableArray<SDMemoryCacheNode *> *evictedNodes = nil;
+    SD_LOCK(self.lock);
+    evictedNodes = [self evictNodesToCost:0 count:count now:CFAbsoluteTimeGetCurrent()];
+    SD_UNLOCK(self.lock);
+    SDMemoryCacheReleaseInBackground(evictedNodes);
+}
+
+- (void)trimToAge:(NSTimeInterval)age {
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    NSMutableArray<SDMemoryCacheNode *> *evictedNodes = [NSMutableArray array];
+    SD_LOCK(self.lock);
+    // The tail is the least recently used, stop at the first object younger than age
+    while (_tail && now - _tail->_time > age) {
+        [evictedNodes addObject:[self removeNode:_tail]];
+    }
+    SD_UNLOCK(self.lock);
+    SDMemoryCacheReleaseInBackground(evictedNodes.count > 0 ? evictedNodes : nil);
+}
+
+@end
@@ -0,0 +1,113 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+/*
+ 按需解码的动图
+
+ `animatedImageWithFrames:` 会把每一帧都解码成完整画布大小的位图，几百帧的动图需要上 GB 的内存。
+ SDWebImageAnimatedImage 只保存压缩的数据和解码器（frame source），以及一小段解码好的帧：
+ 显示第 N 帧时才解码，后面的几帧在后台队列中提前解码，超出缓冲区的帧会被释放。
+ 图片本身是第一帧，普通的 UIImageView 只显示第一帧，使用 SDWebImageAnimatedImageView 播放动画。
+ */
+
+#import <Foundation/Foundation.h>
+#import "SDWebImageCompat.h"
+#import "NSData+ImageContentType.h"
+
+/**
+ A decoder producing the frames of one animated image on demand.
+ The methods are never called concurrently, a frame source may keep decoding state (like the canvas of the previous frame) between calls.
+ */
+@protocol SDWebImageAnimatedImageFrameSource <NSObject>
+
+@required
+/**
+ The compressed data of the animated image, kept to encode the image again for the disk cache
+ */
+@property (nonatomic, copy, readonly, nonnull) NSData *animatedImageData;
+
+/**
+ The format of `animatedImageData`
+ */
+@property (nonatomic, assign, readonly) SDImageFormat animatedImageFormat;
+
+/**
+ The number of frames, a frame source for less than 2 frames should not be used
+ */
+@property (nonatomic, assign, readonly) NSUInteger animatedImageFrameCount;
+
+/**
+ The loop count of the animation, 0 means infinite looping
+ */
+@property (nonatomic, assign, readonly) NSUInteger animatedImageLoopCount;
+
+/**
+ The duration of a frame in seconds
+ */
+- (NSTimeInterval)animatedImageDurationAtIndex:(NSUInteger)index;
+
+/**
+ Decode a frame composited onto the full canvas. Frames are mostly requested in increasing order, which a frame source can use to avoid compositing the previous frames again.
+
+ @param index The index of the frame
+ @return The frame, or nil if it could not be decoded
+ */
+- (nullable UIImage *)animatedImageFrameAtIndex:(NSUInteger)index;
+
+@end
+
+
+/**
+ An animated image decoding its frames on demand, keeping only a small buffer of decoded frames.
+ The image itself is the first frame.
+ */
+@interface SDWebImageAnimatedImage : UIImage
+
+/**
+ The frame source decoding the frames
+ */
+@property (nonatomic, strong, readonly, nonnull) id<SDWebImageAnimatedImageFrameSource> frameSource;
+
+@property (nonatomic, assign, readonly) NSUInteger animatedImageFrameCount;
+@property (nonatomic, assign, readonly) NSUInteger animatedImageLoopCount;
+
+/**
+ The maximum number of decoded frames kept in the buffer, the current frame included.
+ Defaults to the number of frames fitting in 16 MB, between 1 and the frame count.
+ 缓冲区中最多保存的已解码帧数
+ */
+@property (nonatomic, assign) NSUInteger maxBufferedFrameCount;
+
+/**
+ Create an animated image, the first frame is decoded synchronously.
+
+ @param frameSource The frame source of the image
+ @return The animated image, or nil if the frame source has less than 2 frames or the first frame could not be decoded
+ */
+- (nullable instancetype)initWithFrameSource:(nonnull id<SDWebImageAnimatedImageFrameSource>)frameSource;
+
+- (NSTimeInterval)animatedImageDurationAtIndex:(NSUInteger)index;
+
+/**
+ Return a frame, decoding it synchronously if it is not in the buffer yet.
+ The buffer moves to the frame and the following frames are decoded in the background.
+ */
+- (nullable UIImage *)animatedImageFrameAtIndex:(NSUInteger)index;
+
+/**
+ Return a frame only if it is already decoded, without blocking.
+ The buffer moves to the frame and the following frames are decoded in the background, so the frame is usually ready when asked again.
+ */
+- (nullable UIImage *)bufferedAnimatedImageFrameAtIndex:(NSUInteger)index;
+
+/**
+ Release all the decoded frames but the first one
+ */
+- (void)clearBufferedFrames;
+
+@end
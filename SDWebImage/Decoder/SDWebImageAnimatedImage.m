@@ -0,0 +1,206 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDWebImageAnimatedImage.h"
+#import "UIImage+MultiFormat.h"
+
+// 默认缓冲区大小，决定默认的 maxBufferedFrameCount
+static const NSUInteger kAnimatedImageDefaultBufferSize = 16 * 1024 * 1024;
+
+// Whether a frame is in the buffer window starting at `bufferIndex`, the window wraps around the last frame
+static inline BOOL SDAnimatedImageIndexInBuffer(NSUInteger index, NSUInteger bufferIndex, NSUInteger bufferLength, NSUInteger frameCount) {
+    NSUInteger distance = (index + frameCount - bufferIndex) % frameCount;
+    return distance < bufferLength;
+}
+
+@implementation SDWebImageAnimatedImage {
+    UIImage *_posterFrame;
+    // 解码是串行的，frame source 不需要是线程安全的
+    dispatch_semaphore_t _decodeLock;
+    dispatch_semaphore_t _bufferLock;
+    // Decoded frames by index, NSNull for the frames which failed to decode. The first frame is never buffered
+    NSMutableDictionary<NSNumber *, id> *_bufferedFrames;
+    NSUInteger _bufferIndex;
+    BOOL _prefetching;
+}
+
+- (nullable instancetype)initWithFrameSource:(nonnull id<SDWebImageAnimatedImageFrameSource>)frameSource {
+    NSUInteger frameCount = frameSource.animatedImageFrameCount;
+    if (frameCount < 2) {
+        return nil;
+    }
+    UIImage *posterFrame = [frameSource animatedImageFrameAtIndex:0];
+    CGImageRef posterImageRef = posterFrame.CGImage;
+    if (!posterImageRef) {
+        return nil;
+    }
+#if SD_UIKIT || SD_WATCH
+    self = [super initWithCGImage:posterImageRef scale:posterFrame.scale orientation:posterFrame.imageOrientation];
+#else
+    self = [super initWithCGImage:posterImageRef size:NSZeroSize];
+#endif
+    if (self) {
+        _frameSource = frameSource;
+        _animatedImageFrameCount = frameCount;
+        _animatedImageLoopCount = frameSource.animatedImageLoopCount;
+        _posterFrame = posterFrame;
+        _decodeLock = dispatch_semaphore_create(1);
+        _bufferLock = dispatch_semaphore_create(1);
+        _bufferedFrames = [NSMutableDictionary dictionary];
+        size_t bytesPerFrame = CGImageGetBytesPerRow(posterImageRef) * CGImageGetHeight(posterImageRef);
+        NSUInteger bufferedFrameCount = bytesPerFrame > 0 ? kAnimatedImageDefaultBufferSize / bytesPerFrame : 1;
+        _maxBufferedFrameCount = MIN(MAX(bufferedFrameCount, 1), frameCount);
+        self.sd_imageLoopCount = _animatedImageLoopCount;
+#if SD_UIKIT
+        [[NSNotificationCenter defaultCenter] addObserver:self
+                                                 selector:@selector(clearBufferedFrames)
+                                                     name:UIApplicationDidReceiveMemoryWarningNotification
+                                                   object:nil];
+#endif
+    }
+    return self;
+}
+
+- (void)dealloc {
+#if SD_UIKIT
+    [[NSNotificationCenter defaultCenter] removeObserver:self name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
+#endif
+}
+
+- (NSTimeInterval)animatedImageDurationAtIndex:(NSUInteger)index {
+    if (index >= self.animatedImageFrameCount) {
+        return 0;
+    }
+    return [self.frameSource animatedImageDurationAtIndex:index];
+}
+
+- (void)setMaxBufferedFrameCount:(NSUInteger)maxBufferedFrameCount {
+    SD_LOCK(_bufferLock);
+    _maxBufferedFrameCount = MIN(MAX(maxBufferedFrameCount, 1), self.animatedImageFrameCount);
+    [self evictFramesOutsideBuffer];
+    SD_UNLOCK(_bufferLock);
+}
+
+#pragma mark - Frames
+
+- (nullable UIImage *)animatedImageFrameAtIndex:(NSUInteger)index {
+    if (index >= self.animatedImageFrameCount) {
+        return nil;
+    }
+    SD_LOCK(_bufferLock);
+    _bufferIndex = index;
+    [self evictFramesOutsideBuffer];
+    SD_UNLOCK(_bufferLock);
+    UIImage *frame = [self decodeFrameAtIndex:index];
+    [self prefetchFramesFromIndex:index];
+    return frame;
+}
+
+- (nullable UIImage *)bufferedAnimatedImageFrameAtIndex:(NSUInteger)index {
+    if (index >= self.animatedImageFrameCount) {
+        return nil;
+    }
+    UIImage *frame = [self frameFromBufferAtIndex:index];
+    [self prefetchFramesFromIndex:index];
+    return frame;
+}
+
+- (void)clearBufferedFrames {
+    SD_LOCK(_bufferLock);
+    [_bufferedFrames removeAllObjects];
+    SD_UNLOCK(_bufferLock);
+}
+
+- (nullable UIImage *)frameFromBufferAtIndex:(NSUInteger)index {
+    if (index == 0) {
+        return _posterFrame;
+    }
+    SD_LOCK(_bufferLock);
+    id frame = _bufferedFrames[@(index)];
+    SD_UNLOCK(_bufferLock);
+    return frame == [NSNull null] ? nil : frame;
+}
+
+// The decoded frame is buffered if it is still in the buffer window
+- (nullable UIImage *)decodeFrameAtIndex:(NSUInteger)index {
+    if (index == 0) {
+        return _posterFrame;
+    }
+    SD_LOCK(_decodeLock);
+    // 等待解码锁的时候，这一帧可能已经被预取了
+    SD_LOCK(_bufferLock);
+    id frame = _bufferedFrames[@(index)];
+    SD_UNLOCK(_bufferLock);
+    if (!frame) {
+        frame = [self.frameSource animatedImageFrameAtIndex:index] ?: [NSNull null];
+        SD_LOCK(_bufferLock);
+        if (SDAnimatedImageIndexInBuffer(index, _bufferIndex, _maxBufferedFrameCount, self.animatedImageFrameCount)) {
+            _bufferedFrames[@(index)] = frame;
+        }
+        SD_UNLOCK(_bufferLock);
+    }
+    SD_UNLOCK(_decodeLock);
+    return frame == [NSNull null] ? nil : frame;
+}
+
+#pragma mark - Buffer
+
+// 缓冲区移动到 index，在后台按顺序解码缓冲区中还没有解码的帧，同一时间只有一个预取任务
+- (void)prefetchFramesFromIndex:(NSUInteger)index {
+    SD_LOCK(_bufferLock);
+    _bufferIndex = index;
+    [self evictFramesOutsideBuffer];
+    BOOL shouldPrefetch = !_prefetching && [self nextMissingFrameIndex] != NSNotFound;
+    if (shouldPrefetch) {
+        _prefetching = YES;
+    }
+    SD_UNLOCK(_bufferLock);
+    if (!shouldPrefetch) {
+        return;
+    }
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        while (YES) {
+            SD_LOCK(self->_bufferLock);
+            NSUInteger missingIndex = [self nextMissingFrameIndex];
+            if (missingIndex == NSNotFound) {
+                self->_prefetching = NO;
+            }
+            SD_UNLOCK(self->_bufferLock);
+            if (missingIndex == NSNotFound) {
+                return;
+            }
+            @autoreleasepool {
+                [self decodeFrameAtIndex:missingIndex];
+            }
+        }
+    });
+}
+
+// Must be called inside the bufferLock
+- (NSUInteger)nextMissingFrameIndex {
+    NSUInteger frameCount = self.animatedImageFrameCount;
+    for (NSUInteger i = 0; i < _maxBufferedFrameCount; i++) {
+        NSUInteger index = (_bufferIndex + i) % frameCount;
+        if (index != 0 && !_bufferedFrames[@(index)]) {
+            return index;
+        }
+    }
+    return NSNotFound;
+}
+
+// Must be called inside the bufferLock
+- (void)evictFramesOutsideBuffer {
+    NSUInteger frameCount = self.animatedImageFrameCount;
+    for (NSNumber *index in _bufferedFrames.allKeys) {
+        if (!SDAnimatedImageIndexInBuffer(index.unsignedIntegerValue, _bufferIndex, _maxBufferedFrameCount, frameCount)) {
+            [_bufferedFrames removeObjectForKey:index];
+        }
+    }
+}
+
+@end
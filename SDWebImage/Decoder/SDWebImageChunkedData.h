@@ -0,0 +1,57 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+/*
+ 分块的只追加缓冲区
+
+ 下载时每次收到的数据块直接保存（不拷贝），而不是拼接到一个 NSMutableData 中再整体拷贝。
+ 渐进式解码时解码器只读取新追加的数据，或者通过 CGDataProvider 按需读取，不需要每次拷贝全部数据。
+ */
+
+#import <Foundation/Foundation.h>
+#import "SDWebImageCompat.h"
+
+/**
+ * A thread safe, append-only byte buffer keeping the appended data objects as chunks instead of copying them.
+ */
+@interface SDWebImageChunkedData : NSObject
+
+/**
+ * The total number of bytes appended
+ */
+@property (assign, nonatomic, readonly) NSUInteger length;
+
+/**
+ * Append a chunk. The data is retained, not copied, so it must not be mutated afterwards.
+ */
+- (void)appendData:(nonnull NSData *)data;
+
+/**
+ * Copy bytes into a buffer
+ *
+ * @return The number of bytes copied, less than `range.length` if the range goes past the end
+ */
+- (NSUInteger)getBytes:(nonnull void *)buffer range:(NSRange)range;
+
+/**
+ * Return the first bytes, at most `length`. Only the requested bytes are copied.
+ */
+- (nonnull NSData *)prefixDataWithLength:(NSUInteger)length;
+
+/**
+ * Return all the bytes as a contiguous data. The chunks are merged once, the merged data is reused until more data is appended.
+ */
+- (nonnull NSData *)data;
+
+/**
+ * Create a data provider reading the first `length` bytes from the chunks on demand, without copying them up front.
+ * The provider stays valid when more data is appended.
+ */
+- (nullable CGDataProviderRef)newDataProviderWithLength:(NSUInteger)length CF_RETURNS_RETAINED;
+
+@end
@@ -0,0 +1,161 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDWebImageChunkedData.h"
+
+@interface SDWebImageChunkedData ()
+
+@property (strong, nonatomic, nonnull) NSMutableArray<NSData *> *chunks;
+@property (strong, nonatomic, nonnull) dispatch_semaphore_t lock;
+
+@end
+
+@implementation SDWebImageChunkedData {
+    // 每个数据块在缓冲区中的起始偏移，和 chunks 一一对应
+    NSUInteger *_offsets;
+    NSUInteger _offsetsCapacity;
+    NSUInteger _length;
+}
+
+- (instancetype)init {
+    if ((self = [super init])) {
+        _chunks = [NSMutableArray array];
+        _lock = dispatch_semaphore_create(1);
+    }
+    return self;
+}
+
+- (void)dealloc {
+    free(_offsets);
+}
+
+- (NSUInteger)length {
+    SD_LOCK(self.lock);
+    NSUInteger length = _length;
+    SD_UNLOCK(self.lock);
+    return length;
+}
+
+- (void)appendData:(nonnull NSData *)data {
+    if (data.length == 0) {
+        return;
+    }
+    SD_LOCK(self.lock);
+    NSUInteger count = self.chunks.count;
+    if (count == _offsetsCapacity) {
+        NSUInteger capacity = MAX(_offsetsCapacity * 2, 64);
+        NSUInteger *offsets = realloc(_offsets, capacity * sizeof(NSUInteger));
+        if (!offsets) {
+            SD_UNLOCK(self.lock);
+            return;
+        }
+        _offsets = offsets;
+        _offsetsCapacity = capacity;
+    }
+    _offsets[count] = _length;
+    [self.chunks addObject:data];
+    _length += data.length;
+    SD_UNLOCK(self.lock);
+}
+
+// Binary search the chunk containing the position, must be called with the lock held
+- (NSUInteger)chunkIndexForPosition:(NSUInteger)position {
+    NSUInteger low = 0;
+    NSUInteger high = self.chunks.count;
+    while (high - low > 1) {
+        NSUInteger middle = low + (high - low) / 2;
+        if (_offsets[middle] <= position) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+- (NSUInteger)getBytes:(nonnull void *)buffer range:(NSRange)range {
+    SD_LOCK(self.lock);
+    if (range.location >= _length) {
+        SD_UNLOCK(self.lock);
+        return 0;
+    }
+    NSUInteger end = MIN(NSMaxRange(range), _length);
+    NSUInteger position = range.location;
+    NSUInteger index = [self chunkIndexForPosition:position];
+    char *cursor = buffer;
+    while (position < end) {
+        NSData *chunk = self.chunks[index];
+        NSUInteger chunkOffset = position - _offsets[index];
+        NSUInteger count = MIN(chunk.length - chunkOffset, end - position);
+        [chunk getBytes:cursor range:NSMakeRange(chunkOffset, count)];
+        cursor += count;
+        position += count;
+        index++;
+    }
+    SD_UNLOCK(self.lock);
+    return end - range.location;
+}
+
+- (nonnull NSData *)prefixDataWithLength:(NSUInteger)length {
+    NSMutableData *data = [NSMutableData dataWithLength:length];
+    data.length = [self getBytes:data.mutableBytes range:NSMakeRange(0, length)];
+    return [data copy];
+}
+
+- (nonnull NSData *)data {
+    SD_LOCK(self.lock);
+    NSUInteger count = self.chunks.count;
+    if (count == 0) {
+        SD_UNLOCK(self.lock);
+        return [NSData data];
+    }
+    if (count > 1) {
+        // Merge the chunks once, later calls return the merged chunk until more data is appended
+        NSMutableData *merged = [NSMutableData dataWithCapacity:_length];
+        for (NSData *chunk in self.chunks) {
+            [merged appendData:chunk];
+        }
+        [self.chunks removeAllObjects];
+        [self.chunks addObject:merged];
+        _offsets[0] = 0;
+    }
+    NSData *data = self.chunks.firstObject;
+    SD_UNLOCK(self.lock);
+    return data;
+}
+
+#pragma mark - Data provider
+
+static size_t SDChunkedDataProviderGetBytesAtPosition(void *info, void *buffer, off_t position, size_t count) {
+    SDWebImageChunkedData *chunkedData = (__bridge SDWebImageChunkedData *)info;
+    return [chunkedData getBytes:buffer range:NSMakeRange((NSUInteger)position, count)];
+}
+
+static void SDChunkedDataProviderReleaseInfo(void *info) {
+    CFRelease(info);
+}
+
+- (nullable CGDataProviderRef)newDataProviderWithLength:(NSUInteger)length {
+    length = MIN(length, self.length);
+    CGDataProviderDirectCallbacks callbacks = {
+        .version = 0,
+        .getBytePointer = NULL,
+        .releaseBytePointer = NULL,
+        .getBytesAtPosition = SDChunkedDataProviderGetBytesAtPosition,
+        .releaseInfo = SDChunkedDataProviderReleaseInfo
+    };
+    // The chunks are never mutated, the first `length` bytes stay the same when more data is appended
+    void *info = (__bridge_retained void *)self;
+    CGDataProviderRef provider = CGDataProviderCreateDirect(info, (off_t)length, &callbacks);
+    if (!provider) {
+        CFRelease(info);
+    }
+    return provider;
+}
+
+@end
@@ -16,9 +16,17 @@
 
 /**
  A Boolean value indicating whether to scale down large images during decompressing. (NSNumber)
+ Also accepted by `decodedImageWithData:options:`, large images are then downsampled while decoding.
  */
 FOUNDATION_EXPORT NSString * _Nonnull const SDWebImageCoderScaleDownLargeImagesKey;
 
+/**
+ The maximum width or height in pixels of the decoded image, used by `decodedImageWithData:options:`. (NSNumber)
+ Larger images are downsampled while decoding, the full size bitmap is never created.
+ 解码时直接缩小，不会先解码出原始大小的位图
+ */
+FOUNDATION_EXPORT NSString * _Nonnull const SDWebImageCoderDecodeMaxPixelSizeKey;
+
 /**
  Return the shared device-dependent RGB color space created with CGColorSpaceCreateDeviceRGB.
 
@@ -34,6 +42,17 @@ CG_EXTERN CGColorSpaceRef _Nonnull SDCGColorSpaceGetDeviceRGB(void);
  */
 CG_EXTERN BOOL SDCGImageRefContainsAlpha(_Nullable CGImageRef imageRef);
 
+/**
+ The maximum width or height to decode an image with the decoding options,
+ taking both `SDWebImageCoderDecodeMaxPixelSizeKey` and `SDWebImageCoderScaleDownLargeImagesKey` into account.
+
+ @param width The width in pixels of the encoded image
+ @param height The height in pixels of the encoded image
+ @param optionsDict The decoding options
+ @return The maximum pixel size, or 0 if the image should be decoded at full size
+ */
+CG_EXTERN NSUInteger SDImageDecodeMaxPixelSize(size_t width, size_t height, NSDictionary<NSString*, NSObject*> * _Nullable optionsDict);
+
 
 /**
  This is the image coder protocol to provide custom image decoding/encoding.
@@ -91,6 +110,20 @@ CG_EXTERN BOOL SDCGImageRefContainsAlpha(_Nullable CGImageRef imageRef);
  */
 - (nullable NSData *)encodedDataWithImage:(nullable UIImage *)image format:(SDImageFormat)format;
 
+@optional
+#pragma mark - Downsampled Decoding
+
+/**
+ Decode the image data to image, downsampled while decoding according to `SDWebImageCoderDecodeMaxPixelSizeKey`
+ and `SDWebImageCoderScaleDownLargeImagesKey`, so the full size bitmap of a large image is never created.
+ Coders not implementing this decode with `decodedImageWithData:`.
+
+ @param data The image data to be decoded
+ @param optionsDict A dictionary containing any decoding options
+ @return The decoded image from data
+ */
+- (nullable UIImage *)decodedImageWithData:(nullable NSData *)data options:(nullable NSDictionary<NSString*, NSObject*>*)optionsDict;
+
 @end
 
 
@@ -120,4 +153,22 @@ CG_EXTERN BOOL SDCGImageRefContainsAlpha(_Nullable CGImageRef imageRef);
  */
 - (nullable UIImage *)incrementallyDecodedImageWithData:(nullable NSData *)data finished:(BOOL)finished;
 
+@optional
+/**
+ Append the bytes received since the last call, without decoding an image yet.
+ Coders implementing this and `incrementallyDecodedImageWithFinished:` are not passed all the data downloaded so far for each update.
+ 只传入新收到的数据，避免每次都拷贝全部数据
+
+ @param data The newly downloaded bytes
+ */
+- (void)appendIncrementalData:(nonnull NSData *)data;
+
+/**
+ Incremental decode the image from all the bytes appended with `appendIncrementalData:`.
+
+ @param finished Whether the download has finished
+ @return The decoded image from the data appended so far
+ */
+- (nullable UIImage *)incrementallyDecodedImageWithFinished:(BOOL)finished;
+
 @end
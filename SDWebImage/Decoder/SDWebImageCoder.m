@@ -9,6 +9,10 @@
 #import "SDWebImageCoder.h"
 
 NSString * const SDWebImageCoderScaleDownLargeImagesKey = @"scaleDownLargeImages";
+NSString * const SDWebImageCoderDecodeMaxPixelSizeKey = @"decodeMaxPixelSize";
+
+// The same limit as `kDestImageSizeMB` of SDWebImageImageIOCoder, 60MB of 4 bytes pixels
+static const double kScaleDownMaxPixelCount = 60.0 * 1024 * 1024 / 4;
 
 CGColorSpaceRef SDCGColorSpaceGetDeviceRGB(void) {
     static CGColorSpaceRef colorSpace;
@@ -31,3 +35,28 @@ BOOL SDCGImageRefContainsAlpha(CGImageRef imageRef) {
                       alphaInfo == kCGImageAlphaNoneSkipLast);
     return hasAlpha;
 }
+
+NSUInteger SDImageDecodeMaxPixelSize(size_t width, size_t height, NSDictionary<NSString*, NSObject*> *optionsDict) {
+    size_t largerSide = MAX(width, height);
+    if (largerSide == 0) {
+        return 0;
+    }
+    NSUInteger maxPixelSize = 0;
+    NSObject *maxPixelSizeOption = optionsDict[SDWebImageCoderDecodeMaxPixelSizeKey];
+    if ([maxPixelSizeOption isKindOfClass:[NSNumber class]]) {
+        maxPixelSize = [(NSNumber *)maxPixelSizeOption unsignedIntegerValue];
+    }
+    NSObject *scaleDownOption = optionsDict[SDWebImageCoderScaleDownLargeImagesKey];
+    if ([scaleDownOption isKindOfClass:[NSNumber class]] && [(NSNumber *)scaleDownOption boolValue]) {
+        double pixelCount = (double)width * height;
+        if (pixelCount > kScaleDownMaxPixelCount) {
+            // 按面积缩小，宽高按同一比例
+            NSUInteger scaledSize = MAX((NSUInteger)(largerSide * sqrt(kScaleDownMaxPixelCount / pixelCount)), 1);
+            maxPixelSize = maxPixelSize > 0 ? MIN(maxPixelSize, scaledSize) : scaledSize;
+        }
+    }
+    if (maxPixelSize >= largerSide) {
+        return 0;
+    }
+    return maxPixelSize;
+}
@@ -8,6 +8,7 @@
 
 #import "SDWebImageCoderHelper.h"
 #import "SDWebImageFrame.h"
+#import "SDWebImageAnimatedImage.h"
 #import "UIImage+MultiFormat.h"
 #import "NSImage+WebCache.h"
 #import <ImageIO/ImageIO.h>
@@ -88,6 +89,23 @@
     NSMutableArray<SDWebImageFrame *> *frames = [NSMutableArray array];
     NSUInteger frameCount = 0;
     
+    if ([animatedImage isKindOfClass:[SDWebImageAnimatedImage class]]) {
+        // 按需解码的动图在这里才解码全部的帧，只用于编码
+        SDWebImageAnimatedImage *image = (SDWebImageAnimatedImage *)animatedImage;
+        frameCount = image.animatedImageFrameCount;
+        for (size_t i = 0; i < frameCount; i++) {
+            @autoreleasepool {
+                UIImage *frameImage = [image animatedImageFrameAtIndex:i];
+                if (!frameImage) {
+                    continue;
+                }
+                SDWebImageFrame *frame = [SDWebImageFrame frameWithImage:frameImage duration:[image animatedImageDurationAtIndex:i]];
+                [frames addObject:frame];
+            }
+        }
+        return frames.count > 0 ? frames : nil;
+    }
+    
 #if SD_UIKIT || SD_WATCH
     NSArray<UIImage *> *animatedImages = animatedImage.images;
     frameCount = animatedImages.count;
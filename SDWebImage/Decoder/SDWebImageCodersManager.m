@@ -104,6 +104,21 @@
     return nil;
 }
 
+- (UIImage *)decodedImageWithData:(NSData *)data options:(nullable NSDictionary<NSString*, NSObject*>*)optionsDict {
+    if (!data) {
+        return nil;
+    }
+    for (id<SDWebImageCoder> coder in self.coders) {
+        if ([coder canDecodeFromData:data]) {
+            if ([coder respondsToSelector:@selector(decodedImageWithData:options:)]) {
+                return [coder decodedImageWithData:data options:optionsDict];
+            }
+            return [coder decodedImageWithData:data];
+        }
+    }
+    return nil;
+}
+
 - (UIImage *)decompressedImageWithImage:(UIImage *)image
                                    data:(NSData *__autoreleasing  _Nullable *)data
                                 options:(nullable NSDictionary<NSString*, NSObject*>*)optionsDict {
@@ -20,4 +20,19 @@
 
 + (nonnull instancetype)sharedCoder;
 
+/**
+ * Decode animated GIF as a `SDWebImageAnimatedImage` with the built-in GIF decoder, which decodes the frames on demand with their own durations,
+ * instead of decoding all the frames with ImageIO and repeating them to fit `+[UIImage animatedImageWithImages:duration:]`.
+ * The animated image only animates in a `SDWebImageAnimatedImageView`, a plain image view shows the first frame. Defaults to NO. Not used on macOS.
+ * 动图只保存数据和解码器，显示时才解码每一帧，需要用 SDWebImageAnimatedImageView 播放
+ */
+@property (nonatomic, assign) BOOL decodesAnimatedImagesOnDemand;
+
+/**
+ * The maximum width * height of the canvas of a GIF decoded on demand, 0 for no limit. Larger GIFs are decoded with ImageIO.
+ * The canvas is allocated from the logical screen size, and each frame is copied out of it. Defaults to 60 MB of pixels.
+ * 画布按逻辑屏幕的大小分配，很小的 GIF 也可能需要很大的画布
+ */
+@property (nonatomic, assign) NSUInteger maxImagePixelCount;
+
 @end
@@ -12,6 +12,18 @@
 #import "NSData+ImageContentType.h"
 #import "UIImage+MultiFormat.h"
 #import "SDWebImageCoderHelper.h"
+#import "SDWebImageAnimatedImage.h"
+#import "SDWebImageGIFDecoder.h"
+#import "SDWebImagePixelKernels.h"
+
+/**
+ Decode the frames of an animated GIF on demand with the built-in decoder, only one canvas is kept whatever the frame count
+ */
+@interface SDWebImageGIFFrameSource : NSObject <SDWebImageAnimatedImageFrameSource>
+
+- (nullable instancetype)initWithData:(nonnull NSData *)data maxPixelCount:(NSUInteger)maxPixelCount;
+
+@end
 
 @implementation SDWebImageGIFCoder
 
@@ -24,6 +36,13 @@
     return coder;
 }
 
+- (instancetype)init {
+    if ((self = [super init])) {
+        _maxImagePixelCount = SD_GIF_DEFAULT_MAX_PIXEL_COUNT;
+    }
+    return self;
+}
+
 #pragma mark - Decode
 - (BOOL)canDecodeFromData:(nullable NSData *)data {
     return ([NSData sd_imageFormatForImageData:data] == SDImageFormatGIF);
@@ -38,6 +57,15 @@
     return [[UIImage alloc] initWithData:data];
 #else
     
+    if (self.decodesAnimatedImagesOnDemand) {
+        // 只有一帧的 GIF 创建不了 frame source，仍然用 ImageIO 解码
+        SDWebImageGIFFrameSource *frameSource = [[SDWebImageGIFFrameSource alloc] initWithData:data maxPixelCount:self.maxImagePixelCount];
+        UIImage *animatedImage = frameSource ? [[SDWebImageAnimatedImage alloc] initWithFrameSource:frameSource] : nil;
+        if (animatedImage) {
+            return animatedImage;
+        }
+    }
+    
     CGImageSourceRef source = CGImageSourceCreateWithData((__bridge CFDataRef)data, NULL);
     if (!source) {
         return nil;
@@ -143,6 +171,14 @@
         return nil;
     }
     
+    if ([image isKindOfClass:[SDWebImageAnimatedImage class]]) {
+        // 按需解码的动图直接使用原始数据
+        id<SDWebImageAnimatedImageFrameSource> frameSource = ((SDWebImageAnimatedImage *)image).frameSource;
+        if (frameSource.animatedImageFormat == SDImageFormatGIF) {
+            return frameSource.animatedImageData;
+        }
+    }
+    
     NSMutableData *imageData = [NSMutableData data];
     CFStringRef imageUTType = [NSData sd_UTTypeFromSDImageFormat:SDImageFormatGIF];
     NSArray<SDWebImageFrame *> *frames = [SDWebImageCoderHelper framesFromAnimatedImage:image];
@@ -182,3 +218,101 @@
 }
 
 @end
+
+#pragma mark - Frame source
+
+@implementation SDWebImageGIFFrameSource {
+    NSData *_data;
+    SDGIFDecoder *_decoder;
+}
+
+- (nullable instancetype)initWithData:(nonnull NSData *)data maxPixelCount:(NSUInteger)maxPixelCount {
+    if ((self = [super init])) {
+        // 解码器直接引用数据的内存，保存一份不可变的拷贝
+        _data = [data copy];
+        _decoder = SDGIFDecoderCreateWithMaxPixelCount(_data.bytes, _data.length, maxPixelCount);
+        if (!_decoder || SDGIFDecoderGetFrameCount(_decoder) < 2) {
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (_decoder) {
+        SDGIFDecoderRelease(_decoder);
+        _decoder = NULL;
+    }
+}
+
+- (NSData *)animatedImageData {
+    return _data;
+}
+
+- (SDImageFormat)animatedImageFormat {
+    return SDImageFormatGIF;
+}
+
+- (NSUInteger)animatedImageFrameCount {
+    return SDGIFDecoderGetFrameCount(_decoder);
+}
+
+- (NSUInteger)animatedImageLoopCount {
+    return SDGIFDecoderGetLoopCount(_decoder);
+}
+
+- (NSTimeInterval)animatedImageDurationAtIndex:(NSUInteger)index {
+    NSTimeInterval duration = SDGIFDecoderGetFrameInfo(_decoder, index).delay / 100.0;
+    // Same as `sd_frameDurationAtIndex:source:`, durations <= 10 ms are displayed for 100 ms like in Firefox
+    if (duration < 0.011) {
+        duration = 0.1;
+    }
+    return duration;
+}
+
+- (nullable UIImage *)animatedImageFrameAtIndex:(NSUInteger)index {
+    const uint8_t *canvas = SDGIFDecoderRenderFrame(_decoder, index);
+    if (!canvas) {
+        return nil;
+    }
+    size_t width = SDGIFDecoderGetWidth(_decoder);
+    size_t height = SDGIFDecoderGetHeight(_decoder);
+    size_t pixelCount = width * height;
+    // 画布会被下一帧复用，拷贝的同时把 RGBA 转成 Core Animation 直接使用的 BGRA，显示时不需要再转换
+    uint8_t *pixels = malloc(pixelCount * 4);
+    if (!pixels) {
+        return nil;
+    }
+    static const uint8_t order[4] = {2, 1, 0, 3};
+    SDPixelSwizzle(canvas, pixels, pixelCount, order);
+    CGDataProviderRef provider = CGDataProviderCreateWithData(NULL, pixels, pixelCount * 4, SDGIFFreeFrameData);
+    if (!provider) {
+        free(pixels);
+        return nil;
+    }
+    CGBitmapInfo bitmapInfo = kCGBitmapByteOrder32Little;
+    // 完全不透明的帧显示时不需要混合
+    bitmapInfo |= SDPixelIsOpaque(pixels, pixelCount, 3) ? kCGImageAlphaNoneSkipFirst : kCGImageAlphaPremultipliedFirst;
+    CGImageRef imageRef = CGImageCreate(width, height, 8, 32, width * 4, SDCGColorSpaceGetDeviceRGB(), bitmapInfo, provider, NULL, NO, kCGRenderingIntentDefault);
+    CGDataProviderRelease(provider);
+    if (!imageRef) {
+        return nil;
+    }
+#if SD_WATCH
+    CGFloat scale = [WKInterfaceDevice currentDevice].screenScale;
+    UIImage *image = [UIImage imageWithCGImage:imageRef scale:scale orientation:UIImageOrientationUp];
+#elif SD_UIKIT
+    CGFloat scale = [UIScreen mainScreen].scale;
+    UIImage *image = [UIImage imageWithCGImage:imageRef scale:scale orientation:UIImageOrientationUp];
+#else
+    UIImage *image = [[UIImage alloc] initWithCGImage:imageRef size:NSZeroSize];
+#endif
+    CGImageRelease(imageRef);
+    return image;
+}
+
+static void SDGIFFreeFrameData(void *info, const void *data, size_t size) {
+    free((void *)data);
+}
+
+@end
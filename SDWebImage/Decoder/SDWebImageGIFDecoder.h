@@ -0,0 +1,96 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+/*
+ GIF 解码器
+
+ 创建时只解析 GIF 的块结构，记录每一帧的位置、延时、处理方式和 LZW 数据的偏移，不解码任何像素。
+ 渲染第 N 帧时从最近的关键帧开始（或者接着上一次渲染的帧）把各帧的 LZW 数据解码合成到一块画布上，
+ 内存只有一块画布（处理方式为“恢复到上一帧”时再加一块备份），和帧数无关。
+ 只使用 C 标准库，不依赖 ImageIO。
+ */
+
+#ifndef SDWebImageGIFDecoder_h
+#define SDWebImageGIFDecoder_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct SDGIFDecoder SDGIFDecoder;
+
+typedef enum SDGIFDisposal {
+    SDGIFDisposalNone = 0,
+    SDGIFDisposalKeep = 1,
+    SDGIFDisposalBackground = 2,
+    SDGIFDisposalPrevious = 3
+} SDGIFDisposal;
+
+typedef struct SDGIFFrameInfo {
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+    // The delay in hundredths of a second, as stored in the file
+    uint32_t delay;
+    SDGIFDisposal disposal;
+    bool hasTransparency;
+    bool interlaced;
+} SDGIFFrameInfo;
+
+/**
+ * The default maximum width * height of the canvas, 60 MB of RGBA pixels.
+ * The canvas is allocated from the logical screen size whatever the size of the frames, a 65535x65535 GIF of a few bytes would need 17 GB.
+ */
+#define SD_GIF_DEFAULT_MAX_PIXEL_COUNT (60u * 1024 * 1024 / 4)
+
+/**
+ * Same as `SDGIFDecoderCreateWithMaxPixelCount` with `SD_GIF_DEFAULT_MAX_PIXEL_COUNT`
+ */
+SDGIFDecoder *SDGIFDecoderCreate(const uint8_t *bytes, size_t length);
+
+/**
+ * Parse the structure of a GIF. The bytes are not copied and must stay valid until the decoder is released.
+ * A truncated GIF keeps the frames whose data is complete.
+ *
+ * @param maxPixelCount The maximum width * height of the canvas, 0 for no limit
+ * @return The decoder, or NULL if the data is not a GIF, has no complete frame or its canvas has more than `maxPixelCount` pixels
+ */
+SDGIFDecoder *SDGIFDecoderCreateWithMaxPixelCount(const uint8_t *bytes, size_t length, uint64_t maxPixelCount);
+
+void SDGIFDecoderRelease(SDGIFDecoder *decoder);
+
+uint32_t SDGIFDecoderGetWidth(const SDGIFDecoder *decoder);
+uint32_t SDGIFDecoderGetHeight(const SDGIFDecoder *decoder);
+size_t SDGIFDecoderGetFrameCount(const SDGIFDecoder *decoder);
+
+/**
+ * The loop count of the NETSCAPE2.0 extension, 0 means infinite looping and also when the extension is missing
+ */
+uint32_t SDGIFDecoderGetLoopCount(const SDGIFDecoder *decoder);
+
+SDGIFFrameInfo SDGIFDecoderGetFrameInfo(const SDGIFDecoder *decoder, size_t index);
+
+/**
+ * Render a frame composited onto the full canvas.
+ * Rendering the frames in increasing order only decodes each frame once, otherwise the frames are decoded again from the nearest key frame.
+ *
+ * @return The canvas, width * height RGBA pixels with 8 bits per component (fully transparent pixels are all zero, so it is also premultiplied),
+ *         valid until the next render or the release of the decoder. NULL if the frame can not be decoded or the memory can not be allocated
+ */
+const uint8_t *SDGIFDecoderRenderFrame(SDGIFDecoder *decoder, size_t index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SDWebImageGIFDecoder_h */
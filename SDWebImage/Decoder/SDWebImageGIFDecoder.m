@@ -0,0 +1,523 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#include "SDWebImageGIFDecoder.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define SD_GIF_MAX_CODE_COUNT 4096
+#define SD_GIF_NO_FRAME SIZE_MAX
+
+typedef struct {
+    SDGIFFrameInfo info;
+    // -1 when the frame has no transparent color
+    int transparentIndex;
+    const uint8_t *colorTable;
+    uint32_t colorCount;
+    // Offset of the LZW minimum code size, followed by the data sub-blocks
+    size_t dataOffset;
+    bool isKeyFrame;
+} SDGIFFrame;
+
+struct SDGIFDecoder {
+    const uint8_t *bytes;
+    size_t length;
+    uint32_t width;
+    uint32_t height;
+    uint32_t loopCount;
+    SDGIFFrame *frames;
+    size_t frameCount;
+    uint8_t *canvas;
+    // 处理方式为“恢复到上一帧”的帧绘制之前，它所在区域的备份，和画布的布局相同
+    uint8_t *previousCanvas;
+    // The frame drawn on the canvas, its disposal is not applied yet
+    size_t canvasIndex;
+    // LZW 字典
+    uint16_t prefix[SD_GIF_MAX_CODE_COUNT];
+    uint8_t suffix[SD_GIF_MAX_CODE_COUNT];
+    uint8_t stack[SD_GIF_MAX_CODE_COUNT + 1];
+};
+
+static inline uint32_t SDGIFRead16(const uint8_t *p) {
+    return p[0] | ((uint32_t)p[1] << 8);
+}
+
+// Skip the data sub-blocks starting at offset, return the offset after the block terminator, or 0 if the data is truncated
+static size_t SDGIFSkipSubBlocks(const uint8_t *bytes, size_t length, size_t offset) {
+    while (offset < length) {
+        uint8_t size = bytes[offset++];
+        if (size == 0) {
+            return offset;
+        }
+        offset += size;
+    }
+    return 0;
+}
+
+#pragma mark - Structure
+
+static bool SDGIFAppendFrame(SDGIFDecoder *decoder, size_t *capacity, const SDGIFFrame *frame) {
+    if (decoder->frameCount == *capacity) {
+        size_t newCapacity = *capacity > 0 ? *capacity * 2 : 16;
+        SDGIFFrame *frames = realloc(decoder->frames, newCapacity * sizeof(SDGIFFrame));
+        if (!frames) {
+            return false;
+        }
+        decoder->frames = frames;
+        *capacity = newCapacity;
+    }
+    decoder->frames[decoder->frameCount++] = *frame;
+    return true;
+}
+
+static inline bool SDGIFFrameIsFullCanvas(const SDGIFFrame *frame, uint32_t width, uint32_t height) {
+    return frame->info.x == 0 && frame->info.y == 0 && frame->info.width >= width && frame->info.height >= height;
+}
+
+// 关键帧之前的画布可以当作全透明，从最近的关键帧开始合成就能得到任意一帧
+static bool SDGIFFrameIsKeyFrame(const SDGIFFrame *frame, const SDGIFFrame *previous, uint32_t width, uint32_t height) {
+    if (!previous) {
+        return true;
+    }
+    // 恢复到上一帧的帧之后还需要它之前的画布，不能作为关键帧
+    if (SDGIFFrameIsFullCanvas(frame, width, height) && frame->transparentIndex < 0 && frame->info.disposal != SDGIFDisposalPrevious) {
+        return true;
+    }
+    return previous->info.disposal == SDGIFDisposalBackground && (SDGIFFrameIsFullCanvas(previous, width, height) || previous->isKeyFrame);
+}
+
+static inline bool SDGIFCanvasExceedsMaxPixelCount(uint32_t width, uint32_t height, uint64_t maxPixelCount) {
+    return maxPixelCount > 0 && (uint64_t)width * height > maxPixelCount;
+}
+
+SDGIFDecoder *SDGIFDecoderCreate(const uint8_t *bytes, size_t length) {
+    return SDGIFDecoderCreateWithMaxPixelCount(bytes, length, SD_GIF_DEFAULT_MAX_PIXEL_COUNT);
+}
+
+SDGIFDecoder *SDGIFDecoderCreateWithMaxPixelCount(const uint8_t *bytes, size_t length, uint64_t maxPixelCount) {
+    if (length < 13 || memcmp(bytes, "GIF8", 4) != 0 || (bytes[4] != '7' && bytes[4] != '9') || bytes[5] != 'a') {
+        return NULL;
+    }
+    // 画布按逻辑屏幕的大小分配，和帧的大小无关，过大时不解析帧
+    if (SDGIFCanvasExceedsMaxPixelCount(SDGIFRead16(bytes + 6), SDGIFRead16(bytes + 8), maxPixelCount)) {
+        return NULL;
+    }
+    SDGIFDecoder *decoder = calloc(1, sizeof(SDGIFDecoder));
+    if (!decoder) {
+        return NULL;
+    }
+    decoder->bytes = bytes;
+    decoder->length = length;
+    decoder->width = SDGIFRead16(bytes + 6);
+    decoder->height = SDGIFRead16(bytes + 8);
+    decoder->canvasIndex = SD_GIF_NO_FRAME;
+
+    size_t offset = 13;
+    const uint8_t *globalColorTable = NULL;
+    uint32_t globalColorCount = 0;
+    uint8_t screenFlags = bytes[10];
+    if (screenFlags & 0x80) {
+        globalColorCount = 2u << (screenFlags & 0x07);
+        if (offset + globalColorCount * 3 > length) {
+            SDGIFDecoderRelease(decoder);
+            return NULL;
+        }
+        globalColorTable = bytes + offset;
+        offset += globalColorCount * 3;
+    }
+
+    size_t capacity = 0;
+    // The graphic control extension applies to the next image
+    SDGIFDisposal disposal = SDGIFDisposalNone;
+    uint32_t delay = 0;
+    int transparentIndex = -1;
+    while (offset < length) {
+        uint8_t introducer = bytes[offset++];
+        if (introducer == 0x3B) {
+            // Trailer
+            break;
+        }
+        if (introducer == 0x21) {
+            if (offset >= length) {
+                break;
+            }
+            uint8_t label = bytes[offset++];
+            if (label == 0xF9 && offset + 5 <= length && bytes[offset] >= 4) {
+                uint8_t flags = bytes[offset + 1];
+                disposal = (flags >> 2) & 0x07;
+                if (disposal > SDGIFDisposalPrevious) {
+                    // Undefined disposal methods are treated as no disposal
+                    disposal = SDGIFDisposalNone;
+                }
+                delay = SDGIFRead16(bytes + offset + 2);
+                transparentIndex = (flags & 0x01) ? bytes[offset + 4] : -1;
+            } else if (label == 0xFF && offset + 12 <= length && bytes[offset] == 11 && memcmp(bytes + offset + 1, "NETSCAPE2.0", 11) == 0) {
+                size_t subBlock = offset + 12;
+                if (subBlock + 4 <= length && bytes[subBlock] >= 3 && bytes[subBlock + 1] == 1) {
+                    decoder->loopCount = SDGIFRead16(bytes + subBlock + 2);
+                }
+            }
+            offset = SDGIFSkipSubBlocks(bytes, length, offset);
+            if (offset == 0) {
+                break;
+            }
+            continue;
+        }
+        if (introducer != 0x2C || offset + 9 > length) {
+            // Unknown block or truncated image descriptor, keep the frames read so far
+            break;
+        }
+        SDGIFFrame frame = {0};
+        frame.info.x = SDGIFRead16(bytes + offset);
+        frame.info.y = SDGIFRead16(bytes + offset + 2);
+        frame.info.width = SDGIFRead16(bytes + offset + 4);
+        frame.info.height = SDGIFRead16(bytes + offset + 6);
+        uint8_t imageFlags = bytes[offset + 8];
+        offset += 9;
+        frame.info.interlaced = (imageFlags & 0x40) != 0;
+        if (imageFlags & 0x80) {
+            frame.colorCount = 2u << (imageFlags & 0x07);
+            if (offset + frame.colorCount * 3 > length) {
+                break;
+            }
+            frame.colorTable = bytes + offset;
+            offset += frame.colorCount * 3;
+        } else {
+            frame.colorTable = globalColorTable;
+            frame.colorCount = globalColorCount;
+        }
+        if (offset >= length) {
+            break;
+        }
+        frame.dataOffset = offset;
+        offset = SDGIFSkipSubBlocks(bytes, length, offset + 1);
+        if (offset == 0) {
+            // 数据不完整的帧不解码
+            break;
+        }
+        frame.info.delay = delay;
+        frame.info.disposal = disposal;
+        frame.info.hasTransparency = transparentIndex >= 0;
+        frame.transparentIndex = transparentIndex;
+        disposal = SDGIFDisposalNone;
+        delay = 0;
+        transparentIndex = -1;
+        if (frame.info.width == 0 || frame.info.height == 0) {
+            continue;
+        }
+        if (!SDGIFAppendFrame(decoder, &capacity, &frame)) {
+            SDGIFDecoderRelease(decoder);
+            return NULL;
+        }
+    }
+
+    if (decoder->frameCount == 0) {
+        SDGIFDecoderRelease(decoder);
+        return NULL;
+    }
+    // Some encoders leave the logical screen empty, use the size of the frames like the browsers do
+    if (decoder->width == 0 || decoder->height == 0) {
+        for (size_t i = 0; i < decoder->frameCount; i++) {
+            const SDGIFFrameInfo *info = &decoder->frames[i].info;
+            if (info->x + info->width > decoder->width) {
+                decoder->width = info->x + info->width;
+            }
+            if (info->y + info->height > decoder->height) {
+                decoder->height = info->y + info->height;
+            }
+        }
+        if (SDGIFCanvasExceedsMaxPixelCount(decoder->width, decoder->height, maxPixelCount)) {
+            SDGIFDecoderRelease(decoder);
+            return NULL;
+        }
+    }
+    for (size_t i = 0; i < decoder->frameCount; i++) {
+        SDGIFFrame *frame = &decoder->frames[i];
+        frame->isKeyFrame = SDGIFFrameIsKeyFrame(frame, i > 0 ? &decoder->frames[i - 1] : NULL, decoder->width, decoder->height);
+    }
+    return decoder;
+}
+
+void SDGIFDecoderRelease(SDGIFDecoder *decoder) {
+    if (!decoder) {
+        return;
+    }
+    free(decoder->frames);
+    free(decoder->canvas);
+    free(decoder->previousCanvas);
+    free(decoder);
+}
+
+uint32_t SDGIFDecoderGetWidth(const SDGIFDecoder *decoder) {
+    return decoder->width;
+}
+
+uint32_t SDGIFDecoderGetHeight(const SDGIFDecoder *decoder) {
+    return decoder->height;
+}
+
+size_t SDGIFDecoderGetFrameCount(const SDGIFDecoder *decoder) {
+    return decoder->frameCount;
+}
+
+uint32_t SDGIFDecoderGetLoopCount(const SDGIFDecoder *decoder) {
+    return decoder->loopCount;
+}
+
+SDGIFFrameInfo SDGIFDecoderGetFrameInfo(const SDGIFDecoder *decoder, size_t index) {
+    if (index >= decoder->frameCount) {
+        SDGIFFrameInfo empty = {0};
+        return empty;
+    }
+    return decoder->frames[index].info;
+}
+
+#pragma mark - LZW
+
+typedef struct {
+    SDGIFDecoder *decoder;
+    const SDGIFFrame *frame;
+    uint32_t column;
+    // The canvas row of the current frame row, following the interlace passes
+    uint32_t row;
+    uint32_t pass;
+} SDGIFPixelWriter;
+
+static const uint32_t kSDGIFInterlaceStart[4] = {0, 4, 2, 1};
+static const uint32_t kSDGIFInterlaceStep[4] = {8, 8, 4, 2};
+
+static inline void SDGIFWritePixel(SDGIFPixelWriter *writer, uint8_t colorIndex) {
+    const SDGIFFrame *frame = writer->frame;
+    SDGIFDecoder *decoder = writer->decoder;
+    uint32_t x = frame->info.x + writer->column;
+    uint32_t y = frame->info.y + writer->row;
+    if (x < decoder->width && y < decoder->height && writer->row < frame->info.height && (int)colorIndex != frame->transparentIndex) {
+        uint8_t *pixel = decoder->canvas + ((size_t)y * decoder->width + x) * 4;
+        if (colorIndex < frame->colorCount) {
+            const uint8_t *color = frame->colorTable + colorIndex * 3;
+            pixel[0] = color[0];
+            pixel[1] = color[1];
+            pixel[2] = color[2];
+        } else {
+            // 颜色表之外的索引按黑色处理
+            pixel[0] = 0;
+            pixel[1] = 0;
+            pixel[2] = 0;
+        }
+        pixel[3] = 0xFF;
+    }
+    if (++writer->column < frame->info.width) {
+        return;
+    }
+    writer->column = 0;
+    if (!frame->info.interlaced) {
+        writer->row++;
+        return;
+    }
+    writer->row += kSDGIFInterlaceStep[writer->pass];
+    while (writer->row >= frame->info.height && writer->pass < 3) {
+        writer->pass++;
+        writer->row = kSDGIFInterlaceStart[writer->pass];
+    }
+}
+
+// Decode the LZW data of a frame onto the canvas. A truncated or corrupt stream leaves the remaining pixels unchanged, like the browsers do
+static bool SDGIFDecodeFrame(SDGIFDecoder *decoder, size_t index) {
+    const SDGIFFrame *frame = &decoder->frames[index];
+    const uint8_t *bytes = decoder->bytes;
+    size_t length = decoder->length;
+    size_t offset = frame->dataOffset;
+    uint32_t minimumCodeSize = bytes[offset++];
+    if (minimumCodeSize < 1 || minimumCodeSize > 11) {
+        return false;
+    }
+    uint16_t *prefix = decoder->prefix;
+    uint8_t *suffix = decoder->suffix;
+    uint8_t *stack = decoder->stack;
+    uint32_t clearCode = 1u << minimumCodeSize;
+    uint32_t endCode = clearCode + 1;
+    for (uint32_t code = 0; code < clearCode; code++) {
+        prefix[code] = 0;
+        suffix[code] = (uint8_t)code;
+    }
+    uint32_t codeSize = minimumCodeSize + 1;
+    uint32_t codeMask = (1u << codeSize) - 1;
+    uint32_t nextCode = clearCode + 2;
+    int32_t oldCode = -1;
+    uint8_t firstByte = 0;
+
+    uint32_t bitBuffer = 0;
+    uint32_t bitCount = 0;
+    size_t blockRemaining = 0;
+    SDGIFPixelWriter writer = {decoder, frame, 0, frame->info.interlaced ? kSDGIFInterlaceStart[0] : 0, 0};
+    size_t pixelCount = (size_t)frame->info.width * frame->info.height;
+    size_t written = 0;
+
+    while (written < pixelCount) {
+        // 数据分散在多个子块中，按位读取下一个编码
+        while (bitCount < codeSize) {
+            if (blockRemaining == 0) {
+                if (offset >= length || bytes[offset] == 0) {
+                    return true;
+                }
+                blockRemaining = bytes[offset++];
+            }
+            if (offset >= length) {
+                return true;
+            }
+            bitBuffer |= (uint32_t)bytes[offset++] << bitCount;
+            bitCount += 8;
+            blockRemaining--;
+        }
+        uint32_t code = bitBuffer & codeMask;
+        bitBuffer >>= codeSize;
+        bitCount -= codeSize;
+
+        if (code == clearCode) {
+            codeSize = minimumCodeSize + 1;
+            codeMask = (1u << codeSize) - 1;
+            nextCode = clearCode + 2;
+            oldCode = -1;
+            continue;
+        }
+        if (code == endCode) {
+            break;
+        }
+        size_t stackSize = 0;
+        if (oldCode < 0) {
+            if (code > clearCode) {
+                break;
+            }
+            firstByte = (uint8_t)code;
+            stack[stackSize++] = firstByte;
+            oldCode = code;
+        } else {
+            uint32_t inCode = code;
+            if (code >= nextCode) {
+                if (code > nextCode) {
+                    break;
+                }
+                // The code being defined: the previous string followed by its own first byte
+                stack[stackSize++] = firstByte;
+                code = oldCode;
+            }
+            while (code >= clearCode + 2) {
+                stack[stackSize++] = suffix[code];
+                code = prefix[code];
+            }
+            firstByte = (uint8_t)code;
+            stack[stackSize++] = firstByte;
+            if (nextCode < SD_GIF_MAX_CODE_COUNT) {
+                prefix[nextCode] = (uint16_t)oldCode;
+                suffix[nextCode] = firstByte;
+                nextCode++;
+                if (nextCode > codeMask && codeSize < 12) {
+                    codeSize++;
+                    codeMask = (1u << codeSize) - 1;
+                }
+            }
+            oldCode = inCode;
+        }
+        while (stackSize > 0 && written < pixelCount) {
+            SDGIFWritePixel(&writer, stack[--stackSize]);
+            written++;
+        }
+    }
+    return true;
+}
+
+#pragma mark - Rendering
+
+// The part of a frame inside the canvas: the byte range of its rows and the range of rows
+static void SDGIFFrameCanvasRect(const SDGIFDecoder *decoder, const SDGIFFrame *frame, size_t *rowOffset, size_t *rowLength, uint32_t *top, uint32_t *bottom) {
+    uint32_t left = frame->info.x < decoder->width ? frame->info.x : decoder->width;
+    uint32_t right = frame->info.x + frame->info.width < decoder->width ? frame->info.x + frame->info.width : decoder->width;
+    *top = frame->info.y < decoder->height ? frame->info.y : decoder->height;
+    *bottom = frame->info.y + frame->info.height < decoder->height ? frame->info.y + frame->info.height : decoder->height;
+    *rowOffset = (size_t)left * 4;
+    *rowLength = (size_t)(right - left) * 4;
+}
+
+static void SDGIFDisposeFrame(SDGIFDecoder *decoder, size_t index) {
+    const SDGIFFrame *frame = &decoder->frames[index];
+    if (frame->info.disposal != SDGIFDisposalBackground && frame->info.disposal != SDGIFDisposalPrevious) {
+        return;
+    }
+    size_t rowOffset, rowLength;
+    uint32_t top, bottom;
+    SDGIFFrameCanvasRect(decoder, frame, &rowOffset, &rowLength, &top, &bottom);
+    size_t stride = (size_t)decoder->width * 4;
+    for (uint32_t y = top; y < bottom; y++) {
+        uint8_t *row = decoder->canvas + y * stride + rowOffset;
+        if (frame->info.disposal == SDGIFDisposalBackground) {
+            // 和浏览器一样恢复为透明，而不是背景色
+            memset(row, 0, rowLength);
+        } else {
+            memcpy(row, decoder->previousCanvas + y * stride + rowOffset, rowLength);
+        }
+    }
+}
+
+static bool SDGIFSavePreviousCanvas(SDGIFDecoder *decoder, size_t index) {
+    size_t canvasSize = (size_t)decoder->width * decoder->height * 4;
+    if (!decoder->previousCanvas) {
+        decoder->previousCanvas = malloc(canvasSize);
+        if (!decoder->previousCanvas) {
+            return false;
+        }
+    }
+    size_t rowOffset, rowLength;
+    uint32_t top, bottom;
+    SDGIFFrameCanvasRect(decoder, &decoder->frames[index], &rowOffset, &rowLength, &top, &bottom);
+    size_t stride = (size_t)decoder->width * 4;
+    for (uint32_t y = top; y < bottom; y++) {
+        memcpy(decoder->previousCanvas + y * stride + rowOffset, decoder->canvas + y * stride + rowOffset, rowLength);
+    }
+    return true;
+}
+
+const uint8_t *SDGIFDecoderRenderFrame(SDGIFDecoder *decoder, size_t index) {
+    if (index >= decoder->frameCount) {
+        return NULL;
+    }
+    size_t canvasSize = (size_t)decoder->width * decoder->height * 4;
+    if (!decoder->canvas) {
+        if ((size_t)decoder->width * decoder->height > SIZE_MAX / 4) {
+            return NULL;
+        }
+        decoder->canvas = calloc(1, canvasSize);
+        if (!decoder->canvas) {
+            return NULL;
+        }
+    }
+    size_t keyFrameIndex = index;
+    while (keyFrameIndex > 0 && !decoder->frames[keyFrameIndex].isKeyFrame) {
+        keyFrameIndex--;
+    }
+    // 画布上是同一段关键帧之后的前面的帧时接着合成，否则从关键帧重新开始
+    if (decoder->canvasIndex == SD_GIF_NO_FRAME || decoder->canvasIndex < keyFrameIndex || decoder->canvasIndex > index) {
+        memset(decoder->canvas, 0, canvasSize);
+        decoder->canvasIndex = SD_GIF_NO_FRAME;
+    }
+    size_t startIndex = decoder->canvasIndex == SD_GIF_NO_FRAME ? keyFrameIndex : decoder->canvasIndex + 1;
+    for (size_t i = startIndex; i <= index; i++) {
+        if (decoder->canvasIndex != SD_GIF_NO_FRAME) {
+            SDGIFDisposeFrame(decoder, decoder->canvasIndex);
+            // 关键帧总是画在空白的画布上，数据不完整的关键帧按顺序渲染和跳转渲染的结果才相同
+            if (decoder->frames[i].isKeyFrame) {
+                memset(decoder->canvas, 0, canvasSize);
+            }
+        }
+        if ((decoder->frames[i].info.disposal == SDGIFDisposalPrevious && !SDGIFSavePreviousCanvas(decoder, i)) || !SDGIFDecodeFrame(decoder, i)) {
+            decoder->canvasIndex = SD_GIF_NO_FRAME;
+            return NULL;
+        }
+        decoder->canvasIndex = i;
+    }
+    return decoder->canvas;
+}
@@ -0,0 +1,80 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+/*
+ 解析图片头部
+
+ 只根据最先收到的几百个字节读出图片的格式和像素尺寸（JPEG 的 SOF、PNG 的 IHDR、GIF 的逻辑屏幕、WebP 的 VP8/VP8L/VP8X），
+ 下载过程中就能判断图片是否过大或者无法解码，不需要等整个文件下载完再交给解码器。
+ 解析只使用 C 标准库，不分配内存，可以在每次收到数据时调用。
+ */
+
+#ifndef SDWebImageImageHeader_h
+#define SDWebImageImageHeader_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum SDImageHeaderStatus {
+    /**
+     * The bytes are a valid beginning of a known format, but do not reach the dimensions yet.
+     */
+    SDImageHeaderStatusNeedMoreData = 0,
+
+    /**
+     * The format and the dimensions were read.
+     */
+    SDImageHeaderStatusComplete,
+
+    /**
+     * The bytes start like a known format but the header is corrupt, the image can not be decoded.
+     */
+    SDImageHeaderStatusInvalid,
+
+    /**
+     * The format has no header parser (TIFF, HEIC, unknown data), the format may still be set.
+     */
+    SDImageHeaderStatusUnknown
+} SDImageHeaderStatus;
+
+/**
+ * The formats recognized from the first bytes, with the same values as `SDImageFormat`
+ */
+typedef enum SDImageHeaderFormat {
+    SDImageHeaderFormatUndefined = -1,
+    SDImageHeaderFormatJPEG = 0,
+    SDImageHeaderFormatPNG,
+    SDImageHeaderFormatGIF,
+    SDImageHeaderFormatTIFF,
+    SDImageHeaderFormatWebP
+} SDImageHeaderFormat;
+
+typedef struct SDImageHeader {
+    SDImageHeaderFormat format;
+    uint32_t width;
+    uint32_t height;
+} SDImageHeader;
+
+/**
+ * Parse the format and the pixel size of an image from the first bytes of its data.
+ *
+ * @param bytes  The first bytes of the image data
+ * @param length The number of bytes available, call again with more bytes while `SDImageHeaderStatusNeedMoreData` is returned
+ * @param header On return, the format and, for `SDImageHeaderStatusComplete`, the pixel size
+ */
+SDImageHeaderStatus SDImageHeaderParse(const uint8_t *bytes, size_t length, SDImageHeader *header);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SDWebImageImageHeader_h */
@@ -0,0 +1,219 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#include "SDWebImageImageHeader.h"
+#include <stdbool.h>
+#include <string.h>
+
+static inline uint32_t SDReadBig16(const uint8_t *p) {
+    return ((uint32_t)p[0] << 8) | p[1];
+}
+
+static inline uint32_t SDReadBig32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline uint32_t SDReadLittle16(const uint8_t *p) {
+    return p[0] | ((uint32_t)p[1] << 8);
+}
+
+static inline uint32_t SDReadLittle24(const uint8_t *p) {
+    return p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+}
+
+static inline uint32_t SDReadLittle32(const uint8_t *p) {
+    return p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Whether the available bytes match the beginning of a signature
+static inline bool SDMatchesPrefix(const uint8_t *bytes, size_t length, const char *signature, size_t signatureLength) {
+    return memcmp(bytes, signature, length < signatureLength ? length : signatureLength) == 0;
+}
+
+#pragma mark - JPEG
+
+// 依次跳过 SOF 之前的段（APP0/APP1 的 EXIF 可能有几十 KB），SOF 段中是高度和宽度
+static SDImageHeaderStatus SDImageHeaderParseJPEG(const uint8_t *bytes, size_t length, SDImageHeader *header) {
+    if (length < 2) {
+        return SDImageHeaderStatusNeedMoreData;
+    }
+    if (bytes[1] != 0xD8) {
+        return SDImageHeaderStatusInvalid;
+    }
+    size_t offset = 2;
+    while (true) {
+        if (offset >= length) {
+            return SDImageHeaderStatusNeedMoreData;
+        }
+        if (bytes[offset] != 0xFF) {
+            return SDImageHeaderStatusInvalid;
+        }
+        // Markers may be preceded by any number of fill bytes
+        while (offset < length && bytes[offset] == 0xFF) {
+            offset++;
+        }
+        if (offset >= length) {
+            return SDImageHeaderStatusNeedMoreData;
+        }
+        uint8_t marker = bytes[offset++];
+        if (marker == 0x01 || marker == 0xD8 || (marker >= 0xD0 && marker <= 0xD7)) {
+            // Standalone markers have no length
+            continue;
+        }
+        if (marker == 0xD9 || marker == 0xDA) {
+            // End of image or start of scan before any frame header
+            return SDImageHeaderStatusInvalid;
+        }
+        if (offset + 2 > length) {
+            return SDImageHeaderStatusNeedMoreData;
+        }
+        uint32_t segmentLength = SDReadBig16(bytes + offset);
+        if (segmentLength < 2) {
+            return SDImageHeaderStatusInvalid;
+        }
+        bool isStartOfFrame = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+        if (isStartOfFrame) {
+            // length(2) precision(1) height(2) width(2)
+            if (segmentLength < 7) {
+                return SDImageHeaderStatusInvalid;
+            }
+            if (offset + 7 > length) {
+                return SDImageHeaderStatusNeedMoreData;
+            }
+            header->height = SDReadBig16(bytes + offset + 3);
+            header->width = SDReadBig16(bytes + offset + 5);
+            // 高度为 0 时由后面的 DNL 段给出，头部无法确定尺寸
+            return header->width > 0 && header->height > 0 ? SDImageHeaderStatusComplete : SDImageHeaderStatusUnknown;
+        }
+        offset += segmentLength;
+    }
+}
+
+#pragma mark - PNG
+
+static SDImageHeaderStatus SDImageHeaderParsePNG(const uint8_t *bytes, size_t length, SDImageHeader *header) {
+    static const char signature[] = "\x89PNG\r\n\x1A\n";
+    if (!SDMatchesPrefix(bytes, length, signature, 8)) {
+        return SDImageHeaderStatusInvalid;
+    }
+    // signature(8) chunk length(4) "IHDR"(4) width(4) height(4)
+    if (length < 24) {
+        return SDImageHeaderStatusNeedMoreData;
+    }
+    if (memcmp(bytes + 12, "IHDR", 4) != 0) {
+        return SDImageHeaderStatusInvalid;
+    }
+    header->width = SDReadBig32(bytes + 16);
+    header->height = SDReadBig32(bytes + 20);
+    if (header->width == 0 || header->height == 0 || header->width > INT32_MAX || header->height > INT32_MAX) {
+        return SDImageHeaderStatusInvalid;
+    }
+    return SDImageHeaderStatusComplete;
+}
+
+#pragma mark - GIF
+
+static SDImageHeaderStatus SDImageHeaderParseGIF(const uint8_t *bytes, size_t length, SDImageHeader *header) {
+    if (!SDMatchesPrefix(bytes, length, "GIF8", 4)) {
+        return SDImageHeaderStatusInvalid;
+    }
+    // "GIF87a" or "GIF89a", then the logical screen width(2) and height(2)
+    if (length < 10) {
+        return SDImageHeaderStatusNeedMoreData;
+    }
+    if ((bytes[4] != '7' && bytes[4] != '9') || bytes[5] != 'a') {
+        return SDImageHeaderStatusInvalid;
+    }
+    header->width = SDReadLittle16(bytes + 6);
+    header->height = SDReadLittle16(bytes + 8);
+    // 逻辑屏幕尺寸为 0 的 GIF 解码器会使用帧的尺寸
+    return header->width > 0 && header->height > 0 ? SDImageHeaderStatusComplete : SDImageHeaderStatusUnknown;
+}
+
+#pragma mark - WebP
+
+static SDImageHeaderStatus SDImageHeaderParseWebP(const uint8_t *bytes, size_t length, SDImageHeader *header) {
+    // "RIFF" size(4) "WEBP" chunk(4) chunk size(4)
+    if (length < 20) {
+        return SDImageHeaderStatusNeedMoreData;
+    }
+    const uint8_t *chunk = bytes + 12;
+    const uint8_t *payload = bytes + 20;
+    if (memcmp(chunk, "VP8 ", 4) == 0) {
+        // Lossy: frame tag(3) start code 9d 01 2a, then 14 bits width and height
+        if (length < 30) {
+            return SDImageHeaderStatusNeedMoreData;
+        }
+        if (payload[3] != 0x9D || payload[4] != 0x01 || payload[5] != 0x2A) {
+            return SDImageHeaderStatusInvalid;
+        }
+        header->width = SDReadLittle16(payload + 6) & 0x3FFF;
+        header->height = SDReadLittle16(payload + 8) & 0x3FFF;
+    } else if (memcmp(chunk, "VP8L", 4) == 0) {
+        // Lossless: signature 0x2f, then 14 bits width - 1 and 14 bits height - 1
+        if (length < 25) {
+            return SDImageHeaderStatusNeedMoreData;
+        }
+        if (payload[0] != 0x2F) {
+            return SDImageHeaderStatusInvalid;
+        }
+        uint32_t bits = SDReadLittle32(payload + 1);
+        header->width = (bits & 0x3FFF) + 1;
+        header->height = ((bits >> 14) & 0x3FFF) + 1;
+    } else if (memcmp(chunk, "VP8X", 4) == 0) {
+        // Extended: flags(4), then 24 bits canvas width - 1 and height - 1
+        if (length < 30) {
+            return SDImageHeaderStatusNeedMoreData;
+        }
+        header->width = SDReadLittle24(payload + 4) + 1;
+        header->height = SDReadLittle24(payload + 7) + 1;
+    } else {
+        return SDImageHeaderStatusInvalid;
+    }
+    return header->width > 0 && header->height > 0 ? SDImageHeaderStatusComplete : SDImageHeaderStatusInvalid;
+}
+
+#pragma mark - Header
+
+SDImageHeaderStatus SDImageHeaderParse(const uint8_t *bytes, size_t length, SDImageHeader *header) {
+    header->format = SDImageHeaderFormatUndefined;
+    header->width = 0;
+    header->height = 0;
+    if (length == 0) {
+        return SDImageHeaderStatusNeedMoreData;
+    }
+    // 和 sd_imageFormatForImageData: 一样根据第一个字节判断格式
+    switch (bytes[0]) {
+        case 0xFF:
+            header->format = SDImageHeaderFormatJPEG;
+            return SDImageHeaderParseJPEG(bytes, length, header);
+        case 0x89:
+            header->format = SDImageHeaderFormatPNG;
+            return SDImageHeaderParsePNG(bytes, length, header);
+        case 0x47:
+            header->format = SDImageHeaderFormatGIF;
+            return SDImageHeaderParseGIF(bytes, length, header);
+        case 0x49:
+        case 0x4D:
+            header->format = SDImageHeaderFormatTIFF;
+            return SDImageHeaderStatusUnknown;
+        case 0x52: {
+            // Other RIFF files are not images
+            if (!SDMatchesPrefix(bytes, length, "RIFF", 4) || (length > 8 && !SDMatchesPrefix(bytes + 8, length - 8, "WEBP", 4))) {
+                return SDImageHeaderStatusUnknown;
+            }
+            if (length < 12) {
+                return SDImageHeaderStatusNeedMoreData;
+            }
+            header->format = SDImageHeaderFormatWebP;
+            return SDImageHeaderParseWebP(bytes, length, header);
+        }
+        default:
+            return SDImageHeaderStatusUnknown;
+    }
+}
@@ -11,6 +11,9 @@
 #import "NSImage+WebCache.h"
 #import <ImageIO/ImageIO.h>
 #import "NSData+ImageContentType.h"
+#import "SDWebImageChunkedData.h"
+#import "SDWebImageAnimatedImage.h"
+#import "SDWebImageResampler.h"
 
 #if SD_UIKIT || SD_WATCH
 static const size_t kBytesPerPixel = 4;
@@ -26,6 +29,7 @@ static const CGFloat kDestImageSizeMB = 60.0f;
 
 /*
  * Defines the maximum size in MB of a tile used to decode image when the flag `SDWebImageScaleDownLargeImages` is set
+ * The tiles decoded concurrently share this size.
  * Suggested value for iPad1 and iPhone 3GS: 20.
  * Suggested value for iPad2 and iPhone 4: 40.
  * Suggested value for iPhone 3G and iPod 2 and earlier devices: 10.
@@ -37,7 +41,6 @@ static const CGFloat kPixelsPerMB = kBytesPerMB / kBytesPerPixel;
 static const CGFloat kDestTotalPixels = kDestImageSizeMB * kPixelsPerMB;
 static const CGFloat kTileTotalPixels = kSourceImageTileSizeMB * kPixelsPerMB;
 
-static const CGFloat kDestSeemOverlap = 2.0f;   // the numbers of pixels to overlap the seems where tiles meet.
 #endif
 
 @implementation SDWebImageImageIOCoder {
@@ -46,6 +49,8 @@ static const CGFloat kDestSeemOverlap = 2.0f;   // the numbers of pixels to over
         UIImageOrientation _orientation;
 #endif
         CGImageSourceRef _imageSource;
+        // appendIncrementalData: 追加的数据，通过 CGDataProvider 交给 ImageIO 按需读取
+        SDWebImageChunkedData *_incrementalData;
 }
 
 - (void)dealloc {
@@ -122,11 +127,60 @@ static const CGFloat kDestSeemOverlap = 2.0f;   // the numbers of pixels to over
 #endif
 }
 
+- (UIImage *)decodedImageWithData:(NSData *)data options:(nullable NSDictionary<NSString*, NSObject*>*)optionsDict {
+    if (!data) {
+        return nil;
+    }
+    // GIF 保持原来的处理
+    if ([NSData sd_imageFormatForImageData:data] == SDImageFormatGIF) {
+        return [self decodedImageWithData:data];
+    }
+    CGImageSourceRef source = CGImageSourceCreateWithData((__bridge CFDataRef)data, NULL);
+    if (!source) {
+        return nil;
+    }
+    size_t width = 0, height = 0;
+    NSInteger exifOrientation = 1;
+    CFDictionaryRef properties = CGImageSourceCopyPropertiesAtIndex(source, 0, NULL);
+    if (properties) {
+        CFTypeRef val = CFDictionaryGetValue(properties, kCGImagePropertyPixelWidth);
+        if (val) CFNumberGetValue(val, kCFNumberLongType, &width);
+        val = CFDictionaryGetValue(properties, kCGImagePropertyPixelHeight);
+        if (val) CFNumberGetValue(val, kCFNumberLongType, &height);
+        val = CFDictionaryGetValue(properties, kCGImagePropertyOrientation);
+        if (val) CFNumberGetValue(val, kCFNumberNSIntegerType, &exifOrientation);
+        CFRelease(properties);
+    }
+    NSUInteger maxPixelSize = SDImageDecodeMaxPixelSize(width, height, optionsDict);
+    if (maxPixelSize == 0) {
+        CFRelease(source);
+        return [self decodedImageWithData:data];
+    }
+    // ImageIO decodes the thumbnail from the compressed data directly (JPEG DCT scaling, PNG rows streamed),
+    // the orientation is kept in the UIImage instead of rotating the pixels
+    NSDictionary *thumbnailOptions = @{(__bridge NSString *)kCGImageSourceCreateThumbnailFromImageAlways : @YES,
+                                       (__bridge NSString *)kCGImageSourceThumbnailMaxPixelSize : @(maxPixelSize),
+                                       (__bridge NSString *)kCGImageSourceCreateThumbnailWithTransform : @NO,
+                                       (__bridge NSString *)kCGImageSourceShouldCacheImmediately : @YES};
+    CGImageRef imageRef = CGImageSourceCreateThumbnailAtIndex(source, 0, (__bridge CFDictionaryRef)thumbnailOptions);
+    CFRelease(source);
+    if (!imageRef) {
+        return nil;
+    }
+#if SD_UIKIT || SD_WATCH
+    UIImageOrientation orientation = [SDWebImageCoderHelper imageOrientationFromEXIFOrientation:exifOrientation];
+    UIImage *image = [UIImage imageWithCGImage:imageRef scale:1 orientation:orientation];
+#else
+    UIImage *image = [[UIImage alloc] initWithCGImage:imageRef size:NSZeroSize];
+#endif
+    CGImageRelease(imageRef);
+    return image;
+}
+
 - (UIImage *)incrementallyDecodedImageWithData:(NSData *)data finished:(BOOL)finished {
     if (!_imageSource) {
         _imageSource = CGImageSourceCreateIncremental(NULL);
     }
-    UIImage *image;
     
     // The following code is from http://www.cocoaintheshell.com/2011/05/progressive-images-download-imageio/
     // Thanks to the author @Nyx0uf
@@ -134,6 +188,38 @@ static const CGFloat kDestSeemOverlap = 2.0f;   // the numbers of pixels to over
     // Update the data source, we must pass ALL the data, not just the new bytes
     CGImageSourceUpdateData(_imageSource, (__bridge CFDataRef)data, finished);
     
+    return [self sd_incrementallyDecodedImageFinished:finished];
+}
+
+- (void)appendIncrementalData:(nonnull NSData *)data {
+    if (!_incrementalData) {
+        _incrementalData = [SDWebImageChunkedData new];
+    }
+    [_incrementalData appendData:data];
+}
+
+- (UIImage *)incrementallyDecodedImageWithFinished:(BOOL)finished {
+    if (!_imageSource) {
+        _imageSource = CGImageSourceCreateIncremental(NULL);
+    }
+    // The provider reads the appended chunks on demand instead of a copy of all the data
+    CGDataProviderRef provider = [_incrementalData newDataProviderWithLength:_incrementalData.length];
+    if (!provider) {
+        return nil;
+    }
+    CGImageSourceUpdateDataProvider(_imageSource, provider, finished);
+    CGDataProviderRelease(provider);
+    if (finished) {
+        _incrementalData = nil;
+    }
+    
+    return [self sd_incrementallyDecodedImageFinished:finished];
+}
+
+// Create the partial image from the incremental image source
+- (UIImage *)sd_incrementallyDecodedImageFinished:(BOOL)finished {
+    UIImage *image;
+    
     if (_width + _height == 0) {
         CFDictionaryRef properties = CGImageSourceCopyPropertiesAtIndex(_imageSource, 0, NULL);
         if (properties) {
@@ -220,7 +306,9 @@ static const CGFloat kDestSeemOverlap = 2.0f;   // the numbers of pixels to over
         return [self sd_decompressedImageWithImage:image];
     } else {
         UIImage *scaledDownImage = [self sd_decompressedAndScaledDownImageWithImage:image];
-        if (scaledDownImage && !CGSizeEqualToSize(scaledDownImage.size, image.size)) {
+        // The image may already be downsampled while decoding, so compare with the pixel size of the data
+        if (scaledDownImage && (!CGSizeEqualToSize(scaledDownImage.size, image.size) ||
+                                CGImageGetWidth(scaledDownImage.CGImage) < [[self class] sd_pixelSizeFromImageData:*data].width)) {
             // if the image is scaled down, need to modify the data pointer as well
             SDImageFormat format = [NSData sd_imageFormatForImageData:*data];
             NSData *imageData = [self encodedDataWithImage:scaledDownImage format:format];
@@ -363,74 +451,64 @@ static const CGFloat kDestSeemOverlap = 2.0f;   // the numbers of pixels to over
         if (destContext == NULL) {
             return image;
         }
-        //设置目标图片的压缩质量
-
-        CGContextSetInterpolationQuality(destContext, kCGInterpolationHigh);
-        
-        // Now define the size of the rectangle to be used for the
-        // incremental blits from the input image to the output image.
-        // we use a source tile width equal to the width of the source
-        // image due to the way that iOS retrieves image data from disk.
-        // iOS must decode an image from disk in full width 'bands', even
-        // if current graphics context is clipped to a subrect within that
-        // band. Therefore we fully utilize all of the pixel data that results
-        // from a decoding opertion by achnoring our tile size to the full
-        // width of the input image.
-        //计算第一个原图方块，这个方块的宽度同原图一样，高度根据方块容量计算
-
-        CGRect sourceTile = CGRectZero;
-        sourceTile.size.width = sourceResolution.width;
-        // The source tile height is dynamic. Since we specified the size
-        // of the source tile in MB, see how many rows of pixels high it
-        // can be given the input image width.
-        sourceTile.size.height = (int)(kTileTotalPixels / sourceTile.size.width );
-        sourceTile.origin.x = 0.0f;
-        // The output tile is the same proportions as the input tile, but
-        // scaled to image scale.
-        //计算目标图像方块
-
-        CGRect destTile;
-        destTile.size.width = destResolution.width;
-        destTile.size.height = sourceTile.size.height * imageScale;
-        destTile.origin.x = 0.0f;
-        //计算原图像方块与方块重叠的像素大小
-
-        // The source seem overlap is proportionate to the destination seem overlap.
-        // this is the amount of pixels to overlap each tile as we assemble the ouput image.
-        
-        float sourceSeemOverlap = (int)((kDestSeemOverlap/destResolution.height)*sourceResolution.height);
-        CGImageRef sourceTileImageRef;
-        // calculate the number of read/write operations required to assemble the
-        // output image.
-        //计算原图像需要被分割成多少个方块 iterations
-
-        int iterations = (int)( sourceResolution.height / sourceTile.size.height );
-        // If tile height doesn't divide the image height evenly, add another iteration
-        // to account for the remaining pixels.
-        int remainder = (int)sourceResolution.height % (int)sourceTile.size.height;
-        if(remainder) {
-            iterations++;
+        // The destination is resampled in horizontal bands processed concurrently with a Mitchell filter.
+        // Each band draws only the source rows its filter reads, including the rows shared with the
+        // neighbouring bands, so there is no seam where the bands meet. The bands processed at the same
+        // time draw about kSourceImageTileSizeMB of source pixels in total.
+        //目标图片分成多个水平条带，在多个线程上同时缩放，每个条带只绘制它需要的源图片行
+        size_t sourceWidth = (size_t)sourceResolution.width;
+        size_t sourceHeight = (size_t)sourceResolution.height;
+        size_t destWidth = CGBitmapContextGetWidth(destContext);
+        size_t destHeight = CGBitmapContextGetHeight(destContext);
+        size_t destBytesPerRow = CGBitmapContextGetBytesPerRow(destContext);
+        uint8_t *destData = CGBitmapContextGetData(destContext);
+        NSUInteger concurrency = MAX([NSProcessInfo processInfo].activeProcessorCount, 1);
+        CGFloat sourceTileRows = MAX(kTileTotalPixels / concurrency / sourceWidth, 1);
+        size_t bandHeight = MAX((size_t)(sourceTileRows * destHeight / sourceHeight), 1);
+        SDImageResampler *resampler = SDImageResamplerCreate(sourceWidth, sourceHeight, destWidth, destHeight, SDImageResampleFilterMitchell, bandHeight);
+        size_t bandCount = SDImageResamplerGetBandCount(resampler);
+        bool *bandFailed = bandCount > 0 ? calloc(bandCount, sizeof(bool)) : NULL;
+        if (!destData || !resampler || !bandFailed) {
+            free(bandFailed);
+            SDImageResamplerRelease(resampler);
+            CGContextRelease(destContext);
+            return image;
         }
-        //根据重叠像素计算原图方块的大小后，获取原图中该方块内的数据，把该数据写入到相对应的目标方块中
-
-        // Add seem overlaps to the tiles, but save the original tile height for y coordinate calculations.
-        float sourceTileHeightMinusOverlap = sourceTile.size.height;
-        sourceTile.size.height += sourceSeemOverlap;
-        destTile.size.height += kDestSeemOverlap;
-        for( int y = 0; y < iterations; ++y ) {
+        dispatch_apply(bandCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t band) {
             @autoreleasepool {
-                sourceTile.origin.y = y * sourceTileHeightMinusOverlap + sourceSeemOverlap;
-                destTile.origin.y = destResolution.height - (( y + 1 ) * sourceTileHeightMinusOverlap * imageScale + kDestSeemOverlap);
-                sourceTileImageRef = CGImageCreateWithImageInRect( sourceImageRef, sourceTile );
-                if( y == iterations - 1 && remainder ) {
-                    float dify = destTile.size.height;
-                    destTile.size.height = CGImageGetHeight( sourceTileImageRef ) * imageScale;
-                    dify -= destTile.size.height;
-                    destTile.origin.y += dify;
+                size_t sourceFirstRow, sourceRowCount, destFirstRow, destRowCount;
+                SDImageResamplerGetBandSourceRows(resampler, band, &sourceFirstRow, &sourceRowCount);
+                SDImageResamplerGetBandDestinationRows(resampler, band, &destFirstRow, &destRowCount);
+                // Draw the source rows of the band in the pixel format of the destination
+                CGContextRef tileContext = CGBitmapContextCreate(NULL,
+                                                                 sourceWidth,
+                                                                 sourceRowCount,
+                                                                 kBitsPerComponent,
+                                                                 sourceWidth * kBytesPerPixel,
+                                                                 colorspaceRef,
+                                                                 kCGBitmapByteOrderDefault|kCGImageAlphaNoneSkipLast);
+                CGImageRef sourceTileImageRef = CGImageCreateWithImageInRect(sourceImageRef, CGRectMake(0, sourceFirstRow, sourceWidth, sourceRowCount));
+                uint8_t *tileData = tileContext ? CGBitmapContextGetData(tileContext) : NULL;
+                if (tileData && sourceTileImageRef) {
+                    CGContextDrawImage(tileContext, CGRectMake(0, 0, sourceWidth, sourceRowCount), sourceTileImageRef);
+                    bandFailed[band] = !SDImageResamplerProcessBand(resampler, band, tileData, CGBitmapContextGetBytesPerRow(tileContext),
+                                                                    destData + destFirstRow * destBytesPerRow, destBytesPerRow);
+                } else {
+                    bandFailed[band] = true;
                 }
-                CGContextDrawImage( destContext, destTile, sourceTileImageRef );
-                CGImageRelease( sourceTileImageRef );
+                CGImageRelease(sourceTileImageRef);
+                CGContextRelease(tileContext);
             }
+        });
+        BOOL failed = NO;
+        for (size_t band = 0; band < bandCount; band++) {
+            failed = failed || bandFailed[band];
+        }
+        free(bandFailed);
+        SDImageResamplerRelease(resampler);
+        if (failed) {
+            CGContextRelease(destContext);
+            return image;
         }
  
         CGImageRef destImageRef = CGBitmapContextCreateImage(destContext);
@@ -519,7 +597,7 @@ static const CGFloat kDestSeemOverlap = 2.0f;   // the numbers of pixels to over
     // do not decode animated images
     //如果是动态图片不处理
 
-    if (image.images != nil) {
+    if (image.images != nil || [image isKindOfClass:[SDWebImageAnimatedImage class]]) {
         return NO;
     }
     
@@ -592,6 +670,29 @@ static const CGFloat kDestSeemOverlap = 2.0f;   // the numbers of pixels to over
 #endif
 
 #if SD_UIKIT || SD_WATCH
+// 图片数据中记录的像素大小，不解码
++ (CGSize)sd_pixelSizeFromImageData:(nullable NSData *)imageData {
+    CGSize pixelSize = CGSizeZero;
+    if (!imageData) {
+        return pixelSize;
+    }
+    CGImageSourceRef imageSource = CGImageSourceCreateWithData((__bridge CFDataRef)imageData, NULL);
+    if (imageSource) {
+        CFDictionaryRef properties = CGImageSourceCopyPropertiesAtIndex(imageSource, 0, NULL);
+        if (properties) {
+            NSInteger width = 0, height = 0;
+            CFTypeRef val = CFDictionaryGetValue(properties, kCGImagePropertyPixelWidth);
+            if (val) CFNumberGetValue(val, kCFNumberNSIntegerType, &width);
+            val = CFDictionaryGetValue(properties, kCGImagePropertyPixelHeight);
+            if (val) CFNumberGetValue(val, kCFNumberNSIntegerType, &height);
+            pixelSize = CGSizeMake(width, height);
+            CFRelease(properties);
+        }
+        CFRelease(imageSource);
+    }
+    return pixelSize;
+}
+
 // 是否需要压缩原始图片的大小(图像大于目标尺寸才需要压缩)
 
 + (BOOL)shouldScaleDownImage:(nonnull UIImage *)image {
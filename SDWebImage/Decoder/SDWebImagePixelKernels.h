@@ -0,0 +1,64 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+/*
+ 像素格式转换
+
+ 解码器直接按最终的布局写像素，不需要再用 Core Graphics 重绘一次：通道重排（RGBA <-> BGRA 等）、预乘和反预乘 alpha、RGB 扩展为 RGBX、判断是否完全不透明。
+ 每个函数都有 SSE2/SSSE3/AVX2（x86）和 NEON（arm64）的实现，其他架构使用标量实现，结果和标量实现完全相同。
+ 像素都是每个通道 8 位，只使用 C，可以在任何平台上编译和测试。
+ */
+
+#ifndef SDWebImagePixelKernels_h
+#define SDWebImagePixelKernels_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Reorder the channels of 4 byte pixels: `dst[k] = src[order[k]]` for each pixel.
+ * For example `{2, 1, 0, 3}` swaps RGBA and BGRA, `{1, 2, 3, 0}` turns ARGB into RGBA.
+ * `src` and `dst` may be the same buffer.
+ */
+void SDPixelSwizzle(const uint8_t *src, uint8_t *dst, size_t pixelCount, const uint8_t order[4]);
+
+/**
+ * Premultiply the color channels by the alpha channel, which is the last byte of each pixel (RGBA or BGRA).
+ * Each channel becomes `round(c * a / 255)`. `src` and `dst` may be the same buffer.
+ */
+void SDPixelPremultiply(const uint8_t *src, uint8_t *dst, size_t pixelCount);
+
+/**
+ * Undo the premultiplication, the alpha channel is the last byte of each pixel.
+ * Each channel becomes `c * 255 / a` rounded to nearest even and clamped to 255, 0 when the pixel is fully transparent.
+ * `src` and `dst` may be the same buffer.
+ */
+void SDPixelUnpremultiply(const uint8_t *src, uint8_t *dst, size_t pixelCount);
+
+/**
+ * Expand 3 byte pixels to 4 byte pixels, the fourth byte is `fill`. The buffers must not overlap.
+ */
+void SDPixelExpandRGBToRGBX(const uint8_t *src, uint8_t *dst, size_t pixelCount, uint8_t fill);
+
+/**
+ * Whether all the pixels are fully opaque
+ *
+ * @param alphaIndex The byte of the alpha channel in each 4 byte pixel, 0 for ARGB and 3 for RGBA
+ */
+bool SDPixelIsOpaque(const uint8_t *pixels, size_t pixelCount, size_t alphaIndex);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SDWebImagePixelKernels_h */
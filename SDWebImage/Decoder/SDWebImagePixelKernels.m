@@ -0,0 +1,317 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#include "SDWebImagePixelKernels.h"
+#include <math.h>
+
+// 按编译目标选择实现，AVX2 和 SSSE3 覆盖不了的剩余像素用更窄的实现或者标量实现处理
+// 定义 SD_PIXEL_SCALAR 为 1 时只使用标量实现，测试用它作为 SIMD 实现的参照
+#if !SD_PIXEL_SCALAR
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SD_PIXEL_AVX2 1
+#endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#define SD_PIXEL_SSSE3 1
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define SD_PIXEL_SSE2 1
+#endif
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define SD_PIXEL_NEON 1
+#endif
+#endif
+
+// round(x / 255) for x <= 255 * 255, without a division
+static inline uint8_t SDPixelDivide255(uint32_t x) {
+    x += 128;
+    return (uint8_t)((x + (x >> 8)) >> 8);
+}
+
+static inline uint8_t SDPixelUnpremultiplyChannel(uint8_t c, float scale) {
+    long value = lrintf((float)c * scale);
+    return value > 255 ? 255 : (uint8_t)value;
+}
+
+#if SD_PIXEL_SSSE3 || SD_PIXEL_NEON
+// The byte shuffle reordering 4 pixels
+static inline void SDPixelSwizzleTable(const uint8_t order[4], uint8_t table[16]) {
+    for (int pixel = 0; pixel < 4; pixel++) {
+        for (int channel = 0; channel < 4; channel++) {
+            table[pixel * 4 + channel] = (uint8_t)(pixel * 4 + (order[channel] & 3));
+        }
+    }
+}
+#endif
+
+#pragma mark - Swizzle
+
+void SDPixelSwizzle(const uint8_t *src, uint8_t *dst, size_t pixelCount, const uint8_t order[4]) {
+    size_t i = 0;
+#if SD_PIXEL_SSSE3 || SD_PIXEL_NEON
+    uint8_t table[16];
+    SDPixelSwizzleTable(order, table);
+#endif
+#if SD_PIXEL_AVX2
+    __m256i mask256 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)table));
+    for (; i + 8 <= pixelCount; i += 8) {
+        __m256i pixels = _mm256_loadu_si256((const __m256i *)(src + i * 4));
+        _mm256_storeu_si256((__m256i *)(dst + i * 4), _mm256_shuffle_epi8(pixels, mask256));
+    }
+#endif
+#if SD_PIXEL_SSSE3
+    __m128i mask = _mm_loadu_si128((const __m128i *)table);
+    for (; i + 4 <= pixelCount; i += 4) {
+        __m128i pixels = _mm_loadu_si128((const __m128i *)(src + i * 4));
+        _mm_storeu_si128((__m128i *)(dst + i * 4), _mm_shuffle_epi8(pixels, mask));
+    }
+#elif SD_PIXEL_NEON
+    uint8x16_t mask = vld1q_u8(table);
+    for (; i + 4 <= pixelCount; i += 4) {
+        vst1q_u8(dst + i * 4, vqtbl1q_u8(vld1q_u8(src + i * 4), mask));
+    }
+#endif
+    const uint8_t o0 = order[0] & 3, o1 = order[1] & 3, o2 = order[2] & 3, o3 = order[3] & 3;
+    for (; i < pixelCount; i++) {
+        const uint8_t *s = src + i * 4;
+        uint8_t c0 = s[o0], c1 = s[o1], c2 = s[o2], c3 = s[o3];
+        uint8_t *d = dst + i * 4;
+        d[0] = c0;
+        d[1] = c1;
+        d[2] = c2;
+        d[3] = c3;
+    }
+}
+
+#pragma mark - Premultiply
+
+#if SD_PIXEL_SSE2
+// Premultiply the 2 pixels widened to 16 bits, the alpha lane is multiplied by 255 so it is kept
+static inline __m128i SDPixelPremultiply2x16(__m128i pixels) {
+    const __m128i alphaLanes = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+    __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(pixels, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    alpha = _mm_or_si128(_mm_andnot_si128(alphaLanes, alpha), _mm_and_si128(alphaLanes, _mm_set1_epi16(255)));
+    __m128i x = _mm_add_epi16(_mm_mullo_epi16(pixels, alpha), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+#endif
+
+#if SD_PIXEL_AVX2
+static inline __m256i SDPixelPremultiply4x16(__m256i pixels) {
+    const __m256i alphaLanes = _mm256_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0);
+    __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(pixels, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    alpha = _mm256_blendv_epi8(alpha, _mm256_set1_epi16(255), alphaLanes);
+    __m256i x = _mm256_add_epi16(_mm256_mullo_epi16(pixels, alpha), _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+#endif
+
+#if SD_PIXEL_NEON
+static inline uint8x16_t SDPixelPremultiplyChannel16(uint8x16_t channel, uint8x16_t alpha) {
+    uint16x8_t low = vmull_u8(vget_low_u8(channel), vget_low_u8(alpha));
+    uint16x8_t high = vmull_high_u8(channel, alpha);
+    // (x + ((x + 128) >> 8) + 128) >> 8, the same rounding as SDPixelDivide255
+    return vcombine_u8(vraddhn_u16(low, vrshrq_n_u16(low, 8)), vraddhn_u16(high, vrshrq_n_u16(high, 8)));
+}
+#endif
+
+void SDPixelPremultiply(const uint8_t *src, uint8_t *dst, size_t pixelCount) {
+    size_t i = 0;
+#if SD_PIXEL_AVX2
+    const __m256i zero256 = _mm256_setzero_si256();
+    for (; i + 8 <= pixelCount; i += 8) {
+        __m256i pixels = _mm256_loadu_si256((const __m256i *)(src + i * 4));
+        __m256i low = SDPixelPremultiply4x16(_mm256_unpacklo_epi8(pixels, zero256));
+        __m256i high = SDPixelPremultiply4x16(_mm256_unpackhi_epi8(pixels, zero256));
+        _mm256_storeu_si256((__m256i *)(dst + i * 4), _mm256_packus_epi16(low, high));
+    }
+#endif
+#if SD_PIXEL_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 4 <= pixelCount; i += 4) {
+        __m128i pixels = _mm_loadu_si128((const __m128i *)(src + i * 4));
+        __m128i low = SDPixelPremultiply2x16(_mm_unpacklo_epi8(pixels, zero));
+        __m128i high = SDPixelPremultiply2x16(_mm_unpackhi_epi8(pixels, zero));
+        _mm_storeu_si128((__m128i *)(dst + i * 4), _mm_packus_epi16(low, high));
+    }
+#elif SD_PIXEL_NEON
+    for (; i + 16 <= pixelCount; i += 16) {
+        uint8x16x4_t pixels = vld4q_u8(src + i * 4);
+        pixels.val[0] = SDPixelPremultiplyChannel16(pixels.val[0], pixels.val[3]);
+        pixels.val[1] = SDPixelPremultiplyChannel16(pixels.val[1], pixels.val[3]);
+        pixels.val[2] = SDPixelPremultiplyChannel16(pixels.val[2], pixels.val[3]);
+        vst4q_u8(dst + i * 4, pixels);
+    }
+#endif
+    for (; i < pixelCount; i++) {
+        const uint8_t *s = src + i * 4;
+        uint8_t *d = dst + i * 4;
+        uint32_t a = s[3];
+        d[0] = SDPixelDivide255(s[0] * a);
+        d[1] = SDPixelDivide255(s[1] * a);
+        d[2] = SDPixelDivide255(s[2] * a);
+        d[3] = (uint8_t)a;
+    }
+}
+
+#pragma mark - Unpremultiply
+
+#if SD_PIXEL_SSE2
+// One pixel as 4 floats, multiplied by 255 / alpha and rounded to nearest even like lrintf
+static inline __m128i SDPixelUnpremultiply1x32(__m128i pixel) {
+    __m128 value = _mm_cvtepi32_ps(pixel);
+    __m128 scale = _mm_div_ps(_mm_set1_ps(255.0f), _mm_shuffle_ps(value, value, _MM_SHUFFLE(3, 3, 3, 3)));
+    return _mm_cvtps_epi32(_mm_mul_ps(value, scale));
+}
+#endif
+
+void SDPixelUnpremultiply(const uint8_t *src, uint8_t *dst, size_t pixelCount) {
+    size_t i = 0;
+#if SD_PIXEL_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alphaBytes = _mm_set1_epi32((int)0xFF000000);
+    for (; i + 4 <= pixelCount; i += 4) {
+        __m128i pixels = _mm_loadu_si128((const __m128i *)(src + i * 4));
+        __m128i low = _mm_unpacklo_epi8(pixels, zero);
+        __m128i high = _mm_unpackhi_epi8(pixels, zero);
+        __m128i p0 = SDPixelUnpremultiply1x32(_mm_unpacklo_epi16(low, zero));
+        __m128i p1 = SDPixelUnpremultiply1x32(_mm_unpackhi_epi16(low, zero));
+        __m128i p2 = SDPixelUnpremultiply1x32(_mm_unpacklo_epi16(high, zero));
+        __m128i p3 = SDPixelUnpremultiply1x32(_mm_unpackhi_epi16(high, zero));
+        // The saturating packs clamp the channels to 255
+        __m128i result = _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3));
+        // Keep the alpha, fully transparent pixels become zero
+        __m128i alpha = _mm_and_si128(pixels, alphaBytes);
+        result = _mm_or_si128(_mm_andnot_si128(alphaBytes, result), alpha);
+        result = _mm_andnot_si128(_mm_cmpeq_epi32(alpha, zero), result);
+        _mm_storeu_si128((__m128i *)(dst + i * 4), result);
+    }
+#elif SD_PIXEL_NEON
+    const uint32x4_t alphaBytes = vdupq_n_u32(0xFF000000);
+    const float32x4_t maxValue = vdupq_n_f32(255.0f);
+    for (; i + 4 <= pixelCount; i += 4) {
+        uint8x16_t pixels = vld1q_u8(src + i * 4);
+        uint16x8_t low = vmovl_u8(vget_low_u8(pixels));
+        uint16x8_t high = vmovl_high_u8(pixels);
+        uint32x4_t channels[4] = {vmovl_u16(vget_low_u16(low)), vmovl_high_u16(low), vmovl_u16(vget_low_u16(high)), vmovl_high_u16(high)};
+        uint16x4_t narrowed[4];
+        for (int p = 0; p < 4; p++) {
+            float32x4_t value = vcvtq_f32_u32(channels[p]);
+            float32x4_t scale = vdivq_f32(maxValue, vdupq_laneq_f32(value, 3));
+            narrowed[p] = vqmovn_u32(vcvtnq_u32_f32(vmulq_f32(value, scale)));
+        }
+        uint8x16_t packed = vcombine_u8(vqmovn_u16(vcombine_u16(narrowed[0], narrowed[1])), vqmovn_u16(vcombine_u16(narrowed[2], narrowed[3])));
+        uint32x4_t source = vreinterpretq_u32_u8(pixels);
+        uint32x4_t alpha = vandq_u32(source, alphaBytes);
+        uint32x4_t result = vbslq_u32(alphaBytes, source, vreinterpretq_u32_u8(packed));
+        result = vbicq_u32(result, vceqq_u32(alpha, vdupq_n_u32(0)));
+        vst1q_u8(dst + i * 4, vreinterpretq_u8_u32(result));
+    }
+#endif
+    for (; i < pixelCount; i++) {
+        const uint8_t *s = src + i * 4;
+        uint8_t *d = dst + i * 4;
+        uint8_t a = s[3];
+        if (a == 0) {
+            d[0] = d[1] = d[2] = d[3] = 0;
+            continue;
+        }
+        float scale = 255.0f / (float)a;
+        d[0] = SDPixelUnpremultiplyChannel(s[0], scale);
+        d[1] = SDPixelUnpremultiplyChannel(s[1], scale);
+        d[2] = SDPixelUnpremultiplyChannel(s[2], scale);
+        d[3] = a;
+    }
+}
+
+#pragma mark - Expand
+
+void SDPixelExpandRGBToRGBX(const uint8_t *src, uint8_t *dst, size_t pixelCount, uint8_t fill) {
+    size_t i = 0;
+#if SD_PIXEL_SSSE3
+    const __m128i mask = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i fillBytes = _mm_set1_epi32((int)((uint32_t)fill << 24));
+    // Each load reads 16 bytes for 4 pixels, stop while 16 bytes are still available
+    for (; i + 6 <= pixelCount; i += 4) {
+        __m128i pixels = _mm_loadu_si128((const __m128i *)(src + i * 3));
+        _mm_storeu_si128((__m128i *)(dst + i * 4), _mm_or_si128(_mm_shuffle_epi8(pixels, mask), fillBytes));
+    }
+#elif SD_PIXEL_NEON
+    for (; i + 16 <= pixelCount; i += 16) {
+        uint8x16x3_t pixels = vld3q_u8(src + i * 3);
+        uint8x16x4_t expanded = {{pixels.val[0], pixels.val[1], pixels.val[2], vdupq_n_u8(fill)}};
+        vst4q_u8(dst + i * 4, expanded);
+    }
+#endif
+    for (; i < pixelCount; i++) {
+        const uint8_t *s = src + i * 3;
+        uint8_t *d = dst + i * 4;
+        d[0] = s[0];
+        d[1] = s[1];
+        d[2] = s[2];
+        d[3] = fill;
+    }
+}
+
+#pragma mark - Alpha
+
+bool SDPixelIsOpaque(const uint8_t *pixels, size_t pixelCount, size_t alphaIndex) {
+    alphaIndex &= 3;
+    size_t i = 0;
+    // 每一块检查一次，有透明像素的图片很快返回
+    const size_t blockLength = 1024;
+#if SD_PIXEL_AVX2 || SD_PIXEL_SSE2 || SD_PIXEL_NEON
+    const uint32_t alphaMask = 0xFFu << (8 * alphaIndex);
+#endif
+    while (i + blockLength <= pixelCount) {
+        size_t end = i + blockLength;
+#if SD_PIXEL_AVX2
+        __m256i accumulator = _mm256_set1_epi32(-1);
+        for (; i < end; i += 8) {
+            accumulator = _mm256_and_si256(accumulator, _mm256_loadu_si256((const __m256i *)(pixels + i * 4)));
+        }
+        __m256i mask = _mm256_set1_epi32((int)alphaMask);
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_and_si256(accumulator, mask), mask)) != -1) {
+            return false;
+        }
+#elif SD_PIXEL_SSE2
+        __m128i accumulator = _mm_set1_epi32(-1);
+        for (; i < end; i += 4) {
+            accumulator = _mm_and_si128(accumulator, _mm_loadu_si128((const __m128i *)(pixels + i * 4)));
+        }
+        __m128i mask = _mm_set1_epi32((int)alphaMask);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(accumulator, mask), mask)) != 0xFFFF) {
+            return false;
+        }
+#elif SD_PIXEL_NEON
+        uint32x4_t accumulator = vdupq_n_u32(0xFFFFFFFF);
+        for (; i < end; i += 4) {
+            accumulator = vandq_u32(accumulator, vreinterpretq_u32_u8(vld1q_u8(pixels + i * 4)));
+        }
+        uint32x4_t mask = vdupq_n_u32(alphaMask);
+        if (vminvq_u32(vceqq_u32(vandq_u32(accumulator, mask), mask)) == 0) {
+            return false;
+        }
+#else
+        for (; i < end; i++) {
+            if (pixels[i * 4 + alphaIndex] != 0xFF) {
+                return false;
+            }
+        }
+#endif
+    }
+    for (; i < pixelCount; i++) {
+        if (pixels[i * 4 + alphaIndex] != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
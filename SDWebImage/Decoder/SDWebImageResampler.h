@@ -0,0 +1,74 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+/*
+ 图片缩放
+
+ 可分离的高质量缩放（Mitchell 或 Lanczos），先水平缩放再垂直缩放。
+ 目标图片按行分成互相独立的水平条带，每个条带只读取它的滤波器覆盖的源图片行（相邻条带读取的行有重叠），
+ 所以各条带可以同时在不同的线程上处理，拼接处没有接缝，结果和整张图片作为一个条带处理完全相同。
+ 系数使用定点整数，只使用 C 标准库。
+ */
+
+#ifndef SDWebImageResampler_h
+#define SDWebImageResampler_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct SDImageResampler SDImageResampler;
+
+typedef enum SDImageResampleFilter {
+    // Mitchell-Netravali with B = C = 1/3, radius 2
+    SDImageResampleFilterMitchell = 0,
+    // Lanczos with 3 lobes, sharper but may ring around hard edges
+    SDImageResampleFilterLanczos3 = 1
+} SDImageResampleFilter;
+
+/**
+ * Prepare the filter coefficients to resample an image. The resampler is not modified afterwards,
+ * the bands can be processed concurrently.
+ *
+ * @param bandHeight The number of destination rows of each band, the last band may have fewer rows
+ * @return The resampler, or NULL if a size is 0 or the memory can not be allocated
+ */
+SDImageResampler *SDImageResamplerCreate(size_t srcWidth, size_t srcHeight, size_t dstWidth, size_t dstHeight, SDImageResampleFilter filter, size_t bandHeight);
+
+void SDImageResamplerRelease(SDImageResampler *resampler);
+
+size_t SDImageResamplerGetBandCount(const SDImageResampler *resampler);
+
+/**
+ * The destination rows written by a band
+ */
+void SDImageResamplerGetBandDestinationRows(const SDImageResampler *resampler, size_t band, size_t *firstRow, size_t *rowCount);
+
+/**
+ * The source rows read by a band, including the rows shared with the neighbouring bands
+ */
+void SDImageResamplerGetBandSourceRows(const SDImageResampler *resampler, size_t band, size_t *firstRow, size_t *rowCount);
+
+/**
+ * Resample a band. The pixels have 4 channels of 8 bits, filtered the same way, so the alpha should be premultiplied.
+ *
+ * @param src The first source row of the band, see `SDImageResamplerGetBandSourceRows`
+ * @param dst The first destination row of the band, see `SDImageResamplerGetBandDestinationRows`
+ * @return false if the memory can not be allocated
+ */
+bool SDImageResamplerProcessBand(const SDImageResampler *resampler, size_t band, const uint8_t *src, size_t srcBytesPerRow, uint8_t *dst, size_t dstBytesPerRow);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SDWebImageResampler_h */
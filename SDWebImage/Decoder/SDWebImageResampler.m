@@ -0,0 +1,272 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#include "SDWebImageResampler.h"
+#include <math.h>
+#include <stdlib.h>
+
+// 系数的定点精度
+#define SD_RESAMPLE_PRECISION_BITS 14
+
+// The source pixels contributing to a destination pixel, with their coefficients at `offset`
+typedef struct SDImageResampleContribution {
+    size_t first;
+    size_t count;
+    size_t offset;
+} SDImageResampleContribution;
+
+struct SDImageResampler {
+    size_t srcWidth;
+    size_t srcHeight;
+    size_t dstWidth;
+    size_t dstHeight;
+    size_t bandHeight;
+    size_t bandCount;
+    SDImageResampleContribution *horizontal;
+    int32_t *horizontalCoefficients;
+    SDImageResampleContribution *vertical;
+    int32_t *verticalCoefficients;
+};
+
+#pragma mark - Filters
+
+static double SDImageResampleMitchell(double x) {
+    const double B = 1.0 / 3.0;
+    const double C = 1.0 / 3.0;
+    x = fabs(x);
+    if (x < 1.0) {
+        return ((12.0 - 9.0 * B - 6.0 * C) * x * x * x + (-18.0 + 12.0 * B + 6.0 * C) * x * x + (6.0 - 2.0 * B)) / 6.0;
+    }
+    if (x < 2.0) {
+        return ((-B - 6.0 * C) * x * x * x + (6.0 * B + 30.0 * C) * x * x + (-12.0 * B - 48.0 * C) * x + (8.0 * B + 24.0 * C)) / 6.0;
+    }
+    return 0.0;
+}
+
+static double SDImageResampleSinc(double x) {
+    if (x == 0.0) {
+        return 1.0;
+    }
+    x *= M_PI;
+    return sin(x) / x;
+}
+
+static double SDImageResampleLanczos3(double x) {
+    if (fabs(x) >= 3.0) {
+        return 0.0;
+    }
+    return SDImageResampleSinc(x) * SDImageResampleSinc(x / 3.0);
+}
+
+// Compute the contributions of one dimension, the window is cut at the edges of the image and the coefficients normalized
+static bool SDImageResampleComputeContributions(size_t srcSize, size_t dstSize, SDImageResampleFilter filter,
+                                                SDImageResampleContribution **outContributions, int32_t **outCoefficients) {
+    double (*kernel)(double) = filter == SDImageResampleFilterLanczos3 ? SDImageResampleLanczos3 : SDImageResampleMitchell;
+    double radius = filter == SDImageResampleFilterLanczos3 ? 3.0 : 2.0;
+    double scale = (double)srcSize / dstSize;
+    // 缩小时滤波器按比例放大，覆盖更多的源像素
+    double filterScale = scale > 1.0 ? scale : 1.0;
+    double support = radius * filterScale;
+    size_t maxCount = (size_t)ceil(support) * 2 + 1;
+
+    SDImageResampleContribution *contributions = malloc(dstSize * sizeof(SDImageResampleContribution));
+    int32_t *coefficients = malloc(dstSize * maxCount * sizeof(int32_t));
+    double *weights = malloc(maxCount * sizeof(double));
+    if (!contributions || !coefficients || !weights) {
+        free(contributions);
+        free(coefficients);
+        free(weights);
+        return false;
+    }
+    for (size_t i = 0; i < dstSize; i++) {
+        double center = (i + 0.5) * scale;
+        double left = center - support + 0.5;
+        double right = center + support + 0.5;
+        size_t first = left > 0.0 ? (size_t)left : 0;
+        size_t end = right < (double)srcSize ? (size_t)right : srcSize;
+        if (end > first + maxCount) {
+            end = first + maxCount;
+        }
+        if (end <= first) {
+            // 窗口落在图片外面时使用最近的像素
+            first = center < (double)srcSize ? (size_t)center : srcSize - 1;
+            end = first + 1;
+        }
+        size_t count = end - first;
+        double sum = 0.0;
+        for (size_t k = 0; k < count; k++) {
+            double weight = kernel((first + k - center + 0.5) / filterScale);
+            weights[k] = weight;
+            sum += weight;
+        }
+        // 对累加的权重取整，每个系数是相邻两次取整的差，系数的和正好是 1 << SD_RESAMPLE_PRECISION_BITS。
+        // 分别对每个系数取整时误差随系数的个数累积，大幅缩小时单色的图片也会改变颜色
+        int32_t *coefficient = coefficients + i * maxCount;
+        double total = 0.0;
+        int32_t previous = 0;
+        for (size_t k = 0; k < count; k++) {
+            total += sum != 0.0 ? weights[k] / sum : (k == 0 ? 1.0 : 0.0);
+            int32_t current = (int32_t)lround(total * (1 << SD_RESAMPLE_PRECISION_BITS));
+            coefficient[k] = current - previous;
+            previous = current;
+        }
+        coefficient[count - 1] += (1 << SD_RESAMPLE_PRECISION_BITS) - previous;
+        contributions[i].first = first;
+        contributions[i].count = count;
+        contributions[i].offset = i * maxCount;
+    }
+    free(weights);
+    *outContributions = contributions;
+    *outCoefficients = coefficients;
+    return true;
+}
+
+static inline uint8_t SDImageResampleClamp(int32_t value) {
+    if (value < 0) {
+        return 0;
+    }
+    value >>= SD_RESAMPLE_PRECISION_BITS;
+    return value > 255 ? 255 : (uint8_t)value;
+}
+
+#pragma mark - Resampler
+
+SDImageResampler *SDImageResamplerCreate(size_t srcWidth, size_t srcHeight, size_t dstWidth, size_t dstHeight, SDImageResampleFilter filter, size_t bandHeight) {
+    if (srcWidth == 0 || srcHeight == 0 || dstWidth == 0 || dstHeight == 0) {
+        return NULL;
+    }
+    SDImageResampler *resampler = calloc(1, sizeof(SDImageResampler));
+    if (!resampler) {
+        return NULL;
+    }
+    resampler->srcWidth = srcWidth;
+    resampler->srcHeight = srcHeight;
+    resampler->dstWidth = dstWidth;
+    resampler->dstHeight = dstHeight;
+    resampler->bandHeight = bandHeight == 0 || bandHeight > dstHeight ? dstHeight : bandHeight;
+    resampler->bandCount = (dstHeight + resampler->bandHeight - 1) / resampler->bandHeight;
+    if (!SDImageResampleComputeContributions(srcWidth, dstWidth, filter, &resampler->horizontal, &resampler->horizontalCoefficients) ||
+        !SDImageResampleComputeContributions(srcHeight, dstHeight, filter, &resampler->vertical, &resampler->verticalCoefficients)) {
+        SDImageResamplerRelease(resampler);
+        return NULL;
+    }
+    return resampler;
+}
+
+void SDImageResamplerRelease(SDImageResampler *resampler) {
+    if (!resampler) {
+        return;
+    }
+    free(resampler->horizontal);
+    free(resampler->horizontalCoefficients);
+    free(resampler->vertical);
+    free(resampler->verticalCoefficients);
+    free(resampler);
+}
+
+size_t SDImageResamplerGetBandCount(const SDImageResampler *resampler) {
+    return resampler ? resampler->bandCount : 0;
+}
+
+void SDImageResamplerGetBandDestinationRows(const SDImageResampler *resampler, size_t band, size_t *firstRow, size_t *rowCount) {
+    size_t first = band * resampler->bandHeight;
+    size_t end = first + resampler->bandHeight;
+    if (end > resampler->dstHeight) {
+        end = resampler->dstHeight;
+    }
+    *firstRow = first;
+    *rowCount = end > first ? end - first : 0;
+}
+
+void SDImageResamplerGetBandSourceRows(const SDImageResampler *resampler, size_t band, size_t *firstRow, size_t *rowCount) {
+    size_t dstFirst, dstCount;
+    SDImageResamplerGetBandDestinationRows(resampler, band, &dstFirst, &dstCount);
+    if (dstCount == 0) {
+        *firstRow = 0;
+        *rowCount = 0;
+        return;
+    }
+    size_t first = SIZE_MAX;
+    size_t end = 0;
+    for (size_t y = dstFirst; y < dstFirst + dstCount; y++) {
+        const SDImageResampleContribution *contribution = &resampler->vertical[y];
+        if (contribution->first < first) {
+            first = contribution->first;
+        }
+        if (contribution->first + contribution->count > end) {
+            end = contribution->first + contribution->count;
+        }
+    }
+    *firstRow = first;
+    *rowCount = end - first;
+}
+
+bool SDImageResamplerProcessBand(const SDImageResampler *resampler, size_t band, const uint8_t *src, size_t srcBytesPerRow, uint8_t *dst, size_t dstBytesPerRow) {
+    size_t dstFirst, dstCount, srcFirst, srcCount;
+    SDImageResamplerGetBandDestinationRows(resampler, band, &dstFirst, &dstCount);
+    SDImageResamplerGetBandSourceRows(resampler, band, &srcFirst, &srcCount);
+    if (dstCount == 0) {
+        return true;
+    }
+    size_t dstWidth = resampler->dstWidth;
+    size_t rowLength = dstWidth * 4;
+    // 水平缩放后的源图片行，和一行目标像素的累加值
+    uint8_t *rows = malloc(srcCount * rowLength);
+    int32_t *sums = malloc(rowLength * sizeof(int32_t));
+    if (!rows || !sums) {
+        free(rows);
+        free(sums);
+        return false;
+    }
+
+    const int32_t rounding = 1 << (SD_RESAMPLE_PRECISION_BITS - 1);
+    for (size_t y = 0; y < srcCount; y++) {
+        const uint8_t *srcRow = src + y * srcBytesPerRow;
+        uint8_t *row = rows + y * rowLength;
+        for (size_t x = 0; x < dstWidth; x++) {
+            const SDImageResampleContribution *contribution = &resampler->horizontal[x];
+            const int32_t *coefficient = resampler->horizontalCoefficients + contribution->offset;
+            const uint8_t *pixel = srcRow + contribution->first * 4;
+            int32_t c0 = rounding, c1 = rounding, c2 = rounding, c3 = rounding;
+            for (size_t k = 0; k < contribution->count; k++) {
+                int32_t weight = coefficient[k];
+                c0 += pixel[k * 4] * weight;
+                c1 += pixel[k * 4 + 1] * weight;
+                c2 += pixel[k * 4 + 2] * weight;
+                c3 += pixel[k * 4 + 3] * weight;
+            }
+            row[x * 4] = SDImageResampleClamp(c0);
+            row[x * 4 + 1] = SDImageResampleClamp(c1);
+            row[x * 4 + 2] = SDImageResampleClamp(c2);
+            row[x * 4 + 3] = SDImageResampleClamp(c3);
+        }
+    }
+
+    for (size_t y = 0; y < dstCount; y++) {
+        const SDImageResampleContribution *contribution = &resampler->vertical[dstFirst + y];
+        const int32_t *coefficient = resampler->verticalCoefficients + contribution->offset;
+        for (size_t i = 0; i < rowLength; i++) {
+            sums[i] = rounding;
+        }
+        for (size_t k = 0; k < contribution->count; k++) {
+            const uint8_t *row = rows + (contribution->first - srcFirst + k) * rowLength;
+            int32_t weight = coefficient[k];
+            for (size_t i = 0; i < rowLength; i++) {
+                sums[i] += row[i] * weight;
+            }
+        }
+        uint8_t *dstRow = dst + y * dstBytesPerRow;
+        for (size_t i = 0; i < rowLength; i++) {
+            dstRow[i] = SDImageResampleClamp(sums[i]);
+        }
+    }
+
+    free(rows);
+    free(sums);
+    return true;
+}
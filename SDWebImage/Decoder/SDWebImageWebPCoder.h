@@ -18,6 +18,13 @@
 
 + (nonnull instancetype)sharedCoder;
 
+/**
+ * Decode animated WebP as a `SDWebImageAnimatedImage`, which keeps the demuxer and decodes the frames on demand, instead of decoding all the frames at once.
+ * The animated image only animates in a `SDWebImageAnimatedImageView`, a plain image view shows the first frame. Defaults to NO.
+ * 动图只保存解码器，显示时才解码每一帧，需要用 SDWebImageAnimatedImageView 播放
+ */
+@property (nonatomic, assign) BOOL decodesAnimatedImagesOnDemand;
+
 @end
 
 #endif
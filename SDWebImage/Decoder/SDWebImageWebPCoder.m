@@ -10,8 +10,10 @@
 
 #import "SDWebImageWebPCoder.h"
 #import "SDWebImageCoderHelper.h"
+#import "SDWebImageAnimatedImage.h"
 #import "NSImage+WebCache.h"
 #import "UIImage+MultiFormat.h"
+#import "SDWebImagePixelKernels.h"
 #if __has_include(<webp/decode.h>) && __has_include(<webp/encode.h>) && __has_include(<webp/demux.h>) && __has_include(<webp/mux.h>)
 #import <webp/decode.h>
 #import <webp/encode.h>
@@ -24,8 +26,32 @@
 #import "webp/mux.h"
 #endif
 
+// The rect of a frame in the Core Graphics coordinate system of the canvas
+static inline CGRect SDWebPFrameRectInCanvas(size_t canvasHeight, int x, int y, int width, int height) {
+    return CGRectMake(x, (CGFloat)canvasHeight - height - y, width, height);
+}
+
+@interface SDWebImageWebPCoder ()
+
+- (nullable UIImage *)sd_rawWebpImageWithData:(WebPData)webpData;
+- (nullable UIImage *)sd_rawWebpImageWithData:(WebPData)webpData maxPixelSize:(NSUInteger)maxPixelSize;
+- (BOOL)sd_drawWebpFrameWithCanvas:(nonnull CGContextRef)canvas iterator:(WebPIterator)iter;
+
+@end
+
+/**
+ Decode the frames of an animated WebP on demand, the demuxer only indexes the frames of the data without decoding them
+ */
+@interface SDWebImageWebPFrameSource : NSObject <SDWebImageAnimatedImageFrameSource>
+
+- (nullable instancetype)initWithData:(nonnull NSData *)data coder:(nonnull SDWebImageWebPCoder *)coder;
+
+@end
+
 @implementation SDWebImageWebPCoder {
     WebPIDecoder *_idec;
+    // 最近一次 WebPIAppend 的结果
+    VP8StatusCode _incrementalStatus;
 }
 
 - (void)dealloc {
@@ -53,6 +79,26 @@
     return ([NSData sd_imageFormatForImageData:data] == SDImageFormatWebP);
 }
 
+- (UIImage *)decodedImageWithData:(NSData *)data options:(nullable NSDictionary<NSString*, NSObject*>*)optionsDict {
+    if (!data) {
+        return nil;
+    }
+    WebPBitstreamFeatures features;
+    if (WebPGetFeatures(data.bytes, data.length, &features) != VP8_STATUS_OK) {
+        return nil;
+    }
+    NSUInteger maxPixelSize = SDImageDecodeMaxPixelSize(features.width, features.height, optionsDict);
+    // 动图还是按原始大小解码
+    if (maxPixelSize == 0 || features.has_animation) {
+        return [self decodedImageWithData:data];
+    }
+    WebPData webpData;
+    WebPDataInit(&webpData);
+    webpData.bytes = data.bytes;
+    webpData.size = data.length;
+    return [self sd_rawWebpImageWithData:webpData maxPixelSize:maxPixelSize];
+}
+
 - (UIImage *)decodedImageWithData:(NSData *)data {
     if (!data) {
         return nil;
@@ -68,6 +114,15 @@
     }
     
     uint32_t flags = WebPDemuxGetI(demuxer, WEBP_FF_FORMAT_FLAGS);
+    if ((flags & ANIMATION_FLAG) && self.decodesAnimatedImagesOnDemand) {
+        // 只保存解码器，每一帧在显示时才解码
+        SDWebImageWebPFrameSource *frameSource = [[SDWebImageWebPFrameSource alloc] initWithData:data coder:self];
+        UIImage *animatedImage = frameSource ? [[SDWebImageAnimatedImage alloc] initWithFrameSource:frameSource] : nil;
+        if (animatedImage) {
+            WebPDemuxDelete(demuxer);
+            return animatedImage;
+        }
+    }
     int loopCount = WebPDemuxGetI(demuxer, WEBP_FF_LOOP_COUNT);
     int canvasWidth = WebPDemuxGetI(demuxer, WEBP_FF_CANVAS_WIDTH);
     int canvasHeight = WebPDemuxGetI(demuxer, WEBP_FF_CANVAS_HEIGHT);
@@ -154,13 +209,46 @@
         }
     }
     
-    UIImage *image;
-    
     VP8StatusCode status = WebPIUpdate(_idec, data.bytes, data.length);
     if (status != VP8_STATUS_OK && status != VP8_STATUS_SUSPENDED) {
         return nil;
     }
     
+    return [self sd_incrementallyDecodedImageFinished:finished];
+}
+
+- (void)appendIncrementalData:(nonnull NSData *)data {
+    if (!_idec) {
+        // Progressive images need transparent, so always use premultiplied RGBA
+        _idec = WebPINewRGB(MODE_rgbA, NULL, 0, 0);
+        if (!_idec) {
+            _incrementalStatus = VP8_STATUS_OUT_OF_MEMORY;
+            return;
+        }
+    }
+    if (_incrementalStatus != VP8_STATUS_OK && _incrementalStatus != VP8_STATUS_SUSPENDED) {
+        return;
+    }
+    // WebPIAppend only takes the new bytes and decodes them right away, unlike WebPIUpdate which needs all the data so far
+    [data enumerateByteRangesUsingBlock:^(const void *bytes, NSRange byteRange, BOOL *stop) {
+        self->_incrementalStatus = WebPIAppend(self->_idec, bytes, byteRange.length);
+        if (self->_incrementalStatus != VP8_STATUS_OK && self->_incrementalStatus != VP8_STATUS_SUSPENDED) {
+            *stop = YES;
+        }
+    }];
+}
+
+- (UIImage *)incrementallyDecodedImageWithFinished:(BOOL)finished {
+    if (!_idec || (_incrementalStatus != VP8_STATUS_OK && _incrementalStatus != VP8_STATUS_SUSPENDED)) {
+        return nil;
+    }
+    return [self sd_incrementallyDecodedImageFinished:finished];
+}
+
+// Create the partial image from the rows decoded so far
+- (UIImage *)sd_incrementallyDecodedImageFinished:(BOOL)finished {
+    UIImage *image;
+    
     int width = 0;
     int height = 0;
     int last_y = 0;
@@ -233,42 +321,50 @@
 }
 
 - (nullable UIImage *)sd_drawnWebpImageWithCanvas:(CGContextRef)canvas iterator:(WebPIterator)iter {
-    UIImage *image = [self sd_rawWebpImageWithData:iter.fragment];
-    if (!image) {
+    if (![self sd_drawWebpFrameWithCanvas:canvas iterator:iter]) {
         return nil;
     }
     
-    size_t canvasWidth = CGBitmapContextGetWidth(canvas);
-    size_t canvasHeight = CGBitmapContextGetHeight(canvas);
-    CGSize size = CGSizeMake(canvasWidth, canvasHeight);
-    CGFloat tmpX = iter.x_offset;
-    CGFloat tmpY = size.height - iter.height - iter.y_offset;
-    CGRect imageRect = CGRectMake(tmpX, tmpY, iter.width, iter.height);
-    BOOL shouldBlend = iter.blend_method == WEBP_MUX_BLEND;
-    
-    // If not blend, cover the target image rect. (firstly clear then draw)
-    if (!shouldBlend) {
-        CGContextClearRect(canvas, imageRect);
-    }
-    CGContextDrawImage(canvas, imageRect, image.CGImage);
     CGImageRef newImageRef = CGBitmapContextCreateImage(canvas);
     
 #if SD_UIKIT || SD_WATCH
-    image = [UIImage imageWithCGImage:newImageRef];
+    UIImage *image = [UIImage imageWithCGImage:newImageRef];
 #elif SD_MAC
-    image = [[UIImage alloc] initWithCGImage:newImageRef size:NSZeroSize];
+    UIImage *image = [[UIImage alloc] initWithCGImage:newImageRef size:NSZeroSize];
 #endif
     
     CGImageRelease(newImageRef);
     
     if (iter.dispose_method == WEBP_MUX_DISPOSE_BACKGROUND) {
-        CGContextClearRect(canvas, imageRect);
+        CGContextClearRect(canvas, SDWebPFrameRectInCanvas(CGBitmapContextGetHeight(canvas), iter.x_offset, iter.y_offset, iter.width, iter.height));
     }
     
     return image;
 }
 
+// Draw a frame onto the canvas following its blend method, the dispose method is left to the caller
+- (BOOL)sd_drawWebpFrameWithCanvas:(CGContextRef)canvas iterator:(WebPIterator)iter {
+    UIImage *image = [self sd_rawWebpImageWithData:iter.fragment];
+    if (!image) {
+        return NO;
+    }
+    
+    CGRect imageRect = SDWebPFrameRectInCanvas(CGBitmapContextGetHeight(canvas), iter.x_offset, iter.y_offset, iter.width, iter.height);
+    BOOL shouldBlend = iter.blend_method == WEBP_MUX_BLEND;
+    
+    // If not blend, cover the target image rect. (firstly clear then draw)
+    if (!shouldBlend) {
+        CGContextClearRect(canvas, imageRect);
+    }
+    CGContextDrawImage(canvas, imageRect, image.CGImage);
+    return YES;
+}
+
 - (nullable UIImage *)sd_rawWebpImageWithData:(WebPData)webpData {
+    return [self sd_rawWebpImageWithData:webpData maxPixelSize:0];
+}
+
+- (nullable UIImage *)sd_rawWebpImageWithData:(WebPData)webpData maxPixelSize:(NSUInteger)maxPixelSize {
     WebPDecoderConfig config;
     if (!WebPInitDecoderConfig(&config)) {
         return nil;
@@ -278,7 +374,17 @@
         return nil;
     }
     
-    config.output.colorspace = config.input.has_alpha ? MODE_rgbA : MODE_RGB;
+    int largerSide = MAX(config.input.width, config.input.height);
+    if (maxPixelSize > 0 && (NSUInteger)largerSide > maxPixelSize) {
+        // libwebp 解码时直接缩放，不会生成原始大小的位图
+        double scale = (double)maxPixelSize / largerSide;
+        config.options.use_scaling = 1;
+        config.options.scaled_width = MAX((int)round(config.input.width * scale), 1);
+        config.options.scaled_height = MAX((int)round(config.input.height * scale), 1);
+    }
+    
+    // 没有 alpha 的图片也解码成 4 字节的像素，Core Graphics 不需要再转换一次
+    config.output.colorspace = config.input.has_alpha ? MODE_rgbA : MODE_RGBA;
     config.options.use_threads = 1;
     
     // Decode the WebP image data into a RGBA value array
@@ -297,10 +403,12 @@
     CGDataProviderRef provider =
     CGDataProviderCreateWithData(NULL, config.output.u.RGBA.rgba, config.output.u.RGBA.size, FreeImageData);
     CGColorSpaceRef colorSpaceRef = SDCGColorSpaceGetDeviceRGB();
-    CGBitmapInfo bitmapInfo = config.input.has_alpha ? kCGBitmapByteOrder32Big | kCGImageAlphaPremultipliedLast : kCGBitmapByteOrder32Big | kCGImageAlphaNoneSkipLast;
-    size_t components = config.input.has_alpha ? 4 : 3;
+    // 有 alpha 通道但是完全不透明的图片按不透明处理，显示时不需要混合
+    BOOL hasAlpha = config.input.has_alpha && !SDPixelIsOpaque(config.output.u.RGBA.rgba, (size_t)width * height, 3);
+    CGBitmapInfo bitmapInfo = hasAlpha ? kCGBitmapByteOrder32Big | kCGImageAlphaPremultipliedLast : kCGBitmapByteOrder32Big | kCGImageAlphaNoneSkipLast;
+    size_t components = 4;
     CGColorRenderingIntent renderingIntent = kCGRenderingIntentDefault;
-    CGImageRef imageRef = CGImageCreate(width, height, 8, components * 8, components * width, colorSpaceRef, bitmapInfo, provider, NULL, NO, renderingIntent);
+    CGImageRef imageRef = CGImageCreate(width, height, 8, components * 8, config.output.u.RGBA.stride, colorSpaceRef, bitmapInfo, provider, NULL, NO, renderingIntent);
     
     CGDataProviderRelease(provider);
     
@@ -326,6 +434,14 @@
     
     NSData *data;
     
+    if ([image isKindOfClass:[SDWebImageAnimatedImage class]]) {
+        // 按需解码的动图直接使用原始数据
+        id<SDWebImageAnimatedImageFrameSource> frameSource = ((SDWebImageAnimatedImage *)image).frameSource;
+        if (frameSource.animatedImageFormat == SDImageFormatWebP) {
+            return frameSource.animatedImageData;
+        }
+    }
+    
     NSArray<SDWebImageFrame *> *frames = [SDWebImageCoderHelper framesFromAnimatedImage:image];
     if (frames.count == 0) {
         // for static single webp image
@@ -392,15 +508,16 @@
         return nil;
     }
     
-    size_t bytesPerRow = CGImageGetBytesPerRow(imageRef);
-    CGDataProviderRef dataProvider = CGImageGetDataProvider(imageRef);
-    CFDataRef dataRef = CGDataProviderCopyData(dataProvider);
-    uint8_t *rgba = (uint8_t *)CFDataGetBytePtr(dataRef);
+    // WebPEncodeRGBA 需要非预乘的 RGBA，CGImage 可能是 BGRA、预乘或者没有 alpha 通道
+    uint8_t *rgba = SDCreateStraightRGBAPixels(imageRef, width, height);
+    if (!rgba) {
+        return nil;
+    }
     
     uint8_t *data = NULL;
     float quality = 100.0;
-    size_t size = WebPEncodeRGBA(rgba, (int)width, (int)height, (int)bytesPerRow, quality, &data);
-    CFRelease(dataRef);
+    size_t size = WebPEncodeRGBA(rgba, (int)width, (int)height, (int)(width * 4), quality, &data);
+    free(rgba);
     rgba = NULL;
     
     if (size) {
@@ -418,6 +535,272 @@ static void FreeImageData(void *info, const void *data, size_t size) {
     free((void *)data);
 }
 
+// 8 位 RGB 的像素直接转换，其他格式先绘制到预乘的 RGBA 画布上
+static uint8_t *SDCreateStraightRGBAPixels(CGImageRef imageRef, size_t width, size_t height) {
+    uint8_t *rgba = malloc(width * height * 4);
+    if (!rgba) {
+        return NULL;
+    }
+    CGBitmapInfo bitmapInfo = CGImageGetBitmapInfo(imageRef);
+    CGImageAlphaInfo alphaInfo = bitmapInfo & kCGBitmapAlphaInfoMask;
+    CGBitmapInfo byteOrder = bitmapInfo & kCGBitmapByteOrderMask;
+    size_t bitsPerPixel = CGImageGetBitsPerPixel(imageRef);
+    BOOL isBigEndian = byteOrder == kCGBitmapByteOrderDefault || byteOrder == kCGBitmapByteOrder32Big;
+    BOOL isConvertible = CGImageGetBitsPerComponent(imageRef) == 8
+    && !(bitmapInfo & kCGBitmapFloatComponents)
+    && CGColorSpaceGetModel(CGImageGetColorSpace(imageRef)) == kCGColorSpaceModelRGB
+    && ((bitsPerPixel == 32 && alphaInfo != kCGImageAlphaNone && alphaInfo != kCGImageAlphaOnly && (isBigEndian || byteOrder == kCGBitmapByteOrder32Little))
+        || (bitsPerPixel == 24 && alphaInfo == kCGImageAlphaNone && isBigEndian));
+    
+    BOOL converted = NO;
+    CFDataRef dataRef = isConvertible ? CGDataProviderCopyData(CGImageGetDataProvider(imageRef)) : NULL;
+    if (dataRef) {
+        const uint8_t *bytes = CFDataGetBytePtr(dataRef);
+        size_t bytesPerRow = CGImageGetBytesPerRow(imageRef);
+        if ((size_t)CFDataGetLength(dataRef) >= bytesPerRow * (height - 1) + width * bitsPerPixel / 8) {
+            BOOL alphaFirst = alphaInfo == kCGImageAlphaFirst || alphaInfo == kCGImageAlphaPremultipliedFirst || alphaInfo == kCGImageAlphaNoneSkipFirst;
+            BOOL premultiplied = alphaInfo == kCGImageAlphaPremultipliedLast || alphaInfo == kCGImageAlphaPremultipliedFirst;
+            BOOL skipAlpha = alphaInfo == kCGImageAlphaNoneSkipLast || alphaInfo == kCGImageAlphaNoneSkipFirst;
+            // 内存中的字节顺序：RGBA、ARGB、ABGR 或者 BGRA
+            static const uint8_t fromRGBA[4] = {0, 1, 2, 3};
+            static const uint8_t fromARGB[4] = {1, 2, 3, 0};
+            static const uint8_t fromABGR[4] = {3, 2, 1, 0};
+            static const uint8_t fromBGRA[4] = {2, 1, 0, 3};
+            const uint8_t *order = isBigEndian ? (alphaFirst ? fromARGB : fromRGBA) : (alphaFirst ? fromBGRA : fromABGR);
+            for (size_t y = 0; y < height; y++) {
+                const uint8_t *src = bytes + y * bytesPerRow;
+                uint8_t *dst = rgba + y * width * 4;
+                if (bitsPerPixel == 24) {
+                    SDPixelExpandRGBToRGBX(src, dst, width, 0xFF);
+                    continue;
+                }
+                SDPixelSwizzle(src, dst, width, order);
+                if (premultiplied) {
+                    SDPixelUnpremultiply(dst, dst, width);
+                } else if (skipAlpha) {
+                    for (size_t x = 0; x < width; x++) {
+                        dst[x * 4 + 3] = 0xFF;
+                    }
+                }
+            }
+            converted = YES;
+        }
+        CFRelease(dataRef);
+    }
+    if (!converted) {
+        CGContextRef context = CGBitmapContextCreate(rgba, width, height, 8, width * 4, SDCGColorSpaceGetDeviceRGB(), kCGBitmapByteOrder32Big | kCGImageAlphaPremultipliedLast);
+        if (!context) {
+            free(rgba);
+            return NULL;
+        }
+        CGContextDrawImage(context, CGRectMake(0, 0, width, height), imageRef);
+        CGContextRelease(context);
+        SDPixelUnpremultiply(rgba, rgba, width * height);
+    }
+    return rgba;
+}
+
+@end
+
+#pragma mark - Frame source
+
+typedef struct {
+    int x;
+    int y;
+    int width;
+    int height;
+    NSTimeInterval duration;
+    WebPMuxAnimBlend blend;
+    WebPMuxAnimDispose dispose;
+    BOOL hasAlpha;
+    BOOL isKeyFrame;
+} SDWebPFrameInfo;
+
+static inline BOOL SDWebPFrameIsFullCanvas(const SDWebPFrameInfo *frame, int canvasWidth, int canvasHeight) {
+    return frame->x == 0 && frame->y == 0 && frame->width == canvasWidth && frame->height == canvasHeight;
+}
+
+// 和 libwebp 的 anim_decode 一样判断关键帧：关键帧不依赖之前的画布，从最近的关键帧开始合成就能得到任意一帧
+static BOOL SDWebPFrameIsKeyFrame(const SDWebPFrameInfo *frame, const SDWebPFrameInfo *previous, int canvasWidth, int canvasHeight) {
+    if (!previous) {
+        return YES;
+    }
+    if (SDWebPFrameIsFullCanvas(frame, canvasWidth, canvasHeight) && (!frame->hasAlpha || frame->blend == WEBP_MUX_NO_BLEND)) {
+        return YES;
+    }
+    return previous->dispose == WEBP_MUX_DISPOSE_BACKGROUND && (SDWebPFrameIsFullCanvas(previous, canvasWidth, canvasHeight) || previous->isKeyFrame);
+}
+
+@implementation SDWebImageWebPFrameSource {
+    SDWebImageWebPCoder *_coder;
+    NSData *_data;
+    WebPDemuxer *_demuxer;
+    SDWebPFrameInfo *_frames;
+    NSUInteger _frameCount;
+    int _canvasWidth;
+    int _canvasHeight;
+    CGContextRef _canvas;
+    // The frame drawn on the canvas, its dispose method is not applied yet. NSNotFound if the canvas is not usable
+    NSUInteger _canvasIndex;
+}
+
+@synthesize animatedImageLoopCount = _animatedImageLoopCount;
+
+- (nullable instancetype)initWithData:(nonnull NSData *)data coder:(nonnull SDWebImageWebPCoder *)coder {
+    if ((self = [super init])) {
+        _coder = coder;
+        // 解码器直接引用数据的内存，保存一份不可变的拷贝
+        _data = [data copy];
+        _canvasIndex = NSNotFound;
+        WebPData webpData;
+        WebPDataInit(&webpData);
+        webpData.bytes = _data.bytes;
+        webpData.size = _data.length;
+        _demuxer = WebPDemux(&webpData);
+        if (!_demuxer) {
+            return nil;
+        }
+        if (!(WebPDemuxGetI(_demuxer, WEBP_FF_FORMAT_FLAGS) & ANIMATION_FLAG)) {
+            return nil;
+        }
+        _animatedImageLoopCount = WebPDemuxGetI(_demuxer, WEBP_FF_LOOP_COUNT);
+        _canvasWidth = WebPDemuxGetI(_demuxer, WEBP_FF_CANVAS_WIDTH);
+        _canvasHeight = WebPDemuxGetI(_demuxer, WEBP_FF_CANVAS_HEIGHT);
+        NSUInteger frameCount = WebPDemuxGetI(_demuxer, WEBP_FF_FRAME_COUNT);
+        if (frameCount < 2 || ![self indexFramesWithCount:frameCount]) {
+            return nil;
+        }
+        uint32_t flags = WebPDemuxGetI(_demuxer, WEBP_FF_FORMAT_FLAGS);
+        CGBitmapInfo bitmapInfo;
+        if (!(flags & ALPHA_FLAG)) {
+            bitmapInfo = kCGBitmapByteOrder32Big | kCGImageAlphaNoneSkipLast;
+        } else {
+            bitmapInfo = kCGBitmapByteOrder32Big | kCGImageAlphaPremultipliedLast;
+        }
+        _canvas = CGBitmapContextCreate(NULL, _canvasWidth, _canvasHeight, 8, 0, SDCGColorSpaceGetDeviceRGB(), bitmapInfo);
+        if (!_canvas) {
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (_canvas) {
+        CGContextRelease(_canvas);
+        _canvas = NULL;
+    }
+    if (_demuxer) {
+        WebPDemuxDelete(_demuxer);
+        _demuxer = NULL;
+    }
+    if (_frames) {
+        free(_frames);
+        _frames = NULL;
+    }
+}
+
+// Read the geometry, timing and blending of every frame, without decoding them
+- (BOOL)indexFramesWithCount:(NSUInteger)frameCount {
+    _frames = calloc(frameCount, sizeof(SDWebPFrameInfo));
+    if (!_frames) {
+        return NO;
+    }
+    WebPIterator iter;
+    if (!WebPDemuxGetFrame(_demuxer, 1, &iter)) {
+        WebPDemuxReleaseIterator(&iter);
+        return NO;
+    }
+    NSUInteger index = 0;
+    do {
+        SDWebPFrameInfo *frame = &_frames[index];
+        frame->x = iter.x_offset;
+        frame->y = iter.y_offset;
+        frame->width = iter.width;
+        frame->height = iter.height;
+        int duration = iter.duration;
+        if (duration <= 10) {
+            // Same as the eager decoding, Chrome and other implementations use 100ms for durations lower or equal than 10ms
+            duration = 100;
+        }
+        frame->duration = duration / 1000.0;
+        frame->blend = iter.blend_method;
+        frame->dispose = iter.dispose_method;
+        frame->hasAlpha = iter.has_alpha;
+        frame->isKeyFrame = SDWebPFrameIsKeyFrame(frame, index > 0 ? &_frames[index - 1] : NULL, _canvasWidth, _canvasHeight);
+        index++;
+    } while (index < frameCount && WebPDemuxNextFrame(&iter));
+    WebPDemuxReleaseIterator(&iter);
+    _frameCount = index;
+    return _frameCount >= 2;
+}
+
+- (NSData *)animatedImageData {
+    return _data;
+}
+
+- (SDImageFormat)animatedImageFormat {
+    return SDImageFormatWebP;
+}
+
+- (NSUInteger)animatedImageFrameCount {
+    return _frameCount;
+}
+
+- (NSTimeInterval)animatedImageDurationAtIndex:(NSUInteger)index {
+    if (index >= _frameCount) {
+        return 0;
+    }
+    return _frames[index].duration;
+}
+
+- (nullable UIImage *)animatedImageFrameAtIndex:(NSUInteger)index {
+    if (index >= _frameCount) {
+        return nil;
+    }
+    NSUInteger keyFrameIndex = index;
+    while (keyFrameIndex > 0 && !_frames[keyFrameIndex].isKeyFrame) {
+        keyFrameIndex--;
+    }
+    // 画布上是同一段关键帧之后的前面的帧时接着合成，否则从关键帧重新开始
+    if (_canvasIndex == NSNotFound || _canvasIndex < keyFrameIndex || _canvasIndex > index) {
+        CGContextClearRect(_canvas, CGRectMake(0, 0, _canvasWidth, _canvasHeight));
+        _canvasIndex = NSNotFound;
+    }
+    NSUInteger startIndex = _canvasIndex == NSNotFound ? keyFrameIndex : _canvasIndex + 1;
+    for (NSUInteger i = startIndex; i <= index; i++) {
+        if (_canvasIndex != NSNotFound && _frames[_canvasIndex].dispose == WEBP_MUX_DISPOSE_BACKGROUND) {
+            const SDWebPFrameInfo *previous = &_frames[_canvasIndex];
+            CGContextClearRect(_canvas, SDWebPFrameRectInCanvas(_canvasHeight, previous->x, previous->y, previous->width, previous->height));
+        }
+        BOOL drawn = NO;
+        WebPIterator iter;
+        if (WebPDemuxGetFrame(_demuxer, (int)i + 1, &iter)) {
+            @autoreleasepool {
+                drawn = [_coder sd_drawWebpFrameWithCanvas:_canvas iterator:iter];
+            }
+        }
+        WebPDemuxReleaseIterator(&iter);
+        if (!drawn) {
+            _canvasIndex = NSNotFound;
+            return nil;
+        }
+        _canvasIndex = i;
+    }
+    
+    CGImageRef imageRef = CGBitmapContextCreateImage(_canvas);
+    if (!imageRef) {
+        return nil;
+    }
+#if SD_UIKIT || SD_WATCH
+    UIImage *image = [[UIImage alloc] initWithCGImage:imageRef];
+#else
+    UIImage *image = [[UIImage alloc] initWithCGImage:imageRef size:NSZeroSize];
+#endif
+    CGImageRelease(imageRef);
+    return image;
+}
+
 @end
 
 #endif
@@ -0,0 +1,72 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+/*
+ 断点续传
+
+ 下载被取消（比如 cell 滚出屏幕）或者网络出错时，已经收到的数据会连同服务器返回的校验值（强 ETag 或 Last-Modified）一起保存下来。
+ 同一个 URL 再次下载时带上 `Range: bytes=<已收到的长度>-` 和 `If-Range: <校验值>` 请求头：
+ 图片没有变化时服务器返回 206，只需要下载剩下的部分；图片变化了服务器返回 200 和完整的数据，保存的部分数据会被丢弃。
+ */
+
+#import <Foundation/Foundation.h>
+#import "SDWebImageCompat.h"
+
+/**
+ * Persists the partially received bodies of interrupted downloads so they can be resumed with a range request.
+ *
+ * All the methods are thread safe, the files are written on a serial background queue.
+ */
+@interface SDWebImageDownloadResumeStore : NSObject
+
+/**
+ * The directory holding the partial downloads
+ */
+@property (nonatomic, copy, readonly, nonnull) NSString *directory;
+
+/**
+ * Partial downloads smaller than this size, in bytes, are not worth a second request and are not stored. Defaults to 64 KB.
+ * 小于这个大小的部分数据不保存
+ */
+@property (nonatomic, assign) NSUInteger minimumPartialDataSize;
+
+/**
+ * The maximum total size of the stored partial downloads, in bytes. The oldest ones are removed first. Defaults to 32 MB.
+ * 保存的部分数据的总大小上限，超过时先删除最旧的
+ */
+@property (nonatomic, assign) NSUInteger maxTotalSize;
+
+/**
+ * Returns the store used by the downloaders by default, in the caches directory
+ */
++ (nonnull instancetype)sharedStore;
+
+- (nonnull instancetype)initWithDirectory:(nonnull NSString *)directory NS_DESIGNATED_INITIALIZER;
+- (nonnull instancetype)init NS_UNAVAILABLE;
+
+/**
+ * Return the partial body stored for a URL, and the validator it was received with
+ *
+ * @param url       The URL of the download
+ * @param validator On return, the strong ETag or the Last-Modified date of the partial body, to be sent as `If-Range`
+ *
+ * @return The partial body, or nil if nothing is stored for the URL
+ */
+- (nullable NSData *)partialDataForURL:(nonnull NSURL *)url validator:(NSString * _Nullable * _Nonnull)validator;
+
+/**
+ * Store the partial body of an interrupted download, replacing any previous one for the same URL.
+ * Nothing is stored if the data is smaller than `minimumPartialDataSize`.
+ */
+- (void)storePartialData:(nonnull NSData *)data validator:(nonnull NSString *)validator forURL:(nonnull NSURL *)url;
+
+- (void)removePartialDataForURL:(nonnull NSURL *)url;
+
+- (void)removeAllPartialData;
+
+@end
@@ -0,0 +1,210 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDWebImageDownloadResumeStore.h"
+#import <CommonCrypto/CommonDigest.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// 每个文件的开头：magic、URL 长度、校验值长度，后面依次是 URL、校验值和部分数据
+static const uint32_t kPartialDataMagic = 0x53445250; // "SDRP"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t URLLength;
+    uint32_t validatorLength;
+} SDPartialDataHeader;
+
+// Write the whole buffer, write may write less than asked
+static BOOL SDPartialDataWriteAll(int fd, const void *bytes, size_t length) {
+    const char *cursor = bytes;
+    while (length > 0) {
+        ssize_t written = write(fd, cursor, length);
+        if (written <= 0) {
+            return NO;
+        }
+        cursor += written;
+        length -= written;
+    }
+    return YES;
+}
+
+static NSString *SDPartialDataFileNameForURL(NSURL *url) {
+    const char *str = url.absoluteString.UTF8String;
+    if (str == NULL) {
+        str = "";
+    }
+    unsigned char r[CC_MD5_DIGEST_LENGTH];
+    CC_MD5(str, (CC_LONG)strlen(str), r);
+    return [NSString stringWithFormat:@"%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x.partial",
+            r[0], r[1], r[2], r[3], r[4], r[5], r[6], r[7], r[8], r[9], r[10], r[11], r[12], r[13], r[14], r[15]];
+}
+
+@interface SDWebImageDownloadResumeStore ()
+
+@property (nonatomic, copy, readwrite, nonnull) NSString *directory;
+@property (nonatomic, strong, nonnull) dispatch_queue_t ioQueue;
+@property (nonatomic, strong, nonnull) NSFileManager *fileManager;
+
+@end
+
+@implementation SDWebImageDownloadResumeStore
+
++ (nonnull instancetype)sharedStore {
+    static dispatch_once_t once;
+    static id instance;
+    dispatch_once(&once, ^{
+        NSString *cachesDirectory = NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES).firstObject;
+        instance = [[self alloc] initWithDirectory:[cachesDirectory stringByAppendingPathComponent:@"com.hackemist.SDWebImageDownloader.partial"]];
+    });
+    return instance;
+}
+
+- (nonnull instancetype)initWithDirectory:(nonnull NSString *)directory {
+    if ((self = [super init])) {
+        _directory = [directory copy];
+        _minimumPartialDataSize = 64 * 1024;
+        _maxTotalSize = 32 * 1024 * 1024;
+        _ioQueue = dispatch_queue_create("com.hackemist.SDWebImageDownloadResumeStore", DISPATCH_QUEUE_SERIAL);
+        dispatch_sync(_ioQueue, ^{
+            self.fileManager = [NSFileManager new];
+        });
+    }
+    return self;
+}
+
+- (NSString *)pathForURL:(NSURL *)url {
+    return [self.directory stringByAppendingPathComponent:SDPartialDataFileNameForURL(url)];
+}
+
+#pragma mark - Reading
+
+- (nullable NSData *)partialDataForURL:(nonnull NSURL *)url validator:(NSString * _Nullable * _Nonnull)validator {
+    __block NSData *partialData = nil;
+    __block NSString *partialValidator = nil;
+    // 在 ioQueue 中读取，刚刚取消的下载还没写完的数据也能读到
+    dispatch_sync(self.ioQueue, ^{
+        NSString *path = [self pathForURL:url];
+        NSData *fileData = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:nil];
+        if (fileData.length < sizeof(SDPartialDataHeader)) {
+            return;
+        }
+        SDPartialDataHeader header;
+        [fileData getBytes:&header length:sizeof(header)];
+        NSUInteger bodyOffset = sizeof(header) + (NSUInteger)header.URLLength + header.validatorLength;
+        if (header.magic != kPartialDataMagic || fileData.length <= bodyOffset) {
+            [self.fileManager removeItemAtPath:path error:nil];
+            return;
+        }
+        NSString *URLString = [[NSString alloc] initWithData:[fileData subdataWithRange:NSMakeRange(sizeof(header), header.URLLength)] encoding:NSUTF8StringEncoding];
+        if (![URLString isEqualToString:url.absoluteString]) {
+            // 文件名冲突
+            return;
+        }
+        partialValidator = [[NSString alloc] initWithData:[fileData subdataWithRange:NSMakeRange(sizeof(header) + header.URLLength, header.validatorLength)] encoding:NSUTF8StringEncoding];
+        if (partialValidator.length == 0) {
+            return;
+        }
+        partialData = [fileData subdataWithRange:NSMakeRange(bodyOffset, fileData.length - bodyOffset)];
+    });
+    *validator = partialData ? partialValidator : nil;
+    return partialData;
+}
+
+#pragma mark - Writing
+
+- (void)storePartialData:(nonnull NSData *)data validator:(nonnull NSString *)validator forURL:(nonnull NSURL *)url {
+    if (data.length < self.minimumPartialDataSize || data.length > self.maxTotalSize || validator.length == 0) {
+        return;
+    }
+    dispatch_async(self.ioQueue, ^{
+        [self writePartialData:data validator:validator forURL:url];
+        [self trimToMaxTotalSize];
+    });
+}
+
+// Write to a temporary file then rename, a reader never sees a half written file. Must be called on the ioQueue
+- (void)writePartialData:(NSData *)data validator:(NSString *)validator forURL:(NSURL *)url {
+    [self.fileManager createDirectoryAtPath:self.directory withIntermediateDirectories:YES attributes:nil error:nil];
+    NSString *path = [self pathForURL:url];
+    NSString *temporaryPath = [path stringByAppendingString:@".tmp"];
+    NSData *URLData = [url.absoluteString dataUsingEncoding:NSUTF8StringEncoding];
+    NSData *validatorData = [validator dataUsingEncoding:NSUTF8StringEncoding];
+    SDPartialDataHeader header = {
+        .magic = kPartialDataMagic,
+        .URLLength = (uint32_t)URLData.length,
+        .validatorLength = (uint32_t)validatorData.length
+    };
+    int fd = open(temporaryPath.fileSystemRepresentation, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return;
+    }
+    __block BOOL success = SDPartialDataWriteAll(fd, &header, sizeof(header)) &&
+                           SDPartialDataWriteAll(fd, URLData.bytes, URLData.length) &&
+                           SDPartialDataWriteAll(fd, validatorData.bytes, validatorData.length);
+    // 部分数据可能不连续，逐段写入，不拼接拷贝
+    [data enumerateByteRangesUsingBlock:^(const void *bytes, NSRange byteRange, BOOL *stop) {
+        if (!success || !SDPartialDataWriteAll(fd, bytes, byteRange.length)) {
+            success = NO;
+            *stop = YES;
+        }
+    }];
+    close(fd);
+    if (!success || rename(temporaryPath.fileSystemRepresentation, path.fileSystemRepresentation) != 0) {
+        unlink(temporaryPath.fileSystemRepresentation);
+    }
+}
+
+// Remove the oldest partial downloads until the total size fits. Must be called on the ioQueue
+- (void)trimToMaxTotalSize {
+    NSURL *directoryURL = [NSURL fileURLWithPath:self.directory isDirectory:YES];
+    NSArray<NSString *> *resourceKeys = @[NSURLContentModificationDateKey, NSURLTotalFileAllocatedSizeKey];
+    NSArray<NSURL *> *fileURLs = [self.fileManager contentsOfDirectoryAtURL:directoryURL
+                                                 includingPropertiesForKeys:resourceKeys
+                                                                    options:NSDirectoryEnumerationSkipsHiddenFiles
+                                                                      error:nil];
+    NSUInteger totalSize = 0;
+    NSMutableDictionary<NSURL *, NSDictionary<NSString *, id> *> *files = [NSMutableDictionary dictionary];
+    for (NSURL *fileURL in fileURLs) {
+        NSDictionary<NSString *, id> *resourceValues = [fileURL resourceValuesForKeys:resourceKeys error:nil];
+        if (!resourceValues) {
+            continue;
+        }
+        totalSize += [resourceValues[NSURLTotalFileAllocatedSizeKey] unsignedIntegerValue];
+        files[fileURL] = resourceValues;
+    }
+    if (totalSize <= self.maxTotalSize) {
+        return;
+    }
+    NSArray<NSURL *> *sortedFiles = [files keysSortedByValueWithOptions:NSSortConcurrent usingComparator:^NSComparisonResult(id obj1, id obj2) {
+        return [obj1[NSURLContentModificationDateKey] compare:obj2[NSURLContentModificationDateKey]];
+    }];
+    for (NSURL *fileURL in sortedFiles) {
+        if ([self.fileManager removeItemAtURL:fileURL error:nil]) {
+            NSUInteger fileSize = [files[fileURL][NSURLTotalFileAllocatedSizeKey] unsignedIntegerValue];
+            totalSize -= MIN(fileSize, totalSize);
+            if (totalSize <= self.maxTotalSize) {
+                break;
+            }
+        }
+    }
+}
+
+- (void)removePartialDataForURL:(nonnull NSURL *)url {
+    dispatch_async(self.ioQueue, ^{
+        [self.fileManager removeItemAtPath:[self pathForURL:url] error:nil];
+    });
+}
+
+- (void)removeAllPartialData {
+    dispatch_async(self.ioQueue, ^{
+        [self.fileManager removeItemAtPath:self.directory error:nil];
+    });
+}
+
+@end
@@ -0,0 +1,104 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+/*
+ 按优先级调度下载任务
+
+ 原来的做法是把所有下载操作直接加入 NSOperationQueue，只能用 queuePriority 区分高低，
+ LIFO 则是通过 addDependency: 串起一条很长的依赖链来模拟，优先级也无法在排队中途调整。
+
+ 调度器自己保存排队中的操作，每个优先级一个队列，只有在有空闲的并发名额时才把下一个操作交给 NSOperationQueue。
+ 排队的操作可以随时调整优先级（比如 cell 滚入或滚出屏幕），同一优先级内按 FIFO 或 LIFO 取出。
+ 等待时间每超过 agingInterval 就把有效优先级提升一级，预加载这类低优先级的请求不会一直被饿死。
+
+ 并发名额还可以按 host 和预加载分别限制：一个很慢的 host 不会占满所有名额，
+ 预加载的操作（包括因为等待太久被提升的）也不能占用留给屏幕上图片的名额。
+ */
+
+#import <Foundation/Foundation.h>
+#import "SDWebImageCompat.h"
+#import "SDWebImageDownloader.h"
+
+/**
+ * Feeds operations to an operation queue by priority, only when the queue has a free slot.
+ *
+ * The scheduler is thread safe.
+ */
+@interface SDWebImageDownloadScheduler : NSObject
+
+/**
+ * The queue running the operations. Its `maxConcurrentOperationCount` is the number of operations run at the same time.
+ */
+@property (strong, nonatomic, readonly, nonnull) NSOperationQueue *operationQueue;
+
+/**
+ * The order of the operations of the same priority. Defaults to `SDWebImageDownloaderFIFOExecutionOrder`.
+ */
+@property (assign, nonatomic) SDWebImageDownloaderExecutionOrder executionOrder;
+
+/**
+ * A waiting operation is run as if its priority was one level higher for each interval it has waited, in seconds.
+ * Defaults to 2. Set 0 to never raise the priority of waiting operations.
+ * 排队等待时间每超过这个间隔，有效优先级提升一级
+ */
+@property (assign, nonatomic) NSTimeInterval agingInterval;
+
+/**
+ * The maximum number of operations of the same host run at the same time. Defaults to 0, no limit.
+ * 同一个 host 同时执行的操作数上限
+ */
+@property (assign, nonatomic) NSInteger maxConcurrentOperationsPerHost;
+
+/**
+ * The maximum number of operations queued with `SDWebImageDownloaderPriorityPrefetch` run at the same time,
+ * even once their waiting time raised their priority. Defaults to 0, no limit.
+ * 预加载的操作同时执行的数量上限，剩下的名额留给其他优先级
+ */
+@property (assign, nonatomic) NSInteger maxConcurrentPrefetchOperations;
+
+/**
+ * The number of operations waiting for a slot
+ */
+@property (assign, nonatomic, readonly) NSUInteger pendingOperationCount;
+
+- (nonnull instancetype)initWithOperationQueue:(nonnull NSOperationQueue *)operationQueue NS_DESIGNATED_INITIALIZER;
+- (nonnull instancetype)init NS_UNAVAILABLE;
+
+/**
+ * Queue an operation. It is added to the operation queue once no operation of a higher effective priority is waiting.
+ */
+- (void)addOperation:(nonnull NSOperation *)operation priority:(SDWebImageDownloaderPriority)priority;
+
+/**
+ * Queue an operation fetching from a host, it counts against `maxConcurrentOperationsPerHost`.
+ */
+- (void)addOperation:(nonnull NSOperation *)operation priority:(SDWebImageDownloaderPriority)priority host:(nullable NSString *)host;
+
+/**
+ * Change the priority of a waiting operation, the time it already waited is kept.
+ * The `queuePriority` of the operation is updated as well, even if it is already running.
+ */
+- (void)setPriority:(SDWebImageDownloaderPriority)priority forOperation:(nonnull NSOperation *)operation;
+
+/**
+ * Stop tracking a waiting operation, for example once it has been cancelled
+ */
+- (void)removeOperation:(nonnull NSOperation *)operation;
+
+/**
+ * Cancel all the waiting and running operations
+ */
+- (void)cancelAllOperations;
+
+/**
+ * Add waiting operations to the operation queue if it has free slots.
+ * Call it after changing `maxConcurrentOperationCount`, the per host and prefetch limits call it themselves.
+ */
+- (void)drain;
+
+@end
@@ -0,0 +1,341 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDWebImageDownloadScheduler.h"
+
+#define SDWebImageDownloaderPriorityCount (SDWebImageDownloaderPriorityVisible + 1)
+
+static void *SDWebImageDownloadSchedulerContext = &SDWebImageDownloadSchedulerContext;
+
+static SDWebImageDownloaderPriority SDClampedDownloadPriority(SDWebImageDownloaderPriority priority) {
+    return MIN(MAX(priority, SDWebImageDownloaderPriorityPrefetch), SDWebImageDownloaderPriorityVisible);
+}
+
+static NSOperationQueuePriority SDQueuePriorityForDownloadPriority(SDWebImageDownloaderPriority priority) {
+    switch (priority) {
+        case SDWebImageDownloaderPriorityPrefetch:
+            return NSOperationQueuePriorityVeryLow;
+        case SDWebImageDownloaderPriorityLow:
+            return NSOperationQueuePriorityLow;
+        case SDWebImageDownloaderPriorityHigh:
+            return NSOperationQueuePriorityHigh;
+        case SDWebImageDownloaderPriorityVisible:
+            return NSOperationQueuePriorityVeryHigh;
+        default:
+            return NSOperationQueuePriorityNormal;
+    }
+}
+
+// 排队中的一个操作
+@interface SDWebImageDownloadSchedulerEntry : NSObject {
+    @package
+    NSOperation *_operation;
+    SDWebImageDownloaderPriority _priority;
+    // 入队的序号，同一优先级的队列按序号排序
+    NSUInteger _sequence;
+    CFAbsoluteTime _enqueueTime;
+    NSString *_host;
+    // 开始执行时是否占用预加载的名额
+    BOOL _prefetch;
+}
+@end
+
+@implementation SDWebImageDownloadSchedulerEntry
+@end
+
+
+@interface SDWebImageDownloadScheduler ()
+
+@property (strong, nonatomic, readwrite, nonnull) NSOperationQueue *operationQueue;
+// operation -> entry，只包含排队中的操作
+@property (strong, nonatomic, nonnull) NSMapTable<NSOperation *, SDWebImageDownloadSchedulerEntry *> *entries;
+// 已经交给 operationQueue 还没有结束的操作 -> entry
+@property (strong, nonatomic, nonnull) NSMapTable<NSOperation *, SDWebImageDownloadSchedulerEntry *> *runningEntries;
+// 每个 host 正在执行的操作数
+@property (strong, nonatomic, nonnull) NSCountedSet<NSString *> *runningHosts;
+@property (strong, nonatomic, nonnull) dispatch_semaphore_t lock;
+
+@end
+
+@implementation SDWebImageDownloadScheduler {
+    // 每个优先级一个队列，按入队顺序排列
+    NSMutableArray<SDWebImageDownloadSchedulerEntry *> *_queues[SDWebImageDownloaderPriorityCount];
+    NSUInteger _nextSequence;
+    NSUInteger _runningPrefetchCount;
+}
+
+- (instancetype)initWithOperationQueue:(NSOperationQueue *)operationQueue {
+    if ((self = [super init])) {
+        _operationQueue = operationQueue;
+        _executionOrder = SDWebImageDownloaderFIFOExecutionOrder;
+        _agingInterval = 2;
+        for (NSUInteger i = 0; i < SDWebImageDownloaderPriorityCount; i++) {
+            _queues[i] = [NSMutableArray array];
+        }
+        _entries = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsStrongMemory | NSPointerFunctionsObjectPointerPersonality
+                                         valueOptions:NSPointerFunctionsStrongMemory];
+        _runningEntries = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsStrongMemory | NSPointerFunctionsObjectPointerPersonality
+                                                valueOptions:NSPointerFunctionsStrongMemory];
+        _runningHosts = [NSCountedSet set];
+        _lock = dispatch_semaphore_create(1);
+    }
+    return self;
+}
+
+- (void)dealloc {
+    for (NSOperation *operation in self.runningEntries) {
+        [operation removeObserver:self forKeyPath:NSStringFromSelector(@selector(isFinished)) context:SDWebImageDownloadSchedulerContext];
+    }
+}
+
+- (NSUInteger)pendingOperationCount {
+    SD_LOCK(self.lock);
+    NSUInteger count = self.entries.count;
+    SD_UNLOCK(self.lock);
+    return count;
+}
+
+- (void)setMaxConcurrentOperationsPerHost:(NSInteger)maxConcurrentOperationsPerHost {
+    SD_LOCK(self.lock);
+    _maxConcurrentOperationsPerHost = maxConcurrentOperationsPerHost;
+    SD_UNLOCK(self.lock);
+    [self drain];
+}
+
+- (NSInteger)maxConcurrentOperationsPerHost {
+    SD_LOCK(self.lock);
+    NSInteger maxCount = _maxConcurrentOperationsPerHost;
+    SD_UNLOCK(self.lock);
+    return maxCount;
+}
+
+- (void)setMaxConcurrentPrefetchOperations:(NSInteger)maxConcurrentPrefetchOperations {
+    SD_LOCK(self.lock);
+    _maxConcurrentPrefetchOperations = maxConcurrentPrefetchOperations;
+    SD_UNLOCK(self.lock);
+    [self drain];
+}
+
+- (NSInteger)maxConcurrentPrefetchOperations {
+    SD_LOCK(self.lock);
+    NSInteger maxCount = _maxConcurrentPrefetchOperations;
+    SD_UNLOCK(self.lock);
+    return maxCount;
+}
+
+#pragma mark - Queueing
+
+- (void)addOperation:(NSOperation *)operation priority:(SDWebImageDownloaderPriority)priority {
+    [self addOperation:operation priority:priority host:nil];
+}
+
+- (void)addOperation:(NSOperation *)operation priority:(SDWebImageDownloaderPriority)priority host:(nullable NSString *)host {
+    priority = SDClampedDownloadPriority(priority);
+    operation.queuePriority = SDQueuePriorityForDownloadPriority(priority);
+    SDWebImageDownloadSchedulerEntry *entry = [SDWebImageDownloadSchedulerEntry new];
+    entry->_operation = operation;
+    entry->_priority = priority;
+    entry->_enqueueTime = CFAbsoluteTimeGetCurrent();
+    entry->_host = [host lowercaseString];
+    SD_LOCK(self.lock);
+    if ([self.entries objectForKey:operation] || [self.runningEntries objectForKey:operation]) {
+        SD_UNLOCK(self.lock);
+        return;
+    }
+    entry->_sequence = _nextSequence++;
+    [_queues[priority] addObject:entry];
+    [self.entries setObject:entry forKey:operation];
+    SD_UNLOCK(self.lock);
+    [self drain];
+}
+
+- (void)setPriority:(SDWebImageDownloaderPriority)priority forOperation:(NSOperation *)operation {
+    priority = SDClampedDownloadPriority(priority);
+    // 正在执行的操作也更新 queuePriority，下载完成后的解码会用到
+    operation.queuePriority = SDQueuePriorityForDownloadPriority(priority);
+    SD_LOCK(self.lock);
+    SDWebImageDownloadSchedulerEntry *entry = [self.entries objectForKey:operation];
+    if (!entry || entry->_priority == priority) {
+        SD_UNLOCK(self.lock);
+        return;
+    }
+    [_queues[entry->_priority] removeObjectIdenticalTo:entry];
+    entry->_priority = priority;
+    // 按入队序号插回去，保留已经等待的时间
+    NSMutableArray<SDWebImageDownloadSchedulerEntry *> *queue = _queues[priority];
+    NSUInteger low = 0;
+    NSUInteger high = queue.count;
+    while (low < high) {
+        NSUInteger middle = low + (high - low) / 2;
+        if (queue[middle]->_sequence < entry->_sequence) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    [queue insertObject:entry atIndex:low];
+    SD_UNLOCK(self.lock);
+    // 优先级变化不会产生空闲名额，下次有操作结束时再按新的优先级取
+}
+
+- (void)removeOperation:(NSOperation *)operation {
+    SD_LOCK(self.lock);
+    SDWebImageDownloadSchedulerEntry *entry = [self.entries objectForKey:operation];
+    if (entry) {
+        [_queues[entry->_priority] removeObjectIdenticalTo:entry];
+        [self.entries removeObjectForKey:operation];
+    }
+    SD_UNLOCK(self.lock);
+    if (entry && operation.isCancelled) {
+        // 交给队列让它马上结束，completionBlock 才会被调用，不占用并发名额
+        [self.operationQueue addOperation:operation];
+    }
+}
+
+- (void)cancelAllOperations {
+    SD_LOCK(self.lock);
+    NSMutableArray<NSOperation *> *pendingOperations = [NSMutableArray arrayWithCapacity:self.entries.count];
+    for (NSUInteger i = 0; i < SDWebImageDownloaderPriorityCount; i++) {
+        for (SDWebImageDownloadSchedulerEntry *entry in _queues[i]) {
+            [pendingOperations addObject:entry->_operation];
+        }
+        [_queues[i] removeAllObjects];
+    }
+    [self.entries removeAllObjects];
+    SD_UNLOCK(self.lock);
+    [self.operationQueue cancelAllOperations];
+    for (NSOperation *operation in pendingOperations) {
+        [operation cancel];
+    }
+    [self.operationQueue addOperations:pendingOperations waitUntilFinished:NO];
+}
+
+#pragma mark - Running
+
+// Whether the host of an entry has a free slot, must be called with the lock held
+- (BOOL)canRunEntry:(SDWebImageDownloadSchedulerEntry *)entry {
+    if (_maxConcurrentOperationsPerHost <= 0 || !entry->_host) {
+        return YES;
+    }
+    return (NSInteger)[self.runningHosts countForObject:entry->_host] < _maxConcurrentOperationsPerHost;
+}
+
+// Index of the first entry of a queue that can run, from the oldest or from the newest. Must be called with the lock held
+- (NSUInteger)indexOfRunnableEntryInQueue:(NSArray<SDWebImageDownloadSchedulerEntry *> *)queue newestFirst:(BOOL)newestFirst {
+    NSUInteger count = queue.count;
+    for (NSUInteger i = 0; i < count; i++) {
+        NSUInteger index = newestFirst ? count - 1 - i : i;
+        if ([self canRunEntry:queue[index]]) {
+            return index;
+        }
+    }
+    return NSNotFound;
+}
+
+// Pick the next operation to run, must be called with the lock held
+- (nullable SDWebImageDownloadSchedulerEntry *)dequeueEntryAtTime:(CFAbsoluteTime)now {
+    BOOL prefetchSlotFree = _maxConcurrentPrefetchOperations <= 0 || (NSInteger)_runningPrefetchCount < _maxConcurrentPrefetchOperations;
+    NSInteger bestPriority = -1;
+    NSInteger bestEffectivePriority = NSIntegerMin;
+    NSUInteger bestIndex = NSNotFound;
+    for (NSInteger priority = SDWebImageDownloaderPriorityCount - 1; priority >= 0; priority--) {
+        if (priority == SDWebImageDownloaderPriorityPrefetch && !prefetchSlotFree) {
+            continue;
+        }
+        // host 已经占满名额的操作跳过，不阻塞同一队列中其他 host 的操作
+        NSUInteger oldestIndex = [self indexOfRunnableEntryInQueue:_queues[priority] newestFirst:NO];
+        if (oldestIndex == NSNotFound) {
+            continue;
+        }
+        SDWebImageDownloadSchedulerEntry *oldest = _queues[priority][oldestIndex];
+        // 每个队列中等待最久的操作有效优先级最高，相同时原本优先级高的队列优先
+        NSInteger effectivePriority = priority;
+        if (self.agingInterval > 0) {
+            effectivePriority += (NSInteger)MAX((now - oldest->_enqueueTime) / self.agingInterval, 0);
+        }
+        effectivePriority = MIN(effectivePriority, (NSInteger)SDWebImageDownloaderPriorityVisible);
+        if (effectivePriority > bestEffectivePriority) {
+            bestEffectivePriority = effectivePriority;
+            bestPriority = priority;
+            bestIndex = oldestIndex;
+        }
+    }
+    if (bestPriority < 0) {
+        return nil;
+    }
+    NSMutableArray<SDWebImageDownloadSchedulerEntry *> *queue = _queues[bestPriority];
+    NSUInteger index = bestIndex;
+    // 因为等待太久被提升优先级的，总是等待最久的那个
+    if (bestEffectivePriority == bestPriority && self.executionOrder == SDWebImageDownloaderLIFOExecutionOrder) {
+        index = [self indexOfRunnableEntryInQueue:queue newestFirst:YES];
+    }
+    SDWebImageDownloadSchedulerEntry *entry = queue[index];
+    [queue removeObjectAtIndex:index];
+    [self.entries removeObjectForKey:entry->_operation];
+    return entry;
+}
+
+- (void)drain {
+    NSMutableArray<NSOperation *> *operations = nil;
+    SD_LOCK(self.lock);
+    NSInteger maxCount = self.operationQueue.maxConcurrentOperationCount;
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    while (self.entries.count > 0 && (maxCount == NSOperationQueueDefaultMaxConcurrentOperationCount || (NSInteger)self.runningEntries.count < maxCount)) {
+        SDWebImageDownloadSchedulerEntry *entry = [self dequeueEntryAtTime:now];
+        if (!entry) {
+            // 剩下的操作都在等待 host 或预加载的名额
+            break;
+        }
+        entry->_prefetch = entry->_priority == SDWebImageDownloaderPriorityPrefetch;
+        if (entry->_prefetch) {
+            _runningPrefetchCount++;
+        }
+        if (entry->_host) {
+            [self.runningHosts addObject:entry->_host];
+        }
+        [self.runningEntries setObject:entry forKey:entry->_operation];
+        if (!operations) {
+            operations = [NSMutableArray array];
+        }
+        [operations addObject:entry->_operation];
+    }
+    SD_UNLOCK(self.lock);
+    for (NSOperation *operation in operations) {
+        [operation addObserver:self forKeyPath:NSStringFromSelector(@selector(isFinished)) options:0 context:SDWebImageDownloadSchedulerContext];
+        [self.operationQueue addOperation:operation];
+    }
+}
+
+- (void)observeValueForKeyPath:(NSString *)keyPath ofObject:(id)object change:(NSDictionary<NSKeyValueChangeKey,id> *)change context:(void *)context {
+    if (context != SDWebImageDownloadSchedulerContext) {
+        [super observeValueForKeyPath:keyPath ofObject:object change:change context:context];
+        return;
+    }
+    NSOperation *operation = object;
+    if (!operation.isFinished) {
+        return;
+    }
+    SD_LOCK(self.lock);
+    SDWebImageDownloadSchedulerEntry *entry = [self.runningEntries objectForKey:operation];
+    if (entry) {
+        [self.runningEntries removeObjectForKey:operation];
+        if (entry->_prefetch) {
+            _runningPrefetchCount--;
+        }
+        if (entry->_host) {
+            [self.runningHosts removeObject:entry->_host];
+        }
+    }
+    SD_UNLOCK(self.lock);
+    if (entry) {
+        [operation removeObserver:self forKeyPath:NSStringFromSelector(@selector(isFinished)) context:SDWebImageDownloadSchedulerContext];
+        [self drain];
+    }
+}
+
+@end
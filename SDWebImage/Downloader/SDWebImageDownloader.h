@@ -26,6 +26,8 @@
 #import "SDWebImageCompat.h"
 #import "SDWebImageOperation.h"
 
+@class SDWebImageDownloadResumeStore;
+
  
 typedef NS_OPTIONS(NSUInteger, SDWebImageDownloaderOptions) {
     SDWebImageDownloaderLowPriority = 1 << 0,
@@ -85,6 +87,12 @@ typedef NS_OPTIONS(NSUInteger, SDWebImageDownloaderOptions) {
      * Scale down the image // 裁剪大图片
      */
     SDWebImageDownloaderScaleDownLargeImages = 1 << 8,
+
+    /**
+     * 预加载，使用 `SDWebImageDownloaderPriorityPrefetch` 优先级，只占用 `maxConcurrentPrefetchDownloads` 个名额
+     * Download with `SDWebImageDownloaderPriorityPrefetch`, within the `maxConcurrentPrefetchDownloads` slots.
+     */
+    SDWebImageDownloaderPrefetchPriority = 1 << 9,
 };
 //当判断self.option是否是SDWebImageDownloaderIgnoreCachedResponse选项时，应该这么判断：
 //  self.option & SDWebImageDownloaderIgnoreCachedResponse
@@ -112,6 +120,38 @@ typedef NS_ENUM(NSInteger, SDWebImageDownloaderExecutionOrder) {
     SDWebImageDownloaderLIFOExecutionOrder// 栈  后进先出
 };
 
+/**
+ 下载优先级
+
+ 排队中的下载按优先级开始，优先级可以通过 token 随时调整，比如 cell 滚入屏幕时提升为 Visible，滚出屏幕时降低。
+ */
+typedef NS_ENUM(NSInteger, SDWebImageDownloaderPriority) {
+    /**
+     * Prefetched images nobody is waiting for yet.
+     */
+    SDWebImageDownloaderPriorityPrefetch = 0,
+
+    /**
+     * Default value of downloads with the `SDWebImageDownloaderLowPriority` option.
+     */
+    SDWebImageDownloaderPriorityLow,
+
+    /**
+     * Default value.
+     */
+    SDWebImageDownloaderPriorityNormal,
+
+    /**
+     * Default value of downloads with the `SDWebImageDownloaderHighPriority` option.
+     */
+    SDWebImageDownloaderPriorityHigh,
+
+    /**
+     * Images currently displayed on screen.
+     */
+    SDWebImageDownloaderPriorityVisible
+};
+
 FOUNDATION_EXPORT NSString * _Nonnull const SDWebImageDownloadStartNotification;
 FOUNDATION_EXPORT NSString * _Nonnull const SDWebImageDownloadStopNotification;
 
@@ -134,6 +174,18 @@ typedef SDHTTPHeadersDictionary * _Nullable (^SDWebImageDownloaderHeadersFilterB
 @property (nonatomic, strong, nullable) NSURL *url;
 @property (nonatomic, strong, nullable) id downloadOperationCancelToken;
 
+/**
+ * The priority requested for this download, see `-[SDWebImageDownloader setPriority:forToken:]`.
+ * A download shared by several tokens runs with the highest of their priorities.
+ */
+@property (nonatomic, assign, readonly) SDWebImageDownloaderPriority priority;
+
+/**
+ * The response the download finished with, set before the completed block is called.
+ * For a `304 Not Modified` response it carries the new freshness of the cached image.
+ */
+@property (nonatomic, strong, readonly, nullable) NSURLResponse *response;
+
 @end
 
 
@@ -151,12 +203,56 @@ typedef SDHTTPHeadersDictionary * _Nullable (^SDWebImageDownloaderHeadersFilterB
 */
 @property (assign, nonatomic) BOOL shouldDecompressImages; // 下载完成后是否需要解压缩图片，默认为 YES
 
+/**
+ * For progressive downloads, the minimum number of bytes received between two partial images. Defaults to 0.
+ * 渐进式下载时，两次生成部分图片之间至少要收到的字节数
+ */
+@property (assign, nonatomic) NSUInteger minimumProgressiveRenderBytes;
+
+/**
+ * For progressive downloads, the minimum time between two partial images, in seconds. Defaults to 0.1.
+ * 渐进式下载时，两次生成部分图片之间的最短时间
+ */
+@property (assign, nonatomic) NSTimeInterval minimumProgressiveRenderInterval;
+
 /**
  *  最大并行下载的数量
  *  The maximum number of concurrent downloads
  */
 @property (assign, nonatomic) NSInteger maxConcurrentDownloads;
 
+/**
+ *  同一个 host 最大并行下载的数量，默认是 0，不限制
+ *  The maximum number of concurrent downloads from the same host, so a slow host cannot hold every download slot.
+ *  Defaults to 0, no limit.
+ */
+@property (assign, nonatomic) NSInteger maxConcurrentDownloadsPerHost;
+
+/**
+ *  预加载最大并行下载的数量，默认是 3，剩下的名额留给屏幕上的图片
+ *  The maximum number of concurrent downloads with `SDWebImageDownloaderPriorityPrefetch`. Defaults to 3.
+ *  Keep it lower than `maxConcurrentDownloads` so prefetching never holds all the slots. Set 0 for no limit.
+ */
+@property (assign, nonatomic) NSInteger maxConcurrentPrefetchDownloads;
+
+/**
+ *  所有下载加起来每秒最多接收的字节数，默认是 0，不限制。收到数据之后才暂停，只能限制平均速度
+ *  The maximum number of bytes per second received by all the downloads together, 0 for no limit. Defaults to 0.
+ *  The limit is enforced after the fact: once the received data exceeds the budget, the download that received it is
+ *  suspended until the budget allows it again. The data buffered by the system meanwhile still arrives, so this bounds
+ *  the average rate rather than the instantaneous one.
+ *  Downloads of `SDWebImageDownloaderPriorityHigh` or `SDWebImageDownloaderPriorityVisible` count against the budget
+ *  but are never suspended, so the other downloads are throttled in their place.
+ */
+@property (assign, nonatomic) NSUInteger maxBytesPerSecond;
+
+/**
+ *  最大并行解码的数量，默认是 CPU 核心数
+ *  The maximum number of downloaded images decoded in parallel. Defaults to the number of active processors.
+ *  Decoding does not hold a download slot, images of higher priority downloads are decoded first.
+ */
+@property (assign, nonatomic) NSInteger maxConcurrentDecodes;
+
 /**
   当前并行下载数量
  * Shows the current amount of downloads that still need to be downloaded
@@ -184,6 +280,28 @@ typedef SDHTTPHeadersDictionary * _Nullable (^SDWebImageDownloaderHeadersFilterB
  */
 @property (assign, nonatomic) SDWebImageDownloaderExecutionOrder executionOrder;
 
+/**
+ * A queued download is started as if its priority was one level higher for each interval it has waited, in seconds,
+ * so prefetching still makes progress while on-screen images keep arriving. Defaults to 2. Set 0 to disable.
+ * 排队等待时间每超过这个间隔，有效优先级提升一级，避免低优先级的下载一直等待
+ */
+@property (assign, nonatomic) NSTimeInterval priorityAgingInterval;
+
+/**
+ * Keeps the partial bodies of cancelled or failed downloads, later downloads of the same URL are resumed
+ * with a `Range`/`If-Range` request. Defaults to `+[SDWebImageDownloadResumeStore sharedStore]`. Set nil to disable.
+ * 断点续传，保存中断的下载已经收到的数据
+ */
+@property (strong, nonatomic, nullable) SDWebImageDownloadResumeStore *resumeStore;
+
+/**
+ * The maximum number of pixels of a downloaded image, checked against the image header as soon as it arrives,
+ * so an oversized image is not downloaded entirely. With `SDWebImageDownloaderScaleDownLargeImages` the image is
+ * downloaded and scaled down instead. Defaults to 0, no limit.
+ * 图片的最大像素数，下载过程中根据图片头部检查
+ */
+@property (assign, nonatomic) NSUInteger maxImagePixelCount;
+
 /**
  单列方法。返回一个单列对象
  返回一个单列的SDWebImageDownloader对象
@@ -302,6 +420,20 @@ typedef SDHTTPHeadersDictionary * _Nullable (^SDWebImageDownloaderHeadersFilterB
                                                   progress:(nullable SDWebImageDownloaderProgressBlock)progressBlock
                                                  completed:(nullable SDWebImageDownloaderCompletedBlock)completedBlock;
 
+/**
+ * Same as `downloadImageWithURL:options:progress:completed:`, with extra HTTP headers for this request only,
+ * for example `If-None-Match` and `If-Modified-Since` to revalidate a cached image.
+ * 如果同一个 URL 已经在下载，会共用已有的下载，这些请求头被忽略。
+ * When the server answers `304 Not Modified`, the completed block is called with an `NSURLErrorDomain` error of code 304.
+ *
+ * @param requestHeaders The headers added to the request, replacing the ones of `HTTPHeaders` with the same name
+ */
+- (nullable SDWebImageDownloadToken *)downloadImageWithURL:(nullable NSURL *)url
+                                                   options:(SDWebImageDownloaderOptions)options
+                                            requestHeaders:(nullable NSDictionary<NSString *, NSString *> *)requestHeaders
+                                                  progress:(nullable SDWebImageDownloaderProgressBlock)progressBlock
+                                                 completed:(nullable SDWebImageDownloaderCompletedBlock)completedBlock;
+
 /**
  * Cancels a download that was previously queued using -downloadImageWithURL:options:progress:completed:
  *
@@ -309,6 +441,17 @@ typedef SDHTTPHeadersDictionary * _Nullable (^SDWebImageDownloaderHeadersFilterB
  */
 - (void)cancel:(nullable SDWebImageDownloadToken *)token;
 
+/**
+ * 调整一个下载的优先级，排队中的下载会按新的优先级开始，正在进行的下载会调整网络请求和解码的优先级
+ * Changes the priority of a download, for example when the view displaying it scrolls on or off screen.
+ * A queued download starts according to its new priority, a running download updates the priority
+ * of its network task and of its decoding.
+ *
+ * @param priority The new priority
+ * @param token    The token received from -downloadImageWithURL:options:progress:completed:
+ */
+- (void)setPriority:(SDWebImageDownloaderPriority)priority forToken:(nullable SDWebImageDownloadToken *)token;
+
 /**
  * Sets the download queue suspension state
  */
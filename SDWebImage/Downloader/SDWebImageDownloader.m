@@ -8,30 +8,129 @@
 
 #import "SDWebImageDownloader.h"
 #import "SDWebImageDownloaderOperation.h"
+#import "SDWebImageDownloadScheduler.h"
+#import "SDWebImageDownloadResumeStore.h"
+
+@interface SDWebImageDownloadToken ()
+
+@property (nonatomic, assign, readwrite) SDWebImageDownloaderPriority priority;
+@property (nonatomic, strong, readwrite, nullable) NSURLResponse *response;
+
+@end
 
 @implementation SDWebImageDownloadToken
 @end
 
 
+// URL 的分片数量，不同分片的 URL 互不竞争
+static const NSUInteger kURLShardCount = 16;
+
+// URL -> operation 映射的一个分片，每个分片一把锁
+@interface SDWebImageDownloaderURLShard : NSObject {
+    @package
+    NSMutableDictionary<NSURL *, SDWebImageDownloaderOperation *> *_operations;
+    // 每个 URL 下载还没有取消的 token，下载的优先级取它们之中最高的
+    NSMutableDictionary<NSURL *, NSMutableArray<SDWebImageDownloadToken *> *> *_tokens;
+    dispatch_semaphore_t _lock;
+}
+@end
+
+@implementation SDWebImageDownloaderURLShard
+
+- (instancetype)init {
+    if ((self = [super init])) {
+        _operations = [NSMutableDictionary new];
+        _tokens = [NSMutableDictionary new];
+        _lock = dispatch_semaphore_create(1);
+    }
+    return self;
+}
+
+@end
+
+
+// 所有下载共用的带宽预算（令牌桶），每秒补充 maxBytesPerSecond 个字节，最多积攒一秒
+@interface SDWebImageDownloaderBandwidthBudget : NSObject {
+    @package
+    NSUInteger _maxBytesPerSecond;
+    double _availableBytes;
+    CFAbsoluteTime _lastRefillTime;
+    dispatch_semaphore_t _lock;
+}
+@end
+
+@implementation SDWebImageDownloaderBandwidthBudget
+
+- (instancetype)init {
+    if ((self = [super init])) {
+        _lock = dispatch_semaphore_create(1);
+    }
+    return self;
+}
+
+// Take received bytes from the budget, return how long the download must wait before receiving more
+- (NSTimeInterval)consumeBytes:(NSUInteger)length {
+    SD_LOCK(_lock);
+    NSUInteger maxBytesPerSecond = _maxBytesPerSecond;
+    if (maxBytesPerSecond == 0) {
+        SD_UNLOCK(_lock);
+        return 0;
+    }
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    if (_lastRefillTime > 0) {
+        _availableBytes = MIN(_availableBytes + (now - _lastRefillTime) * maxBytesPerSecond, (double)maxBytesPerSecond);
+    } else {
+        _availableBytes = maxBytesPerSecond;
+    }
+    _lastRefillTime = now;
+    _availableBytes -= length;
+    NSTimeInterval delay = _availableBytes < 0 ? -_availableBytes / maxBytesPerSecond : 0;
+    SD_UNLOCK(_lock);
+    return delay;
+}
+
+@end
+
+
 @interface SDWebImageDownloader () <NSURLSessionTaskDelegate, NSURLSessionDataDelegate>
 // 图片下载任务是放在这个 NSOperationQueue 任务队列中来管理的
 @property (strong, nonatomic, nonnull) NSOperationQueue *downloadQueue;
-@property (weak, nonatomic, nullable) NSOperation *lastAddedOperation;
+// 按优先级把排队中的下载操作交给 downloadQueue
+@property (strong, nonatomic, nonnull) SDWebImageDownloadScheduler *scheduler;
+@property (strong, nonatomic, nonnull) SDWebImageDownloaderBandwidthBudget *bandwidthBudget;
+// 解码下载完成的图片的队列，所有下载操作共用
+@property (strong, nonatomic, nonnull) NSOperationQueue *decodeQueue;
 @property (assign, nonatomic, nullable) Class operationClass;
-@property (strong, nonatomic, nonnull) NSMutableDictionary<NSURL *, SDWebImageDownloaderOperation *> *URLOperations;
+// 按 URL 分片保存正在进行的下载，同一个 URL 的多次请求共用一个 operation
+// 原来整个字典由一个 barrierQueue 保护，滚动时所有添加、取消都竞争同一个队列
+@property (strong, nonatomic, nonnull) NSArray<SDWebImageDownloaderURLShard *> *URLShards;
 //@property (strong, nonatomic) NSMutableDictionary *URLCallbacks;
 //图片下载的回调 block 都是存储在这个属性中，该属性是一个字典，key 是图片的 URL，value 是一个数组，
 //包含每个图片的多组回调信息。用 JSON 格式表示的话，就是下面这种形式：
 
 @property (strong, nonatomic, nullable) SDHTTPHeadersMutableDictionary *HTTPHeaders;
-// This queue is used to serialize the handling of the network responses of all the download operation in a single queue
-@property (strong, nonatomic, nullable) dispatch_queue_t barrierQueue;
 
 // The session in which data tasks will run
 @property (strong, nonatomic) NSURLSession *session;
 
 @end
 
+static SDWebImageDownloaderPriority SDWebImageDownloaderPriorityForOptions(SDWebImageDownloaderOptions options) {
+    if (options & SDWebImageDownloaderPrefetchPriority) {
+        return SDWebImageDownloaderPriorityPrefetch;
+    } else if (options & SDWebImageDownloaderHighPriority) {
+        return SDWebImageDownloaderPriorityHigh;
+    } else if (options & SDWebImageDownloaderLowPriority) {
+        return SDWebImageDownloaderPriorityLow;
+    }
+    return SDWebImageDownloaderPriorityNormal;
+}
+
+// 自定义的 operation 可能没有实现 isDecoding
+static BOOL SDDownloaderOperationIsDecoding(SDWebImageDownloaderOperation *operation) {
+    return [operation respondsToSelector:@selector(isDecoding)] && operation.isDecoding;
+}
+
 @implementation SDWebImageDownloader
 
 + (void)initialize {
@@ -76,11 +175,24 @@
     if ((self = [super init])) {
         _operationClass = [SDWebImageDownloaderOperation class];
         _shouldDecompressImages = YES;
-        _executionOrder = SDWebImageDownloaderFIFOExecutionOrder;
+        _minimumProgressiveRenderBytes = 0;
+        _minimumProgressiveRenderInterval = 0.1;
         _downloadQueue = [NSOperationQueue new];
         _downloadQueue.maxConcurrentOperationCount = 6;  //最大并发数6
         _downloadQueue.name = @"com.hackemist.SDWebImageDownloader";
-        _URLOperations = [NSMutableDictionary new];
+        _scheduler = [[SDWebImageDownloadScheduler alloc] initWithOperationQueue:_downloadQueue];
+        _scheduler.maxConcurrentPrefetchOperations = 3;
+        _bandwidthBudget = [SDWebImageDownloaderBandwidthBudget new];
+        _resumeStore = [SDWebImageDownloadResumeStore sharedStore];
+        _decodeQueue = [NSOperationQueue new];
+        _decodeQueue.maxConcurrentOperationCount = [NSProcessInfo processInfo].activeProcessorCount;
+        _decodeQueue.name = @"com.hackemist.SDWebImageDownloader.decode";
+        _decodeQueue.qualityOfService = NSQualityOfServiceUserInitiated;
+        NSMutableArray<SDWebImageDownloaderURLShard *> *URLShards = [NSMutableArray arrayWithCapacity:kURLShardCount];
+        for (NSUInteger i = 0; i < kURLShardCount; i++) {
+            [URLShards addObject:[SDWebImageDownloaderURLShard new]];
+        }
+        _URLShards = [URLShards copy];
         /**
          我们看看image/webp,image/*;q=0.8是什么意思，image/webp是web格式的图片，
          q=0.8指的是权重系数为0.8，q的取值范围是0 - 1， 默认值为1，q作用于它前边分号;
@@ -91,7 +203,6 @@
 #else
         _HTTPHeaders = [@{@"Accept": @"image/*;q=0.8"} mutableCopy];
 #endif
-        _barrierQueue = dispatch_queue_create("com.hackemist.SDWebImageDownloaderBarrierQueue", DISPATCH_QUEUE_CONCURRENT);
         _downloadTimeout = 15.0;
 
         [self createNewSessionWithConfiguration:sessionConfiguration];
@@ -134,7 +245,7 @@
     [self.session invalidateAndCancel];
     self.session = nil;
 
-    [self.downloadQueue cancelAllOperations];
+    [self.scheduler cancelAllOperations];
 }
 
 - (void)setValue:(nullable NSString *)value forHTTPHeaderField:(nullable NSString *)field {
@@ -151,16 +262,71 @@
 
 - (void)setMaxConcurrentDownloads:(NSInteger)maxConcurrentDownloads {
     _downloadQueue.maxConcurrentOperationCount = maxConcurrentDownloads;
+    [_scheduler drain];
 }
 
 - (NSUInteger)currentDownloadCount {
-    return _downloadQueue.operationCount;
+    return _downloadQueue.operationCount + _scheduler.pendingOperationCount;
 }
 
 - (NSInteger)maxConcurrentDownloads {
     return _downloadQueue.maxConcurrentOperationCount;
 }
 
+- (void)setMaxConcurrentDownloadsPerHost:(NSInteger)maxConcurrentDownloadsPerHost {
+    _scheduler.maxConcurrentOperationsPerHost = maxConcurrentDownloadsPerHost;
+}
+
+- (NSInteger)maxConcurrentDownloadsPerHost {
+    return _scheduler.maxConcurrentOperationsPerHost;
+}
+
+- (void)setMaxConcurrentPrefetchDownloads:(NSInteger)maxConcurrentPrefetchDownloads {
+    _scheduler.maxConcurrentPrefetchOperations = maxConcurrentPrefetchDownloads;
+}
+
+- (NSInteger)maxConcurrentPrefetchDownloads {
+    return _scheduler.maxConcurrentPrefetchOperations;
+}
+
+- (void)setMaxBytesPerSecond:(NSUInteger)maxBytesPerSecond {
+    SD_LOCK(_bandwidthBudget->_lock);
+    _bandwidthBudget->_maxBytesPerSecond = maxBytesPerSecond;
+    _bandwidthBudget->_lastRefillTime = 0;
+    SD_UNLOCK(_bandwidthBudget->_lock);
+}
+
+- (NSUInteger)maxBytesPerSecond {
+    SD_LOCK(_bandwidthBudget->_lock);
+    NSUInteger maxBytesPerSecond = _bandwidthBudget->_maxBytesPerSecond;
+    SD_UNLOCK(_bandwidthBudget->_lock);
+    return maxBytesPerSecond;
+}
+
+- (void)setMaxConcurrentDecodes:(NSInteger)maxConcurrentDecodes {
+    _decodeQueue.maxConcurrentOperationCount = maxConcurrentDecodes;
+}
+
+- (NSInteger)maxConcurrentDecodes {
+    return _decodeQueue.maxConcurrentOperationCount;
+}
+
+- (void)setExecutionOrder:(SDWebImageDownloaderExecutionOrder)executionOrder {
+    _scheduler.executionOrder = executionOrder;
+}
+
+- (SDWebImageDownloaderExecutionOrder)executionOrder {
+    return _scheduler.executionOrder;
+}
+
+- (void)setPriorityAgingInterval:(NSTimeInterval)priorityAgingInterval {
+    _scheduler.agingInterval = priorityAgingInterval;
+}
+
+- (NSTimeInterval)priorityAgingInterval {
+    return _scheduler.agingInterval;
+}
+
 - (NSURLSessionConfiguration *)sessionConfiguration {
     return self.session.configuration;
 }
@@ -179,9 +345,17 @@
                                                    options:(SDWebImageDownloaderOptions)options
                                                   progress:(nullable SDWebImageDownloaderProgressBlock)progressBlock
                                                  completed:(nullable SDWebImageDownloaderCompletedBlock)completedBlock {
+    return [self downloadImageWithURL:url options:options requestHeaders:nil progress:progressBlock completed:completedBlock];
+}
+
+- (nullable SDWebImageDownloadToken *)downloadImageWithURL:(nullable NSURL *)url
+                                                   options:(SDWebImageDownloaderOptions)options
+                                            requestHeaders:(nullable NSDictionary<NSString *, NSString *> *)requestHeaders
+                                                  progress:(nullable SDWebImageDownloaderProgressBlock)progressBlock
+                                                 completed:(nullable SDWebImageDownloaderCompletedBlock)completedBlock {
     __weak SDWebImageDownloader *wself = self;
    
-    return [self addProgressCallback:progressBlock completedBlock:completedBlock forURL:url createCallback:^SDWebImageDownloaderOperation *{
+    return [self addProgressCallback:progressBlock completedBlock:completedBlock forURL:url priority:SDWebImageDownloaderPriorityForOptions(options) createCallback:^SDWebImageDownloaderOperation *{
         
         __strong __typeof (wself) sself = wself;
         
@@ -211,10 +385,31 @@
         else {
             request.allHTTPHeaderFields = sself.HTTPHeaders;
         }
+        //这次请求自己的请求头，比如刷新缓存时的 If-None-Match
+        [requestHeaders enumerateKeysAndObjectsUsingBlock:^(NSString *field, NSString *value, BOOL *stop) {
+            [request setValue:value forHTTPHeaderField:field];
+        }];
          // 4.创建操作对象
         SDWebImageDownloaderOperation *operation = [[sself.operationClass alloc] initWithRequest:request inSession:sself.session options:options];
          //是否解压缩返回的图片
         operation.shouldDecompressImages = sself.shouldDecompressImages;
+        //渐进式下载生成部分图片的频率，自定义的 operation 可能没有实现
+        //下载完成后在共用的解码队列中并行解码
+        if ([operation respondsToSelector:@selector(setDecodeQueue:)]) {
+            operation.decodeQueue = sself.decodeQueue;
+        }
+        //中断的下载从已经收到的数据之后续传
+        if ([operation respondsToSelector:@selector(setResumeStore:)]) {
+            operation.resumeStore = sself.resumeStore;
+        }
+        //收到图片头部时检查图片尺寸
+        if ([operation respondsToSelector:@selector(setMaxImagePixelCount:)]) {
+            operation.maxImagePixelCount = sself.maxImagePixelCount;
+        }
+        if ([operation respondsToSelector:@selector(setMinimumProgressiveRenderInterval:)]) {
+            operation.minimumProgressiveRenderBytes = sself.minimumProgressiveRenderBytes;
+            operation.minimumProgressiveRenderInterval = sself.minimumProgressiveRenderInterval;
+        }
         
         // 5.给操作对象设置urlCredential
          //指定验证信息
@@ -225,21 +420,8 @@
             //Basic验证
             operation.credential = [NSURLCredential credentialWithUser:sself.username password:sself.password persistence:NSURLCredentialPersistenceForSession];
         }
-        // 6.指定优先级
-        if (options & SDWebImageDownloaderHighPriority) {
-            operation.queuePriority = NSOperationQueuePriorityHigh;
-        } else if (options & SDWebImageDownloaderLowPriority) {
-            operation.queuePriority = NSOperationQueuePriorityLow;
-        }
-        // 7.把操作添加到队列
-        [sself.downloadQueue addOperation:operation];
-        // 8.根据executionOrder设置，设置依赖   如果是LIFO这种模式，则需要手动指定operation之间的依赖关系
-        if (sself.executionOrder == SDWebImageDownloaderLIFOExecutionOrder) {
-              //如果是LIFO，则让前面的operation依赖于最新添加的operation
-            // Emulate LIFO execution order by systematically adding new operations as last operation's dependency
-            [sself.lastAddedOperation addDependency:operation];
-            sself.lastAddedOperation = operation;
-        }
+        // 6.按优先级把操作交给调度器，有空闲的并发名额时才加入队列，executionOrder 也由调度器处理
+        [sself.scheduler addOperation:operation priority:SDWebImageDownloaderPriorityForOptions(options) host:url.host];
 
         return operation;
     }];
@@ -251,6 +433,7 @@
 - (nullable SDWebImageDownloadToken *)addProgressCallback:(SDWebImageDownloaderProgressBlock)progressBlock
                                            completedBlock:(SDWebImageDownloaderCompletedBlock)completedBlock
                                                    forURL:(nullable NSURL *)url
+                                                 priority:(SDWebImageDownloaderPriority)priority
                                            createCallback:(SDWebImageDownloaderOperation *(^)(void))createCallback {
     // The URL will be used as the key to the callbacks dictionary so it cannot be nil. If it is nil immediately call the completed block with no image or data.
     // 判断 url 是否为 nil，如果为 nil 则直接回调 completedBlock，返回失败的结果，然后 return，因为 url 会作为存储 callbacks 的 key
@@ -263,56 +446,130 @@
         return nil;
     }
 
-    __block SDWebImageDownloadToken *token = nil;
+    SDWebImageDownloadToken *token = nil;
  //因为可能同时下载多张图片，所以就可能出现多个线程同时访问 URLCallbacks 属性的情况。
- //为了保证线程安全，所以这里使用了 dispatch_barrier_sync 来分步执行添加到 barrierQueue 中的任务，这样就能保证同一时间只有一个线程能对 URLCallbacks 进行操作。
+ //为了保证线程安全，URL 所在的分片加锁，这样就能保证同一时间只有一个线程能对同一个 URL 的 operation 进行操作，不同分片的 URL 可以同时操作。
     
     
-// 处理同一个 URL 的多次下载请求（MARK: 使用 dispatch_barrier_sync 函数来保证同一时间只有一个线程能对 URLCallbacks 进行操作)：
+// 处理同一个 URL 的多次下载请求（MARK: 使用分片的锁来保证同一时间只有一个线程能对 URLCallbacks 进行操作)：
 //从属性 URLCallbacks(一个字典) 中取出对应 url 的 callBacksForURL(这是一个数组，因为可能一个 url 不止在一个地方下载)
 //如果没有取到，也就意味着这个 url 是第一次下载，那就初始化一个 callBacksForURL 放到属性 URLCallbacks 中
 //往数组 callBacksForURL 中添加 包装有 callbacks（progressBlock 和 completedBlock）的字典
 //更新 URLCallbacks 存储的对应 url 的 callBacksForURL
     
-    dispatch_barrier_sync(self.barrierQueue, ^{
-        SDWebImageDownloaderOperation *operation = self.URLOperations[url];
-        
-        //如果这个 url 是第一次请求下载，就回调 createCallback
-        if (!operation) {
-            operation = createCallback();
-            self.URLOperations[url] = operation;
-
-            __weak SDWebImageDownloaderOperation *woperation = operation;
-            operation.completionBlock = ^{
-				dispatch_barrier_sync(self.barrierQueue, ^{
-					SDWebImageDownloaderOperation *soperation = woperation;
-					if (!soperation) return;
-					if (self.URLOperations[url] == soperation) {
-						[self.URLOperations removeObjectForKey:url];
-					};
-				});
-            };
+    SDWebImageDownloaderURLShard *shard = [self shardForURL:url];
+    SD_LOCK(shard->_lock);
+    SDWebImageDownloaderOperation *operation = shard->_operations[url];
+    
+    //如果这个 url 是第一次请求下载，或者之前的操作已经结束，就回调 createCallback
+    if (!operation || (operation.isFinished && !SDDownloaderOperationIsDecoding(operation))) {
+        operation = createCallback();
+        shard->_operations[url] = operation;
+        //上一个操作的 token 不再影响新操作的优先级
+        [shard->_tokens removeObjectForKey:url];
+
+        //操作结束后还要等解码结束才移除，解码期间同一个 URL 的请求加入这个操作
+        __weak SDWebImageDownloaderOperation *woperation = operation;
+        SDWebImageNoParamsBlock removeOperationBlock = ^{
+            SDWebImageDownloaderOperation *soperation = woperation;
+            if (!soperation || !soperation.isFinished || SDDownloaderOperationIsDecoding(soperation)) return;
+            SD_LOCK(shard->_lock);
+            if (shard->_operations[url] == soperation) {
+                [shard->_operations removeObjectForKey:url];
+                [shard->_tokens removeObjectForKey:url];
+            }
+            SD_UNLOCK(shard->_lock);
+        };
+        operation.completionBlock = removeOperationBlock;
+        if ([operation respondsToSelector:@selector(setDecodeCompletionBlock:)]) {
+            operation.decodeCompletionBlock = removeOperationBlock;
         }
-        id downloadOperationCancelToken = [operation addHandlersForProgress:progressBlock completed:completedBlock];
-        //　给 token 赋值
-        token = [SDWebImageDownloadToken new];
-        token.url = url;
-        token.downloadOperationCancelToken = downloadOperationCancelToken;
-    });
+    }
+    //　给 token 赋值
+    token = [SDWebImageDownloadToken new];
+    SDWebImageDownloaderCompletedBlock tokenCompletedBlock = completedBlock;
+    if (completedBlock) {
+        //完成时把响应记录到 token 上，刷新缓存时需要 304 响应的缓存有效期
+        //operation 结束时会清空回调，这里强引用它不会循环引用
+        __weak SDWebImageDownloadToken *wtoken = token;
+        tokenCompletedBlock = ^(UIImage *image, NSData *data, NSError *error, BOOL finished) {
+            if (finished && [operation respondsToSelector:@selector(response)]) {
+                wtoken.response = operation.response;
+            }
+            completedBlock(image, data, error, finished);
+        };
+    }
+    id downloadOperationCancelToken = [operation addHandlersForProgress:progressBlock completed:tokenCompletedBlock];
+    token.url = url;
+    token.downloadOperationCancelToken = downloadOperationCancelToken;
+    token.priority = priority;
+    NSMutableArray<SDWebImageDownloadToken *> *tokens = shard->_tokens[url];
+    if (!tokens) {
+        tokens = [NSMutableArray array];
+        shard->_tokens[url] = tokens;
+    }
+    [tokens addObject:token];
+    [self updatePriorityOfOperation:operation inShard:shard forURL:url];
+    SD_UNLOCK(shard->_lock);
 
     return token;
 }
 
+- (nonnull SDWebImageDownloaderURLShard *)shardForURL:(nullable NSURL *)url {
+    return self.URLShards[url.hash % kURLShardCount];
+}
+
+// 下载的优先级取所有 token 中最高的，必须持有分片的锁
+- (void)updatePriorityOfOperation:(NSOperation *)operation inShard:(SDWebImageDownloaderURLShard *)shard forURL:(NSURL *)url {
+    NSArray<SDWebImageDownloadToken *> *tokens = shard->_tokens[url];
+    if (tokens.count == 0) {
+        return;
+    }
+    SDWebImageDownloaderPriority priority = SDWebImageDownloaderPriorityPrefetch;
+    for (SDWebImageDownloadToken *token in tokens) {
+        priority = MAX(priority, token.priority);
+    }
+    [self.scheduler setPriority:priority forOperation:operation];
+}
+
 
 // 移除一个图片加载操作  通过token来确定操作
 - (void)cancel:(nullable SDWebImageDownloadToken *)token {
-    dispatch_barrier_async(self.barrierQueue, ^{
-        SDWebImageDownloaderOperation *operation = self.URLOperations[token.url];
-        BOOL canceled = [operation cancel:token.downloadOperationCancelToken];
-        if (canceled) {
-            [self.URLOperations removeObjectForKey:token.url];
-        }
-    });
+    NSURL *url = token.url;
+    if (!url) {
+        return;
+    }
+    SDWebImageDownloaderURLShard *shard = [self shardForURL:url];
+    SD_LOCK(shard->_lock);
+    SDWebImageDownloaderOperation *operation = shard->_operations[url];
+    BOOL canceled = [operation cancel:token.downloadOperationCancelToken];
+    if (canceled) {
+        [shard->_operations removeObjectForKey:url];
+        [shard->_tokens removeObjectForKey:url];
+    } else if (operation) {
+        // 剩下的 token 可能优先级更低
+        [shard->_tokens[url] removeObjectIdenticalTo:token];
+        [self updatePriorityOfOperation:operation inShard:shard forURL:url];
+    }
+    SD_UNLOCK(shard->_lock);
+    if (canceled) {
+        [self.scheduler removeOperation:operation];
+    }
+}
+
+- (void)setPriority:(SDWebImageDownloaderPriority)priority forToken:(nullable SDWebImageDownloadToken *)token {
+    NSURL *url = token.url;
+    if (!url) {
+        return;
+    }
+    SDWebImageDownloaderURLShard *shard = [self shardForURL:url];
+    SD_LOCK(shard->_lock);
+    token.priority = priority;
+    SDWebImageDownloaderOperation *operation = shard->_operations[url];
+    if (operation && [shard->_tokens[url] indexOfObjectIdenticalTo:token] != NSNotFound) {
+        [self updatePriorityOfOperation:operation inShard:shard forURL:url];
+    }
+    SD_UNLOCK(shard->_lock);
 }
 
 //全部暂停或取消
@@ -321,7 +578,7 @@
 }
 
 - (void)cancelAllDownloads {
-    [self.downloadQueue cancelAllOperations];
+    [self.scheduler cancelAllOperations];
 }
 
 #pragma mark Helper methods
@@ -356,6 +613,17 @@ didReceiveResponse:(NSURLResponse *)response
     SDWebImageDownloaderOperation *dataOperation = [self operationWithTask:dataTask];
 
     [dataOperation URLSession:session dataTask:dataTask didReceiveData:data];
+
+    // 超出带宽预算时暂停这个任务，等预算补充后再继续接收。数据已经收到了，暂停只能限制之后的平均速度
+    // 屏幕上的和高优先级的下载也消耗预算，但是从不暂停，其他下载给它们让出带宽
+    NSTimeInterval delay = [self.bandwidthBudget consumeBytes:data.length];
+    if (delay > 0 && dataOperation.queuePriority < NSOperationQueuePriorityHigh) {
+        [dataTask suspend];
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            // 已经取消的任务 resume 不会有任何效果
+            [dataTask resume];
+        });
+    }
 }
 
 - (void)URLSession:(NSURLSession *)session
@@ -50,6 +50,7 @@
 #import <Foundation/Foundation.h>
 #import "SDWebImageDownloader.h"
 #import "SDWebImageOperation.h"
+#import "SDWebImageDownloadResumeStore.h"
 /*
  SDWebImageDownloaderOperation有四种情况会发送通知：
  
@@ -131,6 +132,54 @@ FOUNDATION_EXPORT NSString * _Nonnull const SDWebImageDownloadFinishNotification
 //是否需要解码(来源于协议
 @property (assign, nonatomic) BOOL shouldDecompressImages;
 
+/**
+ * For progressive downloads, the minimum number of bytes received between two partial images. Defaults to 0.
+ * 渐进式下载时，两次生成部分图片之间至少要收到的字节数
+ */
+@property (assign, nonatomic) NSUInteger minimumProgressiveRenderBytes;
+
+/**
+ * For progressive downloads, the minimum time between two partial images, in seconds. Defaults to 0.1.
+ * The last image is always decoded when the download finishes.
+ * 渐进式下载时，两次生成部分图片之间的最短时间
+ */
+@property (assign, nonatomic) NSTimeInterval minimumProgressiveRenderInterval;
+
+/**
+ * The queue the downloaded image is decoded on, the decode operation gets the priority of the receiver.
+ * If nil, the image is decoded on the session delegate queue.
+ * 下载完成后解码图片的队列，为空时在 NSURLSession 的代理队列中解码
+ */
+@property (strong, nonatomic, nullable) NSOperationQueue *decodeQueue;
+
+/**
+ * Whether the downloaded image is being decoded. The receiver finishes as soon as the download ends, so that it does not
+ * hold a download slot while decoding, but the completion blocks added until the decoding ends are still called with the image.
+ * 下载结束后解码期间为 YES，这时操作已经结束，解码结束前添加的回调也会收到解码后的图片
+ */
+@property (assign, atomic, readonly, getter=isDecoding) BOOL decoding;
+
+/**
+ * Called once the downloaded image has been decoded and the completion blocks called, possibly before the receiver finishes.
+ * 解码结束并且调用了所有回调后调用
+ */
+@property (copy, nonatomic, nullable) SDWebImageNoParamsBlock decodeCompletionBlock;
+
+/**
+ * The store keeping the partial body when the download is cancelled or fails, so the next download of the URL
+ * only requests the missing bytes. If nil, interrupted downloads start over from the first byte.
+ * 下载中断时保存已经收到的数据，下次下载同一个 URL 时续传
+ */
+@property (strong, nonatomic, nullable) SDWebImageDownloadResumeStore *resumeStore;
+
+/**
+ * The maximum number of pixels of a downloaded image, read from the image header as soon as it arrives.
+ * A larger image fails right away, unless `SDWebImageDownloaderScaleDownLargeImages` is set: it is then downloaded
+ * without progressive images and scaled down when decoded. Defaults to 0, no limit.
+ * 图片的最大像素数，收到图片头部时就检查，超过时马上结束下载
+ */
+@property (assign, nonatomic) NSUInteger maxImagePixelCount;
+
 /**
  *  Was used to determine whether the URL connection should consult the credential storage for authenticating the connection.
  *  @deprecated Not used for a couple of versions
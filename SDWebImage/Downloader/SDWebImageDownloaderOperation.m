@@ -10,6 +10,8 @@
 #import "SDWebImageManager.h"
 #import "NSImage+WebCache.h"
 #import "SDWebImageCodersManager.h"
+#import "SDWebImageChunkedData.h"
+#import "SDWebImageImageHeader.h"
 /**
  
  我们的目的是下载一张图片，那么我们最核心的逻辑是什么呢？
@@ -27,6 +29,63 @@ NSString *const SDWebImageDownloadFinishNotification = @"SDWebImageDownloadFinis
 static NSString *const kProgressCallbackKey = @"progress";
 static NSString *const kCompletedCallbackKey = @"completed";
 
+static float SDURLSessionTaskPriorityForQueuePriority(NSOperationQueuePriority queuePriority) {
+    if (queuePriority > NSOperationQueuePriorityNormal) {
+        return NSURLSessionTaskPriorityHigh;
+    } else if (queuePriority < NSOperationQueuePriorityNormal) {
+        return NSURLSessionTaskPriorityLow;
+    }
+    return NSURLSessionTaskPriorityDefault;
+}
+// 选择渐进式解码器时只需要数据的头部
+static const NSUInteger kProgressiveCoderSniffLength = 64;
+// 最多在这么多字节中查找图片的尺寸，JPEG 的 EXIF 段可能很长，超过时交给解码器处理
+static const NSUInteger kImageHeaderSniffLength = 256 * 1024;
+
+// The validator sent as `If-Range` when resuming: a strong ETag, or the Last-Modified date. Weak ETags can not be used for ranges.
+static NSString *SDResumeValidatorForResponse(NSURLResponse *response) {
+    if (![response isKindOfClass:[NSHTTPURLResponse class]]) {
+        return nil;
+    }
+    NSDictionary *headers = ((NSHTTPURLResponse *)response).allHeaderFields;
+    NSString *acceptRanges = headers[@"Accept-Ranges"];
+    if (acceptRanges && [acceptRanges caseInsensitiveCompare:@"none"] == NSOrderedSame) {
+        return nil;
+    }
+    NSString *ETag = headers[@"ETag"];
+    if (ETag.length > 0 && ![ETag hasPrefix:@"W/"]) {
+        return ETag;
+    }
+    NSString *lastModified = headers[@"Last-Modified"];
+    return lastModified.length > 0 ? lastModified : nil;
+}
+
+// Check that a `206 Partial Content` response continues right after the bytes already received,
+// `Content-Range: bytes <offset>-<last>/<total>`. The total length is returned if known, 0 otherwise.
+static BOOL SDResponseContinuesAtOffset(NSURLResponse *response, NSUInteger offset, NSUInteger *totalLength) {
+    if (![response isKindOfClass:[NSHTTPURLResponse class]] || ((NSHTTPURLResponse *)response).statusCode != 206) {
+        return NO;
+    }
+    NSString *contentRange = ((NSHTTPURLResponse *)response).allHeaderFields[@"Content-Range"];
+    if (!contentRange) {
+        return NO;
+    }
+    NSScanner *scanner = [NSScanner scannerWithString:contentRange];
+    long long first = 0;
+    long long last = 0;
+    if (![scanner scanString:@"bytes" intoString:NULL] ||
+        ![scanner scanLongLong:&first] ||
+        ![scanner scanString:@"-" intoString:NULL] ||
+        ![scanner scanLongLong:&last] ||
+        ![scanner scanString:@"/" intoString:NULL] ||
+        first != (long long)offset || last < first) {
+        return NO;
+    }
+    long long total = 0;
+    *totalLength = [scanner scanLongLong:&total] && total > last ? (NSUInteger)total : 0;
+    return YES;
+}
+
 typedef NSMutableDictionary<NSString *, id> SDCallbacksDictionary;
 
 @interface SDWebImageDownloaderOperation ()
@@ -47,10 +106,11 @@ typedef NSMutableDictionary<NSString *, id> SDCallbacksDictionary;
   */
 @property (assign, nonatomic, getter = isExecuting) BOOL executing;
 @property (assign, nonatomic, getter = isFinished) BOOL finished;
+@property (assign, atomic, readwrite, getter=isDecoding) BOOL decoding;
 /**
- 存储图片数据
+ 存储图片数据，收到的数据块直接保存，不拼接拷贝
  */
-@property (strong, nonatomic, nullable) NSMutableData *imageData;
+@property (strong, nonatomic, nullable) SDWebImageChunkedData *imageData;
 @property (copy, nonatomic, nullable) NSData *cachedData;
 /**
  通过SDWebImageDownloader传过来。所以这里是weak。因为他是通过SDWebImageDownloader管理的。
@@ -72,10 +132,11 @@ typedef NSMutableDictionary<NSString *, id> SDCallbacksDictionary;
  */
 @property (strong, nonatomic, readwrite, nullable) NSURLSessionTask *dataTask;
 /**
- 一个并行queue。用于控制数据的处理
- barrierQueue 是一个 GCD 队列
+ 保护 callbackBlocks 的锁
+ 原来用一个并行 queue 加 dispatch_barrier 来保护，每次添加、取消回调都要派发一个 block，滚动时竞争很激烈；
+ 回调数组的操作都很短，直接加锁开销更小
  */
-@property (strong, nonatomic, nullable) dispatch_queue_t barrierQueue;
+@property (strong, nonatomic, nonnull) dispatch_semaphore_t callbacksLock;
 /**
  如果用户设置了后台继续加载选线。则通过backgroundTask来继续下载图片
  backgroundTaskId 是在 app 进入后台后申请的后台任务的身份。
@@ -85,6 +146,23 @@ typedef NSMutableDictionary<NSString *, id> SDCallbacksDictionary;
 #endif
 
 @property (strong, nonatomic, nullable) id<SDWebImageProgressiveCoder> progressiveCoder;
+// 上一次生成部分图片时收到的字节数和时间
+@property (assign, nonatomic) NSUInteger lastProgressiveRenderSize;
+@property (assign, nonatomic) CFAbsoluteTime lastProgressiveRenderTime;
+
+// 续传时之前保存的部分数据，收到响应前有效
+@property (strong, nonatomic, nullable) NSData *partialData;
+// 这次下载是否是从保存的部分数据续传的
+@property (assign, nonatomic) BOOL resumedFromPartialData;
+// 响应的校验值，下载中断时和收到的数据一起保存
+@property (copy, nonatomic, nullable) NSString *responseValidator;
+
+// 是否已经检查过图片头部
+@property (assign, nonatomic) BOOL imageHeaderChecked;
+// 检查图片头部前收到的数据，每次只追加新收到的字节，检查之后释放
+@property (strong, nonatomic, nullable) NSMutableData *imageHeaderData;
+// 图片超过 maxImagePixelCount，但是会缩小解码，不生成部分图片
+@property (assign, nonatomic) BOOL imageExceedsMaxPixelCount;
 
 @end
 
@@ -110,8 +188,10 @@ typedef NSMutableDictionary<NSString *, id> SDCallbacksDictionary;
         _executing = NO;
         _finished = NO;
         _expectedSize = 0;
+        _minimumProgressiveRenderBytes = 0;
+        _minimumProgressiveRenderInterval = 0.1;
         _unownedSession = session;
-        _barrierQueue = dispatch_queue_create("com.hackemist.SDWebImageDownloaderOperationBarrierQueue", DISPATCH_QUEUE_CONCURRENT);
+        _callbacksLock = dispatch_semaphore_create(1);
     }
     return self;
 }
@@ -126,7 +206,8 @@ typedef NSMutableDictionary<NSString *, id> SDCallbacksDictionary;
  dispatch_barrier_sync控制了任务往队列添加这一过程，只有当我的任务完成之后，才能往队列中添加任务。
  dispatch_barrier_async不会控制队列添加任务。但是只有当我的任务完成后，队列中后边的任务才会执行。
  
- 那么在这里的任务是往数组中添加数据，对顺序没什么要求，我们采取dispatch_barrier_async就可以了，已经能保证数据添加的安全性了。
+ 原来这里的任务是往数组中添加数据，对顺序没什么要求，采取的是dispatch_barrier_async。
+ 现在改成了直接加锁：往数组中添加一个元素的时间很短，派发一个 block 的开销反而更大。
  
  */
 - (nullable id)addHandlersForProgress:(nullable SDWebImageDownloaderProgressBlock)progressBlock
@@ -138,16 +219,16 @@ typedef NSMutableDictionary<NSString *, id> SDCallbacksDictionary;
     if (completedBlock) callbacks[kCompletedCallbackKey] = [completedBlock copy];
   
     //把完成和进度Block加入callbackBlocks中
-    dispatch_barrier_async(self.barrierQueue, ^{
-        [self.callbackBlocks addObject:callbacks];
-    });
+    SD_LOCK(self.callbacksLock);
+    [self.callbackBlocks addObject:callbacks];
+    SD_UNLOCK(self.callbacksLock);
     return callbacks;
 }
 
 
-//这个方法是根据key取出所有符合key的block，这里采用了同步的方式，相当于加锁。
+//这个方法是根据key取出所有符合key的block，在锁内遍历回调数组。
 /*
- 比较有意思的是[self.callbackBlocks valueForKey:key]这段代码，self.callbackBlocks是一个数组，我们假定他的结构是这样的：
+ 原来用的是[self.callbackBlocks valueForKey:key]，self.callbackBlocks是一个数组，我们假定他的结构是这样的：
  
  @[@{@"completed" : Block1},
  @{@"progress" : Block2},
@@ -159,29 +240,31 @@ typedef NSMutableDictionary<NSString *, id> SDCallbacksDictionary;
  removeObjectIdenticalTo:这个方法会移除数组中指定相同地址的元素。
 */
 - (nullable NSArray<id> *)callbacksForKey:(NSString *)key {
-    __block NSMutableArray<id> *callbacks = nil;
-    dispatch_sync(self.barrierQueue, ^{
-        // We need to remove [NSNull null] because there might not always be a progress block for each callback
-        callbacks = [[self.callbackBlocks valueForKey:key] mutableCopy];
-        //　移除 callbacks 里面的 [NSNull null]。
-        [callbacks removeObjectIdenticalTo:[NSNull null]];
-    });
+    SD_LOCK(self.callbacksLock);
+    NSMutableArray<id> *callbacks = [NSMutableArray arrayWithCapacity:self.callbackBlocks.count];
+    for (SDCallbacksDictionary *callbackBlock in self.callbackBlocks) {
+        // There might not always be a progress block for each callback
+        id callback = callbackBlock[key];
+        if (callback) {
+            [callbacks addObject:callback];
+        }
+    }
+    SD_UNLOCK(self.callbacksLock);
     return [callbacks copy];    // strip mutability here
 }
 
 
 //这个函数，就是取消某一回调。
-//使用了dispatch_barrier_sync，保证，必须该队列之前的任务都完成，且该取消任务结束后，在将其他的任务加入队列。
-//在 self.barrierQueue 同步删除 self.callbackBlocks 里面的指定回调
+//在锁内同步删除 self.callbackBlocks 里面的指定回调
 //当 self.callbackBlocks 里面的回调删除完的时候，取消操作。
 - (BOOL)cancel:(nullable id)token {
-    __block BOOL shouldCancel = NO;
-    dispatch_barrier_sync(self.barrierQueue, ^{
-        [self.callbackBlocks removeObjectIdenticalTo:token];
-        if (self.callbackBlocks.count == 0) {
-            shouldCancel = YES;
-        }
-    });
+    BOOL shouldCancel = NO;
+    SD_LOCK(self.callbacksLock);
+    [self.callbackBlocks removeObjectIdenticalTo:token];
+    if (self.callbackBlocks.count == 0) {
+        shouldCancel = YES;
+    }
+    SD_UNLOCK(self.callbacksLock);
     if (shouldCancel) {
         [self cancel];
     }
@@ -272,7 +355,22 @@ typedef NSMutableDictionary<NSString *, id> SDCallbacksDictionary;
             session = self.ownedSession;
         }
         
-        self.dataTask = [session dataTaskWithRequest:self.request];
+        NSURLRequest *request = self.request;
+        //有保存的部分数据时只请求剩下的部分，图片已经变化时服务器会返回完整的数据
+        if (self.resumeStore && request.URL && !(self.options & SDWebImageDownloaderUseNSURLCache)) {
+            NSString *validator = nil;
+            NSData *partialData = [self.resumeStore partialDataForURL:request.URL validator:&validator];
+            if (partialData) {
+                NSMutableURLRequest *rangeRequest = [request mutableCopy];
+                [rangeRequest setValue:[NSString stringWithFormat:@"bytes=%lu-", (unsigned long)partialData.length] forHTTPHeaderField:@"Range"];
+                [rangeRequest setValue:validator forHTTPHeaderField:@"If-Range"];
+                request = rangeRequest;
+                self.partialData = partialData;
+                self.responseValidator = validator;
+            }
+        }
+        self.dataTask = [session dataTaskWithRequest:request];
+        self.dataTask.priority = SDURLSessionTaskPriorityForQueuePriority(self.queuePriority);
         self.executing = YES;
     }
     //发送请求
@@ -321,6 +419,10 @@ typedef NSMutableDictionary<NSString *, id> SDCallbacksDictionary;
 
     if (self.dataTask) {
         [self.dataTask cancel];
+        //保存已经收到的数据，reset 清空数据的 block 排在后面
+        [[self sessionDelegateQueue] addOperationWithBlock:^{
+            [self storePartialData];
+        }];
         __weak typeof(self) weakSelf = self;
         dispatch_async(dispatch_get_main_queue(), ^{
             [[NSNotificationCenter defaultCenter] postNotificationName:SDWebImageDownloadStopNotification object:weakSelf];
@@ -347,18 +449,16 @@ typedef NSMutableDictionary<NSString *, id> SDCallbacksDictionary;
  如果任务已经被设置为取消了，那么就无需开启下载任务了，并进行重置
  */
 - (void)reset {
-    __weak typeof(self) weakSelf = self;
-    dispatch_barrier_async(self.barrierQueue, ^{
-        [weakSelf.callbackBlocks removeAllObjects];
-    });
+    SD_LOCK(self.callbacksLock);
+    // 解码期间的回调在解码结束后调用并清空
+    if (!self.isDecoding) {
+        [self.callbackBlocks removeAllObjects];
+    }
+    SD_UNLOCK(self.callbacksLock);
     self.dataTask = nil;
     
-    NSOperationQueue *delegateQueue;
-    if (self.unownedSession) {
-        delegateQueue = self.unownedSession.delegateQueue;
-    } else {
-        delegateQueue = self.ownedSession.delegateQueue;
-    }
+    __weak typeof(self) weakSelf = self;
+    NSOperationQueue *delegateQueue = [self sessionDelegateQueue];
     if (delegateQueue) {
         NSAssert(delegateQueue.maxConcurrentOperationCount == 1, @"NSURLSession delegate queue should be a serial queue");
         [delegateQueue addOperationWithBlock:^{
@@ -385,6 +485,21 @@ typedef NSMutableDictionary<NSString *, id> SDCallbacksDictionary;
     [self didChangeValueForKey:@"isExecuting"];
 }
 
+- (nullable NSOperationQueue *)sessionDelegateQueue {
+    if (self.unownedSession) {
+        return self.unownedSession.delegateQueue;
+    }
+    return self.ownedSession.delegateQueue;
+}
+
+// 下载过程中调整优先级时，同时调整网络请求的优先级
+- (void)setQueuePriority:(NSOperationQueuePriority)queuePriority {
+    [super setQueuePriority:queuePriority];
+    @synchronized (self) {
+        self.dataTask.priority = SDURLSessionTaskPriorityForQueuePriority(queuePriority);
+    }
+}
+
 // 返回YES，表明这个NSOperation对象是并发的
 
 - (BOOL)isConcurrent {
@@ -411,14 +526,43 @@ didReceiveResponse:(NSURLResponse *)response
         //期望的总长度
         NSInteger expected = (NSInteger)response.expectedContentLength;
         expected = expected > 0 ? expected : 0;
+        
+        //初始化 self.imageData
+        self.imageData = [SDWebImageChunkedData new];
+        NSString *requestValidator = self.responseValidator;
+        self.responseValidator = SDResumeValidatorForResponse(response);
+        NSData *partialData = self.partialData;
+        self.partialData = nil;
+        if (partialData) {
+            NSUInteger totalLength = 0;
+            if (SDResponseContinuesAtOffset(response, partialData.length, &totalLength)) {
+                //206：接在保存的数据后面继续下载
+                [self.imageData appendData:partialData];
+                self.resumedFromPartialData = YES;
+                if (!self.responseValidator) {
+                    self.responseValidator = requestValidator;
+                }
+                expected = totalLength > 0 ? (NSInteger)totalLength : (expected > 0 ? expected + (NSInteger)partialData.length : 0);
+            } else {
+                //200：图片已经变化，服务器返回了完整的数据
+                [self.resumeStore removePartialDataForURL:self.request.URL];
+                if (((NSHTTPURLResponse *)response).statusCode == 206) {
+                    //返回的范围接不上保存的数据，不能使用
+                    [self.dataTask cancel];
+                    [self callCompletionBlocksWithError:[NSError errorWithDomain:NSURLErrorDomain code:206 userInfo:@{NSLocalizedDescriptionKey : @"Unexpected partial content range"}]];
+                    [self done];
+                    if (completionHandler) {
+                        completionHandler(NSURLSessionResponseCancel);
+                    }
+                    return;
+                }
+            }
+        }
         self.expectedSize = expected;
         //进度回调Block   执行 self.callbackBlocks 里面表示进度的回调 block，
         for (SDWebImageDownloaderProgressBlock progressBlock in [self callbacksForKey:kProgressCallbackKey]) {
-            progressBlock(0, expected, self.request.URL);
+            progressBlock(self.imageData.length, expected, self.request.URL);
         }
-        
-        //给 self.imageData 根据 expectedSize 的大小初始化，
-        self.imageData = [[NSMutableData alloc] initWithCapacity:expected];
         //把 response  赋值给 self.response
         self.response = response;
         __weak typeof(self) weakSelf = self;
@@ -435,6 +579,10 @@ didReceiveResponse:(NSURLResponse *)response
         //This is the case when server returns '304 Not Modified'. It means that remote image is not changed.
         //In case of 304 we need just cancel the operation and return cached image from the cache.
         //如果返回304表示图片么有变化。在这种情况下，我们只需要取消operation并且返回缓存的图片就可以了。
+        //304 的响应带有新的缓存有效期，刷新缓存时需要用到
+        self.response = response;
+        //cancelInternal 会清空回调，先取出完成回调，否则 304 永远不会通知调用方
+        NSArray<id> *completionBlocks = [self callbacksForKey:kCompletedCallbackKey];
         if (code == 304) {
             [self cancelInternal];
         } else {
@@ -444,8 +592,8 @@ didReceiveResponse:(NSURLResponse *)response
         dispatch_async(dispatch_get_main_queue(), ^{
             [[NSNotificationCenter defaultCenter] postNotificationName:SDWebImageDownloadStopNotification object:weakSelf];
         });
-        //调用 callCompletionBlocksWithError: 方法，携带错误信息回调。
-        [self callCompletionBlocksWithError:[NSError errorWithDomain:NSURLErrorDomain code:((NSHTTPURLResponse *)response).statusCode userInfo:nil]];
+        //携带错误信息回调。
+        [self callCompletionBlocks:completionBlocks withImage:nil imageData:nil error:[NSError errorWithDomain:NSURLErrorDomain code:code userInfo:nil] finished:YES];
 
         [self done];
     }
@@ -461,29 +609,56 @@ didReceiveResponse:(NSURLResponse *)response
  更新进度、拼接图片数据
  */
 - (void)URLSession:(NSURLSession *)session dataTask:(NSURLSessionDataTask *)dataTask didReceiveData:(NSData *)data {
+    //数据块直接保存，不拷贝
     [self.imageData appendData:data];
 
-    if ((self.options & SDWebImageDownloaderProgressiveDownload) && self.expectedSize > 0) {
-        // Get the image data
-        NSData *imageData = [self.imageData copy];
+    //收到图片头部时就判断图片是否过大或者无法解码，不用等到下载完成
+    if (!self.imageHeaderChecked && ![self checkImageHeader]) {
+        return;
+    }
+
+    if ((self.options & SDWebImageDownloaderProgressiveDownload) && self.expectedSize > 0 && !self.imageExceedsMaxPixelCount) {
         // Get the total bytes downloaded
         //获取已经下载的数据长度
-        const NSInteger totalSize = imageData.length;
+        const NSUInteger totalSize = self.imageData.length;
         // Get the finish status
         BOOL finished = (totalSize >= self.expectedSize);
         
+        BOOL appendedAllData = NO;
         if (!self.progressiveCoder) {
             // We need to create a new instance for progressive decoding to avoid conflicts
+            NSData *headerData = [self.imageData prefixDataWithLength:kProgressiveCoderSniffLength];
             for (id<SDWebImageCoder>coder in [SDWebImageCodersManager sharedInstance].coders) {
                 if ([coder conformsToProtocol:@protocol(SDWebImageProgressiveCoder)] &&
-                    [((id<SDWebImageProgressiveCoder>)coder) canIncrementallyDecodeFromData:imageData]) {
+                    [((id<SDWebImageProgressiveCoder>)coder) canIncrementallyDecodeFromData:headerData]) {
                     self.progressiveCoder = [[[coder class] alloc] init];
                     break;
                 }
             }
+            if ([self progressiveCoderAppendsIncrementally]) {
+                // The coder starts with all the data received so far
+                [self.progressiveCoder appendIncrementalData:[self.imageData data]];
+                appendedAllData = YES;
+            }
         }
         
-        UIImage *image = [self.progressiveCoder incrementallyDecodedImageWithData:imageData finished:finished];
+        BOOL appendsIncrementally = [self progressiveCoderAppendsIncrementally];
+        if (appendsIncrementally && !appendedAllData) {
+            //只把新收到的数据交给解码器
+            [self.progressiveCoder appendIncrementalData:data];
+        }
+        
+        UIImage *image = nil;
+        if (self.progressiveCoder && [self shouldRenderProgressiveImageWithTotalSize:totalSize finished:finished]) {
+            self.lastProgressiveRenderSize = totalSize;
+            self.lastProgressiveRenderTime = CFAbsoluteTimeGetCurrent();
+            if (appendsIncrementally) {
+                image = [self.progressiveCoder incrementallyDecodedImageWithFinished:finished];
+            } else {
+                // Coders which do not support appending need all the data so far
+                image = [self.progressiveCoder incrementallyDecodedImageWithData:[self.imageData data] finished:finished];
+            }
+        }
         if (image) {
             NSString *key = [[SDWebImageManager sharedManager] cacheKeyForURL:self.request.URL];
             image = [self scaledImageForKey:key image:image];
@@ -500,6 +675,91 @@ didReceiveResponse:(NSURLResponse *)response
     }
 }
 
+// Check the format and the size in the image header once enough bytes arrived.
+// Return NO if the download was aborted because the image is too large or can not be decoded
+- (BOOL)checkImageHeader {
+    NSUInteger length = MIN(self.imageData.length, kImageHeaderSniffLength);
+    NSUInteger parsedLength = self.imageHeaderData.length;
+    // 收到的数据翻倍或者达到上限时才重新解析，JPEG 的 SOF 在很大的 EXIF / ICC 之后时不用每个数据块都解析一次
+    if (parsedLength > 0 && length < parsedLength * 2 && length < kImageHeaderSniffLength) {
+        return YES;
+    }
+    if (!self.imageHeaderData) {
+        self.imageHeaderData = [NSMutableData data];
+    }
+    NSMutableData *headerData = self.imageHeaderData;
+    headerData.length = length;
+    [self.imageData getBytes:(uint8_t *)headerData.mutableBytes + parsedLength range:NSMakeRange(parsedLength, length - parsedLength)];
+    SDImageHeader header;
+    SDImageHeaderStatus status = SDImageHeaderParse(headerData.bytes, headerData.length, &header);
+    if (status == SDImageHeaderStatusNeedMoreData && length < kImageHeaderSniffLength) {
+        return YES;
+    }
+    self.imageHeaderChecked = YES;
+    self.imageHeaderData = nil;
+
+    NSError *error = nil;
+    if (status == SDImageHeaderStatusInvalid) {
+        error = [NSError errorWithDomain:SDWebImageErrorDomain code:0 userInfo:@{NSLocalizedDescriptionKey : @"Image header is corrupt"}];
+    } else if (![self canDecodeImageHeaderData:headerData]) {
+        error = [NSError errorWithDomain:SDWebImageErrorDomain code:0 userInfo:@{NSLocalizedDescriptionKey : @"Image format is not supported"}];
+    } else if (status == SDImageHeaderStatusComplete && self.maxImagePixelCount > 0 &&
+               (uint64_t)header.width * header.height > self.maxImagePixelCount) {
+        if (self.options & SDWebImageDownloaderScaleDownLargeImages) {
+            //下载完成后缩小解码，全尺寸的部分图片太占内存
+            self.imageExceedsMaxPixelCount = YES;
+        } else {
+            NSString *description = [NSString stringWithFormat:@"Image is too large: %u x %u pixels", header.width, header.height];
+            error = [NSError errorWithDomain:SDWebImageErrorDomain code:0 userInfo:@{NSLocalizedDescriptionKey : description}];
+        }
+    }
+    if (error) {
+        [self abortWithError:error];
+        return NO;
+    }
+    return YES;
+}
+
+- (BOOL)canDecodeImageHeaderData:(NSData *)headerData {
+    for (id<SDWebImageCoder> coder in [SDWebImageCodersManager sharedInstance].coders) {
+        if ([coder canDecodeFromData:headerData]) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+// 放弃下载，已经收到的数据没有用，不保存用于续传
+- (void)abortWithError:(NSError *)error {
+    NSArray<id> *completionBlocks = [self callbacksForKey:kCompletedCallbackKey];
+    self.responseValidator = nil;
+    if (self.resumedFromPartialData) {
+        [self.resumeStore removePartialDataForURL:self.request.URL];
+    }
+    [self cancelInternal];
+    [self callCompletionBlocks:completionBlocks withImage:nil imageData:nil error:error finished:YES];
+    [self done];
+}
+
+- (BOOL)progressiveCoderAppendsIncrementally {
+    return [self.progressiveCoder respondsToSelector:@selector(appendIncrementalData:)] &&
+           [self.progressiveCoder respondsToSelector:@selector(incrementallyDecodedImageWithFinished:)];
+}
+
+// 限制生成部分图片的频率，下载完成时总是生成最后的图片
+- (BOOL)shouldRenderProgressiveImageWithTotalSize:(NSUInteger)totalSize finished:(BOOL)finished {
+    if (finished) {
+        return YES;
+    }
+    if (self.lastProgressiveRenderSize == 0) {
+        return YES;
+    }
+    if (totalSize - self.lastProgressiveRenderSize < self.minimumProgressiveRenderBytes) {
+        return NO;
+    }
+    return CFAbsoluteTimeGetCurrent() - self.lastProgressiveRenderTime >= self.minimumProgressiveRenderInterval;
+}
+
 
 
 
@@ -540,13 +800,19 @@ didReceiveResponse:(NSURLResponse *)response
     }
     
     if (error) {
+        [self storePartialData];
         [self callCompletionBlocksWithError:error];
     } else {
-        if ([self callbacksForKey:kCompletedCallbackKey].count > 0) {
+        if (self.resumedFromPartialData) {
+            [self.resumeStore removePartialDataForURL:self.request.URL];
+        }
+        NSArray<id> *completionBlocks = [self callbacksForKey:kCompletedCallbackKey];
+        if (completionBlocks.count > 0) {
             /**
              *  If you specified to use `NSURLCache`, then the response you get here is what you need.
              */
-            NSData *imageData = [self.imageData copy];
+            // 合并所有数据块，只拷贝一次
+            NSData *imageData = [self.imageData data];
             if (imageData) {
                 /**  if you specified to only use cached data via `SDWebImageDownloaderIgnoreCachedResponse`,
                  *  then we should check if the cached data is equal to image data
@@ -555,37 +821,10 @@ didReceiveResponse:(NSURLResponse *)response
                     // call completion block with nil
                     [self callCompletionBlocksWithImage:nil imageData:nil error:nil finished:YES];
                 } else {
-                    UIImage *image = [[SDWebImageCodersManager sharedInstance] decodedImageWithData:imageData];
-                    //获取url对应的缓存Key
-                    NSString *key = [[SDWebImageManager sharedManager] cacheKeyForURL:self.request.URL];
-                    image = [self scaledImageForKey:key image:image];
-                    
-                    BOOL shouldDecode = YES;
-                    // Do not force decoding animated GIFs and WebPs
-                    if (image.images) {
-                        shouldDecode = NO;
-                    } else {
-#ifdef SD_WEBP
-                        SDImageFormat imageFormat = [NSData sd_imageFormatForImageData:imageData];
-                        if (imageFormat == SDImageFormatWebP) {
-                            shouldDecode = NO;
-                        }
-#endif
-                    }
-                    
-                    if (shouldDecode) {
-                        //是否解码图片数据
-
-                        if (self.shouldDecompressImages) {
-                            BOOL shouldScaleDown = self.options & SDWebImageDownloaderScaleDownLargeImages;
-                            image = [[SDWebImageCodersManager sharedInstance] decompressedImageWithImage:image data:&imageData options:@{SDWebImageCoderScaleDownLargeImagesKey: @(shouldScaleDown)}];
-                        }
-                    }
-                    if (CGSizeEqualToSize(image.size, CGSizeZero)) {
-                        [self callCompletionBlocksWithError:[NSError errorWithDomain:SDWebImageErrorDomain code:0 userInfo:@{NSLocalizedDescriptionKey : @"Downloaded image has 0 pixels"}]];
-                    } else {
-                        [self callCompletionBlocksWithImage:image imageData:imageData error:nil finished:YES];
-                    }
+                    //下载操作马上结束，不占用下载的并发数，解码在解码队列中并行执行
+                    //解码结束前操作仍然留在 downloader 里，同一个 URL 的请求不会重新下载
+                    self.decoding = YES;
+                    [self decodeImageData:imageData];
                 }
             } else {
                 [self callCompletionBlocksWithError:[NSError errorWithDomain:SDWebImageErrorDomain code:0 userInfo:@{NSLocalizedDescriptionKey : @"Image data is nil"}]];
@@ -632,7 +871,94 @@ didReceiveResponse:(NSURLResponse *)response
     }
 }
 
+#pragma mark Decoding
+
+- (void)decodeImageData:(nonnull NSData *)data {
+    dispatch_block_t decodeBlock = ^{
+        @autoreleasepool {
+            NSData *imageData = data;
+            BOOL shouldScaleDown = (self.options & SDWebImageDownloaderScaleDownLargeImages) != 0;
+            // 需要缩小的大图在解码时直接缩小，不生成原始大小的位图
+            UIImage *image = [[SDWebImageCodersManager sharedInstance] decodedImageWithData:imageData options:@{SDWebImageCoderScaleDownLargeImagesKey: @(shouldScaleDown)}];
+            //获取url对应的缓存Key
+            NSString *key = [[SDWebImageManager sharedManager] cacheKeyForURL:self.request.URL];
+            image = [self scaledImageForKey:key image:image];
+            
+            BOOL shouldDecode = YES;
+            // Do not force decoding animated GIFs and WebPs
+            if (image.images) {
+                shouldDecode = NO;
+            } else {
+#ifdef SD_WEBP
+                SDImageFormat imageFormat = [NSData sd_imageFormatForImageData:imageData];
+                if (imageFormat == SDImageFormatWebP) {
+                    shouldDecode = NO;
+                }
+#endif
+            }
+            
+            if (shouldDecode) {
+                //是否解码图片数据
+
+                if (self.shouldDecompressImages) {
+                    image = [[SDWebImageCodersManager sharedInstance] decompressedImageWithImage:image data:&imageData options:@{SDWebImageCoderScaleDownLargeImagesKey: @(shouldScaleDown)}];
+                }
+            }
+            if (CGSizeEqualToSize(image.size, CGSizeZero)) {
+                [self finishDecodingWithImage:nil imageData:nil error:[NSError errorWithDomain:SDWebImageErrorDomain code:0 userInfo:@{NSLocalizedDescriptionKey : @"Downloaded image has 0 pixels"}]];
+            } else {
+                [self finishDecodingWithImage:image imageData:imageData error:nil];
+            }
+        }
+    };
+    
+    NSOperationQueue *decodeQueue = self.decodeQueue;
+    if (!decodeQueue) {
+        decodeBlock();
+        return;
+    }
+    // 高优先级下载的图片先解码
+    NSBlockOperation *decodeOperation = [NSBlockOperation blockOperationWithBlock:decodeBlock];
+    decodeOperation.queuePriority = self.queuePriority;
+    [decodeQueue addOperation:decodeOperation];
+}
+
+// 取出解码期间所有的回调，包括操作结束后才加入的
+- (void)finishDecodingWithImage:(nullable UIImage *)image imageData:(nullable NSData *)imageData error:(nullable NSError *)error {
+    NSMutableArray<id> *completionBlocks = [NSMutableArray array];
+    SD_LOCK(self.callbacksLock);
+    for (SDCallbacksDictionary *callbackBlock in self.callbackBlocks) {
+        id callback = callbackBlock[kCompletedCallbackKey];
+        if (callback) {
+            [completionBlocks addObject:callback];
+        }
+    }
+    [self.callbackBlocks removeAllObjects];
+    self.decoding = NO;
+    SD_UNLOCK(self.callbacksLock);
+    [self callCompletionBlocks:completionBlocks withImage:image imageData:imageData error:error finished:YES];
+    SDWebImageNoParamsBlock decodeCompletionBlock = self.decodeCompletionBlock;
+    self.decodeCompletionBlock = nil;
+    if (decodeCompletionBlock) {
+        decodeCompletionBlock();
+    }
+}
+
 #pragma mark Helper methods
+
+// 保存中断的下载已经收到的数据，必须在 session 的代理队列中调用
+- (void)storePartialData {
+    SDWebImageDownloadResumeStore *resumeStore = self.resumeStore;
+    NSString *validator = self.responseValidator;
+    NSUInteger length = self.imageData.length;
+    if (!resumeStore || !validator || length == 0 || !self.request.URL) {
+        return;
+    }
+    if (self.expectedSize > 0 && length >= (NSUInteger)self.expectedSize) {
+        return;
+    }
+    [resumeStore storePartialData:[self.imageData data] validator:validator forURL:self.request.URL];
+}
 /**
  * 通过image对象获取对应scale模式下的图像
  */
@@ -667,6 +993,14 @@ didReceiveResponse:(NSURLResponse *)response
     //获取key对应的回调Block数组
 
     NSArray<id> *completionBlocks = [self callbacksForKey:kCompletedCallbackKey];
+    [self callCompletionBlocks:completionBlocks withImage:image imageData:imageData error:error finished:finished];
+}
+
+- (void)callCompletionBlocks:(nonnull NSArray<id> *)completionBlocks
+                   withImage:(nullable UIImage *)image
+                   imageData:(nullable NSData *)imageData
+                       error:(nullable NSError *)error
+                    finished:(BOOL)finished {
     //调用回调
 
     dispatch_main_async_safe(^{
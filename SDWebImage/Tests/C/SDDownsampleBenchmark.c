@@ -0,0 +1,204 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+/*
+ 解码时缩小的性能测试
+
+ 40 和 100 百万像素的 JPEG，缩小到 SDWebImageCoderScaleDownLargeImagesKey 的像素预算和 1024 像素，比较两种做法的时间和峰值内存：
+ - 原始大小解码再缩小：先解码出原始大小的位图，再用 SDWebImageResampler 缩小，和缩小大图时重绘的做法相同
+ - 解码时缩小：libjpeg 的 DCT 缩放直接解码出不小于目标的位图（1/8 到 8/8），再缩小到目标大小，和 ImageIO 的缩略图相同
+ 每次在单独的子进程中运行，峰值内存是子进程的 ru_maxrss 减去开始时的值。
+ */
+
+#include "SDWebImageResampler.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <jpeglib.h>
+
+// The same budget as SDWebImageCoderScaleDownLargeImagesKey, 60MB of 4 bytes pixels
+static const double kScaleDownMaxPixelCount = 60.0 * 1024 * 1024 / 4;
+
+typedef struct SDJPEGData {
+    unsigned char *bytes;
+    unsigned long length;
+    size_t width;
+    size_t height;
+} SDJPEGData;
+
+static double SDNow(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+// Peak resident set size in bytes
+static double SDPeakMemory(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return (double)usage.ru_maxrss;
+#else
+    return usage.ru_maxrss * 1024.0;
+#endif
+}
+
+// 渐变加上纹理，接近照片的压缩率；逐行编码，不生成整张位图
+static SDJPEGData SDJPEGCreate(size_t width, size_t height) {
+    SDJPEGData data = {NULL, 0, width, height};
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr error;
+    cinfo.err = jpeg_std_error(&error);
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, &data.bytes, &data.length);
+    cinfo.image_width = (JDIMENSION)width;
+    cinfo.image_height = (JDIMENSION)height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, 85, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    unsigned char *row = malloc(width * 3);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        size_t y = cinfo.next_scanline;
+        for (size_t x = 0; x < width; x++) {
+            row[x * 3] = (unsigned char)(x * 255 / width);
+            row[x * 3 + 1] = (unsigned char)(y * 255 / height);
+            row[x * 3 + 2] = (unsigned char)(((x / 13) ^ (y / 11)) * 5);
+        }
+        JSAMPROW rows[1] = {row};
+        jpeg_write_scanlines(&cinfo, rows, 1);
+    }
+    free(row);
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    return data;
+}
+
+// 和 SDImageDecodeMaxPixelSize 相同：两个限制中较小的一个，0 表示不缩小
+static size_t SDMaxPixelSize(size_t width, size_t height, size_t maxPixelSize, bool scaleDown) {
+    size_t largerSide = width > height ? width : height;
+    double pixelCount = (double)width * height;
+    if (scaleDown && pixelCount > kScaleDownMaxPixelCount) {
+        size_t scaledSize = (size_t)(largerSide * sqrt(kScaleDownMaxPixelCount / pixelCount));
+        scaledSize = scaledSize > 0 ? scaledSize : 1;
+        maxPixelSize = maxPixelSize > 0 && maxPixelSize < scaledSize ? maxPixelSize : scaledSize;
+    }
+    return maxPixelSize >= largerSide ? 0 : maxPixelSize;
+}
+
+// 解码为 RGBX，scaleNumerator / 8 是 DCT 缩放的比例
+static uint8_t *SDJPEGDecode(const SDJPEGData *data, unsigned int scaleNumerator, size_t *width, size_t *height) {
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_error_mgr error;
+    cinfo.err = jpeg_std_error(&error);
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, data->bytes, data->length);
+    jpeg_read_header(&cinfo, TRUE);
+    cinfo.scale_num = scaleNumerator;
+    cinfo.scale_denom = 8;
+#ifdef JCS_EXTENSIONS
+    cinfo.out_color_space = JCS_EXT_RGBX;
+#else
+    cinfo.out_color_space = JCS_RGB;
+#endif
+    jpeg_start_decompress(&cinfo);
+    *width = cinfo.output_width;
+    *height = cinfo.output_height;
+    size_t bytesPerRow = *width * 4;
+    uint8_t *pixels = malloc(bytesPerRow * *height);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        uint8_t *row = pixels + cinfo.output_scanline * bytesPerRow;
+        JSAMPROW rows[1] = {row};
+        jpeg_read_scanlines(&cinfo, rows, 1);
+#ifndef JCS_EXTENSIONS
+        // 在同一行中从后往前扩展为 4 字节的像素
+        for (size_t x = *width; x > 0; x--) {
+            row[(x - 1) * 4 + 3] = 0xFF;
+            row[(x - 1) * 4 + 2] = row[(x - 1) * 3 + 2];
+            row[(x - 1) * 4 + 1] = row[(x - 1) * 3 + 1];
+            row[(x - 1) * 4] = row[(x - 1) * 3];
+        }
+#endif
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return pixels;
+}
+
+static uint8_t *SDResample(const uint8_t *src, size_t srcWidth, size_t srcHeight, size_t dstWidth, size_t dstHeight) {
+    uint8_t *dst = malloc(dstWidth * dstHeight * 4);
+    SDImageResampler *resampler = SDImageResamplerCreate(srcWidth, srcHeight, dstWidth, dstHeight, SDImageResampleFilterMitchell, 64);
+    for (size_t band = 0; band < SDImageResamplerGetBandCount(resampler); band++) {
+        size_t srcRow, srcRowCount, dstRow, dstRowCount;
+        SDImageResamplerGetBandSourceRows(resampler, band, &srcRow, &srcRowCount);
+        SDImageResamplerGetBandDestinationRows(resampler, band, &dstRow, &dstRowCount);
+        SDImageResamplerProcessBand(resampler, band, src + srcRow * srcWidth * 4, srcWidth * 4, dst + dstRow * dstWidth * 4, dstWidth * 4);
+    }
+    SDImageResamplerRelease(resampler);
+    return dst;
+}
+
+static void SDDecode(const SDJPEGData *data, size_t maxPixelSize, bool downsample) {
+    double memory = SDPeakMemory();
+    double start = SDNow();
+    size_t largerSide = data->width > data->height ? data->width : data->height;
+    size_t dstWidth = (size_t)round((double)data->width * maxPixelSize / largerSide);
+    size_t dstHeight = (size_t)round((double)data->height * maxPixelSize / largerSide);
+    // 解码时缩小：最小的不比目标小的 DCT 缩放
+    unsigned int scaleNumerator = 8;
+    while (downsample && scaleNumerator > 1 && (data->width * (scaleNumerator - 1) + 7) / 8 >= dstWidth && (data->height * (scaleNumerator - 1) + 7) / 8 >= dstHeight) {
+        scaleNumerator--;
+    }
+    size_t width, height;
+    uint8_t *pixels = SDJPEGDecode(data, scaleNumerator, &width, &height);
+    double decodeTime = SDNow() - start;
+    uint8_t *scaled = SDResample(pixels, width, height, dstWidth, dstHeight);
+    double time = SDNow() - start;
+    printf("  %-22s %5zux%-5zu %7.0f ms (decode %6.0f ms) peak +%6.1f MB\n", downsample ? "downsampled decode" : "full decode + redraw",
+           width, height, time * 1000, decodeTime * 1000, (SDPeakMemory() - memory) / 1e6);
+    free(pixels);
+    free(scaled);
+}
+
+// 在子进程中运行，峰值内存互不影响
+static void SDRunInChild(const SDJPEGData *data, size_t maxPixelSize, bool downsample) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        SDDecode(data, maxPixelSize, downsample);
+        fflush(stdout);
+        _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+}
+
+int main(void) {
+    static const size_t sizes[][2] = {{7744, 5164}, {12240, 8160}};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        SDJPEGData data = SDJPEGCreate(sizes[i][0], sizes[i][1]);
+        printf("%zux%zu (%.0f MP), JPEG %.1f MB, full size bitmap %.1f MB\n", data.width, data.height, data.width * data.height / 1e6,
+               data.length / 1e6, data.width * data.height * 4 / 1e6);
+        size_t targets[2] = {SDMaxPixelSize(data.width, data.height, 0, true), SDMaxPixelSize(data.width, data.height, 1024, false)};
+        const char *names[2] = {"scale down", "max pixel size 1024"};
+        for (size_t t = 0; t < 2; t++) {
+            printf(" %s: %zu\n", names[t], targets[t]);
+            SDRunInChild(&data, targets[t], false);
+            SDRunInChild(&data, targets[t], true);
+        }
+        free(data.bytes);
+    }
+    return 0;
+}
@@ -0,0 +1,141 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+/*
+ GIF 解码器的性能测试
+
+ 320x240、100 帧的动画，统计创建解码器、按顺序渲染和随机跳转渲染的速度，以及峰值内存。
+ 之前的实现一次解码所有帧并全部保留，作为对比，最后按同样的方式把每一帧复制一份保留下来。
+ 峰值内存只增不减，所以先测按需渲染，再测全部保留。
+ */
+
+#include "SDTestGIF.h"
+#include "SDWebImageGIFDecoder.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+
+static const uint32_t kWidth = 320;
+static const uint32_t kHeight = 240;
+static const size_t kFrameCount = 100;
+static const size_t kRepeatCount = 5;
+
+static double SDNow(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+// Peak resident set size in bytes
+static double SDPeakMemory(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return (double)usage.ru_maxrss;
+#else
+    return usage.ru_maxrss * 1024.0;
+#endif
+}
+
+// 每一帧在画布上移动的一块噪点，和一个每帧都变的透明区域
+static SDBuffer SDBenchmarkGIF(void) {
+    uint8_t colorTable[256 * 3];
+    SDTestGIFFillColorTable(colorTable, 256, 7);
+    SDTestGIFFrame *frames = calloc(kFrameCount, sizeof(SDTestGIFFrame));
+    uint8_t **indexes = calloc(kFrameCount, sizeof(uint8_t *));
+    uint32_t state = 1;
+    for (size_t i = 0; i < kFrameCount; i++) {
+        bool full = i % 20 == 0;
+        uint32_t width = full ? kWidth : 120;
+        uint32_t height = full ? kHeight : 90;
+        indexes[i] = malloc((size_t)width * height);
+        for (size_t p = 0; p < (size_t)width * height; p++) {
+            state = state * 1103515245u + 12345u;
+            // 有长串也有噪点，接近真实动画的压缩率
+            indexes[i][p] = (p / 16) % 3 == 0 ? (uint8_t)(state >> 24) : (uint8_t)(i + p / width);
+        }
+        SDTestGIFFrame frame = {
+            .x = full ? 0 : (uint32_t)(i * 7) % (kWidth - width),
+            .y = full ? 0 : (uint32_t)(i * 3) % (kHeight - height),
+            .width = width, .height = height, .indexes = indexes[i], .transparentIndex = full ? -1 : 0,
+            .disposal = i % 4 == 3 ? SDGIFDisposalPrevious : SDGIFDisposalKeep, .delay = 4};
+        frames[i] = frame;
+    }
+    SDBuffer data = SDTestGIFCreate(kWidth, kHeight, colorTable, 256, 0, frames, kFrameCount);
+    for (size_t i = 0; i < kFrameCount; i++) {
+        free(indexes[i]);
+    }
+    free(indexes);
+    free(frames);
+    return data;
+}
+
+int main(void) {
+    SDBuffer data = SDBenchmarkGIF();
+    size_t canvasLength = (size_t)kWidth * kHeight * 4;
+    printf("GIF: %ux%u, %zu frames, %.1f KB\n", kWidth, kHeight, kFrameCount, data.length / 1024.0);
+    double baseMemory = SDPeakMemory();
+
+    double start = SDNow();
+    for (size_t r = 0; r < kRepeatCount * 20; r++) {
+        SDGIFDecoderRelease(SDGIFDecoderCreate(data.bytes, data.length));
+    }
+    double createTime = (SDNow() - start) / (kRepeatCount * 20);
+    printf("create: %.3f ms\n", createTime * 1000);
+
+    SDGIFDecoder *decoder = SDGIFDecoderCreate(data.bytes, data.length);
+    if (!decoder) {
+        fprintf(stderr, "failed to create the decoder\n");
+        return 1;
+    }
+    start = SDNow();
+    for (size_t r = 0; r < kRepeatCount; r++) {
+        for (size_t i = 0; i < kFrameCount; i++) {
+            SDGIFDecoderRenderFrame(decoder, i);
+        }
+    }
+    double sequentialTime = SDNow() - start;
+    size_t renderCount = kRepeatCount * kFrameCount;
+    printf("sequential render: %.1f frames/s, %.1f MB/s\n", renderCount / sequentialTime, renderCount * canvasLength / sequentialTime / 1e6);
+
+    uint32_t state = 21;
+    start = SDNow();
+    for (size_t r = 0; r < renderCount; r++) {
+        state = state * 1103515245u + 12345u;
+        SDGIFDecoderRenderFrame(decoder, (state >> 16) % kFrameCount);
+    }
+    double seekTime = SDNow() - start;
+    printf("random seek render: %.1f frames/s\n", renderCount / seekTime);
+    double lazyMemory = SDPeakMemory() - baseMemory;
+    printf("on demand peak memory: +%.1f MB\n", lazyMemory / 1e6);
+
+    // 之前的做法：所有帧解码后一直保留
+    uint8_t **frames = calloc(kFrameCount, sizeof(uint8_t *));
+    start = SDNow();
+    for (size_t i = 0; i < kFrameCount; i++) {
+        const uint8_t *canvas = SDGIFDecoderRenderFrame(decoder, i);
+        frames[i] = malloc(canvasLength);
+        if (canvas) {
+            memcpy(frames[i], canvas, canvasLength);
+        } else {
+            memset(frames[i], 0, canvasLength);
+        }
+    }
+    double eagerTime = SDNow() - start;
+    double eagerMemory = SDPeakMemory() - baseMemory;
+    printf("decode all frames: %.1f ms, peak memory: +%.1f MB (%zu frames x %.2f MB)\n", eagerTime * 1000, eagerMemory / 1e6, kFrameCount, canvasLength / 1e6);
+
+    for (size_t i = 0; i < kFrameCount; i++) {
+        free(frames[i]);
+    }
+    free(frames);
+    SDGIFDecoderRelease(decoder);
+    free(data.bytes);
+    return 0;
+}
@@ -0,0 +1,504 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#include "SDTestAssert.h"
+#include "SDTestGIF.h"
+#include "SDWebImageGIFDecoder.h"
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define SDCount(array) (sizeof(array) / sizeof((array)[0]))
+
+typedef struct SDTestGIF {
+    uint32_t width;
+    uint32_t height;
+    const uint8_t *colorTable;
+    uint32_t colorCount;
+    const SDTestGIFFrame *frames;
+    size_t frameCount;
+} SDTestGIF;
+
+static uint32_t SDRandomState = 1;
+
+static uint32_t SDRandom(void) {
+    SDRandomState = SDRandomState * 1103515245u + 12345u;
+    return SDRandomState >> 16;
+}
+
+static uint8_t *SDRandomIndexes(size_t count, uint32_t colorCount) {
+    uint8_t *indexes = malloc(count ? count : 1);
+    for (size_t i = 0; i < count; i++) {
+        indexes[i] = (uint8_t)(SDRandom() % colorCount);
+    }
+    return indexes;
+}
+
+/*
+ 参照的合成，和解码器的实现无关：按顺序把每一帧画到画布上，画下一帧之前按上一帧的处理方式清除或者恢复。
+ 返回 frameCount 块画布，每块 width * height 个 RGBA 像素
+ */
+static uint8_t **SDReferenceFrames(const SDTestGIF *gif) {
+    size_t canvasLength = (size_t)gif->width * gif->height * 4;
+    uint8_t **frames = calloc(gif->frameCount, sizeof(uint8_t *));
+    uint8_t *canvas = calloc(canvasLength ? canvasLength : 1, 1);
+    uint8_t *saved = calloc(canvasLength ? canvasLength : 1, 1);
+    for (size_t i = 0; i < gif->frameCount; i++) {
+        const SDTestGIFFrame *frame = &gif->frames[i];
+        if (i > 0) {
+            const SDTestGIFFrame *previous = &gif->frames[i - 1];
+            if (previous->disposal == SDGIFDisposalBackground) {
+                for (uint32_t y = previous->y; y < previous->y + previous->height && y < gif->height; y++) {
+                    for (uint32_t x = previous->x; x < previous->x + previous->width && x < gif->width; x++) {
+                        memset(canvas + ((size_t)y * gif->width + x) * 4, 0, 4);
+                    }
+                }
+            } else if (previous->disposal == SDGIFDisposalPrevious) {
+                memcpy(canvas, saved, canvasLength);
+            }
+        }
+        if (frame->disposal == SDGIFDisposalPrevious) {
+            memcpy(saved, canvas, canvasLength);
+        }
+        const uint8_t *colorTable = frame->colorTable ? frame->colorTable : gif->colorTable;
+        uint32_t colorCount = frame->colorTable ? frame->colorCount : gif->colorCount;
+        for (uint32_t y = 0; y < frame->height; y++) {
+            for (uint32_t x = 0; x < frame->width; x++) {
+                uint8_t index = frame->indexes[(size_t)y * frame->width + x];
+                if ((int)index == frame->transparentIndex || frame->x + x >= gif->width || frame->y + y >= gif->height) {
+                    continue;
+                }
+                uint8_t *pixel = canvas + ((size_t)(frame->y + y) * gif->width + frame->x + x) * 4;
+                // 颜色表外的索引画成黑色，写入时颜色表补齐到 2 的幂的部分也是黑色
+                bool inTable = index < colorCount;
+                pixel[0] = inTable ? colorTable[index * 3] : 0;
+                pixel[1] = inTable ? colorTable[index * 3 + 1] : 0;
+                pixel[2] = inTable ? colorTable[index * 3 + 2] : 0;
+                pixel[3] = 0xFF;
+            }
+        }
+        frames[i] = malloc(canvasLength ? canvasLength : 1);
+        memcpy(frames[i], canvas, canvasLength);
+    }
+    free(canvas);
+    free(saved);
+    return frames;
+}
+
+static void SDFreeFrames(uint8_t **frames, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        free(frames[i]);
+    }
+    free(frames);
+}
+
+static SDBuffer SDTestGIFData(const SDTestGIF *gif, int loopCount) {
+    return SDTestGIFCreate(gif->width, gif->height, gif->colorTable, gif->colorCount, loopCount, gif->frames, gif->frameCount);
+}
+
+// 按 order 的顺序渲染，每一帧都和参照的合成逐字节相同
+static void SDAssertRenderOrder(const char *name, const SDBuffer *data, const SDTestGIF *gif, uint8_t **reference, const size_t *order, size_t orderCount) {
+    SDGIFDecoder *decoder = SDGIFDecoderCreate(data->bytes, data->length);
+    SDAssert(decoder != NULL, "%s", name);
+    if (!decoder) {
+        return;
+    }
+    SDAssertEqual(SDGIFDecoderGetWidth(decoder), gif->width, "%s", name);
+    SDAssertEqual(SDGIFDecoderGetHeight(decoder), gif->height, "%s", name);
+    SDAssertEqual(SDGIFDecoderGetFrameCount(decoder), gif->frameCount, "%s", name);
+    size_t canvasLength = (size_t)gif->width * gif->height * 4;
+    for (size_t i = 0; i < orderCount; i++) {
+        size_t index = order[i];
+        const uint8_t *canvas = SDGIFDecoderRenderFrame(decoder, index);
+        SDAssert(canvas != NULL, "%s: frame %zu", name, index);
+        if (canvas) {
+            SDAssertEqualBytes(canvas, reference[index], canvasLength, "%s: frame %zu (step %zu)", name, index, i);
+        }
+    }
+    SDGIFDecoderRelease(decoder);
+}
+
+static void SDAssertSequentialRendering(const char *name, const SDTestGIF *gif) {
+    SDBuffer data = SDTestGIFData(gif, 0);
+    uint8_t **reference = SDReferenceFrames(gif);
+    size_t *order = malloc(gif->frameCount * sizeof(size_t));
+    for (size_t i = 0; i < gif->frameCount; i++) {
+        order[i] = i;
+    }
+    SDAssertRenderOrder(name, &data, gif, reference, order, gif->frameCount);
+    free(order);
+    SDFreeFrames(reference, gif->frameCount);
+    free(data.bytes);
+}
+
+static void SDTestKnownBytes(void) {
+    // 用其他编码器生成的 1x1 GIF：两色的全局颜色表（黑、白），LZW 数据 0x44 0x01 是清除码、索引 0、结束码
+    static const uint8_t black[] = "GIF89a\x01\x00\x01\x00\x80\x00\x00\x00\x00\x00\xFF\xFF\xFF\x2C\x00\x00\x00\x00\x01\x00\x01\x00\x00\x02\x02\x44\x01\x00\x3B";
+    static const uint8_t white[] = "GIF89a\x01\x00\x01\x00\x80\x00\x00\x00\x00\x00\xFF\xFF\xFF\x2C\x00\x00\x00\x00\x01\x00\x01\x00\x00\x02\x02\x4C\x01\x00\x3B";
+    static const uint8_t transparent[] = "GIF89a\x01\x00\x01\x00\x80\x00\x00\x00\x00\x00\xFF\xFF\xFF\x21\xF9\x04\x01\x00\x00\x00\x00\x2C\x00\x00\x00\x00\x01\x00\x01\x00\x00\x02\x02\x44\x01\x00\x3B";
+    struct {
+        const char *name;
+        const uint8_t *bytes;
+        size_t length;
+        uint8_t pixel[4];
+    } cases[] = {
+        {"black", black, sizeof(black) - 1, {0, 0, 0, 0xFF}},
+        {"white", white, sizeof(white) - 1, {0xFF, 0xFF, 0xFF, 0xFF}},
+        {"transparent", transparent, sizeof(transparent) - 1, {0, 0, 0, 0}},
+    };
+    for (size_t i = 0; i < SDCount(cases); i++) {
+        SDGIFDecoder *decoder = SDGIFDecoderCreate(cases[i].bytes, cases[i].length);
+        SDAssert(decoder != NULL, "%s", cases[i].name);
+        if (!decoder) {
+            continue;
+        }
+        SDAssertEqual(SDGIFDecoderGetFrameCount(decoder), 1, "%s", cases[i].name);
+        SDAssertEqual(SDGIFDecoderGetLoopCount(decoder), 0, "%s", cases[i].name);
+        const uint8_t *canvas = SDGIFDecoderRenderFrame(decoder, 0);
+        SDAssert(canvas && memcmp(canvas, cases[i].pixel, 4) == 0, "%s", cases[i].name);
+        SDGIFDecoderRelease(decoder);
+    }
+
+    // 不是 GIF，或者没有完整的帧
+    SDAssert(SDGIFDecoderCreate(NULL, 0) == NULL, "empty");
+    SDAssert(SDGIFDecoderCreate((const uint8_t *)"GIF90a\x01\x00\x01\x00", 10) == NULL, "unknown version");
+    SDAssert(SDGIFDecoderCreate(black, 19) == NULL, "no frame");
+    SDAssert(SDGIFDecoderCreate((const uint8_t *)"\x89PNG\r\n\x1A\n", 8) == NULL, "PNG");
+}
+
+static void SDTestLZW(void) {
+    uint8_t colorTable[256 * 3];
+    SDTestGIFFillColorTable(colorTable, 256, 3);
+    uint8_t localTable[16 * 3];
+    SDTestGIFFillColorTable(localTable, 16, 101);
+
+    // 256 色的随机像素很快填满 4096 个编码的字典，数据中有多次清除码
+    uint8_t *noise = SDRandomIndexes(97 * 61, 256);
+    // 少量颜色的长串，解码时经常遇到还没有加入字典的编码（KwKwK）
+    uint8_t *runs = malloc(200 * 150);
+    for (size_t i = 0; i < 200 * 150; i++) {
+        runs[i] = (uint8_t)((i / 7 + i / 1300) % 4);
+    }
+    // 一种颜色的大面积，字典中的串长到几千个索引
+    uint8_t *flat = calloc(300 * 300, 1);
+    uint8_t *local = SDRandomIndexes(40 * 30, 16);
+    // 两色的局部颜色表，最小编码长度仍是 2，索引 2 和 3 在颜色表之外
+    uint8_t *outOfTable = SDRandomIndexes(16 * 16, 4);
+    static const uint8_t twoColors[] = {0x12, 0x34, 0x56, 0xAB, 0xCD, 0xEF};
+
+    SDTestGIFFrame frames[][1] = {
+        {{.x = 0, .y = 0, .width = 97, .height = 61, .indexes = noise, .transparentIndex = -1, .disposal = SDGIFDisposalNone, .delay = 10}},
+        {{.x = 0, .y = 0, .width = 200, .height = 150, .indexes = runs, .transparentIndex = -1, .disposal = SDGIFDisposalNone, .delay = 10}},
+        {{.x = 0, .y = 0, .width = 300, .height = 300, .indexes = flat, .transparentIndex = -1, .disposal = SDGIFDisposalNone, .delay = 10}},
+        {{.x = 0, .y = 0, .width = 40, .height = 30, .indexes = local, .transparentIndex = 5, .disposal = SDGIFDisposalNone, .delay = 10, .colorTable = localTable, .colorCount = 16}},
+        {{.x = 0, .y = 0, .width = 16, .height = 16, .indexes = outOfTable, .transparentIndex = -1, .disposal = SDGIFDisposalNone, .delay = 10, .colorTable = twoColors, .colorCount = 2}},
+    };
+    const char *names[] = {"256 colors noise", "4 color runs", "flat", "local color table", "indexes outside the color table"};
+    for (size_t i = 0; i < SDCount(frames); i++) {
+        SDTestGIF gif = {frames[i][0].width, frames[i][0].height, colorTable, 256, frames[i], 1};
+        SDAssertSequentialRendering(names[i], &gif);
+    }
+
+    free(noise);
+    free(runs);
+    free(flat);
+    free(local);
+    free(outOfTable);
+}
+
+static void SDTestInterlacing(void) {
+    uint8_t colorTable[64 * 3];
+    SDTestGIFFillColorTable(colorTable, 64, 9);
+    // 各种高度下四遍扫描的行数不同，1 到 4 行时后面几遍是空的
+    static const uint32_t heights[] = {1, 2, 3, 4, 5, 7, 8, 9, 13, 16, 17, 33};
+    for (size_t i = 0; i < SDCount(heights); i++) {
+        uint32_t width = 7;
+        uint8_t *indexes = SDRandomIndexes((size_t)width * heights[i], 64);
+        SDTestGIFFrame frame = {.x = 0, .y = 0, .width = width, .height = heights[i], .indexes = indexes, .transparentIndex = -1, .disposal = SDGIFDisposalNone, .interlaced = true};
+        SDTestGIF gif = {width, heights[i], colorTable, 64, &frame, 1};
+        char name[32];
+        snprintf(name, sizeof(name), "interlaced height %u", heights[i]);
+        SDAssertSequentialRendering(name, &gif);
+
+        SDBuffer data = SDTestGIFData(&gif, -1);
+        SDGIFDecoder *decoder = SDGIFDecoderCreate(data.bytes, data.length);
+        SDAssert(decoder && SDGIFDecoderGetFrameInfo(decoder, 0).interlaced, "%s", name);
+        SDGIFDecoderRelease(decoder);
+        free(data.bytes);
+        free(indexes);
+    }
+}
+
+/*
+ 有各种处理方式的动画，32x24：
+ 0 全画布不透明（关键帧）；1 局部透明，背景；2 局部透明，恢复；3 局部，保留；4 局部，恢复；5 超出画布，背景；
+ 6 全画布透明；7 全画布不透明，背景（关键帧）；8 局部（上一帧清除了全画布，关键帧）；9 局部，恢复；10 局部
+ */
+#define SDDisposalFrameCount 11
+
+typedef struct SDDisposalGIF {
+    SDTestGIF gif;
+    SDTestGIFFrame frames[SDDisposalFrameCount];
+    uint8_t colorTable[16 * 3];
+    uint8_t *indexes[SDDisposalFrameCount];
+} SDDisposalGIF;
+
+static void SDDisposalGIFInit(SDDisposalGIF *gif) {
+    static const struct {
+        uint32_t x, y, width, height;
+        int transparentIndex;
+        SDGIFDisposal disposal;
+    } layout[SDDisposalFrameCount] = {
+        {0, 0, 32, 24, -1, SDGIFDisposalNone},
+        {4, 4, 10, 8, 0, SDGIFDisposalBackground},
+        {8, 6, 12, 10, 3, SDGIFDisposalPrevious},
+        {0, 0, 6, 6, -1, SDGIFDisposalKeep},
+        {10, 10, 16, 12, 1, SDGIFDisposalPrevious},
+        {24, 18, 12, 10, -1, SDGIFDisposalBackground},
+        {0, 0, 32, 24, 2, SDGIFDisposalNone},
+        {0, 0, 32, 24, -1, SDGIFDisposalBackground},
+        {5, 3, 9, 9, 4, SDGIFDisposalNone},
+        {12, 0, 20, 24, 0, SDGIFDisposalPrevious},
+        {2, 14, 8, 8, -1, SDGIFDisposalNone},
+    };
+    SDTestGIFFillColorTable(gif->colorTable, 16, 17);
+    for (size_t i = 0; i < SDDisposalFrameCount; i++) {
+        gif->indexes[i] = SDRandomIndexes((size_t)layout[i].width * layout[i].height, 16);
+        SDTestGIFFrame frame = {.x = layout[i].x, .y = layout[i].y, .width = layout[i].width, .height = layout[i].height, .indexes = gif->indexes[i], .transparentIndex = layout[i].transparentIndex, .disposal = layout[i].disposal, .delay = (uint16_t)(i + 1), .interlaced = i % 3 == 1};
+        gif->frames[i] = frame;
+    }
+    SDTestGIF testGIF = {32, 24, gif->colorTable, 16, gif->frames, SDDisposalFrameCount};
+    gif->gif = testGIF;
+}
+
+static void SDDisposalGIFFree(SDDisposalGIF *gif) {
+    for (size_t i = 0; i < SDDisposalFrameCount; i++) {
+        free(gif->indexes[i]);
+    }
+}
+
+static void SDTestDisposal(void) {
+    SDDisposalGIF disposal;
+    SDDisposalGIFInit(&disposal);
+    SDAssertSequentialRendering("disposal", &disposal.gif);
+
+    SDBuffer data = SDTestGIFData(&disposal.gif, 3);
+    SDGIFDecoder *decoder = SDGIFDecoderCreate(data.bytes, data.length);
+    SDAssert(decoder != NULL, "disposal");
+    if (decoder) {
+        SDAssertEqual(SDGIFDecoderGetLoopCount(decoder), 3, "loop count");
+        for (size_t i = 0; i < SDDisposalFrameCount; i++) {
+            const SDTestGIFFrame *frame = &disposal.frames[i];
+            SDGIFFrameInfo info = SDGIFDecoderGetFrameInfo(decoder, i);
+            SDAssertEqual(info.x, frame->x, "frame %zu", i);
+            SDAssertEqual(info.y, frame->y, "frame %zu", i);
+            SDAssertEqual(info.width, frame->width, "frame %zu", i);
+            SDAssertEqual(info.height, frame->height, "frame %zu", i);
+            SDAssertEqual(info.delay, frame->delay, "frame %zu", i);
+            SDAssertEqual(info.disposal, frame->disposal, "frame %zu", i);
+            SDAssertEqual(info.hasTransparency, frame->transparentIndex >= 0, "frame %zu", i);
+            SDAssertEqual(info.interlaced, frame->interlaced, "frame %zu", i);
+        }
+        SDAssert(SDGIFDecoderRenderFrame(decoder, SDDisposalFrameCount) == NULL, "frame out of range");
+        SDGIFDecoderRelease(decoder);
+    }
+    free(data.bytes);
+    SDDisposalGIFFree(&disposal);
+}
+
+static void SDTestSeek(void) {
+    SDDisposalGIF disposal;
+    SDDisposalGIFInit(&disposal);
+    SDBuffer data = SDTestGIFData(&disposal.gif, 0);
+    uint8_t **reference = SDReferenceFrames(&disposal.gif);
+
+    // 倒序、跳跃和重复：每一帧都和按顺序合成的相同，和之前渲染过哪些帧无关
+    size_t reverse[SDDisposalFrameCount];
+    for (size_t i = 0; i < SDDisposalFrameCount; i++) {
+        reverse[i] = SDDisposalFrameCount - 1 - i;
+    }
+    SDAssertRenderOrder("reverse", &data, &disposal.gif, reference, reverse, SDDisposalFrameCount);
+    static const size_t jumps[] = {9, 9, 2, 4, 3, 10, 0, 7, 8, 5, 6, 1, 10, 10, 4};
+    SDAssertRenderOrder("jumps", &data, &disposal.gif, reference, jumps, SDCount(jumps));
+    size_t random[500];
+    for (size_t i = 0; i < SDCount(random); i++) {
+        random[i] = SDRandom() % SDDisposalFrameCount;
+    }
+    SDAssertRenderOrder("random", &data, &disposal.gif, reference, random, SDCount(random));
+    // 每一帧都从新的解码器开始渲染
+    for (size_t i = 0; i < SDDisposalFrameCount; i++) {
+        SDAssertRenderOrder("fresh decoder", &data, &disposal.gif, reference, &i, 1);
+    }
+
+    SDFreeFrames(reference, SDDisposalFrameCount);
+    free(data.bytes);
+    SDDisposalGIFFree(&disposal);
+}
+
+static void SDTestTruncation(void) {
+    SDDisposalGIF disposal;
+    SDDisposalGIFInit(&disposal);
+    SDBuffer data = SDTestGIFData(&disposal.gif, 0);
+    uint8_t **reference = SDReferenceFrames(&disposal.gif);
+    size_t canvasLength = 32 * 24 * 4;
+
+    // 每一个前缀：不会越界读取，只保留数据完整的帧，这些帧和完整文件中的相同
+    size_t previousCount = 0;
+    for (size_t length = 0; length <= data.length; length++) {
+        // 复制到刚好 length 字节的内存中，越界读取可以被内存检查工具发现
+        uint8_t *prefix = malloc(length ? length : 1);
+        memcpy(prefix, data.bytes, length);
+        SDGIFDecoder *decoder = SDGIFDecoderCreate(prefix, length);
+        size_t frameCount = decoder ? SDGIFDecoderGetFrameCount(decoder) : 0;
+        SDAssert(decoder == NULL || frameCount > 0, "prefix of %zu bytes", length);
+        SDAssert(frameCount >= previousCount, "prefix of %zu bytes lost frames", length);
+        // 每个前缀都渲染所有的帧开销太大，只渲染帧数变化的前缀和一部分其他的前缀
+        bool render = frameCount != previousCount || length % 97 == 0 || length == data.length;
+        previousCount = frameCount;
+        if (decoder && render) {
+            for (size_t i = 0; i < frameCount; i++) {
+                const uint8_t *canvas = SDGIFDecoderRenderFrame(decoder, i);
+                SDAssert(canvas && memcmp(canvas, reference[i], canvasLength) == 0, "prefix of %zu bytes: frame %zu", length, i);
+            }
+        }
+        SDGIFDecoderRelease(decoder);
+        free(prefix);
+    }
+    SDAssertEqual(previousCount, SDDisposalFrameCount, "complete file");
+
+    // 缺少结尾 0x3B 的文件仍然有全部的帧
+    SDGIFDecoder *decoder = SDGIFDecoderCreate(data.bytes, data.length - 1);
+    SDAssertEqual(decoder ? SDGIFDecoderGetFrameCount(decoder) : 0, SDDisposalFrameCount, "no trailer");
+    SDGIFDecoderRelease(decoder);
+
+    SDFreeFrames(reference, SDDisposalFrameCount);
+    free(data.bytes);
+    SDDisposalGIFFree(&disposal);
+}
+
+static void SDTestTruncatedLZW(void) {
+    uint8_t colorTable[8 * 3];
+    SDTestGIFFillColorTable(colorTable, 8, 5);
+    uint8_t *background = SDRandomIndexes(20 * 20, 8);
+    uint8_t *indexes = SDRandomIndexes(20 * 20, 8);
+    // 第二帧的 LZW 数据只有 150 个像素就结束了，其余的像素保持上一帧的内容；帧有透明色，不是关键帧
+    SDTestGIFFrame frames[] = {
+        {.x = 0, .y = 0, .width = 20, .height = 20, .indexes = background, .transparentIndex = -1, .disposal = SDGIFDisposalNone, .delay = 10},
+        {.x = 0, .y = 0, .width = 20, .height = 20, .indexes = indexes, .transparentIndex = 7, .disposal = SDGIFDisposalNone, .delay = 10, .encodedPixelCount = 150},
+        {.x = 0, .y = 0, .width = 20, .height = 20, .indexes = indexes, .transparentIndex = -1, .disposal = SDGIFDisposalNone, .delay = 10, .encodedPixelCount = 150},
+    };
+    SDTestGIF gif = {20, 20, colorTable, 8, frames, 3};
+    // 参照的合成画出了全部的像素，只有前 150 个像素和解码的结果相同
+    uint8_t **reference = SDReferenceFrames(&gif);
+    uint8_t transparent[(400 - 150) * 4] = {0};
+    SDBuffer data = SDTestGIFData(&gif, 0);
+    for (size_t order = 0; order < 2; order++) {
+        // 按顺序渲染，和新的解码器直接跳到每一帧
+        SDGIFDecoder *decoder = SDGIFDecoderCreate(data.bytes, data.length);
+        SDAssert(decoder != NULL, "truncated LZW");
+        if (!decoder) {
+            continue;
+        }
+        SDAssertEqual(SDGIFDecoderGetFrameCount(decoder), 3, "truncated LZW");
+        for (size_t i = 1; i < 3; i++) {
+            if (order == 0) {
+                SDGIFDecoderRenderFrame(decoder, i - 1);
+            }
+            const uint8_t *canvas = SDGIFDecoderRenderFrame(decoder, i);
+            SDAssert(canvas != NULL, "truncated LZW: frame %zu", i);
+            if (!canvas) {
+                continue;
+            }
+            SDAssertEqualBytes(canvas, reference[i], 150 * 4, "frame %zu: decoded pixels (order %zu)", i, order);
+            // 关键帧画在空白的画布上，其余的像素是透明的
+            const uint8_t *remaining = i == 1 ? reference[0] + 150 * 4 : transparent;
+            SDAssertEqualBytes(canvas + 150 * 4, remaining, (400 - 150) * 4, "frame %zu: remaining pixels (order %zu)", i, order);
+        }
+        SDGIFDecoderRelease(decoder);
+    }
+    SDFreeFrames(reference, 3);
+    free(data.bytes);
+    free(background);
+    free(indexes);
+}
+
+static void SDTestScreenSize(void) {
+    uint8_t colorTable[4 * 3];
+    SDTestGIFFillColorTable(colorTable, 4, 1);
+    uint8_t *first = SDRandomIndexes(10 * 6, 4);
+    uint8_t *second = SDRandomIndexes(4 * 9, 4);
+    // 逻辑屏幕的尺寸为 0 时使用各帧的范围；宽或高为 0 的帧被跳过
+    SDTestGIFFrame frames[] = {
+        {.x = 0, .y = 0, .width = 10, .height = 6, .indexes = first, .transparentIndex = -1, .disposal = SDGIFDisposalNone, .delay = 10},
+        {.x = 3, .y = 0, .width = 0, .height = 5, .indexes = first, .transparentIndex = -1, .disposal = SDGIFDisposalNone, .delay = 10},
+        {.x = 2, .y = 3, .width = 4, .height = 9, .indexes = second, .transparentIndex = -1, .disposal = SDGIFDisposalNone, .delay = 10},
+    };
+    SDBuffer data = SDTestGIFCreate(0, 0, colorTable, 4, -1, frames, SDCount(frames));
+    SDGIFDecoder *decoder = SDGIFDecoderCreate(data.bytes, data.length);
+    SDAssert(decoder != NULL, "zero screen size");
+    if (decoder) {
+        SDAssertEqual(SDGIFDecoderGetWidth(decoder), 10, "zero screen size");
+        SDAssertEqual(SDGIFDecoderGetHeight(decoder), 12, "zero screen size");
+        SDAssertEqual(SDGIFDecoderGetFrameCount(decoder), 2, "zero screen size");
+        SDAssertEqual(SDGIFDecoderGetLoopCount(decoder), 0, "no NETSCAPE2.0 extension");
+        SDTestGIFFrame expectedFrames[] = {frames[0], frames[2]};
+        SDTestGIF gif = {10, 12, colorTable, 4, expectedFrames, 2};
+        uint8_t **reference = SDReferenceFrames(&gif);
+        for (size_t i = 0; i < 2; i++) {
+            const uint8_t *canvas = SDGIFDecoderRenderFrame(decoder, i);
+            SDAssert(canvas && memcmp(canvas, reference[i], 10 * 12 * 4) == 0, "zero screen size: frame %zu", i);
+        }
+        SDFreeFrames(reference, 2);
+        SDGIFDecoderRelease(decoder);
+    }
+    free(data.bytes);
+    free(first);
+    free(second);
+}
+
+static void SDTestMaxPixelCount(void) {
+    uint8_t colorTable[4 * 3];
+    SDTestGIFFillColorTable(colorTable, 4, 3);
+    uint8_t *indexes = SDRandomIndexes(4 * 4, 4);
+    SDTestGIFFrame frames[] = {
+        {.x = 0, .y = 0, .width = 4, .height = 4, .indexes = indexes, .transparentIndex = -1, .disposal = SDGIFDisposalNone, .delay = 10},
+        {.x = 60000, .y = 60000, .width = 4, .height = 4, .indexes = indexes, .transparentIndex = -1, .disposal = SDGIFDisposalNone, .delay = 10},
+    };
+    // 只有几十个字节，画布却要 17 GB
+    SDBuffer data = SDTestGIFCreate(65535, 65535, colorTable, 4, -1, frames, 1);
+    SDAssert(SDGIFDecoderCreate(data.bytes, data.length) == NULL, "65535x65535 screen");
+    SDGIFDecoder *decoder = SDGIFDecoderCreateWithMaxPixelCount(data.bytes, data.length, 0);
+    SDAssert(decoder != NULL, "65535x65535 screen without limit");
+    SDGIFDecoderRelease(decoder);
+    free(data.bytes);
+
+    data = SDTestGIFCreate(64, 48, colorTable, 4, -1, frames, 1);
+    decoder = SDGIFDecoderCreateWithMaxPixelCount(data.bytes, data.length, 64 * 48);
+    SDAssert(decoder && SDGIFDecoderRenderFrame(decoder, 0), "screen at the limit");
+    SDGIFDecoderRelease(decoder);
+    SDAssert(SDGIFDecoderCreateWithMaxPixelCount(data.bytes, data.length, 64 * 48 - 1) == NULL, "screen above the limit");
+    free(data.bytes);
+
+    // 逻辑屏幕的尺寸为 0 时按各帧的范围检查
+    data = SDTestGIFCreate(0, 0, colorTable, 4, -1, frames, SDCount(frames));
+    SDAssert(SDGIFDecoderCreate(data.bytes, data.length) == NULL, "zero screen size with a distant frame");
+    free(data.bytes);
+    free(indexes);
+}
+
+int main(void) {
+    SDTestKnownBytes();
+    SDTestLZW();
+    SDTestInterlacing();
+    SDTestDisposal();
+    SDTestSeek();
+    SDTestTruncation();
+    SDTestTruncatedLZW();
+    SDTestScreenSize();
+    SDTestMaxPixelCount();
+    return SDTestResult();
+}
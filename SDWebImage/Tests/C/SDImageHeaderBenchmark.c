@@ -0,0 +1,206 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+/*
+ 下载过程中检查图片头部的性能测试
+
+ 按数据块回放一组大图的下载，和 SDWebImageDownloaderOperation 一样在每个数据块到达时检查图片头部，直到头部解析完成或者达到 256 KB。
+ 之前的实现每个数据块都重新拷贝一次最多 256 KB 的前缀再解析，
+ 现在只追加新收到的字节，收到的数据翻倍时才重新解析。统计拷贝的字节数、解析次数和耗时。
+ JPEG 的 SOF 在 EXIF 缩略图和 ICC 配置之后，最多要等到 200 KB 左右，最后一张图片的 SOF 超过了 256 KB。
+ 命令行参数是图片文件的路径时回放这些文件。
+ */
+
+#include "SDTestBuffer.h"
+#include "SDWebImageImageHeader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static const size_t kSniffLength = 256 * 1024;
+static const size_t kRepeatCount = 20;
+
+typedef struct SDHeaderCheckStats {
+    unsigned long long copiedBytes;
+    size_t peakBufferLength;
+    size_t parseCount;
+    double time;
+} SDHeaderCheckStats;
+
+static double SDNow(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static void SDBufferAppendJPEGSegment(SDBuffer *buffer, uint8_t marker, size_t payloadLength, uint32_t *state) {
+    SDBufferAppendByte(buffer, 0xFF);
+    SDBufferAppendByte(buffer, marker);
+    SDBufferAppendBig16(buffer, (uint32_t)payloadLength + 2);
+    for (size_t i = 0; i < payloadLength; i++) {
+        *state = *state * 1103515245u + 12345u;
+        // 负载中没有 0xFF，避免看起来像标记
+        SDBufferAppendByte(buffer, (uint8_t)((*state >> 24) % 0xFF));
+    }
+}
+
+// 4000x3000 的 JPEG，SOF 之前有 metadataLength 字节的 APP1 / APP2，之后是 4 MB 的扫描数据
+static SDBuffer SDLargeJPEG(size_t metadataLength) {
+    SDBuffer buffer = {0};
+    uint32_t state = (uint32_t)metadataLength + 1;
+    SDBufferAppend(&buffer, "\xFF\xD8", 2);
+    SDBufferAppendJPEGSegment(&buffer, 0xE0, 14, &state);
+    for (size_t remaining = metadataLength; remaining > 0;) {
+        size_t payloadLength = remaining < 0xFFFF - 2 ? remaining : 0xFFFF - 2;
+        SDBufferAppendJPEGSegment(&buffer, remaining == metadataLength ? 0xE1 : 0xE2, payloadLength, &state);
+        remaining -= payloadLength;
+    }
+    SDBufferAppendJPEGSegment(&buffer, 0xDB, 130, &state);
+    SDBufferAppendByte(&buffer, 0xFF);
+    SDBufferAppendByte(&buffer, 0xC0);
+    SDBufferAppendBig16(&buffer, 17);
+    SDBufferAppendByte(&buffer, 8);
+    SDBufferAppendBig16(&buffer, 3000);
+    SDBufferAppendBig16(&buffer, 4000);
+    SDBufferAppend(&buffer, "\x03\x01\x22\x00\x02\x11\x01\x03\x11\x01", 10);
+    size_t length = buffer.length + 4 * 1024 * 1024;
+    while (buffer.length < length) {
+        state = state * 1103515245u + 12345u;
+        SDBufferAppendByte(&buffer, (uint8_t)(state >> 24));
+    }
+    return buffer;
+}
+
+static SDBuffer SDReadFile(const char *path) {
+    SDBuffer buffer = {0};
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return buffer;
+    }
+    uint8_t bytes[64 * 1024];
+    size_t count;
+    while ((count = fread(bytes, 1, sizeof(bytes), file)) > 0) {
+        SDBufferAppend(&buffer, bytes, count);
+    }
+    fclose(file);
+    return buffer;
+}
+
+// 之前的实现：每个数据块都拷贝一次前缀再解析
+static SDImageHeaderStatus SDCheckCopyingPrefix(const SDBuffer *image, size_t chunkLength, SDHeaderCheckStats *stats) {
+    SDImageHeaderStatus status = SDImageHeaderStatusNeedMoreData;
+    for (size_t length = 0; length < image->length;) {
+        length = length + chunkLength < image->length ? length + chunkLength : image->length;
+        size_t prefixLength = length < kSniffLength ? length : kSniffLength;
+        uint8_t *prefix = malloc(prefixLength);
+        memcpy(prefix, image->bytes, prefixLength);
+        stats->copiedBytes += prefixLength;
+        if (prefixLength > stats->peakBufferLength) {
+            stats->peakBufferLength = prefixLength;
+        }
+        SDImageHeader header;
+        status = SDImageHeaderParse(prefix, prefixLength, &header);
+        stats->parseCount++;
+        free(prefix);
+        if (status != SDImageHeaderStatusNeedMoreData || length >= kSniffLength) {
+            break;
+        }
+    }
+    return status;
+}
+
+// 现在的实现：只追加新收到的字节，数据翻倍时才重新解析
+static SDImageHeaderStatus SDCheckAppending(const SDBuffer *image, size_t chunkLength, SDHeaderCheckStats *stats) {
+    SDImageHeaderStatus status = SDImageHeaderStatusNeedMoreData;
+    uint8_t *headerBytes = NULL;
+    size_t parsedLength = 0;
+    for (size_t received = 0; received < image->length;) {
+        received = received + chunkLength < image->length ? received + chunkLength : image->length;
+        size_t length = received < kSniffLength ? received : kSniffLength;
+        if (parsedLength > 0 && length < parsedLength * 2 && length < kSniffLength) {
+            continue;
+        }
+        // NSMutableData 增加长度时和 realloc 一样按需要扩容
+        headerBytes = realloc(headerBytes, length);
+        memcpy(headerBytes + parsedLength, image->bytes + parsedLength, length - parsedLength);
+        stats->copiedBytes += length - parsedLength;
+        if (length > stats->peakBufferLength) {
+            stats->peakBufferLength = length;
+        }
+        parsedLength = length;
+        SDImageHeader header;
+        status = SDImageHeaderParse(headerBytes, length, &header);
+        stats->parseCount++;
+        if (status != SDImageHeaderStatusNeedMoreData || length >= kSniffLength) {
+            break;
+        }
+    }
+    free(headerBytes);
+    return status;
+}
+
+static void SDPrintStats(const char *name, size_t chunkLength, const SDHeaderCheckStats *stats) {
+    printf("%-15s chunk %2zu KB: copied %8.2f MB, peak buffer %4zu KB, %6zu parses, %8.3f ms\n",
+           name, chunkLength / 1024, stats->copiedBytes / 1e6 / kRepeatCount,
+           stats->peakBufferLength / 1024, stats->parseCount / kRepeatCount, stats->time * 1000 / kRepeatCount);
+}
+
+int main(int argc, char **argv) {
+    size_t imageCount = argc > 1 ? (size_t)(argc - 1) : 6;
+    SDBuffer *images = calloc(imageCount, sizeof(SDBuffer));
+    if (argc > 1) {
+        for (size_t i = 0; i < imageCount; i++) {
+            images[i] = SDReadFile(argv[i + 1]);
+            if (images[i].length == 0) {
+                fprintf(stderr, "Can not read %s\n", argv[i + 1]);
+                return 1;
+            }
+        }
+    } else {
+        // 没有 metadata、JFIF + EXIF、EXIF 缩略图、EXIF + ICC、很大的 ICC、SOF 超过 256 KB
+        const size_t metadataLengths[] = {0, 8 * 1024, 60 * 1024, 120 * 1024, 200 * 1024, 300 * 1024};
+        for (size_t i = 0; i < imageCount; i++) {
+            images[i] = SDLargeJPEG(metadataLengths[i]);
+        }
+    }
+    unsigned long long imageBytes = 0;
+    for (size_t i = 0; i < imageCount; i++) {
+        imageBytes += images[i].length;
+    }
+    printf("%zu images, %.2f MB\n", imageCount, imageBytes / 1e6);
+
+    // URLSession 通常每次交付 16 KB 左右，慢速网络上更小
+    const size_t chunkLengths[] = {4 * 1024, 16 * 1024, 64 * 1024};
+    for (size_t c = 0; c < sizeof(chunkLengths) / sizeof(chunkLengths[0]); c++) {
+        SDHeaderCheckStats copying = {0};
+        SDHeaderCheckStats appending = {0};
+        for (size_t repeat = 0; repeat < kRepeatCount; repeat++) {
+            for (size_t i = 0; i < imageCount; i++) {
+                double start = SDNow();
+                SDImageHeaderStatus copyingStatus = SDCheckCopyingPrefix(&images[i], chunkLengths[c], &copying);
+                copying.time += SDNow() - start;
+                start = SDNow();
+                SDImageHeaderStatus appendingStatus = SDCheckAppending(&images[i], chunkLengths[c], &appending);
+                appending.time += SDNow() - start;
+                if (copyingStatus != appendingStatus) {
+                    fprintf(stderr, "Image %zu: status %d, expected %d\n", i, appendingStatus, copyingStatus);
+                    return 1;
+                }
+            }
+        }
+        SDPrintStats("copying prefix", chunkLengths[c], &copying);
+        SDPrintStats("appending", chunkLengths[c], &appending);
+        printf("saved %.2f MB of copies per %zu images\n", (copying.copiedBytes - appending.copiedBytes) / 1e6 / kRepeatCount, imageCount);
+    }
+
+    for (size_t i = 0; i < imageCount; i++) {
+        free(images[i].bytes);
+    }
+    free(images);
+    return 0;
+}
@@ -0,0 +1,257 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#include "SDTestAssert.h"
+#include "SDTestBuffer.h"
+#include "SDWebImageImageHeader.h"
+#include <stdbool.h>
+#include <stdlib.h>
+
+typedef struct SDHeaderCase {
+    const char *name;
+    uint8_t *bytes;
+    size_t length;
+    SDImageHeaderStatus status;
+    SDImageHeaderFormat format;
+    uint32_t width;
+    uint32_t height;
+} SDHeaderCase;
+
+// A JPEG segment with `payloadLength` bytes of payload
+static void SDBufferAppendJPEGSegment(SDBuffer *buffer, uint8_t marker, size_t payloadLength) {
+    SDBufferAppendByte(buffer, 0xFF);
+    SDBufferAppendByte(buffer, marker);
+    SDBufferAppendBig16(buffer, (uint32_t)payloadLength + 2);
+    for (size_t i = 0; i < payloadLength; i++) {
+        SDBufferAppendByte(buffer, (uint8_t)(i * 31));
+    }
+}
+
+static void SDBufferAppendJPEGFrame(SDBuffer *buffer, uint8_t marker, uint32_t width, uint32_t height) {
+    SDBufferAppendByte(buffer, 0xFF);
+    SDBufferAppendByte(buffer, marker);
+    // length(2) precision(1) height(2) width(2) components(1) component(3)
+    SDBufferAppendBig16(buffer, 11);
+    SDBufferAppendByte(buffer, 8);
+    SDBufferAppendBig16(buffer, height);
+    SDBufferAppendBig16(buffer, width);
+    SDBufferAppend(buffer, "\x01\x01\x11\x00", 4);
+}
+
+// SOI, APP0, an EXIF APP1 of almost 64 KB, fill bytes, a restart marker, DQT, DHT and a progressive SOF
+static SDBuffer SDJPEGWithLargeAPP1(uint32_t width, uint32_t height) {
+    SDBuffer buffer = {0};
+    SDBufferAppend(&buffer, "\xFF\xD8", 2);
+    SDBufferAppendJPEGSegment(&buffer, 0xE0, 14);
+    SDBufferAppendJPEGSegment(&buffer, 0xE1, 0xFFFF - 2);
+    SDBufferAppend(&buffer, "\xFF\xFF\xFF", 3);
+    SDBufferAppend(&buffer, "\xFF\xD3", 2);
+    SDBufferAppendJPEGSegment(&buffer, 0xDB, 65);
+    SDBufferAppendJPEGSegment(&buffer, 0xC4, 30);
+    SDBufferAppend(&buffer, "\xFF\xFF", 2);
+    SDBufferAppendJPEGFrame(&buffer, 0xC2, width, height);
+    return buffer;
+}
+
+static SDBuffer SDJPEGWithoutFrame(uint8_t marker) {
+    SDBuffer buffer = {0};
+    SDBufferAppend(&buffer, "\xFF\xD8", 2);
+    SDBufferAppendJPEGSegment(&buffer, 0xE0, 14);
+    SDBufferAppendByte(&buffer, 0xFF);
+    SDBufferAppendByte(&buffer, marker);
+    SDBufferAppend(&buffer, "\x00\x0C", 2);
+    return buffer;
+}
+
+static SDBuffer SDPNG(uint32_t width, uint32_t height) {
+    SDBuffer buffer = {0};
+    SDBufferAppend(&buffer, "\x89PNG\r\n\x1A\n", 8);
+    SDBufferAppendBig32(&buffer, 13);
+    SDBufferAppend(&buffer, "IHDR", 4);
+    SDBufferAppendBig32(&buffer, width);
+    SDBufferAppendBig32(&buffer, height);
+    SDBufferAppend(&buffer, "\x08\x06\x00\x00\x00", 5);
+    return buffer;
+}
+
+static SDBuffer SDGIF(const char *signature, uint32_t width, uint32_t height) {
+    SDBuffer buffer = {0};
+    SDBufferAppend(&buffer, signature, 6);
+    SDBufferAppendLittle16(&buffer, width);
+    SDBufferAppendLittle16(&buffer, height);
+    SDBufferAppend(&buffer, "\xF7\x00\x00", 3);
+    return buffer;
+}
+
+static void SDBufferAppendRIFF(SDBuffer *buffer, const char *form, const char *chunk, uint32_t chunkLength) {
+    SDBufferAppend(buffer, "RIFF", 4);
+    SDBufferAppendLittle32(buffer, chunkLength + 12);
+    SDBufferAppend(buffer, form, 4);
+    SDBufferAppend(buffer, chunk, 4);
+    SDBufferAppendLittle32(buffer, chunkLength);
+}
+
+// The 14 bit sizes of a lossy frame, the upper 2 bits are the scale
+static SDBuffer SDWebPVP8(uint32_t width, uint32_t height) {
+    SDBuffer buffer = {0};
+    SDBufferAppendRIFF(&buffer, "WEBP", "VP8 ", 10);
+    SDBufferAppend(&buffer, "\x30\x01\x00\x9D\x01\x2A", 6);
+    SDBufferAppendLittle16(&buffer, width | 0x4000);
+    SDBufferAppendLittle16(&buffer, height | 0x8000);
+    return buffer;
+}
+
+static SDBuffer SDWebPVP8L(uint32_t width, uint32_t height) {
+    SDBuffer buffer = {0};
+    SDBufferAppendRIFF(&buffer, "WEBP", "VP8L", 5);
+    SDBufferAppendByte(&buffer, 0x2F);
+    // width - 1(14) height - 1(14) alpha(1) version(3)
+    SDBufferAppendLittle32(&buffer, (width - 1) | ((height - 1) << 14) | (1u << 28));
+    return buffer;
+}
+
+static SDBuffer SDWebPVP8X(uint32_t width, uint32_t height) {
+    SDBuffer buffer = {0};
+    SDBufferAppendRIFF(&buffer, "WEBP", "VP8X", 10);
+    SDBufferAppendLittle32(&buffer, 0x10);
+    SDBufferAppendLittle24(&buffer, width - 1);
+    SDBufferAppendLittle24(&buffer, height - 1);
+    return buffer;
+}
+
+static SDBuffer SDRIFF(const char *form, const char *chunk) {
+    SDBuffer buffer = {0};
+    SDBufferAppendRIFF(&buffer, form, chunk, 16);
+    SDBufferAppend(&buffer, "\x01\x00\x02\x00\x44\xAC\x00\x00\x10\xB1\x02\x00\x04\x00\x10\x00", 16);
+    return buffer;
+}
+
+#define SDCase(name, buffer, status, format, width, height) { name, (buffer).bytes, (buffer).length, status, format, width, height }
+
+static const char *SDStatusName(SDImageHeaderStatus status) {
+    switch (status) {
+        case SDImageHeaderStatusNeedMoreData: return "NeedMoreData";
+        case SDImageHeaderStatusComplete: return "Complete";
+        case SDImageHeaderStatusInvalid: return "Invalid";
+        case SDImageHeaderStatusUnknown: return "Unknown";
+    }
+    return "?";
+}
+
+int main(void) {
+    SDBuffer jpeg = SDJPEGWithLargeAPP1(4000, 3000);
+    SDBuffer jpegZeroHeight = SDJPEGWithLargeAPP1(640, 0);
+    SDBuffer jpegBaseline = {0};
+    SDBufferAppend(&jpegBaseline, "\xFF\xD8", 2);
+    SDBufferAppendJPEGFrame(&jpegBaseline, 0xC0, 1, 65535);
+    SDBuffer jpegScanFirst = SDJPEGWithoutFrame(0xDA);
+    SDBuffer jpegEndFirst = SDJPEGWithoutFrame(0xD9);
+    SDBuffer jpegShortSegment = SDBufferWithBytes("\xFF\xD8\xFF\xE0\x00\x01", 6);
+    SDBuffer jpegNoMarker = SDBufferWithBytes("\xFF\xD8\x00\xE0\x00\x10", 6);
+    SDBuffer jpegNoSOI = SDBufferWithBytes("\xFF\xE0\x00\x10", 4);
+    SDBuffer png = SDPNG(1024, 768);
+    SDBuffer pngZeroWidth = SDPNG(0, 768);
+    SDBuffer pngTooLarge = SDPNG(0x80000000u, 1);
+    SDBuffer pngNoIHDR = SDPNG(16, 16);
+    memcpy(pngNoIHDR.bytes + 12, "IDAT", 4);
+    SDBuffer pngBadSignature = SDBufferWithBytes("\x89PNX\r\n\x1A\n", 8);
+    SDBuffer gif89 = SDGIF("GIF89a", 320, 240);
+    SDBuffer gif87 = SDGIF("GIF87a", 1, 1);
+    SDBuffer gifZeroScreen = SDGIF("GIF89a", 0, 0);
+    SDBuffer gifBadVersion = SDGIF("GIF88a", 16, 16);
+    SDBuffer vp8 = SDWebPVP8(400, 301);
+    SDBuffer vp8BadStartCode = SDWebPVP8(400, 301);
+    vp8BadStartCode.bytes[23] = 0x9C;
+    SDBuffer vp8l = SDWebPVP8L(16384, 3);
+    SDBuffer vp8lBadSignature = SDWebPVP8L(16, 16);
+    vp8lBadSignature.bytes[20] = 0x2E;
+    SDBuffer vp8x = SDWebPVP8X(1u << 24, 70000);
+    SDBuffer webpUnknownChunk = SDRIFF("WEBP", "ALPH");
+    SDBuffer wave = SDRIFF("WAVE", "fmt ");
+    SDBuffer avi = SDRIFF("AVI ", "LIST");
+    SDBuffer riffPrefix = SDBufferWithBytes("RIFF\x24\x00\x00\x00WA", 10);
+    SDBuffer tiffLittle = SDBufferWithBytes("II*\x00\x08\x00\x00\x00", 8);
+    SDBuffer tiffBig = SDBufferWithBytes("MM\x00*\x00\x00\x00\x08", 8);
+    SDBuffer text = SDBufferWithBytes("<html>", 6);
+
+    SDHeaderCase cases[] = {
+        SDCase("JPEG with a large APP1 and fill bytes", jpeg, SDImageHeaderStatusComplete, SDImageHeaderFormatJPEG, 4000, 3000),
+        SDCase("JPEG frame with zero height", jpegZeroHeight, SDImageHeaderStatusUnknown, SDImageHeaderFormatJPEG, 640, 0),
+        SDCase("JPEG baseline frame right after SOI", jpegBaseline, SDImageHeaderStatusComplete, SDImageHeaderFormatJPEG, 1, 65535),
+        SDCase("JPEG scan before frame", jpegScanFirst, SDImageHeaderStatusInvalid, SDImageHeaderFormatJPEG, 0, 0),
+        SDCase("JPEG end before frame", jpegEndFirst, SDImageHeaderStatusInvalid, SDImageHeaderFormatJPEG, 0, 0),
+        SDCase("JPEG segment length below 2", jpegShortSegment, SDImageHeaderStatusInvalid, SDImageHeaderFormatJPEG, 0, 0),
+        SDCase("JPEG without marker", jpegNoMarker, SDImageHeaderStatusInvalid, SDImageHeaderFormatJPEG, 0, 0),
+        SDCase("JPEG without SOI", jpegNoSOI, SDImageHeaderStatusInvalid, SDImageHeaderFormatJPEG, 0, 0),
+        SDCase("PNG", png, SDImageHeaderStatusComplete, SDImageHeaderFormatPNG, 1024, 768),
+        SDCase("PNG with zero width", pngZeroWidth, SDImageHeaderStatusInvalid, SDImageHeaderFormatPNG, 0, 768),
+        SDCase("PNG wider than INT32_MAX", pngTooLarge, SDImageHeaderStatusInvalid, SDImageHeaderFormatPNG, 0x80000000u, 1),
+        SDCase("PNG without IHDR", pngNoIHDR, SDImageHeaderStatusInvalid, SDImageHeaderFormatPNG, 0, 0),
+        SDCase("PNG with a bad signature", pngBadSignature, SDImageHeaderStatusInvalid, SDImageHeaderFormatPNG, 0, 0),
+        SDCase("GIF89a", gif89, SDImageHeaderStatusComplete, SDImageHeaderFormatGIF, 320, 240),
+        SDCase("GIF87a", gif87, SDImageHeaderStatusComplete, SDImageHeaderFormatGIF, 1, 1),
+        SDCase("GIF with zero screen size", gifZeroScreen, SDImageHeaderStatusUnknown, SDImageHeaderFormatGIF, 0, 0),
+        SDCase("GIF with an unknown version", gifBadVersion, SDImageHeaderStatusInvalid, SDImageHeaderFormatGIF, 0, 0),
+        SDCase("WebP VP8 ignores the scale bits", vp8, SDImageHeaderStatusComplete, SDImageHeaderFormatWebP, 400, 301),
+        SDCase("WebP VP8 with a bad start code", vp8BadStartCode, SDImageHeaderStatusInvalid, SDImageHeaderFormatWebP, 0, 0),
+        SDCase("WebP VP8L", vp8l, SDImageHeaderStatusComplete, SDImageHeaderFormatWebP, 16384, 3),
+        SDCase("WebP VP8L with a bad signature", vp8lBadSignature, SDImageHeaderStatusInvalid, SDImageHeaderFormatWebP, 0, 0),
+        SDCase("WebP VP8X", vp8x, SDImageHeaderStatusComplete, SDImageHeaderFormatWebP, 1u << 24, 70000),
+        SDCase("WebP with an unknown first chunk", webpUnknownChunk, SDImageHeaderStatusInvalid, SDImageHeaderFormatWebP, 0, 0),
+        SDCase("RIFF WAVE", wave, SDImageHeaderStatusUnknown, SDImageHeaderFormatUndefined, 0, 0),
+        SDCase("RIFF AVI", avi, SDImageHeaderStatusUnknown, SDImageHeaderFormatUndefined, 0, 0),
+        SDCase("RIFF prefix of another form", riffPrefix, SDImageHeaderStatusUnknown, SDImageHeaderFormatUndefined, 0, 0),
+        SDCase("TIFF little endian", tiffLittle, SDImageHeaderStatusUnknown, SDImageHeaderFormatTIFF, 0, 0),
+        SDCase("TIFF big endian", tiffBig, SDImageHeaderStatusUnknown, SDImageHeaderFormatTIFF, 0, 0),
+        SDCase("Text", text, SDImageHeaderStatusUnknown, SDImageHeaderFormatUndefined, 0, 0),
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        const SDHeaderCase *testCase = &cases[i];
+        SDImageHeader header;
+        SDImageHeaderStatus status = SDImageHeaderParse(testCase->bytes, testCase->length, &header);
+        SDAssert(status == testCase->status, "%s: got %s, expected %s", testCase->name, SDStatusName(status), SDStatusName(testCase->status));
+        SDAssertEqual(header.format, testCase->format, "%s", testCase->name);
+        SDAssertEqual(header.width, testCase->width, "%s", testCase->name);
+        SDAssertEqual(header.height, testCase->height, "%s", testCase->name);
+        if (testCase->status != SDImageHeaderStatusComplete) {
+            continue;
+        }
+        // 读到尺寸之前的每一个前缀都需要更多数据，下载时不会被提前判定为无效，读到尺寸之后结果不再变化
+        bool complete = false;
+        for (size_t length = 0; length < testCase->length; length++) {
+            status = SDImageHeaderParse(testCase->bytes, length, &header);
+            complete = complete || status == SDImageHeaderStatusComplete;
+            SDImageHeaderStatus expected = complete ? SDImageHeaderStatusComplete : SDImageHeaderStatusNeedMoreData;
+            if (status != expected || (complete && (header.width != testCase->width || header.height != testCase->height))) {
+                SDAssert(false, "%s: prefix of %zu bytes got %s", testCase->name, length, SDStatusName(status));
+                break;
+            }
+        }
+    }
+
+    // 头部后面的数据不影响结果
+    SDBuffer pngWithData = SDPNG(7, 9);
+    SDBufferAppend(&pngWithData, jpeg.bytes, jpeg.length);
+    SDImageHeader header;
+    SDAssertEqual(SDImageHeaderParse(pngWithData.bytes, pngWithData.length, &header), SDImageHeaderStatusComplete, "PNG with data");
+    SDAssertEqual(header.width, 7, "PNG with data");
+    SDAssertEqual(header.height, 9, "PNG with data");
+
+    SDBuffer buffers[] = {
+        jpeg, jpegZeroHeight, jpegBaseline, jpegScanFirst, jpegEndFirst, jpegShortSegment, jpegNoMarker, jpegNoSOI,
+        png, pngZeroWidth, pngTooLarge, pngNoIHDR, pngBadSignature, pngWithData,
+        gif89, gif87, gifZeroScreen, gifBadVersion,
+        vp8, vp8BadStartCode, vp8l, vp8lBadSignature, vp8x, webpUnknownChunk, wave, avi, riffPrefix,
+        tiffLittle, tiffBig, text,
+    };
+    for (size_t i = 0; i < sizeof(buffers) / sizeof(buffers[0]); i++) {
+        free(buffers[i].bytes);
+    }
+    return SDTestResult();
+}
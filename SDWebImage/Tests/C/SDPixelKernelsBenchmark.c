@@ -0,0 +1,98 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+/*
+ 像素转换的性能测试
+
+ 一张 1920x1080 的图片，统计每个函数的吞吐量（按读写的字节数计算 GB/s）。
+ 和测试一样链接标量、默认、SSSE3 和 AVX2 的模块，对比各个实现的速度。CPU 不支持模块的指令集时跳过。
+ */
+
+#include "SDWebImagePixelKernels.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const size_t kPixelCount = 1920 * 1080;
+static const double kMinimumTime = 0.2;
+
+static double SDNow(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static uint8_t *SDSource;
+static uint8_t *SDDestination;
+
+static void SDRunSwizzle(void) {
+    static const uint8_t order[4] = {2, 1, 0, 3};
+    SDPixelSwizzle(SDSource, SDDestination, kPixelCount, order);
+}
+
+static void SDRunPremultiply(void) {
+    SDPixelPremultiply(SDSource, SDDestination, kPixelCount);
+}
+
+static void SDRunUnpremultiply(void) {
+    SDPixelUnpremultiply(SDSource, SDDestination, kPixelCount);
+}
+
+static void SDRunExpand(void) {
+    SDPixelExpandRGBToRGBX(SDSource, SDDestination, kPixelCount, 0xFF);
+}
+
+static volatile bool SDOpaque;
+
+static void SDRunIsOpaque(void) {
+    SDOpaque = SDPixelIsOpaque(SDDestination, kPixelCount, 3);
+}
+
+// 重复运行到至少 kMinimumTime 秒，打印每秒处理的字节数
+static void SDMeasure(const char *name, void (*function)(void), size_t bytesPerPixel) {
+    function();
+    size_t count = 0;
+    double start = SDNow();
+    double elapsed = 0;
+    do {
+        function();
+        count++;
+        elapsed = SDNow() - start;
+    } while (elapsed < kMinimumTime);
+    printf("%-14s %8.2f GB/s %10.3f ms\n", name, (double)count * kPixelCount * bytesPerPixel / elapsed / 1e9, elapsed / count * 1000);
+}
+
+int main(void) {
+    // SD_PIXEL_VARIANT 是链接的模块的名字
+    printf("%s\n", SD_PIXEL_VARIANT);
+#ifdef SD_PIXEL_TEST_CPU
+    if (!__builtin_cpu_supports(SD_PIXEL_TEST_CPU)) {
+        printf("skipped: the CPU does not support %s\n", SD_PIXEL_TEST_CPU);
+        return 0;
+    }
+#endif
+    SDSource = malloc(kPixelCount * 4);
+    SDDestination = malloc(kPixelCount * 4);
+    uint32_t state = 1;
+    for (size_t i = 0; i < kPixelCount * 4; i++) {
+        state = state * 1103515245u + 12345u;
+        SDSource[i] = (uint8_t)(state >> 16);
+    }
+    // 字节数包括读和写
+    SDMeasure("swizzle", SDRunSwizzle, 8);
+    SDMeasure("premultiply", SDRunPremultiply, 8);
+    SDMeasure("unpremultiply", SDRunUnpremultiply, 8);
+    SDMeasure("expand", SDRunExpand, 7);
+    // 不透明的图片需要检查所有的像素
+    memset(SDDestination, 0xFF, kPixelCount * 4);
+    SDMeasure("is opaque", SDRunIsOpaque, 4);
+    free(SDSource);
+    free(SDDestination);
+    return 0;
+}
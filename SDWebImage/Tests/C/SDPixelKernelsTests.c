@@ -0,0 +1,280 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+/*
+ 像素转换的测试
+
+ 同一个测试链接不同编译选项构建的模块（标量、默认、SSSE3、AVX2），每个函数的结果都和这里按文档写的参照实现逐字节相同。
+ 像素数覆盖各个 SIMD 宽度的剩余部分，缓冲区刚好分配需要的大小并且不对齐，越界读写可以被内存检查工具发现。
+ */
+
+#include "SDTestAssert.h"
+#include "SDWebImagePixelKernels.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+// 定义 SD_PIXEL_TEST_CPU 为模块需要的指令集（比如 "avx2"），CPU 不支持时跳过测试
+#define SD_TEST_SKIPPED 77
+
+#define SDCount(array) (sizeof(array) / sizeof((array)[0]))
+
+static uint32_t SDRandomState = 1;
+
+static uint8_t SDRandomByte(void) {
+    SDRandomState = SDRandomState * 1103515245u + 12345u;
+    return (uint8_t)(SDRandomState >> 16);
+}
+
+// 像素数：0 到 70 覆盖 4、8、16 像素一组的所有剩余，以及几个较大的数
+static const size_t kPixelCounts[] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 23, 24, 25, 31, 32, 33,
+    47, 48, 49, 63, 64, 65, 66, 67, 68, 69, 70, 255, 1023, 1024, 1025, 4099,
+};
+
+// `length` 字节放在一块更大的内存的末尾，前面 `offset` 字节不属于它，所以既不对齐，也不能越过末尾
+typedef struct SDTestBytes {
+    uint8_t *memory;
+    uint8_t *bytes;
+} SDTestBytes;
+
+static SDTestBytes SDTestBytesCreate(size_t length, size_t offset) {
+    SDTestBytes bytes;
+    bytes.memory = malloc(length + offset + 1);
+    bytes.bytes = bytes.memory + offset + 1;
+    for (size_t i = 0; i < length; i++) {
+        bytes.bytes[i] = SDRandomByte();
+    }
+    return bytes;
+}
+
+#pragma mark - Reference
+
+static void SDReferenceSwizzle(const uint8_t *src, uint8_t *dst, size_t pixelCount, const uint8_t order[4]) {
+    for (size_t i = 0; i < pixelCount; i++) {
+        uint8_t pixel[4];
+        for (int k = 0; k < 4; k++) {
+            pixel[k] = src[i * 4 + (order[k] & 3)];
+        }
+        memcpy(dst + i * 4, pixel, 4);
+    }
+}
+
+static void SDReferencePremultiply(const uint8_t *src, uint8_t *dst, size_t pixelCount) {
+    for (size_t i = 0; i < pixelCount; i++) {
+        uint32_t a = src[i * 4 + 3];
+        for (int k = 0; k < 3; k++) {
+            // c * a / 255 的小数部分不会是 0.5，四舍五入没有歧义
+            dst[i * 4 + k] = (uint8_t)((src[i * 4 + k] * a * 2 + 255) / 510);
+        }
+        dst[i * 4 + 3] = (uint8_t)a;
+    }
+}
+
+static void SDReferenceUnpremultiply(const uint8_t *src, uint8_t *dst, size_t pixelCount) {
+    for (size_t i = 0; i < pixelCount; i++) {
+        uint8_t a = src[i * 4 + 3];
+        for (int k = 0; k < 3; k++) {
+            if (a == 0) {
+                dst[i * 4 + k] = 0;
+                continue;
+            }
+            float scale = 255.0f / (float)a;
+            long value = lrintf((float)src[i * 4 + k] * scale);
+            dst[i * 4 + k] = value > 255 ? 255 : (uint8_t)value;
+        }
+        dst[i * 4 + 3] = a;
+    }
+}
+
+static void SDReferenceExpand(const uint8_t *src, uint8_t *dst, size_t pixelCount, uint8_t fill) {
+    for (size_t i = 0; i < pixelCount; i++) {
+        dst[i * 4] = src[i * 3];
+        dst[i * 4 + 1] = src[i * 3 + 1];
+        dst[i * 4 + 2] = src[i * 3 + 2];
+        dst[i * 4 + 3] = fill;
+    }
+}
+
+#pragma mark - Tests
+
+typedef void (*SDPixelFunction)(const uint8_t *src, uint8_t *dst, size_t pixelCount);
+
+// 分开的缓冲区和同一个缓冲区（原地转换）都和参照实现相同
+static void SDAssertMatchesReference(const char *name, SDPixelFunction function, SDPixelFunction reference) {
+    for (size_t c = 0; c < SDCount(kPixelCounts); c++) {
+        size_t pixelCount = kPixelCounts[c];
+        size_t length = pixelCount * 4;
+        size_t offset = c % 4;
+        SDTestBytes src = SDTestBytesCreate(length, offset);
+        SDTestBytes dst = SDTestBytesCreate(length, 3 - offset);
+        uint8_t *expected = malloc(length + 1);
+        reference(src.bytes, expected, pixelCount);
+        function(src.bytes, dst.bytes, pixelCount);
+        SDAssertEqualBytes(dst.bytes, expected, length, "%s: %zu pixels", name, pixelCount);
+        function(src.bytes, src.bytes, pixelCount);
+        SDAssertEqualBytes(src.bytes, expected, length, "%s in place: %zu pixels", name, pixelCount);
+        free(src.memory);
+        free(dst.memory);
+        free(expected);
+    }
+}
+
+static void SDTestSwizzle(void) {
+    static const uint8_t orders[][4] = {
+        {2, 1, 0, 3}, {1, 2, 3, 0}, {3, 0, 1, 2}, {3, 2, 1, 0}, {0, 1, 2, 3}, {0, 0, 0, 0}, {2, 2, 3, 3}, {6, 5, 4, 7},
+    };
+    for (size_t o = 0; o < SDCount(orders); o++) {
+        const uint8_t *order = orders[o];
+        for (size_t c = 0; c < SDCount(kPixelCounts); c++) {
+            size_t pixelCount = kPixelCounts[c];
+            size_t length = pixelCount * 4;
+            SDTestBytes src = SDTestBytesCreate(length, c % 4);
+            SDTestBytes dst = SDTestBytesCreate(length, 0);
+            uint8_t *expected = malloc(length + 1);
+            SDReferenceSwizzle(src.bytes, expected, pixelCount, order);
+            SDPixelSwizzle(src.bytes, dst.bytes, pixelCount, order);
+            SDAssertEqualBytes(dst.bytes, expected, length, "swizzle {%u, %u, %u, %u}: %zu pixels", order[0], order[1], order[2], order[3], pixelCount);
+            SDPixelSwizzle(src.bytes, src.bytes, pixelCount, order);
+            SDAssertEqualBytes(src.bytes, expected, length, "swizzle in place {%u, %u, %u, %u}: %zu pixels", order[0], order[1], order[2], order[3], pixelCount);
+            free(src.memory);
+            free(dst.memory);
+            free(expected);
+        }
+    }
+}
+
+// 所有的颜色值和 alpha 的组合，每个像素的三个颜色通道不同
+static uint8_t *SDAllChannelAlphaPairs(size_t *pixelCount) {
+    *pixelCount = 256 * 256;
+    uint8_t *pixels = malloc(*pixelCount * 4);
+    for (size_t i = 0; i < *pixelCount; i++) {
+        uint8_t c = (uint8_t)(i & 0xFF);
+        pixels[i * 4] = c;
+        pixels[i * 4 + 1] = (uint8_t)(255 - c);
+        pixels[i * 4 + 2] = (uint8_t)(c * 7);
+        pixels[i * 4 + 3] = (uint8_t)(i >> 8);
+    }
+    return pixels;
+}
+
+static void SDTestPremultiply(void) {
+    SDAssertMatchesReference("premultiply", SDPixelPremultiply, SDReferencePremultiply);
+    size_t pixelCount;
+    uint8_t *pixels = SDAllChannelAlphaPairs(&pixelCount);
+    uint8_t *result = malloc(pixelCount * 4);
+    uint8_t *expected = malloc(pixelCount * 4);
+    SDPixelPremultiply(pixels, result, pixelCount);
+    SDReferencePremultiply(pixels, expected, pixelCount);
+    for (size_t i = 0; i < pixelCount; i++) {
+        if (memcmp(result + i * 4, expected + i * 4, 4) != 0) {
+            SDAssert(false, "premultiply (%u, %u, %u, %u)", pixels[i * 4], pixels[i * 4 + 1], pixels[i * 4 + 2], pixels[i * 4 + 3]);
+            break;
+        }
+    }
+    free(pixels);
+    free(result);
+    free(expected);
+}
+
+static void SDTestUnpremultiply(void) {
+    SDAssertMatchesReference("unpremultiply", SDPixelUnpremultiply, SDReferenceUnpremultiply);
+    // 包括颜色值大于 alpha 的无效像素，结果限制在 255
+    size_t pixelCount;
+    uint8_t *pixels = SDAllChannelAlphaPairs(&pixelCount);
+    uint8_t *result = malloc(pixelCount * 4);
+    uint8_t *expected = malloc(pixelCount * 4);
+    SDPixelUnpremultiply(pixels, result, pixelCount);
+    SDReferenceUnpremultiply(pixels, expected, pixelCount);
+    for (size_t i = 0; i < pixelCount; i++) {
+        if (memcmp(result + i * 4, expected + i * 4, 4) != 0) {
+            SDAssert(false, "unpremultiply (%u, %u, %u, %u)", pixels[i * 4], pixels[i * 4 + 1], pixels[i * 4 + 2], pixels[i * 4 + 3]);
+            break;
+        }
+    }
+    // 预乘以后再反预乘，不透明的像素不变，其他像素的误差来自两次取整，不超过 127.5 / alpha + 0.5
+    SDPixelPremultiply(pixels, result, pixelCount);
+    SDPixelUnpremultiply(result, result, pixelCount);
+    for (size_t i = 0; i < pixelCount; i++) {
+        uint8_t a = pixels[i * 4 + 3];
+        int tolerance = a == 0 ? 255 : (int)(127.5 / a + 0.5);
+        bool matches = true;
+        for (int k = 0; k < 3; k++) {
+            matches = matches && abs(result[i * 4 + k] - pixels[i * 4 + k]) <= tolerance;
+        }
+        if (!matches || result[i * 4 + 3] != a || (a == 255 && memcmp(result + i * 4, pixels + i * 4, 4) != 0)) {
+            SDAssert(false, "round trip (%u, %u, %u, %u)", pixels[i * 4], pixels[i * 4 + 1], pixels[i * 4 + 2], a);
+            break;
+        }
+    }
+    free(pixels);
+    free(result);
+    free(expected);
+}
+
+static void SDTestExpand(void) {
+    static const uint8_t fills[] = {0xFF, 0x00, 0x5A};
+    for (size_t f = 0; f < SDCount(fills); f++) {
+        for (size_t c = 0; c < SDCount(kPixelCounts); c++) {
+            size_t pixelCount = kPixelCounts[c];
+            SDTestBytes src = SDTestBytesCreate(pixelCount * 3, c % 4);
+            SDTestBytes dst = SDTestBytesCreate(pixelCount * 4, 0);
+            uint8_t *expected = malloc(pixelCount * 4 + 1);
+            SDReferenceExpand(src.bytes, expected, pixelCount, fills[f]);
+            SDPixelExpandRGBToRGBX(src.bytes, dst.bytes, pixelCount, fills[f]);
+            SDAssertEqualBytes(dst.bytes, expected, pixelCount * 4, "expand with 0x%02X: %zu pixels", fills[f], pixelCount);
+            free(src.memory);
+            free(dst.memory);
+            free(expected);
+        }
+    }
+}
+
+static void SDTestIsOpaque(void) {
+    // 块的边界（1024 像素）和 SIMD 宽度附近的像素数，不透明的像素放在开头、块的边界和末尾
+    static const size_t pixelCounts[] = {0, 1, 3, 4, 5, 8, 9, 17, 1023, 1024, 1025, 2048, 2051, 5000};
+    for (size_t alphaIndex = 0; alphaIndex < 4; alphaIndex += 3) {
+        for (size_t c = 0; c < SDCount(pixelCounts); c++) {
+            size_t pixelCount = pixelCounts[c];
+            SDTestBytes pixels = SDTestBytesCreate(pixelCount * 4, c % 4);
+            for (size_t i = 0; i < pixelCount; i++) {
+                pixels.bytes[i * 4 + alphaIndex] = 0xFF;
+            }
+            SDAssert(SDPixelIsOpaque(pixels.bytes, pixelCount, alphaIndex), "opaque: %zu pixels, alpha at %zu", pixelCount, alphaIndex);
+            size_t positions[] = {0, 1, 7, 1023, 1024, 1031, 2047, 2048, pixelCount - 1};
+            for (size_t p = 0; p < SDCount(positions); p++) {
+                size_t position = positions[p];
+                if (position >= pixelCount) {
+                    continue;
+                }
+                pixels.bytes[position * 4 + alphaIndex] = 0xFE;
+                SDAssert(!SDPixelIsOpaque(pixels.bytes, pixelCount, alphaIndex), "pixel %zu of %zu, alpha at %zu", position, pixelCount, alphaIndex);
+                // 其他通道不影响结果
+                pixels.bytes[position * 4 + alphaIndex] = 0xFF;
+                pixels.bytes[position * 4 + (alphaIndex + 1) % 4] = 0;
+                SDAssert(SDPixelIsOpaque(pixels.bytes, pixelCount, alphaIndex), "other channel of pixel %zu of %zu, alpha at %zu", position, pixelCount, alphaIndex);
+            }
+            free(pixels.memory);
+        }
+    }
+}
+
+int main(void) {
+#ifdef SD_PIXEL_TEST_CPU
+    if (!__builtin_cpu_supports(SD_PIXEL_TEST_CPU)) {
+        printf("skipped: the CPU does not support %s\n", SD_PIXEL_TEST_CPU);
+        return SD_TEST_SKIPPED;
+    }
+#endif
+    SDTestSwizzle();
+    SDTestPremultiply();
+    SDTestUnpremultiply();
+    SDTestExpand();
+    SDTestIsOpaque();
+    return SDTestResult();
+}
@@ -0,0 +1,116 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+/*
+ 缩放的性能测试
+
+ 8000x6000 的图片缩小到 SDWebImageCoderScaleDownLargeImagesKey 的像素预算（4579x3434）和 1024 像素，
+ 64 行一个条带，分别用 1、2、4、8 个线程处理所有条带，打印时间和相对一个线程的加速比。
+ 加速比受 CPU 核数限制，所以同时打印可用的核数。
+ */
+
+#include "SDWebImageResampler.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+static const size_t kSourceWidth = 8000;
+static const size_t kSourceHeight = 6000;
+static const size_t kBandHeight = 64;
+static const int kRepeatCount = 3;
+
+static double SDNow(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+typedef struct SDResampleJob {
+    const SDImageResampler *resampler;
+    const uint8_t *src;
+    size_t srcBytesPerRow;
+    uint8_t *dst;
+    size_t dstBytesPerRow;
+    pthread_mutex_t lock;
+    size_t nextBand;
+} SDResampleJob;
+
+// 每个线程依次取下一个还没有处理的条带
+static void *SDResampleThreadMain(void *argument) {
+    SDResampleJob *job = argument;
+    size_t bandCount = SDImageResamplerGetBandCount(job->resampler);
+    while (true) {
+        pthread_mutex_lock(&job->lock);
+        size_t band = job->nextBand++;
+        pthread_mutex_unlock(&job->lock);
+        if (band >= bandCount) {
+            break;
+        }
+        size_t srcRow, srcRowCount, dstRow, dstRowCount;
+        SDImageResamplerGetBandSourceRows(job->resampler, band, &srcRow, &srcRowCount);
+        SDImageResamplerGetBandDestinationRows(job->resampler, band, &dstRow, &dstRowCount);
+        SDImageResamplerProcessBand(job->resampler, band, job->src + srcRow * job->srcBytesPerRow, job->srcBytesPerRow,
+                                    job->dst + dstRow * job->dstBytesPerRow, job->dstBytesPerRow);
+    }
+    return NULL;
+}
+
+// 包括创建缩放器（计算系数）的时间，取几次中最快的一次
+static double SDMeasure(const uint8_t *src, uint8_t *dst, size_t dstWidth, size_t dstHeight, SDImageResampleFilter filter, size_t threadCount) {
+    double best = 0;
+    for (int i = 0; i < kRepeatCount; i++) {
+        double start = SDNow();
+        SDImageResampler *resampler = SDImageResamplerCreate(kSourceWidth, kSourceHeight, dstWidth, dstHeight, filter, kBandHeight);
+        SDResampleJob job = {resampler, src, kSourceWidth * 4, dst, dstWidth * 4, PTHREAD_MUTEX_INITIALIZER, 0};
+        pthread_t threads[8];
+        for (size_t t = 0; t < threadCount; t++) {
+            pthread_create(&threads[t], NULL, SDResampleThreadMain, &job);
+        }
+        for (size_t t = 0; t < threadCount; t++) {
+            pthread_join(threads[t], NULL);
+        }
+        SDImageResamplerRelease(resampler);
+        double time = SDNow() - start;
+        best = i == 0 || time < best ? time : best;
+    }
+    return best;
+}
+
+int main(void) {
+    static const size_t targets[][2] = {{4579, 3434}, {1024, 768}};
+    static const SDImageResampleFilter filters[] = {SDImageResampleFilterMitchell, SDImageResampleFilterLanczos3};
+    static const char *filterNames[] = {"Mitchell", "Lanczos3"};
+    static const size_t threadCounts[] = {1, 2, 4, 8};
+    printf("%ld CPUs online\n", sysconf(_SC_NPROCESSORS_ONLN));
+
+    uint8_t *src = malloc(kSourceWidth * kSourceHeight * 4);
+    uint32_t state = 1;
+    for (size_t i = 0; i < kSourceWidth * kSourceHeight * 4; i++) {
+        state = state * 1103515245u + 12345u;
+        src[i] = (uint8_t)(state >> 16);
+    }
+    for (size_t t = 0; t < sizeof(targets) / sizeof(targets[0]); t++) {
+        size_t dstWidth = targets[t][0], dstHeight = targets[t][1];
+        uint8_t *dst = malloc(dstWidth * dstHeight * 4);
+        for (size_t f = 0; f < sizeof(filters) / sizeof(filters[0]); f++) {
+            printf("%zux%zu -> %zux%zu %s, bands of %zu rows\n", kSourceWidth, kSourceHeight, dstWidth, dstHeight, filterNames[f], kBandHeight);
+            double single = 0;
+            for (size_t c = 0; c < sizeof(threadCounts) / sizeof(threadCounts[0]); c++) {
+                double time = SDMeasure(src, dst, dstWidth, dstHeight, filters[f], threadCounts[c]);
+                single = c == 0 ? time : single;
+                printf("  %zu threads %8.1f ms  %5.2fx\n", threadCounts[c], time * 1000, single / time);
+            }
+        }
+        free(dst);
+    }
+    free(src);
+    return 0;
+}
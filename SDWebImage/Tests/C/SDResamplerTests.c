@@ -0,0 +1,203 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#include "SDTestAssert.h"
+#include "SDWebImageResampler.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SDCount(array) (sizeof(array) / sizeof((array)[0]))
+
+static const SDImageResampleFilter kFilters[] = {SDImageResampleFilterMitchell, SDImageResampleFilterLanczos3};
+static const char *kFilterNames[] = {"Mitchell", "Lanczos3"};
+
+// 缩小、放大、只缩放一个方向、缩到一个像素和极端的宽高比
+static const size_t kSizes[][4] = {
+    {64, 48, 16, 12}, {97, 61, 40, 23}, {40, 30, 97, 71}, {300, 200, 299, 201}, {128, 128, 128, 37},
+    {33, 210, 33, 50}, {500, 3, 20, 3}, {3, 500, 3, 20}, {75, 75, 1, 1}, {1, 1, 9, 7}, {1000, 20, 7, 19}, {20000, 2, 3, 2}, {2, 20000, 2, 3},
+};
+
+static uint32_t SDRandomState = 1;
+
+static uint8_t SDRandomByte(void) {
+    SDRandomState = SDRandomState * 1103515245u + 12345u;
+    return (uint8_t)(SDRandomState >> 16);
+}
+
+// 每行末尾有多余字节的源图片，行的长度不是像素的整数倍
+static uint8_t *SDSourceImage(size_t width, size_t height, size_t bytesPerRow) {
+    uint8_t *pixels = malloc(bytesPerRow * height);
+    for (size_t i = 0; i < bytesPerRow * height; i++) {
+        pixels[i] = SDRandomByte();
+    }
+    return pixels;
+}
+
+// 只把条带需要读取的源图片行复制到刚好大小的内存中，读取这些行之外的内容可以被内存检查工具发现
+static bool SDProcessBand(const SDImageResampler *resampler, size_t band, const uint8_t *src, size_t srcBytesPerRow, uint8_t *dst, size_t dstBytesPerRow) {
+    size_t srcFirst, srcCount, dstFirst, dstCount;
+    SDImageResamplerGetBandSourceRows(resampler, band, &srcFirst, &srcCount);
+    SDImageResamplerGetBandDestinationRows(resampler, band, &dstFirst, &dstCount);
+    uint8_t *rows = malloc(srcCount * srcBytesPerRow);
+    memcpy(rows, src + srcFirst * srcBytesPerRow, srcCount * srcBytesPerRow);
+    bool success = SDImageResamplerProcessBand(resampler, band, rows, srcBytesPerRow, dst + dstFirst * dstBytesPerRow, dstBytesPerRow);
+    free(rows);
+    return success;
+}
+
+// 整张图片作为一个条带缩放，作为参照
+static uint8_t *SDResampleSingleBand(const uint8_t *src, size_t srcWidth, size_t srcHeight, size_t srcBytesPerRow, size_t dstWidth, size_t dstHeight, SDImageResampleFilter filter) {
+    SDImageResampler *resampler = SDImageResamplerCreate(srcWidth, srcHeight, dstWidth, dstHeight, filter, 0);
+    uint8_t *dst = calloc(dstWidth * dstHeight, 4);
+    SDAssertEqual(SDImageResamplerGetBandCount(resampler), 1, "single band");
+    SDAssert(SDProcessBand(resampler, 0, src, srcBytesPerRow, dst, dstWidth * 4), "single band");
+    SDImageResamplerRelease(resampler);
+    return dst;
+}
+
+typedef struct SDBandThread {
+    const SDImageResampler *resampler;
+    const uint8_t *src;
+    size_t srcBytesPerRow;
+    uint8_t *dst;
+    size_t dstBytesPerRow;
+    size_t firstBand;
+    size_t bandStep;
+    bool success;
+} SDBandThread;
+
+static void *SDBandThreadMain(void *argument) {
+    SDBandThread *thread = argument;
+    thread->success = true;
+    for (size_t band = thread->firstBand; band < SDImageResamplerGetBandCount(thread->resampler); band += thread->bandStep) {
+        size_t srcFirst, srcCount, dstFirst, dstCount;
+        SDImageResamplerGetBandSourceRows(thread->resampler, band, &srcFirst, &srcCount);
+        SDImageResamplerGetBandDestinationRows(thread->resampler, band, &dstFirst, &dstCount);
+        const uint8_t *src = thread->src + srcFirst * thread->srcBytesPerRow;
+        uint8_t *dst = thread->dst + dstFirst * thread->dstBytesPerRow;
+        thread->success = SDImageResamplerProcessBand(thread->resampler, band, src, thread->srcBytesPerRow, dst, thread->dstBytesPerRow) && thread->success;
+    }
+    return NULL;
+}
+
+static void SDTestBandsMatchSingleBand(void) {
+    static const size_t bandHeights[] = {1, 2, 3, 7, 16};
+    for (size_t f = 0; f < SDCount(kFilters); f++) {
+        for (size_t s = 0; s < SDCount(kSizes); s++) {
+            size_t srcWidth = kSizes[s][0], srcHeight = kSizes[s][1], dstWidth = kSizes[s][2], dstHeight = kSizes[s][3];
+            size_t srcBytesPerRow = srcWidth * 4 + s % 3;
+            size_t dstBytesPerRow = dstWidth * 4;
+            uint8_t *src = SDSourceImage(srcWidth, srcHeight, srcBytesPerRow);
+            uint8_t *expected = SDResampleSingleBand(src, srcWidth, srcHeight, srcBytesPerRow, dstWidth, dstHeight, kFilters[f]);
+            size_t dstLength = dstBytesPerRow * dstHeight;
+            for (size_t b = 0; b < SDCount(bandHeights); b++) {
+                SDImageResampler *resampler = SDImageResamplerCreate(srcWidth, srcHeight, dstWidth, dstHeight, kFilters[f], bandHeights[b]);
+                size_t bandCount = SDImageResamplerGetBandCount(resampler);
+                SDAssertEqual(bandCount, (dstHeight + bandHeights[b] - 1) / bandHeights[b], "%s %zux%zu", kFilterNames[f], dstWidth, dstHeight);
+                // 条带的目标行首尾相接，源图片行不超出图片
+                size_t nextRow = 0;
+                for (size_t band = 0; band < bandCount; band++) {
+                    size_t first, count;
+                    SDImageResamplerGetBandDestinationRows(resampler, band, &first, &count);
+                    SDAssertEqual(first, nextRow, "band %zu", band);
+                    nextRow = first + count;
+                    SDImageResamplerGetBandSourceRows(resampler, band, &first, &count);
+                    SDAssert(count > 0 && first + count <= srcHeight, "band %zu reads rows %zu..%zu of %zu", band, first, first + count, srcHeight);
+                }
+                SDAssertEqual(nextRow, dstHeight, "%s %zux%zu", kFilterNames[f], dstWidth, dstHeight);
+
+                // 倒序处理条带，每个条带只能看到它的源图片行
+                uint8_t *dst = calloc(dstLength, 1);
+                for (size_t band = bandCount; band > 0; band--) {
+                    SDAssert(SDProcessBand(resampler, band - 1, src, srcBytesPerRow, dst, dstBytesPerRow), "band %zu", band - 1);
+                }
+                SDAssertEqualBytes(dst, expected, dstLength, "%s %zux%zu -> %zux%zu, bands of %zu rows", kFilterNames[f], srcWidth, srcHeight, dstWidth, dstHeight, bandHeights[b]);
+
+                // 多个线程同时处理不同的条带
+                memset(dst, 0, dstLength);
+                SDBandThread threads[4];
+                pthread_t threadIDs[4];
+                for (size_t t = 0; t < 4; t++) {
+                    SDBandThread thread = {resampler, src, srcBytesPerRow, dst, dstBytesPerRow, t, 4, false};
+                    threads[t] = thread;
+                }
+                for (size_t t = 0; t < 4; t++) {
+                    pthread_create(&threadIDs[t], NULL, SDBandThreadMain, &threads[t]);
+                }
+                for (size_t t = 0; t < 4; t++) {
+                    pthread_join(threadIDs[t], NULL);
+                    SDAssert(threads[t].success, "thread %zu", t);
+                }
+                SDAssertEqualBytes(dst, expected, dstLength, "%s %zux%zu -> %zux%zu, bands of %zu rows on 4 threads", kFilterNames[f], srcWidth, srcHeight, dstWidth, dstHeight, bandHeights[b]);
+                free(dst);
+                SDImageResamplerRelease(resampler);
+            }
+            free(src);
+            free(expected);
+        }
+    }
+}
+
+static void SDTestFlatImageStaysFlat(void) {
+    // 系数的和是 1，单色的图片缩放后颜色不变，Lanczos 的负系数也不会在边缘产生振铃
+    static const uint8_t colors[][4] = {
+        {0, 0, 0, 0}, {255, 255, 255, 255}, {1, 1, 1, 1}, {254, 254, 254, 254}, {127, 128, 129, 255}, {10, 200, 37, 255}, {3, 0, 255, 90},
+    };
+    for (size_t f = 0; f < SDCount(kFilters); f++) {
+        for (size_t s = 0; s < SDCount(kSizes); s++) {
+            size_t srcWidth = kSizes[s][0], srcHeight = kSizes[s][1], dstWidth = kSizes[s][2], dstHeight = kSizes[s][3];
+            for (size_t c = 0; c < SDCount(colors); c++) {
+                uint8_t *src = malloc(srcWidth * srcHeight * 4);
+                for (size_t i = 0; i < srcWidth * srcHeight; i++) {
+                    memcpy(src + i * 4, colors[c], 4);
+                }
+                uint8_t *dst = SDResampleSingleBand(src, srcWidth, srcHeight, srcWidth * 4, dstWidth, dstHeight, kFilters[f]);
+                for (size_t i = 0; i < dstWidth * dstHeight; i++) {
+                    if (memcmp(dst + i * 4, colors[c], 4) != 0) {
+                        SDAssert(false, "%s %zux%zu -> %zux%zu: pixel %zu is (%u, %u, %u, %u), expected (%u, %u, %u, %u)", kFilterNames[f], srcWidth, srcHeight, dstWidth, dstHeight, i,
+                                 dst[i * 4], dst[i * 4 + 1], dst[i * 4 + 2], dst[i * 4 + 3], colors[c][0], colors[c][1], colors[c][2], colors[c][3]);
+                        break;
+                    }
+                }
+                free(src);
+                free(dst);
+            }
+        }
+    }
+}
+
+static void SDTestLanczosIdentity(void) {
+    // Lanczos 在整数位置上除了中心都是 0，同样大小时结果和原图相同
+    uint8_t *src = SDSourceImage(37, 23, 37 * 4);
+    uint8_t *dst = SDResampleSingleBand(src, 37, 23, 37 * 4, 37, 23, SDImageResampleFilterLanczos3);
+    SDAssertEqualBytes(dst, src, 37 * 23 * 4, "Lanczos3 at the same size");
+    free(src);
+    free(dst);
+}
+
+static void SDTestInvalidSizes(void) {
+    SDAssert(SDImageResamplerCreate(0, 10, 5, 5, SDImageResampleFilterMitchell, 0) == NULL, "zero source width");
+    SDAssert(SDImageResamplerCreate(10, 0, 5, 5, SDImageResampleFilterMitchell, 0) == NULL, "zero source height");
+    SDAssert(SDImageResamplerCreate(10, 10, 0, 5, SDImageResampleFilterMitchell, 0) == NULL, "zero destination width");
+    SDAssert(SDImageResamplerCreate(10, 10, 5, 0, SDImageResampleFilterMitchell, 0) == NULL, "zero destination height");
+    SDAssertEqual(SDImageResamplerGetBandCount(NULL), 0, "no resampler");
+    // 条带高度为 0 或者比图片高时只有一个条带
+    SDImageResampler *resampler = SDImageResamplerCreate(10, 10, 5, 5, SDImageResampleFilterMitchell, 100);
+    SDAssertEqual(SDImageResamplerGetBandCount(resampler), 1, "band taller than the image");
+    SDImageResamplerRelease(resampler);
+}
+
+int main(void) {
+    SDTestBandsMatchSingleBand();
+    SDTestFlatImageStaysFlat();
+    SDTestLanczosIdentity();
+    SDTestInvalidSizes();
+    return SDTestResult();
+}
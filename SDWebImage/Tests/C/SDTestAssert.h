@@ -0,0 +1,53 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+/*
+ C 测试使用的断言
+
+ 断言失败时打印位置并计数，不会中止测试，main 最后返回 SDTestResult() 交给 ctest 判断是否通过。
+ */
+
+#ifndef SDTestAssert_h
+#define SDTestAssert_h
+
+#include <stdio.h>
+#include <string.h>
+
+static int SDTestFailureCount = 0;
+
+#define SDAssert(condition, ...) do { \
+    if (!(condition)) { \
+        SDTestFailureCount++; \
+        fprintf(stderr, "%s:%d: assertion failed: %s: ", __FILE__, __LINE__, #condition); \
+        fprintf(stderr, __VA_ARGS__); \
+        fprintf(stderr, "\n"); \
+    } \
+} while (0)
+
+#define SDAssertEqual(a, b, ...) do { \
+    long long sd_a = (long long)(a); \
+    long long sd_b = (long long)(b); \
+    if (sd_a != sd_b) { \
+        SDTestFailureCount++; \
+        fprintf(stderr, "%s:%d: %s == %s failed (%lld != %lld): ", __FILE__, __LINE__, #a, #b, sd_a, sd_b); \
+        fprintf(stderr, __VA_ARGS__); \
+        fprintf(stderr, "\n"); \
+    } \
+} while (0)
+
+#define SDAssertEqualBytes(a, b, length, ...) SDAssert(memcmp((a), (b), (length)) == 0, __VA_ARGS__)
+
+static inline int SDTestResult(void) {
+    if (SDTestFailureCount > 0) {
+        fprintf(stderr, "%d assertion(s) failed\n", SDTestFailureCount);
+        return 1;
+    }
+    return 0;
+}
+
+#endif /* SDTestAssert_h */
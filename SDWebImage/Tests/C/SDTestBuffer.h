@@ -0,0 +1,68 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+// C 测试中拼接二进制数据的缓冲区
+
+#ifndef SDTestBuffer_h
+#define SDTestBuffer_h
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct SDBuffer {
+    uint8_t *bytes;
+    size_t length;
+    size_t capacity;
+} SDBuffer;
+
+static inline void SDBufferAppend(SDBuffer *buffer, const void *bytes, size_t length) {
+    if (buffer->length + length > buffer->capacity) {
+        buffer->capacity = (buffer->length + length) * 2;
+        buffer->bytes = realloc(buffer->bytes, buffer->capacity);
+    }
+    memcpy(buffer->bytes + buffer->length, bytes, length);
+    buffer->length += length;
+}
+
+static inline void SDBufferAppendByte(SDBuffer *buffer, uint8_t byte) {
+    SDBufferAppend(buffer, &byte, 1);
+}
+
+static inline void SDBufferAppendBig16(SDBuffer *buffer, uint32_t value) {
+    SDBufferAppendByte(buffer, (uint8_t)(value >> 8));
+    SDBufferAppendByte(buffer, (uint8_t)value);
+}
+
+static inline void SDBufferAppendBig32(SDBuffer *buffer, uint32_t value) {
+    SDBufferAppendBig16(buffer, value >> 16);
+    SDBufferAppendBig16(buffer, value & 0xFFFF);
+}
+
+static inline void SDBufferAppendLittle16(SDBuffer *buffer, uint32_t value) {
+    SDBufferAppendByte(buffer, (uint8_t)value);
+    SDBufferAppendByte(buffer, (uint8_t)(value >> 8));
+}
+
+static inline void SDBufferAppendLittle24(SDBuffer *buffer, uint32_t value) {
+    SDBufferAppendLittle16(buffer, value & 0xFFFF);
+    SDBufferAppendByte(buffer, (uint8_t)(value >> 16));
+}
+
+static inline void SDBufferAppendLittle32(SDBuffer *buffer, uint32_t value) {
+    SDBufferAppendLittle16(buffer, value & 0xFFFF);
+    SDBufferAppendLittle16(buffer, value >> 16);
+}
+
+static inline SDBuffer SDBufferWithBytes(const void *bytes, size_t length) {
+    SDBuffer buffer = {0};
+    SDBufferAppend(&buffer, bytes, length);
+    return buffer;
+}
+
+#endif /* SDTestBuffer_h */
@@ -0,0 +1,212 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+/*
+ 生成测试用的 GIF
+
+ 帧的像素是颜色表的索引，按行存储，写入时用 LZW 压缩（字典满 4096 个编码时输出清除码），隔行扫描的帧按四遍的顺序写入各行。
+ */
+
+#ifndef SDTestGIF_h
+#define SDTestGIF_h
+
+#include "SDTestBuffer.h"
+#include "SDWebImageGIFDecoder.h"
+#include <stdbool.h>
+
+typedef struct SDTestGIFFrame {
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+    // width * height color indexes, row by row
+    const uint8_t *indexes;
+    // -1 for no transparent color
+    int transparentIndex;
+    SDGIFDisposal disposal;
+    uint16_t delay;
+    bool interlaced;
+    // A local color table, or NULL to use the global one
+    const uint8_t *colorTable;
+    uint32_t colorCount;
+    // The number of pixels written to the LZW data, 0 for all of them. Fewer pixels make a truncated stream
+    size_t encodedPixelCount;
+} SDTestGIFFrame;
+
+// Number of bits of a color table with at least `colorCount` entries, between 1 and 8
+static inline uint32_t SDTestGIFColorBits(uint32_t colorCount) {
+    uint32_t bits = 1;
+    while ((1u << bits) < colorCount && bits < 8) {
+        bits++;
+    }
+    return bits;
+}
+
+typedef struct SDTestGIFBitWriter {
+    SDBuffer *buffer;
+    uint8_t block[255];
+    size_t blockLength;
+    uint32_t bitBuffer;
+    uint32_t bitCount;
+} SDTestGIFBitWriter;
+
+static inline void SDTestGIFFlushBlock(SDTestGIFBitWriter *writer) {
+    if (writer->blockLength > 0) {
+        SDBufferAppendByte(writer->buffer, (uint8_t)writer->blockLength);
+        SDBufferAppend(writer->buffer, writer->block, writer->blockLength);
+        writer->blockLength = 0;
+    }
+}
+
+static inline void SDTestGIFWriteCode(SDTestGIFBitWriter *writer, uint32_t code, uint32_t codeSize) {
+    writer->bitBuffer |= code << writer->bitCount;
+    writer->bitCount += codeSize;
+    while (writer->bitCount >= 8) {
+        writer->block[writer->blockLength++] = (uint8_t)writer->bitBuffer;
+        writer->bitBuffer >>= 8;
+        writer->bitCount -= 8;
+        if (writer->blockLength == 255) {
+            SDTestGIFFlushBlock(writer);
+        }
+    }
+}
+
+// LZW data of `pixelCount` indexes: minimum code size, sub-blocks and the block terminator
+static inline void SDTestGIFAppendLZW(SDBuffer *buffer, const uint8_t *indexes, size_t pixelCount, uint32_t minimumCodeSize) {
+    SDBufferAppendByte(buffer, (uint8_t)minimumCodeSize);
+    // 字典：前缀编码和下一个索引到新编码，0 表示没有
+    uint16_t *table = calloc(4096 * 256, sizeof(uint16_t));
+    SDTestGIFBitWriter writer = {.buffer = buffer};
+    uint32_t clearCode = 1u << minimumCodeSize;
+    uint32_t codeSize = minimumCodeSize + 1;
+    uint32_t nextCode = clearCode + 2;
+    SDTestGIFWriteCode(&writer, clearCode, codeSize);
+    if (pixelCount > 0) {
+        uint32_t current = indexes[0];
+        for (size_t i = 1; i < pixelCount; i++) {
+            uint8_t index = indexes[i];
+            uint16_t code = table[current * 256 + index];
+            if (code != 0) {
+                current = code;
+                continue;
+            }
+            SDTestGIFWriteCode(&writer, current, codeSize);
+            if (nextCode < 4096) {
+                table[current * 256 + index] = (uint16_t)nextCode++;
+                // 解码器晚一个编码加入字典，所以在编码数超过当前位数时才增加
+                if (nextCode > (1u << codeSize) && codeSize < 12) {
+                    codeSize++;
+                }
+            } else {
+                SDTestGIFWriteCode(&writer, clearCode, codeSize);
+                memset(table, 0, 4096 * 256 * sizeof(uint16_t));
+                codeSize = minimumCodeSize + 1;
+                nextCode = clearCode + 2;
+            }
+            current = index;
+        }
+        SDTestGIFWriteCode(&writer, current, codeSize);
+    }
+    SDTestGIFWriteCode(&writer, clearCode + 1, codeSize);
+    if (writer.bitCount > 0) {
+        SDTestGIFWriteCode(&writer, 0, 8 - writer.bitCount);
+    }
+    SDTestGIFFlushBlock(&writer);
+    SDBufferAppendByte(buffer, 0);
+    free(table);
+}
+
+static inline void SDTestGIFAppendColorTable(SDBuffer *buffer, const uint8_t *colorTable, uint32_t colorCount) {
+    uint32_t tableCount = 1u << SDTestGIFColorBits(colorCount);
+    SDBufferAppend(buffer, colorTable, colorCount * 3);
+    for (uint32_t i = colorCount; i < tableCount; i++) {
+        SDBufferAppend(buffer, "\0\0\0", 3);
+    }
+}
+
+/**
+ * Write a GIF89a
+ *
+ * @param loopCount The loop count of the NETSCAPE2.0 extension, -1 to omit it
+ */
+static inline SDBuffer SDTestGIFCreate(uint32_t width, uint32_t height, const uint8_t *colorTable, uint32_t colorCount, int loopCount, const SDTestGIFFrame *frames, size_t frameCount) {
+    SDBuffer buffer = {0};
+    SDBufferAppend(&buffer, "GIF89a", 6);
+    SDBufferAppendLittle16(&buffer, width);
+    SDBufferAppendLittle16(&buffer, height);
+    uint32_t colorBits = SDTestGIFColorBits(colorCount);
+    SDBufferAppendByte(&buffer, colorTable ? (uint8_t)(0x80 | ((colorBits - 1) << 4) | (colorBits - 1)) : 0);
+    SDBufferAppend(&buffer, "\0\0", 2);
+    if (colorTable) {
+        SDTestGIFAppendColorTable(&buffer, colorTable, colorCount);
+    }
+    if (loopCount >= 0) {
+        SDBufferAppend(&buffer, "\x21\xFF\x0BNETSCAPE2.0\x03\x01", 16);
+        SDBufferAppendLittle16(&buffer, (uint32_t)loopCount);
+        SDBufferAppendByte(&buffer, 0);
+    }
+    for (size_t i = 0; i < frameCount; i++) {
+        const SDTestGIFFrame *frame = &frames[i];
+        // Graphic control extension
+        SDBufferAppend(&buffer, "\x21\xF9\x04", 3);
+        SDBufferAppendByte(&buffer, (uint8_t)((frame->disposal << 2) | (frame->transparentIndex >= 0 ? 1 : 0)));
+        SDBufferAppendLittle16(&buffer, frame->delay);
+        SDBufferAppendByte(&buffer, frame->transparentIndex >= 0 ? (uint8_t)frame->transparentIndex : 0);
+        SDBufferAppendByte(&buffer, 0);
+        // Image descriptor
+        SDBufferAppendByte(&buffer, 0x2C);
+        SDBufferAppendLittle16(&buffer, frame->x);
+        SDBufferAppendLittle16(&buffer, frame->y);
+        SDBufferAppendLittle16(&buffer, frame->width);
+        SDBufferAppendLittle16(&buffer, frame->height);
+        uint32_t frameColorCount = frame->colorTable ? frame->colorCount : colorCount;
+        uint8_t flags = frame->interlaced ? 0x40 : 0;
+        if (frame->colorTable) {
+            flags |= 0x80 | (SDTestGIFColorBits(frame->colorCount) - 1);
+        }
+        SDBufferAppendByte(&buffer, flags);
+        if (frame->colorTable) {
+            SDTestGIFAppendColorTable(&buffer, frame->colorTable, frame->colorCount);
+        }
+        size_t pixelCount = (size_t)frame->width * frame->height;
+        const uint8_t *indexes = frame->indexes;
+        uint8_t *interlaced = NULL;
+        if (frame->interlaced) {
+            // 四遍：第 0 行起每 8 行、第 4 行起每 8 行、第 2 行起每 4 行、第 1 行起每 2 行
+            static const uint32_t starts[4] = {0, 4, 2, 1};
+            static const uint32_t steps[4] = {8, 8, 4, 2};
+            interlaced = malloc(pixelCount);
+            size_t row = 0;
+            for (int pass = 0; pass < 4; pass++) {
+                for (uint32_t y = starts[pass]; y < frame->height; y += steps[pass]) {
+                    memcpy(interlaced + row++ * frame->width, frame->indexes + (size_t)y * frame->width, frame->width);
+                }
+            }
+            indexes = interlaced;
+        }
+        uint32_t minimumCodeSize = SDTestGIFColorBits(frameColorCount);
+        if (frame->encodedPixelCount > 0 && frame->encodedPixelCount < pixelCount) {
+            pixelCount = frame->encodedPixelCount;
+        }
+        SDTestGIFAppendLZW(&buffer, indexes, pixelCount, minimumCodeSize < 2 ? 2 : minimumCodeSize);
+        free(interlaced);
+    }
+    SDBufferAppendByte(&buffer, 0x3B);
+    return buffer;
+}
+
+// 测试用的颜色表：每个颜色都不同，颜色之间没有规律
+static inline void SDTestGIFFillColorTable(uint8_t *colorTable, uint32_t colorCount, uint32_t seed) {
+    for (uint32_t i = 0; i < colorCount; i++) {
+        colorTable[i * 3] = (uint8_t)(i * 37 + seed);
+        colorTable[i * 3 + 1] = (uint8_t)(i * 91 + seed * 7);
+        colorTable[i * 3 + 2] = (uint8_t)i;
+    }
+}
+
+#endif /* SDTestGIF_h */
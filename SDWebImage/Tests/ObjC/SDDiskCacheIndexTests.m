@@ -0,0 +1,272 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDTestCase.h"
+#import "SDDiskCacheIndex.h"
+#import "SDImageCache.h"
+#import <fcntl.h>
+#import <sys/time.h>
+
+static const NSTimeInterval kDay = 24 * 60 * 60;
+
+@interface SDDiskCacheIndexTests : SDTestCase
+
+@end
+
+@implementation SDDiskCacheIndexTests
+
+- (NSString *)journalPath {
+    return [self.temporaryDirectory stringByAppendingPathComponent:@".sdindex"];
+}
+
+- (void)test01MissingJournalNeedsRebuild {
+    SDDiskCacheIndex *index = [[SDDiskCacheIndex alloc] initWithDirectory:self.temporaryDirectory];
+    XCTAssertFalse([index loadJournal]);
+    XCTAssertFalse(index.isLoaded);
+}
+
+- (void)test02RebuildScansDirectoryInBatches {
+    NSFileManager *fileManager = [NSFileManager new];
+    for (NSUInteger i = 0; i < 5; i++) {
+        NSString *path = [self.temporaryDirectory stringByAppendingPathComponent:[NSString stringWithFormat:@"file%lu.png", (unsigned long)i]];
+        [[self dataWithLength:10 + i seed:(uint8_t)i] writeToFile:path atomically:NO];
+    }
+    SDDiskCacheIndex *index = [[SDDiskCacheIndex alloc] initWithDirectory:self.temporaryDirectory];
+    NSUInteger calls = 0;
+    while (![index rebuildWithFileManager:fileManager batchSize:2]) {
+        calls++;
+        XCTAssertLessThan(calls, 10u);
+    }
+    XCTAssertTrue(index.isLoaded);
+    XCTAssertEqual(index.count, 5u);
+    XCTAssertEqual(index.totalSize, 10u + 11 + 12 + 13 + 14);
+
+    // 重建后写入了新的日志，不需要再扫描目录
+    SDDiskCacheIndex *reloaded = [[SDDiskCacheIndex alloc] initWithDirectory:self.temporaryDirectory];
+    XCTAssertTrue([reloaded loadJournal]);
+    XCTAssertEqual(reloaded.count, 5u);
+    XCTAssertEqual(reloaded.totalSize, index.totalSize);
+}
+
+- (void)test03JournalReplaysWritesRemovalsAndValidators {
+    SDDiskCacheIndex *index = [[SDDiskCacheIndex alloc] initWithDirectory:self.temporaryDirectory];
+    [index rebuildWithFileManager:[NSFileManager new] batchSize:100];
+    [index setEntryForFileName:@"a.png" size:100 expirationTime:0];
+    [index setEntryForFileName:@"b.png" size:200 expirationTime:0];
+    [index setEntryForFileName:@"a.png" size:150 expirationTime:0];
+    [index setEntryForFileName:@"c\tname.png" size:300 expirationTime:0];
+    [index removeEntryForFileName:@"b.png"];
+    XCTAssertTrue([index setHTTPValidatorsForFileName:@"a.png" ETag:@"\"v1\"" lastModified:nil freshnessTime:1234]);
+    XCTAssertFalse([index setHTTPValidatorsForFileName:@"b.png" ETag:@"\"v2\"" lastModified:nil freshnessTime:0]);
+    [index recordAccessForFileName:@"c\tname.png"];
+    [index synchronize];
+
+    SDDiskCacheIndex *reloaded = [[SDDiskCacheIndex alloc] initWithDirectory:self.temporaryDirectory];
+    XCTAssertTrue([reloaded loadJournal]);
+    XCTAssertEqual(reloaded.count, 2u);
+    XCTAssertEqual(reloaded.totalSize, 450u);
+    XCTAssertNil([reloaded entryForFileName:@"b.png"]);
+    SDDiskCacheIndexEntry *entry = [reloaded entryForFileName:@"a.png"];
+    XCTAssertEqual(entry.size, 150u);
+    XCTAssertEqualObjects(entry.ETag, @"\"v1\"");
+    XCTAssertNil(entry.lastModified);
+    XCTAssertEqual(entry.freshnessTime, 1234);
+    XCTAssertEqual([reloaded entryForFileName:@"c\tname.png"].accessCount, 1u);
+}
+
+- (void)test04TruncatedLastRecordIsDiscarded {
+    SDDiskCacheIndex *index = [[SDDiskCacheIndex alloc] initWithDirectory:self.temporaryDirectory];
+    [index rebuildWithFileManager:[NSFileManager new] batchSize:100];
+    [index setEntryForFileName:@"a.png" size:100 expirationTime:0];
+    [index setEntryForFileName:@"b.png" size:200 expirationTime:0];
+
+    // 模拟写入最后一条记录时进程被杀
+    NSMutableData *journal = [NSMutableData dataWithContentsOfFile:[self journalPath]];
+    journal.length -= 3;
+    [journal writeToFile:[self journalPath] atomically:NO];
+
+    SDDiskCacheIndex *reloaded = [[SDDiskCacheIndex alloc] initWithDirectory:self.temporaryDirectory];
+    XCTAssertTrue([reloaded loadJournal]);
+    XCTAssertEqual(reloaded.count, 1u);
+    XCTAssertNotNil([reloaded entryForFileName:@"a.png"]);
+
+    // 丢弃不完整的记录后日志被重写，之后追加的记录不会接在半行后面
+    [reloaded setEntryForFileName:@"c.png" size:300 expirationTime:0];
+    SDDiskCacheIndex *again = [[SDDiskCacheIndex alloc] initWithDirectory:self.temporaryDirectory];
+    XCTAssertTrue([again loadJournal]);
+    XCTAssertEqual(again.count, 2u);
+    XCTAssertEqual(again.totalSize, 400u);
+}
+
+- (void)test05CorruptJournalNeedsRebuild {
+    NSData *journal = [@"SDDiskCacheIndex\t2\n?\tbroken\n" dataUsingEncoding:NSUTF8StringEncoding];
+    [journal writeToFile:[self journalPath] atomically:NO];
+    SDDiskCacheIndex *index = [[SDDiskCacheIndex alloc] initWithDirectory:self.temporaryDirectory];
+    XCTAssertFalse([index loadJournal]);
+
+    NSData *oldVersion = [@"SDDiskCacheIndex\t1\n" dataUsingEncoding:NSUTF8StringEncoding];
+    [oldVersion writeToFile:[self journalPath] atomically:NO];
+    XCTAssertFalse([index loadJournal]);
+}
+
+- (void)test06ChangesBeforeLoadingArePersisted {
+    SDDiskCacheIndex *index = [[SDDiskCacheIndex alloc] initWithDirectory:self.temporaryDirectory];
+    [index rebuildWithFileManager:[NSFileManager new] batchSize:100];
+    [index setEntryForFileName:@"a.png" size:100 expirationTime:0];
+    [index setEntryForFileName:@"b.png" size:200 expirationTime:0];
+
+    // 日志读取完之前的写入和删除只在内存中，读取时合并，并且要重写日志
+    SDDiskCacheIndex *loading = [[SDDiskCacheIndex alloc] initWithDirectory:self.temporaryDirectory];
+    [loading setEntryForFileName:@"c.png" size:300 expirationTime:0];
+    [loading removeEntryForFileName:@"a.png"];
+    XCTAssertTrue([loading loadJournal]);
+    XCTAssertEqual(loading.count, 2u);
+    XCTAssertEqual(loading.totalSize, 500u);
+
+    SDDiskCacheIndex *reloaded = [[SDDiskCacheIndex alloc] initWithDirectory:self.temporaryDirectory];
+    XCTAssertTrue([reloaded loadJournal]);
+    XCTAssertNil([reloaded entryForFileName:@"a.png"]);
+    XCTAssertEqual([reloaded entryForFileName:@"b.png"].size, 200u);
+    XCTAssertEqual([reloaded entryForFileName:@"c.png"].size, 300u);
+}
+
+- (void)test07RemoveAllEntriesResetsJournal {
+    SDDiskCacheIndex *index = [[SDDiskCacheIndex alloc] initWithDirectory:self.temporaryDirectory];
+    [index rebuildWithFileManager:[NSFileManager new] batchSize:100];
+    [index setEntryForFileName:@"a.png" size:100 expirationTime:0];
+    [index removeAllEntries];
+    XCTAssertEqual(index.count, 0u);
+    XCTAssertEqual(index.totalSize, 0u);
+
+    SDDiskCacheIndex *reloaded = [[SDDiskCacheIndex alloc] initWithDirectory:self.temporaryDirectory];
+    [reloaded loadJournal];
+    XCTAssertEqual(reloaded.count, 0u);
+}
+
+#pragma mark - Benchmark
+
+// 填充缓存目录：1~8KB 的文件，每 100 个文件中有一个 40 天前写入的和一个 20 天前写入的
+- (void)fillDirectory:(NSString *)directory count:(NSUInteger)count {
+    [[NSFileManager defaultManager] createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:nil];
+    NSData *data = [self dataWithLength:8192 seed:1];
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    for (NSUInteger i = 0; i < count; i++) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%016lx%016lx.jpg", directory.fileSystemRepresentation, (unsigned long)i * 2654435761u, (unsigned long)i);
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        write(fd, data.bytes, 1024 + i * 7919 % 7168);
+        close(fd);
+        if (i % 100 < 2) {
+            struct timeval times[2] = {now, now};
+            times[0].tv_sec = times[1].tv_sec = now.tv_sec - (i % 100 == 0 ? 40 : 20) * (time_t)kDay;
+            utimes(path, times);
+        }
+    }
+}
+
+// 加索引之前 getSize 的做法：遍历缓存目录，逐个读取文件属性
+- (NSUInteger)directoryScanSizeOfPath:(NSString *)path {
+    NSUInteger size = 0;
+    NSDirectoryEnumerator *fileEnumerator = [[NSFileManager defaultManager] enumeratorAtPath:path];
+    for (NSString *fileName in fileEnumerator) {
+        @autoreleasepool {
+            NSString *filePath = [path stringByAppendingPathComponent:fileName];
+            NSDictionary<NSString *, id> *attrs = [[NSFileManager defaultManager] attributesOfItemAtPath:filePath error:nil];
+            size += [attrs fileSize];
+        }
+    }
+    return size;
+}
+
+// 加索引之前 deleteOldFilesWithCompletionBlock: 的过期清理：遍历缓存目录，预取修改时间和大小，删除过期的文件
+- (NSUInteger)directoryScanTrimPath:(NSString *)path maxCacheAge:(NSTimeInterval)maxCacheAge {
+    NSFileManager *fileManager = [NSFileManager new];
+    NSArray<NSString *> *resourceKeys = @[NSURLIsDirectoryKey, NSURLContentModificationDateKey, NSURLTotalFileAllocatedSizeKey];
+    NSDirectoryEnumerator *fileEnumerator = [fileManager enumeratorAtURL:[NSURL fileURLWithPath:path isDirectory:YES]
+                                              includingPropertiesForKeys:resourceKeys
+                                                                 options:NSDirectoryEnumerationSkipsHiddenFiles
+                                                            errorHandler:NULL];
+    NSDate *expirationDate = [NSDate dateWithTimeIntervalSinceNow:-maxCacheAge];
+    NSMutableDictionary<NSURL *, NSDictionary<NSString *, id> *> *cacheFiles = [NSMutableDictionary dictionary];
+    NSMutableArray<NSURL *> *urlsToDelete = [NSMutableArray array];
+    for (NSURL *fileURL in fileEnumerator) {
+        NSDictionary<NSString *, id> *resourceValues = [fileURL resourceValuesForKeys:resourceKeys error:nil];
+        if (!resourceValues || [resourceValues[NSURLIsDirectoryKey] boolValue]) {
+            continue;
+        }
+        NSDate *modificationDate = resourceValues[NSURLContentModificationDateKey];
+        if ([[modificationDate laterDate:expirationDate] isEqualToDate:expirationDate]) {
+            [urlsToDelete addObject:fileURL];
+            continue;
+        }
+        cacheFiles[fileURL] = resourceValues;
+    }
+    for (NSURL *fileURL in urlsToDelete) {
+        [fileManager removeItemAtURL:fileURL error:nil];
+    }
+    return urlsToDelete.count;
+}
+
+- (void)benchmarkFileCount:(NSUInteger)count {
+    NSString *namespace = [NSString stringWithFormat:@"benchmark%lu", (unsigned long)count];
+    NSString *path = [self.temporaryDirectory stringByAppendingPathComponent:[@"com.hackemist.SDWebImageCache." stringByAppendingString:namespace]];
+    [self fillDirectory:path count:count];
+    NSString *label = [NSString stringWithFormat:@"%lu files", (unsigned long)count];
+
+    // 之前：每次查询和清理都遍历整个目录。先删除 40 天前的文件
+    NSTimeInterval start = SDTestNow();
+    NSUInteger scannedSize = [self directoryScanSizeOfPath:path];
+    [self reportBenchmark:[label stringByAppendingString:@" size query, directory scan"] value:(SDTestNow() - start) * 1000 unit:@"ms"];
+    start = SDTestNow();
+    NSUInteger removedCount = [self directoryScanTrimPath:path maxCacheAge:30 * kDay];
+    [self reportBenchmark:[label stringByAppendingString:@" trim, directory scan"] value:(SDTestNow() - start) * 1000 unit:@"ms"];
+    XCTAssertEqual(removedCount, (count + 99) / 100);
+
+    // 之后：第一次启动时分批重建索引，之后查询直接读取索引
+    start = SDTestNow();
+    SDImageCache *cache = [[SDImageCache alloc] initWithNamespace:namespace diskCacheDirectory:self.temporaryDirectory];
+    NSUInteger indexedSize = [cache getSize];
+    [self reportBenchmark:[label stringByAppendingString:@" index rebuild"] value:(SDTestNow() - start) * 1000 unit:@"ms"];
+    XCTAssertLessThan(indexedSize, scannedSize);
+    const NSUInteger queryCount = 1000;
+    start = SDTestNow();
+    for (NSUInteger i = 0; i < queryCount; i++) {
+        [cache getSize];
+    }
+    [self reportBenchmark:[label stringByAppendingString:@" size query, index"] value:(SDTestNow() - start) * 1000 / queryCount unit:@"ms"];
+
+    // 删除 20 天前的文件，和上面删除的文件数相同
+    cache.config.diskCacheExpireType = SDImageCacheConfigExpireTypeModificationDate;
+    cache.config.maxCacheAge = (NSInteger)(10 * kDay);
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Trim"];
+    start = SDTestNow();
+    [cache deleteOldFilesWithCompletionBlock:^{
+        [self reportBenchmark:[label stringByAppendingString:@" trim, index"] value:(SDTestNow() - start) * 1000 unit:@"ms"];
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:600 handler:nil];
+    XCTAssertEqual([cache getDiskCount], count - 2 * removedCount);
+
+    // 再次启动时读取日志，清理结束时已经写入了日志
+    start = SDTestNow();
+    SDDiskCacheIndex *index = [[SDDiskCacheIndex alloc] initWithDirectory:path];
+    XCTAssertTrue([index loadJournal]);
+    [self reportBenchmark:[label stringByAppendingString:@" journal load"] value:(SDTestNow() - start) * 1000 unit:@"ms"];
+    XCTAssertEqual(index.count, count - 2 * removedCount);
+}
+
+- (void)test08TrimAndSizeQueryBenchmark {
+    if (!SDTestBenchmarkEnabled()) {
+        return;
+    }
+    [self benchmarkFileCount:100000];
+    [self benchmarkFileCount:500000];
+}
+
+@end
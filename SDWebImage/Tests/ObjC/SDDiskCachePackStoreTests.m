@@ -0,0 +1,246 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDTestCase.h"
+#import "SDDiskCachePackStore.h"
+#import "SDImageCache.h"
+#import "SDImageCacheConfig.h"
+#import <sys/stat.h>
+
+@interface SDImageCache ()
+
+- (nonnull NSString *)diskCachePath;
+- (nullable NSData *)diskImageDataBySearchingAllPathsForKey:(nullable NSString *)key;
+
+@end
+
+@interface SDDiskCachePackStoreTests : SDTestCase
+
+@property (nonatomic, strong) SDDiskCachePackStore *store;
+
+@end
+
+@implementation SDDiskCachePackStoreTests
+
+- (void)setUp {
+    [super setUp];
+    self.store = [self newStore];
+}
+
+- (void)tearDown {
+    self.store = nil;
+    [super tearDown];
+}
+
+// 每个段文件只能放下几条 1000 字节的记录
+- (SDDiskCachePackStore *)newStore {
+    SDDiskCachePackStore *store = [[SDDiskCachePackStore alloc] initWithDirectory:self.temporaryDirectory];
+    store.maxSegmentSize = 4096;
+    return store;
+}
+
+- (NSString *)fileNameAtIndex:(NSUInteger)index {
+    return [NSString stringWithFormat:@"%08lu.png", (unsigned long)index];
+}
+
+- (NSArray<NSString *> *)segmentPaths {
+    NSMutableArray<NSString *> *paths = [NSMutableArray array];
+    for (NSString *name in [[NSFileManager defaultManager] contentsOfDirectoryAtPath:self.temporaryDirectory error:nil]) {
+        if ([name.pathExtension isEqualToString:@"segment"]) {
+            [paths addObject:[self.temporaryDirectory stringByAppendingPathComponent:name]];
+        }
+    }
+    return [paths sortedArrayUsingSelector:@selector(compare:)];
+}
+
+- (void)test01AppendedFilesRoundTrip {
+    for (NSUInteger i = 0; i < 10; i++) {
+        XCTAssertTrue([self.store setData:[self dataWithLength:1000 seed:i] forFileName:[self fileNameAtIndex:i]]);
+    }
+    XCTAssertEqual(self.store.count, 10);
+    XCTAssertGreaterThan([self segmentPaths].count, 1);
+    SDDiskCachePackStore *reloaded = [self newStore];
+    [reloaded load];
+    XCTAssertEqual(reloaded.count, 10);
+    for (NSUInteger i = 0; i < 10; i++) {
+        XCTAssertEqual([reloaded sizeForFileName:[self fileNameAtIndex:i]], 1000);
+        XCTAssertEqualObjects([reloaded dataForFileName:[self fileNameAtIndex:i]], [self dataWithLength:1000 seed:i]);
+    }
+    XCTAssertEqual([reloaded sizeForFileName:[self fileNameAtIndex:10]], NSNotFound);
+    XCTAssertNil([reloaded dataForFileName:[self fileNameAtIndex:10]]);
+}
+
+- (void)test02LastRecordSupersedes {
+    NSString *fileName = [self fileNameAtIndex:0];
+    [self.store setData:[self dataWithLength:1000 seed:1] forFileName:fileName];
+    [self.store setData:[self dataWithLength:500 seed:2] forFileName:fileName];
+    XCTAssertEqual(self.store.count, 1);
+    XCTAssertEqualObjects([self.store dataForFileName:fileName], [self dataWithLength:500 seed:2]);
+    SDDiskCachePackStore *reloaded = [self newStore];
+    XCTAssertEqual(reloaded.count, 1);
+    XCTAssertEqualObjects([reloaded dataForFileName:fileName], [self dataWithLength:500 seed:2]);
+}
+
+- (void)test03TombstonesSurviveReload {
+    [self.store setData:[self dataWithLength:1000 seed:0] forFileName:[self fileNameAtIndex:0]];
+    [self.store setData:[self dataWithLength:1000 seed:1] forFileName:[self fileNameAtIndex:1]];
+    XCTAssertTrue([self.store removeDataForFileName:[self fileNameAtIndex:0]]);
+    XCTAssertFalse([self.store removeDataForFileName:[self fileNameAtIndex:0]]);
+    XCTAssertFalse([self.store containsFileName:[self fileNameAtIndex:0]]);
+    SDDiskCachePackStore *reloaded = [self newStore];
+    XCTAssertFalse([reloaded containsFileName:[self fileNameAtIndex:0]]);
+    XCTAssertTrue([reloaded containsFileName:[self fileNameAtIndex:1]]);
+    XCTAssertEqualObjects([reloaded allFileNames], @[[self fileNameAtIndex:1]]);
+}
+
+- (void)test04CompactionKeepsLiveFiles {
+    const NSUInteger fileCount = 20;
+    for (NSUInteger i = 0; i < fileCount; i++) {
+        [self.store setData:[self dataWithLength:1000 seed:i] forFileName:[self fileNameAtIndex:i]];
+    }
+    // 删除大部分文件，其中部分删除记录写在较新的段文件中，压缩时要保留
+    NSMutableSet<NSString *> *liveNames = [NSMutableSet set];
+    for (NSUInteger i = 0; i < fileCount; i++) {
+        if (i % 4 == 0) {
+            [liveNames addObject:[self fileNameAtIndex:i]];
+        } else {
+            [self.store removeDataForFileName:[self fileNameAtIndex:i]];
+        }
+    }
+    NSUInteger sizeBeforeCompaction = self.store.segmentsSize;
+    NSUInteger compactedCount = 0;
+    while ([self.store compactNextSegment]) {
+        compactedCount++;
+        XCTAssertLessThan(compactedCount, 100);
+    }
+    XCTAssertGreaterThan(compactedCount, 0);
+    XCTAssertLessThan(self.store.segmentsSize, sizeBeforeCompaction);
+
+    for (SDDiskCachePackStore *store in @[self.store, [self newStore]]) {
+        XCTAssertEqualObjects([NSSet setWithArray:[store allFileNames]], liveNames);
+        for (NSUInteger i = 0; i < fileCount; i++) {
+            NSData *data = [store dataForFileName:[self fileNameAtIndex:i]];
+            XCTAssertEqualObjects(data, i % 4 == 0 ? [self dataWithLength:1000 seed:i] : nil);
+        }
+    }
+}
+
+- (void)test05TruncatedLastRecordIsDiscarded {
+    for (NSUInteger i = 0; i < 3; i++) {
+        [self.store setData:[self dataWithLength:1000 seed:i] forFileName:[self fileNameAtIndex:i]];
+    }
+    NSString *path = [self segmentPaths].lastObject;
+    NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:path error:nil];
+    XCTAssertEqual(truncate(path.fileSystemRepresentation, (off_t)(attributes.fileSize - 10)), 0);
+
+    SDDiskCachePackStore *reloaded = [self newStore];
+    XCTAssertEqual(reloaded.count, 2);
+    XCTAssertEqualObjects([reloaded dataForFileName:[self fileNameAtIndex:1]], [self dataWithLength:1000 seed:1]);
+    XCTAssertFalse([reloaded containsFileName:[self fileNameAtIndex:2]]);
+    // 新的记录写在截断的位置之后仍然可以读出
+    [reloaded setData:[self dataWithLength:1000 seed:3] forFileName:[self fileNameAtIndex:3]];
+    XCTAssertEqualObjects([[self newStore] dataForFileName:[self fileNameAtIndex:3]], [self dataWithLength:1000 seed:3]);
+}
+
+- (void)test06SegmentsExcludedFromBackup {
+    self.store.excludedFromBackup = YES;
+    [self.store setData:[self dataWithLength:1000 seed:0] forFileName:[self fileNameAtIndex:0]];
+    NSURL *url = [NSURL fileURLWithPath:[self segmentPaths].firstObject];
+    NSNumber *excluded = nil;
+    XCTAssertTrue([url getResourceValue:&excluded forKey:NSURLIsExcludedFromBackupKey error:nil]);
+    XCTAssertTrue(excluded.boolValue);
+}
+
+- (void)test07RemoveAllData {
+    [self.store setData:[self dataWithLength:1000 seed:0] forFileName:[self fileNameAtIndex:0]];
+    [self.store removeAllData];
+    XCTAssertEqual(self.store.count, 0);
+    XCTAssertEqual(self.store.segmentsSize, 0);
+    XCTAssertEqual([self segmentPaths].count, 0);
+    XCTAssertEqual([self newStore].count, 0);
+}
+
+#pragma mark - Benchmark
+
+// 目录中所有文件实际占用的磁盘块
+- (unsigned long long)allocatedSizeOfPath:(NSString *)path {
+    unsigned long long size = 0;
+    NSDirectoryEnumerator<NSString *> *enumerator = [[NSFileManager defaultManager] enumeratorAtPath:path];
+    for (NSString *name in enumerator) {
+        struct stat info;
+        if (stat([path stringByAppendingPathComponent:name].fileSystemRepresentation, &info) == 0) {
+            size += (unsigned long long)info.st_blocks * 512;
+        }
+    }
+    return size;
+}
+
+// 20000 张 2~16KB 的缩略图分别打包存储和每个 key 一个文件，比较写入吞吐量、读取延迟、磁盘占用和清理到一半容量的耗时
+- (void)benchmarkPackThreshold:(NSUInteger)packThreshold name:(NSString *)name {
+    const NSUInteger keyCount = 20000;
+    const NSUInteger readCount = 10000;
+    SDImageCache *cache = [[SDImageCache alloc] initWithNamespace:name diskCacheDirectory:self.temporaryDirectory];
+    cache.config.shouldCacheImagesInMemory = NO;
+    cache.config.diskCachePackThreshold = packThreshold;
+    NSMutableArray<NSData *> *data = [NSMutableArray array];
+    for (NSUInteger i = 0; i < 64; i++) {
+        [data addObject:[self dataWithLength:2048 + i * 229 seed:(uint8_t)i]];
+    }
+
+    unsigned long long logicalSize = 0;
+    NSTimeInterval start = SDTestNow();
+    for (NSUInteger i = 0; i < keyCount; i++) {
+        @autoreleasepool {
+            NSData *thumbnail = data[i % data.count];
+            logicalSize += thumbnail.length;
+            [cache storeImageDataToDisk:thumbnail forKey:[NSString stringWithFormat:@"http://example.com/thumbnail%lu.jpg", (unsigned long)i]];
+        }
+    }
+    [cache flushDiskWrites];
+    NSTimeInterval elapsed = SDTestNow() - start;
+    [self reportBenchmark:[name stringByAppendingString:@" writes"] value:keyCount / elapsed unit:@"files/s"];
+    [self reportBenchmark:[name stringByAppendingString:@" write throughput"] value:logicalSize / elapsed / 1e6 unit:@"MB/s"];
+    [self reportBenchmark:[name stringByAppendingString:@" disk footprint"] value:[self allocatedSizeOfPath:cache.diskCachePath] / 1e6 unit:@"MB"];
+    [self reportBenchmark:[name stringByAppendingString:@" data size"] value:logicalSize / 1e6 unit:@"MB"];
+
+    double *latencies = malloc(readCount * sizeof(double));
+    uint32_t state = 1;
+    for (NSUInteger i = 0; i < readCount; i++) {
+        @autoreleasepool {
+            state = state * 1103515245u + 12345u;
+            NSString *key = [NSString stringWithFormat:@"http://example.com/thumbnail%lu.jpg", (unsigned long)((state >> 8) % keyCount)];
+            NSTimeInterval readStart = SDTestNow();
+            XCTAssertNotNil([cache diskImageDataBySearchingAllPathsForKey:key]);
+            latencies[i] = (SDTestNow() - readStart) * 1e6;
+        }
+    }
+    [self reportBenchmark:[name stringByAppendingString:@" read p50"] value:SDTestPercentile(latencies, readCount, 50) unit:@"us"];
+    [self reportBenchmark:[name stringByAppendingString:@" read p99"] value:SDTestPercentile(latencies, readCount, 99) unit:@"us"];
+    free(latencies);
+
+    // 打包存储时包括压缩段文件的时间
+    cache.config.maxCacheSize = (NSUInteger)(logicalSize / 2);
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Trim"];
+    start = SDTestNow();
+    [cache deleteOldFilesWithCompletionBlock:^{
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:600 handler:nil];
+    [self reportBenchmark:[name stringByAppendingString:@" eviction to half the size"] value:(SDTestNow() - start) * 1000 unit:@"ms"];
+    [self reportBenchmark:[name stringByAppendingString:@" disk footprint after eviction"] value:[self allocatedSizeOfPath:cache.diskCachePath] / 1e6 unit:@"MB"];
+}
+
+- (void)test08PackedSegmentsAgainstOneFilePerKeyBenchmark {
+    if (!SDTestBenchmarkEnabled()) {
+        return;
+    }
+    [self benchmarkPackThreshold:0 name:@"one file per key"];
+    [self benchmarkPackThreshold:32 * 1024 name:@"packed"];
+}
+
+@end
@@ -0,0 +1,139 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDTestCase.h"
+#import "SDImageCache.h"
+#import "SDImageCacheConfig.h"
+
+@interface SDImageCache ()
+
+- (nullable NSData *)diskImageDataBySearchingAllPathsForKey:(nullable NSString *)key;
+
+@end
+
+@interface SDImageCacheEvictionTests : SDTestCase
+
+@property (nonatomic, strong) SDImageCache *cache;
+
+@end
+
+@implementation SDImageCacheEvictionTests
+
+- (void)setUp {
+    [super setUp];
+    self.cache = [[SDImageCache alloc] initWithNamespace:@"eviction" diskCacheDirectory:self.temporaryDirectory];
+    self.cache.config.shouldCacheImagesInMemory = NO;
+    self.cache.config.diskCachePackThreshold = 0;
+}
+
+- (void)tearDown {
+    self.cache = nil;
+    [super tearDown];
+}
+
+- (BOOL)isKeyOnDisk:(NSString *)key {
+    return [[NSFileManager defaultManager] fileExistsAtPath:[self.cache defaultCachePathForKey:key]];
+}
+
+- (void)deleteOldFiles {
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Delete old files"];
+    [self.cache deleteOldFilesWithCompletionBlock:^{
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:kAsyncTestTimeout handler:nil];
+}
+
+// 写入一样大小的文件，返回每个文件的大小
+- (NSUInteger)storeKeys:(NSArray<NSString *> *)keys {
+    NSData *data = [self dataWithLength:1024 seed:0];
+    for (NSString *key in keys) {
+        [self.cache storeImageDataToDisk:data forKey:key];
+        // 让写入和访问时间互不相同
+        [NSThread sleepForTimeInterval:0.01];
+    }
+    return data.length;
+}
+
+- (NSArray<NSString *> *)keys {
+    return @[@"key0", @"key1", @"key2", @"key3", @"key4", @"key5"];
+}
+
+- (void)test01SizeCleanupEvictsLeastRecentlyRead {
+    self.cache.config.diskCacheExpireType = SDImageCacheConfigExpireTypeAccessDate;
+    NSUInteger size = [self storeKeys:[self keys]];
+    // 最早写入的两个文件最近被读过
+    XCTAssertNotNil([self.cache diskImageDataBySearchingAllPathsForKey:@"key1"]);
+    [NSThread sleepForTimeInterval:0.01];
+    XCTAssertNotNil([self.cache diskImageDataBySearchingAllPathsForKey:@"key0"]);
+
+    // 清理到容量的一半以下，也就是剩下两个文件
+    self.cache.config.maxCacheSize = size * 5 + 1;
+    [self deleteOldFiles];
+
+    XCTAssertTrue([self isKeyOnDisk:@"key0"]);
+    XCTAssertTrue([self isKeyOnDisk:@"key1"]);
+    for (NSString *key in @[@"key2", @"key3", @"key4", @"key5"]) {
+        XCTAssertFalse([self isKeyOnDisk:key], @"%@ should have been evicted", key);
+    }
+    XCTAssertEqual([self.cache getDiskCount], 2u);
+    XCTAssertEqual([self.cache getSize], size * 2);
+}
+
+- (void)test02ModificationDateKeepsLegacyOrder {
+    self.cache.config.diskCacheExpireType = SDImageCacheConfigExpireTypeModificationDate;
+    NSUInteger size = [self storeKeys:[self keys]];
+    // 按写入时间淘汰时读取不影响顺序
+    [self.cache diskImageDataBySearchingAllPathsForKey:@"key0"];
+    [self.cache diskImageDataBySearchingAllPathsForKey:@"key1"];
+
+    self.cache.config.maxCacheSize = size * 5 + 1;
+    [self deleteOldFiles];
+
+    XCTAssertTrue([self isKeyOnDisk:@"key4"]);
+    XCTAssertTrue([self isKeyOnDisk:@"key5"]);
+    for (NSString *key in @[@"key0", @"key1", @"key2", @"key3"]) {
+        XCTAssertFalse([self isKeyOnDisk:key], @"%@ should have been evicted", key);
+    }
+}
+
+- (void)test03AccessDateAndSizeEvictsLargeColdFilesFirst {
+    self.cache.config.diskCacheExpireType = SDImageCacheConfigExpireTypeAccessDateAndSize;
+    NSData *large = [self dataWithLength:64 * 1024 seed:1];
+    [self.cache storeImageDataToDisk:large forKey:@"large"];
+    NSUInteger size = [self storeKeys:@[@"small0", @"small1", @"small2"]];
+    XCTAssertGreaterThan(large.length, size * 3);
+    for (NSUInteger i = 0; i < 3; i++) {
+        [self.cache diskImageDataBySearchingAllPathsForKey:@"small0"];
+        [self.cache diskImageDataBySearchingAllPathsForKey:@"small1"];
+        [self.cache diskImageDataBySearchingAllPathsForKey:@"small2"];
+    }
+    // 大文件刚写入但是没有被读过，小文件命中多次
+    [self.cache diskImageDataBySearchingAllPathsForKey:@"large"];
+
+    self.cache.config.maxCacheSize = large.length;
+    [self deleteOldFiles];
+
+    XCTAssertFalse([self isKeyOnDisk:@"large"]);
+    XCTAssertTrue([self isKeyOnDisk:@"small0"]);
+    XCTAssertTrue([self isKeyOnDisk:@"small1"]);
+    XCTAssertTrue([self isKeyOnDisk:@"small2"]);
+}
+
+- (void)test04ExpiredFilesAreRemovedByAge {
+    self.cache.config.diskCacheExpireType = SDImageCacheConfigExpireTypeAccessDate;
+    [self storeKeys:@[@"old", @"recent"]];
+    [NSThread sleepForTimeInterval:1.1];
+    [self.cache diskImageDataBySearchingAllPathsForKey:@"recent"];
+    self.cache.config.maxCacheAge = 1;
+    [self deleteOldFiles];
+
+    XCTAssertFalse([self isKeyOnDisk:@"old"]);
+    XCTAssertTrue([self isKeyOnDisk:@"recent"]);
+}
+
+@end
@@ -0,0 +1,165 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDTestCase.h"
+#import "SDImageCache.h"
+#import "SDImageCacheConfig.h"
+
+static NSString * const kTestKey = @"http://example.com/image.png";
+// Reference values computed with the MurmurHash3_x64_128 of smhasher (seed 0) and MD5
+static NSString * const kTestKeyMurmur3FileName = @"a9f8907b357dfef79b549b15dc551487.png";
+static NSString * const kTestKeyMD5FileName = @"dff8cd3202a7f9a9529aff84233be568.png";
+
+@interface SDImageCache ()
+
+- (nullable NSData *)diskImageDataBySearchingAllPathsForKey:(nullable NSString *)key;
+- (nullable NSString *)cachedFileNameForKey:(nullable NSString *)key;
+
+@end
+
+@interface SDImageCacheKeyHashTests : SDTestCase
+
+@end
+
+@implementation SDImageCacheKeyHashTests
+
+- (SDImageCache *)cacheWithHashType:(SDImageCacheConfigKeyHashType)hashType {
+    SDImageCache *cache = [[SDImageCache alloc] initWithNamespace:@"hash" diskCacheDirectory:self.temporaryDirectory];
+    cache.config.diskCacheKeyHashType = hashType;
+    cache.config.diskCachePackThreshold = 0;
+    cache.config.shouldCacheImagesInMemory = NO;
+    return cache;
+}
+
+- (BOOL)fileExistsNamed:(NSString *)fileName inCache:(SDImageCache *)cache {
+    NSString *directory = [[cache defaultCachePathForKey:kTestKey] stringByDeletingLastPathComponent];
+    return [[NSFileManager defaultManager] fileExistsAtPath:[directory stringByAppendingPathComponent:fileName]];
+}
+
+- (void)test01Murmur3FileNames {
+    SDImageCache *cache = [self cacheWithHashType:SDImageCacheConfigKeyHashTypeMurmur3];
+    XCTAssertEqualObjects([cache defaultCachePathForKey:kTestKey].lastPathComponent, kTestKeyMurmur3FileName);
+    XCTAssertEqualObjects([cache defaultCachePathForKey:@"hello"].lastPathComponent, @"029bbd41b3a7d8cb191dae486a901e5b");
+    XCTAssertEqualObjects([cache defaultCachePathForKey:@"The quick brown fox jumps over the lazy dog"].lastPathComponent, @"6c1b07bc7bbc4be347939ac4a93c437a");
+    // 空 key 的哈希是全 0
+    XCTAssertEqualObjects([cache defaultCachePathForKey:nil].lastPathComponent, @"00000000000000000000000000000000");
+}
+
+- (void)test02MD5FileNames {
+    SDImageCache *cache = [self cacheWithHashType:SDImageCacheConfigKeyHashTypeMD5];
+    XCTAssertEqualObjects([cache defaultCachePathForKey:kTestKey].lastPathComponent, kTestKeyMD5FileName);
+}
+
+- (void)test03CustomFileNames {
+    SDImageCache *cache = [self cacheWithHashType:SDImageCacheConfigKeyHashTypeMurmur3];
+    cache.config.diskCacheFileNameBlock = ^NSString *(NSString *key) {
+        return [key isEqualToString:kTestKey] ? @"custom.png" : nil;
+    };
+    XCTAssertEqualObjects([cache defaultCachePathForKey:kTestKey].lastPathComponent, @"custom.png");
+    XCTAssertEqualObjects([cache defaultCachePathForKey:@"hello"].lastPathComponent, @"029bbd41b3a7d8cb191dae486a901e5b");
+}
+
+- (void)test04MD5FilesAreMigratedOnFirstRead {
+    NSData *data = [self dataWithLength:1000 seed:5];
+    SDImageCache *legacyCache = [self cacheWithHashType:SDImageCacheConfigKeyHashTypeMD5];
+    [legacyCache storeImageDataToDisk:data forKey:kTestKey];
+    XCTAssertTrue([self fileExistsNamed:kTestKeyMD5FileName inCache:legacyCache]);
+    legacyCache = nil;
+
+    SDImageCache *cache = [self cacheWithHashType:SDImageCacheConfigKeyHashTypeMurmur3];
+    XCTAssertFalse([self fileExistsNamed:kTestKeyMurmur3FileName inCache:cache]);
+    XCTAssertEqualObjects([cache diskImageDataBySearchingAllPathsForKey:kTestKey], data);
+    // 第一次读取时改成新的文件名，之后直接命中
+    XCTAssertFalse([self fileExistsNamed:kTestKeyMD5FileName inCache:cache]);
+    XCTAssertTrue([self fileExistsNamed:kTestKeyMurmur3FileName inCache:cache]);
+    XCTAssertEqual([cache getDiskCount], 1u);
+    XCTAssertEqual([cache getSize], data.length);
+    XCTAssertEqualObjects([cache diskImageDataBySearchingAllPathsForKey:kTestKey], data);
+}
+
+- (void)test05FilesWithoutExtensionAreMigrated {
+    NSData *data = [self dataWithLength:1000 seed:7];
+    SDImageCache *cache = [self cacheWithHashType:SDImageCacheConfigKeyHashTypeMurmur3];
+    NSString *directory = [[cache defaultCachePathForKey:kTestKey] stringByDeletingLastPathComponent];
+    cache = nil;
+    // 很早的版本写入的文件名没有后缀，索引不存在时重建
+    [[NSFileManager defaultManager] createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:nil];
+    [data writeToFile:[directory stringByAppendingPathComponent:kTestKeyMD5FileName.stringByDeletingPathExtension] atomically:NO];
+    [[NSFileManager defaultManager] removeItemAtPath:[directory stringByAppendingPathComponent:@".sdindex"] error:nil];
+
+    cache = [self cacheWithHashType:SDImageCacheConfigKeyHashTypeMurmur3];
+    XCTAssertEqualObjects([cache diskImageDataBySearchingAllPathsForKey:kTestKey], data);
+    XCTAssertFalse([self fileExistsNamed:kTestKeyMD5FileName.stringByDeletingPathExtension inCache:cache]);
+    XCTAssertTrue([self fileExistsNamed:kTestKeyMurmur3FileName inCache:cache]);
+}
+
+- (void)test06ChangingTheConfigInvalidatesCachedFileNames {
+    SDImageCache *cache = [self cacheWithHashType:SDImageCacheConfigKeyHashTypeMurmur3];
+    XCTAssertEqualObjects([cache cachedFileNameForKey:kTestKey], kTestKeyMurmur3FileName);
+    cache.config.diskCacheKeyHashType = SDImageCacheConfigKeyHashTypeMD5;
+    XCTAssertEqualObjects([cache cachedFileNameForKey:kTestKey], kTestKeyMD5FileName);
+    cache.config.diskCacheFileNameBlock = ^NSString *(NSString *key) {
+        return @"custom.png";
+    };
+    XCTAssertEqualObjects([cache cachedFileNameForKey:kTestKey], @"custom.png");
+    cache.config.diskCacheFileNameBlock = ^NSString *(NSString *key) {
+        return @"other.png";
+    };
+    XCTAssertEqualObjects([cache cachedFileNameForKey:kTestKey], @"other.png");
+    cache.config.diskCacheFileNameBlock = nil;
+    cache.config.diskCacheKeyHashType = SDImageCacheConfigKeyHashTypeMurmur3;
+    XCTAssertEqualObjects([cache cachedFileNameForKey:kTestKey], kTestKeyMurmur3FileName);
+}
+
+#pragma mark - Benchmark
+
+// 80~300 个字符的 CDN 图片 URL
+- (NSArray<NSString *> *)cdnURLsWithCount:(NSUInteger)count {
+    NSMutableArray<NSString *> *keys = [NSMutableArray arrayWithCapacity:count];
+    uint32_t state = 1;
+    for (NSUInteger i = 0; i < count; i++) {
+        state = state * 1103515245u + 12345u;
+        NSUInteger length = 80 + (state >> 8) % 221;
+        NSMutableString *key = [NSMutableString stringWithFormat:@"https://images.cdn.example.com/v2/%lu/photo.jpg?w=750&q=80&sig=", (unsigned long)i];
+        while (key.length < length) {
+            state = state * 1103515245u + 12345u;
+            [key appendFormat:@"%08x", state];
+        }
+        [keys addObject:[key substringToIndex:length]];
+    }
+    return keys;
+}
+
+- (void)benchmarkKeys:(NSArray<NSString *> *)keys passes:(NSUInteger)passes cache:(SDImageCache *)cache name:(NSString *)name {
+    NSTimeInterval start = SDTestNow();
+    for (NSUInteger pass = 0; pass < passes; pass++) {
+        @autoreleasepool {
+            for (NSString *key in keys) {
+                [cache cachedFileNameForKey:key];
+            }
+        }
+    }
+    [self reportBenchmark:name value:keys.count * passes / (SDTestNow() - start) / 1e6 unit:@"M keys/s"];
+}
+
+- (void)test07FileNameThroughputBenchmark {
+    if (!SDTestBenchmarkEnabled()) {
+        return;
+    }
+    // 不同的 key 远多于缓存的文件名个数，每次都要计算哈希
+    NSArray<NSString *> *coldKeys = [self cdnURLsWithCount:200000];
+    [self benchmarkKeys:coldKeys passes:1 cache:[self cacheWithHashType:SDImageCacheConfigKeyHashTypeMD5] name:@"MD5, uncached"];
+    [self benchmarkKeys:coldKeys passes:1 cache:[self cacheWithHashType:SDImageCacheConfigKeyHashTypeMurmur3] name:@"Murmur3, uncached"];
+    // 最近使用的 key，文件名都在缓存中
+    NSArray<NSString *> *hotKeys = [coldKeys subarrayWithRange:NSMakeRange(0, 512)];
+    SDImageCache *cache = [self cacheWithHashType:SDImageCacheConfigKeyHashTypeMurmur3];
+    [self benchmarkKeys:hotKeys passes:1 cache:cache name:@"Murmur3, warm up"];
+    [self benchmarkKeys:hotKeys passes:400 cache:cache name:@"Murmur3, cached"];
+}
+
+@end
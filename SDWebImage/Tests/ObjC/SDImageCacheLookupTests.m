@@ -0,0 +1,193 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDTestCase.h"
+#import "SDImageCache.h"
+#import "SDImageCacheConfig.h"
+
+@interface SDImageCache ()
+
+- (nonnull NSString *)diskCachePath;
+- (nonnull NSMutableDictionary<NSString *, id> *)customPathFilters;
+- (nonnull NSArray<NSString *> *)possibleFilenames:(nonnull NSArray<NSString *> *)filenames inPath:(nonnull NSString *)path;
+- (nullable NSData *)diskImageDataBySearchingAllPathsForKey:(nullable NSString *)key;
+
+@end
+
+@interface SDImageCacheLookupTests : SDTestCase
+
+@property (nonatomic, strong) SDImageCache *cache;
+
+@end
+
+@implementation SDImageCacheLookupTests
+
+- (void)setUp {
+    [super setUp];
+    self.cache = [[SDImageCache alloc] initWithNamespace:@"lookup" diskCacheDirectory:self.temporaryDirectory];
+    self.cache.config.shouldCacheImagesInMemory = NO;
+}
+
+- (void)tearDown {
+    self.cache = nil;
+    [super tearDown];
+}
+
+- (NSString *)keyAtIndex:(NSUInteger)index {
+    return [NSString stringWithFormat:@"http://example.com/%lu.jpg", (unsigned long)index];
+}
+
+- (NSString *)fileNameForKey:(NSString *)key {
+    return [self.cache defaultCachePathForKey:key].lastPathComponent;
+}
+
+// 只读目录的过滤器在后台建立
+- (void)waitForFilterOfPath:(NSString *)path {
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:kAsyncTestTimeout];
+    while ([deadline timeIntervalSinceNow] > 0) {
+        @synchronized (self.cache.customPathFilters) {
+            if (self.cache.customPathFilters[path]) {
+                return;
+            }
+        }
+        [NSThread sleepForTimeInterval:0.01];
+    }
+    XCTFail(@"The filter of %@ was not built", path);
+}
+
+- (void)test01IndexGivesDefiniteMisses {
+    NSString *storedKey = [self keyAtIndex:0];
+    // 同步写入会等索引加载完
+    [self.cache storeImageDataToDisk:[self dataWithLength:100 seed:0] forKey:storedKey];
+    NSMutableArray<NSString *> *missingNames = [NSMutableArray array];
+    for (NSUInteger i = 1; i <= 100; i++) {
+        [missingNames addObject:[self fileNameForKey:[self keyAtIndex:i]]];
+    }
+    NSArray<NSString *> *possible = [self.cache possibleFilenames:[missingNames arrayByAddingObject:[self fileNameForKey:storedKey]] inPath:self.cache.diskCachePath];
+    XCTAssertEqualObjects(possible, @[[self fileNameForKey:storedKey]]);
+    XCTAssertNil([self.cache diskImageDataBySearchingAllPathsForKey:[self keyAtIndex:1]]);
+}
+
+- (void)test02BloomFilterOfReadOnlyPath {
+    const NSUInteger storedCount = 200;
+    NSString *readOnlyPath = [self.temporaryDirectory stringByAppendingPathComponent:@"bundle"];
+    [[NSFileManager defaultManager] createDirectoryAtPath:readOnlyPath withIntermediateDirectories:YES attributes:nil error:nil];
+    NSMutableArray<NSString *> *storedNames = [NSMutableArray array];
+    for (NSUInteger i = 0; i < storedCount; i++) {
+        NSString *name = [self fileNameForKey:[self keyAtIndex:i]];
+        [[self dataWithLength:10 seed:(uint8_t)i] writeToFile:[readOnlyPath stringByAppendingPathComponent:name] atomically:NO];
+        [storedNames addObject:name];
+    }
+    NSMutableArray<NSString *> *missingNames = [NSMutableArray array];
+    for (NSUInteger i = storedCount; i < storedCount + 1000; i++) {
+        [missingNames addObject:[self fileNameForKey:[self keyAtIndex:i]]];
+    }
+
+    [self.cache addReadOnlyCachePath:readOnlyPath];
+    [self waitForFilterOfPath:readOnlyPath];
+
+    // 没有漏判，误判率低于 1%，留一些余量
+    XCTAssertEqualObjects([self.cache possibleFilenames:storedNames inPath:readOnlyPath], storedNames);
+    NSUInteger falsePositives = [self.cache possibleFilenames:missingNames inPath:readOnlyPath].count;
+    XCTAssertLessThan(falsePositives, 30u);
+
+    XCTAssertEqualObjects([self.cache diskImageDataBySearchingAllPathsForKey:[self keyAtIndex:3]], [self dataWithLength:10 seed:3]);
+    XCTAssertNil([self.cache diskImageDataBySearchingAllPathsForKey:[self keyAtIndex:storedCount]]);
+}
+
+- (void)test03UnfilteredUntilTheFilterIsBuilt {
+    NSString *unknownPath = [self.temporaryDirectory stringByAppendingPathComponent:@"unknown"];
+    NSArray<NSString *> *names = @[@"a.png", @"b.png"];
+    XCTAssertEqualObjects([self.cache possibleFilenames:names inPath:unknownPath], names);
+}
+
+#pragma mark - Benchmark
+
+- (void)writeFilesForKeysFrom:(NSUInteger)first count:(NSUInteger)count toPath:(NSString *)path {
+    [[NSFileManager defaultManager] createDirectoryAtPath:path withIntermediateDirectories:YES attributes:nil error:nil];
+    NSData *data = [self dataWithLength:1024 seed:1];
+    for (NSUInteger i = first; i < first + count; i++) {
+        @autoreleasepool {
+            [data writeToFile:[path stringByAppendingPathComponent:[self fileNameForKey:[self keyAtIndex:i]]] atomically:NO];
+        }
+    }
+}
+
+- (void)reportLatencies:(double *)latencies count:(NSUInteger)count name:(NSString *)name {
+    double total = 0;
+    for (NSUInteger i = 0; i < count; i++) {
+        total += latencies[i];
+    }
+    [self reportBenchmark:[name stringByAppendingString:@" mean"] value:total / count unit:@"us"];
+    [self reportBenchmark:[name stringByAppendingString:@" p50"] value:SDTestPercentile(latencies, count, 50) unit:@"us"];
+    [self reportBenchmark:[name stringByAppendingString:@" p99"] value:SDTestPercentile(latencies, count, 99) unit:@"us"];
+}
+
+// 默认目录 100k 个文件，3 个只读目录各 10k 个文件，比较没有命中时的延迟：
+// 以前的查找在每个目录尝试打开有后缀和没有后缀的两个文件名，现在先查询索引和过滤器
+- (void)test04MissLatencyBenchmark {
+    if (!SDTestBenchmarkEnabled()) {
+        return;
+    }
+    const NSUInteger fileCount = 100000;
+    const NSUInteger readOnlyFileCount = 10000;
+    const NSUInteger missCount = 10000;
+    // 新的命名空间没有索引，从目录重建
+    [self writeFilesForKeysFrom:0 count:fileCount toPath:[self.temporaryDirectory stringByAppendingPathComponent:@"com.hackemist.SDWebImageCache.lookupBenchmark"]];
+    self.cache = [[SDImageCache alloc] initWithNamespace:@"lookupBenchmark" diskCacheDirectory:self.temporaryDirectory];
+    self.cache.config.shouldCacheImagesInMemory = NO;
+    XCTAssertEqual([self.cache getDiskCount], fileCount);
+    NSMutableArray<NSString *> *paths = [NSMutableArray arrayWithObject:self.cache.diskCachePath];
+    for (NSUInteger p = 0; p < 3; p++) {
+        NSString *readOnlyPath = [self.temporaryDirectory stringByAppendingPathComponent:[NSString stringWithFormat:@"bundle%lu", (unsigned long)p]];
+        [self writeFilesForKeysFrom:fileCount + p * readOnlyFileCount count:readOnlyFileCount toPath:readOnlyPath];
+        [self.cache addReadOnlyCachePath:readOnlyPath];
+        [self waitForFilterOfPath:readOnlyPath];
+        [paths addObject:readOnlyPath];
+    }
+
+    NSUInteger firstMissingIndex = fileCount + 3 * readOnlyFileCount;
+    double *latencies = malloc(missCount * sizeof(double));
+    for (NSUInteger i = 0; i < missCount; i++) {
+        @autoreleasepool {
+            NSString *name = [self fileNameForKey:[self keyAtIndex:firstMissingIndex + i]];
+            NSTimeInterval start = SDTestNow();
+            for (NSString *path in paths) {
+                NSString *filePath = [path stringByAppendingPathComponent:name];
+                XCTAssertNil([NSData dataWithContentsOfFile:filePath]);
+                XCTAssertNil([NSData dataWithContentsOfFile:filePath.stringByDeletingPathExtension]);
+            }
+            latencies[i] = (SDTestNow() - start) * 1e6;
+        }
+    }
+    [self reportLatencies:latencies count:missCount name:@"miss, 8 failed opens"];
+
+    for (NSUInteger i = 0; i < missCount; i++) {
+        @autoreleasepool {
+            NSString *key = [self keyAtIndex:firstMissingIndex + i];
+            NSTimeInterval start = SDTestNow();
+            XCTAssertNil([self.cache diskImageDataBySearchingAllPathsForKey:key]);
+            latencies[i] = (SDTestNow() - start) * 1e6;
+        }
+    }
+    [self reportLatencies:latencies count:missCount name:@"miss, index and filters"];
+
+    // 命中只读目录的延迟，确认过滤器没有拖慢命中
+    for (NSUInteger i = 0; i < missCount; i++) {
+        @autoreleasepool {
+            NSString *key = [self keyAtIndex:fileCount + 2 * readOnlyFileCount + i % readOnlyFileCount];
+            NSTimeInterval start = SDTestNow();
+            XCTAssertNotNil([self.cache diskImageDataBySearchingAllPathsForKey:key]);
+            latencies[i] = (SDTestNow() - start) * 1e6;
+        }
+    }
+    [self reportLatencies:latencies count:missCount name:@"hit in the last read-only path"];
+    free(latencies);
+}
+
+@end
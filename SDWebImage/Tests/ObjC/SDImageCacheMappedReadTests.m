@@ -0,0 +1,166 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDTestCase.h"
+#import "SDImageCache.h"
+#import "SDImageCacheConfig.h"
+#import <ImageIO/ImageIO.h>
+#if SD_MAC
+#import <libproc.h>
+#endif
+
+@interface SDImageCache ()
+
+- (nullable NSData *)diskImageDataBySearchingAllPathsForKey:(nullable NSString *)key;
+- (nullable UIImage *)diskImageForKey:(nullable NSString *)key;
+
+@end
+
+@interface SDImageCacheMappedReadTests : SDTestCase
+
+@property (nonatomic, strong) SDImageCache *cache;
+
+@end
+
+@implementation SDImageCacheMappedReadTests
+
+- (void)setUp {
+    [super setUp];
+    self.cache = [[SDImageCache alloc] initWithNamespace:@"mapped" diskCacheDirectory:self.temporaryDirectory];
+    self.cache.config.shouldCacheImagesInMemory = NO;
+    self.cache.config.diskCachePackThreshold = 0;
+    self.cache.config.diskCacheMappedReadingThreshold = 64 * 1024;
+}
+
+- (void)tearDown {
+    self.cache = nil;
+    [super tearDown];
+}
+
+// 数据的内存是否映射自缓存文件。只有 macOS 能查询映射的文件，其它平台总是返回 YES
+- (BOOL)isData:(NSData *)data mappedFromFileOfKey:(NSString *)key {
+#if SD_MAC
+    char path[PROC_PIDPATHINFO_MAXSIZE];
+    int length = proc_regionfilename(getpid(), (uint64_t)(uintptr_t)data.bytes, path, sizeof(path));
+    if (length <= 0) {
+        return NO;
+    }
+    NSString *regionPath = [[NSString stringWithUTF8String:path] stringByResolvingSymlinksInPath];
+    return [regionPath isEqualToString:[[self.cache defaultCachePathForKey:key] stringByResolvingSymlinksInPath]];
+#else
+    return YES;
+#endif
+}
+
+- (void)test01LargeFilesAreMapped {
+    NSData *data = [self dataWithLength:256 * 1024 seed:1];
+    [self.cache storeImageDataToDisk:data forKey:@"large"];
+    NSData *readData = [self.cache diskImageDataBySearchingAllPathsForKey:@"large"];
+    XCTAssertEqualObjects(readData, data);
+    XCTAssertTrue([self isData:readData mappedFromFileOfKey:@"large"]);
+}
+
+#if SD_MAC
+- (void)test02SmallFilesAreCopied {
+    NSData *data = [self dataWithLength:1024 seed:2];
+    [self.cache storeImageDataToDisk:data forKey:@"small"];
+    NSData *readData = [self.cache diskImageDataBySearchingAllPathsForKey:@"small"];
+    XCTAssertEqualObjects(readData, data);
+    XCTAssertFalse([self isData:readData mappedFromFileOfKey:@"small"]);
+}
+
+- (void)test03ZeroThresholdDisablesMapping {
+    self.cache.config.diskCacheMappedReadingThreshold = 0;
+    NSData *data = [self dataWithLength:256 * 1024 seed:3];
+    [self.cache storeImageDataToDisk:data forKey:@"large"];
+    XCTAssertFalse([self isData:[self.cache diskImageDataBySearchingAllPathsForKey:@"large"] mappedFromFileOfKey:@"large"]);
+}
+#endif
+
+- (void)test04MappedDataSurvivesRewritingTheFile {
+    NSData *first = [self dataWithLength:256 * 1024 seed:4];
+    NSData *second = [self dataWithLength:256 * 1024 seed:5];
+    [self.cache storeImageDataToDisk:first forKey:@"large"];
+    NSData *readData = [self.cache diskImageDataBySearchingAllPathsForKey:@"large"];
+    // 写入新文件再重命名，已经映射的旧文件内容不变
+    [self.cache storeImageDataToDisk:second forKey:@"large"];
+    XCTAssertEqualObjects(readData, first);
+    XCTAssertEqualObjects([self.cache diskImageDataBySearchingAllPathsForKey:@"large"], second);
+}
+
+- (void)test05MappedImagesDecode {
+    self.cache.config.diskCacheMappedReadingThreshold = 1;
+    NSData *data = [self PNGDataWithWidth:64 height:32];
+    [self.cache storeImageDataToDisk:data forKey:@"image.png"];
+    UIImage *image = [self.cache diskImageForKey:@"image.png"];
+    XCTAssertNotNil(image);
+    XCTAssertEqual(image.size.width, 64);
+    XCTAssertEqual(image.size.height, 32);
+}
+
+#pragma mark - Benchmark
+
+// 随机像素的 PNG 几乎不能压缩，文件大小接近 width * height * 4
+- (NSData *)noisePNGDataWithWidth:(NSUInteger)width height:(NSUInteger)height seed:(uint32_t)seed {
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+    CGContextRef context = CGBitmapContextCreate(NULL, width, height, 8, width * 4, colorSpace, kCGImageAlphaNoneSkipLast);
+    CGColorSpaceRelease(colorSpace);
+    uint32_t *pixels = CGBitmapContextGetData(context);
+    uint32_t state = seed;
+    for (NSUInteger i = 0; i < width * height; i++) {
+        state = state * 1103515245u + 12345u;
+        pixels[i] = state;
+    }
+    CGImageRef image = CGBitmapContextCreateImage(context);
+    CGContextRelease(context);
+    NSMutableData *data = [NSMutableData data];
+    CGImageDestinationRef destination = CGImageDestinationCreateWithData((__bridge CFMutableDataRef)data, CFSTR("public.png"), 1, NULL);
+    CGImageDestinationAddImage(destination, image, NULL);
+    CGImageDestinationFinalize(destination);
+    CFRelease(destination);
+    CGImageRelease(image);
+    return data;
+}
+
+- (void)test06PeakMemoryDecodingLargeFilesBenchmark {
+    if (!SDTestBenchmarkEnabled()) {
+        return;
+    }
+    const NSUInteger fileCount = 5;
+    NSUInteger totalLength = 0;
+    for (NSUInteger i = 0; i < fileCount; i++) {
+        @autoreleasepool {
+            NSData *data = [self noisePNGDataWithWidth:2300 height:2300 seed:(uint32_t)i + 1];
+            totalLength += data.length;
+            [self.cache storeImageDataToDisk:data forKey:[NSString stringWithFormat:@"photo%lu.png", (unsigned long)i]];
+        }
+    }
+    [self.cache flushDiskWrites];
+    [self reportBenchmark:@"average file size" value:totalLength / fileCount / 1e6 unit:@"MB"];
+
+    for (NSNumber *threshold in @[@0, @(64 * 1024)]) {
+        self.cache.config.diskCacheMappedReadingThreshold = threshold.unsignedIntegerValue;
+        __block NSTimeInterval elapsed = 0;
+        uint64_t peak = [self peakMemoryIncreaseDuringBlock:^{
+            NSTimeInterval start = SDTestNow();
+            // 一张一张解码，解码后的图片马上释放
+            for (NSUInteger i = 0; i < fileCount; i++) {
+                @autoreleasepool {
+                    UIImage *image = [self.cache diskImageForKey:[NSString stringWithFormat:@"photo%lu.png", (unsigned long)i]];
+                    XCTAssertEqual(image.size.width, 2300);
+                }
+            }
+            elapsed = SDTestNow() - start;
+        }];
+        NSString *label = threshold.unsignedIntegerValue > 0 ? @"mapped" : @"copied";
+        [self reportBenchmark:[label stringByAppendingString:@" peak memory"] value:peak / 1e6 unit:@"MB"];
+        [self reportBenchmark:[label stringByAppendingString:@" decode time"] value:elapsed / fileCount * 1000 unit:@"ms/image"];
+    }
+}
+
+@end
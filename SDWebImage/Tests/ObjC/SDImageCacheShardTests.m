@@ -0,0 +1,235 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDTestCase.h"
+#import "SDImageCache.h"
+#import "SDImageCacheConfig.h"
+#import <stdatomic.h>
+
+@interface SDImageCache ()
+
+- (nullable NSData *)diskImageDataBySearchingAllPathsForKey:(nullable NSString *)key;
+- (void)dispatchIOForKeyAndWait:(nullable NSString *)key block:(nonnull dispatch_block_t)block;
+- (void)dispatchExclusiveIOAndWait:(nonnull dispatch_block_t)block;
+- (NSUInteger)ioShardIndexForKey:(nullable NSString *)key;
+
+@end
+
+@interface SDImageCacheShardTests : SDTestCase
+
+@property (nonatomic, strong) SDImageCache *cache;
+
+@end
+
+@implementation SDImageCacheShardTests
+
+- (void)setUp {
+    [super setUp];
+    self.cache = [[SDImageCache alloc] initWithNamespace:@"shards" diskCacheDirectory:self.temporaryDirectory ioShardCount:4];
+    self.cache.config.shouldCacheImagesInMemory = NO;
+}
+
+- (void)tearDown {
+    self.cache = nil;
+    [super tearDown];
+}
+
+- (NSString *)keyAtIndex:(size_t)index {
+    return [NSString stringWithFormat:@"http://example.com/image%zu.png", index];
+}
+
+// 缓存目录中的文件数，包括打包存储的文件
+- (NSUInteger)filesOnDisk {
+    NSString *directory = [[self.cache defaultCachePathForKey:@"key"] stringByDeletingLastPathComponent];
+    NSUInteger count = 0;
+    for (NSString *name in [[NSFileManager defaultManager] contentsOfDirectoryAtPath:directory error:nil]) {
+        if (![name hasPrefix:@"."]) {
+            count++;
+        }
+    }
+    return count;
+}
+
+- (void)test01ShardCount {
+    XCTAssertEqual(self.cache.ioShardCount, 4u);
+    SDImageCache *defaultCache = [[SDImageCache alloc] initWithNamespace:@"default" diskCacheDirectory:self.temporaryDirectory];
+    XCTAssertGreaterThanOrEqual(defaultCache.ioShardCount, 2u);
+    XCTAssertLessThanOrEqual(defaultCache.ioShardCount, 8u);
+}
+
+- (void)test02ConcurrentWritesAndReadsOfDifferentKeys {
+    const size_t count = 200;
+    self.cache.config.diskCachePackThreshold = 0;
+    dispatch_apply(count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        NSString *key = [self keyAtIndex:i];
+        NSData *data = [self dataWithLength:512 + i seed:(uint8_t)i];
+        [self.cache storeImageDataToDisk:data forKey:key];
+        XCTAssertEqualObjects([self.cache diskImageDataBySearchingAllPathsForKey:key], data);
+    });
+    XCTAssertEqual([self.cache getDiskCount], count);
+    XCTAssertEqual([self filesOnDisk], count);
+    for (size_t i = 0; i < count; i++) {
+        NSData *data = [self.cache diskImageDataBySearchingAllPathsForKey:[self keyAtIndex:i]];
+        XCTAssertEqual(data.length, 512 + i);
+    }
+}
+
+- (void)test03OperationsOnTheSameKeyStayOrdered {
+    NSString *key = [self keyAtIndex:0];
+    NSData *first = [self PNGDataWithWidth:8 height:8];
+    NSData *second = [self PNGDataWithWidth:16 height:16];
+    UIImage *image = [[UIImage alloc] initWithData:first];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Ordered operations"];
+    [self.cache storeImage:image imageData:first forKey:key toDisk:YES completion:nil];
+    [self.cache flushDiskWrites];
+    [self.cache removeImageForKey:key fromDisk:YES withCompletion:nil];
+    [self.cache storeImage:image imageData:second forKey:key toDisk:YES completion:nil];
+    [self.cache flushDiskWritesWithCompletion:^{
+        XCTAssertEqualObjects([self.cache diskImageDataBySearchingAllPathsForKey:key], second);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:kAsyncTestTimeout handler:nil];
+}
+
+- (void)test04ExclusiveOperationsWaitForShards {
+    const size_t count = 100;
+    self.cache.config.diskCachePackThreshold = 0;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Clear while writing"];
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_group_async(group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        dispatch_apply(count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+            [self.cache storeImageDataToDisk:[self dataWithLength:256 seed:(uint8_t)i] forKey:[self keyAtIndex:i]];
+        });
+    });
+    [self.cache clearDiskOnCompletion:^{
+        dispatch_group_notify(group, dispatch_get_main_queue(), ^{
+            // 清空和写入交错执行，但是索引和目录中的文件始终一致
+            XCTAssertEqual([self.cache getDiskCount], [self filesOnDisk]);
+            XCTAssertLessThanOrEqual([self.cache getDiskCount], count);
+            [expectation fulfill];
+        });
+    }];
+    [self waitForExpectationsWithTimeout:kAsyncTestTimeout handler:nil];
+}
+
+- (void)test05StoreDataFromTheIOQueuesDoesNotDeadlock {
+    NSString *key = [self keyAtIndex:0];
+    NSData *first = [self dataWithLength:100 seed:1];
+    NSData *second = [self dataWithLength:200 seed:2];
+    NSData *third = [self dataWithLength:300 seed:3];
+    // 在 key 自己的分片队列上、另一个 key 的分片队列上和独占操作中同步写入，都直接在当前队列写入
+    [self.cache dispatchIOForKeyAndWait:key block:^{
+        [self.cache storeImageDataToDisk:first forKey:key];
+    }];
+    XCTAssertEqualObjects([self.cache diskImageDataBySearchingAllPathsForKey:key], first);
+    [self.cache dispatchIOForKeyAndWait:[self keyAtIndex:1] block:^{
+        [self.cache storeImageDataToDisk:second forKey:key];
+    }];
+    XCTAssertEqualObjects([self.cache diskImageDataBySearchingAllPathsForKey:key], second);
+    [self.cache dispatchExclusiveIOAndWait:^{
+        [self.cache storeImageDataToDisk:third forKey:key];
+    }];
+    XCTAssertEqualObjects([self.cache diskImageDataBySearchingAllPathsForKey:key], third);
+
+    // 另一个缓存实例的队列标识相同，但不是这个实例的IO队列，仍然派发到分片队列
+    SDImageCache *otherCache = [[SDImageCache alloc] initWithNamespace:@"other" diskCacheDirectory:self.temporaryDirectory ioShardCount:1];
+    [otherCache dispatchIOForKeyAndWait:key block:^{
+        [self.cache storeImageDataToDisk:first forKey:key];
+    }];
+    XCTAssertEqualObjects([self.cache diskImageDataBySearchingAllPathsForKey:key], first);
+}
+
+- (void)test06KeysWithASharedPrefixAndSuffixSpreadOverAllShards {
+    // NSString 的 hash 只取长字符串开头和结尾的字符，这些 URL 只有中间不同
+    SDImageCache *cache = [[SDImageCache alloc] initWithNamespace:@"spread" diskCacheDirectory:self.temporaryDirectory ioShardCount:8];
+    const NSUInteger count = 2000;
+    NSUInteger keysPerShard[8] = {0};
+    for (NSUInteger i = 0; i < count; i++) {
+        NSString *key = [NSString stringWithFormat:@"https://images.cdn.example.com/production/feed/thumbnails/%lu/photo_2048x2048_q85.jpg?signature=0123456789abcdef0123456789abcdef", (unsigned long)i];
+        keysPerShard[[cache ioShardIndexForKey:key]]++;
+    }
+    for (NSUInteger shard = 0; shard < 8; shard++) {
+        XCTAssertGreaterThan(keysPerShard[shard], count / 8 * 7 / 10, @"shard %lu", (unsigned long)shard);
+        XCTAssertLessThan(keysPerShard[shard], count / 8 * 13 / 10, @"shard %lu", (unsigned long)shard);
+    }
+}
+
+#pragma mark - Benchmark
+
+// 读线程不断读取已经缓存的小图片，写线程同时写入大小不同的图片。报告读取延迟（毫秒）的 p50、p99 和每秒读取次数
+- (void)benchmarkShardCount:(NSUInteger)shardCount readerCount:(NSUInteger)readerCount writerCount:(NSUInteger)writerCount {
+    const NSUInteger keyCount = 1000;
+    const NSUInteger readsPerReader = 2000;
+    NSString *namespace = [NSString stringWithFormat:@"benchmark%lu-%lu-%lu", (unsigned long)shardCount, (unsigned long)readerCount, (unsigned long)writerCount];
+    SDImageCache *cache = [[SDImageCache alloc] initWithNamespace:namespace diskCacheDirectory:self.temporaryDirectory ioShardCount:shardCount];
+    cache.config.shouldCacheImagesInMemory = NO;
+    for (NSUInteger i = 0; i < keyCount; i++) {
+        [cache storeImageDataToDisk:[self dataWithLength:4096 + i * 61 % (60 * 1024) seed:(uint8_t)i] forKey:[self keyAtIndex:i]];
+    }
+    [cache flushDiskWrites];
+    // 写入的图片 90% 是 16KB 或 256KB，10% 是 4MB
+    NSArray<NSData *> *writeData = @[[self dataWithLength:16 * 1024 seed:1], [self dataWithLength:256 * 1024 seed:2], [self dataWithLength:4 * 1024 * 1024 seed:3]];
+
+    double *latencies = malloc(readerCount * readsPerReader * sizeof(double));
+    __block atomic_bool readersFinished = false;
+    __block atomic_ullong writtenBytes = 0;
+    dispatch_queue_t queue = dispatch_queue_create("com.hackemist.SDImageCacheShardTests.benchmark", DISPATCH_QUEUE_CONCURRENT);
+    dispatch_group_t readers = dispatch_group_create();
+    dispatch_group_t writers = dispatch_group_create();
+    NSTimeInterval start = SDTestNow();
+    for (NSUInteger w = 0; w < writerCount; w++) {
+        dispatch_group_async(writers, queue, ^{
+            for (NSUInteger n = 0; !atomic_load(&readersFinished); n++) {
+                NSData *data = writeData[n % 10 == 0 ? 2 : n % 2];
+                [cache storeImageDataToDisk:data forKey:[NSString stringWithFormat:@"http://example.com/writer%lu/%lu.jpg", (unsigned long)w, (unsigned long)(n % 50)]];
+                atomic_fetch_add(&writtenBytes, data.length);
+            }
+        });
+    }
+    for (NSUInteger r = 0; r < readerCount; r++) {
+        dispatch_group_async(readers, queue, ^{
+            uint32_t state = (uint32_t)r + 1;
+            for (NSUInteger n = 0; n < readsPerReader; n++) {
+                state = state * 1103515245u + 12345u;
+                NSString *key = [self keyAtIndex:(state >> 8) % keyCount];
+                NSTimeInterval readStart = SDTestNow();
+                __block NSData *data;
+                [cache dispatchIOForKeyAndWait:key block:^{
+                    data = [cache diskImageDataBySearchingAllPathsForKey:key];
+                }];
+                latencies[r * readsPerReader + n] = (SDTestNow() - readStart) * 1000;
+                XCTAssertNotNil(data);
+            }
+        });
+    }
+    dispatch_group_wait(readers, DISPATCH_TIME_FOREVER);
+    NSTimeInterval elapsed = SDTestNow() - start;
+    atomic_store(&readersFinished, true);
+    dispatch_group_wait(writers, DISPATCH_TIME_FOREVER);
+    [cache flushDiskWrites];
+
+    NSUInteger readCount = readerCount * readsPerReader;
+    NSString *label = [NSString stringWithFormat:@"%lu shards, %lu readers, %lu writers", (unsigned long)shardCount, (unsigned long)readerCount, (unsigned long)writerCount];
+    [self reportBenchmark:[label stringByAppendingString:@" read p50"] value:SDTestPercentile(latencies, readCount, 50) unit:@"ms"];
+    [self reportBenchmark:[label stringByAppendingString:@" read p99"] value:SDTestPercentile(latencies, readCount, 99) unit:@"ms"];
+    [self reportBenchmark:[label stringByAppendingString:@" reads"] value:readCount / elapsed unit:@"/s"];
+    [self reportBenchmark:[label stringByAppendingString:@" writes"] value:atomic_load(&writtenBytes) / elapsed / 1e6 unit:@"MB/s"];
+    free(latencies);
+}
+
+- (void)test07ReadLatencyAgainstShardCountBenchmark {
+    if (!SDTestBenchmarkEnabled()) {
+        return;
+    }
+    for (NSNumber *shardCount in @[@1, @2, @4, @8]) {
+        [self benchmarkShardCount:shardCount.unsignedIntegerValue readerCount:8 writerCount:0];
+        [self benchmarkShardCount:shardCount.unsignedIntegerValue readerCount:8 writerCount:2];
+    }
+}
+
+@end
@@ -0,0 +1,175 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+/*
+ 磁盘缓存淘汰策略的访问记录回放
+
+ 按顺序回放一份 key 的访问记录：命中时从磁盘缓存读取，没有命中时当作重新下载，写入磁盘缓存。
+ 每回放 kTrimInterval 次访问清理一次缓存（和应用进入后台时一样），比较各个淘汰策略的命中率和重新下载的字节数。
+ 第一次访问一个 key 一定不命中，重新下载的字节数只统计之前下载过、被淘汰了的 key。
+
+ 访问记录是文本文件，每行一次访问：`<key> <字节数>`，# 开头的行是注释。
+ 设置环境变量 SD_CACHE_TRACE 为记录文件的路径时回放这个文件，SD_CACHE_TRACE_SIZE 是缓存容量（字节），
+ 默认是所有 key 总大小的 20%。没有设置时回放一份生成的记录：key 的访问频率服从 Zipf 分布，热门的 key 通常最早出现。
+ */
+
+#import "SDTestCase.h"
+#import "SDImageCache.h"
+#import "SDImageCacheConfig.h"
+
+static const NSUInteger kTrimInterval = 200;
+
+@interface SDImageCache ()
+
+- (nullable NSData *)diskImageDataBySearchingAllPathsForKey:(nullable NSString *)key;
+
+@end
+
+@interface SDCacheTraceAccess : NSObject
+
+@property (nonatomic, copy) NSString *key;
+@property (nonatomic, assign) NSUInteger size;
+
+@end
+
+@implementation SDCacheTraceAccess
+
+@end
+
+@interface SDImageCacheTraceReplayTests : SDTestCase
+
+@end
+
+@implementation SDImageCacheTraceReplayTests
+
+- (NSArray<SDCacheTraceAccess *> *)accessesOfTrace:(NSString *)trace {
+    NSMutableArray<SDCacheTraceAccess *> *accesses = [NSMutableArray array];
+    [trace enumerateLinesUsingBlock:^(NSString *line, BOOL *stop) {
+        NSArray<NSString *> *fields = [line componentsSeparatedByCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+        if (fields.count < 2 || [line hasPrefix:@"#"]) {
+            return;
+        }
+        SDCacheTraceAccess *access = [SDCacheTraceAccess new];
+        access.key = fields[0];
+        access.size = (NSUInteger)fields[1].longLongValue;
+        [accesses addObject:access];
+    }];
+    return accesses;
+}
+
+// 4000 个 key，20000 次访问，访问频率服从 s = 0.9 的 Zipf 分布，每个 key 2~64KB
+- (NSString *)generatedTrace {
+    const NSUInteger keyCount = 4000;
+    const NSUInteger accessCount = 20000;
+    double *cumulative = malloc(keyCount * sizeof(double));
+    double sum = 0;
+    for (NSUInteger i = 0; i < keyCount; i++) {
+        sum += 1.0 / pow(i + 1, 0.9);
+        cumulative[i] = sum;
+    }
+    NSMutableString *trace = [NSMutableString stringWithString:@"# generated, Zipf s = 0.9\n"];
+    uint32_t state = 1;
+    for (NSUInteger i = 0; i < accessCount; i++) {
+        state = state * 1103515245u + 12345u;
+        double target = (state >> 8) / (double)(1 << 24) * sum;
+        NSUInteger low = 0, high = keyCount - 1;
+        while (low < high) {
+            NSUInteger middle = (low + high) / 2;
+            if (cumulative[middle] < target) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        [trace appendFormat:@"https://cdn.example.com/images/%lu.jpg %lu\n", (unsigned long)low, (unsigned long)(2048 + low * 7919 % (62 * 1024))];
+    }
+    free(cumulative);
+    return trace;
+}
+
+- (void)replayAccesses:(NSArray<SDCacheTraceAccess *> *)accesses
+             cacheSize:(NSUInteger)cacheSize
+            expireType:(SDImageCacheConfigExpireType)expireType
+                  name:(NSString *)name
+              hitRatio:(double *)hitRatio {
+    NSString *directory = [self.temporaryDirectory stringByAppendingPathComponent:name];
+    SDImageCache *cache = [[SDImageCache alloc] initWithNamespace:@"replay" diskCacheDirectory:directory];
+    cache.config.shouldCacheImagesInMemory = NO;
+    cache.config.diskCacheExpireType = expireType;
+    cache.config.maxCacheSize = cacheSize;
+
+    NSMutableSet<NSString *> *fetchedKeys = [NSMutableSet set];
+    NSMutableDictionary<NSNumber *, NSData *> *dataBySize = [NSMutableDictionary dictionary];
+    NSUInteger hitCount = 0;
+    unsigned long long refetchedBytes = 0;
+    unsigned long long fetchedBytes = 0;
+    for (NSUInteger i = 0; i < accesses.count; i++) {
+        @autoreleasepool {
+            SDCacheTraceAccess *access = accesses[i];
+            if ([cache diskImageDataBySearchingAllPathsForKey:access.key]) {
+                hitCount++;
+            } else {
+                if ([fetchedKeys containsObject:access.key]) {
+                    refetchedBytes += access.size;
+                }
+                [fetchedKeys addObject:access.key];
+                fetchedBytes += access.size;
+                NSData *data = dataBySize[@(access.size)];
+                if (!data) {
+                    data = [self dataWithLength:access.size seed:(uint8_t)access.size];
+                    dataBySize[@(access.size)] = data;
+                }
+                [cache storeImageDataToDisk:data forKey:access.key];
+            }
+        }
+        if ((i + 1) % kTrimInterval == 0) {
+            XCTestExpectation *expectation = [self expectationWithDescription:@"Trim"];
+            [cache deleteOldFilesWithCompletionBlock:^{
+                [expectation fulfill];
+            }];
+            [self waitForExpectationsWithTimeout:60 handler:nil];
+        }
+    }
+    *hitRatio = (double)hitCount / MAX(accesses.count, 1u);
+    [self reportBenchmark:[name stringByAppendingString:@" hit ratio"] value:*hitRatio * 100 unit:@"%"];
+    [self reportBenchmark:[name stringByAppendingString:@" bytes fetched"] value:fetchedBytes / 1e6 unit:@"MB"];
+    [self reportBenchmark:[name stringByAppendingString:@" bytes re-fetched"] value:refetchedBytes / 1e6 unit:@"MB"];
+}
+
+- (void)test01ReplayTraceAgainstEvictionPolicies {
+    if (!SDTestBenchmarkEnabled()) {
+        return;
+    }
+    NSDictionary<NSString *, NSString *> *environment = [NSProcessInfo processInfo].environment;
+    NSString *tracePath = environment[@"SD_CACHE_TRACE"];
+    NSString *trace = tracePath ? [NSString stringWithContentsOfFile:tracePath encoding:NSUTF8StringEncoding error:nil] : [self generatedTrace];
+    XCTAssertNotNil(trace, @"%@", tracePath);
+    NSArray<SDCacheTraceAccess *> *accesses = [self accessesOfTrace:trace ?: @""];
+    XCTAssertGreaterThan(accesses.count, 0u);
+
+    NSMutableDictionary<NSString *, NSNumber *> *sizes = [NSMutableDictionary dictionary];
+    for (SDCacheTraceAccess *access in accesses) {
+        sizes[access.key] = @(access.size);
+    }
+    NSUInteger totalSize = [[sizes.allValues valueForKeyPath:@"@sum.unsignedIntegerValue"] unsignedIntegerValue];
+    NSUInteger cacheSize = environment[@"SD_CACHE_TRACE_SIZE"] ? (NSUInteger)environment[@"SD_CACHE_TRACE_SIZE"].longLongValue : totalSize / 5;
+    [self reportBenchmark:@"accesses" value:accesses.count unit:@""];
+    [self reportBenchmark:@"distinct keys" value:sizes.count unit:@""];
+    [self reportBenchmark:@"cache size" value:cacheSize / 1e6 unit:@"MB"];
+
+    double modificationDateHitRatio = 0, accessDateHitRatio = 0, accessDateAndSizeHitRatio = 0;
+    [self replayAccesses:accesses cacheSize:cacheSize expireType:SDImageCacheConfigExpireTypeModificationDate name:@"ModificationDate" hitRatio:&modificationDateHitRatio];
+    [self replayAccesses:accesses cacheSize:cacheSize expireType:SDImageCacheConfigExpireTypeAccessDate name:@"AccessDate" hitRatio:&accessDateHitRatio];
+    [self replayAccesses:accesses cacheSize:cacheSize expireType:SDImageCacheConfigExpireTypeAccessDateAndSize name:@"AccessDateAndSize" hitRatio:&accessDateAndSizeHitRatio];
+    if (!tracePath) {
+        // 热门的 key 最早写入，按写入时间淘汰时最先被删除
+        XCTAssertGreaterThan(accessDateHitRatio, modificationDateHitRatio);
+    }
+}
+
+@end
@@ -0,0 +1,228 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDTestCase.h"
+#import "SDImageCache.h"
+#import "SDImageCacheConfig.h"
+
+@interface SDImageCache ()
+
+- (nonnull NSArray<dispatch_queue_t> *)ioShardQueues;
+- (nonnull NSMutableDictionary<NSString *, id> *)pendingWrites;
+- (nonnull dispatch_semaphore_t)pendingWritesLock;
+- (nullable NSData *)diskImageDataBySearchingAllPathsForKey:(nullable NSString *)key;
+
+@end
+
+@interface SDImageCacheWriteBehindTests : SDTestCase
+
+@property (nonatomic, strong) SDImageCache *cache;
+@property (nonatomic, strong) UIImage *image;
+
+@end
+
+@implementation SDImageCacheWriteBehindTests
+
+- (void)setUp {
+    [super setUp];
+    // 只有一个分片队列，方便阻塞所有的写入
+    self.cache = [[SDImageCache alloc] initWithNamespace:@"writeBehind" diskCacheDirectory:self.temporaryDirectory ioShardCount:1];
+    self.cache.config.shouldCacheImagesInMemory = NO;
+    self.image = [[UIImage alloc] initWithData:[self PNGDataWithWidth:8 height:8]];
+}
+
+- (void)tearDown {
+    [self.cache flushDiskWrites];
+    self.cache = nil;
+    [super tearDown];
+}
+
+- (NSString *)keyAtIndex:(NSUInteger)index {
+    return [NSString stringWithFormat:@"http://example.com/image%lu.png", (unsigned long)index];
+}
+
+- (BOOL)fileExistsForKey:(NSString *)key {
+    return [[NSFileManager defaultManager] fileExistsAtPath:[self.cache defaultCachePathForKey:key]];
+}
+
+- (id)pendingWriteForKey:(NSString *)key {
+    SD_LOCK(self.cache.pendingWritesLock);
+    id write = self.cache.pendingWrites[key];
+    SD_UNLOCK(self.cache.pendingWritesLock);
+    return write;
+}
+
+// 阻塞分片队列，返回的信号量 signal 之后恢复
+- (dispatch_semaphore_t)blockIOQueue {
+    dispatch_semaphore_t blocked = dispatch_semaphore_create(0);
+    dispatch_semaphore_t resume = dispatch_semaphore_create(0);
+    dispatch_async(self.cache.ioShardQueues.firstObject, ^{
+        dispatch_semaphore_signal(blocked);
+        dispatch_semaphore_wait(resume, DISPATCH_TIME_FOREVER);
+    });
+    dispatch_semaphore_wait(blocked, DISPATCH_TIME_FOREVER);
+    return resume;
+}
+
+- (void)test01WritesAreDeferredButReadable {
+    NSString *key = [self keyAtIndex:0];
+    NSData *data = [self dataWithLength:1000 seed:1];
+    [self.cache storeImage:self.image imageData:data forKey:key toDisk:YES completion:nil];
+    XCTAssertNotNil([self pendingWriteForKey:key]);
+    XCTAssertFalse([self fileExistsForKey:key]);
+    // 还没有写入的数据也可以读到
+    XCTAssertEqualObjects([self.cache diskImageDataBySearchingAllPathsForKey:key], data);
+    [self.cache flushDiskWrites];
+    XCTAssertNil([self pendingWriteForKey:key]);
+    XCTAssertTrue([self fileExistsForKey:key]);
+    XCTAssertEqualObjects([self.cache diskImageDataBySearchingAllPathsForKey:key], data);
+}
+
+- (void)test02WritesOfTheSameKeyCoalesce {
+    NSString *key = [self keyAtIndex:0];
+    NSMutableArray<NSNumber *> *completed = [NSMutableArray array];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Coalesced writes"];
+    for (NSUInteger i = 0; i < 3; i++) {
+        [self.cache storeImage:self.image imageData:[self dataWithLength:1000 seed:(uint8_t)i] forKey:key toDisk:YES completion:^{
+            // 被替换的写入在最后一次写入完成后按存储的顺序回调
+            XCTAssertTrue([self fileExistsForKey:key]);
+            [completed addObject:@(i)];
+        }];
+    }
+    XCTAssertEqual(self.cache.pendingWrites.count, 1);
+    [self.cache flushDiskWritesWithCompletion:^{
+        XCTAssertEqualObjects(completed, (@[@0, @1, @2]));
+        XCTAssertEqualObjects([self.cache diskImageDataBySearchingAllPathsForKey:key], [self dataWithLength:1000 seed:2]);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:kAsyncTestTimeout handler:nil];
+}
+
+- (void)test03WritesAreFlushedAfterADelay {
+    const NSUInteger count = 20;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Delayed writes"];
+    expectation.expectedFulfillmentCount = count;
+    for (NSUInteger i = 0; i < count; i++) {
+        NSString *key = [self keyAtIndex:i];
+        [self.cache storeImage:self.image imageData:[self dataWithLength:100 seed:(uint8_t)i] forKey:key toDisk:YES completion:^{
+            XCTAssertTrue([self fileExistsForKey:key]);
+            [expectation fulfill];
+        }];
+    }
+    [self waitForExpectationsWithTimeout:kAsyncTestTimeout handler:nil];
+    XCTAssertEqual(self.cache.pendingWrites.count, 0);
+    XCTAssertEqual([self.cache getDiskCount], count);
+}
+
+- (void)test04FullBufferIsDispatchedAtOnce {
+    self.cache.config.diskCacheWriteBufferSize = 1000;
+    [self.cache storeImage:self.image imageData:[self dataWithLength:400 seed:0] forKey:[self keyAtIndex:0] toDisk:YES completion:nil];
+    XCTAssertEqualObjects([[self pendingWriteForKey:[self keyAtIndex:0]] valueForKey:@"dispatched"], @NO);
+    dispatch_semaphore_t resume = [self blockIOQueue];
+    [self.cache storeImage:self.image imageData:[self dataWithLength:600 seed:1] forKey:[self keyAtIndex:1] toDisk:YES completion:nil];
+    XCTAssertEqualObjects([[self pendingWriteForKey:[self keyAtIndex:0]] valueForKey:@"dispatched"], @YES);
+    XCTAssertEqualObjects([[self pendingWriteForKey:[self keyAtIndex:1]] valueForKey:@"dispatched"], @YES);
+    dispatch_semaphore_signal(resume);
+    [self.cache flushDiskWrites];
+    XCTAssertTrue([self fileExistsForKey:[self keyAtIndex:0]]);
+    XCTAssertTrue([self fileExistsForKey:[self keyAtIndex:1]]);
+}
+
+- (void)test05RemovalCancelsThePendingWrite {
+    NSString *key = [self keyAtIndex:0];
+    XCTestExpectation *storeExpectation = [self expectationWithDescription:@"Cancelled write"];
+    XCTestExpectation *removeExpectation = [self expectationWithDescription:@"Remove"];
+    [self.cache storeImage:self.image imageData:[self dataWithLength:1000 seed:0] forKey:key toDisk:YES completion:^{
+        [storeExpectation fulfill];
+    }];
+    [self.cache removeImageForKey:key fromDisk:YES withCompletion:^{
+        [removeExpectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:kAsyncTestTimeout handler:nil];
+    [self.cache flushDiskWrites];
+    XCTAssertFalse([self fileExistsForKey:key]);
+    XCTAssertNil([self.cache diskImageDataBySearchingAllPathsForKey:key]);
+}
+
+- (void)test06BackgroundStoresWaitForTheDisk {
+    self.cache.config.diskCacheWriteBufferSize = 1000;
+    dispatch_semaphore_t resume = [self blockIOQueue];
+    // 两次写满缓冲区，派发之后都阻塞在分片队列上
+    [self.cache storeImage:self.image imageData:[self dataWithLength:1000 seed:0] forKey:[self keyAtIndex:0] toDisk:YES completion:nil];
+    [self.cache storeImage:self.image imageData:[self dataWithLength:1000 seed:1] forKey:[self keyAtIndex:1] toDisk:YES completion:nil];
+
+    __block BOOL backgroundStoreReturned = NO;
+    dispatch_semaphore_t backgroundStoreDone = dispatch_semaphore_create(0);
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        [self.cache storeImage:self.image imageData:[self dataWithLength:100 seed:2] forKey:[self keyAtIndex:2] toDisk:YES completion:nil];
+        backgroundStoreReturned = YES;
+        dispatch_semaphore_signal(backgroundStoreDone);
+    });
+    // 主线程不等待
+    [self.cache storeImage:self.image imageData:[self dataWithLength:100 seed:3] forKey:[self keyAtIndex:3] toDisk:YES completion:nil];
+    XCTAssertNotEqual(dispatch_semaphore_wait(backgroundStoreDone, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(0.3 * NSEC_PER_SEC))), 0);
+    XCTAssertFalse(backgroundStoreReturned);
+
+    dispatch_semaphore_signal(resume);
+    XCTAssertEqual(dispatch_semaphore_wait(backgroundStoreDone, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kAsyncTestTimeout * NSEC_PER_SEC))), 0);
+    // 同步写入返回时已经在磁盘上
+    XCTAssertTrue([self fileExistsForKey:[self keyAtIndex:2]]);
+    [self.cache flushDiskWrites];
+    for (NSUInteger i = 0; i < 4; i++) {
+        XCTAssertTrue([self fileExistsForKey:[self keyAtIndex:i]]);
+    }
+}
+
+#pragma mark - Benchmark
+
+// 300 张 20~500KB 的图片同时下载完成，每张存储之后马上读取一次。bufferSize 为 0 时每次存储立即派发写入
+- (void)benchmarkBurstWithBufferSize:(NSUInteger)bufferSize name:(NSString *)name {
+    const NSUInteger burstCount = 300;
+    SDImageCache *cache = [[SDImageCache alloc] initWithNamespace:name diskCacheDirectory:self.temporaryDirectory];
+    cache.config.shouldCacheImagesInMemory = NO;
+    cache.config.diskCacheWriteBufferSize = bufferSize;
+    NSMutableArray<NSData *> *data = [NSMutableArray array];
+    for (NSUInteger i = 0; i < 16; i++) {
+        [data addObject:[self dataWithLength:20 * 1024 + i * 30 * 1024 seed:(uint8_t)i]];
+    }
+
+    double *readLatencies = malloc(burstCount * sizeof(double));
+    unsigned long long totalLength = 0;
+    NSTimeInterval storeTime = 0;
+    NSTimeInterval start = SDTestNow();
+    for (NSUInteger i = 0; i < burstCount; i++) {
+        @autoreleasepool {
+            NSString *key = [NSString stringWithFormat:@"%@/burst%lu.png", name, (unsigned long)i];
+            NSData *imageData = data[i % data.count];
+            totalLength += imageData.length;
+            NSTimeInterval storeStart = SDTestNow();
+            [cache storeImage:self.image imageData:imageData forKey:key toDisk:YES completion:nil];
+            NSTimeInterval readStart = SDTestNow();
+            storeTime += readStart - storeStart;
+            XCTAssertEqualObjects([cache diskImageDataBySearchingAllPathsForKey:key], imageData);
+            readLatencies[i] = (SDTestNow() - readStart) * 1e6;
+        }
+    }
+    [cache flushDiskWrites];
+    NSTimeInterval elapsed = SDTestNow() - start;
+    [self reportBenchmark:[name stringByAppendingString:@" write throughput"] value:totalLength / elapsed / 1e6 unit:@"MB/s"];
+    [self reportBenchmark:[name stringByAppendingString:@" store call"] value:storeTime / burstCount * 1e6 unit:@"us"];
+    [self reportBenchmark:[name stringByAppendingString:@" time to first read p50"] value:SDTestPercentile(readLatencies, burstCount, 50) unit:@"us"];
+    [self reportBenchmark:[name stringByAppendingString:@" time to first read p99"] value:SDTestPercentile(readLatencies, burstCount, 99) unit:@"us"];
+    free(readLatencies);
+}
+
+- (void)test07BurstBenchmark {
+    if (!SDTestBenchmarkEnabled()) {
+        return;
+    }
+    [self benchmarkBurstWithBufferSize:0 name:@"unbuffered"];
+    [self benchmarkBurstWithBufferSize:[SDImageCacheConfig new].diskCacheWriteBufferSize name:@"write behind"];
+}
+
+@end
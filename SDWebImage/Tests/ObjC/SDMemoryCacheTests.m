@@ -0,0 +1,165 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDTestCase.h"
+#import "SDMemoryCache.h"
+#import "SDImageCache.h"
+
+@interface SDMemoryCacheTests : SDTestCase
+
+@end
+
+@implementation SDMemoryCacheTests
+
+- (void)test01CostLimitEvictsLeastRecentlyUsed {
+    SDMemoryCache<NSString *, NSString *> *cache = [SDMemoryCache new];
+    cache.totalCostLimit = 30;
+    [cache setObject:@"a" forKey:@"a" cost:10];
+    [cache setObject:@"b" forKey:@"b" cost:10];
+    [cache setObject:@"c" forKey:@"c" cost:10];
+    // 读取 a 之后 b 是最久没有使用的
+    XCTAssertEqualObjects([cache objectForKey:@"a"], @"a");
+    [cache setObject:@"d" forKey:@"d" cost:10];
+
+    XCTAssertNil([cache objectForKey:@"b"]);
+    XCTAssertTrue([cache containsObjectForKey:@"a"]);
+    XCTAssertTrue([cache containsObjectForKey:@"c"]);
+    XCTAssertTrue([cache containsObjectForKey:@"d"]);
+    XCTAssertEqual(cache.totalCost, 30u);
+    XCTAssertEqual(cache.totalCount, 3u);
+
+    // 一个大对象挤掉多个小对象，顺序是 c、a
+    [cache setObject:@"e" forKey:@"e" cost:15];
+    XCTAssertFalse([cache containsObjectForKey:@"c"]);
+    XCTAssertFalse([cache containsObjectForKey:@"a"]);
+    XCTAssertTrue([cache containsObjectForKey:@"d"]);
+    XCTAssertEqual(cache.totalCost, 25u);
+}
+
+- (void)test02CountLimitEvictsLeastRecentlyUsed {
+    SDMemoryCache<NSString *, NSString *> *cache = [SDMemoryCache new];
+    cache.countLimit = 2;
+    [cache setObject:@"a" forKey:@"a"];
+    [cache setObject:@"b" forKey:@"b"];
+    [cache objectForKey:@"a"];
+    [cache setObject:@"c" forKey:@"c"];
+    XCTAssertTrue([cache containsObjectForKey:@"a"]);
+    XCTAssertFalse([cache containsObjectForKey:@"b"]);
+    XCTAssertTrue([cache containsObjectForKey:@"c"]);
+    XCTAssertEqual(cache.totalCount, 2u);
+}
+
+- (void)test03ContainsDoesNotChangeOrder {
+    SDMemoryCache<NSString *, NSString *> *cache = [SDMemoryCache new];
+    cache.countLimit = 2;
+    [cache setObject:@"a" forKey:@"a"];
+    [cache setObject:@"b" forKey:@"b"];
+    XCTAssertTrue([cache containsObjectForKey:@"a"]);
+    [cache setObject:@"c" forKey:@"c"];
+    XCTAssertFalse([cache containsObjectForKey:@"a"]);
+    XCTAssertTrue([cache containsObjectForKey:@"b"]);
+}
+
+- (void)test04ReplacingAnObjectUpdatesTheCost {
+    SDMemoryCache<NSString *, NSString *> *cache = [SDMemoryCache new];
+    [cache setObject:@"a" forKey:@"a" cost:10];
+    [cache setObject:@"b" forKey:@"a" cost:4];
+    XCTAssertEqual(cache.totalCost, 4u);
+    XCTAssertEqual(cache.totalCount, 1u);
+    XCTAssertEqualObjects([cache objectForKey:@"a"], @"b");
+    [cache setObject:nil forKey:@"a"];
+    XCTAssertEqual(cache.totalCost, 0u);
+    XCTAssertEqual(cache.totalCount, 0u);
+}
+
+- (void)test05TrimToCostAndCount {
+    SDMemoryCache<NSString *, NSString *> *cache = [SDMemoryCache new];
+    for (NSUInteger i = 0; i < 10; i++) {
+        NSString *key = [NSString stringWithFormat:@"%lu", (unsigned long)i];
+        [cache setObject:key forKey:key cost:i + 1];
+    }
+    [cache trimToCost:30];
+    // 从最早写入的开始淘汰，直到总消耗不超过 30：剩下 7、8、9，总消耗 8 + 9 + 10
+    XCTAssertEqual(cache.totalCost, 27u);
+    XCTAssertFalse([cache containsObjectForKey:@"6"]);
+    XCTAssertTrue([cache containsObjectForKey:@"7"]);
+    [cache trimToCount:1];
+    XCTAssertEqual(cache.totalCount, 1u);
+    XCTAssertTrue([cache containsObjectForKey:@"9"]);
+}
+
+- (void)test06AgeLimit {
+    SDMemoryCache<NSString *, NSString *> *cache = [SDMemoryCache new];
+    cache.ageLimit = 0.2;
+    [cache setObject:@"a" forKey:@"a"];
+    [cache setObject:@"b" forKey:@"b"];
+    [NSThread sleepForTimeInterval:0.15];
+    [cache objectForKey:@"b"];
+    [NSThread sleepForTimeInterval:0.1];
+    XCTAssertNil([cache objectForKey:@"a"]);
+    XCTAssertEqualObjects([cache objectForKey:@"b"], @"b");
+    [cache trimToAge:0];
+    XCTAssertEqual(cache.totalCount, 0u);
+}
+
+- (void)test07ImageCacheHasADefaultByteBudget {
+    SDImageCache *imageCache = [[SDImageCache alloc] initWithNamespace:@"memory" diskCacheDirectory:self.temporaryDirectory];
+    XCTAssertEqual(imageCache.maxMemoryCost, (NSUInteger)([NSProcessInfo processInfo].physicalMemory / 8));
+}
+
+#pragma mark - Benchmark
+
+// threadCount 个线程同时访问 cache，90% 读取、10% 写入，key 在 keyCount 个之中随机选择。报告每秒的操作次数
+- (void)benchmarkCache:(id)cache name:(NSString *)name threadCount:(NSUInteger)threadCount {
+    const NSUInteger keyCount = 10000;
+    const NSUInteger operationsPerThread = 200000;
+    NSMutableArray<NSString *> *keys = [NSMutableArray arrayWithCapacity:keyCount];
+    for (NSUInteger i = 0; i < keyCount; i++) {
+        NSString *key = [NSString stringWithFormat:@"http://example.com/image%lu.png", (unsigned long)i];
+        [keys addObject:key];
+        [cache setObject:key forKey:key cost:1024];
+    }
+    dispatch_queue_t queue = dispatch_queue_create("com.hackemist.SDMemoryCacheTests.benchmark", DISPATCH_QUEUE_CONCURRENT);
+    dispatch_group_t group = dispatch_group_create();
+    NSTimeInterval start = SDTestNow();
+    for (NSUInteger t = 0; t < threadCount; t++) {
+        dispatch_group_async(group, queue, ^{
+            uint32_t state = (uint32_t)t + 1;
+            for (NSUInteger n = 0; n < operationsPerThread; n++) {
+                state = state * 1103515245u + 12345u;
+                NSString *key = keys[(state >> 8) % keyCount];
+                if (n % 10 == 0) {
+                    [cache setObject:key forKey:key cost:1024];
+                } else {
+                    [cache objectForKey:key];
+                }
+            }
+        });
+    }
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    NSTimeInterval elapsed = SDTestNow() - start;
+    NSString *label = [NSString stringWithFormat:@"%@, %lu threads", name, (unsigned long)threadCount];
+    [self reportBenchmark:label value:threadCount * operationsPerThread / elapsed / 1e6 unit:@"M ops/s"];
+}
+
+- (void)test08GetSetThroughputUnderContentionBenchmark {
+    if (!SDTestBenchmarkEnabled()) {
+        return;
+    }
+    for (NSNumber *threadCount in @[@1, @2, @4, @8]) {
+        // 预算能放下一半的 key，写入时也会淘汰
+        SDMemoryCache *memoryCache = [SDMemoryCache new];
+        memoryCache.totalCostLimit = 5000 * 1024;
+        [self benchmarkCache:memoryCache name:@"SDMemoryCache" threadCount:threadCount.unsignedIntegerValue];
+        NSCache *systemCache = [NSCache new];
+        systemCache.totalCostLimit = 5000 * 1024;
+        [self benchmarkCache:systemCache name:@"NSCache" threadCount:threadCount.unsignedIntegerValue];
+    }
+}
+
+@end
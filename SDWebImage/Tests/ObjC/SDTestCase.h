@@ -0,0 +1,58 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import <XCTest/XCTest.h>
+#import "SDWebImageCompat.h"
+
+FOUNDATION_EXPORT const NSTimeInterval kAsyncTestTimeout;
+
+/**
+ * Benchmarks are slow, they only run when the `SD_BENCHMARK` environment variable is set, as `ctest -C Benchmark` does
+ */
+FOUNDATION_EXPORT BOOL SDTestBenchmarkEnabled(void);
+
+/**
+ * Seconds of a monotonic clock
+ */
+FOUNDATION_EXPORT NSTimeInterval SDTestNow(void);
+
+/**
+ * The nearest-rank percentile (0 to 100) of the samples. Sorts the samples in place
+ */
+FOUNDATION_EXPORT double SDTestPercentile(double * _Nonnull samples, NSUInteger count, double percentile);
+
+// 所有测试的基类，提供每个测试独立的临时目录
+@interface SDTestCase : XCTestCase
+
+/**
+ * An empty directory created for the current test, removed in `tearDown`
+ */
+@property (nonatomic, copy, readonly, nonnull) NSString *temporaryDirectory;
+
+/**
+ * Data of the given length, different for each seed
+ */
+- (nonnull NSData *)dataWithLength:(NSUInteger)length seed:(uint8_t)seed;
+
+/**
+ * A PNG image of the given size, filled with one color
+ */
+- (nonnull NSData *)PNGDataWithWidth:(NSUInteger)width height:(NSUInteger)height;
+
+/**
+ * How much the physical memory footprint of the process grows at most while the block runs, in bytes, sampled every millisecond.
+ * The footprint is the resident memory the system limits, without clean pages mapped from files
+ */
+- (uint64_t)peakMemoryIncreaseDuringBlock:(nonnull dispatch_block_t)block;
+
+/**
+ * Print one result of a benchmark, prefixed with the name of the test
+ */
+- (void)reportBenchmark:(nonnull NSString *)name value:(double)value unit:(nonnull NSString *)unit;
+
+@end
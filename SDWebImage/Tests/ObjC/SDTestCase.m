@@ -0,0 +1,120 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDTestCase.h"
+#import <ImageIO/ImageIO.h>
+#import <mach/mach.h>
+#import <time.h>
+
+const NSTimeInterval kAsyncTestTimeout = 5;
+
+BOOL SDTestBenchmarkEnabled(void) {
+    return [NSProcessInfo processInfo].environment[@"SD_BENCHMARK"].boolValue;
+}
+
+NSTimeInterval SDTestNow(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static int SDTestCompareDoubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+double SDTestPercentile(double *samples, NSUInteger count, double percentile) {
+    if (count == 0) {
+        return 0;
+    }
+    qsort(samples, count, sizeof(double), SDTestCompareDoubles);
+    NSUInteger rank = (NSUInteger)ceil(percentile / 100 * count);
+    return samples[MIN(MAX(rank, 1u), count) - 1];
+}
+
+static uint64_t SDTestMemoryFootprint(void) {
+    task_vm_info_data_t info;
+    mach_msg_type_number_t count = TASK_VM_INFO_COUNT;
+    if (task_info(mach_task_self(), TASK_VM_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) {
+        return 0;
+    }
+    return info.phys_footprint;
+}
+
+@interface SDTestCase ()
+
+@property (nonatomic, copy, readwrite, nonnull) NSString *temporaryDirectory;
+
+@end
+
+@implementation SDTestCase
+
+- (void)setUp {
+    [super setUp];
+    NSString *name = [NSString stringWithFormat:@"SDWebImageTests-%@", [NSUUID UUID].UUIDString];
+    self.temporaryDirectory = [NSTemporaryDirectory() stringByAppendingPathComponent:name];
+    [[NSFileManager defaultManager] createDirectoryAtPath:self.temporaryDirectory withIntermediateDirectories:YES attributes:nil error:nil];
+}
+
+- (void)tearDown {
+    [[NSFileManager defaultManager] removeItemAtPath:self.temporaryDirectory error:nil];
+    [super tearDown];
+}
+
+- (nonnull NSData *)dataWithLength:(NSUInteger)length seed:(uint8_t)seed {
+    NSMutableData *data = [NSMutableData dataWithLength:length];
+    uint8_t *bytes = data.mutableBytes;
+    for (NSUInteger i = 0; i < length; i++) {
+        bytes[i] = (uint8_t)(i * 31 + seed);
+    }
+    return data;
+}
+
+- (nonnull NSData *)PNGDataWithWidth:(NSUInteger)width height:(NSUInteger)height {
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+    CGContextRef context = CGBitmapContextCreate(NULL, width, height, 8, 0, colorSpace, kCGImageAlphaPremultipliedLast);
+    CGColorSpaceRelease(colorSpace);
+    CGContextSetRGBFillColor(context, 0.2, 0.4, 0.6, 1);
+    CGContextFillRect(context, CGRectMake(0, 0, width, height));
+    CGImageRef image = CGBitmapContextCreateImage(context);
+    CGContextRelease(context);
+    NSMutableData *data = [NSMutableData data];
+    CGImageDestinationRef destination = CGImageDestinationCreateWithData((__bridge CFMutableDataRef)data, CFSTR("public.png"), 1, NULL);
+    CGImageDestinationAddImage(destination, image, NULL);
+    CGImageDestinationFinalize(destination);
+    CFRelease(destination);
+    CGImageRelease(image);
+    return data;
+}
+
+- (uint64_t)peakMemoryIncreaseDuringBlock:(nonnull dispatch_block_t)block {
+    uint64_t baseline = SDTestMemoryFootprint();
+    // 只在 queue 上访问
+    __block uint64_t peak = baseline;
+    dispatch_queue_t queue = dispatch_queue_create("com.hackemist.SDTestCase.memory", DISPATCH_QUEUE_SERIAL);
+    dispatch_source_t timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, queue);
+    dispatch_source_set_timer(timer, DISPATCH_TIME_NOW, NSEC_PER_MSEC, 0);
+    dispatch_source_set_event_handler(timer, ^{
+        peak = MAX(peak, SDTestMemoryFootprint());
+    });
+    dispatch_resume(timer);
+    block();
+    dispatch_sync(queue, ^{
+        peak = MAX(peak, SDTestMemoryFootprint());
+        dispatch_source_cancel(timer);
+    });
+    return peak - baseline;
+}
+
+- (void)reportBenchmark:(nonnull NSString *)name value:(double)value unit:(nonnull NSString *)unit {
+    // 和 C 的性能测试一样直接打印到标准输出，ctest --verbose 可以看到
+    printf("%s %s: %.3f %s\n", self.name.UTF8String, name.UTF8String, value, unit.UTF8String);
+    fflush(stdout);
+}
+
+@end
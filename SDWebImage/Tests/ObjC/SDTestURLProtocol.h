@@ -0,0 +1,72 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ * A canned response of `SDTestURLProtocol`
+ */
+@interface SDTestURLResponse : NSObject
+
+/**
+ * Defaults to 200
+ */
+@property (nonatomic, assign) NSInteger statusCode;
+@property (nonatomic, copy, nullable) NSDictionary<NSString *, NSString *> *headerFields;
+@property (nonatomic, copy, nullable) NSData *data;
+/**
+ * The data is sent in chunks of this size, in bytes. Defaults to 0, the data is sent at once.
+ */
+@property (nonatomic, assign) NSUInteger chunkLength;
+/**
+ * The request fails with this error after the data is sent
+ */
+@property (nonatomic, strong, nullable) NSError *error;
+/**
+ * The time before the response is sent, in seconds
+ */
+@property (nonatomic, assign) NSTimeInterval delay;
+
++ (nonnull instancetype)responseWithData:(nullable NSData *)data;
+
+@end
+
+typedef SDTestURLResponse * _Nonnull (^SDTestURLHandler)(NSURLRequest * _Nonnull request);
+
+// 不访问网络的 HTTP 服务器，用于测试下载器
+@interface SDTestURLProtocol : NSURLProtocol
+
+/**
+ * An ephemeral configuration loading every request with `SDTestURLProtocol`
+ */
++ (nonnull NSURLSessionConfiguration *)sessionConfiguration;
+
+/**
+ * Same as `sessionConfiguration`, storing the responses of requests not ignoring the local cache in `URLCache`.
+ * A cached response is revalidated with `If-None-Match` / `If-Modified-Since`, a 304 from the handler loads the cached response.
+ */
++ (nonnull NSURLSessionConfiguration *)sessionConfigurationWithURLCache:(nonnull NSURLCache *)URLCache;
+
+/**
+ * The handler answering the requests, called on a background thread. Requests get a 404 response without a handler.
+ */
++ (void)setHandler:(nullable SDTestURLHandler)handler;
+
+/**
+ * The requests received so far, in order
+ */
++ (nonnull NSArray<NSURLRequest *> *)requests;
+
++ (NSUInteger)requestCountForURL:(nonnull NSURL *)url;
+
+/**
+ * Remove the handler and forget the requests
+ */
++ (void)reset;
+
+@end
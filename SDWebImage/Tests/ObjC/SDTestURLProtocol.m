@@ -0,0 +1,178 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDTestURLProtocol.h"
+
+@implementation SDTestURLResponse
+
++ (nonnull instancetype)responseWithData:(nullable NSData *)data {
+    SDTestURLResponse *response = [self new];
+    response.data = data;
+    return response;
+}
+
+- (instancetype)init {
+    if ((self = [super init])) {
+        _statusCode = 200;
+    }
+    return self;
+}
+
+@end
+
+static SDTestURLHandler SDTestURLProtocolHandler;
+static NSMutableArray<NSURLRequest *> *SDTestURLProtocolRequests;
+
+static NSObject *SDTestURLProtocolLock(void) {
+    static NSObject *lock;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        lock = [NSObject new];
+        SDTestURLProtocolRequests = [NSMutableArray array];
+    });
+    return lock;
+}
+
+@interface SDTestURLProtocol ()
+
+// 客户端的回调要在 startLoading 所在的线程中执行
+@property (nonatomic, strong) NSThread *clientThread;
+@property (nonatomic, copy) NSArray<NSString *> *clientModes;
+@property (atomic, assign, getter=isStopped) BOOL stopped;
+
+@end
+
+@implementation SDTestURLProtocol
+
++ (nonnull NSURLSessionConfiguration *)sessionConfiguration {
+    NSURLSessionConfiguration *configuration = [NSURLSessionConfiguration ephemeralSessionConfiguration];
+    configuration.protocolClasses = @[self];
+    return configuration;
+}
+
++ (nonnull NSURLSessionConfiguration *)sessionConfigurationWithURLCache:(nonnull NSURLCache *)URLCache {
+    NSURLSessionConfiguration *configuration = [self sessionConfiguration];
+    configuration.URLCache = URLCache;
+    return configuration;
+}
+
++ (void)setHandler:(nullable SDTestURLHandler)handler {
+    @synchronized (SDTestURLProtocolLock()) {
+        SDTestURLProtocolHandler = [handler copy];
+    }
+}
+
++ (nonnull NSArray<NSURLRequest *> *)requests {
+    @synchronized (SDTestURLProtocolLock()) {
+        return [SDTestURLProtocolRequests copy];
+    }
+}
+
++ (NSUInteger)requestCountForURL:(nonnull NSURL *)url {
+    NSUInteger count = 0;
+    for (NSURLRequest *request in [self requests]) {
+        if ([request.URL isEqual:url]) {
+            count++;
+        }
+    }
+    return count;
+}
+
++ (void)reset {
+    @synchronized (SDTestURLProtocolLock()) {
+        SDTestURLProtocolHandler = nil;
+        [SDTestURLProtocolRequests removeAllObjects];
+    }
+}
+
++ (BOOL)canInitWithRequest:(NSURLRequest *)request {
+    return YES;
+}
+
++ (NSURLRequest *)canonicalRequestForRequest:(NSURLRequest *)request {
+    return request;
+}
+
+- (BOOL)usesCache {
+    return self.request.cachePolicy != NSURLRequestReloadIgnoringLocalCacheData;
+}
+
+// 有缓存的响应时和 HTTP 缓存一样发送条件请求
+- (NSURLRequest *)requestRevalidatingCachedResponse {
+    if (![self usesCache] || ![self.cachedResponse.response isKindOfClass:[NSHTTPURLResponse class]]) {
+        return self.request;
+    }
+    NSDictionary *cachedHeaderFields = ((NSHTTPURLResponse *)self.cachedResponse.response).allHeaderFields;
+    NSMutableURLRequest *request = [self.request mutableCopy];
+    if (cachedHeaderFields[@"ETag"]) {
+        [request setValue:cachedHeaderFields[@"ETag"] forHTTPHeaderField:@"If-None-Match"];
+    }
+    if (cachedHeaderFields[@"Last-Modified"]) {
+        [request setValue:cachedHeaderFields[@"Last-Modified"] forHTTPHeaderField:@"If-Modified-Since"];
+    }
+    return request;
+}
+
+- (void)startLoading {
+    SDTestURLHandler handler;
+    NSURLRequest *request = [self requestRevalidatingCachedResponse];
+    @synchronized (SDTestURLProtocolLock()) {
+        handler = SDTestURLProtocolHandler;
+        [SDTestURLProtocolRequests addObject:request];
+    }
+    self.clientThread = [NSThread currentThread];
+    NSString *mode = [NSRunLoop currentRunLoop].currentMode;
+    self.clientModes = mode ? @[mode] : @[NSDefaultRunLoopMode];
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        SDTestURLResponse *response;
+        if (handler) {
+            response = handler(request);
+        } else {
+            response = [SDTestURLResponse responseWithData:nil];
+            response.statusCode = 404;
+        }
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(response.delay * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            [self performSelector:@selector(sendResponse:) onThread:self.clientThread withObject:response waitUntilDone:NO modes:self.clientModes];
+        });
+    });
+}
+
+- (void)sendResponse:(SDTestURLResponse *)response {
+    if (self.isStopped) {
+        return;
+    }
+    if (response.statusCode == 304 && [self usesCache] && self.cachedResponse) {
+        // 304 时加载缓存的响应
+        [self.client URLProtocol:self didReceiveResponse:self.cachedResponse.response cacheStoragePolicy:NSURLCacheStorageNotAllowed];
+        [self.client URLProtocol:self didLoadData:self.cachedResponse.data];
+        [self.client URLProtocolDidFinishLoading:self];
+        return;
+    }
+    NSMutableDictionary<NSString *, NSString *> *headerFields = [NSMutableDictionary dictionaryWithDictionary:response.headerFields ?: @{}];
+    if (!headerFields[@"Content-Length"] && !response.error) {
+        headerFields[@"Content-Length"] = [NSString stringWithFormat:@"%lu", (unsigned long)response.data.length];
+    }
+    NSHTTPURLResponse *URLResponse = [[NSHTTPURLResponse alloc] initWithURL:self.request.URL statusCode:response.statusCode HTTPVersion:@"HTTP/1.1" headerFields:headerFields];
+    [self.client URLProtocol:self didReceiveResponse:URLResponse cacheStoragePolicy:[self usesCache] ? NSURLCacheStorageAllowed : NSURLCacheStorageNotAllowed];
+    NSUInteger length = response.data.length;
+    NSUInteger chunkLength = response.chunkLength > 0 ? response.chunkLength : length;
+    for (NSUInteger offset = 0; offset < length; offset += chunkLength) {
+        [self.client URLProtocol:self didLoadData:[response.data subdataWithRange:NSMakeRange(offset, MIN(chunkLength, length - offset))]];
+    }
+    if (response.error) {
+        [self.client URLProtocol:self didFailWithError:response.error];
+    } else {
+        [self.client URLProtocolDidFinishLoading:self];
+    }
+}
+
+- (void)stopLoading {
+    self.stopped = YES;
+}
+
+@end
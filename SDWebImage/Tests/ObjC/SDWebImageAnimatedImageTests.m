@@ -0,0 +1,286 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#ifdef SD_WEBP
+
+#import "SDTestCase.h"
+#import "SDWebImageAnimatedImage.h"
+#import "SDWebImageWebPCoder.h"
+#import "NSImage+WebCache.h"
+#if __has_include(<webp/encode.h>) && __has_include(<webp/mux.h>)
+#import <webp/encode.h>
+#import <webp/mux.h>
+#else
+#import "webp/encode.h"
+#import "webp/mux.h"
+#endif
+
+static const int kCanvasWidth = 64;
+static const int kCanvasHeight = 48;
+static const NSUInteger kFrameCount = 24;
+
+@interface SDWebImageWebPFrameSource : NSObject <SDWebImageAnimatedImageFrameSource>
+
+- (nullable instancetype)initWithData:(nonnull NSData *)data coder:(nonnull SDWebImageWebPCoder *)coder;
+
+@end
+
+@interface SDWebImageAnimatedImageTests : SDTestCase
+
+@property (nonatomic, copy) NSData *animatedWebPData;
+// 按顺序合成的每一帧的像素，作为其他解码顺序的参照
+@property (nonatomic, copy) NSArray<NSData *> *sequentialFrames;
+
+@end
+
+@implementation SDWebImageAnimatedImageTests
+
+- (void)setUp {
+    [super setUp];
+    self.animatedWebPData = [self animatedWebPDataWithFrameCount:kFrameCount];
+    XCTAssertNotNil(self.animatedWebPData);
+    SDWebImageWebPFrameSource *frameSource = [self frameSource];
+    XCTAssertEqual(frameSource.animatedImageFrameCount, kFrameCount);
+    NSMutableArray<NSData *> *frames = [NSMutableArray arrayWithCapacity:kFrameCount];
+    for (NSUInteger i = 0; i < kFrameCount; i++) {
+        NSData *pixels = [self pixelsOfImage:[frameSource animatedImageFrameAtIndex:i]];
+        XCTAssertNotNil(pixels);
+        [frames addObject:pixels ?: [NSData data]];
+    }
+    self.sequentialFrames = frames;
+}
+
+- (SDWebImageWebPFrameSource *)frameSource {
+    return [[SDWebImageWebPFrameSource alloc] initWithData:self.animatedWebPData coder:[SDWebImageWebPCoder sharedCoder]];
+}
+
+- (NSData *)animatedWebPDataWithFrameCount:(NSUInteger)frameCount {
+    return [self animatedWebPDataWithWidth:kCanvasWidth height:kCanvasHeight frameCount:frameCount];
+}
+
+// 透明背景上移动的方块和半透明的横条，编码器会生成局部的、需要混合的帧；kmin/kmax 让关键帧之间隔着几个非关键帧
+- (NSData *)animatedWebPDataWithWidth:(int)width height:(int)height frameCount:(NSUInteger)frameCount {
+    WebPAnimEncoderOptions options;
+    if (!WebPAnimEncoderOptionsInit(&options)) {
+        return nil;
+    }
+    options.kmin = 3;
+    options.kmax = 6;
+    WebPAnimEncoder *encoder = WebPAnimEncoderNew(width, height, &options);
+    WebPConfig config;
+    if (!encoder || !WebPConfigInit(&config)) {
+        WebPAnimEncoderDelete(encoder);
+        return nil;
+    }
+    config.lossless = 1;
+    uint8_t *rgba = calloc((size_t)width * height, 4);
+    int timestamp = 0;
+    BOOL success = YES;
+    for (NSUInteger i = 0; i < frameCount && success; i++) {
+        memset(rgba, 0, (size_t)width * height * 4);
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                uint8_t *pixel = rgba + ((size_t)y * width + x) * 4;
+                int squareX = (int)(i * 3) % (width - 12);
+                if (x >= squareX && x < squareX + 12 && y >= 16 && y < 28) {
+                    pixel[0] = 0xFF;
+                    pixel[1] = (uint8_t)(i * 10);
+                    pixel[2] = 0x20;
+                    pixel[3] = 0xFF;
+                } else if (y < 8 && i % 8 < 4) {
+                    pixel[0] = 0x10;
+                    pixel[1] = 0x80;
+                    pixel[2] = 0xF0;
+                    pixel[3] = 0x80;
+                }
+            }
+        }
+        WebPPicture picture;
+        if (!WebPPictureInit(&picture)) {
+            success = NO;
+            break;
+        }
+        picture.use_argb = 1;
+        picture.width = width;
+        picture.height = height;
+        success = WebPPictureImportRGBA(&picture, rgba, width * 4) &&
+                  WebPAnimEncoderAdd(encoder, &picture, timestamp, &config);
+        WebPPictureFree(&picture);
+        timestamp += 40 + (int)(i % 3) * 20;
+    }
+    free(rgba);
+    NSData *data = nil;
+    WebPData webpData;
+    WebPDataInit(&webpData);
+    if (success && WebPAnimEncoderAdd(encoder, NULL, timestamp, NULL) && WebPAnimEncoderAssemble(encoder, &webpData)) {
+        data = [NSData dataWithBytes:webpData.bytes length:webpData.size];
+    }
+    WebPDataClear(&webpData);
+    WebPAnimEncoderDelete(encoder);
+    return data;
+}
+
+// 画到同样格式的位图中再比较，和 CGImage 的内部格式无关
+- (NSData *)pixelsOfImage:(UIImage *)image {
+    CGImageRef imageRef = image.CGImage;
+    if (!imageRef) {
+        return nil;
+    }
+    size_t width = CGImageGetWidth(imageRef);
+    size_t height = CGImageGetHeight(imageRef);
+    NSMutableData *pixels = [NSMutableData dataWithLength:width * height * 4];
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+    CGContextRef context = CGBitmapContextCreate(pixels.mutableBytes, width, height, 8, width * 4, colorSpace, kCGBitmapByteOrder32Big | kCGImageAlphaPremultipliedLast);
+    CGColorSpaceRelease(colorSpace);
+    if (!context) {
+        return nil;
+    }
+    CGContextSetBlendMode(context, kCGBlendModeCopy);
+    CGContextDrawImage(context, CGRectMake(0, 0, width, height), imageRef);
+    CGContextRelease(context);
+    return pixels;
+}
+
+- (void)assertFrame:(UIImage *)frame atIndex:(NSUInteger)index {
+    XCTAssertNotNil(frame, @"frame %lu", (unsigned long)index);
+    XCTAssertEqualObjects([self pixelsOfImage:frame], self.sequentialFrames[index], @"frame %lu", (unsigned long)index);
+}
+
+- (void)test01SeekMatchesSequentialRendering {
+    // 倒序、跳跃和重复的访问都需要从关键帧重新合成，或者接着画布上的帧合成
+    NSMutableArray<NSNumber *> *order = [NSMutableArray array];
+    for (NSUInteger i = kFrameCount; i > 0; i--) {
+        [order addObject:@(i - 1)];
+    }
+    [order addObjectsFromArray:@[@5, @5, @17, @4, @6, @23, @0, @12, @13, @11, @22, @1]];
+    SDWebImageWebPFrameSource *frameSource = [self frameSource];
+    for (NSNumber *index in order) {
+        [self assertFrame:[frameSource animatedImageFrameAtIndex:index.unsignedIntegerValue] atIndex:index.unsignedIntegerValue];
+    }
+    XCTAssertNil([frameSource animatedImageFrameAtIndex:kFrameCount]);
+}
+
+- (void)test02RandomSeekMatchesSequentialRendering {
+    SDWebImageWebPFrameSource *frameSource = [self frameSource];
+    srand48(21);
+    for (NSUInteger i = 0; i < 200; i++) {
+        NSUInteger index = (NSUInteger)(drand48() * kFrameCount);
+        [self assertFrame:[frameSource animatedImageFrameAtIndex:index] atIndex:index];
+    }
+}
+
+- (void)test03AnimatedImageFramesWithASmallBuffer {
+    SDWebImageAnimatedImage *image = [[SDWebImageAnimatedImage alloc] initWithFrameSource:[self frameSource]];
+    XCTAssertNotNil(image);
+    XCTAssertEqual(image.animatedImageFrameCount, kFrameCount);
+    image.maxBufferedFrameCount = 2;
+    XCTAssertEqual(image.maxBufferedFrameCount, 2u);
+    // 播放两遍，中间跳到别的帧；后台预取和同步解码交替进行
+    for (NSUInteger loop = 0; loop < 2; loop++) {
+        for (NSUInteger i = 0; i < kFrameCount; i++) {
+            [self assertFrame:[image animatedImageFrameAtIndex:i] atIndex:i];
+        }
+        [self assertFrame:[image animatedImageFrameAtIndex:15] atIndex:15];
+        [self assertFrame:[image animatedImageFrameAtIndex:3] atIndex:3];
+    }
+    // 预取的帧最终都会进入缓冲区
+    UIImage *buffered = nil;
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:kAsyncTestTimeout];
+    while (!(buffered = [image bufferedAnimatedImageFrameAtIndex:4]) && [deadline timeIntervalSinceNow] > 0) {
+        [NSThread sleepForTimeInterval:0.01];
+    }
+    [self assertFrame:buffered atIndex:4];
+    [image clearBufferedFrames];
+    [self assertFrame:[image animatedImageFrameAtIndex:0] atIndex:0];
+}
+
+- (void)test04DurationsAndLoopCount {
+    SDWebImageAnimatedImage *image = [[SDWebImageAnimatedImage alloc] initWithFrameSource:[self frameSource]];
+    XCTAssertEqual(image.animatedImageLoopCount, 0u);
+    for (NSUInteger i = 0; i + 1 < kFrameCount; i++) {
+        XCTAssertEqualWithAccuracy([image animatedImageDurationAtIndex:i], (40 + (i % 3) * 20) / 1000.0, 0.001);
+    }
+    XCTAssertEqual([image animatedImageDurationAtIndex:kFrameCount], 0);
+}
+
+- (void)test05SequentialPlaybackPerformance {
+    SDWebImageWebPFrameSource *frameSource = [self frameSource];
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < kFrameCount * 4; i++) {
+            [frameSource animatedImageFrameAtIndex:i % kFrameCount];
+        }
+    }];
+}
+
+- (void)test06RandomSeekPerformance {
+    SDWebImageWebPFrameSource *frameSource = [self frameSource];
+    [self measureBlock:^{
+        srand48(21);
+        for (NSUInteger i = 0; i < kFrameCount * 4; i++) {
+            [frameSource animatedImageFrameAtIndex:(NSUInteger)(drand48() * kFrameCount)];
+        }
+    }];
+}
+
+// 640x480、60 帧的动画，一次解码所有帧和按需解码播放两遍，比较峰值内存和每秒解码的帧数
+- (void)test07PeakMemoryAndFrameRateBenchmark {
+    if (!SDTestBenchmarkEnabled()) {
+        return;
+    }
+    const int width = 640;
+    const int height = 480;
+    const NSUInteger frameCount = 60;
+    NSData *data = [self animatedWebPDataWithWidth:width height:height frameCount:frameCount];
+    XCTAssertNotNil(data);
+    [self reportBenchmark:@"canvas" value:width * height * 4 / 1e6 unit:@"MB"];
+
+    SDWebImageWebPCoder *coder = [SDWebImageWebPCoder new];
+    __block NSTimeInterval time = 0;
+    uint64_t peakMemory = [self peakMemoryIncreaseDuringBlock:^{
+        @autoreleasepool {
+            NSTimeInterval start = SDTestNow();
+            UIImage *image = [coder decodedImageWithData:data];
+            time = SDTestNow() - start;
+            XCTAssertNotNil(image);
+        }
+    }];
+    [self reportBenchmark:@"all frames peak memory" value:peakMemory / 1e6 unit:@"MB"];
+    [self reportBenchmark:@"all frames decode rate" value:frameCount / time unit:@"frames/s"];
+
+    coder.decodesAnimatedImagesOnDemand = YES;
+    peakMemory = [self peakMemoryIncreaseDuringBlock:^{
+        @autoreleasepool {
+            SDWebImageAnimatedImage *image = (SDWebImageAnimatedImage *)[coder decodedImageWithData:data];
+            XCTAssertTrue([image isKindOfClass:[SDWebImageAnimatedImage class]]);
+            NSTimeInterval start = SDTestNow();
+            for (NSUInteger i = 0; i < frameCount * 2; i++) {
+                @autoreleasepool {
+                    XCTAssertNotNil([image animatedImageFrameAtIndex:i % frameCount]);
+                }
+            }
+            time = SDTestNow() - start;
+        }
+    }];
+    [self reportBenchmark:@"on demand peak memory" value:peakMemory / 1e6 unit:@"MB"];
+    [self reportBenchmark:@"on demand playback rate" value:frameCount * 2 / time unit:@"frames/s"];
+
+    // 随机跳转需要从关键帧重新合成
+    SDWebImageWebPFrameSource *frameSource = [[SDWebImageWebPFrameSource alloc] initWithData:data coder:coder];
+    srand48(21);
+    NSTimeInterval start = SDTestNow();
+    for (NSUInteger i = 0; i < frameCount * 2; i++) {
+        @autoreleasepool {
+            [frameSource animatedImageFrameAtIndex:(NSUInteger)(drand48() * frameCount)];
+        }
+    }
+    [self reportBenchmark:@"random seek rate" value:frameCount * 2 / (SDTestNow() - start) unit:@"frames/s"];
+}
+
+@end
+
+#endif
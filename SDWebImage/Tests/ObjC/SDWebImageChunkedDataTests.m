@@ -0,0 +1,274 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDTestCase.h"
+#import "SDWebImageChunkedData.h"
+#import "SDWebImageImageIOCoder.h"
+#import <ImageIO/ImageIO.h>
+#import <sys/resource.h>
+
+// 模拟的网络带宽，用来计算部分图片的间隔
+static const double kReplayBandwidth = 2 * 1024 * 1024;
+
+static NSTimeInterval SDProcessCPUTime(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+@interface SDWebImageChunkedDataTests : SDTestCase
+
+@end
+
+@implementation SDWebImageChunkedDataTests
+
+// 大小不一的数据块，包括只有一个字节的块
+- (SDWebImageChunkedData *)chunkedDataWithContiguousData:(NSMutableData *)contiguousData {
+    static const NSUInteger chunkLengths[] = {1, 7, 64, 1, 1, 130, 3, 50, 2, 40};
+    SDWebImageChunkedData *chunkedData = [SDWebImageChunkedData new];
+    for (NSUInteger i = 0; i < sizeof(chunkLengths) / sizeof(chunkLengths[0]); i++) {
+        NSData *chunk = [self dataWithLength:chunkLengths[i] seed:(uint8_t)(i * 17)];
+        [chunkedData appendData:chunk];
+        [contiguousData appendData:chunk];
+    }
+    return chunkedData;
+}
+
+- (void)test01GetBytesAcrossChunkBoundaries {
+    NSMutableData *contiguousData = [NSMutableData data];
+    SDWebImageChunkedData *chunkedData = [self chunkedDataWithContiguousData:contiguousData];
+    const NSUInteger length = contiguousData.length;
+    XCTAssertEqual(chunkedData.length, length);
+    uint8_t *buffer = malloc(length);
+    // 每个起点和长度的组合都和连续的数据一致
+    for (NSUInteger location = 0; location < length; location++) {
+        for (NSUInteger count = 1; location + count <= length; count++) {
+            memset(buffer, 0xAA, length);
+            NSUInteger copied = [chunkedData getBytes:buffer range:NSMakeRange(location, count)];
+            if (copied != count || memcmp(buffer, (const uint8_t *)contiguousData.bytes + location, count) != 0) {
+                XCTFail(@"Wrong bytes in range {%lu, %lu}", (unsigned long)location, (unsigned long)count);
+                free(buffer);
+                return;
+            }
+        }
+    }
+    free(buffer);
+}
+
+- (void)test02RangesPastTheEnd {
+    NSMutableData *contiguousData = [NSMutableData data];
+    SDWebImageChunkedData *chunkedData = [self chunkedDataWithContiguousData:contiguousData];
+    const NSUInteger length = contiguousData.length;
+    uint8_t buffer[16];
+    XCTAssertEqual([chunkedData getBytes:buffer range:NSMakeRange(length - 4, sizeof(buffer))], 4);
+    XCTAssertEqual(memcmp(buffer, (const uint8_t *)contiguousData.bytes + length - 4, 4), 0);
+    XCTAssertEqual([chunkedData getBytes:buffer range:NSMakeRange(length, sizeof(buffer))], 0);
+    XCTAssertEqual([chunkedData getBytes:buffer range:NSMakeRange(length + 100, sizeof(buffer))], 0);
+    XCTAssertEqual([[SDWebImageChunkedData new] getBytes:buffer range:NSMakeRange(0, sizeof(buffer))], 0);
+}
+
+- (void)test03EmptyChunksAreIgnored {
+    SDWebImageChunkedData *chunkedData = [SDWebImageChunkedData new];
+    [chunkedData appendData:[NSData data]];
+    XCTAssertEqual(chunkedData.length, 0);
+    XCTAssertEqualObjects(chunkedData.data, [NSData data]);
+    [chunkedData appendData:[self dataWithLength:10 seed:1]];
+    [chunkedData appendData:[NSData data]];
+    XCTAssertEqual(chunkedData.length, 10);
+    XCTAssertEqualObjects(chunkedData.data, [self dataWithLength:10 seed:1]);
+}
+
+- (void)test04PrefixAndMergedData {
+    NSMutableData *contiguousData = [NSMutableData data];
+    SDWebImageChunkedData *chunkedData = [self chunkedDataWithContiguousData:contiguousData];
+    XCTAssertEqualObjects([chunkedData prefixDataWithLength:75], [contiguousData subdataWithRange:NSMakeRange(0, 75)]);
+    XCTAssertEqualObjects([chunkedData prefixDataWithLength:contiguousData.length + 10], contiguousData);
+    NSData *merged = chunkedData.data;
+    XCTAssertEqualObjects(merged, contiguousData);
+    // 没有追加数据时复用合并后的数据
+    XCTAssertEqual(chunkedData.data, merged);
+    // 合并之后继续追加，边界仍然正确
+    NSData *tail = [self dataWithLength:33 seed:99];
+    [chunkedData appendData:tail];
+    [contiguousData appendData:tail];
+    uint8_t buffer[40];
+    NSRange range = NSMakeRange(merged.length - 7, sizeof(buffer));
+    XCTAssertEqual([chunkedData getBytes:buffer range:range], sizeof(buffer));
+    XCTAssertEqual(memcmp(buffer, (const uint8_t *)contiguousData.bytes + range.location, sizeof(buffer)), 0);
+    XCTAssertEqualObjects(chunkedData.data, contiguousData);
+}
+
+- (void)test05DataProviderReadsOnDemand {
+    NSMutableData *contiguousData = [NSMutableData data];
+    SDWebImageChunkedData *chunkedData = [self chunkedDataWithContiguousData:contiguousData];
+    const NSUInteger length = contiguousData.length;
+    CGDataProviderRef provider = [chunkedData newDataProviderWithLength:length - 5];
+    XCTAssertTrue(provider != NULL);
+    // 之后追加的数据不影响已经创建的 provider
+    [chunkedData appendData:[self dataWithLength:100 seed:5]];
+    CFDataRef providerData = CGDataProviderCopyData(provider);
+    XCTAssertEqualObjects((__bridge NSData *)providerData, [contiguousData subdataWithRange:NSMakeRange(0, length - 5)]);
+    CFRelease(providerData);
+    CGDataProviderRelease(provider);
+
+    // 长度超过已有的数据时只读取已有的数据
+    provider = [chunkedData newDataProviderWithLength:NSUIntegerMax];
+    providerData = CGDataProviderCopyData(provider);
+    XCTAssertEqual(CFDataGetLength(providerData), (CFIndex)(length + 100));
+    CFRelease(providerData);
+    CGDataProviderRelease(provider);
+}
+
+- (void)test06ConcurrentAppendAndRead {
+    const size_t chunkCount = 1000;
+    SDWebImageChunkedData *chunkedData = [SDWebImageChunkedData new];
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_group_async(group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        for (size_t i = 0; i < chunkCount; i++) {
+            // 第 i 个数据块的每个字节都是 i % 256
+            NSMutableData *chunk = [NSMutableData dataWithLength:(i % 7) + 1];
+            memset(chunk.mutableBytes, (int)(i % 256), chunk.length);
+            [chunkedData appendData:chunk];
+        }
+    });
+    dispatch_apply(4, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t reader) {
+        uint8_t buffer[64];
+        for (size_t i = 0; i < 2000; i++) {
+            NSUInteger length = chunkedData.length;
+            NSUInteger location = length > 0 ? arc4random_uniform((uint32_t)length) : 0;
+            NSUInteger copied = [chunkedData getBytes:buffer range:NSMakeRange(location, sizeof(buffer))];
+            XCTAssertLessThanOrEqual(copied, sizeof(buffer));
+        }
+    });
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    NSUInteger expectedLength = 0;
+    for (size_t i = 0; i < chunkCount; i++) {
+        expectedLength += (i % 7) + 1;
+    }
+    XCTAssertEqual(chunkedData.length, expectedLength);
+    const uint8_t *bytes = chunkedData.data.bytes;
+    NSUInteger position = 0;
+    for (size_t i = 0; i < chunkCount; i++) {
+        for (size_t j = 0; j < (i % 7) + 1; j++) {
+            XCTAssertEqual(bytes[position++], (uint8_t)(i % 256));
+        }
+    }
+}
+
+#pragma mark - Benchmark
+
+// 3000 x 2000 的渐进式 JPEG，有噪点，几 MB 大小
+- (NSData *)progressiveJPEGData {
+    const size_t width = 3000, height = 2000;
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+    CGContextRef context = CGBitmapContextCreate(NULL, width, height, 8, width * 4, colorSpace, kCGImageAlphaNoneSkipLast);
+    CGColorSpaceRelease(colorSpace);
+    uint8_t *pixels = CGBitmapContextGetData(context);
+    uint32_t state = 1;
+    for (size_t i = 0; i < width * height; i++) {
+        state = state * 1103515245u + 12345u;
+        pixels[i * 4] = (uint8_t)(i % width * 255 / width + (state >> 28));
+        pixels[i * 4 + 1] = (uint8_t)(i / width * 255 / height + (state >> 24 & 15));
+        pixels[i * 4 + 2] = (uint8_t)(state >> 16);
+    }
+    CGImageRef image = CGBitmapContextCreateImage(context);
+    CGContextRelease(context);
+    NSMutableData *data = [NSMutableData data];
+    CGImageDestinationRef destination = CGImageDestinationCreateWithData((__bridge CFMutableDataRef)data, CFSTR("public.jpeg"), 1, NULL);
+    NSDictionary *properties = @{(__bridge NSString *)kCGImageDestinationLossyCompressionQuality: @0.9,
+                                 (__bridge NSString *)kCGImagePropertyJFIFDictionary: @{(__bridge NSString *)kCGImagePropertyJFIFIsProgressive: @YES}};
+    CGImageDestinationAddImage(destination, image, (__bridge CFDictionaryRef)properties);
+    CGImageDestinationFinalize(destination);
+    CFRelease(destination);
+    CGImageRelease(image);
+    return data;
+}
+
+// 按照常见的 URLSession 数据块大小切分响应
+- (NSArray<NSData *> *)chunksOfResponse:(NSData *)response {
+    static const NSUInteger chunkLengths[] = {16384, 32768, 5792, 65536, 8192, 1448, 24576};
+    NSMutableArray<NSData *> *chunks = [NSMutableArray array];
+    NSUInteger location = 0;
+    for (NSUInteger i = 0; location < response.length; i++) {
+        NSUInteger length = MIN(chunkLengths[i % (sizeof(chunkLengths) / sizeof(chunkLengths[0]))], response.length - location);
+        // 和 URLSession 一样，每个数据块是单独的对象
+        [chunks addObject:[NSData dataWithBytes:(const uint8_t *)response.bytes + location length:length]];
+        location += length;
+    }
+    return chunks;
+}
+
+- (void)reportReplay:(NSString *)name bytesCopied:(unsigned long long)bytesCopied renders:(NSUInteger)renders cpuTime:(NSTimeInterval)cpuTime {
+    [self reportBenchmark:[name stringByAppendingString:@" bytes copied"] value:bytesCopied / 1e6 unit:@"MB"];
+    [self reportBenchmark:[name stringByAppendingString:@" partial renders"] value:renders unit:@""];
+    [self reportBenchmark:[name stringByAppendingString:@" CPU time"] value:cpuTime * 1000 unit:@"ms"];
+}
+
+// 数据块按引用保存，只把新的数据交给解码器，解码器通过 CGDataProvider 读取，没有整体拷贝。
+// renderInterval 按模拟的网络时间限制部分图片的频率，0 时每个数据块都生成部分图片
+- (void)replayChunks:(NSArray<NSData *> *)chunks length:(NSUInteger)length renderInterval:(NSTimeInterval)renderInterval name:(NSString *)name {
+    NSUInteger renders = 0;
+    NSTimeInterval start = SDProcessCPUTime();
+    @autoreleasepool {
+        SDWebImageChunkedData *imageData = [SDWebImageChunkedData new];
+        SDWebImageImageIOCoder *coder = [SDWebImageImageIOCoder new];
+        NSTimeInterval lastRenderTime = -renderInterval;
+        for (NSData *chunk in chunks) {
+            @autoreleasepool {
+                [imageData appendData:chunk];
+                [coder appendIncrementalData:chunk];
+                BOOL finished = imageData.length == length;
+                NSTimeInterval networkTime = imageData.length / kReplayBandwidth;
+                if (finished || networkTime - lastRenderTime >= renderInterval) {
+                    lastRenderTime = networkTime;
+                    [coder incrementallyDecodedImageWithFinished:finished];
+                    renders++;
+                }
+            }
+        }
+    }
+    [self reportReplay:name bytesCopied:0 renders:renders cpuTime:SDProcessCPUTime() - start];
+}
+
+// 回放一次渐进式下载。以前每个数据块都追加到 NSMutableData，拷贝全部数据再解码
+- (void)test07ProgressiveDownloadReplayBenchmark {
+    if (!SDTestBenchmarkEnabled()) {
+        return;
+    }
+    // 设置 SD_PROGRESSIVE_RESPONSE 时回放保存的响应
+    NSString *responsePath = [NSProcessInfo processInfo].environment[@"SD_PROGRESSIVE_RESPONSE"];
+    NSData *response = responsePath ? [NSData dataWithContentsOfFile:responsePath] : [self progressiveJPEGData];
+    XCTAssertNotNil(response, @"%@", responsePath);
+    NSArray<NSData *> *chunks = [self chunksOfResponse:response ?: [NSData data]];
+    [self reportBenchmark:@"response size" value:response.length / 1e6 unit:@"MB"];
+    [self reportBenchmark:@"chunks" value:chunks.count unit:@""];
+
+    unsigned long long bytesCopied = 0;
+    NSUInteger renders = 0;
+    NSTimeInterval start = SDProcessCPUTime();
+    @autoreleasepool {
+        NSMutableData *imageData = [NSMutableData data];
+        SDWebImageImageIOCoder *coder = [SDWebImageImageIOCoder new];
+        for (NSData *chunk in chunks) {
+            @autoreleasepool {
+                [imageData appendData:chunk];
+                NSData *copy = [imageData copy];
+                bytesCopied += chunk.length + copy.length;
+                [coder incrementallyDecodedImageWithData:copy finished:imageData.length == response.length];
+                renders++;
+            }
+        }
+    }
+    [self reportReplay:@"contiguous copy" bytesCopied:bytesCopied renders:renders cpuTime:SDProcessCPUTime() - start];
+
+    // 同样每个数据块都生成部分图片，只比较拷贝；再按 SDWebImageDownloader 默认的 0.1 秒间隔限制
+    [self replayChunks:chunks length:response.length renderInterval:0 name:@"chunked, every chunk"];
+    [self replayChunks:chunks length:response.length renderInterval:0.1 name:@"chunked, throttled"];
+}
+
+@end
@@ -0,0 +1,145 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDTestCase.h"
+#import "SDWebImageCoder.h"
+#import "SDWebImageCodersManager.h"
+#import "SDWebImageImageIOCoder.h"
+#import <ImageIO/ImageIO.h>
+
+// SDWebImageCoderScaleDownLargeImagesKey 的像素预算：60MB 的 4 字节像素
+static const double kScaleDownPixelBudget = 60.0 * 1024 * 1024 / 4;
+
+@interface SDWebImageDecodeDownsampleTests : SDTestCase
+
+@end
+
+@implementation SDWebImageDecodeDownsampleTests
+
+- (NSUInteger)maxPixelSizeForWidth:(size_t)width height:(size_t)height maxPixelSize:(nullable NSNumber *)maxPixelSize scaleDown:(BOOL)scaleDown {
+    NSMutableDictionary<NSString *, NSObject *> *options = [NSMutableDictionary dictionary];
+    options[SDWebImageCoderDecodeMaxPixelSizeKey] = maxPixelSize;
+    options[SDWebImageCoderScaleDownLargeImagesKey] = @(scaleDown);
+    return SDImageDecodeMaxPixelSize(width, height, options);
+}
+
+// 缩小后的尺寸：较长的一边缩到 maxPixelSize，另一边按同一比例
+- (CGSize)scaledSizeForWidth:(size_t)width height:(size_t)height maxPixelSize:(NSUInteger)maxPixelSize {
+    double scale = (double)maxPixelSize / MAX(width, height);
+    return CGSizeMake(round(width * scale), round(height * scale));
+}
+
+// 用 ImageIO 编码的 JPEG，可以带 EXIF 方向
+- (NSData *)JPEGDataWithWidth:(NSUInteger)width height:(NSUInteger)height orientation:(NSInteger)orientation {
+    CGContextRef context = CGBitmapContextCreate(NULL, width, height, 8, 0, SDCGColorSpaceGetDeviceRGB(), kCGImageAlphaNoneSkipLast);
+    CGContextSetRGBFillColor(context, 0.8, 0.3, 0.1, 1);
+    CGContextFillRect(context, CGRectMake(0, 0, width, height));
+    CGImageRef image = CGBitmapContextCreateImage(context);
+    CGContextRelease(context);
+    NSMutableData *data = [NSMutableData data];
+    CGImageDestinationRef destination = CGImageDestinationCreateWithData((__bridge CFMutableDataRef)data, CFSTR("public.jpeg"), 1, NULL);
+    NSDictionary *properties = @{(__bridge NSString *)kCGImagePropertyOrientation : @(orientation)};
+    CGImageDestinationAddImage(destination, image, (__bridge CFDictionaryRef)properties);
+    CGImageDestinationFinalize(destination);
+    CFRelease(destination);
+    CGImageRelease(image);
+    return data;
+}
+
+- (void)test01NoOptionsDecodeAtFullSize {
+    XCTAssertEqual(SDImageDecodeMaxPixelSize(8000, 6000, nil), 0u);
+    XCTAssertEqual(SDImageDecodeMaxPixelSize(8000, 6000, @{}), 0u);
+    XCTAssertEqual([self maxPixelSizeForWidth:0 height:0 maxPixelSize:@100 scaleDown:YES], 0u);
+    // 不是 NSNumber 的值被忽略
+    XCTAssertEqual(SDImageDecodeMaxPixelSize(8000, 6000, @{SDWebImageCoderDecodeMaxPixelSizeKey : @"100"}), 0u);
+    XCTAssertEqual(SDImageDecodeMaxPixelSize(8000, 6000, @{SDWebImageCoderScaleDownLargeImagesKey : @"YES"}), 0u);
+}
+
+- (void)test02MaxPixelSizeLimitsTheLongerSide {
+    XCTAssertEqual([self maxPixelSizeForWidth:4000 height:3000 maxPixelSize:@1000 scaleDown:NO], 1000u);
+    XCTAssertEqual([self maxPixelSizeForWidth:3000 height:4000 maxPixelSize:@1000 scaleDown:NO], 1000u);
+    XCTAssertEqual([self maxPixelSizeForWidth:4000 height:3000 maxPixelSize:@3999 scaleDown:NO], 3999u);
+    // 不比原图小时按原始大小解码
+    XCTAssertEqual([self maxPixelSizeForWidth:4000 height:3000 maxPixelSize:@4000 scaleDown:NO], 0u);
+    XCTAssertEqual([self maxPixelSizeForWidth:4000 height:3000 maxPixelSize:@10000 scaleDown:NO], 0u);
+    XCTAssertEqual([self maxPixelSizeForWidth:4000 height:3000 maxPixelSize:@0 scaleDown:NO], 0u);
+}
+
+- (void)test03ScaleDownKeepsThePixelBudget {
+    // 不超过预算的图片不缩小
+    XCTAssertEqual([self maxPixelSizeForWidth:4000 height:3000 maxPixelSize:nil scaleDown:YES], 0u);
+    XCTAssertEqual([self maxPixelSizeForWidth:4096 height:3840 maxPixelSize:nil scaleDown:YES], 0u);
+    XCTAssertEqual([self maxPixelSizeForWidth:8000 height:6000 maxPixelSize:nil scaleDown:NO], 0u);
+
+    // 40、100 百万像素和极端的宽高比：缩小后不超过预算，再大一个像素就超过
+    size_t sizes[][2] = {{8000, 6000}, {6000, 8000}, {7744, 5164}, {12240, 8160}, {100000, 1000}, {4097, 3841}};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        size_t width = sizes[i][0], height = sizes[i][1];
+        NSUInteger maxPixelSize = [self maxPixelSizeForWidth:width height:height maxPixelSize:nil scaleDown:YES];
+        XCTAssertGreaterThan(maxPixelSize, 0u, @"%zux%zu", width, height);
+        XCTAssertLessThan(maxPixelSize, MAX(width, height), @"%zux%zu", width, height);
+        double ratio = (double)MIN(width, height) / MAX(width, height);
+        XCTAssertLessThanOrEqual(maxPixelSize * (maxPixelSize * ratio), kScaleDownPixelBudget, @"%zux%zu", width, height);
+        XCTAssertGreaterThan((maxPixelSize + 1) * ((maxPixelSize + 1) * ratio), kScaleDownPixelBudget, @"%zux%zu", width, height);
+    }
+    XCTAssertEqual([self maxPixelSizeForWidth:8000 height:6000 maxPixelSize:nil scaleDown:YES], 4579u);
+}
+
+- (void)test04TheSmallerLimitWins {
+    // 两个选项都有时使用较小的限制
+    XCTAssertEqual([self maxPixelSizeForWidth:8000 height:6000 maxPixelSize:@1000 scaleDown:YES], 1000u);
+    XCTAssertEqual([self maxPixelSizeForWidth:8000 height:6000 maxPixelSize:@6000 scaleDown:YES], 4579u);
+    XCTAssertEqual([self maxPixelSizeForWidth:8000 height:6000 maxPixelSize:@8000 scaleDown:YES], 4579u);
+    // 不需要缩小到预算时只有 maxPixelSize 起作用
+    XCTAssertEqual([self maxPixelSizeForWidth:4000 height:3000 maxPixelSize:@1000 scaleDown:YES], 1000u);
+    XCTAssertEqual([self maxPixelSizeForWidth:4000 height:3000 maxPixelSize:@5000 scaleDown:YES], 0u);
+}
+
+- (void)test05ImageIODecodesDownsampled {
+    SDWebImageImageIOCoder *coder = [SDWebImageImageIOCoder sharedCoder];
+    NSData *PNGData = [self PNGDataWithWidth:400 height:300];
+    UIImage *image = [coder decodedImageWithData:PNGData options:@{SDWebImageCoderDecodeMaxPixelSizeKey : @100}];
+    XCTAssertEqual(CGImageGetWidth(image.CGImage), 100u);
+    XCTAssertEqual(CGImageGetHeight(image.CGImage), 75u);
+    // 小图按原始大小解码
+    image = [coder decodedImageWithData:PNGData options:@{SDWebImageCoderScaleDownLargeImagesKey : @YES}];
+    XCTAssertEqual(CGImageGetWidth(image.CGImage), 400u);
+    XCTAssertEqual(CGImageGetHeight(image.CGImage), 300u);
+
+    // JPEG 的像素不旋转，方向保存在图片中
+    NSData *JPEGData = [self JPEGDataWithWidth:640 height:480 orientation:6];
+    image = [coder decodedImageWithData:JPEGData options:@{SDWebImageCoderDecodeMaxPixelSizeKey : @160}];
+    CGSize expectedSize = [self scaledSizeForWidth:640 height:480 maxPixelSize:160];
+    XCTAssertEqual(CGImageGetWidth(image.CGImage), (size_t)expectedSize.width);
+    XCTAssertEqual(CGImageGetHeight(image.CGImage), (size_t)expectedSize.height);
+#if SD_UIKIT
+    XCTAssertEqual(image.imageOrientation, UIImageOrientationRight);
+#endif
+}
+
+- (void)test06CodersManagerPassesTheOptions {
+    NSData *PNGData = [self PNGDataWithWidth:400 height:300];
+    UIImage *image = [[SDWebImageCodersManager sharedInstance] decodedImageWithData:PNGData options:@{SDWebImageCoderDecodeMaxPixelSizeKey : @200}];
+    XCTAssertEqual(CGImageGetWidth(image.CGImage), 200u);
+    XCTAssertEqual(CGImageGetHeight(image.CGImage), 150u);
+    image = [[SDWebImageCodersManager sharedInstance] decodedImageWithData:PNGData options:nil];
+    XCTAssertEqual(CGImageGetWidth(image.CGImage), 400u);
+}
+
+- (void)test07DownsampledDecodePerformance {
+    // 解码时缩小，不生成原始大小的位图
+    NSData *JPEGData = [self JPEGDataWithWidth:6000 height:4000 orientation:1];
+    SDWebImageImageIOCoder *coder = [SDWebImageImageIOCoder sharedCoder];
+    [self measureBlock:^{
+        @autoreleasepool {
+            [coder decodedImageWithData:JPEGData options:@{SDWebImageCoderDecodeMaxPixelSizeKey : @1024}];
+        }
+    }];
+}
+
+@end
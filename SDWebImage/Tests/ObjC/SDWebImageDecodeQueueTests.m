@@ -0,0 +1,185 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDTestCase.h"
+#import "SDTestURLProtocol.h"
+#import "SDWebImageDownloader.h"
+#import "SDWebImageDownloaderOperation.h"
+
+@interface SDWebImageDownloader ()
+
+- (nonnull NSOperationQueue *)decodeQueue;
+
+@end
+
+@interface SDWebImageDownloaderOperation ()
+
+- (void)decodeImageData:(nonnull NSData *)data;
+
+@end
+
+@interface SDWebImageDecodeQueueTests : SDTestCase
+
+@property (nonatomic, strong) SDWebImageDownloader *downloader;
+
+@end
+
+@implementation SDWebImageDecodeQueueTests
+
+- (void)setUp {
+    [super setUp];
+    self.downloader = [[SDWebImageDownloader alloc] initWithSessionConfiguration:[SDTestURLProtocol sessionConfiguration]];
+    NSData *imageData = [self PNGDataWithWidth:16 height:16];
+    [SDTestURLProtocol setHandler:^SDTestURLResponse *(NSURLRequest *request) {
+        return [SDTestURLResponse responseWithData:imageData];
+    }];
+}
+
+- (void)tearDown {
+    self.downloader.decodeQueue.suspended = NO;
+    [self.downloader invalidateSessionAndCancel:YES];
+    self.downloader = nil;
+    [SDTestURLProtocol reset];
+    [super tearDown];
+}
+
+- (BOOL)waitForCondition:(BOOL (^)(void))condition {
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:kAsyncTestTimeout];
+    while (!condition()) {
+        if ([deadline timeIntervalSinceNow] < 0) {
+            return NO;
+        }
+        [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+    return YES;
+}
+
+- (void)test01DecodesInPriorityOrder {
+    NSOperationQueue *decodeQueue = [NSOperationQueue new];
+    decodeQueue.maxConcurrentOperationCount = 1;
+    decodeQueue.suspended = YES;
+    NSData *imageData = [self PNGDataWithWidth:16 height:16];
+    NSArray<NSNumber *> *priorities = @[@(NSOperationQueuePriorityLow),
+                                        @(NSOperationQueuePriorityVeryHigh),
+                                        @(NSOperationQueuePriorityNormal),
+                                        @(NSOperationQueuePriorityVeryLow),
+                                        @(NSOperationQueuePriorityHigh)];
+    NSMutableArray<NSNumber *> *decodedPriorities = [NSMutableArray array];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Decoded in priority order"];
+    expectation.expectedFulfillmentCount = priorities.count;
+    for (NSNumber *priority in priorities) {
+        NSURL *url = [NSURL URLWithString:[NSString stringWithFormat:@"http://example.com/%@.png", priority]];
+        SDWebImageDownloaderOperation *operation = [[SDWebImageDownloaderOperation alloc] initWithRequest:[NSURLRequest requestWithURL:url] inSession:nil options:0];
+        operation.decodeQueue = decodeQueue;
+        operation.queuePriority = priority.integerValue;
+        [operation addHandlersForProgress:nil completed:^(UIImage *image, NSData *data, NSError *error, BOOL finished) {
+            XCTAssertNotNil(image);
+            [decodedPriorities addObject:priority];
+            [expectation fulfill];
+        }];
+        [operation decodeImageData:imageData];
+    }
+    // 解码队列暂停时加入的解码按优先级从高到低执行
+    decodeQueue.suspended = NO;
+    [self waitForExpectationsWithTimeout:kAsyncTestTimeout handler:nil];
+    XCTAssertEqualObjects(decodedPriorities, (@[@(NSOperationQueuePriorityVeryHigh),
+                                                @(NSOperationQueuePriorityHigh),
+                                                @(NSOperationQueuePriorityNormal),
+                                                @(NSOperationQueuePriorityLow),
+                                                @(NSOperationQueuePriorityVeryLow)]));
+}
+
+- (void)test02MaxConcurrentDecodes {
+    XCTAssertEqual(self.downloader.maxConcurrentDecodes, (NSInteger)[NSProcessInfo processInfo].activeProcessorCount);
+    self.downloader.maxConcurrentDecodes = 2;
+    XCTAssertEqual(self.downloader.decodeQueue.maxConcurrentOperationCount, 2);
+}
+
+- (void)test03RequestsJoinADecodingDownload {
+    NSURL *url = [NSURL URLWithString:@"http://example.com/decoding.png"];
+    self.downloader.decodeQueue.suspended = YES;
+    __block NSUInteger completedCount = 0;
+    SDWebImageDownloaderCompletedBlock completed = ^(UIImage *image, NSData *data, NSError *error, BOOL finished) {
+        XCTAssertNotNil(image);
+        XCTAssertNil(error);
+        completedCount++;
+    };
+    [self.downloader downloadImageWithURL:url options:0 progress:nil completed:completed];
+    // 下载已经结束，解码还在排队
+    XCTAssertTrue([self waitForCondition:^BOOL{
+        return [SDTestURLProtocol requestCountForURL:url] == 1 && self.downloader.currentDownloadCount == 0;
+    }]);
+    XCTAssertEqual(self.downloader.decodeQueue.operationCount, 1);
+    // 同一个 URL 的请求等待这次解码，不重新下载
+    [self.downloader downloadImageWithURL:url options:0 progress:nil completed:completed];
+    self.downloader.decodeQueue.suspended = NO;
+    XCTAssertTrue([self waitForCondition:^BOOL{
+        return completedCount == 2;
+    }]);
+    XCTAssertEqual([SDTestURLProtocol requestCountForURL:url], 1);
+
+    // 解码结束后 operation 被移除，再次请求重新下载
+    [self.downloader downloadImageWithURL:url options:0 progress:nil completed:completed];
+    XCTAssertTrue([self waitForCondition:^BOOL{
+        return completedCount == 3;
+    }]);
+    XCTAssertEqual([SDTestURLProtocol requestCountForURL:url], 2);
+}
+
+#pragma mark - Benchmark
+
+// 200 个下载同时完成（响应已经在本地），报告全部解码完成的时间和每张图片从开始下载到解码完成的延迟
+- (void)benchmarkMaxConcurrentDecodes:(NSInteger)maxConcurrentDecodes {
+    const NSUInteger downloadCount = 200;
+    SDWebImageDownloader *downloader = [[SDWebImageDownloader alloc] initWithSessionConfiguration:[SDTestURLProtocol sessionConfiguration]];
+    downloader.maxConcurrentDownloads = downloadCount;
+    downloader.maxConcurrentDecodes = maxConcurrentDecodes;
+    double *latencies = malloc(downloadCount * sizeof(double));
+    __block NSUInteger completedCount = 0;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"All decoded"];
+    expectation.expectedFulfillmentCount = downloadCount;
+    NSTimeInterval start = SDTestNow();
+    for (NSUInteger i = 0; i < downloadCount; i++) {
+        NSURL *url = [NSURL URLWithString:[NSString stringWithFormat:@"http://example.com/decode%ld/%lu.png", (long)maxConcurrentDecodes, (unsigned long)i]];
+        [downloader downloadImageWithURL:url options:0 progress:nil completed:^(UIImage *image, NSData *data, NSError *error, BOOL finished) {
+            XCTAssertNotNil(image);
+            NSTimeInterval latency = SDTestNow() - start;
+            @synchronized (expectation) {
+                latencies[completedCount++] = latency * 1000;
+            }
+            [expectation fulfill];
+        }];
+    }
+    [self waitForExpectationsWithTimeout:600 handler:nil];
+    NSTimeInterval elapsed = SDTestNow() - start;
+    NSString *label = [NSString stringWithFormat:@"%ld decodes on %lu cores", (long)maxConcurrentDecodes, (unsigned long)[NSProcessInfo processInfo].activeProcessorCount];
+    [self reportBenchmark:[label stringByAppendingString:@" time to all decoded"] value:elapsed * 1000 unit:@"ms"];
+    [self reportBenchmark:[label stringByAppendingString:@" latency p50"] value:SDTestPercentile(latencies, downloadCount, 50) unit:@"ms"];
+    [self reportBenchmark:[label stringByAppendingString:@" latency p99"] value:SDTestPercentile(latencies, downloadCount, 99) unit:@"ms"];
+    free(latencies);
+    [downloader invalidateSessionAndCancel:YES];
+}
+
+- (void)test04TimeToAllDecodedAgainstCoreCountBenchmark {
+    if (!SDTestBenchmarkEnabled()) {
+        return;
+    }
+    // 解码和解压缩 1600 x 1200 的图片
+    NSData *imageData = [self PNGDataWithWidth:1600 height:1200];
+    [SDTestURLProtocol setHandler:^SDTestURLResponse *(NSURLRequest *request) {
+        return [SDTestURLResponse responseWithData:imageData];
+    }];
+    // 1 个并发解码和以前在 session 的串行队列上解码一样
+    NSInteger coreCount = (NSInteger)[NSProcessInfo processInfo].activeProcessorCount;
+    for (NSInteger maxConcurrentDecodes = 1; maxConcurrentDecodes < coreCount; maxConcurrentDecodes *= 2) {
+        [self benchmarkMaxConcurrentDecodes:maxConcurrentDecodes];
+    }
+    [self benchmarkMaxConcurrentDecodes:coreCount];
+}
+
+@end
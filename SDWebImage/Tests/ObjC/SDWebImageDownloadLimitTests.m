@@ -0,0 +1,306 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDTestCase.h"
+#import "SDTestURLProtocol.h"
+#import "SDWebImageDownloader.h"
+#import "SDWebImageDownloadScheduler.h"
+
+@interface SDWebImageDownloadLimitTests : SDTestCase
+
+@property (nonatomic, strong) NSOperationQueue *operationQueue;
+@property (nonatomic, strong) SDWebImageDownloadScheduler *scheduler;
+@property (nonatomic, strong) dispatch_semaphore_t gate;
+// host -> 正在执行的操作数，和执行期间的最大值
+@property (nonatomic, strong) NSCountedSet<NSString *> *runningHosts;
+@property (nonatomic, strong) NSMutableDictionary<NSString *, NSNumber *> *maxRunningPerHost;
+@property (nonatomic, assign) NSUInteger maxRunning;
+
+@end
+
+@implementation SDWebImageDownloadLimitTests
+
+- (void)setUp {
+    [super setUp];
+    self.operationQueue = [NSOperationQueue new];
+    self.operationQueue.maxConcurrentOperationCount = 4;
+    self.scheduler = [[SDWebImageDownloadScheduler alloc] initWithOperationQueue:self.operationQueue];
+    self.scheduler.agingInterval = 0;
+    self.gate = dispatch_semaphore_create(0);
+    self.runningHosts = [NSCountedSet set];
+    self.maxRunningPerHost = [NSMutableDictionary dictionary];
+}
+
+- (void)tearDown {
+    for (NSUInteger i = 0; i < 100; i++) {
+        dispatch_semaphore_signal(self.gate);
+    }
+    [self.operationQueue waitUntilAllOperationsAreFinished];
+    self.scheduler = nil;
+    [SDTestURLProtocol reset];
+    [super tearDown];
+}
+
+// 记录同时执行的数量，waitForGate 时一直执行到 gate 被 signal
+- (NSOperation *)operationForHost:(NSString *)host waitForGate:(BOOL)waitForGate {
+    dispatch_semaphore_t gate = self.gate;
+    return [NSBlockOperation blockOperationWithBlock:^{
+        @synchronized (self) {
+            [self.runningHosts addObject:host];
+            NSUInteger running = [self.runningHosts countForObject:host];
+            self.maxRunningPerHost[host] = @(MAX(running, self.maxRunningPerHost[host].unsignedIntegerValue));
+            self.maxRunning = MAX(self.maxRunning, [self totalRunning]);
+        }
+        if (waitForGate) {
+            dispatch_semaphore_wait(gate, DISPATCH_TIME_FOREVER);
+        } else {
+            [NSThread sleepForTimeInterval:0.02];
+        }
+        @synchronized (self) {
+            [self.runningHosts removeObject:host];
+        }
+    }];
+}
+
+- (NSUInteger)totalRunning {
+    NSUInteger total = 0;
+    for (NSString *host in self.runningHosts) {
+        total += [self.runningHosts countForObject:host];
+    }
+    return total;
+}
+
+- (BOOL)waitForCondition:(BOOL (^)(void))condition {
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:kAsyncTestTimeout];
+    while (!condition()) {
+        if ([deadline timeIntervalSinceNow] < 0) {
+            return NO;
+        }
+        [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+    return YES;
+}
+
+#pragma mark - Per host limits
+
+- (void)test01PerHostLimit {
+    self.scheduler.maxConcurrentOperationsPerHost = 2;
+    for (NSUInteger i = 0; i < 6; i++) {
+        [self.scheduler addOperation:[self operationForHost:@"slow.example.com" waitForGate:NO] priority:SDWebImageDownloaderPriorityNormal host:@"slow.example.com"];
+    }
+    for (NSUInteger i = 0; i < 6; i++) {
+        // host 不区分大小写
+        NSString *host = i % 2 ? @"FAST.example.com" : @"fast.example.com";
+        [self.scheduler addOperation:[self operationForHost:@"fast.example.com" waitForGate:NO] priority:SDWebImageDownloaderPriorityNormal host:host];
+    }
+    XCTAssertTrue([self waitForCondition:^BOOL{
+        return self.scheduler.pendingOperationCount == 0 && self.operationQueue.operationCount == 0;
+    }]);
+    XCTAssertEqualObjects(self.maxRunningPerHost[@"slow.example.com"], @2);
+    XCTAssertEqualObjects(self.maxRunningPerHost[@"fast.example.com"], @2);
+    // 两个 host 同时使用剩下的名额
+    XCTAssertEqual(self.maxRunning, 4);
+}
+
+- (void)test02BusyHostDoesNotBlockOtherHosts {
+    self.scheduler.maxConcurrentOperationsPerHost = 1;
+    [self.scheduler addOperation:[self operationForHost:@"slow.example.com" waitForGate:YES] priority:SDWebImageDownloaderPriorityVisible host:@"slow.example.com"];
+    [self.scheduler addOperation:[self operationForHost:@"slow.example.com" waitForGate:YES] priority:SDWebImageDownloaderPriorityVisible host:@"slow.example.com"];
+    [self.scheduler addOperation:[self operationForHost:@"other.example.com" waitForGate:YES] priority:SDWebImageDownloaderPriorityLow host:@"other.example.com"];
+    // 排在前面的高优先级操作在等 host 的名额，低优先级的其他 host 先执行
+    XCTAssertEqual(self.operationQueue.operationCount, 2);
+    XCTAssertEqual(self.scheduler.pendingOperationCount, 1);
+    // 放宽限制时马上执行等待的操作
+    self.scheduler.maxConcurrentOperationsPerHost = 0;
+    XCTAssertEqual(self.operationQueue.operationCount, 3);
+    XCTAssertEqual(self.scheduler.pendingOperationCount, 0);
+}
+
+#pragma mark - Prefetch slots
+
+- (void)test03PrefetchSlots {
+    self.scheduler.maxConcurrentPrefetchOperations = 1;
+    for (NSUInteger i = 0; i < 3; i++) {
+        [self.scheduler addOperation:[self operationForHost:@"prefetch" waitForGate:YES] priority:SDWebImageDownloaderPriorityPrefetch];
+    }
+    XCTAssertEqual(self.operationQueue.operationCount, 1);
+    XCTAssertEqual(self.scheduler.pendingOperationCount, 2);
+    // 预加载占不满的名额留给屏幕上的图片
+    [self.scheduler addOperation:[self operationForHost:@"visible" waitForGate:YES] priority:SDWebImageDownloaderPriorityVisible];
+    [self.scheduler addOperation:[self operationForHost:@"visible" waitForGate:YES] priority:SDWebImageDownloaderPriorityNormal];
+    XCTAssertEqual(self.operationQueue.operationCount, 3);
+    XCTAssertEqual(self.scheduler.pendingOperationCount, 2);
+}
+
+- (void)test04AgedPrefetchStaysInItsSlots {
+    self.scheduler.agingInterval = 0.01;
+    self.scheduler.maxConcurrentPrefetchOperations = 1;
+    for (NSUInteger i = 0; i < 3; i++) {
+        [self.scheduler addOperation:[self operationForHost:@"prefetch" waitForGate:YES] priority:SDWebImageDownloaderPriorityPrefetch];
+    }
+    // 等待之后有效优先级提升到 Visible，仍然只占用预加载的名额
+    [NSThread sleepForTimeInterval:0.1];
+    [self.scheduler drain];
+    XCTAssertEqual(self.operationQueue.operationCount, 1);
+    XCTAssertEqual(self.scheduler.pendingOperationCount, 2);
+}
+
+- (void)test05DownloaderPrefetchOption {
+    SDWebImageDownloader *downloader = [[SDWebImageDownloader alloc] initWithSessionConfiguration:[SDTestURLProtocol sessionConfiguration]];
+    XCTAssertEqual(downloader.maxConcurrentPrefetchDownloads, 3);
+    downloader.maxConcurrentPrefetchDownloads = 1;
+    downloader.maxConcurrentDownloads = 2;
+    [SDTestURLProtocol setHandler:^SDTestURLResponse *(NSURLRequest *request) {
+        SDTestURLResponse *response = [SDTestURLResponse responseWithData:nil];
+        response.delay = 60;
+        return response;
+    }];
+    for (NSUInteger i = 0; i < 3; i++) {
+        NSURL *url = [NSURL URLWithString:[NSString stringWithFormat:@"http://example.com/prefetch%lu.png", (unsigned long)i]];
+        [downloader downloadImageWithURL:url options:SDWebImageDownloaderPrefetchPriority progress:nil completed:nil];
+    }
+    [downloader downloadImageWithURL:[NSURL URLWithString:@"http://example.com/visible.png"] options:0 progress:nil completed:nil];
+    // 一个预加载和屏幕上的图片在下载，另外两个预加载在等待
+    XCTAssertTrue([self waitForCondition:^BOOL{
+        return [SDTestURLProtocol requests].count == 2;
+    }]);
+    XCTAssertEqual([SDTestURLProtocol requestCountForURL:[NSURL URLWithString:@"http://example.com/visible.png"]], 1);
+    XCTAssertEqual(downloader.currentDownloadCount, 4);
+    [downloader invalidateSessionAndCancel:YES];
+}
+
+#pragma mark - Bandwidth
+
+// 下载 length 字节需要的时间
+- (NSTimeInterval)downloadTimeWithMaxBytesPerSecond:(NSUInteger)maxBytesPerSecond length:(NSUInteger)length options:(SDWebImageDownloaderOptions)options {
+    SDWebImageDownloader *downloader = [[SDWebImageDownloader alloc] initWithSessionConfiguration:[SDTestURLProtocol sessionConfiguration]];
+    downloader.maxBytesPerSecond = maxBytesPerSecond;
+    downloader.resumeStore = nil;
+    NSData *data = [self dataWithLength:length seed:1];
+    [SDTestURLProtocol setHandler:^SDTestURLResponse *(NSURLRequest *request) {
+        SDTestURLResponse *response = [SDTestURLResponse responseWithData:data];
+        response.chunkLength = 16 * 1024;
+        return response;
+    }];
+    __block BOOL finished = NO;
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    // 数据不是图片，完成时返回错误
+    [downloader downloadImageWithURL:[NSURL URLWithString:@"http://example.com/bandwidth.png"] options:options progress:nil completed:^(UIImage *image, NSData *imageData, NSError *error, BOOL isFinished) {
+        finished = isFinished;
+    }];
+    XCTAssertTrue([self waitForCondition:^BOOL{
+        return finished;
+    }]);
+    NSTimeInterval time = CFAbsoluteTimeGetCurrent() - start;
+    [downloader invalidateSessionAndCancel:YES];
+    return time;
+}
+
+- (void)test06BandwidthThrottlesLowPriorityDownloads {
+    // 第一秒的预算是 64 KB，剩下的 128 KB 至少需要两秒
+    NSTimeInterval time = [self downloadTimeWithMaxBytesPerSecond:64 * 1024 length:192 * 1024 options:SDWebImageDownloaderLowPriority];
+    XCTAssertGreaterThan(time, 1.0);
+}
+
+- (void)test07BandwidthNeverThrottlesHighPriorityDownloads {
+    NSTimeInterval time = [self downloadTimeWithMaxBytesPerSecond:64 * 1024 length:192 * 1024 options:SDWebImageDownloaderHighPriority];
+    XCTAssertLessThan(time, 1.0);
+}
+
+- (void)test08NoBandwidthLimitByDefault {
+    NSTimeInterval time = [self downloadTimeWithMaxBytesPerSecond:0 length:192 * 1024 options:SDWebImageDownloaderLowPriority];
+    XCTAssertLessThan(time, 1.0);
+}
+
+#pragma mark - Benchmark
+
+// 大量预加载的同时每 50ms 请求一张屏幕上的图片，三个 host 的延迟分别是 10ms、100ms 和 500ms
+// 统计屏幕上的图片从请求到收到第一个字节的时间，和所有预加载完成的时间
+- (void)benchmarkForegroundTimeToFirstByteWithPrefetchDownloads:(NSInteger)maxConcurrentPrefetchDownloads perHost:(NSInteger)maxConcurrentDownloadsPerHost name:(NSString *)name {
+    NSDictionary<NSString *, NSNumber *> *latencies = @{@"fast.example.com": @0.01, @"medium.example.com": @0.1, @"slow.example.com": @0.5};
+    NSArray<NSString *> *hosts = [latencies.allKeys sortedArrayUsingSelector:@selector(compare:)];
+    const NSUInteger prefetchCount = 90;
+    const NSUInteger foregroundCount = 30;
+    NSData *data = [self dataWithLength:64 * 1024 seed:7];
+    [SDTestURLProtocol setHandler:^SDTestURLResponse *(NSURLRequest *request) {
+        SDTestURLResponse *response = [SDTestURLResponse responseWithData:data];
+        response.chunkLength = 16 * 1024;
+        response.delay = latencies[request.URL.host].doubleValue;
+        return response;
+    }];
+    SDWebImageDownloader *downloader = [[SDWebImageDownloader alloc] initWithSessionConfiguration:[SDTestURLProtocol sessionConfiguration]];
+    downloader.resumeStore = nil;
+    downloader.maxConcurrentDownloads = 6;
+    downloader.maxConcurrentPrefetchDownloads = maxConcurrentPrefetchDownloads;
+    downloader.maxConcurrentDownloadsPerHost = maxConcurrentDownloadsPerHost;
+
+    __block NSUInteger prefetchedCount = 0;
+    __block NSTimeInterval prefetchEnd = 0;
+    NSTimeInterval start = SDTestNow();
+    for (NSUInteger i = 0; i < prefetchCount; i++) {
+        NSURL *url = [NSURL URLWithString:[NSString stringWithFormat:@"http://%@/prefetch/%lu.png", hosts[i % hosts.count], (unsigned long)i]];
+        // 数据不是图片，完成时返回错误
+        [downloader downloadImageWithURL:url options:SDWebImageDownloaderPrefetchPriority progress:nil completed:^(UIImage *image, NSData *imageData, NSError *error, BOOL finished) {
+            @synchronized (self) {
+                prefetchedCount++;
+                prefetchEnd = SDTestNow();
+            }
+        }];
+    }
+
+    double *timesToFirstByte = calloc(foregroundCount, sizeof(double));
+    double *fastHostTimesToFirstByte = calloc(foregroundCount, sizeof(double));
+    __block NSUInteger firstByteCount = 0;
+    __block NSUInteger fastHostCount = 0;
+    for (NSUInteger i = 0; i < foregroundCount; i++) {
+        NSString *host = hosts[i % hosts.count];
+        NSURL *url = [NSURL URLWithString:[NSString stringWithFormat:@"http://%@/visible/%lu.png", host, (unsigned long)i]];
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(i * 0.05 * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+            NSTimeInterval requestTime = SDTestNow();
+            __block BOOL receivedFirstByte = NO;
+            [downloader downloadImageWithURL:url options:0 progress:^(NSInteger receivedSize, NSInteger expectedSize, NSURL *targetURL) {
+                @synchronized (self) {
+                    if (receivedSize <= 0 || receivedFirstByte) {
+                        return;
+                    }
+                    receivedFirstByte = YES;
+                    double timeToFirstByte = (SDTestNow() - requestTime) * 1000;
+                    timesToFirstByte[firstByteCount++] = timeToFirstByte;
+                    if ([host isEqualToString:@"fast.example.com"]) {
+                        fastHostTimesToFirstByte[fastHostCount++] = timeToFirstByte;
+                    }
+                }
+            } completed:nil];
+        });
+    }
+    XCTAssertTrue([self waitForCondition:^BOOL{
+        @synchronized (self) {
+            return firstByteCount == foregroundCount && prefetchedCount == prefetchCount;
+        }
+    }]);
+
+    [self reportBenchmark:[name stringByAppendingString:@" foreground TTFB p50"] value:SDTestPercentile(timesToFirstByte, firstByteCount, 50) unit:@"ms"];
+    [self reportBenchmark:[name stringByAppendingString:@" foreground TTFB p99"] value:SDTestPercentile(timesToFirstByte, firstByteCount, 99) unit:@"ms"];
+    [self reportBenchmark:[name stringByAppendingString:@" fast host foreground TTFB p99"] value:SDTestPercentile(fastHostTimesToFirstByte, fastHostCount, 99) unit:@"ms"];
+    [self reportBenchmark:[name stringByAppendingString:@" prefetch total time"] value:(prefetchEnd - start) * 1000 unit:@"ms"];
+    free(timesToFirstByte);
+    free(fastHostTimesToFirstByte);
+    [downloader invalidateSessionAndCancel:YES];
+    [SDTestURLProtocol reset];
+}
+
+- (void)test09ForegroundTimeToFirstByteDuringPrefetchBenchmark {
+    if (!SDTestBenchmarkEnabled()) {
+        return;
+    }
+    [self benchmarkForegroundTimeToFirstByteWithPrefetchDownloads:0 perHost:0 name:@"no limits"];
+    [self benchmarkForegroundTimeToFirstByteWithPrefetchDownloads:3 perHost:0 name:@"prefetch slots"];
+    [self benchmarkForegroundTimeToFirstByteWithPrefetchDownloads:3 perHost:2 name:@"prefetch slots + per host"];
+}
+
+@end
@@ -0,0 +1,246 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDTestCase.h"
+#import "SDTestURLProtocol.h"
+#import "SDWebImageDownloader.h"
+#import "SDWebImageDownloadResumeStore.h"
+
+@interface SDWebImageDownloadResumeTests : SDTestCase
+
+@property (nonatomic, strong) SDWebImageDownloader *downloader;
+@property (nonatomic, strong) SDWebImageDownloadResumeStore *resumeStore;
+@property (nonatomic, strong) NSURL *url;
+@property (nonatomic, strong) NSData *imageData;
+
+@end
+
+@implementation SDWebImageDownloadResumeTests
+
+- (void)setUp {
+    [super setUp];
+    self.downloader = [[SDWebImageDownloader alloc] initWithSessionConfiguration:[SDTestURLProtocol sessionConfiguration]];
+    self.resumeStore = [[SDWebImageDownloadResumeStore alloc] initWithDirectory:self.temporaryDirectory];
+    self.resumeStore.minimumPartialDataSize = 1;
+    self.downloader.resumeStore = self.resumeStore;
+    self.url = [NSURL URLWithString:@"http://example.com/resume.png"];
+    self.imageData = [self PNGDataWithWidth:64 height:64];
+}
+
+- (void)tearDown {
+    [self.downloader invalidateSessionAndCancel:YES];
+    self.downloader = nil;
+    [SDTestURLProtocol reset];
+    [super tearDown];
+}
+
+- (NSUInteger)halfLength {
+    return self.imageData.length / 2;
+}
+
+// 发送前一半数据后连接断开
+- (SDTestURLResponse *)interruptedResponseWithHeaders:(NSDictionary<NSString *, NSString *> *)headers {
+    SDTestURLResponse *response = [SDTestURLResponse responseWithData:[self.imageData subdataWithRange:NSMakeRange(0, self.halfLength)]];
+    NSMutableDictionary<NSString *, NSString *> *headerFields = [headers mutableCopy];
+    headerFields[@"Content-Length"] = [NSString stringWithFormat:@"%lu", (unsigned long)self.imageData.length];
+    response.headerFields = headerFields;
+    response.error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorNetworkConnectionLost userInfo:nil];
+    return response;
+}
+
+- (SDTestURLResponse *)partialResponseFromOffset:(NSUInteger)offset {
+    NSUInteger length = self.imageData.length;
+    SDTestURLResponse *response = [SDTestURLResponse responseWithData:[self.imageData subdataWithRange:NSMakeRange(offset, length - offset)]];
+    response.statusCode = 206;
+    response.headerFields = @{@"Content-Range": [NSString stringWithFormat:@"bytes %lu-%lu/%lu", (unsigned long)offset, (unsigned long)(length - 1), (unsigned long)length]};
+    return response;
+}
+
+// 下载一次，返回完成时的数据和错误
+- (NSData *)downloadWithError:(NSError **)error {
+    __block NSData *downloadedData = nil;
+    __block NSError *downloadError = nil;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Download"];
+    [self.downloader downloadImageWithURL:self.url options:0 progress:nil completed:^(UIImage *image, NSData *data, NSError *anError, BOOL finished) {
+        if (finished) {
+            downloadedData = image ? data : nil;
+            downloadError = anError;
+            [expectation fulfill];
+        }
+    }];
+    [self waitForExpectationsWithTimeout:kAsyncTestTimeout handler:nil];
+    if (error) {
+        *error = downloadError;
+    }
+    return downloadedData;
+}
+
+- (NSData *)storedPartialDataWithValidator:(NSString **)validator {
+    return [self.resumeStore partialDataForURL:self.url validator:validator];
+}
+
+- (void)test01ResumesWithARangeRequest {
+    [SDTestURLProtocol setHandler:^SDTestURLResponse *(NSURLRequest *request) {
+        NSString *range = [request valueForHTTPHeaderField:@"Range"];
+        if (range && [[request valueForHTTPHeaderField:@"If-Range"] isEqualToString:@"\"v1\""]) {
+            XCTAssertEqualObjects(range, ([NSString stringWithFormat:@"bytes=%lu-", (unsigned long)self.halfLength]));
+            return [self partialResponseFromOffset:self.halfLength];
+        }
+        return [self interruptedResponseWithHeaders:@{@"ETag": @"\"v1\"", @"Accept-Ranges": @"bytes"}];
+    }];
+    NSError *error = nil;
+    XCTAssertNil([self downloadWithError:&error]);
+    XCTAssertNotNil(error);
+    NSString *validator = nil;
+    XCTAssertEqual([self storedPartialDataWithValidator:&validator].length, self.halfLength);
+    XCTAssertEqualObjects(validator, @"\"v1\"");
+
+    XCTAssertEqualObjects([self downloadWithError:&error], self.imageData);
+    XCTAssertNil(error);
+    NSArray<NSURLRequest *> *requests = [SDTestURLProtocol requests];
+    XCTAssertEqual(requests.count, 2);
+    XCTAssertNil([requests[0] valueForHTTPHeaderField:@"Range"]);
+    XCTAssertNotNil([requests[1] valueForHTTPHeaderField:@"Range"]);
+    // 续传完成后删除保存的数据
+    XCTAssertNil([self storedPartialDataWithValidator:&validator]);
+}
+
+- (void)test02ChangedImageIsDownloadedAgain {
+    NSData *newImageData = [self PNGDataWithWidth:32 height:48];
+    [SDTestURLProtocol setHandler:^SDTestURLResponse *(NSURLRequest *request) {
+        if ([request valueForHTTPHeaderField:@"Range"]) {
+            // If-Range 不匹配，服务器返回完整的新图片
+            XCTAssertEqualObjects([request valueForHTTPHeaderField:@"If-Range"], @"\"v1\"");
+            SDTestURLResponse *response = [SDTestURLResponse responseWithData:newImageData];
+            response.headerFields = @{@"ETag": @"\"v2\""};
+            return response;
+        }
+        return [self interruptedResponseWithHeaders:@{@"ETag": @"\"v1\""}];
+    }];
+    [self downloadWithError:nil];
+    NSError *error = nil;
+    XCTAssertEqualObjects([self downloadWithError:&error], newImageData);
+    XCTAssertNil(error);
+    XCTAssertNil([self storedPartialDataWithValidator:NULL]);
+}
+
+- (void)test03LastModifiedValidator {
+    NSString *lastModified = @"Wed, 21 Oct 2015 07:28:00 GMT";
+    [SDTestURLProtocol setHandler:^SDTestURLResponse *(NSURLRequest *request) {
+        if ([[request valueForHTTPHeaderField:@"If-Range"] isEqualToString:lastModified]) {
+            return [self partialResponseFromOffset:self.halfLength];
+        }
+        return [self interruptedResponseWithHeaders:@{@"ETag": @"W/\"weak\"", @"Last-Modified": lastModified}];
+    }];
+    [self downloadWithError:nil];
+    // 弱 ETag 不能用于范围请求，使用 Last-Modified
+    NSString *validator = nil;
+    XCTAssertNotNil([self storedPartialDataWithValidator:&validator]);
+    XCTAssertEqualObjects(validator, lastModified);
+    XCTAssertEqualObjects([self downloadWithError:nil], self.imageData);
+}
+
+- (void)test04NoValidatorNoResume {
+    [SDTestURLProtocol setHandler:^SDTestURLResponse *(NSURLRequest *request) {
+        if ([request valueForHTTPHeaderField:@"Range"]) {
+            XCTFail(@"A download without a strong validator must not be resumed");
+        }
+        if ([SDTestURLProtocol requests].count == 1) {
+            return [self interruptedResponseWithHeaders:@{@"ETag": @"W/\"weak\""}];
+        }
+        return [SDTestURLResponse responseWithData:self.imageData];
+    }];
+    [self downloadWithError:nil];
+    XCTAssertNil([self storedPartialDataWithValidator:NULL]);
+    XCTAssertEqualObjects([self downloadWithError:nil], self.imageData);
+}
+
+- (void)test05AcceptRangesNone {
+    [SDTestURLProtocol setHandler:^SDTestURLResponse *(NSURLRequest *request) {
+        return [self interruptedResponseWithHeaders:@{@"ETag": @"\"v1\"", @"Accept-Ranges": @"none"}];
+    }];
+    [self downloadWithError:nil];
+    XCTAssertNil([self storedPartialDataWithValidator:NULL]);
+}
+
+- (void)test06MismatchedContentRangeFails {
+    [SDTestURLProtocol setHandler:^SDTestURLResponse *(NSURLRequest *request) {
+        if ([request valueForHTTPHeaderField:@"Range"]) {
+            // 返回的范围接不上已经收到的数据
+            return [self partialResponseFromOffset:self.halfLength - 1];
+        }
+        return [self interruptedResponseWithHeaders:@{@"ETag": @"\"v1\""}];
+    }];
+    [self downloadWithError:nil];
+    NSError *error = nil;
+    XCTAssertNil([self downloadWithError:&error]);
+    XCTAssertNotNil(error);
+    XCTAssertNil([self storedPartialDataWithValidator:NULL]);
+}
+
+#pragma mark - Benchmark
+
+// 下载被中断 cycles - 1 次（和取消一样保存已经收到的数据），每次多收到 1/cycles，最后一次完成。返回服务器发送的字节数
+- (unsigned long long)bytesTransferredOverCycles:(NSUInteger)cycles resume:(BOOL)resume {
+    self.downloader.resumeStore = resume ? self.resumeStore : nil;
+    self.url = [NSURL URLWithString:[NSString stringWithFormat:@"http://example.com/cycles%lu-%d.png", (unsigned long)cycles, resume]];
+    NSData *imageData = self.imageData;
+    const NSUInteger length = imageData.length;
+    __block unsigned long long transferred = 0;
+    __block NSUInteger attempt = 0;
+    [SDTestURLProtocol setHandler:^SDTestURLResponse *(NSURLRequest *request) {
+        attempt++;
+        NSUInteger end = attempt < cycles ? length * attempt / cycles : length;
+        NSUInteger offset = 0;
+        NSString *range = [request valueForHTTPHeaderField:@"Range"];
+        if ([range hasPrefix:@"bytes="] && [[request valueForHTTPHeaderField:@"If-Range"] isEqualToString:@"\"v1\""]) {
+            offset = (NSUInteger)[range substringFromIndex:6].integerValue;
+        }
+        SDTestURLResponse *response = [SDTestURLResponse responseWithData:[imageData subdataWithRange:NSMakeRange(offset, end - offset)]];
+        NSMutableDictionary<NSString *, NSString *> *headerFields = [@{@"ETag": @"\"v1\"", @"Accept-Ranges": @"bytes",
+                                                                       @"Content-Length": [NSString stringWithFormat:@"%lu", (unsigned long)(length - offset)]} mutableCopy];
+        if (offset > 0) {
+            response.statusCode = 206;
+            headerFields[@"Content-Range"] = [NSString stringWithFormat:@"bytes %lu-%lu/%lu", (unsigned long)offset, (unsigned long)(length - 1), (unsigned long)length];
+        }
+        response.headerFields = headerFields;
+        if (end < length) {
+            response.error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorNetworkConnectionLost userInfo:nil];
+        }
+        transferred += response.data.length;
+        return response;
+    }];
+    for (NSUInteger cycle = 0; cycle < cycles; cycle++) {
+        NSError *error = nil;
+        NSData *data = [self downloadWithError:&error];
+        if (cycle == cycles - 1) {
+            XCTAssertEqualObjects(data, imageData);
+        } else {
+            XCTAssertNotNil(error);
+        }
+    }
+    return transferred;
+}
+
+- (void)test07BytesTransferredOverInterruptedCyclesBenchmark {
+    if (!SDTestBenchmarkEnabled()) {
+        return;
+    }
+    self.imageData = [self PNGDataWithWidth:2048 height:2048];
+    [self reportBenchmark:@"image size" value:self.imageData.length / 1e3 unit:@"KB"];
+    for (NSNumber *cycles in @[@2, @5, @10]) {
+        NSString *label = [NSString stringWithFormat:@"%@ cycles", cycles];
+        unsigned long long restarted = [self bytesTransferredOverCycles:cycles.unsignedIntegerValue resume:NO];
+        unsigned long long resumed = [self bytesTransferredOverCycles:cycles.unsignedIntegerValue resume:YES];
+        [self reportBenchmark:[label stringByAppendingString:@" restarted from scratch"] value:restarted / 1e3 unit:@"KB"];
+        [self reportBenchmark:[label stringByAppendingString:@" resumed"] value:resumed / 1e3 unit:@"KB"];
+        XCTAssertEqual(resumed, self.imageData.length);
+    }
+}
+
+@end
@@ -0,0 +1,286 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDTestCase.h"
+#import "SDWebImageDownloadScheduler.h"
+
+@interface SDWebImageDownloadSchedulerTests : SDTestCase
+
+@property (nonatomic, strong) NSOperationQueue *operationQueue;
+@property (nonatomic, strong) SDWebImageDownloadScheduler *scheduler;
+// 执行过的操作的名字，按执行顺序
+@property (nonatomic, strong) NSMutableArray<NSString *> *runOrder;
+@property (nonatomic, strong) dispatch_semaphore_t gate;
+
+@end
+
+@implementation SDWebImageDownloadSchedulerTests
+
+- (void)setUp {
+    [super setUp];
+    self.operationQueue = [NSOperationQueue new];
+    self.operationQueue.maxConcurrentOperationCount = 1;
+    self.scheduler = [[SDWebImageDownloadScheduler alloc] initWithOperationQueue:self.operationQueue];
+    self.scheduler.agingInterval = 0;
+    self.runOrder = [NSMutableArray array];
+    // 第一个操作占住唯一的名额，直到 openGate，之后加入的操作都在调度器中排队
+    self.gate = dispatch_semaphore_create(0);
+    dispatch_semaphore_t gate = self.gate;
+    [self.scheduler addOperation:[NSBlockOperation blockOperationWithBlock:^{
+        dispatch_semaphore_wait(gate, DISPATCH_TIME_FOREVER);
+    }] priority:SDWebImageDownloaderPriorityNormal];
+}
+
+- (void)tearDown {
+    dispatch_semaphore_signal(self.gate);
+    [self.operationQueue waitUntilAllOperationsAreFinished];
+    self.scheduler = nil;
+    [super tearDown];
+}
+
+- (NSOperation *)operationNamed:(NSString *)name {
+    NSMutableArray<NSString *> *runOrder = self.runOrder;
+    return [NSBlockOperation blockOperationWithBlock:^{
+        @synchronized (runOrder) {
+            [runOrder addObject:name];
+        }
+    }];
+}
+
+- (NSOperation *)addOperationNamed:(NSString *)name priority:(SDWebImageDownloaderPriority)priority {
+    NSOperation *operation = [self operationNamed:name];
+    [self.scheduler addOperation:operation priority:priority];
+    return operation;
+}
+
+// 放开占住名额的操作，等待所有操作执行完
+- (NSArray<NSString *> *)openGate {
+    dispatch_semaphore_signal(self.gate);
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:kAsyncTestTimeout];
+    while ((self.scheduler.pendingOperationCount > 0 || self.operationQueue.operationCount > 0) && [deadline timeIntervalSinceNow] > 0) {
+        [NSThread sleepForTimeInterval:0.005];
+    }
+    XCTAssertEqual(self.scheduler.pendingOperationCount, 0);
+    @synchronized (self.runOrder) {
+        return [self.runOrder copy];
+    }
+}
+
+- (void)test01RunsByPriority {
+    [self addOperationNamed:@"low" priority:SDWebImageDownloaderPriorityLow];
+    [self addOperationNamed:@"visible" priority:SDWebImageDownloaderPriorityVisible];
+    [self addOperationNamed:@"normal" priority:SDWebImageDownloaderPriorityNormal];
+    [self addOperationNamed:@"prefetch" priority:SDWebImageDownloaderPriorityPrefetch];
+    [self addOperationNamed:@"high" priority:SDWebImageDownloaderPriorityHigh];
+    XCTAssertEqual(self.scheduler.pendingOperationCount, 5);
+    XCTAssertEqualObjects([self openGate], (@[@"visible", @"high", @"normal", @"low", @"prefetch"]));
+}
+
+- (void)test02ExecutionOrderWithinAPriority {
+    [self addOperationNamed:@"1" priority:SDWebImageDownloaderPriorityNormal];
+    [self addOperationNamed:@"2" priority:SDWebImageDownloaderPriorityNormal];
+    self.scheduler.executionOrder = SDWebImageDownloaderLIFOExecutionOrder;
+    NSOperation *operation = [self addOperationNamed:@"3" priority:SDWebImageDownloaderPriorityNormal];
+    [self addOperationNamed:@"high" priority:SDWebImageDownloaderPriorityHigh];
+    // LIFO 不依赖 addDependency: 串起来的依赖链
+    XCTAssertEqual(operation.dependencies.count, 0);
+    XCTAssertEqualObjects([self openGate], (@[@"high", @"3", @"2", @"1"]));
+}
+
+- (void)test03FIFOWithinAPriority {
+    for (NSUInteger i = 0; i < 5; i++) {
+        [self addOperationNamed:[NSString stringWithFormat:@"%lu", (unsigned long)i] priority:SDWebImageDownloaderPriorityLow];
+    }
+    XCTAssertEqualObjects([self openGate], (@[@"0", @"1", @"2", @"3", @"4"]));
+}
+
+- (void)test04Reprioritization {
+    NSOperation *first = [self addOperationNamed:@"first" priority:SDWebImageDownloaderPriorityLow];
+    NSOperation *second = [self addOperationNamed:@"second" priority:SDWebImageDownloaderPriorityLow];
+    NSOperation *third = [self addOperationNamed:@"third" priority:SDWebImageDownloaderPriorityNormal];
+    [self addOperationNamed:@"fourth" priority:SDWebImageDownloaderPriorityNormal];
+    // cell 滚入屏幕
+    [self.scheduler setPriority:SDWebImageDownloaderPriorityVisible forOperation:second];
+    XCTAssertEqual(second.queuePriority, NSOperationQueuePriorityVeryHigh);
+    // cell 滚出屏幕
+    [self.scheduler setPriority:SDWebImageDownloaderPriorityPrefetch forOperation:third];
+    XCTAssertEqual(third.queuePriority, NSOperationQueuePriorityVeryLow);
+    // 优先级不变时什么都不做
+    [self.scheduler setPriority:SDWebImageDownloaderPriorityLow forOperation:first];
+    XCTAssertEqual(first.queuePriority, NSOperationQueuePriorityLow);
+    XCTAssertEqualObjects([self openGate], (@[@"second", @"fourth", @"first", @"third"]));
+}
+
+- (void)test05ReprioritizationKeepsTheQueueOrder {
+    [self addOperationNamed:@"a" priority:SDWebImageDownloaderPriorityNormal];
+    NSOperation *b = [self addOperationNamed:@"b" priority:SDWebImageDownloaderPriorityLow];
+    [self addOperationNamed:@"c" priority:SDWebImageDownloaderPriorityNormal];
+    // b 入队比 c 早，提升到 Normal 后排在 c 前面
+    [self.scheduler setPriority:SDWebImageDownloaderPriorityNormal forOperation:b];
+    XCTAssertEqualObjects([self openGate], (@[@"a", @"b", @"c"]));
+}
+
+- (void)test06WaitingOperationsAge {
+    self.scheduler.agingInterval = 0.1;
+    [self addOperationNamed:@"prefetch" priority:SDWebImageDownloaderPriorityPrefetch];
+    [NSThread sleepForTimeInterval:0.35];
+    // prefetch 等待了三个间隔，有效优先级是 High，排在新的 Normal 前面，但不超过新的 Visible
+    [self addOperationNamed:@"normal" priority:SDWebImageDownloaderPriorityNormal];
+    [self addOperationNamed:@"visible" priority:SDWebImageDownloaderPriorityVisible];
+    XCTAssertEqualObjects([self openGate], (@[@"visible", @"prefetch", @"normal"]));
+}
+
+- (void)test07NoAgingWithoutInterval {
+    [self addOperationNamed:@"prefetch" priority:SDWebImageDownloaderPriorityPrefetch];
+    [NSThread sleepForTimeInterval:0.2];
+    [self addOperationNamed:@"low" priority:SDWebImageDownloaderPriorityLow];
+    XCTAssertEqualObjects([self openGate], (@[@"low", @"prefetch"]));
+}
+
+- (void)test08RemovedOperationsDoNotRun {
+    NSOperation *cancelled = [self addOperationNamed:@"cancelled" priority:SDWebImageDownloaderPriorityVisible];
+    [self addOperationNamed:@"normal" priority:SDWebImageDownloaderPriorityNormal];
+    [cancelled cancel];
+    [self.scheduler removeOperation:cancelled];
+    XCTAssertEqual(self.scheduler.pendingOperationCount, 1);
+    // 取消的操作马上结束，不等待名额
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:kAsyncTestTimeout];
+    while (!cancelled.isFinished && [deadline timeIntervalSinceNow] > 0) {
+        [NSThread sleepForTimeInterval:0.005];
+    }
+    XCTAssertTrue(cancelled.isFinished);
+    XCTAssertEqualObjects([self openGate], (@[@"normal"]));
+}
+
+- (void)test09CancelAllOperations {
+    NSOperation *pending = [self addOperationNamed:@"pending" priority:SDWebImageDownloaderPriorityNormal];
+    [self.scheduler cancelAllOperations];
+    XCTAssertEqual(self.scheduler.pendingOperationCount, 0);
+    XCTAssertTrue(pending.isCancelled);
+    XCTAssertEqualObjects([self openGate], @[]);
+}
+
+#pragma mark - Benchmark
+
+static const NSUInteger kScrollVisibleCellCount = 8;
+static const NSUInteger kScrollPrefetchCellCount = 12;
+static const NSTimeInterval kScrollTick = 0.05;
+
+// 每个时间片第一个可见 cell 的位置：快速滑动、停下、慢速滑动、再快速滑动
+- (NSArray<NSNumber *> *)scrollTrace {
+    NSMutableArray<NSNumber *> *trace = [NSMutableArray array];
+    NSUInteger first = 0;
+    static const NSUInteger phases[][2] = {{40, 4}, {20, 0}, {40, 1}, {30, 6}, {20, 0}};
+    for (NSUInteger p = 0; p < sizeof(phases) / sizeof(phases[0]); p++) {
+        for (NSUInteger tick = 0; tick < phases[p][0]; tick++) {
+            [trace addObject:@(first)];
+            first += phases[p][1];
+        }
+    }
+    return trace;
+}
+
+// 模拟的下载，每个 cell 需要 30~80ms
+- (NSOperation *)downloadOperationForCell:(NSUInteger)cell finishTimes:(NSMutableDictionary<NSNumber *, NSNumber *> *)finishTimes start:(NSTimeInterval)start {
+    return [NSBlockOperation blockOperationWithBlock:^{
+        [NSThread sleepForTimeInterval:0.03 + (cell * 7 % 11) * 0.005];
+        @synchronized (finishTimes) {
+            finishTimes[@(cell)] = @(SDTestNow() - start);
+        }
+    }];
+}
+
+// 回放滑动记录，每个 cell 变为可见时请求图片，同时预加载后面的 cell。
+// 报告从 cell 变为可见到图片下载完成的时间，以及图片到达之前就滑出屏幕的 cell 数。
+// reprioritize 为 NO 时和以前一样：所有请求同一个优先级，先进先出，滑出屏幕的请求仍然按顺序执行
+- (void)replayScrollTrace:(NSArray<NSNumber *> *)trace reprioritize:(BOOL)reprioritize name:(NSString *)name {
+    NSOperationQueue *queue = [NSOperationQueue new];
+    queue.maxConcurrentOperationCount = 6;
+    SDWebImageDownloadScheduler *scheduler = [[SDWebImageDownloadScheduler alloc] initWithOperationQueue:queue];
+    if (!reprioritize) {
+        scheduler.agingInterval = 0;
+    }
+    NSMutableDictionary<NSNumber *, NSOperation *> *operations = [NSMutableDictionary dictionary];
+    NSMutableDictionary<NSNumber *, NSNumber *> *finishTimes = [NSMutableDictionary dictionary];
+    NSMutableDictionary<NSNumber *, NSNumber *> *visibleSince = [NSMutableDictionary dictionary];
+    NSMutableArray<NSNumber *> *latencies = [NSMutableArray array];
+    NSUInteger missedCount = 0;
+    NSTimeInterval start = SDTestNow();
+    for (NSNumber *firstVisible in trace) {
+        NSUInteger first = firstVisible.unsignedIntegerValue;
+        NSTimeInterval now = SDTestNow() - start;
+        NSDictionary<NSNumber *, NSNumber *> *finished;
+        @synchronized (finishTimes) {
+            finished = [finishTimes copy];
+        }
+        for (NSNumber *cell in visibleSince.allKeys) {
+            if (cell.unsignedIntegerValue >= first && cell.unsignedIntegerValue < first + kScrollVisibleCellCount) {
+                continue;
+            }
+            // 滑出屏幕
+            if (finished[cell]) {
+                [latencies addObject:@(MAX(finished[cell].doubleValue - visibleSince[cell].doubleValue, 0))];
+            } else {
+                missedCount++;
+                if (reprioritize) {
+                    [scheduler setPriority:SDWebImageDownloaderPriorityPrefetch forOperation:operations[cell]];
+                }
+            }
+            [visibleSince removeObjectForKey:cell];
+        }
+        for (NSUInteger i = first; i < first + kScrollVisibleCellCount + kScrollPrefetchCellCount; i++) {
+            BOOL visible = i < first + kScrollVisibleCellCount;
+            NSNumber *cell = @(i);
+            NSOperation *operation = operations[cell];
+            if (!operation) {
+                operation = [self downloadOperationForCell:i finishTimes:finishTimes start:start];
+                operations[cell] = operation;
+                SDWebImageDownloaderPriority priority = SDWebImageDownloaderPriorityNormal;
+                if (reprioritize) {
+                    priority = visible ? SDWebImageDownloaderPriorityVisible : SDWebImageDownloaderPriorityPrefetch;
+                }
+                [scheduler addOperation:operation priority:priority];
+            } else if (visible && !visibleSince[cell] && !finished[cell] && reprioritize) {
+                [scheduler setPriority:SDWebImageDownloaderPriorityVisible forOperation:operation];
+            }
+            if (visible && !visibleSince[cell]) {
+                visibleSince[cell] = @(now);
+            }
+        }
+        [NSThread sleepForTimeInterval:kScrollTick];
+    }
+    // 停止滑动之后等待屏幕上的图片
+    for (NSNumber *cell in visibleSince) {
+        [operations[cell] waitUntilFinished];
+        @synchronized (finishTimes) {
+            [latencies addObject:@(MAX(finishTimes[cell].doubleValue - visibleSince[cell].doubleValue, 0))];
+        }
+    }
+    [scheduler cancelAllOperations];
+    [queue waitUntilAllOperationsAreFinished];
+
+    double *samples = malloc(latencies.count * sizeof(double));
+    for (NSUInteger i = 0; i < latencies.count; i++) {
+        samples[i] = latencies[i].doubleValue * 1000;
+    }
+    [self reportBenchmark:[name stringByAppendingString:@" time to visible image p50"] value:SDTestPercentile(samples, latencies.count, 50) unit:@"ms"];
+    [self reportBenchmark:[name stringByAppendingString:@" time to visible image p99"] value:SDTestPercentile(samples, latencies.count, 99) unit:@"ms"];
+    [self reportBenchmark:[name stringByAppendingString:@" cells scrolled away before their image"] value:missedCount unit:@""];
+    free(samples);
+}
+
+- (void)test10ScrollTraceTimeToVisibleImageBenchmark {
+    if (!SDTestBenchmarkEnabled()) {
+        return;
+    }
+    NSArray<NSNumber *> *trace = [self scrollTrace];
+    [self replayScrollTrace:trace reprioritize:NO name:@"FIFO"];
+    [self replayScrollTrace:trace reprioritize:YES name:@"priorities"];
+}
+
+@end
@@ -0,0 +1,156 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDTestCase.h"
+#import "SDTestURLProtocol.h"
+#import "SDWebImageDownloader.h"
+
+@interface SDWebImageDownloaderURLMapTests : SDTestCase
+
+@property (nonatomic, strong) SDWebImageDownloader *downloader;
+
+@end
+
+@implementation SDWebImageDownloaderURLMapTests
+
+- (void)setUp {
+    [super setUp];
+    self.downloader = [[SDWebImageDownloader alloc] initWithSessionConfiguration:[SDTestURLProtocol sessionConfiguration]];
+    // 队列暂停时下载不会开始，只测试 URL 到 operation 的映射
+    [self.downloader setSuspended:YES];
+    NSData *imageData = [self PNGDataWithWidth:4 height:4];
+    [SDTestURLProtocol setHandler:^SDTestURLResponse *(NSURLRequest *request) {
+        return [SDTestURLResponse responseWithData:imageData];
+    }];
+}
+
+- (void)tearDown {
+    [self.downloader invalidateSessionAndCancel:YES];
+    self.downloader = nil;
+    [SDTestURLProtocol reset];
+    [super tearDown];
+}
+
+- (NSURL *)URLAtIndex:(NSUInteger)index {
+    return [NSURL URLWithString:[NSString stringWithFormat:@"http://example.com/image%lu.png", (unsigned long)index]];
+}
+
+- (BOOL)waitForCondition:(BOOL (^)(void))condition {
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:kAsyncTestTimeout];
+    while (!condition()) {
+        if ([deadline timeIntervalSinceNow] < 0) {
+            return NO;
+        }
+        [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+    return YES;
+}
+
+- (void)test01ConcurrentRequestsCoalesce {
+    const size_t URLCount = 50;
+    const size_t requestsPerURL = 20;
+    dispatch_apply(URLCount * requestsPerURL, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        [self.downloader downloadImageWithURL:[self URLAtIndex:i % URLCount] options:0 progress:nil completed:^(UIImage *image, NSData *data, NSError *error, BOOL finished) {}];
+    });
+    // 每个 URL 只有一个下载
+    XCTAssertEqual(self.downloader.currentDownloadCount, URLCount);
+}
+
+- (void)test02ConcurrentAddAndCancel {
+    const size_t URLCount = 64;
+    const size_t pairsPerThread = 1000;
+    __block NSUInteger completedCount = 0;
+    dispatch_apply(8, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t thread) {
+        for (size_t i = 0; i < pairsPerThread; i++) {
+            SDWebImageDownloadToken *token = [self.downloader downloadImageWithURL:[self URLAtIndex:(thread * pairsPerThread + i) % URLCount] options:0 progress:nil completed:^(UIImage *image, NSData *data, NSError *error, BOOL finished) {
+                completedCount++;
+            }];
+            [self.downloader cancel:token];
+        }
+    });
+    [self.downloader setSuspended:NO];
+    XCTAssertTrue([self waitForCondition:^BOOL{
+        return self.downloader.currentDownloadCount == 0;
+    }]);
+    // 所有请求都取消了，不会访问网络，也不会回调
+    XCTAssertEqual([SDTestURLProtocol requests].count, 0);
+    XCTAssertEqual(completedCount, 0);
+}
+
+- (void)test03CancellingOneTokenKeepsTheDownload {
+    NSURL *url = [self URLAtIndex:0];
+    __block NSUInteger keptCount = 0;
+    SDWebImageDownloadToken *cancelledToken = [self.downloader downloadImageWithURL:url options:0 progress:nil completed:^(UIImage *image, NSData *data, NSError *error, BOOL finished) {
+        XCTFail(@"A cancelled token must not be called");
+    }];
+    [self.downloader downloadImageWithURL:url options:0 progress:nil completed:^(UIImage *image, NSData *data, NSError *error, BOOL finished) {
+        XCTAssertNotNil(image);
+        keptCount++;
+    }];
+    [self.downloader cancel:cancelledToken];
+    // 取消两次也只影响自己的回调
+    [self.downloader cancel:cancelledToken];
+    XCTAssertEqual(self.downloader.currentDownloadCount, 1);
+    [self.downloader setSuspended:NO];
+    XCTAssertTrue([self waitForCondition:^BOOL{
+        return keptCount == 1 && self.downloader.currentDownloadCount == 0;
+    }]);
+    XCTAssertEqual([SDTestURLProtocol requestCountForURL:url], 1);
+}
+
+- (void)test04ChurnDoesNotLoseWaitingRequests {
+    const NSUInteger URLCount = 16;
+    NSMutableArray<NSNumber *> *completedCounts = [NSMutableArray array];
+    for (NSUInteger i = 0; i < URLCount; i++) {
+        [completedCounts addObject:@0];
+        [self.downloader downloadImageWithURL:[self URLAtIndex:i] options:0 progress:nil completed:^(UIImage *image, NSData *data, NSError *error, BOOL finished) {
+            XCTAssertNotNil(image);
+            completedCounts[i] = @(completedCounts[i].unsignedIntegerValue + 1);
+        }];
+    }
+    // 同一批 URL 上反复添加和取消其他请求
+    dispatch_apply(8, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t thread) {
+        for (size_t i = 0; i < 2000; i++) {
+            SDWebImageDownloadToken *token = [self.downloader downloadImageWithURL:[self URLAtIndex:(thread + i) % URLCount] options:SDWebImageDownloaderHighPriority progress:nil completed:^(UIImage *image, NSData *data, NSError *error, BOOL finished) {
+                XCTFail(@"A cancelled token must not be called");
+            }];
+            [self.downloader cancel:token];
+        }
+    });
+    XCTAssertEqual(self.downloader.currentDownloadCount, URLCount);
+    [self.downloader setSuspended:NO];
+    XCTAssertTrue([self waitForCondition:^BOOL{
+        return self.downloader.currentDownloadCount == 0;
+    }]);
+    XCTAssertTrue([self waitForCondition:^BOOL{
+        return [completedCounts indexOfObject:@0] == NSNotFound;
+    }]);
+    for (NSUInteger i = 0; i < URLCount; i++) {
+        XCTAssertEqualObjects(completedCounts[i], @1);
+        XCTAssertEqual([SDTestURLProtocol requestCountForURL:[self URLAtIndex:i]], 1);
+    }
+}
+
+- (void)test05AddAndCancelPerformance {
+    // 8 个线程共 100k 次添加和取消，URL 分布在所有分片上
+    const size_t threadCount = 8;
+    const size_t pairsPerThread = 100000 / threadCount;
+    const size_t URLCount = 256;
+    [self measureBlock:^{
+        dispatch_apply(threadCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t thread) {
+            for (size_t i = 0; i < pairsPerThread; i++) {
+                @autoreleasepool {
+                    SDWebImageDownloadToken *token = [self.downloader downloadImageWithURL:[self URLAtIndex:(thread * pairsPerThread + i) % URLCount] options:0 progress:nil completed:nil];
+                    [self.downloader cancel:token];
+                }
+            }
+        });
+    }];
+}
+
+@end
@@ -0,0 +1,146 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDTestCase.h"
+#import "SDTestURLProtocol.h"
+#import "SDImageCache.h"
+#import "SDWebImageDownloader.h"
+#import "SDWebImageManager.h"
+
+static const NSUInteger kChurnOperationCount = 10000;
+
+@interface SDWebImageManager ()
+
+@property (strong, nonatomic, nonnull) NSMutableDictionary<NSURL *, id> *failedURLs;
+
+- (BOOL)isFailedURL:(nonnull NSURL *)url;
+- (void)recordFailedURL:(nonnull NSURL *)url;
+- (void)removeFailedURL:(nonnull NSURL *)url;
+
+@end
+
+@interface SDWebImageManagerChurnTests : SDTestCase
+
+@property (nonatomic, strong) SDImageCache *cache;
+@property (nonatomic, strong) SDWebImageDownloader *downloader;
+@property (nonatomic, strong) SDWebImageManager *manager;
+@property (nonatomic, copy) NSArray<NSURL *> *URLs;
+
+@end
+
+@implementation SDWebImageManagerChurnTests
+
+- (void)setUp {
+    [super setUp];
+    self.cache = [[SDImageCache alloc] initWithNamespace:@"churn" diskCacheDirectory:self.temporaryDirectory];
+    self.downloader = [[SDWebImageDownloader alloc] initWithSessionConfiguration:[SDTestURLProtocol sessionConfiguration]];
+    // 下载不会开始，加载停留在缓存查询或者下载队列中，直到被取消
+    [self.downloader setSuspended:YES];
+    self.manager = [[SDWebImageManager alloc] initWithCache:self.cache downloader:self.downloader];
+    NSMutableArray<NSURL *> *URLs = [NSMutableArray arrayWithCapacity:kChurnOperationCount];
+    for (NSUInteger i = 0; i < kChurnOperationCount; i++) {
+        [URLs addObject:[NSURL URLWithString:[NSString stringWithFormat:@"http://example.com/image%lu.png", (unsigned long)i]]];
+    }
+    self.URLs = URLs;
+}
+
+- (void)tearDown {
+    [self.manager cancelAll];
+    [self.downloader invalidateSessionAndCancel:YES];
+    self.manager = nil;
+    self.downloader = nil;
+    self.cache = nil;
+    [SDTestURLProtocol reset];
+    [super tearDown];
+}
+
+- (BOOL)waitForCondition:(BOOL (^)(void))condition {
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:kAsyncTestTimeout];
+    while (!condition()) {
+        if ([deadline timeIntervalSinceNow] < 0) {
+            return NO;
+        }
+        [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+    return YES;
+}
+
+// 开始 kChurnOperationCount 个加载，再按开始的顺序取消，每次取消都从正在执行的操作中移除一个
+- (void)loadAndCancelAll {
+    NSMutableArray<id<SDWebImageOperation>> *operations = [NSMutableArray arrayWithCapacity:kChurnOperationCount];
+    for (NSURL *url in self.URLs) {
+        [operations addObject:[self.manager loadImageWithURL:url options:0 progress:nil completed:^(UIImage *image, NSData *data, NSError *error, SDImageCacheType cacheType, BOOL finished, NSURL *imageURL) {}]];
+    }
+    for (id<SDWebImageOperation> operation in operations) {
+        [operation cancel];
+    }
+}
+
+- (void)test01ChurnLeavesNothingRunning {
+    [self loadAndCancelAll];
+    XCTAssertTrue([self waitForCondition:^BOOL{
+        return !self.manager.isRunning;
+    }]);
+    XCTAssertEqual(self.downloader.currentDownloadCount, 0u);
+}
+
+- (void)test02LoadAndCancelChurnPerformance {
+    [self measureBlock:^{
+        [self loadAndCancelAll];
+        XCTAssertTrue([self waitForCondition:^BOOL{
+            return !self.manager.isRunning;
+        }]);
+    }];
+}
+
+- (void)test03FailedURLsAreBoundedAndExpire {
+    self.manager.maxFailedURLCount = 100;
+    self.manager.failedURLRetryInterval = 60;
+    for (NSURL *url in self.URLs) {
+        [self.manager recordFailedURL:url];
+    }
+    XCTAssertEqual(self.manager.failedURLs.count, 100u);
+    // 最早记录的重试时间最早，最先被移除
+    XCTAssertFalse([self.manager isFailedURL:self.URLs.firstObject]);
+    XCTAssertTrue([self.manager isFailedURL:self.URLs.lastObject]);
+
+    // 重试时间过后可以再次下载
+    self.manager.failedURLRetryInterval = 0.2;
+    NSURL *url = self.URLs.firstObject;
+    [self.manager recordFailedURL:url];
+    XCTAssertTrue([self.manager isFailedURL:url]);
+    [NSThread sleepForTimeInterval:0.3];
+    XCTAssertFalse([self.manager isFailedURL:url]);
+    // 再次失败时间隔加倍
+    [self.manager recordFailedURL:url];
+    [NSThread sleepForTimeInterval:0.25];
+    XCTAssertTrue([self.manager isFailedURL:url]);
+    [NSThread sleepForTimeInterval:0.25];
+    XCTAssertFalse([self.manager isFailedURL:url]);
+    [self.manager removeFailedURL:url];
+
+    // 间隔为 0 时不会过期
+    self.manager.failedURLRetryInterval = 0;
+    [self.manager recordFailedURL:url];
+    XCTAssertTrue([self.manager isFailedURL:url]);
+}
+
+- (void)test04FailedURLChurnPerformance {
+    self.manager.maxFailedURLCount = 1000;
+    [self measureBlock:^{
+        for (NSURL *url in self.URLs) {
+            [self.manager recordFailedURL:url];
+            [self.manager isFailedURL:url];
+        }
+        for (NSURL *url in self.URLs) {
+            [self.manager removeFailedURL:url];
+        }
+    }];
+}
+
+@end
@@ -0,0 +1,211 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDTestCase.h"
+#import "SDTestURLProtocol.h"
+#import "SDImageCache.h"
+#import "SDWebImageCodersManager.h"
+#import "SDWebImageDownloader.h"
+#import "SDWebImageImageIOCoder.h"
+#import "SDWebImageManager.h"
+#import <stdatomic.h>
+
+static const NSUInteger kSignedURLCount = 50;
+
+// 统计解码次数的 coder，解码交给 ImageIO
+@interface SDTestCountingCoder : NSObject <SDWebImageCoder>
+
+@property (nonatomic, assign, readonly) NSUInteger decodeCount;
+
+@end
+
+@implementation SDTestCountingCoder {
+    atomic_uint _decodeCount;
+}
+
+- (NSUInteger)decodeCount {
+    return atomic_load(&_decodeCount);
+}
+
+- (BOOL)canDecodeFromData:(NSData *)data {
+    return [[SDWebImageImageIOCoder sharedCoder] canDecodeFromData:data];
+}
+
+- (UIImage *)decodedImageWithData:(NSData *)data {
+    atomic_fetch_add(&_decodeCount, 1);
+    return [[SDWebImageImageIOCoder sharedCoder] decodedImageWithData:data];
+}
+
+- (UIImage *)decompressedImageWithImage:(UIImage *)image data:(NSData *__autoreleasing  _Nullable *)data options:(NSDictionary<NSString *,NSObject *> *)optionsDict {
+    return [[SDWebImageImageIOCoder sharedCoder] decompressedImageWithImage:image data:data options:optionsDict];
+}
+
+- (BOOL)canEncodeToFormat:(SDImageFormat)format {
+    return [[SDWebImageImageIOCoder sharedCoder] canEncodeToFormat:format];
+}
+
+- (NSData *)encodedDataWithImage:(UIImage *)image format:(SDImageFormat)format {
+    return [[SDWebImageImageIOCoder sharedCoder] encodedDataWithImage:image format:format];
+}
+
+@end
+
+@interface SDWebImageManagerCoalescingTests : SDTestCase
+
+@property (nonatomic, strong) SDImageCache *cache;
+@property (nonatomic, strong) SDWebImageDownloader *downloader;
+@property (nonatomic, strong) SDWebImageManager *manager;
+@property (nonatomic, strong) SDTestCountingCoder *coder;
+
+@end
+
+@implementation SDWebImageManagerCoalescingTests
+
+- (void)setUp {
+    [super setUp];
+    self.cache = [[SDImageCache alloc] initWithNamespace:@"coalescing" diskCacheDirectory:self.temporaryDirectory];
+    self.downloader = [[SDWebImageDownloader alloc] initWithSessionConfiguration:[SDTestURLProtocol sessionConfiguration]];
+    self.downloader.resumeStore = nil;
+    self.manager = [[SDWebImageManager alloc] initWithCache:self.cache downloader:self.downloader];
+    // 签名不同的 URL 使用同一个缓存 key
+    self.manager.cacheKeyFilter = ^NSString *(NSURL *url) {
+        NSURLComponents *components = [NSURLComponents componentsWithURL:url resolvingAgainstBaseURL:NO];
+        components.query = nil;
+        return components.string;
+    };
+    self.coder = [SDTestCountingCoder new];
+    [[SDWebImageCodersManager sharedInstance] addCoder:self.coder];
+
+    NSData *data = [self PNGDataWithWidth:32 height:32];
+    [SDTestURLProtocol setHandler:^SDTestURLResponse *(NSURLRequest *request) {
+        SDTestURLResponse *response = [SDTestURLResponse responseWithData:data];
+        // 下载期间所有的加载都已经开始
+        response.delay = 0.2;
+        return response;
+    }];
+}
+
+- (void)tearDown {
+    [[SDWebImageCodersManager sharedInstance] removeCoder:self.coder];
+    [self.downloader invalidateSessionAndCancel:YES];
+    self.manager = nil;
+    self.downloader = nil;
+    self.cache = nil;
+    [SDTestURLProtocol reset];
+    [super tearDown];
+}
+
+- (NSURL *)signedURLAtIndex:(NSUInteger)index {
+    return [NSURL URLWithString:[NSString stringWithFormat:@"http://example.com/image.png?signature=%lu", (unsigned long)index]];
+}
+
+- (BOOL)waitForCondition:(BOOL (^)(void))condition {
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:kAsyncTestTimeout];
+    while (!condition()) {
+        if ([deadline timeIntervalSinceNow] < 0) {
+            return NO;
+        }
+        [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+    return YES;
+}
+
+// 从多个线程同时加载 kSignedURLCount 个签名不同的 URL，返回每个 URL 的回调
+- (NSDictionary<NSURL *, NSArray<UIImage *> *> *)loadSignedURLsFromIndex:(NSUInteger)firstIndex {
+    NSMutableDictionary<NSURL *, NSMutableArray<UIImage *> *> *results = [NSMutableDictionary dictionary];
+    NSLock *lock = [NSLock new];
+    __block NSUInteger completionCount = 0;
+    dispatch_apply(kSignedURLCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        NSURL *url = [self signedURLAtIndex:firstIndex + i];
+        [self.manager loadImageWithURL:url options:0 progress:nil completed:^(UIImage *image, NSData *data, NSError *error, SDImageCacheType cacheType, BOOL finished, NSURL *imageURL) {
+            XCTAssertNil(error);
+            XCTAssertTrue(finished);
+            XCTAssertEqualObjects(imageURL, url);
+            [lock lock];
+            NSMutableArray<UIImage *> *images = results[url];
+            if (!images) {
+                images = [NSMutableArray array];
+                results[url] = images;
+            }
+            if (image) {
+                [images addObject:image];
+            }
+            completionCount++;
+            [lock unlock];
+        }];
+    });
+    XCTAssertTrue([self waitForCondition:^BOOL{
+        [lock lock];
+        BOOL done = completionCount >= kSignedURLCount;
+        [lock unlock];
+        return done;
+    }]);
+    // 确认没有多余的回调
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.2]];
+    [lock lock];
+    XCTAssertEqual(completionCount, kSignedURLCount);
+    NSDictionary *copy = [results copy];
+    [lock unlock];
+    return copy;
+}
+
+- (void)test01SignedURLsOfOneKeyDownloadAndDecodeOnce {
+    NSDictionary<NSURL *, NSArray<UIImage *> *> *results = [self loadSignedURLsFromIndex:0];
+    XCTAssertEqual(results.count, kSignedURLCount);
+    UIImage *sharedImage = results.allValues.firstObject.firstObject;
+    XCTAssertNotNil(sharedImage);
+    for (NSArray<UIImage *> *images in results.allValues) {
+        XCTAssertEqual(images.count, 1u);
+        // 解码一次，所有调用方得到同一个图片
+        XCTAssertEqual(images.firstObject, sharedImage);
+    }
+    XCTAssertEqual([SDTestURLProtocol requests].count, 1u);
+    XCTAssertEqual(self.coder.decodeCount, 1u);
+}
+
+- (void)test02LaterLoadsOfTheKeyHitTheCache {
+    [self loadSignedURLsFromIndex:0];
+    [self.cache flushDiskWrites];
+    NSDictionary<NSURL *, NSArray<UIImage *> *> *results = [self loadSignedURLsFromIndex:kSignedURLCount];
+    XCTAssertEqual(results.count, kSignedURLCount);
+    XCTAssertEqual([SDTestURLProtocol requests].count, 1u);
+    XCTAssertEqual(self.coder.decodeCount, 1u);
+
+    // 只有磁盘缓存时，一次缓存查询只解码一次
+    [self.cache clearMemory];
+    results = [self loadSignedURLsFromIndex:2 * kSignedURLCount];
+    XCTAssertEqual(results.count, kSignedURLCount);
+    XCTAssertEqual([SDTestURLProtocol requests].count, 1u);
+    XCTAssertEqual(self.coder.decodeCount, 2u);
+}
+
+- (void)test03CancelledLoadsDoNotCancelTheSharedDownload {
+    NSMutableArray<id<SDWebImageOperation>> *operations = [NSMutableArray array];
+    __block NSUInteger completionCount = 0;
+    for (NSUInteger i = 0; i < kSignedURLCount; i++) {
+        id<SDWebImageOperation> operation = [self.manager loadImageWithURL:[self signedURLAtIndex:i] options:0 progress:nil completed:^(UIImage *image, NSData *data, NSError *error, SDImageCacheType cacheType, BOOL finished, NSURL *imageURL) {
+            XCTAssertNotNil(image);
+            XCTAssertEqualObjects(imageURL, [self signedURLAtIndex:kSignedURLCount - 1]);
+            completionCount++;
+        }];
+        [operations addObject:operation];
+    }
+    // 取消除最后一个以外的加载，下载继续进行
+    for (NSUInteger i = 0; i + 1 < kSignedURLCount; i++) {
+        [operations[i] cancel];
+    }
+    XCTAssertTrue([self waitForCondition:^BOOL{
+        return completionCount > 0;
+    }]);
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.2]];
+    XCTAssertEqual(completionCount, 1u);
+    XCTAssertEqual([SDTestURLProtocol requests].count, 1u);
+    XCTAssertEqual(self.coder.decodeCount, 1u);
+}
+
+@end
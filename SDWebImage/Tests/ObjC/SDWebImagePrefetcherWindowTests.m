@@ -0,0 +1,234 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDTestCase.h"
+#import "SDTestURLProtocol.h"
+#import "SDImageCache.h"
+#import "SDWebImageDownloader.h"
+#import "SDWebImageManager.h"
+#import "SDWebImagePrefetcher.h"
+
+static const NSUInteger kRowCount = 200;
+static const NSUInteger kVisibleRowCount = 8;
+
+@interface SDWebImagePrefetcher ()
+
+@property (copy, nonatomic, nonnull) NSArray<NSURL *> *windowTargetURLs;
+@property (strong, nonatomic, nonnull) NSMutableDictionary<NSURL *, id> *windowOperations;
+@property (strong, nonatomic, nonnull) dispatch_semaphore_t windowLock;
+
+@end
+
+// 滚动轨迹中的一步：可见的第一行和滚动速度（行/秒）
+typedef struct SDScrollStep {
+    NSUInteger firstVisibleRow;
+    CGFloat velocity;
+} SDScrollStep;
+
+@interface SDWebImagePrefetcherWindowTests : SDTestCase
+
+@property (nonatomic, strong) SDImageCache *cache;
+@property (nonatomic, strong) SDWebImageDownloader *downloader;
+@property (nonatomic, strong) SDWebImageManager *manager;
+@property (nonatomic, strong) SDWebImagePrefetcher *prefetcher;
+@property (nonatomic, copy) NSArray<NSURL *> *URLs;
+
+@end
+
+@implementation SDWebImagePrefetcherWindowTests
+
+- (void)setUp {
+    [super setUp];
+    self.cache = [[SDImageCache alloc] initWithNamespace:@"window" diskCacheDirectory:self.temporaryDirectory];
+    self.downloader = [[SDWebImageDownloader alloc] initWithSessionConfiguration:[SDTestURLProtocol sessionConfiguration]];
+    self.downloader.resumeStore = nil;
+    self.manager = [[SDWebImageManager alloc] initWithCache:self.cache downloader:self.downloader];
+    self.prefetcher = [[SDWebImagePrefetcher alloc] initWithImageManager:self.manager];
+    self.prefetcher.maxConcurrentDownloads = 4;
+    NSMutableArray<NSURL *> *URLs = [NSMutableArray arrayWithCapacity:kRowCount];
+    for (NSUInteger i = 0; i < kRowCount; i++) {
+        [URLs addObject:[NSURL URLWithString:[NSString stringWithFormat:@"http://example.com/row%lu.png", (unsigned long)i]]];
+    }
+    self.URLs = URLs;
+    self.prefetcher.windowURLs = URLs;
+
+    NSData *data = [self PNGDataWithWidth:8 height:8];
+    [SDTestURLProtocol setHandler:^SDTestURLResponse *(NSURLRequest *request) {
+        SDTestURLResponse *response = [SDTestURLResponse responseWithData:data];
+        // 下载跨过轨迹中的几步，滚动时窗口里总有正在进行的下载
+        response.delay = 0.1;
+        return response;
+    }];
+}
+
+- (void)tearDown {
+    [self.prefetcher cancelPrefetching];
+    [self.downloader invalidateSessionAndCancel:YES];
+    self.prefetcher = nil;
+    self.manager = nil;
+    self.downloader = nil;
+    self.cache = nil;
+    [SDTestURLProtocol reset];
+    [super tearDown];
+}
+
+- (BOOL)waitForCondition:(BOOL (^)(void))condition {
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:kAsyncTestTimeout];
+    while (!condition()) {
+        if ([deadline timeIntervalSinceNow] < 0) {
+            return NO;
+        }
+        [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+    return YES;
+}
+
+- (NSArray<NSURL *> *)URLsOfRows:(NSArray<NSNumber *> *)rows {
+    NSMutableArray<NSURL *> *URLs = [NSMutableArray arrayWithCapacity:rows.count];
+    for (NSNumber *row in rows) {
+        [URLs addObject:self.URLs[row.unsignedIntegerValue]];
+    }
+    return URLs;
+}
+
+- (NSSet<NSURL *> *)runningWindowURLs {
+    SD_LOCK(self.prefetcher.windowLock);
+    NSSet<NSURL *> *URLs = [NSSet setWithArray:self.prefetcher.windowOperations.allKeys];
+    SD_UNLOCK(self.prefetcher.windowLock);
+    return URLs;
+}
+
+// 和 updateWindowWithVisibleRange:velocity: 无关地算出滚动方向上应该预取的行
+- (NSArray<NSURL *> *)expectedWindowForStep:(SDScrollStep)step {
+    double length = self.prefetcher.minimumWindowLength + fabs(step.velocity) * self.prefetcher.windowLookaheadTime;
+    NSUInteger windowLength = (NSUInteger)MIN(length, (double)self.prefetcher.maximumWindowLength);
+    NSUInteger first = step.firstVisibleRow;
+    NSUInteger end = first + kVisibleRowCount;
+    NSMutableArray<NSURL *> *URLs = [NSMutableArray array];
+    for (NSUInteger i = 0; i < windowLength; i++) {
+        if (step.velocity > 0 && end + i < kRowCount) {
+            [URLs addObject:self.URLs[end + i]];
+        } else if (step.velocity < 0 && i < first) {
+            [URLs addObject:self.URLs[first - i - 1]];
+        } else if (step.velocity == 0) {
+            // 静止时前后交替
+            NSUInteger distance = i / 2;
+            if (i % 2 == 0 && end + distance < kRowCount) {
+                [URLs addObject:self.URLs[end + distance]];
+            } else if (i % 2 == 1 && distance < first) {
+                [URLs addObject:self.URLs[first - distance - 1]];
+            }
+        }
+    }
+    return URLs;
+}
+
+// 窗口里的图片都已经预取到缓存中
+- (BOOL)waitForWindowPrefetched {
+    return [self waitForCondition:^BOOL{
+        for (NSURL *url in self.prefetcher.windowTargetURLs) {
+            if (![self.cache imageFromMemoryCacheForKey:[self.manager cacheKeyForURL:url]]) {
+                return NO;
+            }
+        }
+        return YES;
+    }];
+}
+
+// 按轨迹移动窗口，每一步检查窗口和正在进行的下载，步与步之间让下载进行 interval 秒
+- (void)replaySteps:(const SDScrollStep *)steps count:(NSUInteger)count interval:(NSTimeInterval)interval {
+    for (NSUInteger i = 0; i < count; i++) {
+        SDScrollStep step = steps[i];
+        NSRange visibleRange = NSMakeRange(step.firstVisibleRow, kVisibleRowCount);
+        [self.prefetcher updateWindowWithVisibleRange:visibleRange velocity:step.velocity];
+
+        NSArray<NSURL *> *window = [self expectedWindowForStep:step];
+        XCTAssertEqualObjects(self.prefetcher.windowTargetURLs, window, @"step %lu", (unsigned long)i);
+        NSMutableSet<NSURL *> *keptURLs = [NSMutableSet setWithArray:window];
+        [keptURLs addObjectsFromArray:[self.URLs subarrayWithRange:visibleRange]];
+        NSSet<NSURL *> *runningURLs = [self runningWindowURLs];
+        // 离开窗口和可见范围的下载已经取消，并发数不超过上限
+        XCTAssertTrue([runningURLs isSubsetOfSet:keptURLs], @"step %lu", (unsigned long)i);
+        XCTAssertLessThanOrEqual(runningURLs.count, self.prefetcher.maxConcurrentDownloads, @"step %lu", (unsigned long)i);
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:interval]];
+    }
+}
+
+- (void)test01StationaryWindowAlternatesAroundTheVisibleRange {
+    [self.downloader setSuspended:YES];
+    [self.prefetcher updateWindowWithVisibleRange:NSMakeRange(10, kVisibleRowCount) velocity:0];
+    XCTAssertEqualObjects(self.prefetcher.windowTargetURLs, ([self URLsOfRows:@[@18, @9, @19, @8]]));
+    // 最前面只能往后预取
+    [self.prefetcher updateWindowWithVisibleRange:NSMakeRange(0, kVisibleRowCount) velocity:0];
+    XCTAssertEqualObjects(self.prefetcher.windowTargetURLs, ([self URLsOfRows:@[@8, @9]]));
+}
+
+- (void)test02WindowGrowsWithVelocityUpToTheMaximum {
+    [self.downloader setSuspended:YES];
+    SDScrollStep steps[] = {{20, 10}, {20, -10}, {100, 26}, {100, 1000}, {180, 1000}, {5, -1000}};
+    for (NSUInteger i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+        [self.prefetcher updateWindowWithVisibleRange:NSMakeRange(steps[i].firstVisibleRow, kVisibleRowCount) velocity:steps[i].velocity];
+        XCTAssertEqualObjects(self.prefetcher.windowTargetURLs, [self expectedWindowForStep:steps[i]], @"step %lu", (unsigned long)i);
+    }
+    XCTAssertEqual(self.prefetcher.windowTargetURLs.count, 5u);
+    [self.prefetcher updateWindowWithVisibleRange:NSMakeRange(100, kVisibleRowCount) velocity:1000];
+    XCTAssertEqual(self.prefetcher.windowTargetURLs.count, self.prefetcher.maximumWindowLength);
+}
+
+- (void)test03ReplayScrollingDown {
+    // 每 0.05 秒滚动 2 行，40 行/秒，最后停在第 120 行
+    NSMutableData *trace = [NSMutableData data];
+    for (NSUInteger row = 0; row <= 120; row += 2) {
+        SDScrollStep step = {row, row < 120 ? 40 : 0};
+        [trace appendBytes:&step length:sizeof(step)];
+    }
+    [self replaySteps:trace.bytes count:trace.length / sizeof(SDScrollStep) interval:0.05];
+
+    // 停下来以后窗口里的图片都会预取到缓存中
+    XCTAssertEqualObjects(self.prefetcher.windowTargetURLs, ([self URLsOfRows:@[@128, @119, @129, @118]]));
+    XCTAssertTrue([self waitForWindowPrefetched]);
+    // 一直往下滚动，取消的 URL 不会回到窗口中，每个 URL 最多下载一次
+    for (NSURL *url in self.URLs) {
+        XCTAssertLessThanOrEqual([SDTestURLProtocol requestCountForURL:url], 1u, @"%@", url);
+    }
+}
+
+- (void)test04ReplayScrollingBackUp {
+    SDScrollStep down[] = {{60, 40}, {62, 40}, {64, 40}};
+    [self replaySteps:down count:3 interval:0.02];
+    NSSet<NSURL *> *aheadURLs = [self runningWindowURLs];
+    XCTAssertGreaterThan(aheadURLs.count, 0u);
+
+    // 反向滚动时取消前方的下载，改为预取可见范围上面的行
+    SDScrollStep up[] = {{64, -40}, {62, -40}, {60, -40}, {58, -40}, {56, 0}};
+    [self replaySteps:up count:5 interval:0.05];
+    NSSet<NSURL *> *runningURLs = [self runningWindowURLs];
+    XCTAssertFalse([aheadURLs intersectsSet:runningURLs]);
+    XCTAssertTrue([self waitForWindowPrefetched]);
+}
+
+- (void)test05ReplayPerformance {
+    [self.downloader setSuspended:YES];
+    // 来回滚动整个列表，只统计移动窗口的开销
+    NSMutableData *trace = [NSMutableData data];
+    for (NSUInteger pass = 0; pass < 5; pass++) {
+        for (NSUInteger row = 0; row + kVisibleRowCount < kRowCount; row++) {
+            SDScrollStep step = {pass % 2 == 0 ? row : kRowCount - kVisibleRowCount - row, pass % 2 == 0 ? 60 : -60};
+            [trace appendBytes:&step length:sizeof(step)];
+        }
+    }
+    const SDScrollStep *steps = trace.bytes;
+    NSUInteger count = trace.length / sizeof(SDScrollStep);
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < count; i++) {
+            [self.prefetcher updateWindowWithVisibleRange:NSMakeRange(steps[i].firstVisibleRow, kVisibleRowCount) velocity:steps[i].velocity];
+        }
+    }];
+}
+
+@end
@@ -0,0 +1,283 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDTestCase.h"
+#import "SDTestURLProtocol.h"
+#import "SDImageCache.h"
+#import "SDWebImageDownloader.h"
+#import "SDWebImageManager.h"
+
+static NSString * const kLastModified = @"Wed, 21 Oct 2015 07:28:00 GMT";
+
+@interface SDWebImageRevalidationTests : SDTestCase
+
+@property (nonatomic, strong) SDImageCache *cache;
+@property (nonatomic, strong) SDWebImageDownloader *downloader;
+@property (nonatomic, strong) SDWebImageManager *manager;
+@property (nonatomic, strong) NSURL *url;
+
+@end
+
+@implementation SDWebImageRevalidationTests
+
+- (void)setUp {
+    [super setUp];
+    self.cache = [[SDImageCache alloc] initWithNamespace:@"revalidation" diskCacheDirectory:self.temporaryDirectory];
+    self.downloader = [[SDWebImageDownloader alloc] initWithSessionConfiguration:[SDTestURLProtocol sessionConfiguration]];
+    self.downloader.resumeStore = nil;
+    self.manager = [[SDWebImageManager alloc] initWithCache:self.cache downloader:self.downloader];
+    self.url = [NSURL URLWithString:@"http://example.com/revalidate.png"];
+}
+
+- (void)tearDown {
+    [self.downloader invalidateSessionAndCancel:YES];
+    self.manager = nil;
+    self.downloader = nil;
+    self.cache = nil;
+    [SDTestURLProtocol reset];
+    [super tearDown];
+}
+
+- (NSString *)key {
+    return [self.manager cacheKeyForURL:self.url];
+}
+
+- (NSHTTPURLResponse *)responseWithHeaders:(NSDictionary<NSString *, NSString *> *)headers statusCode:(NSInteger)statusCode {
+    return [[NSHTTPURLResponse alloc] initWithURL:self.url statusCode:statusCode HTTPVersion:@"HTTP/1.1" headerFields:headers];
+}
+
+- (BOOL)waitForCondition:(BOOL (^)(void))condition {
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:kAsyncTestTimeout];
+    while (!condition()) {
+        if ([deadline timeIntervalSinceNow] < 0) {
+            return NO;
+        }
+        [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+    return YES;
+}
+
+// 加载一次，返回每次回调的图片数据，等待 settleTime 确认没有更多的回调
+- (NSArray<NSData *> *)loadWithOptions:(SDWebImageOptions)options settleTime:(NSTimeInterval)settleTime {
+    NSMutableArray<NSData *> *results = [NSMutableArray array];
+    [self.manager loadImageWithURL:self.url options:options progress:nil completed:^(UIImage *image, NSData *data, NSError *error, SDImageCacheType cacheType, BOOL finished, NSURL *imageURL) {
+        XCTAssertNil(error);
+        XCTAssertNotNil(image);
+        [results addObject:data ?: [NSData data]];
+    }];
+    XCTAssertTrue([self waitForCondition:^BOOL{
+        return results.count > 0;
+    }]);
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:settleTime]];
+    [self.cache flushDiskWrites];
+    return results;
+}
+
+#pragma mark - Cache
+
+- (void)test01ValidatorsAreStoredWithTheImage {
+    UIImage *image = [[UIImage alloc] initWithData:[self PNGDataWithWidth:8 height:8]];
+    NSHTTPURLResponse *response = [self responseWithHeaders:@{@"ETag": @"\"v1\"", @"Last-Modified": kLastModified, @"Cache-Control": @"max-age=3600"} statusCode:200];
+    [self.cache storeImage:image imageData:[self PNGDataWithWidth:8 height:8] forKey:self.key response:response toDisk:YES completion:nil];
+    [self.cache flushDiskWrites];
+    XCTAssertEqualObjects([self.cache conditionalRequestHeadersForKey:self.key], (@{@"If-None-Match": @"\"v1\"", @"If-Modified-Since": kLastModified}));
+    XCTAssertTrue([self.cache isDiskImageFreshForKey:self.key]);
+    XCTAssertNil([self.cache conditionalRequestHeadersForKey:@"http://example.com/missing.png"]);
+    XCTAssertFalse([self.cache isDiskImageFreshForKey:@"http://example.com/missing.png"]);
+}
+
+- (void)test02FreshnessHeaders {
+    UIImage *image = [[UIImage alloc] initWithData:[self PNGDataWithWidth:8 height:8]];
+    NSData *data = [self PNGDataWithWidth:8 height:8];
+    NSArray<NSDictionary<NSString *, NSString *> *> *staleHeaders = @[@{@"ETag": @"\"v1\"", @"Cache-Control": @"max-age=3600, no-cache"},
+                                                                      @{@"ETag": @"\"v1\"", @"Cache-Control": @"max-age=60", @"Age": @"120"},
+                                                                      @{@"ETag": @"\"v1\"", @"Expires": kLastModified},
+                                                                      @{@"ETag": @"\"v1\""}];
+    for (NSDictionary<NSString *, NSString *> *headers in staleHeaders) {
+        [self.cache storeImage:image imageData:data forKey:self.key response:[self responseWithHeaders:headers statusCode:200] toDisk:YES completion:nil];
+        [self.cache flushDiskWrites];
+        XCTAssertFalse([self.cache isDiskImageFreshForKey:self.key], @"%@", headers);
+    }
+    [self.cache storeImage:image imageData:data forKey:self.key response:[self responseWithHeaders:@{@"Expires": @"Fri, 01 Jan 2100 00:00:00 GMT"} statusCode:200] toDisk:YES completion:nil];
+    [self.cache flushDiskWrites];
+    XCTAssertTrue([self.cache isDiskImageFreshForKey:self.key]);
+}
+
+- (void)test03NotModifiedResponseRefreshesTheEntry {
+    UIImage *image = [[UIImage alloc] initWithData:[self PNGDataWithWidth:8 height:8]];
+    [self.cache storeImage:image imageData:[self PNGDataWithWidth:8 height:8] forKey:self.key response:[self responseWithHeaders:@{@"ETag": @"\"v1\""} statusCode:200] toDisk:YES completion:nil];
+    [self.cache flushDiskWrites];
+    XCTAssertFalse([self.cache isDiskImageFreshForKey:self.key]);
+    // 304 没有带校验信息时沿用之前的
+    [self.cache refreshDiskImageForKey:self.key withNotModifiedResponse:[self responseWithHeaders:@{@"Cache-Control": @"max-age=3600"} statusCode:304]];
+    [self.cache flushDiskWrites];
+    XCTAssertTrue([self.cache isDiskImageFreshForKey:self.key]);
+    XCTAssertEqualObjects([self.cache conditionalRequestHeadersForKey:self.key], @{@"If-None-Match": @"\"v1\""});
+}
+
+#pragma mark - Manager
+
+- (void)test04NotModifiedKeepsTheCachedImage {
+    NSData *imageData = [self PNGDataWithWidth:8 height:8];
+    [SDTestURLProtocol setHandler:^SDTestURLResponse *(NSURLRequest *request) {
+        if ([[request valueForHTTPHeaderField:@"If-None-Match"] isEqualToString:@"\"v1\""]) {
+            XCTAssertEqualObjects([request valueForHTTPHeaderField:@"If-Modified-Since"], kLastModified);
+            SDTestURLResponse *response = [SDTestURLResponse responseWithData:nil];
+            response.statusCode = 304;
+            response.headerFields = @{@"Cache-Control": @"max-age=3600"};
+            return response;
+        }
+        SDTestURLResponse *response = [SDTestURLResponse responseWithData:imageData];
+        response.headerFields = @{@"ETag": @"\"v1\"", @"Last-Modified": kLastModified, @"Cache-Control": @"max-age=0"};
+        return response;
+    }];
+    XCTAssertEqual([self loadWithOptions:0 settleTime:0].count, 1);
+    XCTAssertFalse([self.cache isDiskImageFreshForKey:self.key]);
+
+    // 缓存的图片回调一次，304 不再回调
+    NSArray<NSData *> *results = [self loadWithOptions:SDWebImageRefreshCached settleTime:0.3];
+    XCTAssertEqual(results.count, 1);
+    XCTAssertEqual([SDTestURLProtocol requests].count, 2);
+    XCTAssertTrue([self waitForCondition:^BOOL{
+        return [self.cache isDiskImageFreshForKey:self.key];
+    }]);
+
+    // 304 带来了新的有效期，不需要再向服务器确认
+    XCTAssertEqual([self loadWithOptions:SDWebImageRefreshCached settleTime:0.3].count, 1);
+    XCTAssertEqual([SDTestURLProtocol requests].count, 2);
+}
+
+- (void)test05ChangedImageReplacesTheCachedImage {
+    NSData *oldImageData = [self PNGDataWithWidth:8 height:8];
+    NSData *newImageData = [self PNGDataWithWidth:16 height:16];
+    [SDTestURLProtocol setHandler:^SDTestURLResponse *(NSURLRequest *request) {
+        SDTestURLResponse *response;
+        if ([request valueForHTTPHeaderField:@"If-None-Match"]) {
+            response = [SDTestURLResponse responseWithData:newImageData];
+            response.headerFields = @{@"ETag": @"\"v2\""};
+        } else {
+            response = [SDTestURLResponse responseWithData:oldImageData];
+            response.headerFields = @{@"ETag": @"\"v1\""};
+        }
+        return response;
+    }];
+    [self loadWithOptions:0 settleTime:0];
+    NSMutableArray<NSData *> *results = [NSMutableArray array];
+    [self.manager loadImageWithURL:self.url options:SDWebImageRefreshCached progress:nil completed:^(UIImage *image, NSData *data, NSError *error, SDImageCacheType cacheType, BOOL finished, NSURL *imageURL) {
+        [results addObject:data ?: [NSData data]];
+    }];
+    XCTAssertTrue([self waitForCondition:^BOOL{
+        return results.count == 2;
+    }]);
+    XCTAssertEqualObjects(results.lastObject, newImageData);
+    [self.cache flushDiskWrites];
+    XCTAssertEqualObjects([self.cache conditionalRequestHeadersForKey:self.key], @{@"If-None-Match": @"\"v2\""});
+}
+
+#pragma mark - Benchmark
+
+// 加载 urls 中的每张图片，图片第一次下载之后每一轮都向服务器确认一次（图片没有变化，服务器返回 304）
+// usesURLCache 为 YES 时和以前一样借助 NSURLCache 刷新：NSURLCache 发送条件请求，图片在 NSURLCache 和 SDImageCache 中各存一份
+- (void)benchmarkRefreshingURLs:(NSArray<NSURL *> *)urls rounds:(NSUInteger)rounds usesURLCache:(BOOL)usesURLCache name:(NSString *)name {
+    NSString *directory = [self.temporaryDirectory stringByAppendingPathComponent:name];
+    SDImageCache *cache = [[SDImageCache alloc] initWithNamespace:@"revalidationBenchmark" diskCacheDirectory:directory];
+    cache.config.shouldCacheImagesInMemory = NO;
+    NSURLCache *URLCache = [[NSURLCache alloc] initWithMemoryCapacity:0 diskCapacity:1024 * 1024 * 1024 diskPath:[NSUUID UUID].UUIDString];
+    NSURLCache *sharedURLCache = [NSURLCache sharedURLCache];
+    SDWebImageDownloader *downloader = [[SDWebImageDownloader alloc] initWithSessionConfiguration:[SDTestURLProtocol sessionConfigurationWithURLCache:URLCache]];
+    downloader.resumeStore = nil;
+    SDWebImageManager *manager = [[SDWebImageManager alloc] initWithCache:cache downloader:downloader];
+    if (usesURLCache) {
+        // SDWebImageDownloaderIgnoreCachedResponse 从 sharedURLCache 读取缓存的数据做比较
+        [NSURLCache setSharedURLCache:URLCache];
+    }
+
+    NSTimeInterval start = SDTestNow();
+    for (NSUInteger round = 0; round <= rounds; round++) {
+        __block NSUInteger completedCount = 0;
+        for (NSURL *url in urls) {
+            if (usesURLCache) {
+                // 以前 SDWebImageRefreshCached 的做法
+                SDWebImageDownloaderOptions options = SDWebImageDownloaderUseNSURLCache;
+                if (round > 0) {
+                    options |= SDWebImageDownloaderIgnoreCachedResponse;
+                }
+                [downloader downloadImageWithURL:url options:options progress:nil completed:^(UIImage *image, NSData *data, NSError *error, BOOL finished) {
+                    XCTAssertNil(error);
+                    if (image) {
+                        [cache storeImage:image imageData:data forKey:[manager cacheKeyForURL:url] toDisk:YES completion:nil];
+                    }
+                    completedCount++;
+                }];
+            } else {
+                [manager loadImageWithURL:url options:SDWebImageRefreshCached progress:nil completed:^(UIImage *image, NSData *data, NSError *error, SDImageCacheType cacheType, BOOL finished, NSURL *imageURL) {
+                    XCTAssertNil(error);
+                }];
+            }
+        }
+        XCTAssertTrue([self waitForCondition:^BOOL{
+            return usesURLCache ? completedCount == urls.count : ![manager isRunning];
+        }]);
+        [cache flushDiskWrites];
+    }
+    NSTimeInterval elapsed = SDTestNow() - start;
+    // NSURLCache 在后台写入磁盘
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:1]];
+
+    [self reportBenchmark:[name stringByAppendingString:@" requests"] value:[SDTestURLProtocol requests].count unit:@""];
+    [self reportBenchmark:[name stringByAppendingString:@" SDImageCache disk usage"] value:[cache getSize] / 1e6 unit:@"MB"];
+    [self reportBenchmark:[name stringByAppendingString:@" NSURLCache disk usage"] value:URLCache.currentDiskUsage / 1e6 unit:@"MB"];
+    [self reportBenchmark:[name stringByAppendingString:@" total time"] value:elapsed * 1000 unit:@"ms"];
+
+    [NSURLCache setSharedURLCache:sharedURLCache];
+    [downloader invalidateSessionAndCancel:YES];
+    [URLCache removeAllCachedResponses];
+    [SDTestURLProtocol reset];
+}
+
+- (void)test06BytesOnTheWireAndDiskUsageBenchmark {
+    if (!SDTestBenchmarkEnabled()) {
+        return;
+    }
+    const NSUInteger imageCount = 40;
+    const NSUInteger rounds = 5;
+    NSMutableDictionary<NSURL *, NSData *> *imageDataByURL = [NSMutableDictionary dictionary];
+    for (NSUInteger i = 0; i < imageCount; i++) {
+        NSURL *url = [NSURL URLWithString:[NSString stringWithFormat:@"http://example.com/revalidate/%lu.png", (unsigned long)i]];
+        imageDataByURL[url] = [self PNGDataWithWidth:256 + i * 16 height:256 + i * 16];
+    }
+    NSUInteger imageBytes = [[imageDataByURL.allValues valueForKeyPath:@"@sum.length"] unsignedIntegerValue];
+    [self reportBenchmark:@"images" value:imageCount unit:@""];
+    [self reportBenchmark:@"image bytes" value:imageBytes / 1e6 unit:@"MB"];
+
+    for (NSNumber *usesURLCache in @[@YES, @NO]) {
+        __block unsigned long long wireBytes = 0;
+        [SDTestURLProtocol setHandler:^SDTestURLResponse *(NSURLRequest *request) {
+            SDTestURLResponse *response;
+            if ([[request valueForHTTPHeaderField:@"If-None-Match"] isEqualToString:@"\"v1\""]) {
+                response = [SDTestURLResponse responseWithData:nil];
+                response.statusCode = 304;
+            } else {
+                response = [SDTestURLResponse responseWithData:imageDataByURL[request.URL]];
+            }
+            // 每次都要向服务器确认
+            response.headerFields = @{@"ETag": @"\"v1\"", @"Cache-Control": @"no-cache"};
+            @synchronized (self) {
+                wireBytes += response.data.length;
+            }
+            return response;
+        }];
+        NSString *name = usesURLCache.boolValue ? @"NSURLCache" : @"SDImageCache validators";
+        [self benchmarkRefreshingURLs:imageDataByURL.allKeys rounds:rounds usesURLCache:usesURLCache.boolValue name:name];
+        [self reportBenchmark:[name stringByAppendingString:@" bytes on the wire"] value:wireBytes / 1e6 unit:@"MB"];
+        // 第一次下载之后都是 304
+        XCTAssertEqual(wireBytes, (unsigned long long)imageBytes);
+    }
+}
+
+@end
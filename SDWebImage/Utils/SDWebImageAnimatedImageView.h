@@ -0,0 +1,45 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+/*
+ 播放 SDWebImageAnimatedImage 的 UIImageView
+
+ 每次屏幕刷新时检查当前帧是否显示够了时间，下一帧从动图的缓冲区中取，还没解码好时停在当前帧等待，不会阻塞主线程。
+ 设置其他图片时和 UIImageView 一样。
+ */
+
+#import "SDWebImageCompat.h"
+
+#if SD_UIKIT
+
+#import "SDWebImageAnimatedImage.h"
+
+/**
+ * An image view playing `SDWebImageAnimatedImage` with the durations of each frame, other images are displayed like `UIImageView` does.
+ * The animation starts when an animated image is set while the view is in a window, and pauses when the view leaves the window.
+ */
+@interface SDWebImageAnimatedImageView : UIImageView
+
+/**
+ * The run loop mode of the display link driving the animation. Defaults to `NSRunLoopCommonModes`, so the animation continues while scrolling.
+ */
+@property (nonatomic, copy, nonnull) NSString *runLoopMode;
+
+/**
+ * The index of the displayed frame
+ */
+@property (nonatomic, assign, readonly) NSUInteger currentFrameIndex;
+
+/**
+ * The number of loops played so far
+ */
+@property (nonatomic, assign, readonly) NSUInteger currentLoopCount;
+
+@end
+
+#endif
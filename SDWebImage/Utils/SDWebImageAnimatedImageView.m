@@ -0,0 +1,188 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDWebImageAnimatedImageView.h"
+
+#if SD_UIKIT
+
+#import <QuartzCore/QuartzCore.h>
+
+@class SDWebImageAnimatedImageView;
+
+// CADisplayLink retains its target, the view is only weakly referenced
+@interface SDWebImageAnimatedImageViewTicker : NSObject {
+    @package
+    __weak SDWebImageAnimatedImageView *_view;
+}
+
+@end
+
+@interface SDWebImageAnimatedImageView ()
+
+- (void)displayDidRefresh:(CADisplayLink *)displayLink;
+
+@end
+
+@implementation SDWebImageAnimatedImageViewTicker
+
+- (void)step:(CADisplayLink *)displayLink {
+    SDWebImageAnimatedImageView *view = _view;
+    if (!view) {
+        [displayLink invalidate];
+        return;
+    }
+    [view displayDidRefresh:displayLink];
+}
+
+@end
+
+@implementation SDWebImageAnimatedImageView {
+    SDWebImageAnimatedImage *_animatedImage;
+    CADisplayLink *_displayLink;
+    // 当前帧已经显示的时间
+    NSTimeInterval _elapsedTime;
+    BOOL _animationFinished;
+}
+
+- (instancetype)initWithFrame:(CGRect)frame {
+    if ((self = [super initWithFrame:frame])) {
+        _runLoopMode = NSRunLoopCommonModes;
+    }
+    return self;
+}
+
+- (instancetype)initWithCoder:(NSCoder *)aDecoder {
+    if ((self = [super initWithCoder:aDecoder])) {
+        _runLoopMode = NSRunLoopCommonModes;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [_displayLink invalidate];
+}
+
+#pragma mark - Image
+
+- (UIImage *)image {
+    return _animatedImage ?: [super image];
+}
+
+- (void)setImage:(UIImage *)image {
+    if (image && image == _animatedImage) {
+        return;
+    }
+    [self stopAnimating];
+    _currentFrameIndex = 0;
+    _currentLoopCount = 0;
+    _elapsedTime = 0;
+    _animationFinished = NO;
+    if ([image isKindOfClass:[SDWebImageAnimatedImage class]]) {
+        _animatedImage = (SDWebImageAnimatedImage *)image;
+        // 动图本身就是第一帧
+        [super setImage:image];
+        if (self.window) {
+            [self startAnimating];
+        }
+    } else {
+        _animatedImage = nil;
+        [super setImage:image];
+    }
+}
+
+- (void)setRunLoopMode:(NSString *)runLoopMode {
+    if ([_runLoopMode isEqualToString:runLoopMode]) {
+        return;
+    }
+    if (_displayLink) {
+        [_displayLink removeFromRunLoop:[NSRunLoop mainRunLoop] forMode:_runLoopMode];
+        [_displayLink addToRunLoop:[NSRunLoop mainRunLoop] forMode:runLoopMode];
+    }
+    _runLoopMode = [runLoopMode copy];
+}
+
+#pragma mark - Animation
+
+- (void)startAnimating {
+    if (!_animatedImage) {
+        [super startAnimating];
+        return;
+    }
+    if (!_displayLink) {
+        SDWebImageAnimatedImageViewTicker *ticker = [SDWebImageAnimatedImageViewTicker new];
+        ticker->_view = self;
+        _displayLink = [CADisplayLink displayLinkWithTarget:ticker selector:@selector(step:)];
+        [_displayLink addToRunLoop:[NSRunLoop mainRunLoop] forMode:self.runLoopMode];
+    }
+    _animationFinished = NO;
+    // 提前开始解码下一帧
+    [_animatedImage bufferedAnimatedImageFrameAtIndex:(_currentFrameIndex + 1) % _animatedImage.animatedImageFrameCount];
+    _displayLink.paused = NO;
+}
+
+- (void)stopAnimating {
+    [super stopAnimating];
+    _displayLink.paused = YES;
+}
+
+- (BOOL)isAnimating {
+    if (!_animatedImage) {
+        return [super isAnimating];
+    }
+    return _displayLink && !_displayLink.paused;
+}
+
+- (void)didMoveToWindow {
+    [super didMoveToWindow];
+    if (!_animatedImage) {
+        return;
+    }
+    if (self.window && !_animationFinished) {
+        [self startAnimating];
+    } else if (!self.window) {
+        [self stopAnimating];
+    }
+}
+
+- (void)displayDidRefresh:(CADisplayLink *)displayLink {
+    SDWebImageAnimatedImage *image = _animatedImage;
+    if (!image) {
+        return;
+    }
+    NSTimeInterval duration = [image animatedImageDurationAtIndex:_currentFrameIndex];
+    _elapsedTime += displayLink.duration;
+    if (_elapsedTime < duration) {
+        return;
+    }
+    NSUInteger frameCount = image.animatedImageFrameCount;
+    NSUInteger nextIndex = (_currentFrameIndex + 1) % frameCount;
+    if (nextIndex == 0 && image.animatedImageLoopCount > 0 && _currentLoopCount + 1 >= image.animatedImageLoopCount) {
+        // 播放完指定的次数，停在最后一帧
+        _currentLoopCount++;
+        _animationFinished = YES;
+        [self stopAnimating];
+        return;
+    }
+    UIImage *nextFrame = [image bufferedAnimatedImageFrameAtIndex:nextIndex];
+    if (!nextFrame) {
+        // 下一帧还没有解码好，停在当前帧等待
+        _elapsedTime = duration;
+        return;
+    }
+    // 掉帧时不追赶，最多只前进一帧
+    _elapsedTime = MIN(_elapsedTime - duration, [image animatedImageDurationAtIndex:nextIndex]);
+    if (nextIndex == 0) {
+        _currentLoopCount++;
+    }
+    _currentFrameIndex = nextIndex;
+    [super setImage:nextFrame];
+}
+
+@end
+
+#endif
@@ -34,7 +34,9 @@ typedef NS_OPTIONS(NSUInteger, SDWebImageOptions) {
 
     /**有这么一个使用场景，如果一个图片的资源发生了改变，但是该图片的 URL 没有改变，就可以使用这个选项来刷新数据
      * Even if the image is cached, respect the HTTP response cache control, and refresh the image from remote location if needed.
-     * The disk caching will be handled by NSURLCache instead of SDWebImage leading to slight performance degradation.
+     * The cached image is revalidated with the `ETag` / `Last-Modified` stored with it on disk, and is not revalidated
+     * at all while it is fresh according to the `Cache-Control` / `Expires` it was downloaded with.
+     * A `304 Not Modified` answer keeps the cached image, the data is never stored a second time in NSURLCache.
      * This option helps deal with images changing behind the same request URL, e.g. Facebook graph api profile pics.
      * If a cached image is refreshed, the completion block is called once with the cached image and again with the final image.
      *
@@ -92,7 +94,13 @@ typedef NS_OPTIONS(NSUInteger, SDWebImageOptions) {
      * images to a size compatible with the constrained memory of devices.
      * If `SDWebImageProgressiveDownload` flag is set the scale down is deactivated.
      */
-    SDWebImageScaleDownLargeImages = 1 << 12
+    SDWebImageScaleDownLargeImages = 1 << 12,
+
+    /**预加载，下载只占用 `SDWebImageDownloader` 留给预加载的名额，不会让屏幕上的图片等待
+     * Download with the prefetch priority, within the `maxConcurrentPrefetchDownloads` slots of the downloader,
+     * so prefetching never delays on-screen images. `SDWebImagePrefetcher` always adds this flag.
+     */
+    SDWebImagePrefetchPriority = 1 << 13
 };
 
 typedef void(^SDExternalCompletionBlock)(UIImage * _Nullable image, NSError * _Nullable error, SDImageCacheType cacheType, NSURL * _Nullable imageURL);
@@ -185,6 +193,20 @@ SDWebImageManager *manager = [SDWebImageManager sharedManager];
  */
 @property (nonatomic, copy, nullable) SDWebImageCacheKeyFilterBlock cacheKeyFilter;
 
+/**
+ * 下载失败的 URL 多久之后可以重试，每次失败间隔加倍，最多一天
+ * A URL that failed to download is not downloaded again before this interval, in seconds, unless
+ * `SDWebImageRetryFailed` is set. The interval doubles on each failure of the same URL, up to a day.
+ * Defaults to 60. Set 0 to never retry failed URLs.
+ */
+@property (assign, nonatomic) NSTimeInterval failedURLRetryInterval;
+
+/**
+ * 最多记录多少个下载失败的 URL
+ * The maximum number of failed URLs remembered. Defaults to 1000. Set 0 for no limit.
+ */
+@property (assign, nonatomic) NSUInteger maxFailedURLCount;
+
 /**
  * Returns global SDWebImageManager instance.
  *
@@ -201,6 +223,10 @@ SDWebImageManager *manager = [SDWebImageManager sharedManager];
 /**
  * Downloads the image at the given URL if not present in cache or return the cached version otherwise.
  *
+ * Concurrent loads of URLs with the same cache key (see `cacheKeyFilter`) share one cache query, one download
+ * and one decode, unless their options change the result. Loads with `SDWebImageRefreshCached` are never shared.
+ * 缓存 key 相同的并发加载会合并
+ *
  * @param url            The URL to the image
  * @param options        A mask to specify options to use for this request
  * @param progressBlock  A block called while image is downloading
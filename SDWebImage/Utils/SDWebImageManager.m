@@ -18,9 +18,67 @@
 @property (copy, nonatomic, nullable) SDWebImageNoParamsBlock cancelBlock;
 //执行缓存的操作
 @property (strong, nonatomic, nullable) NSOperation *cacheOperation;
+//下载图片的 token 和请求的下载优先级，同一个 key 的加载合并后优先级取最高的
+@property (strong, nonatomic, nullable) SDWebImageDownloadToken *downloadToken;
+@property (assign, nonatomic) SDWebImageDownloaderPriority downloadPriority;
 
 @end
 
+// 等待同一个缓存 key 的加载结果的一个调用方
+@interface SDWebImageManagerLoadWaiter : NSObject {
+    @package
+    SDWebImageCombinedOperation *_operation;
+    NSURL *_url;
+    SDWebImageDownloaderPriority _priority;
+    SDWebImageDownloaderProgressBlock _progressBlock;
+    SDInternalCompletionBlock _completedBlock;
+}
+@end
+
+@implementation SDWebImageManagerLoadWaiter
+@end
+
+// 同一个缓存 key 正在进行的一次加载，key 相同的并发请求共用一次缓存查询、下载和解码
+@interface SDWebImageManagerLoadGroup : NSObject {
+    @package
+    NSString *_key;
+    // 实际加载的 URL，是某一个等待者请求的 URL
+    NSURL *_url;
+    SDWebImageOptions _options;
+    // 实际执行缓存查询和下载的 operation，所有等待者都取消时取消它
+    SDWebImageCombinedOperation *_operation;
+    NSMutableArray<SDWebImageManagerLoadWaiter *> *_waiters;
+}
+@end
+
+@implementation SDWebImageManagerLoadGroup
+@end
+
+// 下载失败的 URL，在重试时间之前不再下载。每次失败重试间隔加倍
+@interface SDWebImageFailedURLEntry : NSObject {
+    @package
+    NSUInteger _failureCount;
+    CFAbsoluteTime _retryTime;
+}
+@end
+
+@implementation SDWebImageFailedURLEntry
+@end
+
+// 不影响加载结果的选项，只有这些选项不同的请求可以合并
+static const SDWebImageOptions SDWebImageCoalescingIgnoredOptions = SDWebImageRetryFailed | SDWebImageLowPriority | SDWebImageHighPriority | SDWebImagePrefetchPriority | SDWebImageDelayPlaceholder | SDWebImageAvoidAutoSetImage;
+
+static SDWebImageDownloaderPriority SDWebImageManagerPriorityForOptions(SDWebImageOptions options) {
+    if (options & SDWebImagePrefetchPriority) {
+        return SDWebImageDownloaderPriorityPrefetch;
+    } else if (options & SDWebImageHighPriority) {
+        return SDWebImageDownloaderPriorityHigh;
+    } else if (options & SDWebImageLowPriority) {
+        return SDWebImageDownloaderPriorityLow;
+    }
+    return SDWebImageDownloaderPriorityNormal;
+}
+
 @interface SDWebImageManager ()
 
 
@@ -28,10 +86,15 @@
 @property (strong, nonatomic, readwrite, nonnull) SDImageCache *imageCache;
 //下载对象
 @property (strong, nonatomic, readwrite, nonnull) SDWebImageDownloader *imageDownloader;
-//集合存储所有下载失败的图片url
-@property (strong, nonatomic, nonnull) NSMutableSet<NSURL *> *failedURLs;
-//存储正在执行下载图片操作的数组
-@property (strong, nonatomic, nonnull) NSMutableArray<SDWebImageCombinedOperation *> *runningOperations;
+//下载失败的图片url，重试时间过后失效，数量有上限
+@property (strong, nonatomic, nonnull) NSMutableDictionary<NSURL *, SDWebImageFailedURLEntry *> *failedURLs;
+@property (strong, nonatomic, nonnull) dispatch_semaphore_t failedURLsLock;
+//正在执行的操作，添加和移除都是 O(1)
+@property (strong, nonatomic, nonnull) NSHashTable<SDWebImageCombinedOperation *> *runningOperations;
+@property (strong, nonatomic, nonnull) dispatch_semaphore_t runningOperationsLock;
+//每个缓存 key 正在进行的加载
+@property (strong, nonatomic, nonnull) NSMutableDictionary<NSString *, SDWebImageManagerLoadGroup *> *loadGroups;
+@property (strong, nonatomic, nonnull) dispatch_semaphore_t loadGroupsLock;
 
 
 
@@ -58,8 +121,14 @@
     if ((self = [super init])) {
         _imageCache = cache;
         _imageDownloader = downloader;
-        _failedURLs = [NSMutableSet new];
-        _runningOperations = [NSMutableArray new];
+        _failedURLs = [NSMutableDictionary new];
+        _failedURLsLock = dispatch_semaphore_create(1);
+        _failedURLRetryInterval = 60;
+        _maxFailedURLCount = 1000;
+        _runningOperations = [NSHashTable hashTableWithOptions:NSPointerFunctionsStrongMemory | NSPointerFunctionsObjectPointerPersonality];
+        _runningOperationsLock = dispatch_semaphore_create(1);
+        _loadGroups = [NSMutableDictionary new];
+        _loadGroupsLock = dispatch_semaphore_create(1);
     }
     return self;
 }
@@ -133,27 +202,96 @@
 //取消所有的下载操作
 
 - (void)cancelAll {
-    @synchronized (self.runningOperations) {
-        NSArray<SDWebImageCombinedOperation *> *copiedOperations = [self.runningOperations copy];
-        [copiedOperations makeObjectsPerformSelector:@selector(cancel)];
-        [self.runningOperations removeObjectsInArray:copiedOperations];
-    }
+    SD_LOCK(self.runningOperationsLock);
+    NSArray<SDWebImageCombinedOperation *> *copiedOperations = self.runningOperations.allObjects;
+    [self.runningOperations removeAllObjects];
+    SD_UNLOCK(self.runningOperationsLock);
+    // 在锁外取消，取消时会再次移除
+    [copiedOperations makeObjectsPerformSelector:@selector(cancel)];
 }
 //判断当前是否有下载图片
 
 - (BOOL)isRunning {
-    BOOL isRunning = NO;
-    @synchronized (self.runningOperations) {
-        isRunning = (self.runningOperations.count > 0);
-    }
+    SD_LOCK(self.runningOperationsLock);
+    BOOL isRunning = (self.runningOperations.count > 0);
+    SD_UNLOCK(self.runningOperationsLock);
     return isRunning;
 }
+
+- (void)safelyAddOperationToRunning:(nonnull SDWebImageCombinedOperation *)operation {
+    SD_LOCK(self.runningOperationsLock);
+    [self.runningOperations addObject:operation];
+    SD_UNLOCK(self.runningOperationsLock);
+}
+
 //线程安全的移除下载operation
 - (void)safelyRemoveOperationFromRunning:(nullable SDWebImageCombinedOperation*)operation {
-    @synchronized (self.runningOperations) {
-        if (operation) {
-            [self.runningOperations removeObject:operation];
+    if (!operation) {
+        return;
+    }
+    SD_LOCK(self.runningOperationsLock);
+    [self.runningOperations removeObject:operation];
+    SD_UNLOCK(self.runningOperationsLock);
+}
+
+#pragma mark - Failed URLs
+
+- (BOOL)isFailedURL:(nonnull NSURL *)url {
+    SD_LOCK(self.failedURLsLock);
+    SDWebImageFailedURLEntry *entry = self.failedURLs[url];
+    // 重试时间过后可以再次下载，记录保留到下载成功，再次失败时重试间隔加倍
+    BOOL failed = entry && entry->_retryTime > CFAbsoluteTimeGetCurrent();
+    SD_UNLOCK(self.failedURLsLock);
+    return failed;
+}
+
+- (void)recordFailedURL:(nonnull NSURL *)url {
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    SD_LOCK(self.failedURLsLock);
+    SDWebImageFailedURLEntry *entry = self.failedURLs[url];
+    if (!entry) {
+        if (self.maxFailedURLCount > 0 && self.failedURLs.count >= self.maxFailedURLCount) {
+            [self evictFailedURLsAtTime:now];
+        }
+        entry = [SDWebImageFailedURLEntry new];
+        self.failedURLs[url] = entry;
+    }
+    entry->_failureCount++;
+    NSTimeInterval interval = self.failedURLRetryInterval;
+    if (interval > 0) {
+        // 60s, 120s, 240s ... 最多一天
+        interval = MIN(ldexp(interval, (int)MIN(entry->_failureCount - 1, (NSUInteger)16)), MAX(interval, 24 * 60 * 60));
+        entry->_retryTime = now + interval;
+    } else {
+        // 不会过期，和原来一样只有 SDWebImageRetryFailed 才会重试
+        entry->_retryTime = DBL_MAX;
+    }
+    SD_UNLOCK(self.failedURLsLock);
+}
+
+- (void)removeFailedURL:(nonnull NSURL *)url {
+    SD_LOCK(self.failedURLsLock);
+    [self.failedURLs removeObjectForKey:url];
+    SD_UNLOCK(self.failedURLsLock);
+}
+
+// Make room for one more failed URL: drop the expired ones, or the one closest to its retry time. Must be called with the lock held
+- (void)evictFailedURLsAtTime:(CFAbsoluteTime)now {
+    __block NSURL *earliestURL = nil;
+    __block CFAbsoluteTime earliestRetryTime = DBL_MAX;
+    NSMutableArray<NSURL *> *expiredURLs = [NSMutableArray array];
+    [self.failedURLs enumerateKeysAndObjectsUsingBlock:^(NSURL *url, SDWebImageFailedURLEntry *entry, BOOL *stop) {
+        if (entry->_retryTime <= now) {
+            [expiredURLs addObject:url];
+        } else if (entry->_retryTime < earliestRetryTime) {
+            earliestRetryTime = entry->_retryTime;
+            earliestURL = url;
         }
+    }];
+    if (expiredURLs.count > 0) {
+        [self.failedURLs removeObjectsForKeys:expiredURLs];
+    } else if (earliestURL) {
+        [self.failedURLs removeObjectForKey:earliestURL];
     }
 }
 
@@ -213,14 +351,11 @@
         url = nil;
     }
     
-    __block SDWebImageCombinedOperation *operation = [SDWebImageCombinedOperation new];
-    __weak SDWebImageCombinedOperation *weakOperation = operation;
+    SDWebImageCombinedOperation *operation = [SDWebImageCombinedOperation new];
     
     BOOL isFailedUrl = NO;
     if (url) {
-        @synchronized (self.failedURLs) {
-            isFailedUrl = [self.failedURLs containsObject:url];
-        }
+        isFailedUrl = [self isFailedURL:url];
     }
     
     if (url.absoluteString.length == 0 || (!(options & SDWebImageRetryFailed) && isFailedUrl)) {
@@ -228,21 +363,226 @@
         return operation;
     }
     
-    @synchronized (self.runningOperations) {
-        [self.runningOperations addObject:operation];
-    }
+    [self safelyAddOperationToRunning:operation];
     NSString *key = [self cacheKeyForURL:url];
     
+    // 刷新缓存会回调两次，不和其他请求合并
+    if (key && !(options & SDWebImageRefreshCached)) {
+        [self joinLoadGroupForKey:key url:url options:options operation:operation progress:progressBlock completed:completedBlock];
+        return operation;
+    }
+    [self loadImageWithOperation:operation url:url key:key options:options progress:progressBlock completed:completedBlock];
+    return operation;
+}
+
+#pragma mark - Coalescing
+
+// 同一个缓存 key（比如签名不同但是 cacheKeyFilter 相同的 URL）的并发加载只查询一次缓存、下载和解码一次，结果分发给每个调用方
+- (void)joinLoadGroupForKey:(nonnull NSString *)key
+                        url:(nonnull NSURL *)url
+                    options:(SDWebImageOptions)options
+                  operation:(nonnull SDWebImageCombinedOperation *)operation
+                   progress:(nullable SDWebImageDownloaderProgressBlock)progressBlock
+                  completed:(nonnull SDInternalCompletionBlock)completedBlock {
+    SDWebImageManagerLoadWaiter *waiter = [SDWebImageManagerLoadWaiter new];
+    waiter->_operation = operation;
+    waiter->_url = url;
+    waiter->_priority = SDWebImageManagerPriorityForOptions(options);
+    waiter->_progressBlock = [progressBlock copy];
+    waiter->_completedBlock = [completedBlock copy];
+
+    SD_LOCK(self.loadGroupsLock);
+    SDWebImageManagerLoadGroup *group = self.loadGroups[key];
+    BOOL joined = group && (group->_options & ~SDWebImageCoalescingIgnoredOptions) == (options & ~SDWebImageCoalescingIgnoredOptions);
+    if (!joined) {
+        group = [self loadGroupForKey:key url:url options:options priority:waiter->_priority];
+        // 选项不同的加载单独进行，不登记
+        if (!self.loadGroups[key]) {
+            self.loadGroups[key] = group;
+        }
+    }
+    [group->_waiters addObject:waiter];
+    SD_UNLOCK(self.loadGroupsLock);
+
+    [self setCancelBlockForWaiter:waiter inLoadGroup:group];
+
+    if (joined) {
+        [self raiseDownloadPriority:waiter->_priority forOperation:group->_operation];
+        return;
+    }
+    [self startLoadGroup:group];
+}
+
+- (nonnull SDWebImageManagerLoadGroup *)loadGroupForKey:(nonnull NSString *)key url:(nonnull NSURL *)url options:(SDWebImageOptions)options priority:(SDWebImageDownloaderPriority)priority {
+    SDWebImageManagerLoadGroup *group = [SDWebImageManagerLoadGroup new];
+    group->_key = [key copy];
+    group->_url = url;
+    group->_options = options;
+    group->_operation = [SDWebImageCombinedOperation new];
+    group->_operation.downloadPriority = priority;
+    group->_waiters = [NSMutableArray array];
+    return group;
+}
+
+- (void)setCancelBlockForWaiter:(nonnull SDWebImageManagerLoadWaiter *)waiter inLoadGroup:(nonnull SDWebImageManagerLoadGroup *)group {
+    SDWebImageCombinedOperation *operation = waiter->_operation;
+    __weak SDWebImageCombinedOperation *weakOperation = operation;
+    __weak SDWebImageManagerLoadGroup *weakGroup = group;
+    @synchronized (operation) {
+        operation.cancelBlock = ^{
+            [self removeWaiterWithOperation:weakOperation fromLoadGroup:weakGroup];
+        };
+    }
+}
+
+- (void)startLoadGroup:(nonnull SDWebImageManagerLoadGroup *)group {
+    SDWebImageCombinedOperation *groupOperation = group->_operation;
+    [self safelyAddOperationToRunning:groupOperation];
+    SDWebImageDownloaderProgressBlock groupProgressBlock = ^(NSInteger receivedSize, NSInteger expectedSize, NSURL *targetURL) {
+        for (SDWebImageManagerLoadWaiter *groupWaiter in [self waitersOfLoadGroup:group]) {
+            if (groupWaiter->_progressBlock && !groupWaiter->_operation.isCancelled) {
+                groupWaiter->_progressBlock(receivedSize, expectedSize, targetURL);
+            }
+        }
+    };
+    SDInternalCompletionBlock groupCompletedBlock = ^(UIImage *image, NSData *data, NSError *error, SDImageCacheType cacheType, BOOL finished, NSURL *imageURL) {
+        NSArray<SDWebImageManagerLoadWaiter *> *waiters;
+        if (finished) {
+            waiters = [self finishLoadGroup:group];
+        } else {
+            waiters = [self waitersOfLoadGroup:group];
+        }
+        // 失败的只是加载的这个 URL（比如签名过期），请求其他 URL 的调用方换成自己的 URL 重新加载
+        NSMutableArray<SDWebImageManagerLoadWaiter *> *retryWaiters = nil;
+        if (finished && !image && error && error.code != NSURLErrorCancelled) {
+            for (SDWebImageManagerLoadWaiter *groupWaiter in waiters) {
+                if (!groupWaiter->_operation.isCancelled && ![groupWaiter->_url isEqual:group->_url]) {
+                    if (!retryWaiters) {
+                        retryWaiters = [NSMutableArray array];
+                    }
+                    [retryWaiters addObject:groupWaiter];
+                }
+            }
+        }
+        // 已经在主线程，每个调用方拿到的是自己请求的 URL
+        for (SDWebImageManagerLoadWaiter *groupWaiter in waiters) {
+            if (retryWaiters && [retryWaiters indexOfObjectIdenticalTo:groupWaiter] != NSNotFound) {
+                continue;
+            }
+            if (!groupWaiter->_operation.isCancelled) {
+                groupWaiter->_completedBlock(image, data, error, cacheType, finished, groupWaiter->_url);
+            }
+            if (finished) {
+                [self safelyRemoveOperationFromRunning:groupWaiter->_operation];
+            }
+        }
+        if (retryWaiters) {
+            [self retryLoadGroup:group withWaiters:retryWaiters];
+        }
+    };
+    [self loadImageWithOperation:groupOperation url:group->_url key:group->_key options:group->_options progress:groupProgressBlock completed:groupCompletedBlock];
+}
+
+// 用第一个等待者的 URL 重新加载。每次重试都去掉了请求失败的 URL 的等待者，所以重试次数不超过 URL 的个数
+- (void)retryLoadGroup:(nonnull SDWebImageManagerLoadGroup *)failedGroup withWaiters:(nonnull NSArray<SDWebImageManagerLoadWaiter *> *)waiters {
+    SDWebImageDownloaderPriority priority = SDWebImageDownloaderPriorityPrefetch;
+    for (SDWebImageManagerLoadWaiter *waiter in waiters) {
+        priority = MAX(priority, waiter->_priority);
+    }
+    SDWebImageManagerLoadWaiter *firstWaiter = waiters.firstObject;
+    SDWebImageManagerLoadGroup *group = [self loadGroupForKey:failedGroup->_key url:firstWaiter->_url options:failedGroup->_options priority:priority];
+    [group->_waiters addObjectsFromArray:waiters];
+    SD_LOCK(self.loadGroupsLock);
+    if (!self.loadGroups[group->_key]) {
+        self.loadGroups[group->_key] = group;
+    }
+    SD_UNLOCK(self.loadGroupsLock);
+    for (SDWebImageManagerLoadWaiter *waiter in waiters) {
+        [self setCancelBlockForWaiter:waiter inLoadGroup:group];
+    }
+    [self startLoadGroup:group];
+}
+
+- (nonnull NSArray<SDWebImageManagerLoadWaiter *> *)waitersOfLoadGroup:(nonnull SDWebImageManagerLoadGroup *)group {
+    SD_LOCK(self.loadGroupsLock);
+    NSArray<SDWebImageManagerLoadWaiter *> *waiters = [group->_waiters copy];
+    SD_UNLOCK(self.loadGroupsLock);
+    return waiters;
+}
+
+// 加载结束，之后同一个 key 的请求重新开始一次加载
+- (nonnull NSArray<SDWebImageManagerLoadWaiter *> *)finishLoadGroup:(nonnull SDWebImageManagerLoadGroup *)group {
+    SD_LOCK(self.loadGroupsLock);
+    NSArray<SDWebImageManagerLoadWaiter *> *waiters = [group->_waiters copy];
+    [group->_waiters removeAllObjects];
+    if (self.loadGroups[group->_key] == group) {
+        [self.loadGroups removeObjectForKey:group->_key];
+    }
+    SD_UNLOCK(self.loadGroupsLock);
+    return waiters;
+}
+
+- (void)removeWaiterWithOperation:(nullable SDWebImageCombinedOperation *)operation fromLoadGroup:(nullable SDWebImageManagerLoadGroup *)group {
+    [self safelyRemoveOperationFromRunning:operation];
+    if (!operation || !group) {
+        return;
+    }
+    BOOL empty = NO;
+    SD_LOCK(self.loadGroupsLock);
+    NSUInteger index = [group->_waiters indexOfObjectPassingTest:^BOOL(SDWebImageManagerLoadWaiter *waiter, NSUInteger idx, BOOL *stop) {
+        return waiter->_operation == operation;
+    }];
+    if (index != NSNotFound) {
+        [group->_waiters removeObjectAtIndex:index];
+        empty = group->_waiters.count == 0;
+        if (empty && self.loadGroups[group->_key] == group) {
+            [self.loadGroups removeObjectForKey:group->_key];
+        }
+    }
+    SD_UNLOCK(self.loadGroupsLock);
+    if (empty) {
+        // 没有调用方在等待了，取消缓存查询和下载。取消的缓存查询不会回调，需要在这里移除
+        [group->_operation cancel];
+        [self safelyRemoveOperationFromRunning:group->_operation];
+    }
+}
+
+- (void)raiseDownloadPriority:(SDWebImageDownloaderPriority)priority forOperation:(nonnull SDWebImageCombinedOperation *)operation {
+    SDWebImageDownloadToken *token = nil;
+    @synchronized (operation) {
+        if (priority <= operation.downloadPriority) {
+            return;
+        }
+        operation.downloadPriority = priority;
+        token = operation.downloadToken;
+    }
+    // 还在查询缓存时，开始下载时使用新的优先级
+    if (token) {
+        [self.imageDownloader setPriority:priority forToken:token];
+    }
+}
+
+#pragma mark - Loading
+
+- (void)loadImageWithOperation:(nonnull SDWebImageCombinedOperation *)operation
+                           url:(nonnull NSURL *)url
+                           key:(nullable NSString *)key
+                       options:(SDWebImageOptions)options
+                      progress:(nullable SDWebImageDownloaderProgressBlock)progressBlock
+                     completed:(nonnull SDInternalCompletionBlock)completedBlock {
+    __weak SDWebImageCombinedOperation *weakOperation = operation;
     operation.cacheOperation = [self.imageCache queryCacheOperationForKey:key done:^(UIImage *cachedImage, NSData *cachedData, SDImageCacheType cacheType) {
         if (operation.isCancelled) {
             [self safelyRemoveOperationFromRunning:operation];
             return;
         }
         
-        if ((!cachedImage || options & SDWebImageRefreshCached) && (![self.delegate respondsToSelector:@selector(imageManager:shouldDownloadImageForURL:)] || [self.delegate imageManager:self shouldDownloadImageForURL:url])) {
-            if (cachedImage && options & SDWebImageRefreshCached) {
+        // 磁盘缓存的图片按下载时响应的 Cache-Control / Expires 还没有过期时，不需要向服务器确认
+        BOOL shouldRefresh = (options & SDWebImageRefreshCached) && !(cachedImage && [self.imageCache isDiskImageFreshForKey:key]);
+        if ((!cachedImage || shouldRefresh) && (![self.delegate respondsToSelector:@selector(imageManager:shouldDownloadImageForURL:)] || [self.delegate imageManager:self shouldDownloadImageForURL:url])) {
+            if (cachedImage && shouldRefresh) {
                 // If image was found in the cache but SDWebImageRefreshCached is provided, notify about the cached image
-                // AND try to re-download it in order to let a chance to NSURLCache to refresh it from server.
+                // AND revalidate it with the server using the validators stored with it on disk.
                 [self callCompletionBlockForOperation:weakOperation completion:completedBlock image:cachedImage data:cachedData error:nil cacheType:cacheType finished:YES url:url];
             }
             
@@ -250,26 +590,32 @@
             SDWebImageDownloaderOptions downloaderOptions = 0;
             if (options & SDWebImageLowPriority) downloaderOptions |= SDWebImageDownloaderLowPriority;
             if (options & SDWebImageProgressiveDownload) downloaderOptions |= SDWebImageDownloaderProgressiveDownload;
-            if (options & SDWebImageRefreshCached) downloaderOptions |= SDWebImageDownloaderUseNSURLCache;
             if (options & SDWebImageContinueInBackground) downloaderOptions |= SDWebImageDownloaderContinueInBackground;
             if (options & SDWebImageHandleCookies) downloaderOptions |= SDWebImageDownloaderHandleCookies;
             if (options & SDWebImageAllowInvalidSSLCertificates) downloaderOptions |= SDWebImageDownloaderAllowInvalidSSLCertificates;
             if (options & SDWebImageHighPriority) downloaderOptions |= SDWebImageDownloaderHighPriority;
             if (options & SDWebImageScaleDownLargeImages) downloaderOptions |= SDWebImageDownloaderScaleDownLargeImages;
+            if (options & SDWebImagePrefetchPriority) downloaderOptions |= SDWebImageDownloaderPrefetchPriority;
             
-            if (cachedImage && options & SDWebImageRefreshCached) {
+            // 刷新缓存不再借助 NSURLCache（图片会在 NSURLCache 和 SDImageCache 中各存一份），
+            // 而是带上磁盘缓存保存的 ETag / Last-Modified 发送条件请求，服务器返回 304 时直接沿用磁盘缓存
+            NSDictionary<NSString *, NSString *> *requestHeaders = nil;
+            if (cachedImage && shouldRefresh) {
                 // force progressive off if image already cached but forced refreshing
                 downloaderOptions &= ~SDWebImageDownloaderProgressiveDownload;
-                // ignore image read from NSURLCache if image if cached but force refreshing
-                downloaderOptions |= SDWebImageDownloaderIgnoreCachedResponse;
+                requestHeaders = [self.imageCache conditionalRequestHeadersForKey:key];
             }
             
-            SDWebImageDownloadToken *subOperationToken = [self.imageDownloader downloadImageWithURL:url options:downloaderOptions progress:progressBlock completed:^(UIImage *downloadedImage, NSData *downloadedData, NSError *error, BOOL finished) {
+            __block SDWebImageDownloadToken *subOperationToken = nil;
+            subOperationToken = [self.imageDownloader downloadImageWithURL:url options:downloaderOptions requestHeaders:requestHeaders progress:progressBlock completed:^(UIImage *downloadedImage, NSData *downloadedData, NSError *error, BOOL finished) {
                 __strong __typeof(weakOperation) strongOperation = weakOperation;
                 if (!strongOperation || strongOperation.isCancelled) {
                     // Do nothing if the operation was cancelled
                     // See #699 for more details
                     // if we would call the completedBlock, there could be a race condition between this block and another completedBlock for the same object, so if this one is called second, we will overwrite the new data
+                } else if (cachedImage && shouldRefresh && [error.domain isEqualToString:NSURLErrorDomain] && error.code == 304) {
+                    // 304 Not Modified：缓存的图片已经通知过了，只更新它的有效期，不调用 completion block
+                    [self.imageCache refreshDiskImageForKey:key withNotModifiedResponse:subOperationToken.response];
                 } else if (error) {
                     [self callCompletionBlockForOperation:strongOperation completion:completedBlock error:error url:url];
                     
@@ -281,17 +627,11 @@
                         && error.code != NSURLErrorCannotFindHost
                         && error.code != NSURLErrorCannotConnectToHost
                         && error.code != NSURLErrorNetworkConnectionLost) {
-                        @synchronized (self.failedURLs) {
-                            [self.failedURLs addObject:url];
-                        }
+                        [self recordFailedURL:url];
                     }
                 }
                 else {
-                    if ((options & SDWebImageRetryFailed)) {
-                        @synchronized (self.failedURLs) {
-                            [self.failedURLs removeObject:url];
-                        }
-                    }
+                    [self removeFailedURL:url];
                     
                     BOOL cacheOnDisk = !(options & SDWebImageCacheMemoryOnly);
                     
@@ -300,8 +640,8 @@
                         downloadedImage = [self scaledImageForKey:key image:downloadedImage];
                     }
                     
-                    if (options & SDWebImageRefreshCached && cachedImage && !downloadedImage) {
-                        // Image refresh hit the NSURLCache cache, do not call the completion block
+                    if (shouldRefresh && cachedImage && !downloadedImage) {
+                        // Image refresh returned no new image, do not call the completion block
                     } else if (downloadedImage && (!downloadedImage.images || (options & SDWebImageTransformAnimatedImage)) && [self.delegate respondsToSelector:@selector(imageManager:transformDownloadedImage:withURL:)]) {
                         dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^{
                             UIImage *transformedImage = [self.delegate imageManager:self transformDownloadedImage:downloadedImage withURL:url];
@@ -309,14 +649,14 @@
                             if (transformedImage && finished) {
                                 BOOL imageWasTransformed = ![transformedImage isEqual:downloadedImage];
                                 // pass nil if the image was transformed, so we can recalculate the data from the image
-                                [self.imageCache storeImage:transformedImage imageData:(imageWasTransformed ? nil : downloadedData) forKey:key toDisk:cacheOnDisk completion:nil];
+                                [self.imageCache storeImage:transformedImage imageData:(imageWasTransformed ? nil : downloadedData) forKey:key response:subOperationToken.response toDisk:cacheOnDisk completion:nil];
                             }
                             
                             [self callCompletionBlockForOperation:strongOperation completion:completedBlock image:transformedImage data:downloadedData error:nil cacheType:SDImageCacheTypeNone finished:finished url:url];
                         });
                     } else {
                         if (downloadedImage && finished) {
-                            [self.imageCache storeImage:downloadedImage imageData:downloadedData forKey:key toDisk:cacheOnDisk completion:nil];
+                            [self.imageCache storeImage:downloadedImage imageData:downloadedData forKey:key response:subOperationToken.response toDisk:cacheOnDisk completion:nil];
                         }
                         [self callCompletionBlockForOperation:strongOperation completion:completedBlock image:downloadedImage data:downloadedData error:nil cacheType:SDImageCacheTypeNone finished:finished url:url];
                     }
@@ -327,6 +667,11 @@
                 }
             }];
             @synchronized(operation) {
+                operation.downloadToken = subOperationToken;
+                // 合并的请求在查询缓存时提升了优先级
+                if (operation.downloadPriority > SDWebImageManagerPriorityForOptions(options)) {
+                    [self.imageDownloader setPriority:operation.downloadPriority forToken:subOperationToken];
+                }
                 // Need same lock to ensure cancelBlock called because cancel method can be called in different queue
                 operation.cancelBlock = ^{
                     [self.imageDownloader cancel:subOperationToken];
@@ -345,8 +690,6 @@
             [self safelyRemoveOperationFromRunning:operation];
         }
     }];
-    
-    return operation;
 }
 
 
@@ -376,9 +719,7 @@
     BOOL isFailedUrl = NO;
     if (url) {
         //为了防止在多线程访问出现问题，创建互斥锁
-        @synchronized (self.failedURLs) {
-            isFailedUrl = [self.failedURLs containsObject:url];
-        }
+        isFailedUrl = [self isFailedURL:url];
     }
     //如果url为nil，或者没有设置失败url重新下载的配置且该url已经下载失败过，那么返回失败的回调
     if (url.absoluteString.length == 0 || (!(options & SDWebImageRetryFailed) && isFailedUrl)) {
@@ -386,9 +727,7 @@
         return operation;
     }
     //创建互斥锁，添加operation到数组中
-    @synchronized (self.runningOperations) {
-        [self.runningOperations addObject:operation];
-    }
+    [self safelyAddOperationToRunning:operation];
     NSString *key = [self cacheKeyForURL:url];
     //使用缓存对象，根据key去寻找查找
     operation.cacheOperation = [self.imageCache queryCacheOperationForKey:key done:^(UIImage *cachedImage, NSData *cachedData, SDImageCacheType cacheType) {
@@ -445,18 +784,12 @@
                         && error.code != NSURLErrorCannotConnectToHost
                         && error.code != NSURLErrorNetworkConnectionLost) {
                         //下载失败则添加图片url到failedURLs集合
-                        @synchronized (self.failedURLs) {
-                            [self.failedURLs addObject:url];
-                        }
+                        [self recordFailedURL:url];
                     }
                 }
                 else {
-                    //虽然下载失败，但是如果设置了可以重新下载失败的url则remove该url
-                    if ((options & SDWebImageRetryFailed)) {
-                        @synchronized (self.failedURLs) {
-                            [self.failedURLs removeObject:url];
-                        }
-                    }
+                    //下载成功，移除之前的失败记录
+                    [self removeFailedURL:url];
                     //是否需要缓存在磁盘
                     BOOL cacheOnDisk = !(options & SDWebImageCacheMemoryOnly);
                     
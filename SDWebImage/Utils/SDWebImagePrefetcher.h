@@ -52,6 +52,7 @@ typedef void(^SDWebImagePrefetcherCompletionBlock)(NSUInteger noOfFinishedUrls,
 /**
  * 在同一时间预取的 URL 的最大数目，默认是 3
  * Maximum number of URLs to prefetch at the same time. Defaults to 3.
+ * The downloader is shared with on-screen images and is not changed, see `-[SDWebImageDownloader maxConcurrentPrefetchDownloads]`.
  */
 @property (nonatomic, assign) NSUInteger maxConcurrentDownloads;
 
@@ -115,9 +116,59 @@ typedef void(^SDWebImagePrefetcherCompletionBlock)(NSUInteger noOfFinishedUrls,
            completed:(nullable SDWebImagePrefetcherCompletionBlock)completionBlock;
 
 /**
- * Remove and cancel queued list
+ * Remove and cancel queued list, and the windowed prefetching
  */
 - (void)cancelPrefetching;
 
+#pragma mark - Windowed prefetching
+
+/*
+ 窗口预取
+
+ 列表滚动时不停地用 prefetchURLs: 会每次从 0 开始并且取消上一批的下载。
+ 窗口预取只需要设置一次完整的 URL 列表（windowURLs），滚动时用 updateWindowWithVisibleRange:velocity: 告诉预取器当前可见的范围和滚动速度：
+ 在滚动方向上预取可见范围之后的一段 URL，滚得越快窗口越长；只取消离开窗口的下载，留在窗口里的下载继续进行。
+ */
+
+/**
+ * The ordered list of all the URLs the windowed prefetching can load, usually one per row of the list view.
+ * Setting a new list cancels the windowed loads of the URLs which are no longer in it.
+ */
+@property (copy, nonatomic, nullable) NSArray<NSURL *> *windowURLs;
+
+/**
+ * The number of URLs prefetched ahead of the visible range when the list does not move. Defaults to 4.
+ * 静止时在可见范围之后预取的数量
+ */
+@property (nonatomic, assign) NSUInteger minimumWindowLength;
+
+/**
+ * The maximum number of URLs prefetched ahead of the visible range, whatever the velocity. Defaults to 30.
+ */
+@property (nonatomic, assign) NSUInteger maximumWindowLength;
+
+/**
+ * The time, in seconds, of scrolling the window should cover: the window grows by `velocity * windowLookaheadTime` URLs. Defaults to 1.
+ * 窗口要覆盖的滚动时间，窗口长度 = minimumWindowLength + 速度 * windowLookaheadTime
+ */
+@property (nonatomic, assign) NSTimeInterval windowLookaheadTime;
+
+/**
+ * The maximum number of bytes the windowed loads may still have to receive. No new load is started above it, 0 means no limit. Defaults to 4 MB.
+ * The size of a download is known from its response, the windowed loads are also limited by `maxConcurrentDownloads`.
+ * 窗口预取还没收完的字节数上限，超过后不再开始新的下载
+ */
+@property (nonatomic, assign) NSUInteger maxWindowBytesInFlight;
+
+/**
+ * Move the prefetch window, call it when the list scrolls.
+ * The URLs ahead of the visible range in the scrolling direction are loaded nearest first with `SDWebImagePrefetchPriority`,
+ * the loads of the URLs which left the window and the visible range are canceled.
+ *
+ * @param visibleRange The indexes in `windowURLs` of the visible rows
+ * @param velocity     The scrolling velocity in rows per second, positive when the indexes increase
+ */
+- (void)updateWindowWithVisibleRange:(NSRange)visibleRange velocity:(CGFloat)velocity;
+
 
 @end
@@ -19,10 +19,19 @@
 @property (copy, nonatomic, nullable) SDWebImagePrefetcherCompletionBlock completionBlock;
 @property (copy, nonatomic, nullable) SDWebImagePrefetcherProgressBlock progressBlock;
 
+// 窗口预取的状态，由 windowLock 保护，进度回调在下载的队列中调用
+@property (strong, nonatomic, nonnull) dispatch_semaphore_t windowLock;
+@property (copy, nonatomic, nonnull) NSArray<NSURL *> *windowTargetURLs; // nearest first
+@property (strong, nonatomic, nonnull) NSMutableDictionary<NSURL *, id> *windowOperations; // NSNull until the load returns its operation
+@property (strong, nonatomic, nonnull) NSMutableDictionary<NSURL *, NSNumber *> *windowRemainingBytes;
+@property (strong, nonatomic, nonnull) NSMutableSet<NSURL *> *windowFinishedURLs;
+
 @end
 
 @implementation SDWebImagePrefetcher
 
+@synthesize windowURLs = _windowURLs;
+
 + (nonnull instancetype)sharedImagePrefetcher {
     static dispatch_once_t once;
     static id instance;
@@ -41,18 +50,21 @@
         _manager = manager;
         _options = SDWebImageLowPriority;
         _prefetcherQueue = dispatch_get_main_queue();
-        self.maxConcurrentDownloads = 3;
+        // 同时预取的数量只由预取的并行链数量决定，不再修改共用的 downloader 的 maxConcurrentDownloads
+        _maxConcurrentDownloads = 3;
+        _minimumWindowLength = 4;
+        _maximumWindowLength = 30;
+        _windowLookaheadTime = 1;
+        _maxWindowBytesInFlight = 4 * 1024 * 1024;
+        _windowLock = dispatch_semaphore_create(1);
+        _windowURLs = @[];
+        _windowTargetURLs = @[];
+        _windowOperations = [NSMutableDictionary new];
+        _windowRemainingBytes = [NSMutableDictionary new];
+        _windowFinishedURLs = [NSMutableSet new];
     }
     return self;
 }
-
-- (void)setMaxConcurrentDownloads:(NSUInteger)maxConcurrentDownloads {
-    self.manager.imageDownloader.maxConcurrentDownloads = maxConcurrentDownloads;
-}
-
-- (NSUInteger)maxConcurrentDownloads {
-    return self.manager.imageDownloader.maxConcurrentDownloads;
-}
 //调用该方法后，所有的未完成的下载都会被清空，也就说现在 SDWebImagePrefetcher 只专注处理传进来的 NSURL 的数组，
 //是无状态的下载，也就是要求传入的 NSURL 要完整。然后循环去调用下载方法。
 
@@ -65,7 +77,8 @@
         currentURL = self.prefetchURLs[index];
         self.requestedCount++;
     }
-    [self.manager loadImageWithURL:currentURL options:self.options progress:nil completed:^(UIImage *image, NSData *data, NSError *error, SDImageCacheType cacheType, BOOL finished, NSURL *imageURL) {
+    //预取的下载只占用 downloader 留给预加载的名额
+    [self.manager loadImageWithURL:currentURL options:self.options | SDWebImagePrefetchPriority progress:nil completed:^(UIImage *image, NSData *data, NSError *error, SDImageCacheType cacheType, BOOL finished, NSURL *imageURL) {
         if (!finished) return;
         self.finishedCount++;
 
@@ -143,7 +156,177 @@
         self.requestedCount = 0;
         self.finishedCount = 0;
     }
+    // cancelAll 也取消了窗口预取的下载，被取消的下载不会回调，清空窗口的状态
+    SD_LOCK(self.windowLock);
+    self.windowTargetURLs = @[];
+    [self.windowOperations removeAllObjects];
+    [self.windowRemainingBytes removeAllObjects];
+    SD_UNLOCK(self.windowLock);
     [self.manager cancelAll];
 }
 
+#pragma mark - Windowed prefetching
+
+- (NSArray<NSURL *> *)windowURLs {
+    SD_LOCK(self.windowLock);
+    NSArray<NSURL *> *urls = _windowURLs;
+    SD_UNLOCK(self.windowLock);
+    return urls;
+}
+
+- (void)setWindowURLs:(NSArray<NSURL *> *)windowURLs {
+    NSArray<NSURL *> *urls = windowURLs ? [windowURLs copy] : @[];
+    NSSet<NSURL *> *keptURLs = [NSSet setWithArray:urls];
+    SD_LOCK(self.windowLock);
+    _windowURLs = urls;
+    self.windowTargetURLs = @[];
+    // 已经预取完的 URL 只对同一个列表有意义
+    [self.windowFinishedURLs intersectSet:keptURLs];
+    NSArray *operations = [self removeWindowOperationsNotInURLs:keptURLs];
+    SD_UNLOCK(self.windowLock);
+    for (id<SDWebImageOperation> operation in operations) {
+        [operation cancel];
+    }
+}
+
+- (void)updateWindowWithVisibleRange:(NSRange)visibleRange velocity:(CGFloat)velocity {
+    SD_LOCK(self.windowLock);
+    NSArray<NSURL *> *urls = _windowURLs;
+    NSUInteger count = urls.count;
+    NSUInteger location = MIN(visibleRange.location, count);
+    NSUInteger end = MIN(NSMaxRange(visibleRange), count);
+    // 窗口长度随速度增长
+    double speed = isfinite(velocity) ? fabs((double)velocity) : 0;
+    double length = (double)self.minimumWindowLength + speed * MAX(self.windowLookaheadTime, 0);
+    NSUInteger windowLength = (NSUInteger)MIN(length, (double)self.maximumWindowLength);
+
+    NSMutableArray<NSURL *> *targetURLs = [NSMutableArray arrayWithCapacity:windowLength];
+    if (velocity > 0) {
+        for (NSUInteger i = end; i < count && i - end < windowLength; i++) {
+            [targetURLs addObject:urls[i]];
+        }
+    } else if (velocity < 0) {
+        for (NSUInteger i = location; i > 0 && location - i < windowLength; i--) {
+            [targetURLs addObject:urls[i - 1]];
+        }
+    } else {
+        // 静止时不知道下一次往哪边滚，两边交替，近的先预取
+        for (NSUInteger i = 0; i < windowLength; i++) {
+            BOOL forward = (i % 2 == 0);
+            NSUInteger distance = i / 2;
+            if (forward && end + distance < count) {
+                [targetURLs addObject:urls[end + distance]];
+            } else if (!forward && distance < location) {
+                [targetURLs addObject:urls[location - distance - 1]];
+            }
+        }
+    }
+    self.windowTargetURLs = targetURLs;
+
+    // 可见范围内的下载也保留，界面上的加载会合并到这些下载上
+    NSMutableSet<NSURL *> *keptURLs = [NSMutableSet setWithArray:targetURLs];
+    if (end > location) {
+        [keptURLs addObjectsFromArray:[urls subarrayWithRange:NSMakeRange(location, end - location)]];
+    }
+    NSArray *operations = [self removeWindowOperationsNotInURLs:keptURLs];
+    SD_UNLOCK(self.windowLock);
+
+    for (id<SDWebImageOperation> operation in operations) {
+        [operation cancel];
+    }
+    [self startWindowLoads];
+}
+
+// Must be called inside the windowLock, the returned operations should be canceled outside of it
+- (NSArray<id<SDWebImageOperation>> *)removeWindowOperationsNotInURLs:(NSSet<NSURL *> *)keptURLs {
+    NSMutableArray<id<SDWebImageOperation>> *operations = [NSMutableArray array];
+    for (NSURL *url in self.windowOperations.allKeys) {
+        if ([keptURLs containsObject:url]) {
+            continue;
+        }
+        id operation = self.windowOperations[url];
+        if (operation != [NSNull null]) {
+            [operations addObject:operation];
+        }
+        [self.windowOperations removeObjectForKey:url];
+        [self.windowRemainingBytes removeObjectForKey:url];
+    }
+    return operations;
+}
+
+// 按从近到远的顺序开始窗口里还没有预取的 URL，直到达到并发数或者字节数上限
+- (void)startWindowLoads {
+    NSMutableArray<NSURL *> *startURLs = [NSMutableArray array];
+    SD_LOCK(self.windowLock);
+    NSUInteger bytesInFlight = 0;
+    for (NSNumber *remainingBytes in self.windowRemainingBytes.allValues) {
+        bytesInFlight += remainingBytes.unsignedIntegerValue;
+    }
+    for (NSURL *url in self.windowTargetURLs) {
+        if (self.windowOperations.count >= self.maxConcurrentDownloads) {
+            break;
+        }
+        if (self.maxWindowBytesInFlight > 0 && bytesInFlight >= self.maxWindowBytesInFlight) {
+            break;
+        }
+        if (self.windowOperations[url] || [self.windowFinishedURLs containsObject:url]) {
+            continue;
+        }
+        // 先占位，防止同时调用时重复开始
+        self.windowOperations[url] = [NSNull null];
+        [startURLs addObject:url];
+    }
+    SD_UNLOCK(self.windowLock);
+
+    for (NSURL *url in startURLs) {
+        [self startWindowLoadWithURL:url];
+    }
+}
+
+- (void)startWindowLoadWithURL:(NSURL *)url {
+    __weak typeof(self) wself = self;
+    id<SDWebImageOperation> operation = [self.manager loadImageWithURL:url options:self.options | SDWebImagePrefetchPriority progress:^(NSInteger receivedSize, NSInteger expectedSize, NSURL * _Nullable targetURL) {
+        __strong typeof(wself) sself = wself;
+        if (!sself || expectedSize <= 0) {
+            return;
+        }
+        SD_LOCK(sself.windowLock);
+        if (sself.windowOperations[url]) {
+            sself.windowRemainingBytes[url] = @((NSUInteger)MAX(expectedSize - receivedSize, 0));
+        }
+        SD_UNLOCK(sself.windowLock);
+    } completed:^(UIImage *image, NSData *data, NSError *error, SDImageCacheType cacheType, BOOL finished, NSURL *imageURL) {
+        __strong typeof(wself) sself = wself;
+        if (!sself || !finished) {
+            return;
+        }
+        SD_LOCK(sself.windowLock);
+        BOOL wasRunning = sself.windowOperations[url] != nil;
+        [sself.windowOperations removeObjectForKey:url];
+        [sself.windowRemainingBytes removeObjectForKey:url];
+        // 失败的 URL 由 manager 的 failedURLs 决定什么时候重试，这里同样不再预取
+        if (wasRunning) {
+            [sself.windowFinishedURLs addObject:url];
+        }
+        SD_UNLOCK(sself.windowLock);
+        if (wasRunning) {
+            // 缓存命中时会同步回调，异步开始下一个避免递归
+            dispatch_async(sself.prefetcherQueue, ^{
+                [sself startWindowLoads];
+            });
+        }
+    }];
+
+    SD_LOCK(self.windowLock);
+    BOOL reserved = self.windowOperations[url] == [NSNull null];
+    if (reserved) {
+        self.windowOperations[url] = operation;
+    }
+    SD_UNLOCK(self.windowLock);
+    // 开始之前窗口已经移走了，或者已经完成
+    if (!reserved) {
+        [operation cancel];
+    }
+}
+
 @end